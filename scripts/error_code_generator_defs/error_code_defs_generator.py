@@ -150,6 +150,8 @@ static inline ADUC_Result_t MAKE_ADUC_DELIVERY_OPTIMIZATION_EXTENDEDRESULTCODE(c
 
 #define ADUC_ERROR_CURL_DOWNLOADER_EXTERNAL_FAILURE(exitCode) MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONTENT_DOWNLOADER_CURL_DOWNLOADER((0x1000 + exitCode))
 
+#define ADUC_ERROR_LIBCURL_DOWNLOADER_CURL_FAILURE(curlCode) MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONTENT_DOWNLOADER_LIBCURL_DOWNLOADER((0x1000 + curlCode))
+
 #endif // ADUC_RESULT_H
 """
 
@@ -10,6 +10,8 @@
 #include "aduc/logging.h"
 #include "adushell_action.hpp"
 
+#include <aducpal/unistd.h> // getegid, geteuid
+
 #include <functional>
 #include <string>
 #include <vector>
@@ -30,6 +32,9 @@ typedef struct tagADUShell_LaunchArguments
     char* logFile; /**< Custom log file path */
     bool showVersion; /**< Show an agent version */
     const char* configFolder; /**< Custom config folder. Default is /etc/adu */
+    bool brokerMode; /**< Serve tasks from the configured broker socket instead of running one task */
+    std::function<void(const std::string& line)>
+        outputLineSink; /**< Optional. Receives each line of task output as it is written, for broker clients */
 } ADUShell_LaunchArguments;
 
 /**
@@ -76,4 +81,35 @@ private:
 
 using ADUShellTaskFuncType = std::function<ADUShellTaskResult(const ADUShell_LaunchArguments&)>;
 
+/**
+ * @brief Parse command-line arguments.
+ * @remark Not thread-safe, as it uses getopt_long.
+ * @param argc arguments count.
+ * @param argv arguments array.
+ * @param launchArgs a struct to store the parsed arguments.
+ *
+ * @return 0 if succeeded.
+ */
+int ParseLaunchArguments(const int argc, char** argv, ADUShell_LaunchArguments* launchArgs);
+
+/**
+ * @brief Runs the task for the update type and action in @p launchArgs.
+ *
+ * @param launchArgs The parsed launch arguments.
+ * @return int The exit status of the task.
+ */
+int ADUShell_Dowork(const ADUShell_LaunchArguments& launchArgs);
+
+/**
+ * @brief Checks whether a user may run adu-shell tasks.
+ * @remark This function is not thread-safe if called with the defaults for the optional args.
+ * @param geteuidFunc Optional. The function for getting the user id to check. Default is geteuid.
+ * @param getegidFunc Optional. The function for getting the group id to check. Default is getegid.
+ *
+ * @return true if the user is one of the adu shell trusted users, or is in the trusted group.
+ */
+bool ADUShell_PermissionCheck(
+    const std::function<uid_t()>& geteuidFunc = ADUCPAL_geteuid,
+    const std::function<gid_t()>& getegidFunc = ADUCPAL_getegid);
+
 #endif // ADU_SHELL_HPP
@@ -0,0 +1,28 @@
+/**
+ * @file adushell_broker.hpp
+ * @brief Private header for the long-lived adu-shell broker, started with 'adu-shell --broker'.
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADU_SHELL_BROKER_HPP
+#define ADU_SHELL_BROKER_HPP
+
+#include "aduc/config_utils.h"
+
+/**
+ * @brief The most tasks the broker runs at the same time. Further connections wait until a task completes.
+ */
+#define ADUSHELL_BROKER_MAX_CONCURRENT_TASKS 4
+
+/**
+ * @brief Serves adu-shell tasks on the aduShellBrokerSocketPath socket until SIGINT or SIGTERM.
+ * @details Each connection is authenticated with its peer credentials, against the same trusted users and group
+ * as a launched adu-shell, and its task runs on a thread of its own. After a stop signal, no more connections are
+ * accepted, and running tasks complete before this returns.
+ *
+ * @param config The configuration, which must have aduShellBrokerSocketPath.
+ * @return int The process exit code.
+ */
+int ADUShellBroker_Run(const ADUC_ConfigInfo* config);
+
+#endif // ADU_SHELL_BROKER_HPP
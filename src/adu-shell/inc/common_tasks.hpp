@@ -19,6 +19,23 @@ namespace Tasks
 {
 namespace Common
 {
+/**
+ * @brief Runs a child process for a task.
+ * @details When the task was sent by an adu-shell broker client, each line of output is also passed to
+ * launchArgs.outputLineSink as soon as it is written, so that the client sees it while the task runs.
+ *
+ * @param launchArgs The adu-shell launch command-line arguments that has been parsed.
+ * @param command Name of a command to run, searched for in PATH when it doesn't contain '/'.
+ * @param args List of arguments for the command.
+ * @param output The standard output and standard error of the command.
+ * @return An exit code from the command.
+ */
+int LaunchChildProcess(
+    const ADUShell_LaunchArguments& launchArgs,
+    const std::string& command,
+    const std::vector<std::string>& args,
+    std::string& output);
+
 /**
  * @brief Reboot the system.
  *
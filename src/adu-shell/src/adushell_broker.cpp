@@ -0,0 +1,321 @@
+/**
+ * @file adushell_broker.cpp
+ * @brief Implements the long-lived adu-shell broker, which runs tasks sent by the agent over a Unix domain socket.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "adushell_broker.hpp"
+#include "aduc/adushell_broker_utils.hpp"
+#include "aduc/logging.h"
+#include "aduc/string_c_utils.h" // IsNullOrEmpty
+#include "adushell.hpp"
+
+#include <aducpal/grp.h> // getgrnam
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <getopt.h> // optind
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h> // chmod
+#include <sys/time.h> // timeval
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * @brief Set by SIGINT and SIGTERM to stop accepting connections.
+ */
+static volatile sig_atomic_t s_stop_requested = 0;
+
+/**
+ * @brief Serializes ParseLaunchArguments, as getopt_long keeps its state in globals.
+ */
+static std::mutex s_parse_mutex;
+
+/**
+ * @brief How long a client may take to send its request, or to read a frame of output, before it is dropped.
+ */
+static const time_t BrokerClientTimeoutSeconds = 10;
+
+/**
+ * @brief How often the broker checks for a stop signal while it waits for connections.
+ */
+static const int BrokerPollIntervalMilliseconds = 500;
+
+/**
+ * @brief A task running on a thread of its own.
+ */
+struct BrokerTask
+{
+    std::thread thread; /**< The thread that serves the connection. */
+    std::shared_ptr<std::atomic<bool>> done; /**< Set by the thread when it is about to exit. */
+};
+
+static void OnBrokerSignal(int /*sig*/)
+{
+    s_stop_requested = 1;
+}
+
+/**
+ * @brief Joins the threads of completed tasks, or of all tasks when @p all is true.
+ */
+static void ReapTasks(std::list<BrokerTask>& tasks, bool all)
+{
+    for (auto it = tasks.begin(); it != tasks.end();)
+    {
+        if (all || it->done->load())
+        {
+            it->thread.join();
+            it = tasks.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+/**
+ * @brief Reads the request of an authenticated connection, runs its task and sends back the output and exit status.
+ *
+ * @param fd The connection, which is closed before this returns.
+ */
+static void ServeConnection(int fd)
+{
+    int exitStatus = EXIT_FAILURE;
+    int ret = -1;
+    ADUShellBrokerFrameType type = ADUShellBrokerFrameType::Exit;
+    std::string payload;
+    std::vector<std::string> args;
+    std::vector<char*> argv;
+    ADUShell_LaunchArguments launchArgs;
+    bool clientConnected = true;
+
+    // A client that stalls must not hold a task slot, or block a task on its output.
+    struct timeval timeout = { BrokerClientTimeoutSeconds, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    if (!ADUShellBroker_ReadFrame(fd, &type, payload) || type != ADUShellBrokerFrameType::Request)
+    {
+        Log_Error("Invalid adu-shell broker request.");
+        goto done;
+    }
+
+    ADUShellBroker_DecodeArgs(payload, args);
+
+    argv.reserve(args.size() + 2);
+    argv.emplace_back(const_cast<char*>("adu-shell")); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+    for (std::string& arg : args)
+    {
+        argv.emplace_back(&arg[0]);
+    }
+    argv.emplace_back(nullptr);
+
+    {
+        std::lock_guard<std::mutex> lock{ s_parse_mutex };
+
+        // Start getopt_long over, as each request is parsed like a new command line.
+        optind = 0;
+        ret = ParseLaunchArguments(static_cast<int>(argv.size() - 1), argv.data(), &launchArgs);
+    }
+
+    if (ret != 0 || launchArgs.brokerMode || launchArgs.showVersion)
+    {
+        Log_Error("Invalid adu-shell broker request arguments.");
+        goto done;
+    }
+
+    launchArgs.outputLineSink = [fd, &clientConnected](const std::string& line) {
+        if (clientConnected
+            && !ADUShellBroker_WriteFrame(fd, ADUShellBrokerFrameType::Output, line.data(), line.size()))
+        {
+            // The task keeps running; only the rest of its output is not sent.
+            Log_Warn("adu-shell broker client stopped reading task output, error %d", errno);
+            clientConnected = false;
+        }
+    };
+
+    Log_Info("Running broker task. Update type: %s, action: %s", launchArgs.updateType, launchArgs.updateAction);
+
+    exitStatus = ADUShell_Dowork(launchArgs);
+
+    Log_Info("Broker task exited with %d.", exitStatus);
+
+done:
+    if (clientConnected)
+    {
+        ADUShellBroker_WriteExitFrame(fd, exitStatus);
+    }
+
+    close(fd);
+}
+
+/**
+ * @brief Serves adu-shell tasks on the aduShellBrokerSocketPath socket until SIGINT or SIGTERM.
+ *
+ * @param config The configuration, which must have aduShellBrokerSocketPath.
+ * @return int The process exit code.
+ */
+int ADUShellBroker_Run(const ADUC_ConfigInfo* config)
+{
+    int ret = EXIT_FAILURE;
+    int listenFd = -1;
+    bool socketBound = false;
+    struct sockaddr_un address = {};
+    struct sigaction action = {};
+    const struct group* aduGroup = nullptr;
+    std::list<BrokerTask> tasks;
+    const char* socketPath = config->aduShellBrokerSocketPath;
+
+    if (IsNullOrEmpty(socketPath))
+    {
+        Log_Error("adu-shell broker needs aduShellBrokerSocketPath in du-config.json.");
+        goto done;
+    }
+
+    if (strlen(socketPath) >= sizeof(address.sun_path))
+    {
+        Log_Error("adu-shell broker socket path '%s' is too long.", socketPath);
+        goto done;
+    }
+
+    // Without SA_RESTART, so that a stop signal interrupts the wait for connections.
+    action.sa_handler = OnBrokerSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0)
+    {
+        Log_Error("Cannot create adu-shell broker socket, error %d", errno);
+        goto done;
+    }
+
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+
+    // A socket left behind by a broker that did not stop cleanly would make bind fail.
+    unlink(socketPath);
+
+    if (bind(listenFd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        Log_Error("Cannot bind adu-shell broker socket '%s', error %d", socketPath, errno);
+        goto done;
+    }
+
+    socketBound = true;
+
+    // Only root and the adu-shell group can connect; each connection's peer credentials are checked on top of that.
+    aduGroup = ADUCPAL_getgrnam(ADUSHELL_EFFECTIVE_GROUP_NAME);
+    if (aduGroup == nullptr || chown(socketPath, 0, aduGroup->gr_gid) != 0 || chmod(socketPath, 0660) != 0)
+    {
+        Log_Error(
+            "Cannot restrict adu-shell broker socket '%s' to the %s group.",
+            socketPath,
+            ADUSHELL_EFFECTIVE_GROUP_NAME);
+        goto done;
+    }
+
+    if (listen(listenFd, SOMAXCONN) != 0)
+    {
+        Log_Error("Cannot listen on adu-shell broker socket '%s', error %d", socketPath, errno);
+        goto done;
+    }
+
+    Log_Info("adu-shell broker is listening on '%s'.", socketPath);
+
+    while (s_stop_requested == 0)
+    {
+        ReapTasks(tasks, false);
+
+        if (tasks.size() >= ADUSHELL_BROKER_MAX_CONCURRENT_TASKS)
+        {
+            // Leave further connections in the backlog until a task completes.
+            poll(nullptr, 0, BrokerPollIntervalMilliseconds / 5);
+            continue;
+        }
+
+        struct pollfd listenPollFd = { listenFd, POLLIN, 0 };
+        const int ready = poll(&listenPollFd, 1, BrokerPollIntervalMilliseconds);
+        if (ready < 0 && errno != EINTR)
+        {
+            Log_Error("Cannot wait for adu-shell broker connections, error %d", errno);
+            break;
+        }
+
+        if (ready <= 0)
+        {
+            continue;
+        }
+
+        const int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno != EINTR && errno != ECONNABORTED)
+            {
+                Log_Warn("Cannot accept adu-shell broker connection, error %d", errno);
+            }
+            continue;
+        }
+
+        uid_t peerUid = 0;
+        gid_t peerGid = 0;
+        if (!ADUShellBroker_GetPeerCredentials(fd, &peerUid, &peerGid)
+            || !ADUShell_PermissionCheck([peerUid]() { return peerUid; }, [peerGid]() { return peerGid; }))
+        {
+            Log_Warn(
+                "Rejected adu-shell broker connection from uid %d, gid %d.",
+                static_cast<int>(peerUid),
+                static_cast<int>(peerGid));
+            close(fd);
+            continue;
+        }
+
+        auto taskDone = std::make_shared<std::atomic<bool>>(false);
+        try
+        {
+            std::thread thread{ [fd, taskDone]() {
+                ServeConnection(fd);
+                taskDone->store(true);
+            } };
+            tasks.push_back(BrokerTask{ std::move(thread), taskDone });
+        }
+        catch (const std::system_error& e)
+        {
+            Log_Error("Cannot start adu-shell broker task thread: %s", e.what());
+            close(fd);
+        }
+    }
+
+    Log_Info("adu-shell broker is stopping after %zu running tasks complete.", tasks.size());
+    ReapTasks(tasks, true);
+
+    ret = EXIT_SUCCESS;
+
+done:
+    if (listenFd >= 0)
+    {
+        close(listenFd);
+    }
+
+    if (socketBound)
+    {
+        unlink(socketPath);
+    }
+
+    return ret;
+}
@@ -153,12 +153,12 @@ void AddPackagesToArgs(const std::string& targetData, std::vector<std::string>*
  *
  * @return A result from child process.
  */
-ADUShellTaskResult Update(const ADUShell_LaunchArguments& /*launchArgs*/)
+ADUShellTaskResult Update(const ADUShell_LaunchArguments& launchArgs)
 {
     ADUShellTaskResult taskResult;
 
     const std::vector<std::string> aptArgs = { apt_option_update };
-    taskResult.SetExitStatus(ADUC_LaunchChildProcess(aptget_command, aptArgs, taskResult.Output()));
+    taskResult.SetExitStatus(Common::LaunchChildProcess(launchArgs, aptget_command, aptArgs, taskResult.Output()));
     if (taskResult.ExitStatus() != 0)
     {
         Log_Warn("apt-get update failed. (Exit code: %d)", taskResult.ExitStatus());
@@ -199,7 +199,7 @@ ADUShellTaskResult Download(const ADUShell_LaunchArguments& launchArgs)
         return taskResult;
     }
 
-    taskResult.SetExitStatus(ADUC_LaunchChildProcess(aptget_command, aptArgs, taskResult.Output()));
+    taskResult.SetExitStatus(Common::LaunchChildProcess(launchArgs, aptget_command, aptArgs, taskResult.Output()));
     return taskResult;
 }
 
@@ -233,7 +233,7 @@ ADUShellTaskResult Install(const ADUShell_LaunchArguments& launchArgs)
         return taskResult;
     }
 
-    int ret = ADUC_LaunchChildProcess(aptget_command, aptArgs, taskResult.Output());
+    int ret = Common::LaunchChildProcess(launchArgs, aptget_command, aptArgs, taskResult.Output());
 
     taskResult.SetExitStatus(ret);
     return taskResult;
@@ -269,7 +269,7 @@ ADUShellTaskResult Remove(const ADUShell_LaunchArguments& launchArgs)
         return taskResult;
     }
 
-    taskResult.SetExitStatus(ADUC_LaunchChildProcess(aptget_command, aptArgs, taskResult.Output()));
+    taskResult.SetExitStatus(Common::LaunchChildProcess(launchArgs, aptget_command, aptArgs, taskResult.Output()));
     return taskResult;
 }
 
@@ -282,11 +282,11 @@ ADUShellTaskResult Remove(const ADUShell_LaunchArguments& launchArgs)
  * @param launchArgs An adu-shell launch arguments.
  * @return A result from child process.
  */
-ADUShellTaskResult RemoveUnusedDependencies(const ADUShell_LaunchArguments& /*launchArgs*/)
+ADUShellTaskResult RemoveUnusedDependencies(const ADUShell_LaunchArguments& launchArgs)
 {
     ADUShellTaskResult taskResult;
     std::vector<std::string> aptArgs = { apt_option_y, apt_option_install, apt_option_auto_remove };
-    taskResult.SetExitStatus(ADUC_LaunchChildProcess(aptget_command, aptArgs, taskResult.Output()));
+    taskResult.SetExitStatus(Common::LaunchChildProcess(launchArgs, aptget_command, aptArgs, taskResult.Output()));
     return taskResult;
 }
 
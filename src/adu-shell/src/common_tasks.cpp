@@ -17,19 +17,46 @@ namespace Tasks
 {
 namespace Common
 {
+/**
+ * @brief Runs a child process for a task.
+ *
+ * @param launchArgs The adu-shell launch command-line arguments that has been parsed.
+ * @param command Name of a command to run, searched for in PATH when it doesn't contain '/'.
+ * @param args List of arguments for the command.
+ * @param output The standard output and standard error of the command.
+ * @return An exit code from the command.
+ */
+int LaunchChildProcess(
+    const ADUShell_LaunchArguments& launchArgs,
+    const std::string& command,
+    const std::vector<std::string>& args,
+    std::string& output)
+{
+    if (!launchArgs.outputLineSink)
+    {
+        return ADUC_LaunchChildProcess(command, args, output);
+    }
+
+    ADUC_ChildProcessOptions options;
+    options.outputLineSink = launchArgs.outputLineSink;
+    options.errorLineSink = launchArgs.outputLineSink;
+
+    return ADUC_LaunchChildProcessWithOptions(command, args, options, output);
+}
+
 /**
  * @brief Reboots the system.
  *
  * @param launchArgs The adu-shell launch command-line arguments that has been parsed.
  * @return A result from child process.
  */
-ADUShellTaskResult Reboot(const ADUShell_LaunchArguments& /*launchArgs*/)
+ADUShellTaskResult Reboot(const ADUShell_LaunchArguments& launchArgs)
 {
     Log_Info("Launching child process to reboot the device.");
     ADUShellTaskResult taskResult;
     std::vector<std::string> args{ "--reboot", "--no-wall" };
     std::string output;
-    taskResult.SetExitStatus(ADUC_LaunchChildProcess("/sbin/reboot", args, output));
+    taskResult.SetExitStatus(LaunchChildProcess(launchArgs, "/sbin/reboot", args, output));
     if (!output.empty())
     {
         Log_Info(output.c_str());
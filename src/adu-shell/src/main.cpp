@@ -25,6 +25,7 @@
 #include "aduc/string_utils.hpp"
 
 #include "adushell.hpp"
+#include "adushell_broker.hpp"
 #include "adushell_const.hpp"
 #include "azure_c_shared_utility/vector.h"
 #include "common_tasks.hpp"
@@ -69,6 +70,7 @@ int ParseLaunchArguments(const int argc, char** argv, ADUShell_LaunchArguments*
     launchArgs->targetData = nullptr;
     launchArgs->logFile = nullptr;
     launchArgs->showVersion = false;
+    launchArgs->brokerMode = false;
 
 #if _ADU_DEBUG
     launchArgs->logLevel = ADUC_LOG_DEBUG;
@@ -105,6 +107,9 @@ int ParseLaunchArguments(const int argc, char** argv, ADUShell_LaunchArguments*
         //
         // "--config-folder"     |   Path to the folder containing the ADU configuration files.
         //
+        // "--broker"            |   Serve tasks for the agent on the aduShellBrokerSocketPath socket
+        //                             from du-config.json, instead of running a single task.
+        //
         static struct option long_options[] =
         {
             { "version",           no_argument,       nullptr, 'v' },
@@ -115,6 +120,7 @@ int ParseLaunchArguments(const int argc, char** argv, ADUShell_LaunchArguments*
             { "target-log-folder", required_argument, nullptr, 'f' },
             { "log-level",         required_argument, nullptr, 'l' },
             { "config-folder",     required_argument, nullptr, 'F' },
+            { "broker",            no_argument,       nullptr, 'b' },
             { nullptr, 0, nullptr, 0 }
         };
 
@@ -122,7 +128,7 @@ int ParseLaunchArguments(const int argc, char** argv, ADUShell_LaunchArguments*
 
         /* getopt_long stores the option index here. */
         int option_index = 0;
-        int option = getopt_long(argc, argv, "vt:a:d:o:f:l:F;", long_options, &option_index);
+        int option = getopt_long(argc, argv, "vt:a:d:o:f:l:F;b", long_options, &option_index);
 
         /* Detect the end of the options. */
         if (option == -1)
@@ -136,6 +142,10 @@ int ParseLaunchArguments(const int argc, char** argv, ADUShell_LaunchArguments*
             launchArgs->showVersion = true;
             break;
 
+        case 'b':
+            launchArgs->brokerMode = true;
+            break;
+
         case 't':
             launchArgs->updateType = optarg;
             break;
@@ -212,6 +222,11 @@ int ParseLaunchArguments(const int argc, char** argv, ADUShell_LaunchArguments*
         }
     }
 
+    if (launchArgs->brokerMode)
+    {
+        return result;
+    }
+
     if (launchArgs->updateType == nullptr)
     {
         printf("Missing --update-type option.\n");
@@ -274,10 +289,14 @@ int ADUShell_Dowork(const ADUShell_LaunchArguments& launchArgs)
 /**
  * @brief Checking if the process has permission to run the adu shell operations
  *
+ * @param geteuidFunc The function for getting the user id to check. Default is geteuid.
+ * @param getegidFunc The function for getting the group id to check. Default is getegid.
  * @return true if the process is either in the trusted Group, or is one of the adu shell trusted users.
  * @return false otherwise
  */
-bool ADUShell_PermissionCheck()
+bool ADUShell_PermissionCheck(
+    const std::function<uid_t()>& geteuidFunc /* = geteuid */,
+    const std::function<gid_t()>& getegidFunc /* = getegid */)
 {
     bool isTrusted = false;
 
@@ -287,7 +306,7 @@ bool ADUShell_PermissionCheck()
     {
         VECTOR_HANDLE aduShellTrustedUsers = ADUC_ConfigInfo_GetAduShellTrustedUsers(config);
 
-        isTrusted = VerifyProcessEffectiveUser(aduShellTrustedUsers);
+        isTrusted = VerifyProcessEffectiveUser(aduShellTrustedUsers, geteuidFunc);
 
         ADUC_ConfigInfo_FreeAduShellTrustedUsers(aduShellTrustedUsers);
         aduShellTrustedUsers = nullptr;
@@ -298,7 +317,7 @@ bool ADUShell_PermissionCheck()
     // check whether the effective user is in the trusted group
     if (!isTrusted)
     {
-        isTrusted = VerifyProcessEffectiveGroup(ADUSHELL_EFFECTIVE_GROUP_NAME);
+        isTrusted = VerifyProcessEffectiveGroup(ADUSHELL_EFFECTIVE_GROUP_NAME, getegidFunc);
     }
 
     // If a trusted user list is provided, the permission check passes if the user is either in trusted group,
@@ -397,8 +416,15 @@ int main(int argc, char** argv)
             effectiveUserId,
             ADUCPAL_getegid());
 
-        s_task_in_progress = true;
-        ret = ADUShell_Dowork(launchArgs);
+        if (launchArgs.brokerMode)
+        {
+            ret = ADUShellBroker_Run(config);
+        }
+        else
+        {
+            s_task_in_progress = true;
+            ret = ADUShell_Dowork(launchArgs);
+        }
 
         ADUC_Logging_Uninit();
 
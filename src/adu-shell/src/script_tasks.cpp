@@ -82,7 +82,8 @@ ADUShellTaskResult Execute(const ADUShell_LaunchArguments& launchArgs)
         }
     }
 
-    taskResult.SetExitStatus(ADUC_LaunchChildProcess(launchArgs.targetData, args, taskResult.Output()));
+    taskResult.SetExitStatus(
+        Common::LaunchChildProcess(launchArgs, launchArgs.targetData, args, taskResult.Output()));
 
 done:
     // Restore the permissions.
@@ -8,6 +8,7 @@
 #ifndef ADUC_TYPES_DOWNLOAD_H
 #define ADUC_TYPES_DOWNLOAD_H
 
+#include <stdbool.h> // bool
 #include <stdint.h> // uint64_t
 
 /**
@@ -32,4 +33,33 @@ typedef void (*ADUC_DownloadProgressCallback)(
     uint64_t bytesTransferred,
     uint64_t bytesTotal);
 
+/**
+ * @brief Function signature for callback that a content downloader polls to find out whether the
+ * workflow that requested the download has been cancelled.
+ * @return true if the download for @p workflowId should be abandoned.
+ */
+typedef bool (*ADUC_DownloadCancellationCallback)(const char* workflowId);
+
+/**
+ * @brief The maximum length of a base64 encoded digest in an ADUC_VerifiedDigest (SHA512, excluding null-terminator).
+ */
+#define ADUC_VERIFIED_DIGEST_MAX_HASH_BASE64_LEN 88
+
+/**
+ * @brief A token produced by a content downloader that hashed the payload while writing it to disk.
+ * @details It records the digest together with the identity of the file that was written, so that the
+ * agent can trust the digest without re-reading the file, as long as the file has not changed since.
+ * An empty hashBase64 (e.g. a zero-initialized token) means the token was not populated.
+ */
+typedef struct tagADUC_VerifiedDigest
+{
+    int32_t algorithm; /**< The SHAversion of the digest. */
+    char hashBase64[ADUC_VERIFIED_DIGEST_MAX_HASH_BASE64_LEN + 1]; /**< The base64 encoded digest. */
+    uint64_t fileSize; /**< The size of the file in bytes when the digest was taken. */
+    uint64_t fileDevice; /**< The device id of the file when the digest was taken. */
+    uint64_t fileInode; /**< The inode of the file when the digest was taken. */
+    int64_t fileModifiedTimeSec; /**< The modification time (seconds) of the file when the digest was taken. */
+    int64_t fileModifiedTimeNsec; /**< The modification time (nanoseconds) of the file when the digest was taken. */
+} ADUC_VerifiedDigest;
+
 #endif // ADUC_TYPES_DOWNLOAD_H
@@ -1191,23 +1191,14 @@ static void CallDownloadHandlerOnUpdateWorkflowCompleted(const ADUC_WorkflowHand
         ADUC_Result result;
         memset(&result, 0, sizeof(result));
 
-        ADUC_FileEntity fileEntity;
-        memset(&fileEntity, 0, sizeof(fileEntity));
-
-        if (!workflow_get_update_file(workflowHandle, i, &fileEntity))
-        {
-            continue;
-        }
-
-        if (IsNullOrEmpty(fileEntity.DownloadHandlerId))
+        const ADUC_FileEntity* fileEntity = workflow_peek_update_file(workflowHandle, i);
+        if (fileEntity == NULL || IsNullOrEmpty(fileEntity->DownloadHandlerId))
         {
-            ADUC_FileEntity_Uninit(&fileEntity);
             continue;
         }
 
         // NOTE: do not free the handle as it is owned by the DownloadHandlerFactory.
-        DownloadHandlerHandle* handle = ADUC_DownloadHandlerFactory_LoadDownloadHandler(fileEntity.DownloadHandlerId);
-        ADUC_FileEntity_Uninit(&fileEntity);
+        DownloadHandlerHandle* handle = ADUC_DownloadHandlerFactory_LoadDownloadHandler(fileEntity->DownloadHandlerId);
         if (handle != NULL)
         {
             result = ADUC_DownloadHandlerPlugin_OnUpdateWorkflowCompleted(handle, workflowHandle);
@@ -8,12 +8,16 @@
  */
 
 #include "aduc/shutdown_service.h"
+#include "aduc/event_loop_utils.h" // ADUC_EventLoop_Wake
 
 static bool s_isShuttingDown = false;
 
 void ADUC_ShutdownService_RequestShutdown()
 {
     s_isShuttingDown = true;
+
+    // Let the main loop see the request now rather than on its next scheduled wake-up.
+    ADUC_EventLoop_Wake();
 }
 
 bool ADUC_ShutdownService_ShouldKeepRunning()
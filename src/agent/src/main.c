@@ -18,6 +18,7 @@
 #include "aduc/connection_string_utils.h"
 #include "aduc/d2c_messaging.h"
 #include "aduc/device_info_interface.h"
+#include "aduc/event_loop_utils.h"
 #include "aduc/extension_manager.h"
 #include "aduc/extension_utils.h"
 #include "aduc/health_management.h"
@@ -30,7 +31,6 @@
 #include "aduc/system_utils.h" // ADUC_SystemUtils_MkDirRecursiveDefault
 #include "aducpal/stdlib.h" // setenv
 #include <azure_c_shared_utility/shared_util_options.h>
-#include <azure_c_shared_utility/threadapi.h> // ThreadAPI_Sleep
 #include <ctype.h>
 #include <diagnostics_devicename.h>
 #include <diagnostics_interface.h>
@@ -74,6 +74,11 @@
  */
 #define RET_COLON_FOR_MISSING_OPTIONARG ":"
 
+/**
+ * @brief The longest the main loop sleeps without being woken up or asked to run at an earlier time.
+ */
+#define MAIN_LOOP_MAX_WAIT_MS (60 * 1000)
+
 // Name of ADU Agent subcomponent that this device implements.
 static const char g_aduPnPComponentName[] = "deviceUpdate";
 
@@ -106,9 +111,10 @@ typedef void (*PnPComponentConnectedFunc)(void* componentContext);
 
 /**
  * @brief Function signature for PnP component worker method.
- *        Called regularly after the device client is created.
+ *        Called whenever the main loop wakes up after the device client is created.
  *
  * This allows an component implementation to do work in a cooperative multitasking environment.
+ * A component that needs to be called at a given time requests it with ADUC_EventLoop_RequestWakeIn.
  */
 typedef void (*PnPComponentDoWorkFunc)(void* componentContext);
 
@@ -481,6 +487,12 @@ static void ADUC_PnP_Components_HandleRefresh(ADUC_ClientHandle clientHandle)
 
         *(entry->clientHandle) = clientHandle;
     }
+
+    // Messages sent on the previous connection will not get a response.
+    if (clientHandle != NULL)
+    {
+        ADUC_D2C_Messaging_OnReconnected();
+    }
 }
 
 /**
@@ -820,6 +832,7 @@ void ShutdownAgent()
     ADUC_PnP_Components_Destroy();
     IoTHub_CommunicationManager_Deinit();
     DiagnosticsComponent_DestroyDeviceName();
+    ADUC_EventLoop_Deinit();
     ADUC_Logging_Uninit();
     ExtensionManager_Uninit();
 }
@@ -1063,6 +1076,10 @@ int main(int argc, char** argv)
     signal(SIGINT, OnShutdownSignal);
     signal(SIGTERM, OnShutdownSignal);
 
+    // Create the event loop first, so that the components can wake it up as soon as they start.
+    // On failure, the main loop polls instead.
+    (void)ADUC_EventLoop_Init();
+
     if (!StartupAgent(&launchArgs))
     {
         goto done;
@@ -1075,7 +1092,7 @@ int main(int argc, char** argv)
     Log_Info("Agent running.");
     while (ADUC_ShutdownService_ShouldKeepRunning())
     {
-        // If any components have requested a DoWork callback, regularly call it.
+        // If any components have requested a DoWork callback, call it.
         for (unsigned index = 0; index < ARRAY_SIZE(componentList); ++index)
         {
             PnPComponentEntry* entry = componentList + index;
@@ -1090,12 +1107,15 @@ int main(int argc, char** argv)
         ADUC_D2C_Messaging_DoWork();
 
         // NOTE: When using low level samples (iothub_ll_*), the IoTHubDeviceClient_LL_DoWork
-        // function must be called regularly (eg. every 100 milliseconds) for the IoT device client to work properly.
+        // function must be called regularly for the IoT device client to work properly.
         // See: https://github.com/Azure/azure-iot-sdk-c/tree/master/iothub_client/samples
         // NOTE: For this example the above has been wrapped to support module and device client methods using
-        // the client_handle_helper.h function ClientHandle_DoWork()
+        // the client_handle_helper.h function ClientHandle_DoWork(). IoTHub_CommunicationManager_DoWork requests
+        // the next call with ADUC_EventLoop_RequestWakeIn, as do the D2C messaging retries.
 
-        ThreadAPI_Sleep(100);
+        // Sleep until woken up (e.g. by a new D2C message or a shutdown request), or until the earliest time
+        // requested by the work above.
+        ADUC_EventLoop_Wait(MAIN_LOOP_MAX_WAIT_MS);
     };
 
     ret = 0; // Success.
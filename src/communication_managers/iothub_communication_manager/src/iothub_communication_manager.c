@@ -6,17 +6,19 @@
  * Licensed under the MIT License.
  */
 #include "aduc/iothub_communication_manager.h"
-#include "aduc/adu_core_export_helpers.h" // ADUC_MethodCall_RestartAgent
 #include "aduc/adu_types.h"
 #include "aduc/client_handle_helper.h"
 #include "aduc/config_utils.h"
 #include "aduc/connection_string_utils.h" // ConnectionStringUtils_DoesKeyExist
+#include "aduc/event_loop_utils.h" // ADUC_EventLoop_RequestWakeIn
 #include "aduc/https_proxy_utils.h"
 #include "aduc/logging.h"
+#include "aduc/network_monitor_utils.h" // ADUC_NetworkMonitor_Start
 #include "aduc/retry_utils.h"
 #include "aduc/string_c_utils.h" // LoadBufferWithFileContents
 #include <azure_c_shared_utility/shared_util_options.h>
 
+#include "eis_credential_cache.h"
 #include "eis_utils.h"
 
 #include <iothub.h>
@@ -72,6 +74,29 @@ static time_t g_last_connection_status_callback_time =
     0; // The last time the connection callback was called (since epoch)
 static unsigned int g_authentication_retries = 0; // The total authentication retries count.
 
+/**
+ * @brief Whether a network interface came up or a default route was added since the last connection maintenance. Set
+ * by the network monitor thread.
+ */
+static volatile sig_atomic_t g_network_restored = 0;
+
+/**
+ * @brief The shortest time between two reconnection attempts caused by network changes, so that a flapping link does
+ * not tear down a connection that is still being established.
+ */
+#define NETWORK_RESTORED_MIN_RECONNECT_INTERVAL_SECONDS 5
+
+/**
+ * @brief Whether the credential cache renewed the SAS token since the last connection maintenance. Set by the
+ * credential renewal thread.
+ */
+static volatile sig_atomic_t g_credential_renewed = 0;
+
+/**
+ * @brief The authentication type of the current IoT Hub connection.
+ */
+static ADUC_AuthType g_connection_auth_type = ADUC_AuthType_NotSet;
+
 // Engine type for an OpenSSL Engine
 static const OPTION_OPENSSL_KEY_TYPE x509_key_from_engine = KEY_TYPE_ENGINE;
 
@@ -105,6 +130,63 @@ static time_t GetTimeSinceEpochInSeconds()
     return timeSinceEpoch.tv_sec;
 }
 
+/**
+ * @brief Called by the network monitor when the network changes. Wakes the main loop, so that connection maintenance
+ * reconnects right away when a network interface comes up or a default route is added while the connection is broken.
+ * The retries do not depend on it: a change the monitor misses only delays the reconnection until the next retry.
+ *
+ * @param changes The ADUC_NetworkChange flags.
+ * @param context Not used.
+ */
+static void OnNetworkChange(unsigned int changes, void* context)
+{
+    UNREFERENCED_PARAMETER(context);
+
+    if ((changes & (ADUC_NetworkChange_LinkUp | ADUC_NetworkChange_DefaultRouteAdded)) != 0)
+    {
+        g_network_restored = 1;
+        ADUC_EventLoop_Wake();
+    }
+}
+
+/**
+ * @brief Called by the credential cache when it renewed the credential ahead of its expiry. Wakes the main loop, so
+ * that connection maintenance moves the connection to the new SAS token before the current one expires.
+ *
+ * @param context Not used.
+ */
+static void OnCredentialRenewed(void* context)
+{
+    UNREFERENCED_PARAMETER(context);
+
+    g_credential_renewed = 1;
+    ADUC_EventLoop_Wake();
+}
+
+/**
+ * @brief Checks whether the agent gets its connection information from the identity service.
+ */
+static bool IsConnectionFromIdentityService()
+{
+    bool isFromIdentityService = false;
+    const ADUC_ConfigInfo* config = ADUC_ConfigInfo_GetInstance();
+
+    if (config == NULL)
+    {
+        return false;
+    }
+
+    const ADUC_AgentInfo* agent = ADUC_ConfigInfo_GetAgent(config, 0);
+    if (agent != NULL && agent->connectionType != NULL)
+    {
+        isFromIdentityService = (strcmp(agent->connectionType, "AIS") == 0);
+    }
+
+    ADUC_ConfigInfo_ReleaseInstance(config);
+
+    return isFromIdentityService;
+}
+
 /**
  * @brief Initializes the IoT Hub connection manager.
  *
@@ -142,6 +224,19 @@ bool IoTHub_CommunicationManager_Init(
     g_iothub_client_handle_changed_callback = client_handle_updated_callback;
     g_iothub_client_initialized = true;
 
+    // Not fatal: without it, the connection is retried after the back-off delays only.
+    if (!ADUC_NetworkMonitor_Start(OnNetworkChange, NULL))
+    {
+        Log_Warn("Cannot monitor network changes. Reconnecting after network outages may be delayed.");
+    }
+
+    // Not fatal either: without it, each connection requests its credential from the identity service.
+    if (IsConnectionFromIdentityService()
+        && !EISCredentialCache_Start(EIS_PROVISIONING_TIMEOUT, OnCredentialRenewed, NULL))
+    {
+        Log_Warn("Cannot renew the identity service credential in the background.");
+    }
+
     return true;
 }
 
@@ -163,6 +258,9 @@ static void ADUC_DeviceClient_Destroy(ADUC_ClientHandle clientHandle)
  */
 void IoTHub_CommunicationManager_Deinit()
 {
+    ADUC_NetworkMonitor_Stop();
+    EISCredentialCache_Stop();
+
     if (g_aduc_client_handle_address != NULL && *g_aduc_client_handle_address != NULL)
     {
         ClientHandle_Destroy(*g_aduc_client_handle_address);
@@ -229,6 +327,13 @@ void IoTHub_CommunicationManager_ConnectionStatus_Callback(
                 now_time - g_first_unauthenticated_time,
                 g_next_authentication_attempt_time - now_time);
         }
+
+        // The next attempt must not reuse the cached credential that the hub refused.
+        if (status_reason == IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN
+            || status_reason == IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL)
+        {
+            EISCredentialCache_Invalidate();
+        }
         break;
     }
 
@@ -551,10 +656,8 @@ bool GetConnectionInfoFromIdentityService(ADUC_ConnectionInfo* info)
     }
     memset(info, 0, sizeof(*info));
 
-    time_t expirySecsSinceEpoch = time(NULL) + EIS_TOKEN_EXPIRY_TIME_IN_SECONDS;
-
-    EISUtilityResult eisProvisionResult =
-        RequestConnectionStringFromEISWithExpiry(expirySecsSinceEpoch, EIS_PROVISIONING_TIMEOUT, info);
+    // Reuses the credential while its SAS token is valid, instead of requesting a new one from EIS on each connection.
+    EISUtilityResult eisProvisionResult = EISCredentialCache_GetConnectionInfo(EIS_PROVISIONING_TIMEOUT, info);
 
     if (eisProvisionResult.err != EISErr_Ok && eisProvisionResult.service != EISService_Utils)
     {
@@ -670,6 +773,8 @@ static void ADUC_Refresh_IotHub_Connection_SAS_Token()
         goto done;
     }
 
+    g_connection_auth_type = info.authType;
+
     if (g_iothub_client_handle_changed_callback != NULL)
     {
         g_iothub_client_handle_changed_callback(*g_aduc_client_handle_address);
@@ -688,22 +793,50 @@ done:
  */
 static void Connection_Maintenance()
 {
+    const bool isNetworkRestored = (g_network_restored != 0);
+    const bool isCredentialRenewed = (g_credential_renewed != 0);
+    g_network_restored = 0;
+    g_credential_renewed = 0;
+
     if (IoTHub_CommunicationManager_IsAuthenticated())
     {
+        // The SAS token of the connection expires soon: reconnect with the renewed one now, rather than be
+        // disconnected at expiry and wait for the back-off. The renewed credential is already cached.
+        if (isCredentialRenewed && g_connection_auth_type == ADUC_AuthType_SASToken)
+        {
+            Log_Info("The SAS token was renewed. Refreshing the IoT Hub connection.");
+            g_last_authentication_attempt_time = GetTimeSinceEpochInSeconds();
+            ADUC_Refresh_IotHub_Connection_SAS_Token();
+        }
+
         return;
     }
 
     // Try to (re)connect to the IoT Hub if:
     //   1. The connection is broken (or unauthenticated)
-    //   2. It has been long enough since the last authentication attemps
+    //   2. It has been long enough since the last authentication attemps, or the network just came back
     time_t now_time = GetTimeSinceEpochInSeconds();
 
+    if (isNetworkRestored && g_last_authentication_attempt_time != 0)
+    {
+        // Reconnect now, as if this was the first attempt, instead of waiting for a back-off computed while the
+        // network was down. An attempt made just before is given some time to complete.
+        const time_t earliestAttemptTime =
+            g_last_authentication_attempt_time + NETWORK_RESTORED_MIN_RECONNECT_INTERVAL_SECONDS;
+
+        Log_Info("Network restored. Reconnecting to the IoT Hub.");
+        g_authentication_retries = 0;
+        g_last_authentication_attempt_time = 0;
+        g_next_authentication_attempt_time = (now_time < earliestAttemptTime) ? earliestAttemptTime : now_time;
+    }
+
     if (now_time < g_next_authentication_attempt_time)
     {
         return;
     }
 
     int additionalDelayInSeconds = TIME_SPAN_FIFTEEN_SECONDS_IN_SECONDS;
+    unsigned long maxBackOffDelayInSeconds = TIME_SPAN_ONE_HOUR_IN_SECONDS;
 
     // If we haven't tried to connect, no need to compute the next retry time.
     // Otherwise, compute next retry time we've attempted to authenticate after the previous time.
@@ -732,14 +865,12 @@ static void Connection_Maintenance()
             additionalDelayInSeconds = TIME_SPAN_FIVE_MINUTES_IN_SECONDS;
             break;
         case IOTHUB_CLIENT_CONNECTION_NO_NETWORK:
-            // 1) try to restart agent to prevent empty reported properties in module twin
-            // 2) if restart agent could not be performed, wait for at least 5 minutes to retry.
+            // The connection is re-created, with the D2C messages still pending, once the network is back. Keep
+            // retrying with a short back-off, since the network monitor may not be running or may miss the change;
+            // when it sees a network interface come up or a default route, it only wakes the retry earlier.
             Log_Error("No network.");
-            if (ADUC_MethodCall_RestartAgent() != 0)
-            {
-                additionalDelayInSeconds = TIME_SPAN_FIVE_MINUTES_IN_SECONDS;
-                Log_Error("Agent restart attempt failed.");
-            }
+            additionalDelayInSeconds = TIME_SPAN_FIFTEEN_SECONDS_IN_SECONDS;
+            maxBackOffDelayInSeconds = TIME_SPAN_FIVE_MINUTES_IN_SECONDS;
             break;
 
         case IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR:
@@ -762,7 +893,7 @@ static void Connection_Maintenance()
             additionalDelayInSeconds,
             g_authentication_retries /* current retires count */,
             ADUC_RETRY_DEFAULT_INITIAL_DELAY_MS /* initialDelayUnitMilliSecs */,
-            TIME_SPAN_ONE_HOUR_IN_SECONDS,
+            maxBackOffDelayInSeconds,
             ADUC_RETRY_DEFAULT_MAX_JITTER_PERCENT);
 
         g_next_authentication_attempt_time = (nextRetryTime);
@@ -777,6 +908,44 @@ static void Connection_Maintenance()
     ADUC_Refresh_IotHub_Connection_SAS_Token();
 }
 
+/**
+ * @brief How often the IoT Hub client's DoWork is called while the connection is established. The client reads the
+ * twin updates sent by the hub, and sends its keep-alive pings, in DoWork, so this bounds how long a desired property
+ * change waits to be read. Outgoing messages wake the main loop when they are submitted.
+ */
+#define CONNECTED_CLIENT_DOWORK_INTERVAL_MS 1000
+
+/**
+ * @brief How often the IoT Hub client's DoWork is called while it is connecting or reconnecting.
+ */
+#define CONNECTING_CLIENT_DOWORK_INTERVAL_MS 100
+
+/**
+ * @brief Requests that the main loop calls IoTHub_CommunicationManager_DoWork again when the client or the
+ * connection maintenance need it.
+ */
+static void RequestNextWakeUp()
+{
+    unsigned int delayMs = CONNECTING_CLIENT_DOWORK_INTERVAL_MS;
+
+    if (IoTHub_CommunicationManager_IsAuthenticated())
+    {
+        delayMs = CONNECTED_CLIENT_DOWORK_INTERVAL_MS;
+    }
+    else if (g_aduc_client_handle_address == NULL || *g_aduc_client_handle_address == NULL)
+    {
+        // No client to drive: wait for the next authentication attempt.
+        const time_t now_time = GetTimeSinceEpochInSeconds();
+        if (g_next_authentication_attempt_time > now_time)
+        {
+            const time_t delaySecs = g_next_authentication_attempt_time - now_time;
+            delayMs = (delaySecs < (time_t)(UINT_MAX / 1000)) ? (unsigned int)delaySecs * 1000 : UINT_MAX;
+        }
+    }
+
+    ADUC_EventLoop_RequestWakeIn(delayMs);
+}
+
 /**
  * @brief Performs the connection management tasks synchronously (in the caller's thread context).
  *
@@ -788,4 +957,5 @@ void IoTHub_CommunicationManager_DoWork(void* user_context)
     UNREFERENCED_PARAMETER(user_context);
     Connection_Maintenance();
     ClientHandle_DoWork(*g_aduc_client_handle_address);
+    RequestNextWakeUp();
 }
@@ -14,6 +14,7 @@
 #include <azure_c_shared_utility/strings.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h> // strcmp, strlen
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
@@ -32,6 +33,24 @@
  */
 #define MAX_FILES_TO_REPORT 20
 
+/**
+ * @brief Suffix of the files still being written by a log rotation, e.g. when zlog compresses a rotated log file
+ */
+#define TEMP_FILE_SUFFIX ".tmp"
+
+/**
+ * @brief Checks whether @p fileName is a temporary file that should not be uploaded
+ * @param fileName the name of the file
+ * @returns true if @p fileName ends with TEMP_FILE_SUFFIX
+ */
+static bool IsTempFile(const char* fileName)
+{
+    const size_t fileNameLength = strlen(fileName);
+    const size_t suffixLength = sizeof(TEMP_FILE_SUFFIX) - 1;
+
+    return fileNameLength >= suffixLength && strcmp(fileName + fileNameLength - suffixLength, TEMP_FILE_SUFFIX) == 0;
+}
+
 /**
  * @brief Creates a new entry within the @p sortedLogFiles array when the new file is newer than any current entry up to @p sortedLogFiles
  * @details The array @p sortedLogFiles is kept in order of newest to oldest, expected to be zeroed out before the first call
@@ -143,8 +162,10 @@ bool FileInfoUtils_FillFileInfoWithNewestFilesInDir(FileInfo* logFiles, size_t l
             continue;
         }
 
-        // Note: Only care about the first level files that are not symbolic
-        if (S_ISDIR(statbuf.st_mode) || S_ISLNK(statbuf.st_mode) || statbuf.st_size == 0)
+        // Note: Only care about the first level files that are not symbolic. Compressed rotated logs (.gz) are
+        // uploaded as they are, but not the temporary files they are written to.
+        if (S_ISDIR(statbuf.st_mode) || S_ISLNK(statbuf.st_mode) || statbuf.st_size == 0
+            || IsTempFile(entry->d_name))
         {
             STRING_delete(filePath);
             continue;
@@ -91,7 +91,17 @@ bool AzureBlobStorageHelper::UploadFilesToContainer(
 
                 std::vector<std::pair<std::string, std::string>> metadata;
 
-                this->client->UploadBlob(blobName, fileStream);
+                // Rotated logs compressed by the agent are uploaded as they are.
+                Azure::Storage::Blobs::UploadBlockBlobOptions options;
+                const std::string gzipExtension = ".gz";
+                if (blobName.size() >= gzipExtension.size()
+                    && blobName.compare(blobName.size() - gzipExtension.size(), gzipExtension.size(), gzipExtension)
+                        == 0)
+                {
+                    options.HttpHeaders.ContentType = "application/gzip";
+                }
+
+                this->client->UploadBlob(blobName, fileStream, options);
             });
     }
 
@@ -6,11 +6,13 @@
  * Licensed under the MIT License.
  */
 #include "aduc/component_enumerator_extension.hpp"
+#include "aduc/component_inventory.hpp"
 #include "parson.h"
 #include <aduc/contract_utils.h>
-#include <algorithm>
 #include <sstream>
+#include <string>
 #include <string.h>
+#include <vector>
 
 /*
 
@@ -44,8 +46,10 @@
 //
 const char* g_contosoComponentInventoryFilePath = "/usr/local/contoso-devices/components-inventory.json";
 
-static JSON_Value* _GetAllComponentsFromFile(const char* configFilepath)
+static JSON_Value* _GetAllComponentsFromFile(const char* configFilepath, std::vector<std::string>& sourceFiles)
 {
+    sourceFiles.emplace_back(configFilepath);
+
     // Read config file.
     JSON_Value* rootValue = json_parse_file(configFilepath);
     if (rootValue == nullptr)
@@ -86,6 +90,9 @@ static JSON_Value* _GetAllComponentsFromFile(const char* configFilepath)
                 std::stringstream propsFile;
                 propsFile << path << "/" << firmwareDataFile;
 
+                // Also watched when missing, so that the component's status changes when it appears.
+                sourceFiles.push_back(propsFile.str());
+
                 // Read properties from firmware data file.
                 JSON_Value* propsValues = json_parse_file(propsFile.str().c_str());
                 if (propsValues == nullptr)
@@ -135,16 +142,16 @@ static JSON_Value* _GetAllComponentsFromFile(const char* configFilepath)
     return rootValue;
 }
 
-static bool _json_object_contains_named_value(JSON_Object* jsonObject, const char* name, const char* value)
+/**
+ * @brief Gets the components inventory, which is only read again when the inventory or a firmware data file changes.
+ */
+static ADUC::ComponentInventory& _GetComponentInventory()
 {
-    if (!(jsonObject != nullptr && name != nullptr && *name != 0 && value != nullptr && *value != 0))
-    {
-        return false;
-    }
+    static ADUC::ComponentInventory inventory{ [](std::vector<std::string>& sourceFiles) {
+        return _GetAllComponentsFromFile(g_contosoComponentInventoryFilePath, sourceFiles);
+    } };
 
-    return (
-        json_object_has_value_of_type(jsonObject, name, JSONString) != 0
-        && strcmp(json_object_get_string(jsonObject, name), value) == 0);
+    return inventory;
 }
 
 EXTERN_C_BEGIN
@@ -175,49 +182,9 @@ EXTERN_C_BEGIN
  */
 EXPORTED_METHOD char* SelectComponents(const char* selectorJson)
 {
-    char* outputString = nullptr;
-
-    JSON_Value* allComponentsValue = nullptr;
-    JSON_Array* componentsArray = nullptr;
-
-    JSON_Value* selectorValue = json_parse_string(selectorJson);
-    JSON_Object* selector = json_object(selectorValue);
-    if (selector == nullptr)
-    {
-        goto done;
-    }
-
     // NOTE: For demonstration purposes, we're popoulating components data by reading from
-    // the specified 'component inventory' file.
-    allComponentsValue = _GetAllComponentsFromFile(g_contosoComponentInventoryFilePath);
-    componentsArray = json_object_get_array(json_object(allComponentsValue), "components");
-    if (componentsArray == nullptr)
-    {
-        goto done;
-    }
-
-    // Keep only components that contain all properties (name & value) specified in the selector.
-    for (int i = static_cast<int>(json_array_get_count(componentsArray)) - 1; i >= 0; i--)
-    {
-        JSON_Object* component = json_array_get_object(componentsArray, i);
-        for (int s = static_cast<int>(json_object_get_count(selector)) - 1; s >= 0; s--)
-        {
-            bool matched = _json_object_contains_named_value(
-                component, json_object_get_name(selector, s), json_string(json_object_get_value_at(selector, s)));
-            if (!matched)
-            {
-                json_array_remove(componentsArray, (size_t)i);
-            }
-        }
-    }
-
-    outputString = json_serialize_to_string_pretty(allComponentsValue);
-
-done:
-    json_value_free(selectorValue);
-    json_value_free(allComponentsValue);
-
-    return outputString;
+    // the specified 'component inventory' file, once, and again only after it changes.
+    return _GetComponentInventory().SelectComponents(selectorJson);
 }
 
 /**
@@ -228,10 +195,7 @@ done:
  */
 EXPORTED_METHOD char* GetAllComponents()
 {
-    JSON_Value* val = _GetAllComponentsFromFile(g_contosoComponentInventoryFilePath);
-    char* returnString = json_serialize_to_string_pretty(val);
-    json_value_free(val);
-    return returnString;
+    return _GetComponentInventory().GetAllComponents();
 }
 
 /**
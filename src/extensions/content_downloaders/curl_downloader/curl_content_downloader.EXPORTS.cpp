@@ -6,7 +6,7 @@
  * Licensed under the MIT License.
  */
 
-#include "curl_content_downloader.h" // for Download_curl
+#include "curl_content_downloader.h" // for Download_curl, DownloadWithDigest_curl
 #include <aduc/c_utils.h> // for EXTERN_C_BEGIN, EXTERN_C_END
 #include <aduc/contract_utils.h> // for ADUC_ExtensionContractInfo
 #include <aduc/types/download.h> // for ADUC_DownloadProgressCallback
@@ -31,6 +31,18 @@ EXPORTED_METHOD ADUC_Result Download(
     return Download_curl(entity, workflowId, workFolder, timeoutInSeconds, downloadProgressCallback);
 }
 
+EXPORTED_METHOD ADUC_Result DownloadWithDigest(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int timeoutInSeconds,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    ADUC_VerifiedDigest* verifiedDigest)
+{
+    return DownloadWithDigest_curl(
+        entity, workflowId, workFolder, timeoutInSeconds, downloadProgressCallback, verifiedDigest);
+}
+
 EXPORTED_METHOD ADUC_Result Initialize(const char* initializeData)
 {
     UNREFERENCED_PARAMETER(initializeData);
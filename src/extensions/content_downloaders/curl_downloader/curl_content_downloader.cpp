@@ -10,31 +10,51 @@
 #include "aduc/contract_utils.h"
 #include "aduc/hash_utils.h"
 #include "aduc/logging.h"
-#include "aduc/process_utils.hpp" // for ADUC_LaunchChildProcess
+#include "aduc/process_utils.hpp" // for ADUC_LaunchChildProcessStreamOutput
 
+#include <errno.h>
 #include <sstream>
+#include <stdio.h> // for FILE
+#include <string.h> // for memset
 #include <sys/stat.h> // for stat
 #include <vector>
 
 // keep this last to minimize chance to interfere with system header includes.
 #include "aduc/aduc_banned.h"
 
-ADUC_Result Download_curl(
+/**
+ * @brief Downloads the file entity with curl, hashing the content as it is written to the work folder.
+ *
+ * @param entity The file entity to download.
+ * @param workflowId The workflow id.
+ * @param workFolder The work folder for the update payloads.
+ * @param timeoutInSeconds The download timeout in seconds.
+ * @param downloadProgressCallback The download progress callback.
+ * @param[out] verifiedDigest The verified digest token of the downloaded file. Left empty when the download is skipped or fails.
+ * @return ADUC_Result The result.
+ */
+static ADUC_Result DownloadAndDigest_curl(
     const ADUC_FileEntity* entity,
     const char* workflowId,
     const char* workFolder,
     unsigned int timeoutInSeconds,
-    ADUC_DownloadProgressCallback downloadProgressCallback)
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    ADUC_VerifiedDigest* verifiedDigest)
 {
     UNREFERENCED_PARAMETER(timeoutInSeconds);
     ADUC_Result result = { ADUC_Result_Failure };
     SHAversion algVersion;
     std::vector<std::string> args;
-    std::string output;
+    std::string errorOutput;
     int exitCode = 1;
     std::stringstream fullFilePath;
     bool isValidHash;
     bool reportProgress = false;
+    FILE* file = nullptr;
+    bool writeFailed = false;
+    ADUC_HashUtils_StreamContext hashContext = {};
+
+    memset(verifiedDigest, 0, sizeof(*verifiedDigest));
 
     if (entity == nullptr)
     {
@@ -93,7 +113,7 @@ ADUC_Result Download_curl(
         fullFilePath.str().c_str(),
         ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0),
         algVersion,
-        false /* suppressErrorLog */);
+        true /* suppressErrorLog */);
 
     if (isValidHash)
     {
@@ -108,18 +128,62 @@ ADUC_Result Download_curl(
         entity->DownloadUri,
         fullFilePath.str().c_str());
 
-    args.emplace_back("-o");
-    args.emplace_back(fullFilePath.str().c_str());
-    args.emplace_back("-O");
+    if (!ADUC_HashUtils_StreamContext_Init(&hashContext, algVersion))
+    {
+        result.ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_TYPE_NOT_SUPPORTED;
+        reportProgress = true;
+        goto done;
+    }
+
+    file = fopen(fullFilePath.str().c_str(), "wb");
+    if (file == nullptr)
+    {
+        Log_Error("Cannot open '%s' for writing, errno %d", fullFilePath.str().c_str(), errno);
+        result.ExtendedResultCode = ADUC_ERROR_CURL_DOWNLOADER_CANNOT_WRITE_FILE;
+        reportProgress = true;
+        goto done;
+    }
+
+    // curl writes the content to stdout, which is hashed as it is written to the file,
+    // so the file never has to be read back to validate it.
+    args.emplace_back("--silent");
+    args.emplace_back("--show-error");
     args.emplace_back(entity->DownloadUri);
 
-    exitCode = ADUC_LaunchChildProcess("/usr/bin/curl", args, output);
+    exitCode = ADUC_LaunchChildProcessStreamOutput(
+        "/usr/bin/curl",
+        args,
+        [file, &hashContext, &writeFailed](const uint8_t* data, size_t size) -> bool {
+            if (fwrite(data, 1, size, file) != size || !ADUC_HashUtils_StreamContext_Update(&hashContext, data, size))
+            {
+                writeFailed = true;
+                return false;
+            }
+            return true;
+        },
+        errorOutput);
+
+    if (fclose(file) != 0)
+    {
+        writeFailed = true;
+    }
+    file = nullptr;
 
-    if (exitCode == 0)
+    if (!errorOutput.empty())
     {
-        result = { ADUC_Result_Download_Success };
+        Log_Info("Download output:: \n%s", errorOutput.c_str());
     }
-    else
+
+    if (writeFailed)
+    {
+        Log_Error("Failed to write '%s', errno %d", fullFilePath.str().c_str(), errno);
+        result.ResultCode = ADUC_Result_Failure;
+        result.ExtendedResultCode = ADUC_ERROR_CURL_DOWNLOADER_CANNOT_WRITE_FILE;
+        reportProgress = true;
+        goto done;
+    }
+
+    if (exitCode != 0)
     {
         result.ResultCode = ADUC_Result_Failure;
         result.ExtendedResultCode = ADUC_ERROR_CURL_DOWNLOADER_EXTERNAL_FAILURE(exitCode);
@@ -127,33 +191,35 @@ ADUC_Result Download_curl(
         goto done;
     }
 
-    Log_Info("Download output:: \n%s", output.c_str());
+    // Note: Currently we expect there to be only one hash, but
+    // support for multiple hashes is already built in.
+    Log_Info("Validating file hash");
 
-    // If we downloaded successfully, validate the file hash.
-    if (IsAducResultCodeSuccess(result.ResultCode))
+    if (!ADUC_HashUtils_StreamContext_FinalizeToVerifiedDigest(
+            &hashContext,
+            ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0),
+            fullFilePath.str().c_str(),
+            verifiedDigest))
     {
-        // Note: Currently we expect there to be only one hash, but
-        // support for multiple hashes is already built in.
-        Log_Info("Validating file hash");
+        Log_Error("Hash for %s is not valid", entity->TargetFilename);
 
-        const bool isValid = ADUC_HashUtils_IsValidFileHash(
-            fullFilePath.str().c_str(),
-            ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0),
-            algVersion,
-            true /* suppressErrorLog */);
+        result.ResultCode = ADUC_Result_Failure;
+        result.ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_INVALID_HASH;
+        reportProgress = true;
+        goto done;
+    }
 
-        if (!isValid)
-        {
-            Log_Error("Hash for %s is not valid", entity->TargetFilename);
+    result = { ADUC_Result_Download_Success };
+    reportProgress = true;
 
-            result.ResultCode = ADUC_Result_Failure;
-            result.ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_INVALID_HASH;
-            reportProgress = true;
-            goto done;
-        }
+done:
+
+    if (file != nullptr)
+    {
+        fclose(file);
     }
 
-done:
+    ADUC_HashUtils_StreamContext_UnInit(&hashContext);
 
     if (reportProgress && (downloadProgressCallback != nullptr))
     {
@@ -183,3 +249,32 @@ done:
         result.ExtendedResultCode);
     return result;
 }
+
+ADUC_Result Download_curl(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int timeoutInSeconds,
+    ADUC_DownloadProgressCallback downloadProgressCallback)
+{
+    ADUC_VerifiedDigest verifiedDigest;
+    return DownloadAndDigest_curl(
+        entity, workflowId, workFolder, timeoutInSeconds, downloadProgressCallback, &verifiedDigest);
+}
+
+ADUC_Result DownloadWithDigest_curl(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int timeoutInSeconds,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    ADUC_VerifiedDigest* verifiedDigest)
+{
+    if (verifiedDigest == nullptr)
+    {
+        return Download_curl(entity, workflowId, workFolder, timeoutInSeconds, downloadProgressCallback);
+    }
+
+    return DownloadAndDigest_curl(
+        entity, workflowId, workFolder, timeoutInSeconds, downloadProgressCallback, verifiedDigest);
+}
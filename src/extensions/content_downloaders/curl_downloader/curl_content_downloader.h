@@ -1,6 +1,6 @@
 
 #include <aduc/result.h> // for ADUC_Result
-#include <aduc/types/download.h> // for ADUC_DownloadProgressCallback
+#include <aduc/types/download.h> // for ADUC_DownloadProgressCallback, ADUC_VerifiedDigest
 #include <aduc/types/update_content.h> // for ADUC_FileEntity
 
 ADUC_Result Download_curl(
@@ -9,3 +9,11 @@ ADUC_Result Download_curl(
     const char* workFolder,
     unsigned int timeoutInSeconds,
     ADUC_DownloadProgressCallback downloadProgressCallback);
+
+ADUC_Result DownloadWithDigest_curl(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int timeoutInSeconds,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    ADUC_VerifiedDigest* verifiedDigest);
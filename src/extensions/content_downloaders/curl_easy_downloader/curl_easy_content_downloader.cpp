@@ -0,0 +1,1447 @@
+/**
+ * @file curl_easy_content_downloader.cpp
+ * @brief Content Downloader Extension using libcurl.
+ *
+ * @details Downloads into a "<TargetFilename>.partial" file in the work folder and resumes it with an HTTP Range
+ * request when a download is interrupted, either within a call (transient network errors are retried) or across
+ * calls (the partial file is kept when a download fails or is cancelled). The partial file is renamed to the target
+ * file once the download is complete.
+ *
+ * A large payload is split into byte ranges (segments) that are downloaded concurrently over separate connections into
+ * the preallocated partial file. The hash is computed over the contiguous prefix of the file as segments complete, and
+ * the partial file is truncated to that prefix when the download is interrupted, so that it can be resumed. Segments
+ * written ahead of the prefix leave holes in the partial file, so the length of the prefix is also kept in a
+ * "<TargetFilename>.partial.prefix" file while the segments are downloaded. When the process dies before truncating
+ * the partial file, the next download truncates it to that length before resuming.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#include "curl_easy_content_downloader.h"
+
+#include "aduc/config_utils.h" // for ADUC_ConfigInfo_GetInstance
+#include "aduc/content_downloader_extension.hpp"
+#include "aduc/hash_utils.h"
+#include "aduc/logging.h"
+
+#include <algorithm> // for std::find, std::min
+#include <atomic>
+#include <chrono>
+#include <curl/curl.h>
+#include <errno.h>
+#include <fcntl.h> // for open, fallocate
+#include <mutex> // for std::once_flag, std::mutex
+#include <sstream>
+#include <stdio.h> // for FILE, rename, remove
+#include <string.h> // for memset
+#include <string>
+#include <sys/stat.h> // for stat
+#include <thread> // for std::this_thread::sleep_for
+#include <unistd.h> // for fdatasync, fsync, ftruncate, pread, pwrite, truncate
+#include <vector>
+
+// keep this last to minimize chance to interfere with system header includes.
+#include "aduc/aduc_banned.h"
+
+/**
+ * @brief The number of consecutive attempts that received no data before the download is abandoned.
+ */
+static const unsigned int k_maxStalledAttempts = 5;
+
+/**
+ * @brief The maximum number of seconds to back off between attempts.
+ */
+static const unsigned int k_maxRetryDelayInSeconds = 30;
+
+/**
+ * @brief The minimum interval between InProgress progress reports.
+ */
+static const std::chrono::seconds k_progressReportInterval{ 1 };
+
+/**
+ * @brief The size of the buffer used to hash an existing partial file.
+ */
+static const size_t k_partialFileReadBufferSize = 64 * 1024;
+
+/**
+ * @brief The default maximum number of segments of a payload downloaded concurrently.
+ */
+static const unsigned int k_defaultDownloadSegmentCount = 4;
+
+/**
+ * @brief The default minimum size of a segment, in MB. Smaller payloads are downloaded over a single connection.
+ */
+static const unsigned int k_defaultMinSegmentSizeInMB = 16;
+
+/**
+ * @brief How much the hashed prefix of a segmented download grows before its length is saved again, so that a
+ * download interrupted by a crash or power loss resumes after it.
+ */
+static const uint64_t k_prefixCheckpointIntervalInBytes = 16 * 1024 * 1024;
+
+/**
+ * @brief The suffix, after that of the partial file, of the file that keeps the length of the hashed prefix of a
+ * segmented download.
+ */
+static const char k_prefixFileSuffix[] = ".prefix";
+
+/**
+ * @brief The maximum time to wait for activity on the segment connections before checking for cancellation.
+ */
+static const int k_segmentPollIntervalInMilliseconds = 100;
+
+static std::once_flag s_curlGlobalInitFlag;
+static CURLcode s_curlGlobalInitResult = CURLE_FAILED_INIT;
+
+// Each module that loads the content downloader registers its own callback, which only knows about
+// the downloads that module started, so every registered callback is consulted.
+static std::mutex s_cancellationCallbacksMutex;
+static std::vector<ADUC_DownloadCancellationCallback> s_cancellationCallbacks;
+
+static std::once_flag s_segmentConfigFlag;
+static unsigned int s_downloadSegmentCount = k_defaultDownloadSegmentCount;
+static uint64_t s_minSegmentSizeInBytes = static_cast<uint64_t>(k_defaultMinSegmentSizeInMB) * 1024 * 1024;
+
+/**
+ * @brief The state shared with the libcurl callbacks of a download.
+ */
+typedef struct tagLibcurlDownloadContext
+{
+    CURL* curl; /**< The easy handle of the download. */
+    FILE* file; /**< The partial file, opened for appending. */
+    ADUC_HashUtils_StreamContext* hashContext; /**< The hash of every byte in the partial file. */
+    uint64_t bytesInFile; /**< The number of bytes in the partial file. */
+    bool responseChecked; /**< Whether the response code of the current attempt has been checked. */
+    bool writeFailed; /**< Whether writing or hashing the content failed. */
+    std::atomic<bool> cancelled; /**< Whether the workflow was cancelled during the download. */
+    const ADUC_FileEntity* entity;
+    const char* workflowId;
+    ADUC_DownloadProgressCallback downloadProgressCallback;
+    std::chrono::steady_clock::time_point lastProgressReport;
+} LibcurlDownloadContext;
+
+struct tagLibcurlSegmentedDownload;
+
+/**
+ * @brief A byte range of the payload, downloaded over its own connection.
+ */
+typedef struct tagLibcurlSegment
+{
+    CURL* curl; /**< The easy handle of the segment. */
+    struct tagLibcurlSegmentedDownload* download; /**< The download the segment belongs to. */
+    uint64_t offset; /**< The offset of the first byte of the segment. */
+    uint64_t end; /**< The offset one past the last byte of the segment. */
+    uint64_t bytesWritten; /**< The number of bytes of the segment written to the partial file. */
+    uint64_t bytesWrittenBeforeAttempt; /**< bytesWritten when the current attempt started. */
+    unsigned int stalledAttempts; /**< The number of consecutive attempts that received no data. */
+    bool responseChecked; /**< Whether the response code of the current attempt has been checked. */
+    bool active; /**< Whether the easy handle is added to the multi handle. */
+    bool waitingForRetry; /**< Whether the segment is waiting to be retried at retryAt. */
+    std::chrono::steady_clock::time_point retryAt;
+} LibcurlSegment;
+
+/**
+ * @brief The state of a download split into segments.
+ */
+typedef struct tagLibcurlSegmentedDownload
+{
+    LibcurlDownloadContext* context; /**< The download context. bytesInFile is the length of the hashed prefix. */
+    int fd; /**< The partial file, opened for reading and writing at any offset. */
+    std::vector<LibcurlSegment> segments; /**< The segments, in file order. */
+    size_t hashSegmentIndex; /**< The index of the segment that contains the end of the hashed prefix. */
+    uint64_t bytesWritten; /**< The number of bytes written by every segment, for progress reporting. */
+    bool rangeNotSupported; /**< Whether the server did not honor a Range request. */
+    std::vector<uint8_t> readBuffer; /**< The buffer for hashing content written ahead of the hashed prefix. */
+} LibcurlSegmentedDownload;
+
+/**
+ * @brief Initializes libcurl once for the lifetime of the process.
+ *
+ * @return bool true if libcurl is initialized.
+ */
+static bool EnsureCurlGlobalInit()
+{
+    std::call_once(s_curlGlobalInitFlag, []() { s_curlGlobalInitResult = curl_global_init(CURL_GLOBAL_DEFAULT); });
+    return s_curlGlobalInitResult == CURLE_OK;
+}
+
+/**
+ * @brief Checks whether the workflow that requested the download has been cancelled.
+ * @details Called on the thread that runs the transfer, while the agent sets the cancellation on its own thread. The
+ * callbacks read the cancellation flags under the lock of their owner, not s_cancellationCallbacksMutex, which only
+ * guards the list of callbacks.
+ *
+ * @param workflowId The workflow id.
+ * @return bool true if the download should be abandoned.
+ */
+static bool IsCancelled(const char* workflowId)
+{
+    std::lock_guard<std::mutex> lock{ s_cancellationCallbacksMutex };
+    for (ADUC_DownloadCancellationCallback callback : s_cancellationCallbacks)
+    {
+        if (callback(workflowId))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Reads the segmented download settings from du-config.json.
+ */
+static void LoadSegmentConfig()
+{
+    const ADUC_ConfigInfo* config = ADUC_ConfigInfo_GetInstance();
+
+    if (config != nullptr)
+    {
+        if (config->downloadSegmentCount != 0)
+        {
+            s_downloadSegmentCount = config->downloadSegmentCount;
+        }
+
+        if (config->downloadMinSegmentSizeInMB != 0)
+        {
+            s_minSegmentSizeInBytes = static_cast<uint64_t>(config->downloadMinSegmentSizeInMB) * 1024 * 1024;
+        }
+
+        ADUC_ConfigInfo_ReleaseInstance(config);
+    }
+
+    Log_Info(
+        "Downloading payloads in up to %u segments of at least %llu bytes.",
+        s_downloadSegmentCount,
+        static_cast<unsigned long long>(s_minSegmentSizeInBytes));
+}
+
+/**
+ * @brief Gets the number of segments to split the remaining content of a payload into.
+ *
+ * @param bytesToDownload The number of bytes left to download.
+ * @return unsigned int The number of segments. 1 means to download over a single connection.
+ */
+static unsigned int GetSegmentCount(uint64_t bytesToDownload)
+{
+    std::call_once(s_segmentConfigFlag, LoadSegmentConfig);
+
+    const uint64_t segmentCount = std::min<uint64_t>(bytesToDownload / s_minSegmentSizeInBytes, s_downloadSegmentCount);
+    return segmentCount > 1 ? static_cast<unsigned int>(segmentCount) : 1;
+}
+
+/**
+ * @brief Reports InProgress download progress, at most once per k_progressReportInterval.
+ *
+ * @param context The download context.
+ * @param bytesTransferred The number of bytes of the payload downloaded so far.
+ */
+static void ReportProgress(LibcurlDownloadContext* context, uint64_t bytesTransferred)
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (context->downloadProgressCallback != nullptr && now - context->lastProgressReport >= k_progressReportInterval)
+    {
+        context->lastProgressReport = now;
+        context->downloadProgressCallback(
+            context->workflowId,
+            context->entity->FileId,
+            ADUC_DownloadProgressState_InProgress,
+            bytesTransferred,
+            context->entity->SizeInBytes);
+    }
+}
+
+/**
+ * @brief Discards the content of the partial file, e.g. when the server does not honor the Range request.
+ *
+ * @param context The download context.
+ * @return bool true on success.
+ */
+static bool RestartPartialFile(LibcurlDownloadContext* context)
+{
+    if (fflush(context->file) != 0 || ftruncate(fileno(context->file), 0) != 0)
+    {
+        Log_Error("Cannot truncate partial file, errno %d", errno);
+        return false;
+    }
+
+    context->bytesInFile = 0;
+    return ADUC_HashUtils_StreamContext_Reset(context->hashContext);
+}
+
+/**
+ * @brief libcurl CURLOPT_WRITEFUNCTION that appends the received content to the partial file and hashes it.
+ */
+static size_t WriteCallback(char* data, size_t size, size_t nmemb, void* userdata)
+{
+    auto* context = static_cast<LibcurlDownloadContext*>(userdata);
+    const size_t length = size * nmemb;
+
+    if (!context->responseChecked)
+    {
+        context->responseChecked = true;
+
+        long responseCode = 0;
+        curl_easy_getinfo(context->curl, CURLINFO_RESPONSE_CODE, &responseCode);
+
+        // A server that does not support range requests sends the whole content.
+        if (context->bytesInFile > 0 && responseCode != 206)
+        {
+            Log_Info("Server did not resume the download (HTTP %ld). Restarting from the beginning.", responseCode);
+            if (!RestartPartialFile(context))
+            {
+                context->writeFailed = true;
+                return 0;
+            }
+        }
+    }
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+    if (fwrite(data, 1, length, context->file) != length
+        || !ADUC_HashUtils_StreamContext_Update(context->hashContext, bytes, length))
+    {
+        context->writeFailed = true;
+        return 0;
+    }
+
+    context->bytesInFile += length;
+    return length;
+}
+
+/**
+ * @brief libcurl CURLOPT_XFERINFOFUNCTION that reports progress and aborts the transfer on cancellation.
+ */
+static int ProgressCallback(void* userdata, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+    UNREFERENCED_PARAMETER(dltotal);
+    UNREFERENCED_PARAMETER(dlnow);
+    UNREFERENCED_PARAMETER(ultotal);
+    UNREFERENCED_PARAMETER(ulnow);
+
+    auto* context = static_cast<LibcurlDownloadContext*>(userdata);
+
+    if (IsCancelled(context->workflowId))
+    {
+        context->cancelled = true;
+        return 1; // Non-zero aborts the transfer with CURLE_ABORTED_BY_CALLBACK.
+    }
+
+    ReportProgress(context, context->bytesInFile);
+    return 0;
+}
+
+/**
+ * @brief Whether a failed transfer is worth resuming.
+ *
+ * @param curlCode The result of the transfer.
+ * @return bool true for network errors that a later attempt may not hit.
+ */
+static bool IsTransientCurlError(CURLcode curlCode)
+{
+    switch (curlCode)
+    {
+    case CURLE_COULDNT_RESOLVE_HOST:
+    case CURLE_COULDNT_CONNECT:
+    case CURLE_PARTIAL_FILE:
+    case CURLE_OPERATION_TIMEDOUT:
+    case CURLE_SEND_ERROR:
+    case CURLE_RECV_ERROR:
+    case CURLE_GOT_NOTHING:
+    case CURLE_HTTP2:
+    case CURLE_HTTP2_STREAM:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Saves the length of the hashed prefix of a segmented download, once the prefix is on disk.
+ *
+ * @param prefixFilePath The file that keeps the length.
+ * @param partialFd The partial file.
+ * @param prefixLength The length of the hashed prefix.
+ * @return bool true on success.
+ */
+static bool SavePrefixLength(const std::string& prefixFilePath, int partialFd, uint64_t prefixLength)
+{
+    bool succeeded = false;
+    const std::string tempFilePath = prefixFilePath + ".tmp";
+
+    // The content must not be lost after the length that claims it is saved.
+    if (fdatasync(partialFd) != 0)
+    {
+        return false;
+    }
+
+    FILE* file = fopen(tempFilePath.c_str(), "w");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    succeeded = fprintf(file, "%llu\n", static_cast<unsigned long long>(prefixLength)) > 0 && fflush(file) == 0
+        && fsync(fileno(file)) == 0;
+
+    if (fclose(file) != 0)
+    {
+        succeeded = false;
+    }
+
+    // Replaced atomically, so that the length is never torn.
+    if (!succeeded || rename(tempFilePath.c_str(), prefixFilePath.c_str()) != 0)
+    {
+        remove(tempFilePath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Truncates the partial file of a segmented download that did not end, e.g. because the process crashed, to
+ * its hashed prefix, which is the only content known to be contiguous.
+ *
+ * @param partialFilePath The partial file path.
+ * @return bool true on success, including when there was no segmented download in progress.
+ */
+static bool RecoverPartialFile(const std::string& partialFilePath)
+{
+    const std::string prefixFilePath = partialFilePath + k_prefixFileSuffix;
+    unsigned long long prefixLength = 0;
+    bool hasPrefixLength = false;
+    struct stat st;
+
+    FILE* file = fopen(prefixFilePath.c_str(), "r");
+    if (file == nullptr)
+    {
+        return errno == ENOENT;
+    }
+
+    hasPrefixLength = (fscanf(file, "%llu", &prefixLength) == 1);
+    fclose(file);
+
+    if (stat(partialFilePath.c_str(), &st) == 0)
+    {
+        // Without a valid length, nothing in the file is known to be contiguous.
+        const uint64_t bytesToKeep =
+            hasPrefixLength ? std::min<uint64_t>(prefixLength, static_cast<uint64_t>(st.st_size)) : 0;
+
+        Log_Info(
+            "Segmented download of '%s' was interrupted. Keeping its first %llu bytes.",
+            partialFilePath.c_str(),
+            static_cast<unsigned long long>(bytesToKeep));
+
+        if (truncate(partialFilePath.c_str(), static_cast<off_t>(bytesToKeep)) != 0)
+        {
+            return false;
+        }
+    }
+    else if (errno != ENOENT)
+    {
+        return false;
+    }
+
+    return remove(prefixFilePath.c_str()) == 0 || errno == ENOENT;
+}
+
+/**
+ * @brief Hashes the content of an existing partial file so that the download can resume after it.
+ *
+ * @param partialFilePath The partial file path.
+ * @param hashContext The hash context to update.
+ * @param[out] bytesHashed The number of bytes in the partial file.
+ * @return bool true on success, including when there is no partial file.
+ */
+static bool
+HashPartialFile(const char* partialFilePath, ADUC_HashUtils_StreamContext* hashContext, uint64_t* bytesHashed)
+{
+    bool succeeded = false;
+    std::vector<uint8_t> buffer(k_partialFileReadBufferSize);
+    size_t bytesRead = 0;
+
+    *bytesHashed = 0;
+
+    FILE* file = fopen(partialFilePath, "rb");
+    if (file == nullptr)
+    {
+        return errno == ENOENT;
+    }
+
+    while ((bytesRead = fread(buffer.data(), 1, buffer.size(), file)) > 0)
+    {
+        if (!ADUC_HashUtils_StreamContext_Update(hashContext, buffer.data(), bytesRead))
+        {
+            goto done;
+        }
+        *bytesHashed += bytesRead;
+    }
+
+    succeeded = (ferror(file) == 0);
+
+done:
+    fclose(file);
+    return succeeded;
+}
+
+/**
+ * @brief Gets the retry backoff.
+ *
+ * @param stalledAttempts The number of consecutive attempts that received no data.
+ * @return unsigned int The number of seconds to wait before the next attempt.
+ */
+static unsigned int GetRetryDelayInSeconds(unsigned int stalledAttempts)
+{
+    unsigned int delayInSeconds = 1U << (stalledAttempts < 5 ? stalledAttempts : 5);
+    if (delayInSeconds > k_maxRetryDelayInSeconds)
+    {
+        delayInSeconds = k_maxRetryDelayInSeconds;
+    }
+
+    return delayInSeconds;
+}
+
+/**
+ * @brief Sleeps for the retry backoff, waking up early if the workflow is cancelled.
+ *
+ * @param workflowId The workflow id.
+ * @param stalledAttempts The number of consecutive attempts that received no data.
+ * @return bool false if the workflow was cancelled.
+ */
+static bool WaitBeforeRetry(const char* workflowId, unsigned int stalledAttempts)
+{
+    const unsigned int delayInSeconds = GetRetryDelayInSeconds(stalledAttempts);
+
+    for (unsigned int i = 0; i < delayInSeconds; ++i)
+    {
+        if (IsCancelled(workflowId))
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+
+    return !IsCancelled(workflowId);
+}
+
+/**
+ * @brief Sets the options that every transfer of a download uses.
+ *
+ * @param curl The easy handle.
+ * @param downloadUri The URI of the payload.
+ * @param timeoutInSeconds The maximum number of seconds without receiving data. 0 means no timeout.
+ */
+static void SetTransferOptions(CURL* curl, const char* downloadUri, unsigned int timeoutInSeconds)
+{
+    curl_easy_setopt(curl, CURLOPT_URL, downloadUri);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+    if (timeoutInSeconds > 0)
+    {
+        // The timeout bounds how long the download may go without receiving any data, not the whole download.
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, static_cast<long>(timeoutInSeconds));
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, static_cast<long>(timeoutInSeconds));
+    }
+}
+
+/**
+ * @brief Downloads the rest of the payload over a single connection, appending it to the partial file.
+ *
+ * @param context The download context. The partial file must be open for appending.
+ * @param timeoutInSeconds The maximum number of seconds without receiving data. 0 means no timeout.
+ * @param[out] responseCode The HTTP response code of the last attempt.
+ * @return CURLcode The result of the last attempt. CURLE_OK when the payload is downloaded.
+ */
+static CURLcode
+DownloadInSingleStream(LibcurlDownloadContext* context, unsigned int timeoutInSeconds, long* responseCode)
+{
+    const ADUC_FileEntity* entity = context->entity;
+    CURLcode curlCode = CURLE_OK;
+    unsigned int stalledAttempts = 0;
+    std::chrono::steady_clock::time_point lastDataReceived;
+
+    CURL* curl = curl_easy_init();
+    if (curl == nullptr)
+    {
+        return CURLE_FAILED_INIT;
+    }
+
+    context->curl = curl;
+
+    SetTransferOptions(curl, entity->DownloadUri, timeoutInSeconds);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, context);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, ProgressCallback);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, context);
+
+    lastDataReceived = std::chrono::steady_clock::now();
+
+    for (;;)
+    {
+        const uint64_t bytesBeforeAttempt = context->bytesInFile;
+
+        if (entity->SizeInBytes > 0 && context->bytesInFile == entity->SizeInBytes)
+        {
+            // Everything was downloaded by an earlier attempt.
+            curlCode = CURLE_OK;
+            break;
+        }
+
+        context->responseChecked = false;
+        curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, static_cast<curl_off_t>(context->bytesInFile));
+
+        curlCode = curl_easy_perform(curl);
+
+        if (curlCode == CURLE_OK || context->writeFailed || context->cancelled)
+        {
+            break;
+        }
+
+        *responseCode = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, responseCode);
+
+        if (curlCode == CURLE_HTTP_RETURNED_ERROR && *responseCode == 416 && context->bytesInFile > 0)
+        {
+            // Range not satisfiable: the partial file does not belong to this payload.
+            Log_Info("Server rejected the resume range. Restarting from the beginning.");
+            if (!RestartPartialFile(context))
+            {
+                context->writeFailed = true;
+                break;
+            }
+            continue;
+        }
+
+        if (!IsTransientCurlError(curlCode))
+        {
+            break;
+        }
+
+        if (context->bytesInFile != bytesBeforeAttempt)
+        {
+            stalledAttempts = 0;
+            lastDataReceived = std::chrono::steady_clock::now();
+        }
+        else
+        {
+            ++stalledAttempts;
+        }
+
+        if (stalledAttempts >= k_maxStalledAttempts
+            || (timeoutInSeconds > 0
+                && std::chrono::steady_clock::now() - lastDataReceived >= std::chrono::seconds(timeoutInSeconds)))
+        {
+            Log_Error("Giving up on download after %u attempts without receiving data.", stalledAttempts);
+            break;
+        }
+
+        Log_Warn(
+            "Download of '%s' interrupted at %llu bytes: %s. Resuming.",
+            entity->TargetFilename,
+            static_cast<unsigned long long>(context->bytesInFile),
+            curl_easy_strerror(curlCode));
+
+        if (!WaitBeforeRetry(context->workflowId, stalledAttempts))
+        {
+            context->cancelled = true;
+            break;
+        }
+    }
+
+    context->curl = nullptr;
+    curl_easy_cleanup(curl);
+    return curlCode;
+}
+
+/**
+ * @brief Allocates the disk space of the whole payload for the partial file, so that running out of disk space fails
+ * the download before it starts and the segments are not fragmented on disk.
+ *
+ * @details The size of the file is kept, so that it never claims content that was not downloaded.
+ *
+ * @param fd The partial file.
+ * @param size The size of the payload.
+ * @return bool true on success, or when the file system does not support preallocation.
+ */
+static bool PreallocateFile(int fd, uint64_t size)
+{
+    if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size)) == 0)
+    {
+        return true;
+    }
+
+    // The file then grows as the segments are written.
+    return errno == EOPNOTSUPP || errno == ENOSYS;
+}
+
+/**
+ * @brief Hashes the content written right after the hashed prefix, up to the first byte not written yet.
+ *
+ * @param download The segmented download.
+ * @return bool true on success.
+ */
+static bool AdvanceHashedPrefix(LibcurlSegmentedDownload* download)
+{
+    LibcurlDownloadContext* context = download->context;
+
+    while (download->hashSegmentIndex < download->segments.size())
+    {
+        const LibcurlSegment& segment = download->segments[download->hashSegmentIndex];
+        const uint64_t writtenEnd = segment.offset + segment.bytesWritten;
+
+        while (context->bytesInFile < writtenEnd)
+        {
+            const size_t bytesToRead =
+                static_cast<size_t>(std::min<uint64_t>(download->readBuffer.size(), writtenEnd - context->bytesInFile));
+            const ssize_t bytesRead = pread(
+                download->fd, download->readBuffer.data(), bytesToRead, static_cast<off_t>(context->bytesInFile));
+            if (bytesRead < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (bytesRead <= 0
+                || !ADUC_HashUtils_StreamContext_Update(
+                    context->hashContext, download->readBuffer.data(), static_cast<size_t>(bytesRead)))
+            {
+                return false;
+            }
+
+            context->bytesInFile += static_cast<uint64_t>(bytesRead);
+        }
+
+        if (writtenEnd < segment.end)
+        {
+            break;
+        }
+
+        ++download->hashSegmentIndex;
+    }
+
+    return true;
+}
+
+/**
+ * @brief libcurl CURLOPT_WRITEFUNCTION that writes the received content of a segment in place in the partial file.
+ */
+static size_t SegmentWriteCallback(char* data, size_t size, size_t nmemb, void* userdata)
+{
+    auto* segment = static_cast<LibcurlSegment*>(userdata);
+    LibcurlSegmentedDownload* download = segment->download;
+    LibcurlDownloadContext* context = download->context;
+    const size_t length = size * nmemb;
+    const uint64_t offset = segment->offset + segment->bytesWritten;
+    size_t bytesWritten = 0;
+
+    if (!segment->responseChecked)
+    {
+        segment->responseChecked = true;
+
+        long responseCode = 0;
+        curl_easy_getinfo(segment->curl, CURLINFO_RESPONSE_CODE, &responseCode);
+
+        if (responseCode != 206)
+        {
+            Log_Info("Server did not honor the range request (HTTP %ld).", responseCode);
+            download->rangeNotSupported = true;
+            return 0;
+        }
+    }
+
+    if (length > segment->end - offset)
+    {
+        Log_Info("Server sent more content than the requested range.");
+        download->rangeNotSupported = true;
+        return 0;
+    }
+
+    while (bytesWritten < length)
+    {
+        const ssize_t result =
+            pwrite(download->fd, data + bytesWritten, length - bytesWritten, static_cast<off_t>(offset + bytesWritten));
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (result <= 0)
+        {
+            context->writeFailed = true;
+            return 0;
+        }
+
+        bytesWritten += static_cast<size_t>(result);
+    }
+
+    segment->bytesWritten += length;
+    download->bytesWritten += length;
+
+    // Content that extends the hashed prefix is hashed from the buffer; content written ahead of it is read back
+    // from the file once the segments before it are complete.
+    if (offset == context->bytesInFile)
+    {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+        if (!ADUC_HashUtils_StreamContext_Update(context->hashContext, bytes, length))
+        {
+            context->writeFailed = true;
+            return 0;
+        }
+
+        context->bytesInFile += length;
+    }
+
+    if (!AdvanceHashedPrefix(download))
+    {
+        context->writeFailed = true;
+        return 0;
+    }
+
+    return length;
+}
+
+/**
+ * @brief Adds a segment to the multi handle, requesting the part of its range that has not been written yet.
+ *
+ * @param multi The multi handle.
+ * @param segment The segment.
+ * @return bool true on success.
+ */
+static bool StartSegment(CURLM* multi, LibcurlSegment* segment)
+{
+    const std::string range =
+        std::to_string(segment->offset + segment->bytesWritten) + "-" + std::to_string(segment->end - 1);
+
+    curl_easy_setopt(segment->curl, CURLOPT_RANGE, range.c_str());
+
+    segment->responseChecked = false;
+    segment->waitingForRetry = false;
+    segment->bytesWrittenBeforeAttempt = segment->bytesWritten;
+
+    if (curl_multi_add_handle(multi, segment->curl) != CURLM_OK)
+    {
+        return false;
+    }
+
+    segment->active = true;
+    return true;
+}
+
+/**
+ * @brief Downloads the rest of the payload in segments over concurrent connections.
+ *
+ * @details The segments are written in place in the partial file. When the download does not complete, the partial
+ * file is truncated to the hashed prefix so that a later attempt resumes after it. Until then, the length of the
+ * prefix is kept in a file, for RecoverPartialFile to truncate the partial file if the process dies.
+ *
+ * @param context The download context.
+ * @param partialFilePath The partial file path.
+ * @param segmentCount The number of segments.
+ * @param timeoutInSeconds The maximum number of seconds without receiving data. 0 means no timeout.
+ * @param[out] curlCode The result of the failed transfer, if any.
+ * @param[out] responseCode The HTTP response code of the failed transfer, if any.
+ * @return bool false if the payload should be downloaded over a single connection instead, e.g. when the server does
+ * not support range requests.
+ */
+static bool DownloadInSegments(
+    LibcurlDownloadContext* context,
+    const char* partialFilePath,
+    unsigned int segmentCount,
+    unsigned int timeoutInSeconds,
+    CURLcode* curlCode,
+    long* responseCode)
+{
+    bool useSegments = true;
+    bool completed = false;
+    const ADUC_FileEntity* entity = context->entity;
+    const uint64_t fileSize = entity->SizeInBytes;
+    const uint64_t firstOffset = context->bytesInFile;
+    const uint64_t segmentLength = (fileSize - firstOffset + segmentCount - 1) / segmentCount;
+    const std::string prefixFilePath = std::string{ partialFilePath } + k_prefixFileSuffix;
+    bool prefixFileSaved = false;
+    uint64_t savedPrefixLength = firstOffset;
+    CURLM* multi = nullptr;
+    LibcurlSegmentedDownload download = {};
+    uint64_t lastBytesWritten = 0;
+    std::chrono::steady_clock::time_point lastDataReceived;
+
+    *curlCode = CURLE_OK;
+
+    download.context = context;
+    download.readBuffer.resize(k_partialFileReadBufferSize);
+    download.fd = open(partialFilePath, O_RDWR | O_CLOEXEC);
+    if (download.fd < 0)
+    {
+        context->writeFailed = true;
+        goto done;
+    }
+
+    if (!PreallocateFile(download.fd, fileSize))
+    {
+        Log_Error(
+            "Cannot allocate %llu bytes for '%s', errno %d",
+            static_cast<unsigned long long>(fileSize),
+            partialFilePath,
+            errno);
+        context->writeFailed = true;
+        goto done;
+    }
+
+    // Before anything is written ahead of the prefix.
+    if (!SavePrefixLength(prefixFilePath, download.fd, firstOffset))
+    {
+        Log_Error("Cannot save the state of the download to '%s', errno %d", prefixFilePath.c_str(), errno);
+        context->writeFailed = true;
+        goto done;
+    }
+
+    prefixFileSaved = true;
+
+    multi = curl_multi_init();
+    if (multi == nullptr)
+    {
+        useSegments = false;
+        goto done;
+    }
+
+    // The easy handles point to the segments, so the vector must not be resized from here on.
+    download.segments.resize(segmentCount);
+    for (unsigned int i = 0; i < segmentCount; ++i)
+    {
+        LibcurlSegment* segment = &download.segments[i];
+
+        segment->download = &download;
+        segment->offset = firstOffset + i * segmentLength;
+        segment->end = std::min(segment->offset + segmentLength, fileSize);
+        segment->curl = curl_easy_init();
+        if (segment->curl == nullptr)
+        {
+            useSegments = false;
+            goto done;
+        }
+
+        SetTransferOptions(segment->curl, entity->DownloadUri, timeoutInSeconds);
+        curl_easy_setopt(segment->curl, CURLOPT_WRITEFUNCTION, SegmentWriteCallback);
+        curl_easy_setopt(segment->curl, CURLOPT_WRITEDATA, segment);
+        curl_easy_setopt(segment->curl, CURLOPT_PRIVATE, segment);
+
+        if (!StartSegment(multi, segment))
+        {
+            useSegments = false;
+            goto done;
+        }
+    }
+
+    Log_Info(
+        "Downloading File '%s' from '%s' in %u segments of %llu bytes, starting at %llu bytes",
+        entity->TargetFilename,
+        entity->DownloadUri,
+        segmentCount,
+        static_cast<unsigned long long>(segmentLength),
+        static_cast<unsigned long long>(firstOffset));
+
+    lastDataReceived = std::chrono::steady_clock::now();
+
+    for (;;)
+    {
+        int runningHandles = 0;
+        int messagesLeft = 0;
+        CURLMsg* message = nullptr;
+        bool failed = false;
+
+        if (curl_multi_perform(multi, &runningHandles) != CURLM_OK)
+        {
+            useSegments = false;
+            break;
+        }
+
+        while (!failed && (message = curl_multi_info_read(multi, &messagesLeft)) != nullptr)
+        {
+            if (message->msg != CURLMSG_DONE)
+            {
+                continue;
+            }
+
+            char* privateData = nullptr;
+            curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &privateData);
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            auto* segment = reinterpret_cast<LibcurlSegment*>(privateData);
+
+            CURLcode segmentCode = message->data.result;
+            curl_multi_remove_handle(multi, segment->curl);
+            segment->active = false;
+
+            if (segmentCode == CURLE_OK && segment->offset + segment->bytesWritten < segment->end)
+            {
+                segmentCode = CURLE_PARTIAL_FILE;
+            }
+
+            if (segmentCode == CURLE_OK || context->writeFailed || download.rangeNotSupported)
+            {
+                continue;
+            }
+
+            if (!IsTransientCurlError(segmentCode))
+            {
+                *curlCode = segmentCode;
+                curl_easy_getinfo(segment->curl, CURLINFO_RESPONSE_CODE, responseCode);
+                failed = true;
+                break;
+            }
+
+            if (segment->bytesWritten != segment->bytesWrittenBeforeAttempt)
+            {
+                segment->stalledAttempts = 0;
+            }
+            else if (++segment->stalledAttempts >= k_maxStalledAttempts)
+            {
+                Log_Error("Giving up on download after %u attempts without receiving data.", segment->stalledAttempts);
+                *curlCode = segmentCode;
+                failed = true;
+                break;
+            }
+
+            Log_Warn(
+                "Download of '%s' interrupted at %llu bytes: %s. Resuming.",
+                entity->TargetFilename,
+                static_cast<unsigned long long>(segment->offset + segment->bytesWritten),
+                curl_easy_strerror(segmentCode));
+
+            segment->waitingForRetry = true;
+            segment->retryAt = std::chrono::steady_clock::now()
+                + std::chrono::seconds(GetRetryDelayInSeconds(segment->stalledAttempts));
+        }
+
+        if (failed || context->writeFailed)
+        {
+            break;
+        }
+
+        if (download.rangeNotSupported)
+        {
+            useSegments = false;
+            break;
+        }
+
+        if (context->bytesInFile == fileSize)
+        {
+            completed = true;
+            break;
+        }
+
+        if (IsCancelled(context->workflowId))
+        {
+            context->cancelled = true;
+            break;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+
+        if (download.bytesWritten != lastBytesWritten)
+        {
+            lastBytesWritten = download.bytesWritten;
+            lastDataReceived = now;
+        }
+        else if (timeoutInSeconds > 0 && now - lastDataReceived >= std::chrono::seconds(timeoutInSeconds))
+        {
+            Log_Error("Giving up on download after %u seconds without receiving data.", timeoutInSeconds);
+            *curlCode = CURLE_OPERATION_TIMEDOUT;
+            break;
+        }
+
+        ReportProgress(context, firstOffset + download.bytesWritten);
+
+        if (context->bytesInFile - savedPrefixLength >= k_prefixCheckpointIntervalInBytes)
+        {
+            // A failure only makes a resume after a crash start from an earlier offset.
+            if (SavePrefixLength(prefixFilePath, download.fd, context->bytesInFile))
+            {
+                savedPrefixLength = context->bytesInFile;
+            }
+        }
+
+        for (LibcurlSegment& segment : download.segments)
+        {
+            if (segment.waitingForRetry && now >= segment.retryAt && !StartSegment(multi, &segment))
+            {
+                useSegments = false;
+                break;
+            }
+        }
+
+        if (!useSegments)
+        {
+            break;
+        }
+
+        curl_multi_wait(multi, nullptr, 0, k_segmentPollIntervalInMilliseconds, nullptr);
+    }
+
+done:
+
+    for (LibcurlSegment& segment : download.segments)
+    {
+        if (segment.curl != nullptr)
+        {
+            if (segment.active)
+            {
+                curl_multi_remove_handle(multi, segment.curl);
+            }
+            curl_easy_cleanup(segment.curl);
+        }
+    }
+
+    if (multi != nullptr)
+    {
+        curl_multi_cleanup(multi);
+    }
+
+    if (download.fd >= 0)
+    {
+        // Keep only the hashed prefix, which is contiguous, so that the download can be resumed after it.
+        if (!completed && ftruncate(download.fd, static_cast<off_t>(context->bytesInFile)) != 0)
+        {
+            Log_Error("Cannot truncate partial file, errno %d", errno);
+            context->writeFailed = true;
+            useSegments = true;
+        }
+        else if (prefixFileSaved && remove(prefixFilePath.c_str()) != 0)
+        {
+            // Harmless: the next download truncates the partial file to the last saved length.
+            Log_Warn("Cannot remove '%s', errno %d", prefixFilePath.c_str(), errno);
+        }
+
+        if (close(download.fd) != 0)
+        {
+            context->writeFailed = true;
+            useSegments = true;
+        }
+    }
+
+    return useSegments;
+}
+
+/**
+ * @brief Downloads the file entity with libcurl, resuming a partial download and hashing the content as it is written.
+ *
+ * @param entity The file entity to download.
+ * @param workflowId The workflow id.
+ * @param workFolder The work folder for the update payloads.
+ * @param timeoutInSeconds The maximum number of seconds without receiving data before the download times out. 0 means no timeout.
+ * @param downloadProgressCallback The download progress callback.
+ * @param[out] verifiedDigest The verified digest token of the downloaded file. Left empty when the download is skipped or fails.
+ * @return ADUC_Result The result.
+ */
+static ADUC_Result DownloadAndDigest_libcurl(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int timeoutInSeconds,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    ADUC_VerifiedDigest* verifiedDigest)
+{
+    ADUC_Result result = { ADUC_Result_Failure };
+    SHAversion algVersion;
+    std::stringstream fullFilePath;
+    std::string partialFilePath;
+    bool reportProgress = false;
+    CURLcode curlCode = CURLE_OK;
+    long responseCode = 0;
+    unsigned int segmentCount = 1;
+    ADUC_HashUtils_StreamContext hashContext = {};
+    LibcurlDownloadContext context = {};
+
+    memset(verifiedDigest, 0, sizeof(*verifiedDigest));
+
+    if (entity == nullptr)
+    {
+        result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_INVALID_FILE_ENTITY;
+        goto done;
+    }
+
+    if (entity->DownloadUri == nullptr || *entity->DownloadUri == 0)
+    {
+        result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_INVALID_DOWNLOAD_URI;
+        goto done;
+    }
+
+    if (entity->HashCount == 0)
+    {
+        Log_Error("File entity does not contain a file hash! Cannot validate cancelling download.");
+        result.ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_IS_EMPTY;
+        reportProgress = true;
+        goto done;
+    }
+
+    fullFilePath << workFolder << "/" << entity->TargetFilename;
+    partialFilePath = fullFilePath.str() + ".partial";
+
+    if (!ADUC_HashUtils_GetShaVersionForTypeString(
+            ADUC_HashUtils_GetHashType(entity->Hash, entity->HashCount, 0), &algVersion))
+    {
+        Log_Error(
+            "FileEntity for %s has unsupported hash type %s",
+            fullFilePath.str().c_str(),
+            ADUC_HashUtils_GetHashType(entity->Hash, entity->HashCount, 0));
+        result.ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_TYPE_NOT_SUPPORTED;
+        reportProgress = true;
+        goto done;
+    }
+
+    // If target file exists, validate file hash.
+    // If file is valid, then skip the download.
+    if (ADUC_HashUtils_IsValidFileHash(
+            fullFilePath.str().c_str(),
+            ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0),
+            algVersion,
+            true /* suppressErrorLog */))
+    {
+        result = { ADUC_Result_Download_Skipped_FileExists };
+        reportProgress = true;
+        goto done;
+    }
+
+    if (!EnsureCurlGlobalInit())
+    {
+        Log_Error("curl_global_init failed: %d", s_curlGlobalInitResult);
+        result.ExtendedResultCode = ADUC_ERROR_LIBCURL_DOWNLOADER_INIT_FAILURE;
+        reportProgress = true;
+        goto done;
+    }
+
+    if (!ADUC_HashUtils_StreamContext_Init(&hashContext, algVersion))
+    {
+        result.ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_TYPE_NOT_SUPPORTED;
+        reportProgress = true;
+        goto done;
+    }
+
+    context.hashContext = &hashContext;
+    context.entity = entity;
+    context.workflowId = workflowId;
+    context.downloadProgressCallback = downloadProgressCallback;
+
+    // Resume after the content that an earlier, interrupted download left in the partial file.
+    if (!RecoverPartialFile(partialFilePath) || !HashPartialFile(partialFilePath.c_str(), &hashContext, &context.bytesInFile))
+    {
+        Log_Error("Cannot read partial file '%s', errno %d", partialFilePath.c_str(), errno);
+        result.ExtendedResultCode = ADUC_ERROR_LIBCURL_DOWNLOADER_CANNOT_READ_PARTIAL_FILE;
+        reportProgress = true;
+        goto done;
+    }
+
+    context.file = fopen(partialFilePath.c_str(), "ab");
+    if (context.file == nullptr)
+    {
+        Log_Error("Cannot open '%s' for writing, errno %d", partialFilePath.c_str(), errno);
+        result.ExtendedResultCode = ADUC_ERROR_LIBCURL_DOWNLOADER_CANNOT_WRITE_FILE;
+        reportProgress = true;
+        goto done;
+    }
+
+    if (entity->SizeInBytes > 0 && context.bytesInFile > entity->SizeInBytes)
+    {
+        Log_Warn("Partial file '%s' is larger than the payload. Discarding it.", partialFilePath.c_str());
+        if (!RestartPartialFile(&context))
+        {
+            result.ExtendedResultCode = ADUC_ERROR_LIBCURL_DOWNLOADER_CANNOT_WRITE_FILE;
+            reportProgress = true;
+            goto done;
+        }
+    }
+
+    if (entity->SizeInBytes > 0)
+    {
+        segmentCount = GetSegmentCount(entity->SizeInBytes - context.bytesInFile);
+    }
+
+    if (segmentCount <= 1
+        || !DownloadInSegments(
+            &context, partialFilePath.c_str(), segmentCount, timeoutInSeconds, &curlCode, &responseCode))
+    {
+        Log_Info(
+            "Downloading File '%s' from '%s' to '%s', resuming at %llu bytes",
+            entity->TargetFilename,
+            entity->DownloadUri,
+            fullFilePath.str().c_str(),
+            static_cast<unsigned long long>(context.bytesInFile));
+
+        curlCode = DownloadInSingleStream(&context, timeoutInSeconds, &responseCode);
+    }
+
+    if (fclose(context.file) != 0)
+    {
+        context.writeFailed = true;
+    }
+    context.file = nullptr;
+
+    if (context.cancelled)
+    {
+        Log_Info(
+            "Download of '%s' cancelled at %llu bytes.",
+            entity->TargetFilename,
+            static_cast<unsigned long long>(context.bytesInFile));
+        result = { ADUC_Result_Failure_Cancelled };
+        reportProgress = true;
+        goto done;
+    }
+
+    if (context.writeFailed)
+    {
+        Log_Error("Failed to write '%s', errno %d", partialFilePath.c_str(), errno);
+        result.ExtendedResultCode = ADUC_ERROR_LIBCURL_DOWNLOADER_CANNOT_WRITE_FILE;
+        reportProgress = true;
+        goto done;
+    }
+
+    if (curlCode != CURLE_OK)
+    {
+        Log_Error("Download failed: %s (%d)", curl_easy_strerror(curlCode), curlCode);
+        if (curlCode == CURLE_FAILED_INIT)
+        {
+            result.ExtendedResultCode = ADUC_ERROR_LIBCURL_DOWNLOADER_INIT_FAILURE;
+        }
+        else if (curlCode == CURLE_HTTP_RETURNED_ERROR)
+        {
+            Log_Error("HTTP response code %ld", responseCode);
+            result.ExtendedResultCode = ADUC_ERROR_LIBCURL_DOWNLOADER_HTTP_FAILURE;
+        }
+        else
+        {
+            result.ExtendedResultCode = ADUC_ERROR_LIBCURL_DOWNLOADER_CURL_FAILURE(curlCode);
+        }
+        reportProgress = true;
+        goto done;
+    }
+
+    if (rename(partialFilePath.c_str(), fullFilePath.str().c_str()) != 0)
+    {
+        Log_Error("Cannot rename '%s' to '%s', errno %d", partialFilePath.c_str(), fullFilePath.str().c_str(), errno);
+        result.ExtendedResultCode = ADUC_ERROR_LIBCURL_DOWNLOADER_CANNOT_WRITE_FILE;
+        reportProgress = true;
+        goto done;
+    }
+
+    // Note: Currently we expect there to be only one hash, but
+    // support for multiple hashes is already built in.
+    Log_Info("Validating file hash");
+
+    if (!ADUC_HashUtils_StreamContext_FinalizeToVerifiedDigest(
+            &hashContext,
+            ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0),
+            fullFilePath.str().c_str(),
+            verifiedDigest))
+    {
+        Log_Error("Hash for %s is not valid", entity->TargetFilename);
+
+        // Do not resume from corrupted content next time.
+        remove(fullFilePath.str().c_str());
+
+        result.ExtendedResultCode = ADUC_ERC_VALIDATION_FILE_HASH_INVALID_HASH;
+        reportProgress = true;
+        goto done;
+    }
+
+    result = { ADUC_Result_Download_Success };
+    reportProgress = true;
+
+done:
+
+    if (context.file != nullptr)
+    {
+        fclose(context.file);
+    }
+
+    ADUC_HashUtils_StreamContext_UnInit(&hashContext);
+
+    if (reportProgress && (downloadProgressCallback != nullptr))
+    {
+        if (IsAducResultCodeSuccess(result.ResultCode))
+        {
+            struct stat st;
+            const off_t fileSize{ (stat(fullFilePath.str().c_str(), &st) == 0) ? st.st_size : 0 };
+            downloadProgressCallback(
+                workflowId, entity->FileId, ADUC_DownloadProgressState_Completed, fileSize, entity->SizeInBytes);
+        }
+        else
+        {
+            downloadProgressCallback(
+                workflowId,
+                entity->FileId,
+                (result.ResultCode == ADUC_Result_Failure_Cancelled) ? ADUC_DownloadProgressState_Cancelled
+                                                                     : ADUC_DownloadProgressState_Error,
+                context.bytesInFile,
+                entity->SizeInBytes);
+        }
+    }
+
+    Log_Info(
+        "Download task end. resultCode: %d, extendedCode: %d (0x%X)",
+        result.ResultCode,
+        result.ExtendedResultCode,
+        result.ExtendedResultCode);
+    return result;
+}
+
+ADUC_Result Initialize_libcurl(const char* initializeData)
+{
+    UNREFERENCED_PARAMETER(initializeData);
+
+    if (!EnsureCurlGlobalInit())
+    {
+        Log_Error("curl_global_init failed: %d", s_curlGlobalInitResult);
+        return { ADUC_GeneralResult_Failure, ADUC_ERROR_LIBCURL_DOWNLOADER_INIT_FAILURE };
+    }
+
+    return { ADUC_GeneralResult_Success };
+}
+
+void SetDownloadCancellationCallback_libcurl(ADUC_DownloadCancellationCallback cancellationCallback)
+{
+    if (cancellationCallback == nullptr)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock{ s_cancellationCallbacksMutex };
+    if (std::find(s_cancellationCallbacks.begin(), s_cancellationCallbacks.end(), cancellationCallback)
+        == s_cancellationCallbacks.end())
+    {
+        s_cancellationCallbacks.push_back(cancellationCallback);
+    }
+}
+
+ADUC_Result Download_libcurl(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int timeoutInSeconds,
+    ADUC_DownloadProgressCallback downloadProgressCallback)
+{
+    ADUC_VerifiedDigest verifiedDigest;
+    return DownloadAndDigest_libcurl(
+        entity, workflowId, workFolder, timeoutInSeconds, downloadProgressCallback, &verifiedDigest);
+}
+
+ADUC_Result DownloadWithDigest_libcurl(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int timeoutInSeconds,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    ADUC_VerifiedDigest* verifiedDigest)
+{
+    if (verifiedDigest == nullptr)
+    {
+        return Download_libcurl(entity, workflowId, workFolder, timeoutInSeconds, downloadProgressCallback);
+    }
+
+    return DownloadAndDigest_libcurl(
+        entity, workflowId, workFolder, timeoutInSeconds, downloadProgressCallback, verifiedDigest);
+}
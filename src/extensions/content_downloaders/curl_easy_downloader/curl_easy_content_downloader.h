@@ -0,0 +1,34 @@
+/**
+ * @file curl_easy_content_downloader.h
+ * @brief Content Downloader Extension using libcurl.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef CURL_EASY_CONTENT_DOWNLOADER_H
+#define CURL_EASY_CONTENT_DOWNLOADER_H
+
+#include <aduc/result.h> // for ADUC_Result
+#include <aduc/types/download.h> // for ADUC_DownloadProgressCallback, ADUC_VerifiedDigest, ADUC_DownloadCancellationCallback
+#include <aduc/types/update_content.h> // for ADUC_FileEntity
+
+ADUC_Result Initialize_libcurl(const char* initializeData);
+
+void SetDownloadCancellationCallback_libcurl(ADUC_DownloadCancellationCallback cancellationCallback);
+
+ADUC_Result Download_libcurl(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int timeoutInSeconds,
+    ADUC_DownloadProgressCallback downloadProgressCallback);
+
+ADUC_Result DownloadWithDigest_libcurl(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int timeoutInSeconds,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    ADUC_VerifiedDigest* verifiedDigest);
+
+#endif // CURL_EASY_CONTENT_DOWNLOADER_H
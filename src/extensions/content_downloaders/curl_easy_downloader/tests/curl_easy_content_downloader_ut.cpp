@@ -0,0 +1,348 @@
+/**
+ * @file curl_easy_content_downloader_ut.cpp
+ * @brief Unit Tests for the libcurl content downloader.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "curl_easy_content_downloader.h"
+
+#include <aduc/calloc_wrapper.hpp> // ADUC::StringUtils::cstr_wrapper
+#include <aduc/hash_utils.h>
+#include <aduc/system_utils.h>
+#include <aduc/types/adu_core.h> // ADUC_Result_Download_Success
+
+#include <catch2/catch_all.hpp>
+
+#include <arpa/inet.h> // htonl
+#include <chrono>
+#include <csignal> // kill, SIGKILL
+#include <fstream>
+#include <functional>
+#include <netinet/in.h> // sockaddr_in
+#include <random>
+#include <sstream>
+#include <string>
+#include <strings.h> // strncasecmp
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h> // waitpid
+#include <thread>
+#include <unistd.h> // fork, close
+#include <vector>
+
+/**
+ * @brief A minimal HTTP server that serves one file and honors Range requests, in a child process.
+ *
+ * @details While the "stall" file exists in its folder, it stops sending each response after stallAfterBytes, as a
+ * server that stops responding would. It appends the first offset of every request to its "requests" file.
+ */
+class TestHttpServer
+{
+public:
+    TestHttpServer(const std::string& folder, const std::string& content, size_t stallAfterBytes)
+        : m_folder{ folder }, m_content{ content }, m_stallAfterBytes{ stallAfterBytes }
+    {
+        sockaddr_in address = {};
+        socklen_t addressLength = sizeof(address);
+
+        m_listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        REQUIRE(m_listenFd >= 0);
+
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        REQUIRE(bind(m_listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+        REQUIRE(listen(m_listenFd, 16) == 0);
+        REQUIRE(getsockname(m_listenFd, reinterpret_cast<sockaddr*>(&address), &addressLength) == 0);
+        m_port = ntohs(address.sin_port);
+
+        m_pid = fork();
+        REQUIRE(m_pid >= 0);
+        if (m_pid == 0)
+        {
+            Serve();
+            _exit(0);
+        }
+
+        close(m_listenFd);
+    }
+
+    ~TestHttpServer()
+    {
+        kill(m_pid, SIGKILL);
+        waitpid(m_pid, nullptr, 0);
+    }
+
+    TestHttpServer(const TestHttpServer&) = delete;
+    TestHttpServer& operator=(const TestHttpServer&) = delete;
+    TestHttpServer(TestHttpServer&&) = delete;
+    TestHttpServer& operator=(TestHttpServer&&) = delete;
+
+    std::string Url() const
+    {
+        return "http://127.0.0.1:" + std::to_string(m_port) + "/payload.bin";
+    }
+
+    std::vector<uint64_t> GetRequestOffsets() const
+    {
+        std::vector<uint64_t> offsets;
+        std::ifstream file{ m_folder + "/requests" };
+        uint64_t offset = 0;
+        while (file >> offset)
+        {
+            offsets.push_back(offset);
+        }
+
+        return offsets;
+    }
+
+private:
+    void Serve()
+    {
+        for (;;)
+        {
+            const int fd = accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0)
+            {
+                std::thread{ [this, fd]() { HandleConnection(fd); } }.detach();
+            }
+        }
+    }
+
+    bool IsStalling() const
+    {
+        struct stat st = {};
+        return stat((m_folder + "/stall").c_str(), &st) == 0;
+    }
+
+    void HandleConnection(int fd)
+    {
+        std::string request;
+        char buffer[4096];
+        uint64_t first = 0;
+        uint64_t last = m_content.size() - 1;
+        bool hasRange = false;
+
+        while (request.find("\r\n\r\n") == std::string::npos)
+        {
+            const ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+            if (received <= 0)
+            {
+                close(fd);
+                return;
+            }
+            request.append(buffer, static_cast<size_t>(received));
+        }
+
+        std::istringstream lines{ request };
+        std::string line;
+        while (std::getline(lines, line))
+        {
+            unsigned long long rangeFirst = 0;
+            unsigned long long rangeLast = 0;
+            if (strncasecmp(line.c_str(), "Range: bytes=", 13) != 0)
+            {
+                continue;
+            }
+
+            hasRange = true;
+            const int fields = sscanf(line.c_str() + 13, "%llu-%llu", &rangeFirst, &rangeLast);
+            first = rangeFirst;
+            if (fields == 2)
+            {
+                last = rangeLast;
+            }
+        }
+
+        {
+            std::ofstream requests{ m_folder + "/requests", std::ios::app };
+            requests << first << "\n";
+        }
+
+        std::string header = hasRange ? "HTTP/1.1 206 Partial Content\r\n" : "HTTP/1.1 200 OK\r\n";
+        header += "Content-Length: " + std::to_string(last - first + 1) + "\r\n";
+        if (hasRange)
+        {
+            header += "Content-Range: bytes " + std::to_string(first) + "-" + std::to_string(last) + "/"
+                + std::to_string(m_content.size()) + "\r\n";
+        }
+        header += "Connection: close\r\n\r\n";
+
+        if (send(fd, header.data(), header.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(header.size()))
+        {
+            uint64_t offset = first;
+            while (offset <= last)
+            {
+                if (offset - first >= m_stallAfterBytes && IsStalling())
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                    continue;
+                }
+
+                const size_t length = static_cast<size_t>(std::min<uint64_t>(64 * 1024, last - offset + 1));
+                const ssize_t sent = send(fd, m_content.data() + offset, length, MSG_NOSIGNAL);
+                if (sent <= 0)
+                {
+                    break;
+                }
+                offset += static_cast<uint64_t>(sent);
+            }
+        }
+
+        close(fd);
+    }
+
+    std::string m_folder;
+    std::string m_content;
+    size_t m_stallAfterBytes;
+    int m_listenFd = -1;
+    unsigned short m_port = 0;
+    pid_t m_pid = -1;
+};
+
+class DownloadTestCaseFixture
+{
+public:
+    DownloadTestCaseFixture() : m_testPath{ std::string{ ADUC_SystemUtils_GetTemporaryPathName() } + "/curl_easy_ut" }
+    {
+        (void)ADUC_SystemUtils_RmDirRecursive(m_testPath.c_str());
+        REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault(WorkFolder().c_str()) == 0);
+    }
+
+    ~DownloadTestCaseFixture()
+    {
+        (void)ADUC_SystemUtils_RmDirRecursive(m_testPath.c_str());
+    }
+
+    DownloadTestCaseFixture(const DownloadTestCaseFixture&) = delete;
+    DownloadTestCaseFixture& operator=(const DownloadTestCaseFixture&) = delete;
+    DownloadTestCaseFixture(DownloadTestCaseFixture&&) = delete;
+    DownloadTestCaseFixture& operator=(DownloadTestCaseFixture&&) = delete;
+
+    const std::string& TestPath() const
+    {
+        return m_testPath;
+    }
+
+    std::string WorkFolder() const
+    {
+        return m_testPath + "/work";
+    }
+
+    static uint64_t FileSize(const std::string& path)
+    {
+        struct stat st = {};
+        return stat(path.c_str(), &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+    }
+
+    static bool WaitUntil(const std::function<bool()>& condition)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+        while (!condition())
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+            {
+                return false;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+
+        return true;
+    }
+
+private:
+    std::string m_testPath;
+};
+
+TEST_CASE_METHOD(DownloadTestCaseFixture, "Download_libcurl resumes a segmented download after a crash")
+{
+    // Large enough for two segments of the default minimum size, each stalled past a prefix checkpoint.
+    const size_t payloadSize = 40 * 1024 * 1024;
+    const size_t stallAfterBytes = 17 * 1024 * 1024;
+
+    std::string content(payloadSize, '\0');
+    std::mt19937 random{ 42 };
+    for (char& c : content)
+    {
+        c = static_cast<char>(random());
+    }
+
+    const std::string sourcePath = TestPath() + "/payload.bin";
+    {
+        std::ofstream source{ sourcePath, std::ios::binary };
+        source << content;
+    }
+
+    char* hash = nullptr;
+    REQUIRE(ADUC_HashUtils_GetFileHash(sourcePath.c_str(), SHA256, &hash));
+    ADUC::StringUtils::cstr_wrapper hashWrapper{ hash };
+
+    // The server stalls every response until the file is removed.
+    {
+        std::ofstream stall{ TestPath() + "/stall" };
+    }
+
+    TestHttpServer server{ TestPath(), content, stallAfterBytes };
+    std::string url = server.Url();
+    std::string fileId = "payload";
+    std::string targetFilename = "payload.bin";
+    std::string hashType = "sha256";
+    ADUC_Hash fileHash = { hash, &hashType[0] };
+
+    ADUC_FileEntity entity = {};
+    entity.FileId = &fileId[0];
+    entity.DownloadUri = &url[0];
+    entity.Hash = &fileHash;
+    entity.HashCount = 1;
+    entity.TargetFilename = &targetFilename[0];
+    entity.SizeInBytes = payloadSize;
+
+    const std::string targetPath = WorkFolder() + "/" + targetFilename;
+    const std::string partialPath = targetPath + ".partial";
+    const std::string prefixPath = partialPath + ".prefix";
+
+    // Kill the download once both segments stalled, after the hashed prefix was saved.
+    const pid_t downloader = fork();
+    REQUIRE(downloader >= 0);
+    if (downloader == 0)
+    {
+        (void)Download_libcurl(&entity, "workflow", WorkFolder().c_str(), 0 /* timeoutInSeconds */, nullptr);
+        _exit(0);
+    }
+
+    const bool stalled = WaitUntil([&]() {
+        std::ifstream prefixFile{ prefixPath };
+        uint64_t prefixLength = 0;
+        return (prefixFile >> prefixLength) && prefixLength > 0
+            && FileSize(partialPath) >= payloadSize / 2 + stallAfterBytes;
+    });
+
+    kill(downloader, SIGKILL);
+    REQUIRE(waitpid(downloader, nullptr, 0) == downloader);
+    REQUIRE(stalled);
+
+    // The partial file has a hole between the segments, and never claims the size of the payload.
+    uint64_t savedPrefixLength = 0;
+    {
+        std::ifstream prefixFile{ prefixPath };
+        REQUIRE(prefixFile >> savedPrefixLength);
+    }
+    CHECK(savedPrefixLength <= stallAfterBytes);
+    CHECK(FileSize(partialPath) < payloadSize);
+
+    REQUIRE(remove((TestPath() + "/stall").c_str()) == 0);
+    const size_t requestsBeforeResume = server.GetRequestOffsets().size();
+
+    const ADUC_Result result =
+        Download_libcurl(&entity, "workflow", WorkFolder().c_str(), 0 /* timeoutInSeconds */, nullptr);
+    CHECK(result.ResultCode == ADUC_Result_Download_Success);
+    CHECK(ADUC_HashUtils_IsValidFileHash(targetPath.c_str(), hash, SHA256, false /* suppressErrorLog */));
+    CHECK_FALSE(ADUC_SystemUtils_Exists(partialPath.c_str()));
+    CHECK_FALSE(ADUC_SystemUtils_Exists(prefixPath.c_str()));
+
+    // Resumed after the saved prefix rather than from the beginning.
+    const std::vector<uint64_t> offsets = server.GetRequestOffsets();
+    REQUIRE(offsets.size() > requestsBeforeResume);
+    CHECK(offsets[requestsBeforeResume] == savedPrefixLength);
+}
@@ -11,10 +11,10 @@
 #include <aduc/c_utils.h> // EXTERN_C_{BEGIN,END}
 #include <aduc/extension_utils.h> // GetDownloadHandlerFileEntity
 #include <aduc/auto_file_entity.hpp> // AutoFileEntity
-#include <aduc/hash_utils.h> // ADUC_HashUtils_VerifyWithStrongestHash
 #include <aduc/logging.h> // ADUC_Logging_GetLevel
 #include <aduc/plugin_exception.hpp>
 #include <aduc/types/update_content.h> // ADUC_FileEntity
+#include <aduc/verified_extension_cache.h> // ADUC_VerifiedExtensionCache_VerifyWithStrongestHash
 #include <unordered_map>
 
 using DownloadHandlerHandle = void*;
@@ -28,6 +28,8 @@ DownloadHandlerFactory* DownloadHandlerFactory::GetInstance()
 
 DownloadHandlerPlugin* DownloadHandlerFactory::LoadDownloadHandler(const std::string& downloadHandlerId) noexcept
 {
+    std::lock_guard<std::mutex> lock{ cachedPluginsMutex };
+
     auto entry = cachedPlugins.find(downloadHandlerId);
     if (entry != cachedPlugins.end())
     {
@@ -43,8 +45,11 @@ DownloadHandlerPlugin* DownloadHandlerFactory::LoadDownloadHandler(const std::st
     }
 
 
-    if (!ADUC_HashUtils_VerifyWithStrongestHash(
-            downloadHandlerFileEntity.TargetFilename, downloadHandlerFileEntity.Hash, downloadHandlerFileEntity.HashCount))
+    // Download handlers that were verified before, and have not changed since, are not hashed again.
+    if (!ADUC_VerifiedExtensionCache_VerifyWithStrongestHash(
+            downloadHandlerFileEntity.TargetFilename,
+            downloadHandlerFileEntity.Hash,
+            downloadHandlerFileEntity.HashCount))
     {
         Log_Error("verify hash failed for %s", downloadHandlerFileEntity.TargetFilename);
         return nullptr;
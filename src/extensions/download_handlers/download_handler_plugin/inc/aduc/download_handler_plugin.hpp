@@ -13,6 +13,7 @@
 #include <aduc/logging.h> // ADUC_LOG_SEVERITY
 #include <aduc/result.h> // ADUC_Result
 #include <aduc/shared_lib.hpp> // aduc::SharedLib
+#include <aduc/types/download.h> // ADUC_VerifiedDigest
 #include <aduc/types/update_content.h> // typedef struct ADUC_FileEntity
 #include <string>
 
@@ -45,12 +46,15 @@ public:
      * @param workflowHandle workflow handle
      * @param fileEntity file for the update to be processed
      * @param payloadFilePath path to the payload file
+     * @param[out] verifiedDigest optional verified digest of the payload file, left empty if the plugin does not
+     * output one
      * @return ADUC_Result result of the update
     */
     ADUC_Result ProcessUpdate(
         const ADUC_WorkflowHandle workflowHandle,
         const ADUC_FileEntity* fileEntity,
-        const char* payloadFilePath) const noexcept;
+        const char* payloadFilePath,
+        ADUC_VerifiedDigest* verifiedDigest = nullptr) const noexcept;
     /**
      * @brief OnUpdateWorkflowCompleted method for DownloadHandlerPlugin
      * @param workflowHandle workflow handle
@@ -66,6 +70,9 @@ public:
 
 private:
     aduc::SharedLib lib;
+
+    // Whether the plugin exports the optional ProcessUpdateWithDigest.
+    bool hasProcessUpdateWithDigest = false;
 };
 
 #endif // DOWNLOAD_HANDLER_PLUGIN_HPP
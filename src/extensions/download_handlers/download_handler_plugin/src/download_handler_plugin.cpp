@@ -21,6 +21,12 @@ using CleanupFn = void (*)();
 using ProcessUpdateFn = ADUC_Result (*)(
     const ADUC_WorkflowHandle workflowHandle, const ADUC_FileEntity* fileEntity, const char* targetFilePath);
 
+using ProcessUpdateWithDigestFn = ADUC_Result (*)(
+    const ADUC_WorkflowHandle workflowHandle,
+    const ADUC_FileEntity* fileEntity,
+    const char* targetFilePath,
+    ADUC_VerifiedDigest* verifiedDigest);
+
 using OnUpdateWorkflowCompletedFn = ADUC_Result (*)(const ADUC_WorkflowHandle workflowHandle);
 using GetContractInfoFn = ADUC_Result (*)(ADUC_ExtensionContractInfo* contractInfo);
 
@@ -36,6 +42,18 @@ DownloadHandlerPlugin::DownloadHandlerPlugin(const std::string& libPath, ADUC_LO
     const char* const symbol = DOWNLOAD_HANDLER__Initialize__EXPORT_SYMBOL;
     CallExport<InitializeFn, false /* ExportReturnsAducResult */, ADUC_LOG_SEVERITY>(
         symbol, lib, nullptr /* outResult */, logLevel);
+
+    // Optional, so it is looked up here rather than failing the call later.
+    try
+    {
+        lib.GetSymbol(DOWNLOAD_HANDLER__ProcessUpdateWithDigest__EXPORT_SYMBOL);
+        hasProcessUpdateWithDigest = true;
+    }
+    catch (...)
+    {
+        Log_Debug(
+            "'%s' does not export '%s'", libPath.c_str(), DOWNLOAD_HANDLER__ProcessUpdateWithDigest__EXPORT_SYMBOL);
+    }
 }
 
 /**
@@ -73,6 +91,8 @@ DownloadHandlerPlugin::~DownloadHandlerPlugin() noexcept
  * download handlers.
  * @param targetFilePath The file path of the file that the plugin should create if wanting to return a ResultCode of
  * ADUC_Result_Download_Handler_SuccessSkipDownload.
+ * @param[out] verifiedDigest Optional. The verified digest of the file at @p targetFilePath, if the plugin exports
+ * ProcessUpdateWithDigest. Left empty otherwise, in which case the caller hashes the file.
  * @return ADUC_Result The result. When able to produce the target file path using workflowHandle and fileEntity inputs,
  * it returns a result with ResultCode of ADUC_Result_Download_Handler_SuccessSkipDownload to tell the agent to skip
  * downloading the update content. When it wants the agent to go ahead and download the update payload as usual, it
@@ -81,16 +101,39 @@ DownloadHandlerPlugin::~DownloadHandlerPlugin() noexcept
 ADUC_Result DownloadHandlerPlugin::ProcessUpdate(
     const ADUC_WorkflowHandle workflowHandle,
     const ADUC_FileEntity* fileEntity,
-    const char* targetFilePath) const noexcept
+    const char* targetFilePath,
+    ADUC_VerifiedDigest* verifiedDigest) const noexcept
 {
     ADUC_Result result{ ADUC_GeneralResult_Failure, 0 };
 
-    const char* const symbol = DOWNLOAD_HANDLER__ProcessUpdate__EXPORT_SYMBOL;
+    if (verifiedDigest != nullptr)
+    {
+        *verifiedDigest = {};
+    }
 
     try
     {
-        CallExport<ProcessUpdateFn, true /* ExportReturnsAducResult */>(
-            symbol, lib, &result /* outResult */, workflowHandle, fileEntity, targetFilePath);
+        if (verifiedDigest != nullptr && hasProcessUpdateWithDigest)
+        {
+            CallExport<ProcessUpdateWithDigestFn, true /* ExportReturnsAducResult */>(
+                DOWNLOAD_HANDLER__ProcessUpdateWithDigest__EXPORT_SYMBOL,
+                lib,
+                &result /* outResult */,
+                workflowHandle,
+                fileEntity,
+                targetFilePath,
+                verifiedDigest);
+        }
+        else
+        {
+            CallExport<ProcessUpdateFn, true /* ExportReturnsAducResult */>(
+                DOWNLOAD_HANDLER__ProcessUpdate__EXPORT_SYMBOL,
+                lib,
+                &result /* outResult */,
+                workflowHandle,
+                fileEntity,
+                targetFilePath);
+        }
     }
     catch (const aduc::PluginException& pe)
     {
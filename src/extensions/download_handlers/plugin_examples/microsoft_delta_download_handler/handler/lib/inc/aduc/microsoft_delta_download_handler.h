@@ -11,6 +11,7 @@
 #define __DELTA_DOWNLOAD_HANDLER_H__
 
 #include <aduc/result.h> /* ADUC_Result */
+#include <aduc/types/download.h> /* ADUC_VerifiedDigest */
 #include <aduc/types/update_content.h> /* ADUC_FileEntity */
 #include <aduc/types/workflow.h> /* ADUC_WorkflowHandle */
 
@@ -37,6 +38,25 @@ ADUC_Result MicrosoftDeltaDownloadHandler_ProcessUpdate(
     const char* payloadFilePath,
     const char* updateCacheBasePath);
 
+/**
+ * @brief Processes the target update like MicrosoftDeltaDownloadHandler_ProcessUpdate, and outputs the verified
+ * digest of the target update it produced, so that the agent does not hash it again.
+ *
+ * @param[in] workflowHandle The workflow handle.
+ * @param[in] fileEntity The FileEntity metadata of the update content and its related files.
+ * @param[in] payloadFilePath The sandbox output filepath where the update content would normally be written.
+ * @param[in] updateCacheBasePath The update cache base path. Use NULL for default.
+ * @param[out] verifiedDigest The verified digest of the target update when returning
+ * ADUC_Result_Download_Handler_SuccessSkipDownload, cleared otherwise. May be NULL.
+ * @return ADUC_Result The result.
+ */
+ADUC_Result MicrosoftDeltaDownloadHandler_ProcessUpdateWithDigest(
+    const ADUC_WorkflowHandle workflowHandle,
+    const ADUC_FileEntity* fileEntity,
+    const char* payloadFilePath,
+    const char* updateCacheBasePath,
+    ADUC_VerifiedDigest* verifiedDigest);
+
 /**
  * @brief Called when the update workflow successfully completes.
  * In the case of Delta download handler plugin, it moves all the payload files from download sandbox to the cache.
@@ -48,4 +68,9 @@ ADUC_Result MicrosoftDeltaDownloadHandler_ProcessUpdate(
 ADUC_Result MicrosoftDeltaDownloadHandler_OnUpdateWorkflowCompleted(
     const ADUC_WorkflowHandle workflowHandle, const char* updateCacheBasePath);
 
+/**
+ * @brief Releases the diff processor, which is kept loaded across updates, before the plugin is unloaded.
+ */
+void MicrosoftDeltaDownloadHandler_Cleanup();
+
 #endif /* __DELTA_DOWNLOAD_HANDLER_H__ */
@@ -14,6 +14,7 @@
 #include <aduc/string_c_utils.h> // IsNullOrEmpty
 #include <aduc/types/adu_core.h> // ADUC_Result_Success, etc
 #include <aduc/workflow_utils.h> // workflow_get_workfolder
+#include <string.h> // memset
 
 /**
  * @brief Processes the target update from FileEntity metadata at the given output filepath.
@@ -37,6 +38,30 @@ ADUC_Result MicrosoftDeltaDownloadHandler_ProcessUpdate(
     const ADUC_FileEntity* fileEntity,
     const char* payloadFilePath,
     const char* updateCacheBasePath)
+{
+    return MicrosoftDeltaDownloadHandler_ProcessUpdateWithDigest(
+        workflowHandle, fileEntity, payloadFilePath, updateCacheBasePath, NULL /* verifiedDigest */);
+}
+
+/**
+ * @brief Processes the target update like MicrosoftDeltaDownloadHandler_ProcessUpdate, and outputs the verified
+ * digest of the target update it produced, so that the agent does not hash it again.
+ * The target update is streamed out of the delta processor and hashed as it is written.
+ *
+ * @param[in] workflowHandle The workflow handle.
+ * @param[in] fileEntity The FileEntity metadata of the update content and its related files.
+ * @param[in] payloadFilePath The sandbox output filepath where the update content would normally be written.
+ * @param[in] updateCacheBasePath The update cache base path. Use NULL for default.
+ * @param[out] verifiedDigest The verified digest of the target update when returning
+ * ADUC_Result_Download_Handler_SuccessSkipDownload, cleared otherwise. May be NULL.
+ * @return ADUC_Result The result.
+ */
+ADUC_Result MicrosoftDeltaDownloadHandler_ProcessUpdateWithDigest(
+    const ADUC_WorkflowHandle workflowHandle,
+    const ADUC_FileEntity* fileEntity,
+    const char* payloadFilePath,
+    const char* updateCacheBasePath,
+    ADUC_VerifiedDigest* verifiedDigest)
 {
     ADUC_Result result = { .ResultCode = ADUC_Result_Failure, .ExtendedResultCode = 0 };
 
@@ -50,55 +75,40 @@ ADUC_Result MicrosoftDeltaDownloadHandler_ProcessUpdate(
         goto done;
     }
 
+    if (verifiedDigest != NULL)
+    {
+        memset(verifiedDigest, 0, sizeof(*verifiedDigest));
+    }
+
     // Each relatedFile represents a delta update associated with a different
     // source update in the source update update cache.
     //
     // To save bandwidth (delta updates are much smaller than a full update),
-    // try processing each delta update until one succeeds.
+    // try the delta updates of the cached source updates, smallest first and
+    // a few at once, until one produces the update.
     //
     // If processing of all relatedFile fails, then return
     // ADUC_Result_Download_RequiredFullDownload success result code, which
     // will cause the agent to not fail and download the original, full update.
-    for (int index = 0; index < fileEntity->RelatedFileCount; ++index)
+    result = MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFiles(
+        workflowHandle,
+        fileEntity,
+        payloadFilePath,
+        updateCacheBasePath,
+        MicrosoftDeltaDownloadHandlerUtils_ProcessDeltaUpdate,
+        MicrosoftDeltaDownloadHandlerUtils_ProcessDeltaUpdateToStream,
+        MicrosoftDeltaDownloadHandlerUtils_DownloadDeltaUpdate,
+        MicrosoftDeltaDownloadHandlerUtils_CancelDeltaUpdateDownload,
+        verifiedDigest);
+    if (result.ResultCode == ADUC_Result_Failure
+        && (result.ExtendedResultCode == ADUC_ERC_DDH_BAD_ARGS
+            || result.ExtendedResultCode == ADUC_ERC_DDH_RELATEDFILE_NO_PROPERTIES))
     {
-        ADUC_Result relatedFileResult;
-        memset(&relatedFileResult, 0, sizeof(relatedFileResult));
-        ADUC_RelatedFile* relatedFile = &fileEntity->RelatedFiles[index];
-
-        if (relatedFile->Properties == NULL || relatedFile->PropertiesCount < 1)
-        {
-            result.ExtendedResultCode = ADUC_ERC_DDH_RELATEDFILE_NO_PROPERTIES;
-            goto done;
-        }
-
-        relatedFileResult = MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFile(
-            workflowHandle,
-            relatedFile,
-            payloadFilePath,
-            updateCacheBasePath,
-            MicrosoftDeltaDownloadHandlerUtils_ProcessDeltaUpdate,
-            MicrosoftDeltaDownloadHandlerUtils_DownloadDeltaUpdate);
-
-        if (relatedFileResult.ResultCode == ADUC_Result_Success_Cache_Miss)
-        {
-            Log_Warn("src update cache miss for Delta %d", index);
-            workflow_add_erc(workflowHandle, ADUC_ERC_DDH_SOURCE_UPDATE_CACHE_MISS);
-            continue;
-        }
-
-        if (IsAducResultCodeSuccess(relatedFileResult.ResultCode))
-        {
-            Log_Info("Processing Delta %d succeeded", index);
-            result.ResultCode = ADUC_Result_Success;
-            break;
-        }
-
-        Log_Warn("Delta %d failed, ERC: 0x%08x.", index, relatedFileResult.ExtendedResultCode);
-        workflow_add_erc(workflowHandle, relatedFileResult.ExtendedResultCode);
-        // continue processing the next relatedFile
+        goto done;
     }
 
-    if (IsAducResultCodeSuccess(result.ResultCode))
+    // The extended result codes of the delta updates that failed were added to the workflow.
+    if (result.ResultCode == ADUC_Result_Success)
     {
         result.ResultCode = ADUC_Result_Download_Handler_SuccessSkipDownload;
     }
@@ -107,6 +117,8 @@ ADUC_Result MicrosoftDeltaDownloadHandler_ProcessUpdate(
         result.ResultCode = ADUC_Result_Download_Handler_RequiredFullDownload;
     };
 
+    result.ExtendedResultCode = 0;
+
 done:
 
     return result;
@@ -138,3 +150,11 @@ done:
 
     return result;
 }
+
+/**
+ * @brief Releases the diff processor, which is kept loaded across updates, before the plugin is unloaded.
+ */
+void MicrosoftDeltaDownloadHandler_Cleanup()
+{
+    MicrosoftDeltaDownloadHandlerUtils_Cleanup();
+}
@@ -9,6 +9,7 @@
  * Initialize                 - Do one-time initialization (e.g. initialize logging),
  * Cleanup                    - Free resources and cleanup right before unloading,
  * ProcessUpdate              - Do processing using data provided by ADUC_WorkflowHandle and update file metadata (ADUC_FileEntity),
+ * ProcessUpdateWithDigest    - Same as ProcessUpdate, and also outputs the verified digest of the update content it produced,
  * OnUpdateWorkflowCompleted  - Callback for post-processing when the current update has been installed and applied successfully.
  *
  * @copyright Copyright (c) Microsoft Corporation.
@@ -46,6 +47,7 @@ EXPORTED_METHOD void Initialize(ADUC_LOG_SEVERITY logLevel)
  */
 EXPORTED_METHOD void Cleanup()
 {
+    MicrosoftDeltaDownloadHandler_Cleanup();
     ADUC_Logging_Uninit();
 }
 
@@ -70,6 +72,26 @@ EXPORTED_METHOD ADUC_Result ProcessUpdate(
         workflowHandle, fileEntity, targetUpdateFilePath, NULL /* updateCacheBasePath */);
 }
 
+/**
+ * @brief Same as ProcessUpdate, and also outputs the verified digest of the target update it produced, so that the
+ * agent does not need to read the target update again to check its hash.
+ *
+ * @param[in] workflowHandle The workflow handle.
+ * @param[in] fileEntity The FileEntity metadata of the update content and its related files.
+ * @param[in] targetUpdateFilePath The target update path to write the update content when returning ADUC_Result_Download_Handler_SuccessSkipDownload.
+ * @param[out] verifiedDigest The verified digest of the target update when returning ADUC_Result_Download_Handler_SuccessSkipDownload.
+ * @return ADUC_Result The result.
+ */
+EXPORTED_METHOD ADUC_Result ProcessUpdateWithDigest(
+    const ADUC_WorkflowHandle workflowHandle,
+    const ADUC_FileEntity* fileEntity,
+    const char* targetUpdateFilePath,
+    ADUC_VerifiedDigest* verifiedDigest)
+{
+    return MicrosoftDeltaDownloadHandler_ProcessUpdateWithDigest(
+        workflowHandle, fileEntity, targetUpdateFilePath, NULL /* updateCacheBasePath */, verifiedDigest);
+}
+
 /**
  * @brief Called when the update workflow successfully completes.
  * In the case of Delta download handler plugin, it moves all the payloads from sandbox to cache
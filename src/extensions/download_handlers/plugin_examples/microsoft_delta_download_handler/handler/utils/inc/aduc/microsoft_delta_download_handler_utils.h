@@ -11,9 +11,13 @@
 
 #include <aduc/c_utils.h> // EXTERN_C_BEGIN, EXTERN_C_END
 #include <aduc/types/adu_core.h> // ADUC_Result_*
+#include <aduc/types/download.h> // ADUC_VerifiedDigest
 #include <aduc/types/update_content.h> // ADUC_RelatedFile
 #include <aduc/types/workflow.h> // ADUC_WorkflowHandle
 #include <azure_c_shared_utility/strings.h> // STRING_*
+#include <stdbool.h>
+#include <stddef.h> // size_t
+#include <stdint.h> // uint8_t
 
 EXTERN_C_BEGIN
 
@@ -27,6 +31,45 @@ EXTERN_C_BEGIN
 typedef ADUC_Result (*ProcessDeltaUpdateFn)(
     const char* sourceUpdateFilePath, const char* deltaUpdateFilePath, const char* targetUpdateFilePath);
 
+/**
+ * @brief Function prototype for the function that receives the target update as it is produced.
+ * @param context The context passed along with the function.
+ * @param data The next bytes of the target update.
+ * @param size The number of bytes in @p data.
+ * @return bool true to keep receiving the target update. On false, the rest of it is discarded.
+ */
+typedef bool (*MicrosoftDeltaDownloadHandler_WriteFn)(void* context, const uint8_t* data, size_t size);
+
+/**
+ * @brief Function prototype for the function to process a delta update into a stream.
+ * @param sourceUpdateFilePath The source update path.
+ * @param deltaUpdateFilePath The path for the delta update
+ * @param writeFn The function called with the target update, in order, as it is produced.
+ * @param writeContext The context passed to @p writeFn.
+ * @return ADUC_Result The result.
+ */
+typedef ADUC_Result (*ProcessDeltaUpdateStreamFn)(
+    const char* sourceUpdateFilePath,
+    const char* deltaUpdateFilePath,
+    MicrosoftDeltaDownloadHandler_WriteFn writeFn,
+    void* writeContext);
+
+/**
+ * @brief The default maximum number of delta updates applied at once by
+ * MicrosoftDeltaDownloadHandlerUtils_ProcessDeltaUpdates.
+ */
+#define MICROSOFT_DELTA_DOWNLOAD_HANDLER_DEFAULT_MAX_CONCURRENT_DELTA_UPDATES 2
+
+/**
+ * @brief A delta update to process into a target update.
+ */
+typedef struct tagMicrosoftDeltaDownloadHandler_DeltaUpdate
+{
+    const char* SourceUpdateFilePath; /**< The source update path. */
+    const char* DeltaUpdateFilePath; /**< The delta update path. */
+    const char* TargetUpdateFilePath; /**< The target update path. */
+} MicrosoftDeltaDownloadHandler_DeltaUpdate;
+
 /**
  * @brief Function prototype for the function to download a delta update.
  * @param workflowHandle The workflow handle.
@@ -36,6 +79,14 @@ typedef ADUC_Result (*ProcessDeltaUpdateFn)(
 typedef ADUC_Result (*DownloadDeltaUpdateFn)(
     const ADUC_WorkflowHandle workflowHandle, const ADUC_RelatedFile* relatedFile);
 
+/**
+ * @brief Function prototype for the function to cancel an in-progress download of a delta update.
+ * @param workflowHandle The workflow handle.
+ * @param relatedFile The related file for the delta download
+ */
+typedef void (*CancelDeltaUpdateDownloadFn)(
+    const ADUC_WorkflowHandle workflowHandle, const ADUC_RelatedFile* relatedFile);
+
 /**
  * @brief Processes a related file of an update for delta download handling.
  *
@@ -56,6 +107,45 @@ ADUC_Result MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFile(
     ProcessDeltaUpdateFn processDeltaUpdateFn,
     DownloadDeltaUpdateFn downloadDeltaUpdateFn);
 
+/**
+ * @brief Processes the related files of an update for delta download handling, until one of them produces the update.
+ * @details The source updates of all related files are looked up first. The related files whose source update is in
+ * the cache are then tried smallest delta update first, with up to the maximum set by
+ * MicrosoftDeltaDownloadHandlerUtils_SetMaxConcurrentDeltaUpdates downloaded and applied at once. The first one to
+ * produce a target update that matches the hash of @p fileEntity wins, and the downloads of the others are
+ * cancelled. The extended result codes of cache misses and failed related files are added to the workflow.
+ * When @p processDeltaUpdateStreamFn is given, the target update is hashed as it is written, rather than read back
+ * once written, unless streaming was turned off with MicrosoftDeltaDownloadHandlerUtils_SetStreamDeltaUpdates.
+ *
+ * @param workflowHandle The workflow handle.
+ * @param fileEntity The file entity of the update, with its related files.
+ * @param payloadFilePath The payload file path.
+ * @param updateCacheBasePath The update cache base path. Use NULL for default.
+ * @param processDeltaUpdateFn The function to call to process delta updates. It is called from several threads
+ * at once.
+ * @param processDeltaUpdateStreamFn The function to call to process delta updates into a stream, or NULL to only
+ * process them into files. It is called from several threads at once. If it fails for a reason other than a hash
+ * mismatch, the delta update is processed with @p processDeltaUpdateFn instead.
+ * @param downloadDeltaUpdateFn The function to call to download the delta updates. It is called from several threads
+ * at once.
+ * @param cancelDeltaUpdateDownloadFn The function to call to cancel the download of a delta update that is no longer
+ * needed.
+ * @param[out] verifiedDigest On success, the verified digest of the update at @p payloadFilePath. May be NULL.
+ * @return ADUC_Result The result.
+ * @details Returns ADUC_Result_Success when the update was produced at @p payloadFilePath, and
+ * ADUC_Result_Success_Cache_Miss when no source update was found in cache.
+ */
+ADUC_Result MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFiles(
+    const ADUC_WorkflowHandle workflowHandle,
+    const ADUC_FileEntity* fileEntity,
+    const char* payloadFilePath,
+    const char* updateCacheBasePath,
+    ProcessDeltaUpdateFn processDeltaUpdateFn,
+    ProcessDeltaUpdateStreamFn processDeltaUpdateStreamFn,
+    DownloadDeltaUpdateFn downloadDeltaUpdateFn,
+    CancelDeltaUpdateDownloadFn cancelDeltaUpdateDownloadFn,
+    ADUC_VerifiedDigest* verifiedDigest);
+
 /**
  * @brief Looks up the source update in the source update cache and outputs the path to it, if it exists.
  *
@@ -93,6 +183,16 @@ ADUC_Result MicrosoftDeltaDownloadHandlerUtils_GetSourceUpdateProperties(
 ADUC_Result MicrosoftDeltaDownloadHandlerUtils_DownloadDeltaUpdate(
     const ADUC_WorkflowHandle workflowHandle, const ADUC_RelatedFile* relatedFile);
 
+/**
+ * @brief Cancels the in-progress download of a delta update related file, if any.
+ * @details Only content downloaders that support cancellation stop early.
+ *
+ * @param workflowHandle The workflow handle.
+ * @param relatedFile The related file.
+ */
+void MicrosoftDeltaDownloadHandlerUtils_CancelDeltaUpdateDownload(
+    const ADUC_WorkflowHandle workflowHandle, const ADUC_RelatedFile* relatedFile);
+
 /**
  * @brief Gets the file path to the delta update downloaded in the download sandbox work folder.
  *
@@ -115,6 +215,68 @@ ADUC_Result MicrosoftDeltaDownloadHandlerUtils_GetDeltaUpdateDownloadSandboxPath
 ADUC_Result MicrosoftDeltaDownloadHandlerUtils_ProcessDeltaUpdate(
     const char* sourceUpdateFilePath, const char* deltaUpdateFilePath, const char* targetUpdateFilePath);
 
+/**
+ * @brief Creates a target update from the source and delta updates, and passes it to @p writeFn as it is produced,
+ * without writing it to a file.
+ * @details The diff processor only writes to a path, so it writes to a FIFO that is read on the calling thread.
+ * The call fails with ADUC_ERC_DDH_STREAM_TARGET_UPDATE if the FIFO cannot be made, and with a diff processor error
+ * if the diff processor cannot write to it.
+ *
+ * @param sourceUpdateFilePath The source update path.
+ * @param deltaUpdateFilePath The delta update path. The FIFO is made in its folder.
+ * @param writeFn The function called with the target update, in order, as it is produced.
+ * @param writeContext The context passed to @p writeFn.
+ * @return ADUC_Result The result. It is a failure if @p writeFn returned false.
+ */
+ADUC_Result MicrosoftDeltaDownloadHandlerUtils_ProcessDeltaUpdateToStream(
+    const char* sourceUpdateFilePath,
+    const char* deltaUpdateFilePath,
+    MicrosoftDeltaDownloadHandler_WriteFn writeFn,
+    void* writeContext);
+
+/**
+ * @brief Creates the target updates of independent delta updates, applying up to the maximum set by
+ * MicrosoftDeltaDownloadHandlerUtils_SetMaxConcurrentDeltaUpdates at once.
+ *
+ * @param deltaUpdates The delta updates. Their target update paths must differ.
+ * @param deltaUpdateCount The count of @p deltaUpdates.
+ * @param processDeltaUpdateFn The function to call to process each delta update, e.g.
+ * MicrosoftDeltaDownloadHandlerUtils_ProcessDeltaUpdate. It is called from several threads at once.
+ * @param[out] results The result of each delta update, in the order of @p deltaUpdates.
+ */
+void MicrosoftDeltaDownloadHandlerUtils_ProcessDeltaUpdates(
+    const MicrosoftDeltaDownloadHandler_DeltaUpdate* deltaUpdates,
+    size_t deltaUpdateCount,
+    ProcessDeltaUpdateFn processDeltaUpdateFn,
+    ADUC_Result* results);
+
+/**
+ * @brief Sets the maximum number of delta updates applied at once by
+ * MicrosoftDeltaDownloadHandlerUtils_ProcessDeltaUpdates, and downloaded and applied at once by
+ * MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFiles. This is also the number of idle diff processor sessions
+ * kept for reuse. The default is MICROSOFT_DELTA_DOWNLOAD_HANDLER_DEFAULT_MAX_CONCURRENT_DELTA_UPDATES.
+ *
+ * @param maxConcurrentDeltaUpdates The maximum, at least 1.
+ */
+void MicrosoftDeltaDownloadHandlerUtils_SetMaxConcurrentDeltaUpdates(size_t maxConcurrentDeltaUpdates);
+
+/**
+ * @brief Sets whether MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFiles streams the target updates.
+ * @details Streaming is on by default. It is turned off for the life of the process once a delta update fails to
+ * stream but can be processed into a file, as the diff processor cannot write to a FIFO then. This is meant for
+ * tests and benchmarks.
+ *
+ * @param streamDeltaUpdates true to stream the target updates.
+ */
+void MicrosoftDeltaDownloadHandlerUtils_SetStreamDeltaUpdates(bool streamDeltaUpdates);
+
+/**
+ * @brief Closes the pooled diff processor sessions and unloads the diff processor library.
+ * @details The diff processor library is loaded on the first delta update, and kept loaded along with its sessions
+ * for the next delta updates until this is called. It is loaded again on the next delta update.
+ */
+void MicrosoftDeltaDownloadHandlerUtils_Cleanup();
+
 EXTERN_C_END
 
 #endif // MICROSOFT_DELTA_DOWNLOAD_HANDLER_UTILS_H
@@ -255,8 +255,29 @@ done:
     return result;
 }
 
+/**
+ * @brief Creates the id of the download of a delta update related file, which is unique within all workflows.
+ *
+ * @param workflowHandle The workflow handle.
+ * @param relatedFile The related file.
+ * @return STRING_HANDLE The download id, or NULL on error.
+ */
+static STRING_HANDLE CreateDeltaUpdateDownloadId(
+    const ADUC_WorkflowHandle workflowHandle, const ADUC_RelatedFile* relatedFile)
+{
+    const char* workflowId = workflow_peek_id(workflowHandle);
+
+    if (IsNullOrEmpty(workflowId) || IsNullOrEmpty(relatedFile->FileId))
+    {
+        return NULL;
+    }
+
+    return STRING_construct_sprintf("%s/%s", workflowId, relatedFile->FileId);
+}
+
 /**
  * @brief Downloads a delta update related file.
+ * @details The download can be cancelled on its own with MicrosoftDeltaDownloadHandlerUtils_CancelDeltaUpdateDownload.
  *
  * @param workflowHandle The workflow handle.
  * @param relatedFile The related file.
@@ -265,6 +286,9 @@ done:
 ADUC_Result MicrosoftDeltaDownloadHandlerUtils_DownloadDeltaUpdate(
     const ADUC_WorkflowHandle workflowHandle, const ADUC_RelatedFile* relatedFile)
 {
+    ADUC_Result result = { .ResultCode = ADUC_Result_Failure };
+    ExtensionManager_Download_Options downloadOptions = Default_ExtensionManager_Download_Options;
+
     Log_Debug("Try download delta update from '%s'", relatedFile->DownloadUri);
 
     ADUC_FileEntity deltaUpdateFileEntity = {
@@ -276,11 +300,41 @@ ADUC_Result MicrosoftDeltaDownloadHandlerUtils_DownloadDeltaUpdate(
         .TargetFilename = relatedFile->FileName,
     };
 
-    return ExtensionManager_Download(
-        &deltaUpdateFileEntity,
-        workflowHandle,
-        &Default_ExtensionManager_Download_Options,
-        NULL /* downloadProgressCallback */);
+    // Without a download id, the download can only be cancelled along with the workflow.
+    STRING_HANDLE downloadId = CreateDeltaUpdateDownloadId(workflowHandle, relatedFile);
+    downloadOptions.downloadId = STRING_c_str(downloadId);
+
+    result = ExtensionManager_Download(
+        &deltaUpdateFileEntity, workflowHandle, &downloadOptions, NULL /* downloadProgressCallback */);
+
+    STRING_delete(downloadId);
+
+    return result;
+}
+
+/**
+ * @brief Cancels the in-progress download of a delta update related file, if any.
+ *
+ * @param workflowHandle The workflow handle.
+ * @param relatedFile The related file.
+ */
+void MicrosoftDeltaDownloadHandlerUtils_CancelDeltaUpdateDownload(
+    const ADUC_WorkflowHandle workflowHandle, const ADUC_RelatedFile* relatedFile)
+{
+    STRING_HANDLE downloadId = CreateDeltaUpdateDownloadId(workflowHandle, relatedFile);
+
+    if (downloadId == NULL)
+    {
+        Log_Warn("Cannot cancel download of delta update '%s'", relatedFile->FileName);
+        return;
+    }
+
+    if (!ExtensionManager_CancelDownload(STRING_c_str(downloadId)))
+    {
+        Log_Debug("Download of delta update '%s' is not in progress", relatedFile->FileName);
+    }
+
+    STRING_delete(downloadId);
 }
 
 /**
@@ -11,6 +11,23 @@
 #include "aduc/logging.h"
 #include "aduc/result.h" // MAKE_DELTA_PROCESSOR_EXTENDEDRESULTCODE
 #include "aduc/shared_lib.hpp"
+#include <aduc/hash_utils.h> // ADUC_HashUtils_*
+#include <aduc/workflow_utils.h> // workflow_add_erc
+
+#include <algorithm> // std::min, std::stable_sort
+#include <atomic>
+#include <cerrno>
+#include <cstdio> // std::remove, std::rename
+#include <cstdlib> // mkdtemp
+#include <fcntl.h> // open, O_*
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <string>
+#include <sys/stat.h> // mkfifo, lstat
+#include <thread>
+#include <unistd.h> // read, close, unlink, rmdir
+#include <vector>
 
 const char* AduDiffSharedLibName = "libadudiffapi.so";
 
@@ -27,6 +44,642 @@ using adu_diff_apply_get_error_count_fn = size_t (*)(adu_apply_handle handle);
 using adu_diff_apply_get_error_text_fn = const char* (*)(adu_apply_handle handle, size_t index);
 using adu_diff_apply_get_error_code_fn = int (*)(adu_apply_handle handle, size_t index);
 
+namespace
+{
+/**
+ * @brief The maximum number of deltas applied concurrently by MicrosoftDeltaDownloadHandlerUtils_ProcessDeltaUpdates.
+ */
+std::atomic<size_t> s_maxConcurrentDeltaUpdates{
+    MICROSOFT_DELTA_DOWNLOAD_HANDLER_DEFAULT_MAX_CONCURRENT_DELTA_UPDATES
+};
+
+/**
+ * @brief Whether MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFiles streams the target updates.
+ */
+std::atomic<bool> s_streamDeltaUpdates{ true };
+
+/**
+ * @brief The size of the reads from the FIFO the diff processor writes the target update to, which is the default
+ * capacity of a pipe.
+ */
+const size_t StreamReadBufferSize = 64 * 1024;
+
+/**
+ * @brief How long to wait for the diff processor to write more of the target update before checking if it is done.
+ */
+const int StreamPollTimeoutMs = 100;
+
+/**
+ * @brief The diff processor library, loaded on first use and kept loaded until Unload, along with a pool of apply
+ * sessions shared by all the deltas of all the workflows.
+ */
+class DiffProcessor
+{
+public:
+    DiffProcessor() = default;
+    DiffProcessor(const DiffProcessor&) = delete;
+    DiffProcessor& operator=(const DiffProcessor&) = delete;
+    DiffProcessor(DiffProcessor&&) = delete;
+    DiffProcessor& operator=(DiffProcessor&&) = delete;
+
+    ~DiffProcessor()
+    {
+        Unload();
+    }
+
+    static DiffProcessor& GetInstance()
+    {
+        static DiffProcessor s_instance;
+        return s_instance;
+    }
+
+    /**
+     * @brief Creates a target update from the source and delta updates, with a pooled session.
+     */
+    ADUC_Result
+    Apply(const char* sourceUpdateFilePath, const char* deltaUpdateFilePath, const char* targetUpdateFilePath)
+    {
+        ADUC_Result result = { ADUC_Result_Failure };
+        adu_apply_handle session = nullptr;
+
+        result = AcquireSession(&session);
+        if (IsAducResultCodeFailure(result.ResultCode))
+        {
+            return result;
+        }
+
+        result = { ADUC_Result_Failure };
+
+        Log_Debug("Apply diff ...");
+
+        int res = _applyFn(session, sourceUpdateFilePath, deltaUpdateFilePath, targetUpdateFilePath);
+
+        if (res == 0)
+        {
+            result.ResultCode = ADUC_Result_Success;
+        }
+        else
+        {
+            Log_Error("diff apply - overall err: %d", res);
+            result.ExtendedResultCode = MAKE_DELTA_PROCESSOR_EXTENDEDRESULTCODE(res);
+
+            size_t errorCount = _getErrorCountFn(session);
+            for (size_t errIndex = 0; errIndex < errorCount; ++errIndex)
+            {
+                int error_code = _getErrorCodeFn(session, errIndex);
+                const char* error_text = _getErrorTextFn(session, errIndex); // do not free
+
+                Log_Error("diff apply - errcode %d: '%s'", error_code, error_text);
+
+                result.ExtendedResultCode = MAKE_DELTA_PROCESSOR_EXTENDEDRESULTCODE(error_code);
+            }
+        }
+
+        // A session that failed still holds its errors, so it is not reused.
+        ReleaseSession(session, res == 0 /* reuse */);
+
+        return result;
+    }
+
+    /**
+     * @brief Closes the pooled sessions and unloads the diff processor library.
+     * @details Sessions in use are closed when released; the library stays loaded until then.
+     */
+    void Unload()
+    {
+        std::lock_guard<std::mutex> lock{ _mutex };
+
+        CloseIdleSessions();
+
+        if (_activeSessionCount > 0)
+        {
+            Log_Warn("%zu diff apply session(s) in use, unloading %s later", _activeSessionCount, AduDiffSharedLibName);
+            _unloadRequested = true;
+            return;
+        }
+
+        UnloadLibrary();
+    }
+
+private:
+    /**
+     * @brief Loads the library and resolves its symbols, if not done yet. Must be called with the mutex held.
+     */
+    ADUC_Result EnsureLoaded()
+    {
+        ADUC_Result result = { ADUC_Result_Failure };
+
+        if (_diffApi)
+        {
+            return { ADUC_Result_Success };
+        }
+
+        try
+        {
+            Log_Debug("load diff processor %s ...", AduDiffSharedLibName);
+
+            result.ExtendedResultCode = ADUC_ERC_DDH_PROCESSOR_LOAD_LIB;
+            std::unique_ptr<aduc::SharedLib> diffApi{ new aduc::SharedLib{ AduDiffSharedLibName } };
+
+            Log_Debug("ensure symbols ...");
+
+            result.ExtendedResultCode = ADUC_ERC_DDH_PROCESSOR_ENSURE_SYMBOLS;
+            diffApi->EnsureSymbols({ "adu_diff_apply",
+                                     "adu_diff_apply_close_session",
+                                     "adu_diff_apply_create_session",
+                                     "adu_diff_apply_get_error_code",
+                                     "adu_diff_apply_get_error_count",
+                                     "adu_diff_apply_get_error_text" });
+
+            _createSessionFn = reinterpret_cast<adu_diff_apply_create_session_fn>(
+                diffApi->GetSymbol("adu_diff_apply_create_session"));
+            _closeSessionFn = reinterpret_cast<adu_diff_apply_close_session_fn>(
+                diffApi->GetSymbol("adu_diff_apply_close_session"));
+            _applyFn = reinterpret_cast<adu_diff_apply_fn>(diffApi->GetSymbol("adu_diff_apply"));
+            _getErrorCountFn = reinterpret_cast<adu_diff_apply_get_error_count_fn>(
+                diffApi->GetSymbol("adu_diff_apply_get_error_count"));
+            _getErrorTextFn = reinterpret_cast<adu_diff_apply_get_error_text_fn>(
+                diffApi->GetSymbol("adu_diff_apply_get_error_text"));
+            _getErrorCodeFn = reinterpret_cast<adu_diff_apply_get_error_code_fn>(
+                diffApi->GetSymbol("adu_diff_apply_get_error_code"));
+
+            _diffApi = std::move(diffApi);
+            _unloadRequested = false;
+            result = { ADUC_Result_Success };
+        }
+        catch (const std::exception& e)
+        {
+            Log_Error("Unhandled std exception: %s", e.what());
+        }
+        catch (...)
+        {
+            Log_Error("Unhandled exception");
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief Takes a session from the pool, or creates one, loading the library if needed.
+     */
+    ADUC_Result AcquireSession(adu_apply_handle* session)
+    {
+        std::lock_guard<std::mutex> lock{ _mutex };
+
+        ADUC_Result result = EnsureLoaded();
+        if (IsAducResultCodeFailure(result.ResultCode))
+        {
+            return result;
+        }
+
+        if (!_idleSessions.empty())
+        {
+            *session = _idleSessions.back();
+            _idleSessions.pop_back();
+        }
+        else
+        {
+            Log_Debug("create session ...");
+
+            *session = _createSessionFn();
+            if (*session == nullptr)
+            {
+                Log_Error("create diffapply session failed");
+                return { ADUC_Result_Failure, ADUC_ERC_DDH_PROCESSOR_CREATE_SESSION };
+            }
+        }
+
+        ++_activeSessionCount;
+        return { ADUC_Result_Success };
+    }
+
+    /**
+     * @brief Returns a session to the pool, or closes it if it cannot be reused or the pool is full.
+     */
+    void ReleaseSession(adu_apply_handle session, bool reuse)
+    {
+        std::lock_guard<std::mutex> lock{ _mutex };
+
+        --_activeSessionCount;
+
+        if (reuse && !_unloadRequested && _idleSessions.size() < s_maxConcurrentDeltaUpdates.load())
+        {
+            _idleSessions.push_back(session);
+            return;
+        }
+
+        Log_Debug("close session ...");
+        _closeSessionFn(session);
+
+        if (_unloadRequested && _activeSessionCount == 0)
+        {
+            UnloadLibrary();
+        }
+    }
+
+    /**
+     * @brief Closes the pooled sessions. Must be called with the mutex held.
+     */
+    void CloseIdleSessions()
+    {
+        for (adu_apply_handle session : _idleSessions)
+        {
+            _closeSessionFn(session);
+        }
+
+        _idleSessions.clear();
+    }
+
+    /**
+     * @brief Unloads the library. Must be called with the mutex held, and no session open.
+     */
+    void UnloadLibrary()
+    {
+        if (_diffApi)
+        {
+            Log_Debug("unload diff processor %s", AduDiffSharedLibName);
+        }
+
+        _diffApi.reset();
+        _unloadRequested = false;
+
+        _createSessionFn = nullptr;
+        _closeSessionFn = nullptr;
+        _applyFn = nullptr;
+        _getErrorCountFn = nullptr;
+        _getErrorTextFn = nullptr;
+        _getErrorCodeFn = nullptr;
+    }
+
+    std::mutex _mutex;
+    std::unique_ptr<aduc::SharedLib> _diffApi;
+    std::vector<adu_apply_handle> _idleSessions;
+    size_t _activeSessionCount = 0;
+    bool _unloadRequested = false;
+
+    adu_diff_apply_create_session_fn _createSessionFn = nullptr;
+    adu_diff_apply_close_session_fn _closeSessionFn = nullptr;
+    adu_diff_apply_fn _applyFn = nullptr;
+    adu_diff_apply_get_error_count_fn _getErrorCountFn = nullptr;
+    adu_diff_apply_get_error_text_fn _getErrorTextFn = nullptr;
+    adu_diff_apply_get_error_code_fn _getErrorCodeFn = nullptr;
+};
+
+/**
+ * @brief A related file whose source update is in the cache, so that its delta update can produce the target update.
+ */
+struct DeltaCandidate
+{
+    const ADUC_RelatedFile* relatedFile = nullptr;
+    std::string sourceUpdateFilePath;
+
+    // The target update is produced next to the payload file, and moved to it if it wins.
+    std::string targetUpdateFilePath;
+
+    // Set while the delta update is downloaded, so that the winner can cancel the download.
+    std::atomic<bool> downloading{ false };
+
+    // Left as cancelled if the candidate is skipped, or loses to another one.
+    ADUC_Result result = { ADUC_Result_Failure_Cancelled };
+
+    // Set when the target update passes the hash check.
+    ADUC_VerifiedDigest verifiedDigest = {};
+};
+
+const size_t NoWinner = static_cast<size_t>(-1);
+
+/**
+ * @brief The file a streamed target update is written to, and the hash of what was written so far.
+ */
+struct TargetUpdateWriter
+{
+    FILE* file = nullptr;
+    ADUC_HashUtils_StreamContext hashContext = {};
+};
+
+/**
+ * @brief A MicrosoftDeltaDownloadHandler_WriteFn that writes to a TargetUpdateWriter.
+ */
+bool WriteTargetUpdate(void* context, const uint8_t* data, size_t size)
+{
+    TargetUpdateWriter* writer = static_cast<TargetUpdateWriter*>(context);
+
+    return fwrite(data, 1, size, writer->file) == size
+        && ADUC_HashUtils_StreamContext_Update(&writer->hashContext, data, size);
+}
+
+/**
+ * @brief Streams the target update of a candidate into its target update file, hashing it as it is written.
+ * @details On success, the verified digest of the candidate is set. A target update that does not match
+ * @p hashValue fails with ADUC_ERC_DDH_TARGET_UPDATE_HASH_MISMATCH.
+ */
+ADUC_Result StreamDeltaCandidate(
+    DeltaCandidate* candidate,
+    const char* deltaUpdateFilePath,
+    const char* hashValue,
+    SHAversion algorithm,
+    ProcessDeltaUpdateStreamFn processDeltaUpdateStreamFn)
+{
+    ADUC_Result result = { ADUC_Result_Failure, ADUC_ERC_DDH_STREAM_TARGET_UPDATE };
+    TargetUpdateWriter writer;
+
+    if (!ADUC_HashUtils_StreamContext_Init(&writer.hashContext, algorithm))
+    {
+        return result;
+    }
+
+    writer.file = fopen(candidate->targetUpdateFilePath.c_str(), "wb");
+    if (writer.file == nullptr)
+    {
+        Log_Error("Cannot open '%s', errno %d", candidate->targetUpdateFilePath.c_str(), errno);
+        ADUC_HashUtils_StreamContext_UnInit(&writer.hashContext);
+        return result;
+    }
+
+    result = processDeltaUpdateStreamFn(
+        candidate->sourceUpdateFilePath.c_str(), deltaUpdateFilePath, WriteTargetUpdate, &writer);
+
+    if (fclose(writer.file) != 0 && IsAducResultCodeSuccess(result.ResultCode))
+    {
+        Log_Error("Cannot write '%s', errno %d", candidate->targetUpdateFilePath.c_str(), errno);
+        result = { ADUC_Result_Failure, ADUC_ERC_DDH_STREAM_TARGET_UPDATE };
+    }
+
+    if (IsAducResultCodeSuccess(result.ResultCode)
+        && !ADUC_HashUtils_StreamContext_FinalizeToVerifiedDigest(
+            &writer.hashContext, hashValue, candidate->targetUpdateFilePath.c_str(), &candidate->verifiedDigest))
+    {
+        result = { ADUC_Result_Failure, ADUC_ERC_DDH_TARGET_UPDATE_HASH_MISMATCH };
+    }
+
+    ADUC_HashUtils_StreamContext_UnInit(&writer.hashContext);
+
+    return result;
+}
+
+/**
+ * @brief Applies a delta update into a FIFO from a worker thread, and passes what the diff processor writes to
+ * @p writeFn on the calling thread.
+ */
+ADUC_Result ApplyDeltaUpdateToStream(
+    const char* sourceUpdateFilePath,
+    const char* deltaUpdateFilePath,
+    MicrosoftDeltaDownloadHandler_WriteFn writeFn,
+    void* writeContext)
+{
+    ADUC_Result result = { ADUC_Result_Failure, ADUC_ERC_DDH_STREAM_TARGET_UPDATE };
+
+    // The FIFO is made next to the delta update, in a private folder.
+    std::string streamFolder{ deltaUpdateFilePath };
+    const size_t separator = streamFolder.find_last_of('/');
+    streamFolder = (separator == std::string::npos) ? std::string{ "." } : streamFolder.substr(0, separator);
+    streamFolder += "/.delta-stream-XXXXXX";
+
+    std::vector<char> streamFolderTemplate{ streamFolder.begin(), streamFolder.end() };
+    streamFolderTemplate.push_back('\0');
+    if (mkdtemp(streamFolderTemplate.data()) == nullptr)
+    {
+        Log_Error("Cannot make folder '%s', errno %d", streamFolder.c_str(), errno);
+        return result;
+    }
+
+    streamFolder = streamFolderTemplate.data();
+    const std::string fifoPath = streamFolder + "/target";
+
+    int fd = -1;
+    if (mkfifo(fifoPath.c_str(), S_IRUSR | S_IWUSR) != 0)
+    {
+        Log_Error("Cannot make FIFO '%s', errno %d", fifoPath.c_str(), errno);
+        goto done;
+    }
+
+    // Opened for reading and writing, so that neither this open nor the one of the diff processor waits for the other
+    // end, and reads never see the end of the stream while the diff processor is still writing.
+    fd = open(fifoPath.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+        Log_Error("Cannot open FIFO '%s', errno %d", fifoPath.c_str(), errno);
+        goto done;
+    }
+
+    {
+        std::atomic<bool> applied{ false };
+        ADUC_Result applyResult = { ADUC_Result_Failure };
+        std::thread applier;
+
+        try
+        {
+            applier = std::thread{ [&]() {
+                try
+                {
+                    applyResult = DiffProcessor::GetInstance().Apply(
+                        sourceUpdateFilePath, deltaUpdateFilePath, fifoPath.c_str());
+                }
+                catch (...)
+                {
+                    Log_Error("Unhandled exception");
+                }
+
+                applied = true;
+            } };
+        }
+        catch (const std::exception& e)
+        {
+            Log_Error("Cannot start delta apply thread: %s", e.what());
+            goto done;
+        }
+
+        std::vector<uint8_t> buffer(StreamReadBufferSize);
+        bool writeFailed = false;
+        bool readFailed = false;
+
+        for (;;)
+        {
+            // Loaded before reading, so that once the diff processor is done, an empty FIFO is the end of the stream.
+            const bool done = applied.load();
+            const ssize_t readSize = read(fd, buffer.data(), buffer.size());
+
+            if (readSize > 0)
+            {
+                // After a failed write, the rest is still drained, so that the diff processor is not blocked.
+                if (!writeFailed && !writeFn(writeContext, buffer.data(), static_cast<size_t>(readSize)))
+                {
+                    Log_Error("Cannot write the target update");
+                    writeFailed = true;
+                }
+                continue;
+            }
+
+            if (readSize < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (readSize < 0 && errno != EAGAIN && errno != EWOULDBLOCK && !readFailed)
+            {
+                Log_Error("Cannot read FIFO '%s', errno %d", fifoPath.c_str(), errno);
+                readFailed = true;
+            }
+
+            if (done)
+            {
+                break;
+            }
+
+            struct pollfd pollFd = { fd, POLLIN, 0 };
+            poll(&pollFd, 1, StreamPollTimeoutMs);
+        }
+
+        applier.join();
+
+        // A diff processor that replaces the target rather than writing to it cannot stream.
+        struct stat st;
+        const bool isFifo = lstat(fifoPath.c_str(), &st) == 0 && S_ISFIFO(st.st_mode);
+
+        if (IsAducResultCodeFailure(applyResult.ResultCode))
+        {
+            result = applyResult;
+        }
+        else if (!isFifo)
+        {
+            Log_Error("diff processor replaced FIFO '%s'", fifoPath.c_str());
+        }
+        else if (!writeFailed && !readFailed)
+        {
+            result = { ADUC_Result_Success };
+        }
+    }
+
+done:
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    unlink(fifoPath.c_str());
+    rmdir(streamFolder.c_str());
+
+    return result;
+}
+
+/**
+ * @brief Downloads and applies the delta update of a candidate, and checks the target update against @p fileEntity.
+ * @details The target update is streamed, and hashed as it is written, if @p processDeltaUpdateStreamFn is given and
+ * streaming is on. Otherwise, or if streaming fails for a reason other than a hash mismatch, it is processed into a
+ * file that is hashed once written. The target update file is removed unless it passes the hash check.
+ */
+ADUC_Result ProcessDeltaCandidate(
+    const ADUC_WorkflowHandle workflowHandle,
+    const ADUC_FileEntity* fileEntity,
+    DeltaCandidate* candidate,
+    const std::atomic<size_t>& winnerIndex,
+    ProcessDeltaUpdateFn processDeltaUpdateFn,
+    ProcessDeltaUpdateStreamFn processDeltaUpdateStreamFn,
+    DownloadDeltaUpdateFn downloadDeltaUpdateFn)
+{
+    ADUC_Result result = downloadDeltaUpdateFn(workflowHandle, candidate->relatedFile);
+    candidate->downloading = false;
+
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        if (result.ResultCode != ADUC_Result_Failure_Cancelled)
+        {
+            Log_Error("DeltaUpdate download failed, erc 0x%08x.", result.ExtendedResultCode);
+        }
+        return result;
+    }
+
+    if (winnerIndex.load() != NoWinner)
+    {
+        return { ADUC_Result_Failure_Cancelled };
+    }
+
+    STRING_HANDLE deltaUpdatePathHandle = nullptr;
+    result = MicrosoftDeltaDownloadHandlerUtils_GetDeltaUpdateDownloadSandboxPath(
+        workflowHandle, candidate->relatedFile, &deltaUpdatePathHandle);
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        Log_Error("get delta update sandbox path, erc 0x%08x.", result.ExtendedResultCode);
+        return result;
+    }
+
+    const char* deltaUpdateFilePath = STRING_c_str(deltaUpdatePathHandle);
+
+    size_t hashIndex = 0;
+    SHAversion algorithm = SHA256;
+    const char* hashValue = nullptr;
+    if (ADUC_HashUtils_GetIndexStrongestValidHash(fileEntity->Hash, fileEntity->HashCount, &hashIndex, &algorithm))
+    {
+        hashValue = ADUC_HashUtils_GetHashValue(fileEntity->Hash, fileEntity->HashCount, hashIndex);
+    }
+
+    bool processIntoFile = (hashValue != nullptr);
+    bool streamFailed = false;
+
+    if (hashValue == nullptr)
+    {
+        Log_Error("no valid hash to check the target update against");
+        result = { ADUC_Result_Failure, ADUC_ERC_DDH_TARGET_UPDATE_HASH_MISMATCH };
+    }
+    else if (processDeltaUpdateStreamFn != nullptr && s_streamDeltaUpdates.load())
+    {
+        Log_Debug("Streaming delta update at '%s'...", deltaUpdateFilePath);
+        processIntoFile = false;
+
+        result =
+            StreamDeltaCandidate(candidate, deltaUpdateFilePath, hashValue, algorithm, processDeltaUpdateStreamFn);
+        if (IsAducResultCodeFailure(result.ResultCode)
+            && result.ExtendedResultCode != ADUC_ERC_DDH_TARGET_UPDATE_HASH_MISMATCH)
+        {
+            Log_Warn(
+                "streaming delta update failed, ERC 0x%08x, processing it into a file", result.ExtendedResultCode);
+            std::remove(candidate->targetUpdateFilePath.c_str());
+            processIntoFile = true;
+            streamFailed = true;
+        }
+    }
+
+    if (processIntoFile)
+    {
+        Log_Debug("Processing delta update at '%s'...", deltaUpdateFilePath);
+
+        result = processDeltaUpdateFn(
+            candidate->sourceUpdateFilePath.c_str(), deltaUpdateFilePath, candidate->targetUpdateFilePath.c_str());
+
+        if (IsAducResultCodeFailure(result.ResultCode))
+        {
+            Log_Error("processing delta update failed, ERC 0x%08x", result.ExtendedResultCode);
+        }
+        else if (!ADUC_HashUtils_GetFileVerifiedDigest(
+                     candidate->targetUpdateFilePath.c_str(), hashValue, algorithm, &candidate->verifiedDigest))
+        {
+            result = { ADUC_Result_Failure, ADUC_ERC_DDH_TARGET_UPDATE_HASH_MISMATCH };
+        }
+        else if (streamFailed)
+        {
+            // The delta update is good, so it is the diff processor that cannot write to a stream.
+            Log_Warn("turning off streaming of delta updates");
+            s_streamDeltaUpdates = false;
+        }
+    }
+
+    STRING_delete(deltaUpdatePathHandle);
+
+    if (result.ExtendedResultCode == ADUC_ERC_DDH_TARGET_UPDATE_HASH_MISMATCH)
+    {
+        Log_Error("target update made from delta '%s' failed hash check", candidate->relatedFile->FileName);
+    }
+
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        std::remove(candidate->targetUpdateFilePath.c_str());
+    }
+
+    return result;
+}
+
+} // namespace
+
 EXTERN_C_BEGIN
 
 /**
@@ -48,103 +701,413 @@ ADUC_Result MicrosoftDeltaDownloadHandlerUtils_ProcessDeltaUpdate(
 
     ADUC_Result result = { ADUC_Result_Failure };
 
-    adu_apply_handle session = nullptr;
+    try
+    {
+        result = DiffProcessor::GetInstance().Apply(sourceUpdateFilePath, deltaUpdateFilePath, targetUpdateFilePath);
+    }
+    catch (const std::exception& e)
+    {
+        Log_Error("Unhandled std exception: %s", e.what());
+    }
+    catch (...)
+    {
+        Log_Error("Unhandled exception");
+    }
+
+    if (IsAducResultCodeSuccess(result.ResultCode))
+    {
+        result.ExtendedResultCode = 0;
+    }
+
+    Log_Debug("ResultCode %d, erc %d", result.ResultCode, result.ExtendedResultCode);
+
+    return result;
+}
+
+/**
+ * @brief Creates a target update from the source and delta updates, and passes it to @p writeFn as it is produced.
+ *
+ * @param sourceUpdateFilePath The source update path.
+ * @param deltaUpdateFilePath The delta update path.
+ * @param writeFn The function called with the target update, in order, as it is produced.
+ * @param writeContext The context passed to @p writeFn.
+ * @return ADUC_Result The result.
+ */
+ADUC_Result MicrosoftDeltaDownloadHandlerUtils_ProcessDeltaUpdateToStream(
+    const char* sourceUpdateFilePath,
+    const char* deltaUpdateFilePath,
+    MicrosoftDeltaDownloadHandler_WriteFn writeFn,
+    void* writeContext)
+{
+    Log_Debug("Streaming from src '%s' and delta '%s'", sourceUpdateFilePath, deltaUpdateFilePath);
 
-    adu_diff_apply_create_session_fn createSessionFn = nullptr;
-    adu_diff_apply_close_session_fn closeSessionFn = nullptr;
-    adu_diff_apply_fn applyFn = nullptr;
-    adu_diff_apply_get_error_count_fn getErrorCountFn = nullptr;
-    adu_diff_apply_get_error_text_fn getErrorTextFn = nullptr;
-    adu_diff_apply_get_error_code_fn getErrorCodeFn = nullptr;
+    ADUC_Result result = { ADUC_Result_Failure, ADUC_ERC_DDH_BAD_ARGS };
+
+    if (sourceUpdateFilePath == nullptr || deltaUpdateFilePath == nullptr || writeFn == nullptr)
+    {
+        return result;
+    }
 
     try
     {
-        Log_Debug("load diff processor %s ...", AduDiffSharedLibName);
+        result = ApplyDeltaUpdateToStream(sourceUpdateFilePath, deltaUpdateFilePath, writeFn, writeContext);
+    }
+    catch (const std::exception& e)
+    {
+        Log_Error("Unhandled std exception: %s", e.what());
+        result = { ADUC_Result_Failure, ADUC_ERC_DDH_STREAM_TARGET_UPDATE };
+    }
+    catch (...)
+    {
+        Log_Error("Unhandled exception");
+        result = { ADUC_Result_Failure, ADUC_ERC_DDH_STREAM_TARGET_UPDATE };
+    }
 
-        result.ExtendedResultCode = ADUC_ERC_DDH_PROCESSOR_LOAD_LIB;
-        aduc::SharedLib diffApi{ AduDiffSharedLibName };
+    if (IsAducResultCodeSuccess(result.ResultCode))
+    {
+        result.ExtendedResultCode = 0;
+    }
 
-        Log_Debug("ensure symbols ...");
+    Log_Debug("ResultCode %d, erc %d", result.ResultCode, result.ExtendedResultCode);
 
-        result.ExtendedResultCode = ADUC_ERC_DDH_PROCESSOR_ENSURE_SYMBOLS;
-        diffApi.EnsureSymbols({ "adu_diff_apply",
-                                "adu_diff_apply_close_session",
-                                "adu_diff_apply_create_session",
-                                "adu_diff_apply_get_error_code",
-                                "adu_diff_apply_get_error_count",
-                                "adu_diff_apply_get_error_text" });
+    return result;
+}
 
-        createSessionFn =
-            reinterpret_cast<adu_diff_apply_create_session_fn>(diffApi.GetSymbol("adu_diff_apply_create_session"));
-        closeSessionFn =
-            reinterpret_cast<adu_diff_apply_close_session_fn>(diffApi.GetSymbol("adu_diff_apply_close_session"));
-        applyFn = reinterpret_cast<adu_diff_apply_fn>(diffApi.GetSymbol("adu_diff_apply"));
-        getErrorCountFn =
-            reinterpret_cast<adu_diff_apply_get_error_count_fn>(diffApi.GetSymbol("adu_diff_apply_get_error_count"));
-        getErrorTextFn =
-            reinterpret_cast<adu_diff_apply_get_error_text_fn>(diffApi.GetSymbol("adu_diff_apply_get_error_text"));
-        getErrorCodeFn =
-            reinterpret_cast<adu_diff_apply_get_error_code_fn>(diffApi.GetSymbol("adu_diff_apply_get_error_code"));
+/**
+ * @brief Creates the target updates of independent delta updates, applying up to the maximum set by
+ * MicrosoftDeltaDownloadHandlerUtils_SetMaxConcurrentDeltaUpdates at once.
+ *
+ * @param deltaUpdates The delta updates. Their target update paths must differ.
+ * @param deltaUpdateCount The count of @p deltaUpdates.
+ * @param processDeltaUpdateFn The function to call to process each delta update.
+ * @param[out] results The result of each delta update, in the order of @p deltaUpdates.
+ */
+void MicrosoftDeltaDownloadHandlerUtils_ProcessDeltaUpdates(
+    const MicrosoftDeltaDownloadHandler_DeltaUpdate* deltaUpdates,
+    size_t deltaUpdateCount,
+    ProcessDeltaUpdateFn processDeltaUpdateFn,
+    ADUC_Result* results)
+{
+    if (deltaUpdates == nullptr || processDeltaUpdateFn == nullptr || results == nullptr)
+    {
+        return;
+    }
 
-        Log_Debug("create session ...");
+    std::atomic<size_t> nextIndex{ 0 };
 
-        session = createSessionFn();
-        if (session == nullptr)
+    auto worker = [&]() {
+        for (size_t index = nextIndex++; index < deltaUpdateCount; index = nextIndex++)
         {
-            Log_Error("create diffapply session failed");
-            result.ExtendedResultCode = ADUC_ERC_DDH_PROCESSOR_CREATE_SESSION;
+            const MicrosoftDeltaDownloadHandler_DeltaUpdate* deltaUpdate = &deltaUpdates[index];
+            results[index] = processDeltaUpdateFn(
+                deltaUpdate->SourceUpdateFilePath, deltaUpdate->DeltaUpdateFilePath, deltaUpdate->TargetUpdateFilePath);
         }
-        else
+    };
+
+    const size_t workerCount = std::min(std::max<size_t>(s_maxConcurrentDeltaUpdates.load(), 1), deltaUpdateCount);
+    std::vector<std::thread> workers;
+
+    // The calling thread is one of the workers; the others fall back to it if they cannot be started.
+    for (size_t i = 1; i < workerCount; ++i)
+    {
+        try
+        {
+            workers.emplace_back(worker);
+        }
+        catch (const std::exception& e)
         {
-            Log_Debug("Apply diff ...");
+            Log_Warn("Cannot start delta update worker: %s", e.what());
+            break;
+        }
+    }
+
+    worker();
+
+    for (std::thread& thread : workers)
+    {
+        thread.join();
+    }
+}
+
+/**
+ * @brief Processes the related files of an update for delta download handling, until one of them produces the update.
+ * @details Source update cache lookups are answered from its index, so all of them are done first. The cache hits are
+ * then ranked by the size of their delta update, as the smallest one is the quickest to download, and tried on a
+ * bounded worker pool. The first target update to pass the hash check is moved to @p payloadFilePath, and the
+ * downloads still in progress are cancelled. A streamed target update is hashed as it is written, so it is not read
+ * back, and the digest is handed to the caller so that it is not read again either.
+ *
+ * @param workflowHandle The workflow handle.
+ * @param fileEntity The file entity of the update, with its related files.
+ * @param payloadFilePath The payload file path.
+ * @param updateCacheBasePath The update cache base path. Use NULL for default.
+ * @param processDeltaUpdateFn The function to call to process delta updates.
+ * @param processDeltaUpdateStreamFn The function to call to process delta updates into a stream, or NULL.
+ * @param downloadDeltaUpdateFn The function to call to download the delta updates.
+ * @param cancelDeltaUpdateDownloadFn The function to call to cancel the download of a delta update.
+ * @param[out] verifiedDigest On success, the verified digest of the update at @p payloadFilePath. May be NULL.
+ * @return ADUC_Result The result.
+ */
+ADUC_Result MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFiles(
+    const ADUC_WorkflowHandle workflowHandle,
+    const ADUC_FileEntity* fileEntity,
+    const char* payloadFilePath,
+    const char* updateCacheBasePath,
+    ProcessDeltaUpdateFn processDeltaUpdateFn,
+    ProcessDeltaUpdateStreamFn processDeltaUpdateStreamFn,
+    DownloadDeltaUpdateFn downloadDeltaUpdateFn,
+    CancelDeltaUpdateDownloadFn cancelDeltaUpdateDownloadFn,
+    ADUC_VerifiedDigest* verifiedDigest)
+{
+    ADUC_Result result = { ADUC_Result_Failure };
 
-            int res = applyFn(session, sourceUpdateFilePath, deltaUpdateFilePath, targetUpdateFilePath);
+    if (verifiedDigest != nullptr)
+    {
+        *verifiedDigest = {};
+    }
+
+    if (workflowHandle == nullptr || fileEntity == nullptr || fileEntity->RelatedFiles == nullptr
+        || payloadFilePath == nullptr || processDeltaUpdateFn == nullptr || downloadDeltaUpdateFn == nullptr
+        || cancelDeltaUpdateDownloadFn == nullptr)
+    {
+        result.ExtendedResultCode = ADUC_ERC_DDH_BAD_ARGS;
+        return result;
+    }
+
+    try
+    {
+        struct CacheHit
+        {
+            const ADUC_RelatedFile* relatedFile;
+            std::string sourceUpdateFilePath;
+        };
 
-            if (res == 0)
+        std::vector<CacheHit> cacheHits;
+
+        //
+        // See which source updates are in the update cache.
+        //
+        for (size_t index = 0; index < fileEntity->RelatedFileCount; ++index)
+        {
+            const ADUC_RelatedFile* relatedFile = &fileEntity->RelatedFiles[index];
+            STRING_HANDLE sourceUpdatePathHandle = nullptr;
+
+            if (relatedFile->Properties == nullptr || relatedFile->PropertiesCount < 1)
             {
-                result.ResultCode = ADUC_Result_Success;
+                result = { ADUC_Result_Failure, ADUC_ERC_DDH_RELATEDFILE_NO_PROPERTIES };
+                return result;
+            }
+
+            ADUC_Result lookupResult = MicrosoftDeltaDownloadHandlerUtils_LookupSourceUpdateCachePath(
+                workflowHandle, relatedFile, updateCacheBasePath, &sourceUpdatePathHandle);
+
+            if (IsAducResultCodeFailure(lookupResult.ResultCode))
+            {
+                Log_Warn("Delta %zu failed, ERC: 0x%08x.", index, lookupResult.ExtendedResultCode);
+                workflow_add_erc(workflowHandle, lookupResult.ExtendedResultCode);
+            }
+            else if (lookupResult.ResultCode == ADUC_Result_Success_Cache_Miss)
+            {
+                Log_Warn("src update cache miss for Delta %zu", index);
+                workflow_add_erc(workflowHandle, ADUC_ERC_DDH_SOURCE_UPDATE_CACHE_MISS);
             }
             else
             {
-                Log_Error("diff apply - overall err: %d", res);
-                result.ExtendedResultCode = MAKE_DELTA_PROCESSOR_EXTENDEDRESULTCODE(res);
+                cacheHits.push_back({ relatedFile, STRING_c_str(sourceUpdatePathHandle) });
+            }
+
+            STRING_delete(sourceUpdatePathHandle);
+        }
+
+        if (cacheHits.empty())
+        {
+            result = { ADUC_Result_Success_Cache_Miss };
+            return result;
+        }
+
+        // Smallest delta update first; related files of the same size keep the order of the update manifest.
+        std::stable_sort(cacheHits.begin(), cacheHits.end(), [](const CacheHit& lhs, const CacheHit& rhs) {
+            return lhs.relatedFile->SizeInBytes < rhs.relatedFile->SizeInBytes;
+        });
+
+        std::vector<DeltaCandidate> candidates(cacheHits.size());
+        for (size_t index = 0; index < candidates.size(); ++index)
+        {
+            candidates[index].relatedFile = cacheHits[index].relatedFile;
+            candidates[index].sourceUpdateFilePath = std::move(cacheHits[index].sourceUpdateFilePath);
+            candidates[index].targetUpdateFilePath =
+                std::string{ payloadFilePath } + ".delta" + std::to_string(index);
+        }
 
-                size_t errorCount = getErrorCountFn(session);
-                for (size_t errIndex = 0; errIndex < errorCount; ++errIndex)
+        //
+        // Download and apply the best candidates at once, until one produces the target update.
+        //
+        std::atomic<size_t> nextIndex{ 0 };
+        std::atomic<size_t> winnerIndex{ NoWinner };
+
+        auto worker = [&]() {
+            for (size_t index = nextIndex++; index < candidates.size(); index = nextIndex++)
+            {
+                DeltaCandidate& candidate = candidates[index];
+
+                // Flagged before checking for a winner, so that a winner found after the check cancels it.
+                candidate.downloading = true;
+                if (winnerIndex.load() != NoWinner)
                 {
-                    int error_code = getErrorCodeFn(session, errIndex);
-                    const char* error_text = getErrorTextFn(session, errIndex); // do not free
-                        //
-                    Log_Error("diff apply - errcode %d: '%s'", error_code, error_text);
+                    candidate.downloading = false;
+                    break;
+                }
 
-                    result.ExtendedResultCode = MAKE_DELTA_PROCESSOR_EXTENDEDRESULTCODE(error_code);
+                Log_Debug(
+                    "Trying delta '%s' of %zu bytes",
+                    candidate.relatedFile->FileName,
+                    candidate.relatedFile->SizeInBytes);
+
+                candidate.result = ProcessDeltaCandidate(
+                    workflowHandle,
+                    fileEntity,
+                    &candidate,
+                    winnerIndex,
+                    processDeltaUpdateFn,
+                    processDeltaUpdateStreamFn,
+                    downloadDeltaUpdateFn);
+                if (IsAducResultCodeFailure(candidate.result.ResultCode))
+                {
+                    continue;
+                }
+
+                size_t noWinner = NoWinner;
+                if (!winnerIndex.compare_exchange_strong(noWinner, index))
+                {
+                    std::remove(candidate.targetUpdateFilePath.c_str());
+                    candidate.result = { ADUC_Result_Failure_Cancelled };
+                    continue;
+                }
+
+                for (DeltaCandidate& other : candidates)
+                {
+                    if (other.downloading.load())
+                    {
+                        cancelDeltaUpdateDownloadFn(workflowHandle, other.relatedFile);
+                    }
                 }
             }
+        };
+
+        const size_t workerCount =
+            std::min(std::max<size_t>(s_maxConcurrentDeltaUpdates.load(), 1), candidates.size());
+        std::vector<std::thread> workers;
+
+        // The calling thread is one of the workers; the others fall back to it if they cannot be started.
+        for (size_t i = 1; i < workerCount; ++i)
+        {
+            try
+            {
+                workers.emplace_back(worker);
+            }
+            catch (const std::exception& e)
+            {
+                Log_Warn("Cannot start delta update worker: %s", e.what());
+                break;
+            }
+        }
+
+        worker();
+
+        for (std::thread& thread : workers)
+        {
+            thread.join();
         }
+
+        // The workflow is not thread-safe, so failures are added to it once all the workers are done, in rank order.
+        result = { ADUC_Result_Failure_Cancelled };
+        for (const DeltaCandidate& candidate : candidates)
+        {
+            if (IsAducResultCodeFailure(candidate.result.ResultCode)
+                && candidate.result.ResultCode != ADUC_Result_Failure_Cancelled)
+            {
+                Log_Warn(
+                    "Delta '%s' failed, ERC: 0x%08x.",
+                    candidate.relatedFile->FileName,
+                    candidate.result.ExtendedResultCode);
+                workflow_add_erc(workflowHandle, candidate.result.ExtendedResultCode);
+                result = candidate.result;
+            }
+        }
+
+        const size_t winner = winnerIndex.load();
+        if (winner == NoWinner)
+        {
+            return result;
+        }
+
+        if (std::rename(candidates[winner].targetUpdateFilePath.c_str(), payloadFilePath) != 0)
+        {
+            Log_Error("Cannot move '%s' to '%s'", candidates[winner].targetUpdateFilePath.c_str(), payloadFilePath);
+            std::remove(candidates[winner].targetUpdateFilePath.c_str());
+            workflow_add_erc(workflowHandle, ADUC_ERC_DDH_MOVE_TARGET_UPDATE);
+            result = { ADUC_Result_Failure, ADUC_ERC_DDH_MOVE_TARGET_UPDATE };
+            return result;
+        }
+
+        // The move keeps the identity of the file, so its verified digest is still current.
+        if (verifiedDigest != nullptr)
+        {
+            *verifiedDigest = candidates[winner].verifiedDigest;
+        }
+
+        Log_Info("Processing Delta '%s' succeeded", candidates[winner].relatedFile->FileName);
+        result = { ADUC_Result_Success };
     }
     catch (const std::exception& e)
     {
         Log_Error("Unhandled std exception: %s", e.what());
+        result = { ADUC_Result_Failure, ADUC_ERC_NOMEM };
     }
     catch (...)
     {
         Log_Error("Unhandled exception");
+        result = { ADUC_Result_Failure, ADUC_ERC_NOMEM };
     }
 
-    if (session != nullptr && closeSessionFn != nullptr)
+    return result;
+}
+
+/**
+ * @brief Sets the maximum number of delta updates applied at once by
+ * MicrosoftDeltaDownloadHandlerUtils_ProcessDeltaUpdates, which is also the number of idle sessions kept for reuse.
+ *
+ * @param maxConcurrentDeltaUpdates The maximum, at least 1.
+ */
+void MicrosoftDeltaDownloadHandlerUtils_SetMaxConcurrentDeltaUpdates(size_t maxConcurrentDeltaUpdates)
+{
+    s_maxConcurrentDeltaUpdates = std::max<size_t>(maxConcurrentDeltaUpdates, 1);
+}
+
+/**
+ * @brief Sets whether MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFiles streams the target updates.
+ *
+ * @param streamDeltaUpdates true to stream the target updates.
+ */
+void MicrosoftDeltaDownloadHandlerUtils_SetStreamDeltaUpdates(bool streamDeltaUpdates)
+{
+    s_streamDeltaUpdates = streamDeltaUpdates;
+}
+
+/**
+ * @brief Closes the pooled diff processor sessions and unloads the diff processor library.
+ * It is loaded again on the next delta update.
+ */
+void MicrosoftDeltaDownloadHandlerUtils_Cleanup()
+{
+    try
     {
-        Log_Debug("close session ...");
-        closeSessionFn(session);
+        DiffProcessor::GetInstance().Unload();
     }
-
-    if (IsAducResultCodeSuccess(result.ResultCode))
+    catch (...)
     {
-        result.ExtendedResultCode = 0;
+        Log_Error("Unhandled exception");
     }
-
-    Log_Debug("ResultCode %d, erc %d", result.ResultCode, result.ExtendedResultCode);
-
-    return result;
 }
 
 EXTERN_C_END
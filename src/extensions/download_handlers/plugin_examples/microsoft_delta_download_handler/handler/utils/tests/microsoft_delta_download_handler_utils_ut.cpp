@@ -11,13 +11,29 @@
 using Catch::Matchers::Equals;
 
 #include "aduc/microsoft_delta_download_handler_utils.h"
+#include <aduc/calloc_wrapper.hpp> // ADUC::StringUtils::cstr_wrapper
+#include <aduc/hash_utils.h> // ADUC_HashUtils_GetFileHash
 #include <aduc/parser_utils.h>
 #include <aduc/result.h> // ADUC_Result_*
+#include <aduc/source_update_cache.h> // ADUC_SourceUpdateCache_Reset
+#include <aduc/source_update_cache_utils.h> // ADUC_SourceUpdateCacheUtils_CreateSourceUpdateCachePath
+#include <aduc/system_utils.h> // ADUC_SystemUtils_*, SystemUtils_IsFile
 #include <aduc/types/adu_core.h> // ADUC_Result_*
 #include <aduc/types/update_content.h> // ADUC_RelatedFile, ADUC_FileEntity
 #include <aduc/types/workflow.h> // ADUC_WorkflowHandle
 #include <aduc/workflow_utils.h>
+#include <algorithm> // std::max
+#include <atomic>
+#include <chrono>
+#include <cstdio> // std::remove
+#include <cstdlib> // mkdtemp
+#include <fstream>
+#include <mutex>
 #include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #define TEST_WORKFLOW_ID "7e3e7d32de4db3ef1337bac7341ab347"
 #define TEST_PAYLOAD_FILE_ID "ac47d3bab772454283ae95f0bbb1a1de"
@@ -149,3 +165,462 @@ TEST_CASE("MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFile Cache Miss")
 
     ADUC_FileEntity_Uninit(&fileEntity);
 }
+
+static std::atomic<int> s_activeDeltaUpdates{ 0 };
+static std::atomic<int> s_maxActiveDeltaUpdates{ 0 };
+
+ADUC_Result MockConcurrentProcessDeltaUpdateFn(
+    const char* _sourceUpdateFilePath, const char* _deltaUpdateFilePath, const char* targetUpdateFilePath)
+{
+    const int active = ++s_activeDeltaUpdates;
+
+    int maxActive = s_maxActiveDeltaUpdates.load();
+    while (active > maxActive && !s_maxActiveDeltaUpdates.compare_exchange_weak(maxActive, active))
+    {
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    --s_activeDeltaUpdates;
+
+    // Fail the deltas whose target name ends with 'x'.
+    const std::string target{ targetUpdateFilePath };
+    ADUC_Result result = { ADUC_Result_Success };
+    if (target.back() == 'x')
+    {
+        result = { ADUC_Result_Failure, ADUC_ERC_DDH_PROCESSOR_CREATE_SESSION };
+    }
+    return result;
+}
+
+TEST_CASE("MicrosoftDeltaDownloadHandlerUtils_ProcessDeltaUpdates applies on a bounded worker pool")
+{
+    const size_t maxConcurrent = GENERATE(1, 3);
+    MicrosoftDeltaDownloadHandlerUtils_SetMaxConcurrentDeltaUpdates(maxConcurrent);
+    s_maxActiveDeltaUpdates = 0;
+
+    std::vector<std::string> targets;
+    for (int i = 0; i < 8; ++i)
+    {
+        targets.push_back("/target" + std::to_string(i) + (i % 3 == 0 ? "x" : ""));
+    }
+
+    std::vector<MicrosoftDeltaDownloadHandler_DeltaUpdate> deltaUpdates;
+    for (const std::string& target : targets)
+    {
+        deltaUpdates.push_back({ "/source", "/delta", target.c_str() });
+    }
+
+    std::vector<ADUC_Result> results(deltaUpdates.size());
+
+    MicrosoftDeltaDownloadHandlerUtils_ProcessDeltaUpdates(
+        deltaUpdates.data(), deltaUpdates.size(), MockConcurrentProcessDeltaUpdateFn, results.data());
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        CHECK(IsAducResultCodeSuccess(results[i].ResultCode) == (i % 3 != 0));
+    }
+
+    CHECK(s_maxActiveDeltaUpdates.load() <= static_cast<int>(maxConcurrent));
+    if (maxConcurrent > 1)
+    {
+        CHECK(s_maxActiveDeltaUpdates.load() > 1);
+    }
+
+    MicrosoftDeltaDownloadHandlerUtils_SetMaxConcurrentDeltaUpdates(
+        MICROSOFT_DELTA_DOWNLOAD_HANDLER_DEFAULT_MAX_CONCURRENT_DELTA_UPDATES);
+}
+
+namespace
+{
+/**
+ * @brief A delta update related file of the test update.
+ * @details The mocks below act on the file name: a delta update named "good..." produces the target update, and the
+ * others a corrupt one; a "slow..." download runs until it is cancelled, and a "...after_slow" one waits for it to
+ * start; a "...unstreamable..." one cannot be streamed. The source update is put in the cache unless its hash starts
+ * with "missing".
+ */
+struct TestDelta
+{
+    const char* fileName;
+    size_t sizeInBytes;
+    const char* sourceHash;
+};
+
+const char* const TargetUpdateContent = "target update";
+
+std::mutex s_deltaMutex;
+std::vector<std::string> s_downloadedDeltas;
+std::vector<std::string> s_cancelledDeltas;
+std::vector<std::string> s_processedDeltas;
+std::vector<std::string> s_streamedDeltas;
+std::atomic<bool> s_slowDownloadStarted{ false };
+std::atomic<bool> s_slowDownloadCancelled{ false };
+
+bool WaitFor(const std::atomic<bool>& flag)
+{
+    for (int i = 0; i < 500 && !flag.load(); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    return flag.load();
+}
+
+ADUC_Result
+MockRankedDownloadDeltaUpdateFn(const ADUC_WorkflowHandle _workflowHandle, const ADUC_RelatedFile* relatedFile)
+{
+    const std::string fileName{ relatedFile->FileName };
+
+    {
+        std::lock_guard<std::mutex> lock{ s_deltaMutex };
+        s_downloadedDeltas.push_back(fileName);
+    }
+
+    if (fileName.find("slow") == 0)
+    {
+        s_slowDownloadStarted = true;
+        if (WaitFor(s_slowDownloadCancelled))
+        {
+            return { ADUC_Result_Failure_Cancelled };
+        }
+    }
+    else if (fileName.find("after_slow") != std::string::npos)
+    {
+        WaitFor(s_slowDownloadStarted);
+    }
+
+    return { ADUC_Result_Success };
+}
+
+void MockCancelDeltaUpdateDownloadFn(const ADUC_WorkflowHandle _workflowHandle, const ADUC_RelatedFile* relatedFile)
+{
+    const std::string fileName{ relatedFile->FileName };
+
+    {
+        std::lock_guard<std::mutex> lock{ s_deltaMutex };
+        s_cancelledDeltas.push_back(fileName);
+    }
+
+    if (fileName.find("slow") == 0)
+    {
+        s_slowDownloadCancelled = true;
+    }
+}
+
+ADUC_Result MockRankedProcessDeltaUpdateFn(
+    const char* _sourceUpdateFilePath, const char* deltaUpdateFilePath, const char* targetUpdateFilePath)
+{
+    const std::string deltaUpdateFileName = std::regex_replace(deltaUpdateFilePath, std::regex(".*/"), "");
+
+    {
+        std::lock_guard<std::mutex> lock{ s_deltaMutex };
+        s_processedDeltas.push_back(deltaUpdateFileName);
+    }
+
+    std::ofstream file{ targetUpdateFilePath, std::ios::trunc | std::ios::binary };
+    file << (deltaUpdateFileName.find("good") == 0 ? TargetUpdateContent : "corrupt");
+
+    return { file.good() ? ADUC_Result_Success : ADUC_Result_Failure };
+}
+
+ADUC_Result MockRankedProcessDeltaUpdateStreamFn(
+    const char* _sourceUpdateFilePath,
+    const char* deltaUpdateFilePath,
+    MicrosoftDeltaDownloadHandler_WriteFn writeFn,
+    void* writeContext)
+{
+    const std::string deltaUpdateFileName = std::regex_replace(deltaUpdateFilePath, std::regex(".*/"), "");
+
+    {
+        std::lock_guard<std::mutex> lock{ s_deltaMutex };
+        s_streamedDeltas.push_back(deltaUpdateFileName);
+    }
+
+    if (deltaUpdateFileName.find("unstreamable") != std::string::npos)
+    {
+        return { ADUC_Result_Failure, ADUC_ERC_DDH_STREAM_TARGET_UPDATE };
+    }
+
+    // Written in two parts, as a diff processor writes its output in blocks.
+    const std::string content = deltaUpdateFileName.find("good") == 0 ? TargetUpdateContent : "corrupt";
+    const size_t half = content.size() / 2;
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(content.data());
+
+    if (!writeFn(writeContext, data, half) || !writeFn(writeContext, data + half, content.size() - half))
+    {
+        return { ADUC_Result_Failure, ADUC_ERC_DDH_STREAM_TARGET_UPDATE };
+    }
+
+    return { ADUC_Result_Success };
+}
+
+/**
+ * @brief An update with delta update related files, and a source update cache, in a temporary folder.
+ */
+class DeltaCandidatesFixture
+{
+public:
+    DeltaCandidatesFixture()
+    {
+        REQUIRE(mkdtemp(_dir) != nullptr);
+
+        s_downloadedDeltas.clear();
+        s_cancelledDeltas.clear();
+        s_processedDeltas.clear();
+        s_streamedDeltas.clear();
+        s_slowDownloadStarted = false;
+        s_slowDownloadCancelled = false;
+    }
+
+    DeltaCandidatesFixture(const DeltaCandidatesFixture&) = delete;
+    DeltaCandidatesFixture& operator=(const DeltaCandidatesFixture&) = delete;
+    DeltaCandidatesFixture(DeltaCandidatesFixture&&) = delete;
+    DeltaCandidatesFixture& operator=(DeltaCandidatesFixture&&) = delete;
+
+    ~DeltaCandidatesFixture()
+    {
+        ADUC_FileEntity_Uninit(&_fileEntity);
+        workflow_free(_handle);
+
+        MicrosoftDeltaDownloadHandlerUtils_SetMaxConcurrentDeltaUpdates(
+            MICROSOFT_DELTA_DOWNLOAD_HANDLER_DEFAULT_MAX_CONCURRENT_DELTA_UPDATES);
+        MicrosoftDeltaDownloadHandlerUtils_SetStreamDeltaUpdates(true);
+        ADUC_SourceUpdateCache_Reset();
+        ADUC_SystemUtils_RmDirRecursive(_dir);
+    }
+
+    std::string GetPayloadFilePath() const
+    {
+        return std::string{ _dir } + "/target_update.swu";
+    }
+
+    std::string GetCacheBasePath() const
+    {
+        return std::string{ _dir } + "/cache";
+    }
+
+    /**
+     * @brief Creates the workflow of an update with @p deltas, and puts their source updates in the cache.
+     */
+    void CreateUpdate(const std::vector<TestDelta>& deltas)
+    {
+        const std::string expectedPath = std::string{ _dir } + "/expected";
+        {
+            std::ofstream file{ expectedPath, std::ios::trunc | std::ios::binary };
+            file << TargetUpdateContent;
+        }
+
+        ADUC::StringUtils::cstr_wrapper payloadHash;
+        REQUIRE(ADUC_HashUtils_GetFileHash(expectedPath.c_str(), SHA256, payloadHash.address_of()));
+
+        REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault((GetCacheBasePath() + "/contoso").c_str()) == 0);
+
+        std::stringstream relatedFiles;
+        std::stringstream fileUrls;
+
+        for (size_t i = 0; i < deltas.size(); ++i)
+        {
+            const TestDelta& delta = deltas[i];
+            const std::string fileId = "deltafileid" + std::to_string(i);
+
+            relatedFiles << (i == 0 ? "" : ",") << R"(")" << fileId << R"(":{"fileName":")" << delta.fileName
+                         << R"(","sizeInBytes":)" << delta.sizeInBytes << R"(,"hashes":{"sha256":"deltahash"},)"
+                         << R"("properties":{"microsoft.sourceFileHash":")" << delta.sourceHash
+                         << R"(","microsoft.sourceFileHashAlgorithm":"sha256"}})";
+            fileUrls << R"(,")" << fileId << R"(":"http://hostname:port/path/to/)" << delta.fileName << R"(")";
+
+            if (std::string{ delta.sourceHash }.find("missing") != 0)
+            {
+                STRING_HANDLE sourcePath = ADUC_SourceUpdateCacheUtils_CreateSourceUpdateCachePath(
+                    "contoso", delta.sourceHash, "sha256", GetCacheBasePath().c_str());
+                REQUIRE(sourcePath != nullptr);
+                std::ofstream file{ STRING_c_str(sourcePath), std::ios::trunc | std::ios::binary };
+                file << "source update";
+                STRING_delete(sourcePath);
+            }
+        }
+
+        std::string manifest =
+            R"({"compatibility":[{"deviceManufacturer":"contoso","deviceModel":"toaster"}],)"
+            R"("createdDateTime":"2022-03-12T12:22:37.2627901Z",)"
+            R"("files":{")" TEST_PAYLOAD_FILE_ID R"(":{"fileName":"target_update.swu",)"
+            R"("hashes":{"sha256":")"
+            + std::string{ payloadHash.get() }
+            + R"("},"sizeInBytes":13,"downloadHandler":{"id":"microsoft/delta:1"},"relatedFiles":{)"
+            + relatedFiles.str()
+            + R"(}}},"instructions":{"steps":[{"files":[")" TEST_PAYLOAD_FILE_ID R"("],)"
+              R"("handler":"microsoft/swupdate:1","handlerProperties":{"installedCriteria":"1.0"}}]},)"
+              R"("manifestVersion":"5","updateId":{"name":"toaster_firmware","provider":"contoso","version":"0.1"}})";
+        manifest = std::regex_replace(manifest, std::regex("\""), "\\\"");
+
+        const std::string desired = R"({"fileUrls":{")" TEST_PAYLOAD_FILE_ID R"(":"http://hostname:port/path/to/full")"
+            + fileUrls.str() + R"(},"updateManifest":")" + manifest
+            + R"(","updateManifestSignature":"SIGNATURE","workflow":{"action":3,"id":")" TEST_WORKFLOW_ID R"("}})";
+
+        ADUC_Result result = workflow_init(desired.c_str(), false, &_handle);
+        REQUIRE(IsAducResultCodeSuccess(result.ResultCode));
+        REQUIRE(workflow_set_workfolder(_handle, "%s/work", _dir));
+        REQUIRE(workflow_get_update_file(_handle, 0, &_fileEntity));
+        REQUIRE(_fileEntity.RelatedFileCount == deltas.size());
+    }
+
+    ADUC_Result ProcessRelatedFiles(ProcessDeltaUpdateStreamFn processDeltaUpdateStreamFn = nullptr)
+    {
+        return MicrosoftDeltaDownloadHandlerUtils_ProcessRelatedFiles(
+            _handle,
+            &_fileEntity,
+            GetPayloadFilePath().c_str(),
+            GetCacheBasePath().c_str(),
+            MockRankedProcessDeltaUpdateFn,
+            processDeltaUpdateStreamFn,
+            MockRankedDownloadDeltaUpdateFn,
+            MockCancelDeltaUpdateDownloadFn,
+            &_verifiedDigest);
+    }
+
+    /**
+     * @brief Checks that the verified digest handed over by the last ProcessRelatedFiles is that of the payload file.
+     */
+    bool IsVerifiedDigestOfPayloadFile() const
+    {
+        return ADUC_HashUtils_IsVerifiedDigestCurrent(&_verifiedDigest, GetPayloadFilePath().c_str())
+            && ADUC_HashUtils_IsVerifiedDigestMatch(&_verifiedDigest, _fileEntity.Hash[0].value, SHA256);
+    }
+
+    std::string ReadPayloadFile() const
+    {
+        std::ifstream file{ GetPayloadFilePath(), std::ios::binary };
+        std::stringstream content;
+        content << file.rdbuf();
+        return content.str();
+    }
+
+    /**
+     * @brief Checks that no target update made from a losing delta update is left next to the payload file.
+     */
+    bool HasLeftoverTargetUpdates() const
+    {
+        for (size_t i = 0; i < _fileEntity.RelatedFileCount; ++i)
+        {
+            const std::string path = GetPayloadFilePath() + ".delta" + std::to_string(i);
+            if (SystemUtils_IsFile(path.c_str(), nullptr))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+private:
+    char _dir[sizeof("/tmp/aduc_delta_candidates_XXXXXX")] = "/tmp/aduc_delta_candidates_XXXXXX";
+    ADUC_WorkflowHandle _handle = nullptr;
+    ADUC_FileEntity _fileEntity = {};
+    ADUC_VerifiedDigest _verifiedDigest = {};
+};
+
+} // namespace
+
+TEST_CASE_METHOD(DeltaCandidatesFixture, "ProcessRelatedFiles tries the smallest cached delta first")
+{
+    MicrosoftDeltaDownloadHandlerUtils_SetMaxConcurrentDeltaUpdates(1);
+    CreateUpdate({ { "good_large.delta", 3000, "sourceA" },
+                   { "good_missing.delta", 10, "missingSource" },
+                   { "good_small.delta", 100, "sourceB" } });
+
+    ADUC_Result result = ProcessRelatedFiles();
+
+    CHECK(result.ResultCode == ADUC_Result_Success);
+    CHECK(ReadPayloadFile() == TargetUpdateContent);
+    CHECK(s_downloadedDeltas == std::vector<std::string>{ "good_small.delta" });
+    CHECK(IsVerifiedDigestOfPayloadFile());
+    CHECK_FALSE(HasLeftoverTargetUpdates());
+}
+
+TEST_CASE_METHOD(DeltaCandidatesFixture, "ProcessRelatedFiles falls back on a hash mismatch")
+{
+    MicrosoftDeltaDownloadHandlerUtils_SetMaxConcurrentDeltaUpdates(1);
+    CreateUpdate({ { "good_large.delta", 3000, "sourceA" }, { "corrupt_small.delta", 100, "sourceB" } });
+
+    ADUC_Result result = ProcessRelatedFiles();
+
+    CHECK(result.ResultCode == ADUC_Result_Success);
+    CHECK(ReadPayloadFile() == TargetUpdateContent);
+    CHECK(s_downloadedDeltas == std::vector<std::string>{ "corrupt_small.delta", "good_large.delta" });
+    CHECK_FALSE(HasLeftoverTargetUpdates());
+}
+
+TEST_CASE_METHOD(DeltaCandidatesFixture, "ProcessRelatedFiles fails when no delta matches")
+{
+    CreateUpdate({ { "corrupt_large.delta", 3000, "sourceA" }, { "corrupt_small.delta", 100, "sourceB" } });
+
+    ADUC_Result result = ProcessRelatedFiles();
+
+    CHECK(result.ResultCode == ADUC_Result_Failure);
+    CHECK(result.ExtendedResultCode == ADUC_ERC_DDH_TARGET_UPDATE_HASH_MISMATCH);
+    CHECK_FALSE(SystemUtils_IsFile(GetPayloadFilePath().c_str(), nullptr));
+    CHECK_FALSE(HasLeftoverTargetUpdates());
+}
+
+TEST_CASE_METHOD(DeltaCandidatesFixture, "ProcessRelatedFiles cancels the other downloads once one wins")
+{
+    MicrosoftDeltaDownloadHandlerUtils_SetMaxConcurrentDeltaUpdates(2);
+    CreateUpdate({ { "slow_good.delta", 3000, "sourceA" }, { "good_after_slow.delta", 100, "sourceB" } });
+
+    ADUC_Result result = ProcessRelatedFiles();
+
+    CHECK(result.ResultCode == ADUC_Result_Success);
+    CHECK(ReadPayloadFile() == TargetUpdateContent);
+    CHECK(s_slowDownloadCancelled.load());
+    CHECK(s_cancelledDeltas == std::vector<std::string>{ "slow_good.delta" });
+    CHECK_FALSE(HasLeftoverTargetUpdates());
+}
+
+TEST_CASE_METHOD(DeltaCandidatesFixture, "ProcessRelatedFiles downloads nothing without cached sources")
+{
+    CreateUpdate({ { "good_large.delta", 3000, "missingSourceA" }, { "good_small.delta", 100, "missingSourceB" } });
+
+    ADUC_Result result = ProcessRelatedFiles();
+
+    CHECK(result.ResultCode == ADUC_Result_Success_Cache_Miss);
+    CHECK(s_downloadedDeltas.empty());
+}
+
+TEST_CASE_METHOD(DeltaCandidatesFixture, "ProcessRelatedFiles streams the target update")
+{
+    MicrosoftDeltaDownloadHandlerUtils_SetMaxConcurrentDeltaUpdates(1);
+    CreateUpdate({ { "good_large.delta", 3000, "sourceA" }, { "corrupt_small.delta", 100, "sourceB" } });
+
+    ADUC_Result result = ProcessRelatedFiles(MockRankedProcessDeltaUpdateStreamFn);
+
+    CHECK(result.ResultCode == ADUC_Result_Success);
+    CHECK(ReadPayloadFile() == TargetUpdateContent);
+    CHECK(IsVerifiedDigestOfPayloadFile());
+
+    // A hash mismatch of a streamed target update is not retried into a file.
+    CHECK(s_streamedDeltas == std::vector<std::string>{ "corrupt_small.delta", "good_large.delta" });
+    CHECK(s_processedDeltas.empty());
+    CHECK_FALSE(HasLeftoverTargetUpdates());
+}
+
+TEST_CASE_METHOD(DeltaCandidatesFixture, "ProcessRelatedFiles stops streaming when only files can be processed")
+{
+    CreateUpdate({ { "good_unstreamable.delta", 100, "sourceA" } });
+
+    ADUC_Result result = ProcessRelatedFiles(MockRankedProcessDeltaUpdateStreamFn);
+
+    CHECK(result.ResultCode == ADUC_Result_Success);
+    CHECK(ReadPayloadFile() == TargetUpdateContent);
+    CHECK(IsVerifiedDigestOfPayloadFile());
+    CHECK(s_streamedDeltas == std::vector<std::string>{ "good_unstreamable.delta" });
+    CHECK(s_processedDeltas == std::vector<std::string>{ "good_unstreamable.delta" });
+
+    REQUIRE(std::remove(GetPayloadFilePath().c_str()) == 0);
+
+    result = ProcessRelatedFiles(MockRankedProcessDeltaUpdateStreamFn);
+
+    CHECK(result.ResultCode == ADUC_Result_Success);
+    CHECK(s_streamedDeltas.size() == 1);
+    CHECK(s_processedDeltas.size() == 2);
+    CHECK_FALSE(HasLeftoverTargetUpdates());
+}
@@ -9,9 +9,34 @@
 #ifndef __SOURCE_UPDATE_CACHE_H__
 #define __SOURCE_UPDATE_CACHE_H__
 
+#include <aduc/c_utils.h> // EXTERN_C_*
 #include <aduc/result.h> // ADUC_RESULT
 #include <aduc/types/workflow.h> // ADUC_WorkflowHandle
 #include <azure_c_shared_utility/strings.h> // STRING_HANDLE
+#include <stddef.h> // size_t
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief The order in which files are evicted from the source update cache to free space.
+ */
+typedef enum tagADUC_SourceUpdateCache_EvictionPolicy
+{
+    ADUC_SourceUpdateCache_EvictionPolicy_LeastRecentlyUsed = 0, /**< Least recently used first. The default. */
+    ADUC_SourceUpdateCache_EvictionPolicy_LeastFrequentlyUsed = 1, /**< Least used first, then least recently used. */
+} ADUC_SourceUpdateCache_EvictionPolicy;
+
+/**
+ * @brief The effectiveness of the source update cache since the agent started.
+ */
+typedef struct tagADUC_SourceUpdateCache_Statistics
+{
+    size_t HitCount; /**< The number of lookups that found a source update. */
+    size_t MissCount; /**< The number of lookups that did not. */
+    size_t EvictionCount; /**< The number of files evicted to free space. */
+    size_t EntryCount; /**< The number of files in the cache. */
+    unsigned long long SizeInBytes; /**< The total size of the files in the cache. */
+} ADUC_SourceUpdateCache_Statistics;
 
 /**
  * @brief Looks up a source update from the source update cache.
@@ -39,4 +64,36 @@ ADUC_Result ADUC_SourceUpdateCache_Lookup(
  */
 ADUC_Result ADUC_SourceUpdateCache_Move(const ADUC_WorkflowHandle workflowHandle, const char* updateCacheBasePath);
 
+/**
+ * @brief Sets the byte budget of the source update cache.
+ * @details The default is ADUC_DELTA_DOWNLOAD_HANDLER_SOURCE_UPDATE_CACHE_MAX_SIZE_MB. With a budget, files are
+ * evicted when payloads are moved into the cache until the cache fits in the budget. Without one (0), as many bytes
+ * as the incoming payloads take are evicted instead.
+ *
+ * @param maxSizeInBytes The budget in bytes, or 0 for none.
+ */
+void ADUC_SourceUpdateCache_SetMaxSizeInBytes(unsigned long long maxSizeInBytes);
+
+/**
+ * @brief Sets the order in which files are evicted. The default is least recently used first.
+ *
+ * @param policy The eviction policy.
+ */
+void ADUC_SourceUpdateCache_SetEvictionPolicy(ADUC_SourceUpdateCache_EvictionPolicy policy);
+
+/**
+ * @brief Gets the hit, miss and eviction counts, and the number and total size of the files in the cache.
+ *
+ * @param[out] outStatistics The statistics.
+ */
+void ADUC_SourceUpdateCache_GetStatistics(ADUC_SourceUpdateCache_Statistics* outStatistics);
+
+/**
+ * @brief Drops the index in memory, so that it is loaded again from the manifest file on next use, as after a
+ * restart. The statistics are reset too.
+ */
+void ADUC_SourceUpdateCache_Reset(void);
+
+EXTERN_C_END
+
 #endif // __SOURCE_UPDATE_CACHE_H__
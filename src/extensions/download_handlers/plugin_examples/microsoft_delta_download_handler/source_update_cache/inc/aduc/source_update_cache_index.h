@@ -0,0 +1,85 @@
+/**
+ * @file source_update_cache_index.h
+ * @brief The in-memory index of the source update cache, persisted to a manifest file in the cache base directory.
+ *
+ * @details An entry is kept for each file in the cache, keyed by its path relative to the cache base directory, with
+ * its size, inode, last-used time and use count. Lookups are answered from the index, so a miss does not touch the
+ * filesystem. The manifest is rebuilt from the files in the cache when it is missing, untrusted or malformed.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#ifndef SOURCE_UPDATE_CACHE_INDEX_H
+#define SOURCE_UPDATE_CACHE_INDEX_H
+
+#include <aduc/c_utils.h> // EXTERN_C_*
+#include <stdbool.h>
+#include <stddef.h> // size_t
+#include <sys/types.h> // ino_t
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief The name of the manifest file in the cache base directory.
+ */
+#define ADUC_SOURCE_UPDATE_CACHE_INDEX_FILE_NAME "source_update_cache_index"
+
+/**
+ * @brief Looks up a cache file, and records its use on a hit.
+ * @details A hit is confirmed with a single stat of the file. An entry whose file is gone or has another size is
+ * dropped, and counted as a miss.
+ *
+ * @param updateCacheBasePath The path to the base of update cache. NULL for default.
+ * @param cacheFilePath The path of the cache file, as made by ADUC_SourceUpdateCacheUtils_CreateSourceUpdateCachePath.
+ * @return bool true on a hit.
+ */
+bool ADUC_SourceUpdateCacheIndex_Lookup(const char* updateCacheBasePath, const char* cacheFilePath);
+
+/**
+ * @brief Adds, or refreshes, the entry of a file that was just moved into the cache.
+ *
+ * @param updateCacheBasePath The path to the base of update cache. NULL for default.
+ * @param cacheFilePath The path of the cache file.
+ * @return bool true on success.
+ */
+bool ADUC_SourceUpdateCacheIndex_Add(const char* updateCacheBasePath, const char* cacheFilePath);
+
+/**
+ * @brief Gets the total size of the files in the cache.
+ *
+ * @param updateCacheBasePath The path to the base of update cache. NULL for default.
+ * @return unsigned long long The size in bytes.
+ */
+unsigned long long ADUC_SourceUpdateCacheIndex_GetSizeInBytes(const char* updateCacheBasePath);
+
+/**
+ * @brief Deletes files from the cache, in the order of the eviction policy, until @p bytesToFree bytes are freed or
+ * no more files can be deleted.
+ *
+ * @param updateCacheBasePath The path to the base of update cache. NULL for default.
+ * @param bytesToFree The number of bytes to free.
+ * @param keepFilePaths The paths of the cache files that must be kept. May be NULL if @p keepFilePathCount is 0.
+ * @param keepFilePathCount The number of paths in @p keepFilePaths.
+ * @param keepInodes The inodes of the cache files that must be kept. May be NULL if @p keepInodeCount is 0.
+ * @param keepInodeCount The number of inodes in @p keepInodes.
+ * @return int 0 on success.
+ */
+int ADUC_SourceUpdateCacheIndex_Evict(
+    const char* updateCacheBasePath,
+    unsigned long long bytesToFree,
+    const char* const* keepFilePaths,
+    size_t keepFilePathCount,
+    const ino_t* keepInodes,
+    size_t keepInodeCount);
+
+/**
+ * @brief Gets the byte budget set with ADUC_SourceUpdateCache_SetMaxSizeInBytes.
+ *
+ * @return unsigned long long The budget in bytes, or 0 if there is none.
+ */
+unsigned long long ADUC_SourceUpdateCacheIndex_GetMaxSizeInBytes(void);
+
+EXTERN_C_END
+
+#endif // SOURCE_UPDATE_CACHE_INDEX_H
@@ -8,17 +8,16 @@
  */
 
 #include "aduc/source_update_cache.h"
+#include "aduc/source_update_cache_index.h" // ADUC_SourceUpdateCacheIndex_*
 #include "aduc/source_update_cache_utils.h" // ADUC_SourceUpdateCacheUtils_CreateSourceUpdateCachePath
-#include <aduc/permission_utils.h> // PermissionUtils_VerifyFilemodeBitmask
-#include <aduc/system_utils.h> // SystemUtils_IsFile, ADUC_SystemUtils_MkDirRecursiveAduUser
+#include <aduc/logging.h>
 #include <aduc/types/adu_core.h> // ADUC_Result_Success_Cache_Miss
+#include <aduc/workflow_utils.h> // workflow_get_update_files_count, workflow_peek_update_file
 #include <azure_c_shared_utility/crt_abstractions.h> // for mallocAndStrcpy_s
 #include <azure_c_shared_utility/strings.h>
 #include <stdio.h> // rename
 #include <stdlib.h> // free
 
-#include <aducpal/sys_stat.h> // S_*
-
 /**
  * @brief Looks up a source update from the source update cache.
  *
@@ -46,9 +45,8 @@ ADUC_Result ADUC_SourceUpdateCache_Lookup(
         goto done;
     }
 
-    // file exists and is readable
-    if (!SystemUtils_IsFile(STRING_c_str(filePath), NULL)
-        || !PermissionUtils_VerifyFilemodeBitmask(STRING_c_str(filePath), S_IRUSR))
+    // Answered from the index, so that a miss does not touch the filesystem.
+    if (!ADUC_SourceUpdateCacheIndex_Lookup(updateCacheBasePath, STRING_c_str(filePath)))
     {
         result.ResultCode = ADUC_Result_Success_Cache_Miss;
         goto done;
@@ -65,13 +63,78 @@ done:
     return result;
 }
 
+/**
+ * @brief Gets the total size of the payloads of the update, from the SizeInBytes of their file entities.
+ *
+ * @param workflowHandle The workflow handle.
+ * @param[out] outSize The total size in bytes.
+ * @return ADUC_Result The result.
+ */
 static ADUC_Result getPayloadTotalSize(const ADUC_WorkflowHandle workflowHandle, off_t* outSize)
 {
     ADUC_Result result = { .ResultCode = ADUC_Result_Failure };
+    off_t totalSize = 0;
+
     *outSize = 0;
+
+    size_t countPayloads = workflow_get_update_files_count(workflowHandle);
+    for (size_t index = 0; index < countPayloads; ++index)
+    {
+        const ADUC_FileEntity* fileEntity = workflow_peek_update_file(workflowHandle, index);
+        if (fileEntity == NULL)
+        {
+            Log_Error("get update file %zu", index);
+            goto done;
+        }
+
+        totalSize += (off_t)fileEntity->SizeInBytes;
+    }
+
+    *outSize = totalSize;
+    result.ResultCode = ADUC_Result_Success;
+
+    ADUC_SourceUpdateCache_Statistics statistics;
+    ADUC_SourceUpdateCache_GetStatistics(&statistics);
+    Log_Info(
+        "source update cache: %zu file(s), %llu bytes, %zu hit(s), %zu miss(es), %zu eviction(s)",
+        statistics.EntryCount,
+        statistics.SizeInBytes,
+        statistics.HitCount,
+        statistics.MissCount,
+        statistics.EvictionCount);
+
+done:
+
     return result;
 }
 
+/**
+ * @brief Gets the number of bytes to evict from the cache when moving payloads of @p spaceRequired bytes into it.
+ * @details With a byte budget, that is what the cache takes beyond the budget, counting the incoming payloads unless
+ * they were already moved in. Without one, that is @p spaceRequired, so that the new payloads replace older ones.
+ *
+ * @param spaceRequired The total size of the incoming payloads.
+ * @param payloadsInCache Whether the payloads were already moved into the cache.
+ * @param updateCacheBasePath The update cache base path. Use NULL for default.
+ * @return off_t The number of bytes to evict.
+ */
+static off_t getBytesToEvict(off_t spaceRequired, bool payloadsInCache, const char* updateCacheBasePath)
+{
+    const unsigned long long maxSizeInBytes = ADUC_SourceUpdateCacheIndex_GetMaxSizeInBytes();
+    if (maxSizeInBytes == 0)
+    {
+        return spaceRequired;
+    }
+
+    unsigned long long sizeInBytes = ADUC_SourceUpdateCacheIndex_GetSizeInBytes(updateCacheBasePath);
+    if (!payloadsInCache)
+    {
+        sizeInBytes += (unsigned long long)spaceRequired;
+    }
+
+    return sizeInBytes > maxSizeInBytes ? (off_t)(sizeInBytes - maxSizeInBytes) : 0;
+}
+
 /**
  * @brief Moves all payloads from the download sandbox work folder to the cache.
  *
@@ -85,12 +148,19 @@ ADUC_Result ADUC_SourceUpdateCache_Move(const ADUC_WorkflowHandle workflowHandle
 
     off_t spaceRequired = 0;
     result = getPayloadTotalSize(workflowHandle, &spaceRequired);
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        goto done;
+    }
 
     int res = -1;
 
 #ifndef TWO_PHASE_COMMIT
     // When NOT two-phase commit, proactively make space by pre-purging cache dir of oldest files upto size of sandboxFilePath.
-    res = ADUC_SourceUpdateCacheUtils_PurgeOldestFromUpdateCache(workflowHandle, spaceRequired, updateCacheBasePath);
+    res = ADUC_SourceUpdateCacheUtils_PurgeOldestFromUpdateCache(
+        workflowHandle,
+        getBytesToEvict(spaceRequired, false /* payloadsInCache */, updateCacheBasePath),
+        updateCacheBasePath);
     if (res != 0)
     {
         Log_Error("pre-purge failed, res %d", res);
@@ -109,7 +179,10 @@ ADUC_Result ADUC_SourceUpdateCache_Move(const ADUC_WorkflowHandle workflowHandle
 
 #ifdef TWO_PHASE_COMMIT
     // In the case of two-phase commit, purge cache dir of oldest files upto size of sandboxFilePath AFTER move/copy.
-    res = ADUC_SourceUpdateCacheUtils_PurgeOldestFromUpdateCache(workflowHandle, spaceRequired, updateCacheBasePath);
+    res = ADUC_SourceUpdateCacheUtils_PurgeOldestFromUpdateCache(
+        workflowHandle,
+        getBytesToEvict(spaceRequired, true /* payloadsInCache */, updateCacheBasePath),
+        updateCacheBasePath);
     if (res != 0)
     {
         Log_Error("post-purge failed, res %d", res);
@@ -120,6 +193,16 @@ ADUC_Result ADUC_SourceUpdateCache_Move(const ADUC_WorkflowHandle workflowHandle
 
     result.ResultCode = ADUC_Result_Success;
 
+    ADUC_SourceUpdateCache_Statistics statistics;
+    ADUC_SourceUpdateCache_GetStatistics(&statistics);
+    Log_Info(
+        "source update cache: %zu file(s), %llu bytes, %zu hit(s), %zu miss(es), %zu eviction(s)",
+        statistics.EntryCount,
+        statistics.SizeInBytes,
+        statistics.HitCount,
+        statistics.MissCount,
+        statistics.EvictionCount);
+
 done:
 
     return result;
@@ -0,0 +1,680 @@
+/**
+ * @file source_update_cache_index.cpp
+ * @brief Implements the index of the source update cache.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#include "aduc/source_update_cache_index.h"
+#include "aduc/source_update_cache.h"
+#include <aduc/file_utils.hpp> // aduc::findFilesInDir
+#include <aduc/logging.h>
+#include <aduc/string_c_utils.h> // IsNullOrEmpty
+#include <algorithm> // std::sort, std::max
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h> // open, O_*
+#include <mutex>
+#include <stdexcept> // std::invalid_argument
+#include <stdio.h> // FILE, fgets, rename
+#include <string.h> // strncmp, strcspn
+#include <string>
+#include <sys/stat.h> // stat
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <aducpal/sys_stat.h> // S_I*
+#include <aducpal/unistd.h> // close, geteuid, unlink
+
+#ifndef ADUC_DELTA_DOWNLOAD_HANDLER_SOURCE_UPDATE_CACHE_MAX_SIZE_MB
+#    define ADUC_DELTA_DOWNLOAD_HANDLER_SOURCE_UPDATE_CACHE_MAX_SIZE_MB 0
+#endif
+
+/**
+ * @brief The first line of a manifest file. The version is bumped whenever the format of the entries changes.
+ */
+#define SOURCE_UPDATE_CACHE_INDEX_HEADER "aduc-source-update-cache 1"
+
+/**
+ * @brief The maximum length of a line of the manifest file, including the relative path.
+ */
+#define SOURCE_UPDATE_CACHE_INDEX_MAX_LINE_LEN 4352
+
+namespace
+{
+/**
+ * @brief A file in the cache.
+ */
+struct CacheEntry
+{
+    unsigned long long sizeInBytes; ///< The size of the file.
+    long long lastUsedTime; ///< When the file was last moved into the cache or looked up, in microseconds since epoch.
+    unsigned long long useCount; ///< The number of lookups that found the file.
+    unsigned long long inode; ///< The inode of the file.
+};
+
+using CacheEntries = std::unordered_map<std::string, CacheEntry>;
+
+std::mutex s_mutex;
+
+// The cache base directory the entries were loaded from.
+std::string s_basePath;
+bool s_loaded = false;
+
+// The entries, keyed by the path of the file relative to s_basePath.
+CacheEntries s_entries;
+unsigned long long s_sizeInBytes = 0;
+
+long long s_lastUsedTime = 0;
+
+size_t s_hitCount = 0;
+size_t s_missCount = 0;
+size_t s_evictionCount = 0;
+
+unsigned long long s_maxSizeInBytes = ADUC_DELTA_DOWNLOAD_HANDLER_SOURCE_UPDATE_CACHE_MAX_SIZE_MB * 1024ULL * 1024ULL;
+ADUC_SourceUpdateCache_EvictionPolicy s_evictionPolicy = ADUC_SourceUpdateCache_EvictionPolicy_LeastRecentlyUsed;
+
+std::string GetBasePath(const char* updateCacheBasePath)
+{
+    return IsNullOrEmpty(updateCacheBasePath) ? ADUC_DELTA_DOWNLOAD_HANDLER_SOURCE_UPDATE_CACHE_DIR
+                                              : updateCacheBasePath;
+}
+
+/**
+ * @brief Gets a use time that is later than all the previous ones, even within the same clock tick.
+ */
+long long NextUsedTime()
+{
+    const long long now = std::chrono::duration_cast<std::chrono::microseconds>(
+                              std::chrono::system_clock::now().time_since_epoch())
+                              .count();
+    s_lastUsedTime = std::max(now, s_lastUsedTime + 1);
+    return s_lastUsedTime;
+}
+
+/**
+ * @brief Returns whether @p relativePath has the form of a cache file path, '{provider}/{fileName}'. Anything else,
+ * such as a path with '..', is never indexed, so that eviction cannot delete files outside of the cache.
+ */
+bool IsValidRelativePath(const std::string& relativePath)
+{
+    const size_t separator = relativePath.find('/');
+    if (separator == std::string::npos || relativePath.find('/', separator + 1) != std::string::npos)
+    {
+        return false;
+    }
+
+    const std::string provider = relativePath.substr(0, separator);
+    const std::string fileName = relativePath.substr(separator + 1);
+
+    for (const std::string& segment : { provider, fileName })
+    {
+        if (segment.empty() || segment == "." || segment == "..")
+        {
+            return false;
+        }
+    }
+
+    return std::none_of(relativePath.begin(), relativePath.end(), [](char c) {
+        return static_cast<unsigned char>(c) < 0x20 || c == '\\';
+    });
+}
+
+/**
+ * @brief Gets the path of @p filePath relative to the base directory of the loaded entries.
+ *
+ * @return bool true if @p filePath is a valid cache file path under the base directory.
+ */
+bool GetRelativePath(const char* filePath, std::string* outRelativePath)
+{
+    if (filePath == nullptr || strncmp(filePath, s_basePath.c_str(), s_basePath.size()) != 0
+        || filePath[s_basePath.size()] != '/')
+    {
+        return false;
+    }
+
+    *outRelativePath = filePath + s_basePath.size() + 1;
+    return IsValidRelativePath(*outRelativePath);
+}
+
+/**
+ * @brief Returns whether the manifest file described by @p st can be trusted: a regular file, owned by the effective
+ * user of the process, and not writable by group or others. Its entries decide which files get deleted.
+ */
+bool IsTrustedManifestFile(const struct stat* st)
+{
+#if defined(WIN32)
+    (void)st;
+    return false;
+#else
+    return S_ISREG(st->st_mode) && st->st_uid == geteuid() && (st->st_mode & (S_IWGRP | S_IWOTH)) == 0;
+#endif
+}
+
+std::string GetManifestFilePath()
+{
+    return s_basePath + "/" ADUC_SOURCE_UPDATE_CACHE_INDEX_FILE_NAME;
+}
+
+void ClearEntries()
+{
+    s_entries.clear();
+    s_sizeInBytes = 0;
+}
+
+void SetEntry(const std::string& relativePath, const CacheEntry& entry)
+{
+    const CacheEntries::iterator existing = s_entries.find(relativePath);
+    if (existing != s_entries.end())
+    {
+        s_sizeInBytes -= existing->second.sizeInBytes;
+        existing->second = entry;
+    }
+    else
+    {
+        s_entries.emplace(relativePath, entry);
+    }
+
+    s_sizeInBytes += entry.sizeInBytes;
+    s_lastUsedTime = std::max(s_lastUsedTime, entry.lastUsedTime);
+}
+
+void RemoveEntry(CacheEntries::iterator entry)
+{
+    s_sizeInBytes -= entry->second.sizeInBytes;
+    s_entries.erase(entry);
+}
+
+/**
+ * @brief Saves the entries to the manifest file, replacing it atomically. Must be called with the mutex held.
+ * @details A failure to save is not an error: the manifest is rebuilt from the files in the cache on next load.
+ */
+void SaveEntries()
+{
+    FILE* file = nullptr;
+    bool saved = false;
+    const std::string manifestFilePath = GetManifestFilePath();
+    const std::string tempFilePath = manifestFilePath + ".tmp";
+
+    // Owner read and write only, as the entries decide which files get deleted.
+    int fd = open(tempFilePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+    {
+        Log_Warn("Cannot create '%s', errno: %d", tempFilePath.c_str(), errno);
+        goto done;
+    }
+
+    file = fdopen(fd, "w");
+    if (file == nullptr)
+    {
+        goto done;
+    }
+
+    fd = -1;
+
+    fprintf(file, "%s\n", SOURCE_UPDATE_CACHE_INDEX_HEADER);
+
+    for (const CacheEntries::value_type& item : s_entries)
+    {
+        fprintf(
+            file,
+            "%lld %llu %llu %llu %s\n",
+            item.second.lastUsedTime,
+            item.second.useCount,
+            item.second.sizeInBytes,
+            item.second.inode,
+            item.first.c_str());
+    }
+
+    if (fflush(file) != 0 || ferror(file))
+    {
+        Log_Warn("Cannot write '%s'", tempFilePath.c_str());
+        goto done;
+    }
+
+    if (fclose(file) != 0)
+    {
+        file = nullptr;
+        goto done;
+    }
+
+    file = nullptr;
+
+    if (rename(tempFilePath.c_str(), manifestFilePath.c_str()) != 0)
+    {
+        Log_Warn("Cannot rename '%s' to '%s', errno: %d", tempFilePath.c_str(), manifestFilePath.c_str(), errno);
+        goto done;
+    }
+
+    saved = true;
+
+done:
+    if (file != nullptr)
+    {
+        fclose(file);
+    }
+
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    if (!saved)
+    {
+        (void)remove(tempFilePath.c_str());
+    }
+}
+
+/**
+ * @brief Loads the entries from the manifest file. Must be called with the mutex held.
+ *
+ * @return bool true if the manifest file exists, is trusted, and is well-formed.
+ */
+bool LoadEntriesFromManifest()
+{
+    bool loaded = false;
+    struct stat st = {};
+    std::vector<char> line(SOURCE_UPDATE_CACHE_INDEX_MAX_LINE_LEN);
+    const std::string manifestFilePath = GetManifestFilePath();
+
+    FILE* file = fopen(manifestFilePath.c_str(), "r");
+    if (file == nullptr)
+    {
+        goto done;
+    }
+
+    if (fstat(fileno(file), &st) != 0 || !IsTrustedManifestFile(&st))
+    {
+        Log_Warn("Ignoring untrusted source update cache manifest '%s'.", manifestFilePath.c_str());
+        goto done;
+    }
+
+    if (fgets(line.data(), static_cast<int>(line.size()), file) == nullptr
+        || strncmp(line.data(), SOURCE_UPDATE_CACHE_INDEX_HEADER, strlen(SOURCE_UPDATE_CACHE_INDEX_HEADER)) != 0)
+    {
+        Log_Info("Ignoring source update cache manifest '%s' of another version.", manifestFilePath.c_str());
+        goto done;
+    }
+
+    while (fgets(line.data(), static_cast<int>(line.size()), file) != nullptr)
+    {
+        CacheEntry entry = {};
+        int pathOffset = -1;
+
+        // The relative path is last, as the file names of cache files not made by the agent may contain spaces.
+        if (sscanf(
+                line.data(),
+                "%lld %llu %llu %llu %n",
+                &entry.lastUsedTime,
+                &entry.useCount,
+                &entry.sizeInBytes,
+                &entry.inode,
+                &pathOffset)
+                != 4
+            || pathOffset < 0)
+        {
+            Log_Warn("Ignoring malformed source update cache manifest '%s'.", manifestFilePath.c_str());
+            ClearEntries();
+            goto done;
+        }
+
+        char* relativePath = line.data() + pathOffset;
+        relativePath[strcspn(relativePath, "\r\n")] = '\0';
+
+        if (!IsValidRelativePath(relativePath))
+        {
+            Log_Warn("Ignoring malformed source update cache manifest '%s'.", manifestFilePath.c_str());
+            ClearEntries();
+            goto done;
+        }
+
+        SetEntry(relativePath, entry);
+    }
+
+    loaded = true;
+
+done:
+    if (file != nullptr)
+    {
+        fclose(file);
+    }
+
+    return loaded;
+}
+
+/**
+ * @brief Rebuilds the entries from the files in the cache, as after an upgrade from an agent without an index.
+ * The files are ranked by their modification time. Must be called with the mutex held.
+ */
+void RebuildEntriesFromFiles()
+{
+    std::vector<std::string> filesInCache;
+
+    try
+    {
+        aduc::findFilesInDir(s_basePath, &filesInCache);
+    }
+    catch (const std::invalid_argument&)
+    {
+        // No cache dir yet.
+        return;
+    }
+
+    for (const std::string& filePath : filesInCache)
+    {
+        std::string relativePath;
+        struct stat st = {};
+
+        // Skips the files at the root of the cache, such as the manifest file.
+        if (!GetRelativePath(filePath.c_str(), &relativePath) || stat(filePath.c_str(), &st) != 0
+            || !S_ISREG(st.st_mode))
+        {
+            continue;
+        }
+
+        CacheEntry entry = {};
+        entry.sizeInBytes = static_cast<unsigned long long>(st.st_size);
+        entry.lastUsedTime = static_cast<long long>(st.st_mtime) * 1000000LL;
+        entry.inode = static_cast<unsigned long long>(st.st_ino);
+        SetEntry(relativePath, entry);
+    }
+
+    if (!s_entries.empty())
+    {
+        Log_Info("Rebuilt source update cache index of %zu file(s) in '%s'.", s_entries.size(), s_basePath.c_str());
+        SaveEntries();
+    }
+}
+
+/**
+ * @brief Loads the entries of @p updateCacheBasePath, unless they are already loaded. Must be called with the mutex
+ * held.
+ */
+void EnsureLoaded(const char* updateCacheBasePath)
+{
+    const std::string basePath = GetBasePath(updateCacheBasePath);
+    if (s_loaded && basePath == s_basePath)
+    {
+        return;
+    }
+
+    ClearEntries();
+    s_basePath = basePath;
+    s_loaded = true;
+
+    if (!LoadEntriesFromManifest())
+    {
+        RebuildEntriesFromFiles();
+    }
+}
+
+/**
+ * @brief Returns whether @p a is to be evicted before @p b under the eviction policy.
+ */
+bool IsEvictedBefore(const CacheEntries::value_type* a, const CacheEntries::value_type* b)
+{
+    if (s_evictionPolicy == ADUC_SourceUpdateCache_EvictionPolicy_LeastFrequentlyUsed
+        && a->second.useCount != b->second.useCount)
+    {
+        return a->second.useCount < b->second.useCount;
+    }
+
+    return a->second.lastUsedTime < b->second.lastUsedTime;
+}
+
+} // namespace
+
+EXTERN_C_BEGIN
+
+bool ADUC_SourceUpdateCacheIndex_Lookup(const char* updateCacheBasePath, const char* cacheFilePath)
+{
+    try
+    {
+        std::lock_guard<std::mutex> lock{ s_mutex };
+
+        EnsureLoaded(updateCacheBasePath);
+
+        std::string relativePath;
+        const CacheEntries::iterator entry =
+            GetRelativePath(cacheFilePath, &relativePath) ? s_entries.find(relativePath) : s_entries.end();
+        if (entry == s_entries.end())
+        {
+            ++s_missCount;
+            return false;
+        }
+
+        // The file exists, is readable, and was not truncated since it was moved into the cache.
+        struct stat st = {};
+        if (stat(cacheFilePath, &st) != 0 || !S_ISREG(st.st_mode) || (st.st_mode & S_IRUSR) == 0
+            || static_cast<unsigned long long>(st.st_size) != entry->second.sizeInBytes)
+        {
+            Log_Warn("Dropping stale source update cache entry '%s'.", relativePath.c_str());
+            RemoveEntry(entry);
+            SaveEntries();
+            ++s_missCount;
+            return false;
+        }
+
+        entry->second.lastUsedTime = NextUsedTime();
+        ++entry->second.useCount;
+        entry->second.inode = static_cast<unsigned long long>(st.st_ino);
+        SaveEntries();
+
+        ++s_hitCount;
+        return true;
+    }
+    catch (const std::exception& e)
+    {
+        Log_Error("Unhandled std exception: %s", e.what());
+    }
+    catch (...)
+    {
+        Log_Error("Unhandled exception");
+    }
+
+    return false;
+}
+
+bool ADUC_SourceUpdateCacheIndex_Add(const char* updateCacheBasePath, const char* cacheFilePath)
+{
+    try
+    {
+        std::lock_guard<std::mutex> lock{ s_mutex };
+
+        EnsureLoaded(updateCacheBasePath);
+
+        std::string relativePath;
+        struct stat st = {};
+        if (!GetRelativePath(cacheFilePath, &relativePath) || stat(cacheFilePath, &st) != 0)
+        {
+            Log_Error("Cannot index source update cache file '%s'", cacheFilePath);
+            return false;
+        }
+
+        CacheEntry entry = {};
+        entry.sizeInBytes = static_cast<unsigned long long>(st.st_size);
+        entry.lastUsedTime = NextUsedTime();
+        entry.inode = static_cast<unsigned long long>(st.st_ino);
+
+        // A source update moved into the cache again keeps its use count.
+        const CacheEntries::const_iterator existing = s_entries.find(relativePath);
+        if (existing != s_entries.end())
+        {
+            entry.useCount = existing->second.useCount;
+        }
+
+        SetEntry(relativePath, entry);
+        SaveEntries();
+
+        return true;
+    }
+    catch (const std::exception& e)
+    {
+        Log_Error("Unhandled std exception: %s", e.what());
+    }
+    catch (...)
+    {
+        Log_Error("Unhandled exception");
+    }
+
+    return false;
+}
+
+unsigned long long ADUC_SourceUpdateCacheIndex_GetSizeInBytes(const char* updateCacheBasePath)
+{
+    try
+    {
+        std::lock_guard<std::mutex> lock{ s_mutex };
+
+        EnsureLoaded(updateCacheBasePath);
+
+        return s_sizeInBytes;
+    }
+    catch (const std::exception& e)
+    {
+        Log_Error("Unhandled std exception: %s", e.what());
+    }
+    catch (...)
+    {
+        Log_Error("Unhandled exception");
+    }
+
+    return 0;
+}
+
+int ADUC_SourceUpdateCacheIndex_Evict(
+    const char* updateCacheBasePath,
+    unsigned long long bytesToFree,
+    const char* const* keepFilePaths,
+    size_t keepFilePathCount,
+    const ino_t* keepInodes,
+    size_t keepInodeCount)
+{
+    try
+    {
+        std::lock_guard<std::mutex> lock{ s_mutex };
+
+        EnsureLoaded(updateCacheBasePath);
+
+        std::unordered_set<std::string> keepRelativePaths;
+        for (size_t index = 0; index < keepFilePathCount; ++index)
+        {
+            std::string relativePath;
+            if (GetRelativePath(keepFilePaths[index], &relativePath))
+            {
+                keepRelativePaths.insert(relativePath);
+            }
+        }
+
+        const std::unordered_set<unsigned long long> keepInodeSet{ keepInodes, keepInodes + keepInodeCount };
+
+        std::vector<const CacheEntries::value_type*> candidates;
+        candidates.reserve(s_entries.size());
+        for (const CacheEntries::value_type& item : s_entries)
+        {
+            if (keepRelativePaths.count(item.first) == 0 && keepInodeSet.count(item.second.inode) == 0)
+            {
+                candidates.push_back(&item);
+            }
+        }
+
+        std::sort(candidates.begin(), candidates.end(), IsEvictedBefore);
+
+        std::vector<std::string> evictedRelativePaths;
+        unsigned long long freed = 0;
+
+        for (const CacheEntries::value_type* candidate : candidates)
+        {
+            if (freed >= bytesToFree)
+            {
+                break;
+            }
+
+            const std::string filePath = s_basePath + "/" + candidate->first;
+            if (unlink(filePath.c_str()) != 0 && errno != ENOENT)
+            {
+                // Keep going to attempt to free up space.
+                Log_Error("unlink '%s', errno: %d", filePath.c_str(), errno);
+                continue;
+            }
+
+            freed += candidate->second.sizeInBytes;
+            evictedRelativePaths.push_back(candidate->first);
+        }
+
+        if (!evictedRelativePaths.empty())
+        {
+            for (const std::string& relativePath : evictedRelativePaths)
+            {
+                RemoveEntry(s_entries.find(relativePath));
+            }
+
+            s_evictionCount += evictedRelativePaths.size();
+            SaveEntries();
+
+            Log_Info("Evicted %zu source update(s), %llu bytes.", evictedRelativePaths.size(), freed);
+        }
+
+        return 0;
+    }
+    catch (const std::exception& e)
+    {
+        Log_Error("Unhandled std exception: %s", e.what());
+    }
+    catch (...)
+    {
+        Log_Error("Unhandled exception");
+    }
+
+    return -1;
+}
+
+unsigned long long ADUC_SourceUpdateCacheIndex_GetMaxSizeInBytes(void)
+{
+    std::lock_guard<std::mutex> lock{ s_mutex };
+    return s_maxSizeInBytes;
+}
+
+void ADUC_SourceUpdateCache_SetMaxSizeInBytes(unsigned long long maxSizeInBytes)
+{
+    std::lock_guard<std::mutex> lock{ s_mutex };
+    s_maxSizeInBytes = maxSizeInBytes;
+}
+
+void ADUC_SourceUpdateCache_SetEvictionPolicy(ADUC_SourceUpdateCache_EvictionPolicy policy)
+{
+    std::lock_guard<std::mutex> lock{ s_mutex };
+    s_evictionPolicy = policy;
+}
+
+void ADUC_SourceUpdateCache_GetStatistics(ADUC_SourceUpdateCache_Statistics* outStatistics)
+{
+    if (outStatistics == nullptr)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock{ s_mutex };
+
+    outStatistics->HitCount = s_hitCount;
+    outStatistics->MissCount = s_missCount;
+    outStatistics->EvictionCount = s_evictionCount;
+    outStatistics->EntryCount = s_entries.size();
+    outStatistics->SizeInBytes = s_sizeInBytes;
+}
+
+void ADUC_SourceUpdateCache_Reset(void)
+{
+    std::lock_guard<std::mutex> lock{ s_mutex };
+
+    ClearEntries();
+    s_basePath.clear();
+    s_loaded = false;
+    s_hitCount = 0;
+    s_missCount = 0;
+    s_evictionCount = 0;
+}
+
+EXTERN_C_END
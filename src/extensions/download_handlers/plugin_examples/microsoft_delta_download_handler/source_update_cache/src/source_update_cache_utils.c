@@ -8,6 +8,7 @@
  */
 
 #include "aduc/source_update_cache_utils.h"
+#include "aduc/source_update_cache_index.h" // ADUC_SourceUpdateCacheIndex_Add
 #include <aduc/parser_utils.h> // ADUC_FileEntity_Uninit
 #include <aduc/path_utils.h> // PathUtils_SanitizePathSegment
 #include <aduc/string_c_utils.h> // IsNullOrEmpty
@@ -153,8 +154,6 @@ ADUC_Result ADUC_SourceUpdateCacheUtils_MoveToUpdateCache(
 {
     ADUC_Result result = { .ResultCode = ADUC_Result_Failure };
     int res = -1;
-    ADUC_FileEntity fileEntity;
-    memset(&fileEntity, 0, sizeof(fileEntity));
     STRING_HANDLE sandboxUpdatePayloadFile = NULL;
     ADUC_UpdateId* updateId = NULL;
     STRING_HANDLE updateCacheFilePath = NULL;
@@ -163,13 +162,14 @@ ADUC_Result ADUC_SourceUpdateCacheUtils_MoveToUpdateCache(
     size_t countPayloads = workflow_get_update_files_count(workflowHandle);
     for (size_t index = 0; index < countPayloads; ++index)
     {
-        if (!workflow_get_update_file(workflowHandle, index, &fileEntity))
+        const ADUC_FileEntity* fileEntity = workflow_peek_update_file(workflowHandle, index);
+        if (fileEntity == NULL)
         {
             Log_Error("get update file %d", index);
             goto done;
         }
 
-        workflow_get_entity_workfolder_filepath(workflowHandle, &fileEntity, &sandboxUpdatePayloadFile);
+        workflow_get_entity_workfolder_filepath(workflowHandle, fileEntity, &sandboxUpdatePayloadFile);
 
         result = workflow_get_expected_update_id(workflowHandle, &updateId);
         if (IsAducResultCodeFailure(result.ResultCode))
@@ -188,8 +188,8 @@ ADUC_Result ADUC_SourceUpdateCacheUtils_MoveToUpdateCache(
         }
 
         const char* provider = updateId->Provider;
-        const char* hash = (fileEntity.Hash[0]).value;
-        const char* alg = (fileEntity.Hash[0]).type;
+        const char* hash = (fileEntity->Hash[0]).value;
+        const char* alg = (fileEntity->Hash[0]).type;
 
         updateCacheFilePath =
             ADUC_SourceUpdateCacheUtils_CreateSourceUpdateCachePath(provider, hash, alg, updateCacheBasePath);
@@ -231,17 +231,27 @@ ADUC_Result ADUC_SourceUpdateCacheUtils_MoveToUpdateCache(
 
             // fallback to copy
             //
-            if (ADUC_SystemUtils_CopyFileToDir(
-                    STRING_c_str(sandboxUpdatePayloadFile), dirPathCache, false /* overwriteExistingFile */)
+            ADUC_SystemUtils_CopyFileStats copyStats;
+            if (ADUC_SystemUtils_CopyFile(
+                    STRING_c_str(sandboxUpdatePayloadFile),
+                    STRING_c_str(updateCacheFilePath),
+                    false /* overwriteExistingFile */,
+                    &copyStats)
                 != 0)
             {
                 Log_Error("Copy Failed");
                 result.ExtendedResultCode = ADUC_ERC_MOVE_COPYFALLBACK;
                 goto done;
             }
+
+            Log_Debug("copied %llu bytes, method %d", (unsigned long long)copyStats.bytesCopied, copyStats.method);
         }
 
-        ADUC_FileEntity_Uninit(&fileEntity);
+        // Not fatal: the payload is in the cache, but lookups will miss it.
+        if (!ADUC_SourceUpdateCacheIndex_Add(updateCacheBasePath, STRING_c_str(updateCacheFilePath)))
+        {
+            Log_Warn("Failed to index '%s'", STRING_c_str(updateCacheFilePath));
+        }
 
         ADUC_UpdateId_UninitAndFree(updateId);
         updateId = NULL;
@@ -256,7 +266,6 @@ ADUC_Result ADUC_SourceUpdateCacheUtils_MoveToUpdateCache(
     result.ResultCode = ADUC_Result_Success;
 
 done:
-    ADUC_FileEntity_Uninit(&fileEntity);
     ADUC_UpdateId_UninitAndFree(updateId);
     STRING_delete(sandboxUpdatePayloadFile);
     STRING_delete(updateCacheFilePath);
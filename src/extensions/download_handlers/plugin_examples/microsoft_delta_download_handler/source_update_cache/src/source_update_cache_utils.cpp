@@ -1,4 +1,3 @@
-
 /**
  * @file source_update_cache_utils.cpp
  * @brief utils for source_update_cache
@@ -8,71 +7,20 @@
  */
 
 #include "aduc/source_update_cache_utils.h"
+#include "aduc/source_update_cache_index.h" // ADUC_SourceUpdateCacheIndex_Evict
 #include <aduc/aduc_inode.h> // ADUC_INODE_SENTINEL_VALUE
-#include <aduc/file_utils.hpp> // aduc::findFilesInDir
 #include <aduc/logging.h>
-#include <aduc/workflow_utils.h>
-#include <algorithm> // std::
-#include <queue> // std::priority_queue
-#include <set>
+#include <aduc/types/update_content.h> // ADUC_FileEntity
+#include <aduc/workflow_utils.h> // workflow_*
 #include <string>
-#include <sys/stat.h> // stat
 #include <sys/types.h> // ino_t
-#include <time.h> // time_t
-
-#include <aducpal/unistd.h> // unlink
-
 #include <vector>
 
-struct LessThan_UpdateCachePurgeFile
-{
-};
-
-class UpdateCachePurgeFile
-{
-public:
-    UpdateCachePurgeFile(ino_t fileNodeId, time_t lastModifiedTime, off_t fileSize, const std::string& filePath) :
-        inode(fileNodeId), mtime(lastModifiedTime), size(fileSize), path(filePath)
-    {
-    }
-
-    bool operator<(const UpdateCachePurgeFile& other) const
-    {
-        return mtime < other.mtime;
-    }
-
-    ino_t GetInode() const
-    {
-        return inode;
-    }
-
-    time_t GetLastModifiedTime() const
-    {
-        return mtime;
-    }
-
-    off_t GetSizeInBytes() const
-    {
-        return size;
-    }
-
-    std::string GetFilePath() const
-    {
-        return path;
-    }
-
-private:
-    ino_t inode; ///< the inode from stat call.
-    time_t mtime; ///< last modified time from stat call.
-    off_t size; ///< The size of the file in bytes.
-    std::string path; ///< the abs path to the file.
-};
-
 EXTERN_C_BEGIN
 
 /**
- * @brief Deletes oldest files from the update cache until given totalSize is freed, or no more files exist.
- * Excludes payload files of the current update.
+ * @brief Deletes files from the update cache, least recently used first by default, until given totalSize is freed,
+ * or no more files exist. Excludes payload files of the current update.
  * @param workflowHandle The workflow handle.
  * @param totalSize The maximum total size in bytes to be freed up in the update cache.
  * @param updateCacheBasePath The path to the base of update cache. NULL for default.
@@ -82,108 +30,62 @@ int ADUC_SourceUpdateCacheUtils_PurgeOldestFromUpdateCache(
     const ADUC_WorkflowHandle workflowHandle, off_t totalSize, const char* updateCacheBasePath)
 {
     int result = -1;
+    ADUC_UpdateId* updateId = nullptr;
+
+    if (totalSize <= 0)
+    {
+        return 0;
+    }
 
-    // Algorithm
-    //
-    // 1. Create priority queue of type (UpdateCachePurgeFile*), where UpdateCachePurgeFile items sort by last modified time
-    // 2. Find all files under the dir and add a corresponding UpdateCachePurgeFile entry to the priority queue
-    // 3. from workflowHandle, get the inode for each payload file and remove from the priority queue (if exists)
-    //         (the inode is saved at the time of moving the payload from sandbox to cache)
-    // 4. while pq has items and totalSize > 0
-    //        pop pq and delete the non-payload file at that item's path
-    //
     try
     {
-        // get the files currently in the update cache
-        std::vector<std::string> filesInCache;
-        aduc::findFilesInDir(
-            updateCacheBasePath == nullptr ? ADUC_DELTA_DOWNLOAD_HANDLER_SOURCE_UPDATE_CACHE_DIR : updateCacheBasePath,
-            &filesInCache);
+        // The current update's payloads are kept, whether they are found by their cache path, or by the inode saved
+        // at the time of moving the payload from sandbox to cache.
+        std::vector<std::string> updatePayloadPaths;
+        std::vector<ino_t> updatePayloadInodes;
 
-        std::priority_queue<UpdateCachePurgeFile> oldestCacheFiles;
+        ADUC_Result updateIdResult = workflow_get_expected_update_id(workflowHandle, &updateId);
 
-        // populate set of inodes of any payloads that have been moved to cache from sandbox
-        std::set<ino_t> updatePayloadInodes;
         size_t countPayloads = workflow_get_update_files_count(workflowHandle);
         for (size_t index = 0; index < countPayloads; ++index)
         {
             ino_t payload_inode = workflow_get_update_file_inode(workflowHandle, index);
             if (payload_inode != ADUC_INODE_SENTINEL_VALUE)
             {
-                updatePayloadInodes.insert(payload_inode);
+                updatePayloadInodes.push_back(payload_inode);
             }
-        }
-
-        // filter out the current update's payloads that were moved to cache to avoid removal
-        if (updatePayloadInodes.size() > 0)
-        {
-            Log_Debug("Removing %d payload paths from the cache purge list.", updatePayloadInodes.size());
-
-            auto newEnd = std::remove_if(
-                filesInCache.begin(), filesInCache.end(), [&updatePayloadInodes](const std::string& filePath) {
-                    struct stat st
-                    {
-                    };
-                    if (stat(filePath.c_str(), &st) != 0)
-                    {
-                        Log_Warn("filter - stat '%s', errno: %d", filePath.c_str(), errno);
-                        st.st_ino = ADUC_INODE_SENTINEL_VALUE;
-                        return false; // err on the side of not removing it
-                    }
-
-                    const ino_t& updateCacheInode = st.st_ino;
-
-                    // Remove from list of files to be purged when the file's inode is in the set of update payload inodes
-                    std::set<ino_t>::iterator iter = updatePayloadInodes.find(updateCacheInode);
-                    if (iter == updatePayloadInodes.end())
-                    {
-                        return false;
-                    }
-
-                    return true;
-                });
-
-            filesInCache.erase(newEnd);
-        }
 
-        // insert into purge list
-        std::for_each(filesInCache.begin(), filesInCache.end(), [&oldestCacheFiles](const std::string& filePath) {
-            struct stat st
+            const ADUC_FileEntity* fileEntity = workflow_peek_update_file(workflowHandle, index);
+            if (IsAducResultCodeFailure(updateIdResult.ResultCode) || fileEntity == nullptr
+                || fileEntity->HashCount == 0)
             {
-            };
-            if (stat(filePath.c_str(), &st) != 0)
-            {
-                Log_Warn("pq push - stat '%s', errno: %d", filePath.c_str(), errno);
+                continue;
             }
-            else
+
+            STRING_HANDLE payloadPath = ADUC_SourceUpdateCacheUtils_CreateSourceUpdateCachePath(
+                updateId->Provider, fileEntity->Hash[0].value, fileEntity->Hash[0].type, updateCacheBasePath);
+            if (payloadPath != nullptr)
             {
-                oldestCacheFiles.emplace(st.st_ino, st.st_mtime, st.st_size, filePath);
+                updatePayloadPaths.emplace_back(STRING_c_str(payloadPath));
+                STRING_delete(payloadPath);
             }
-        });
+        }
 
-        // delete files until made enough room as per totalSize needed for new update payloads
-        while (!oldestCacheFiles.empty() && totalSize > 0)
+        std::vector<const char*> keepFilePaths;
+        for (const std::string& payloadPath : updatePayloadPaths)
         {
-            UpdateCachePurgeFile cachePurgeFile = oldestCacheFiles.top();
-            oldestCacheFiles.pop();
-            off_t fileSize = cachePurgeFile.GetSizeInBytes();
-
-            std::string filePathForDelete{ std::move(cachePurgeFile.GetFilePath()) };
-            int res = unlink(filePathForDelete.c_str());
-            if (res != 0)
-            {
-                Log_Error(
-                    "unlink '%s', inode %d - errno: %d", filePathForDelete.c_str(), cachePurgeFile.GetInode(), errno);
-                result = -1; // overall it is a failure, but keep going to attempt to free up space.
-                continue;
-            }
-            else
-            {
-                totalSize -= fileSize; // off_t is signed
-            }
+            keepFilePaths.push_back(payloadPath.c_str());
         }
 
-        result = 0;
+        Log_Debug("Keeping %zu payload(s) of the current update in the cache.", countPayloads);
+
+        result = ADUC_SourceUpdateCacheIndex_Evict(
+            updateCacheBasePath,
+            static_cast<unsigned long long>(totalSize),
+            keepFilePaths.data(),
+            keepFilePaths.size(),
+            updatePayloadInodes.data(),
+            updatePayloadInodes.size());
     }
     catch (const std::exception& e)
     {
@@ -195,6 +97,8 @@ int ADUC_SourceUpdateCacheUtils_PurgeOldestFromUpdateCache(
         Log_Error("Unhandled exception");
     }
 
+    workflow_free_update_id(updateId);
+
     return result;
 }
 
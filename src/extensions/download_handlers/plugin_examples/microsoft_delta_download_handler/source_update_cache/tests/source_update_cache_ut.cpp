@@ -0,0 +1,283 @@
+/**
+ * @file source_update_cache_ut.cpp
+ * @brief Unit Tests for the source update cache index.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#include "aduc/source_update_cache.h"
+#include "aduc/source_update_cache_index.h"
+#include "aduc/source_update_cache_utils.h"
+
+#include <catch2/catch_all.hpp>
+#include <aduc/system_utils.h> // ADUC_SystemUtils_*, SystemUtils_IsDir
+#include <azure_c_shared_utility/strings.h> // STRING_*
+#include <cstdio> // std::remove
+#include <cstdlib> // mkdtemp
+#include <fstream> // std::ofstream
+#include <string>
+#include <sys/stat.h> // chmod
+
+#define PROVIDER_NAME "TestProvider"
+
+namespace
+{
+/**
+ * @brief A cache base dir in a temporary folder, with the index dropped from memory before and after each test.
+ */
+class SourceUpdateCacheFixture
+{
+public:
+    SourceUpdateCacheFixture()
+    {
+        REQUIRE(mkdtemp(_dir) != nullptr);
+        ADUC_SourceUpdateCache_Reset();
+    }
+
+    SourceUpdateCacheFixture(const SourceUpdateCacheFixture&) = delete;
+    SourceUpdateCacheFixture& operator=(const SourceUpdateCacheFixture&) = delete;
+    SourceUpdateCacheFixture(SourceUpdateCacheFixture&&) = delete;
+    SourceUpdateCacheFixture& operator=(SourceUpdateCacheFixture&&) = delete;
+
+    ~SourceUpdateCacheFixture()
+    {
+        ADUC_SourceUpdateCache_SetEvictionPolicy(ADUC_SourceUpdateCache_EvictionPolicy_LeastRecentlyUsed);
+        ADUC_SourceUpdateCache_Reset();
+        ADUC_SystemUtils_RmDirRecursive(_dir);
+    }
+
+    const char* GetBasePath() const
+    {
+        return _dir;
+    }
+
+    std::string GetCachePath(const char* hash) const
+    {
+        STRING_HANDLE path =
+            ADUC_SourceUpdateCacheUtils_CreateSourceUpdateCachePath(PROVIDER_NAME, hash, "sha256", _dir);
+        REQUIRE(path != nullptr);
+        std::string result{ STRING_c_str(path) };
+        STRING_delete(path);
+        return result;
+    }
+
+    std::string GetManifestPath() const
+    {
+        return std::string{ _dir } + "/" ADUC_SOURCE_UPDATE_CACHE_INDEX_FILE_NAME;
+    }
+
+    /**
+     * @brief Writes a cache file of @p sizeInBytes bytes for @p hash, without adding it to the index.
+     */
+    std::string WriteCacheFile(const char* hash, size_t sizeInBytes) const
+    {
+        const std::string providerDir = std::string{ _dir } + "/" PROVIDER_NAME;
+        REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault(providerDir.c_str()) == 0);
+
+        const std::string path = GetCachePath(hash);
+        std::ofstream file{ path, std::ios::trunc | std::ios::binary };
+        file << std::string(sizeInBytes, 'x');
+        REQUIRE(file.good());
+        return path;
+    }
+
+    /**
+     * @brief Writes a cache file for @p hash, and adds it to the index, as moving a payload into the cache does.
+     */
+    std::string AddCacheFile(const char* hash, size_t sizeInBytes) const
+    {
+        const std::string path = WriteCacheFile(hash, sizeInBytes);
+        REQUIRE(ADUC_SourceUpdateCacheIndex_Add(_dir, path.c_str()));
+        return path;
+    }
+
+    bool Lookup(const char* hash) const
+    {
+        STRING_HANDLE path = nullptr;
+        ADUC_Result result = ADUC_SourceUpdateCache_Lookup(PROVIDER_NAME, hash, "sha256", _dir, &path);
+        REQUIRE(IsAducResultCodeSuccess(result.ResultCode));
+
+        const bool hit = result.ResultCode == ADUC_Result_Success;
+        CHECK(hit == (path != nullptr));
+        if (hit)
+        {
+            CHECK(std::string{ STRING_c_str(path) } == GetCachePath(hash));
+        }
+
+        STRING_delete(path);
+        return hit;
+    }
+
+private:
+    char _dir[sizeof("/tmp/aduc_source_update_cache_XXXXXX")] = "/tmp/aduc_source_update_cache_XXXXXX";
+};
+
+ADUC_SourceUpdateCache_Statistics GetStatistics()
+{
+    ADUC_SourceUpdateCache_Statistics statistics = {};
+    ADUC_SourceUpdateCache_GetStatistics(&statistics);
+    return statistics;
+}
+
+bool IsFile(const std::string& path)
+{
+    return SystemUtils_IsFile(path.c_str(), nullptr);
+}
+
+} // namespace
+
+TEST_CASE_METHOD(SourceUpdateCacheFixture, "Lookups are answered from the index")
+{
+    AddCacheFile("hashA==", 10);
+
+    CHECK(Lookup("hashA=="));
+    CHECK_FALSE(Lookup("hashB=="));
+
+    ADUC_SourceUpdateCache_Statistics statistics = GetStatistics();
+    CHECK(statistics.HitCount == 1);
+    CHECK(statistics.MissCount == 1);
+    CHECK(statistics.EntryCount == 1);
+    CHECK(statistics.SizeInBytes == 10);
+
+    SECTION("The index survives a restart")
+    {
+        ADUC_SourceUpdateCache_Reset();
+
+        CHECK(Lookup("hashA=="));
+        CHECK(GetStatistics().HitCount == 1);
+        CHECK(GetStatistics().MissCount == 0);
+    }
+
+    SECTION("A file gone from the cache is dropped from the index")
+    {
+        REQUIRE(std::remove(GetCachePath("hashA==").c_str()) == 0);
+
+        CHECK_FALSE(Lookup("hashA=="));
+        CHECK(GetStatistics().EntryCount == 0);
+        CHECK(GetStatistics().SizeInBytes == 0);
+    }
+
+    SECTION("A truncated file is dropped from the index")
+    {
+        WriteCacheFile("hashA==", 5);
+
+        CHECK_FALSE(Lookup("hashA=="));
+        CHECK(GetStatistics().EntryCount == 0);
+    }
+}
+
+TEST_CASE_METHOD(SourceUpdateCacheFixture, "A miss does not create the cache")
+{
+    CHECK_FALSE(Lookup("hashA=="));
+    CHECK_FALSE(IsFile(GetManifestPath()));
+    CHECK_FALSE(SystemUtils_IsDir((std::string{ GetBasePath() } + "/" PROVIDER_NAME).c_str(), nullptr));
+}
+
+TEST_CASE_METHOD(SourceUpdateCacheFixture, "The index is rebuilt from the files in the cache")
+{
+    WriteCacheFile("hashA==", 10);
+    WriteCacheFile("hashB==", 20);
+
+    SECTION("Without a manifest")
+    {
+        CHECK(Lookup("hashA=="));
+    }
+
+    SECTION("With an untrusted manifest")
+    {
+        {
+            std::ofstream manifest{ GetManifestPath(), std::ios::trunc };
+            manifest << "aduc-source-update-cache 1\n"
+                     << "0 0 1000 0 " PROVIDER_NAME "/other\n";
+        }
+        REQUIRE(chmod(GetManifestPath().c_str(), 0666) == 0);
+
+        CHECK(Lookup("hashA=="));
+    }
+
+    SECTION("With a manifest entry outside of the cache")
+    {
+        {
+            std::ofstream manifest{ GetManifestPath(), std::ios::trunc };
+            manifest << "aduc-source-update-cache 1\n"
+                     << "0 0 1000 0 ../other\n";
+        }
+        REQUIRE(chmod(GetManifestPath().c_str(), 0600) == 0);
+
+        CHECK(Lookup("hashA=="));
+    }
+
+    CHECK(GetStatistics().EntryCount == 2);
+    CHECK(GetStatistics().SizeInBytes == 30);
+}
+
+TEST_CASE_METHOD(SourceUpdateCacheFixture, "A trusted manifest is loaded without listing the cache")
+{
+    {
+        std::ofstream manifest{ GetManifestPath(), std::ios::trunc };
+        manifest << "aduc-source-update-cache 1\n"
+                 << "0 0 1000 0 " PROVIDER_NAME "/other\n";
+    }
+    REQUIRE(chmod(GetManifestPath().c_str(), 0600) == 0);
+
+    CHECK(ADUC_SourceUpdateCacheIndex_GetSizeInBytes(GetBasePath()) == 1000);
+    CHECK(GetStatistics().EntryCount == 1);
+}
+
+TEST_CASE_METHOD(SourceUpdateCacheFixture, "Eviction")
+{
+    const std::string pathA = AddCacheFile("hashA==", 10);
+    const std::string pathB = AddCacheFile("hashB==", 10);
+    const std::string pathC = AddCacheFile("hashC==", 10);
+
+    SECTION("Least recently used first")
+    {
+        CHECK(Lookup("hashA=="));
+
+        CHECK(ADUC_SourceUpdateCacheIndex_Evict(GetBasePath(), 15, nullptr, 0, nullptr, 0) == 0);
+
+        CHECK(IsFile(pathA));
+        CHECK_FALSE(IsFile(pathB));
+        CHECK_FALSE(IsFile(pathC));
+        CHECK(GetStatistics().EvictionCount == 2);
+        CHECK(GetStatistics().SizeInBytes == 10);
+    }
+
+    SECTION("Least frequently used first")
+    {
+        ADUC_SourceUpdateCache_SetEvictionPolicy(ADUC_SourceUpdateCache_EvictionPolicy_LeastFrequentlyUsed);
+
+        CHECK(Lookup("hashC=="));
+        CHECK(Lookup("hashC=="));
+        CHECK(Lookup("hashA=="));
+
+        CHECK(ADUC_SourceUpdateCacheIndex_Evict(GetBasePath(), 10, nullptr, 0, nullptr, 0) == 0);
+
+        CHECK(IsFile(pathA));
+        CHECK_FALSE(IsFile(pathB));
+        CHECK(IsFile(pathC));
+    }
+
+    SECTION("The payloads of the current update are kept")
+    {
+        const char* keepFilePaths[] = { pathA.c_str() };
+
+        CHECK(ADUC_SourceUpdateCacheIndex_Evict(GetBasePath(), 100, keepFilePaths, 1, nullptr, 0) == 0);
+
+        CHECK(IsFile(pathA));
+        CHECK_FALSE(IsFile(pathB));
+        CHECK_FALSE(IsFile(pathC));
+        CHECK(GetStatistics().EntryCount == 1);
+    }
+
+    SECTION("Evictions are saved to the manifest")
+    {
+        CHECK(ADUC_SourceUpdateCacheIndex_Evict(GetBasePath(), 10, nullptr, 0, nullptr, 0) == 0);
+        ADUC_SourceUpdateCache_Reset();
+
+        CHECK(ADUC_SourceUpdateCacheIndex_GetSizeInBytes(GetBasePath()) == 20);
+        CHECK_FALSE(Lookup("hashA=="));
+        CHECK(Lookup("hashB=="));
+    }
+}
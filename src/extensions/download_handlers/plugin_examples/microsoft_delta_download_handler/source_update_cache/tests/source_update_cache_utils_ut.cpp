@@ -6,6 +6,7 @@
  * Licensed under the MIT License.
  */
 
+#include "aduc/source_update_cache.h" // ADUC_SourceUpdateCache_Reset
 #include "aduc/source_update_cache_utils.h"
 
 #include <catch2/catch_all.hpp>
@@ -147,6 +148,7 @@ TEST_CASE("ADUC_SourceUpdateCacheUtils_MoveToUpdateCache")
 
     // Remove and recreate test dirs.
     REQUIRE(testBaseDir.RemoveDir());
+    ADUC_SourceUpdateCache_Reset();
     // explicitly do not create cache dir as it should get created.
     REQUIRE(testSandbox.CreateDir());
 
@@ -207,8 +209,10 @@ TEST_CASE("ADUC_SourceUpdateCacheUtils_PurgeOldestFromUpdateCache")
     const std::string NonPayloadFileContents = "old source update data\n";
 
     auto setupCacheFilesFn = [&](bool createUpdatePayloadFile, bool createNonUpdatePayloadFile) {
-        testCache.RemoveDir();
+        // Also removes the index manifest in the cache base dir, and drops the index in memory.
+        testBaseDir.RemoveDir();
         testCache.CreateDir();
+        ADUC_SourceUpdateCache_Reset();
 
         if (createUpdatePayloadFile)
         {
@@ -271,7 +275,7 @@ TEST_CASE("ADUC_SourceUpdateCacheUtils_PurgeOldestFromUpdateCache")
         // Act
         //
         int res = ADUC_SourceUpdateCacheUtils_PurgeOldestFromUpdateCache(
-            handle, 1 /* totalSize */, testCache.GetDir().c_str() /* updateCacheBasePath */);
+            handle, 1 /* totalSize */, TEST_CACHE_BASE_PATH /* updateCacheBasePath */);
         REQUIRE(res == 0);
 
         //
@@ -309,7 +313,7 @@ TEST_CASE("ADUC_SourceUpdateCacheUtils_PurgeOldestFromUpdateCache")
         // Act
         //
         int res = ADUC_SourceUpdateCacheUtils_PurgeOldestFromUpdateCache(
-            handle, 1 /* totalSize */, testCache.GetDir().c_str() /* updateCacheBasePath */);
+            handle, 1 /* totalSize */, TEST_CACHE_BASE_PATH /* updateCacheBasePath */);
         REQUIRE(res == 0);
 
         //
@@ -373,7 +377,7 @@ TEST_CASE("ADUC_SourceUpdateCacheUtils_PurgeOldestFromUpdateCache")
         // Act
         //
         int res = ADUC_SourceUpdateCacheUtils_PurgeOldestFromUpdateCache(
-            handle, nonPayloadFileSize + 1 /* totalSize */, testCache.GetDir().c_str() /* updateCacheBasePath */);
+            handle, nonPayloadFileSize + 1 /* totalSize */, TEST_CACHE_BASE_PATH /* updateCacheBasePath */);
         REQUIRE(res == 0);
 
         //
@@ -14,6 +14,7 @@
 #include <aduc/types/download.h> /* ADUC_DownloadProgressCallback */
 #include <aduc/types/update_content.h> /* ADUC_FileEntity */
 #include <aduc/types/workflow.h> /* ADUC_WorkflowHandle */
+#include <stdbool.h> /* bool */
 
 EXTERN_C_BEGIN
 
@@ -40,6 +41,15 @@ ADUC_Result ExtensionManager_Download(
     ExtensionManager_Download_Options* options,
     ADUC_DownloadProgressCallback downloadProgressCallback);
 
+/**
+ * @brief Cancels an in-progress download started with ExtensionManager_Download_Options.downloadId set to
+ * @p downloadId. Only content downloaders that export SetDownloadCancellationCallback stop early.
+ *
+ * @param downloadId The download id.
+ * @return bool true if a download for @p downloadId was in progress.
+ */
+bool ExtensionManager_CancelDownload(const char* downloadId);
+
 /**
  * @brief Uninitializes the extension manager.
  */
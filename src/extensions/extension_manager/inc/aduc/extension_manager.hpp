@@ -18,15 +18,19 @@
 #include <aduc/types/download.h> // ADUC_DownloadProgressCallback
 #include <aduc/types/update_content.h> // ADUC_FileEntity
 
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 
 // Forward declaration.
 class ContentHandler;
 
 using ADUC_WorkflowHandle = void*;
 using ADUC_DownloadProcResolver = DownloadProc (*)(void* lib);
+using ADUC_DownloadWithDigestProcResolver = DownloadWithDigestProc (*)(void* lib);
 
 class ExtensionManager
 {
@@ -74,13 +78,26 @@ public:
     static DownloadProc DefaultDownloadProcResolver(void* lib);
 
     /**
-     * @brief
+     * @brief The default resolver for the optional download with digest proc.
+     *
+     * @param lib The dynamic library.
+     * @return DownloadWithDigestProc The resolved proc, or nullptr if the content downloader does not export it.
+     */
+    static DownloadWithDigestProc DefaultDownloadWithDigestProcResolver(void* lib);
+
+    /**
+     * @brief Downloads the file entity into the workflow work folder and validates its hash.
+     * @details When the content downloader exports DownloadWithDigest and returns a verified digest token for the
+     * file it wrote, the token is used to validate the file instead of re-reading it.
+     * Concurrent downloads to the same work folder file, e.g. of steps that share a payload, are serialized: later
+     * callers wait for the first one, and reuse its result when they expect the same content.
      *
      * @param entity An #ADUC_FileEntity object with information of the file to be downloaded.
      * @param workflowHandle The workflow handle opaque object for per-workflow workflow data.
      * @param downloadOptions The download options.
      * @param downloadProgressCallback A download progress reporting callback.
      * @param downloadProcResolver The resolver that resolves the library's symbol to a @p DownloadProc. Defaults to DefaultDownloadProcResolver.
+     * @param downloadWithDigestProcResolver The resolver that resolves the library's optional symbol to a @p DownloadWithDigestProc. Defaults to DefaultDownloadWithDigestProcResolver.
      * @return ADUC_Result
      */
     static ADUC_Result Download(
@@ -88,7 +105,28 @@ public:
         ADUC_WorkflowHandle workflowHandle,
         ExtensionManager_Download_Options* downloadOptions,
         ADUC_DownloadProgressCallback downloadProgressCallback,
-        ADUC_DownloadProcResolver downloadProcResolver = DefaultDownloadProcResolver);
+        ADUC_DownloadProcResolver downloadProcResolver = DefaultDownloadProcResolver,
+        ADUC_DownloadWithDigestProcResolver downloadWithDigestProcResolver = DefaultDownloadWithDigestProcResolver);
+
+    /**
+     * @brief Checks whether the workflow of an in-progress download has been cancelled.
+     * @details This is the ADUC_DownloadCancellationCallback handed to content downloaders that export
+     * SetDownloadCancellationCallback. It may be called from any thread.
+     *
+     * @param workflowId The workflow id that was passed to the content downloader.
+     * @return true if a download for @p workflowId is in progress and its workflow has been cancelled.
+     */
+    static bool IsDownloadCancelled(const char* workflowId);
+
+    /**
+     * @brief Cancels the in-progress download of @p downloadId, leaving the other downloads of its workflow alone.
+     * @details @p downloadId is the ExtensionManager_Download_Options.downloadId of the download. The cancellation
+     * is forgotten once the download returns.
+     *
+     * @param downloadId The download id.
+     * @return true if a download for @p downloadId was in progress.
+     */
+    static bool CancelDownload(const char* downloadId);
 
 private:
     static void UnloadAllUpdateContentHandlers();
@@ -96,6 +134,18 @@ private:
 
     static void _FreeComponentsDataString(char* componentsJson);
 
+    static ADUC_Result DownloadToTarget(
+        const ADUC_FileEntity* entity,
+        ADUC_WorkflowHandle workflowHandle,
+        const char* targetUpdateFilePath,
+        ExtensionManager_Download_Options* downloadOptions,
+        ADUC_DownloadProgressCallback downloadProgressCallback,
+        ADUC_DownloadProcResolver downloadProcResolver,
+        ADUC_DownloadWithDigestProcResolver downloadWithDigestProcResolver);
+
+    static void RegisterActiveDownload(const char* workflowId, ADUC_WorkflowHandle workflowHandle);
+    static void UnregisterActiveDownload(const char* workflowId, ADUC_WorkflowHandle workflowHandle);
+
     static ADUC_Result LoadExtensionLibrary(
         const char* extensionName,
         const char* extensionPath,
@@ -110,8 +160,31 @@ private:
     static std::unordered_map<std::string, ContentHandler*> _contentHandlers;
     static void* _contentDownloader;
     static ADUC_ExtensionContractInfo _contentDownloaderContractVersion;
+    static std::mutex _contentDownloaderMutex;
     static void* _componentEnumerator;
     static ADUC_ExtensionContractInfo _componentEnumeratorContractVersion;
+
+    // The workflows that currently have a content downloader download in progress, keyed by workflow id.
+    static std::mutex _activeDownloadsMutex;
+    static std::unordered_multimap<std::string, ADUC_WorkflowHandle> _activeDownloads;
+
+    // The active downloads cancelled with CancelDownload, keyed by download id.
+    static std::unordered_set<std::string> _cancelledDownloads;
+
+    // A download to a work folder file, which the other downloads to that file wait for.
+    struct TargetDownload
+    {
+        std::string expectedHash; // The hash type and value of the content being downloaded.
+        bool isDone = false;
+        ADUC_Result result{};
+        std::condition_variable completed;
+    };
+
+    // The downloads in progress, keyed by target file path. Guarded by _activeDownloadsMutex.
+    static std::unordered_map<std::string, std::shared_ptr<TargetDownload>> _targetDownloads;
+
+    // Serializes the extended result codes that concurrent downloads of a workflow add to it.
+    static std::mutex _workflowErcMutex;
 };
 
 #endif // ADUC_EXTENSION_MANAGER_HPP
@@ -10,6 +10,8 @@ typedef struct tagADUC_ExtensionManager_Download_Options
 {
     unsigned int
         timeoutInMinutes; /**< The maximum number of minutes the content downloader should wait for the download to complete(whilst the network interface stays up). */
+    const char*
+        downloadId; /**< The id passed to the content downloader in place of the workflow id, so that this download alone can be cancelled with ExtensionManager_CancelDownload. NULL for the workflow id. */
 } ExtensionManager_Download_Options;
 
 EXTERN_C_BEGIN
@@ -13,6 +13,7 @@
 #include <aduc/extension_manager_download_options.h>
 #include <aduc/result.h>
 
+#include <aduc/types/download.h> // ADUC_VerifiedDigest
 #include <aduc/types/update_content.h>
 using ADUC_WorkflowHandle = void*;
 class DownloadHandlerPlugin;
@@ -20,10 +21,17 @@ class DownloadHandlerPlugin;
 EXTERN_C_BEGIN
 
 ADUC_Result ProcessDownloadHandlerExtensibility(
-    ADUC_WorkflowHandle workflowHandle, const ADUC_FileEntity* entity, const char* targetUpdateFilePath) noexcept;
+    ADUC_WorkflowHandle workflowHandle,
+    const ADUC_FileEntity* entity,
+    const char* targetUpdateFilePath,
+    ADUC_VerifiedDigest* verifiedDigest) noexcept;
 
 unsigned int GetDownloadTimeoutInMinutes(const ExtensionManager_Download_Options* downloadOptions) noexcept;
 
+bool RestoreFromDownloadCache(const ADUC_FileEntity* entity, const char* targetUpdateFilePath) noexcept;
+
+void AddToDownloadCache(const ADUC_FileEntity* entity, const char* updateFilePath) noexcept;
+
 EXTERN_C_END
 
 #endif // ADUC_EXTENSION_MANAGER_HELPER_HPP
@@ -30,6 +30,7 @@
 #include <aduc/string_handle_wrapper.hpp>
 #include <aduc/string_utils.hpp>
 #include <aduc/types/workflow.h> // ADUC_WorkflowHandle
+#include <aduc/verified_extension_cache.h>
 #include <aduc/workflow_utils.h>
 
 #include <cstring>
@@ -50,8 +51,14 @@ std::unordered_map<std::string, void*> ExtensionManager::_libs;
 std::unordered_map<std::string, ContentHandler*> ExtensionManager::_contentHandlers;
 void* ExtensionManager::_contentDownloader;
 ADUC_ExtensionContractInfo ExtensionManager::_contentDownloaderContractVersion;
+std::mutex ExtensionManager::_contentDownloaderMutex;
 void* ExtensionManager::_componentEnumerator;
 ADUC_ExtensionContractInfo ExtensionManager::_componentEnumeratorContractVersion;
+std::mutex ExtensionManager::_activeDownloadsMutex;
+std::unordered_multimap<std::string, ADUC_WorkflowHandle> ExtensionManager::_activeDownloads;
+std::unordered_set<std::string> ExtensionManager::_cancelledDownloads;
+std::unordered_map<std::string, std::shared_ptr<ExtensionManager::TargetDownload>> ExtensionManager::_targetDownloads;
+std::mutex ExtensionManager::_workflowErcMutex;
 
 /**
  * @brief Loads extension shared library file.
@@ -131,11 +138,9 @@ ADUC_Result ExtensionManager::LoadExtensionLibrary(
         goto done;
     }
 
-    if (!ADUC_HashUtils_IsValidFileHash(
-            entity.TargetFilename,
-            ADUC_HashUtils_GetHashValue(entity.Hash, entity.HashCount, 0),
-            algVersion,
-            true /* suppressErrorLog */))
+    // Extensions that were verified before, and have not changed since, are not hashed again.
+    if (!ADUC_VerifiedExtensionCache_IsValidFileHash(
+            entity.TargetFilename, ADUC_HashUtils_GetHashValue(entity.Hash, entity.HashCount, 0), algVersion))
     {
         Log_Error("Hash for %s is not valid", entity.TargetFilename);
         result.ExtendedResultCode = ADUC_ERC_EXTENSION_CREATE_FAILURE_VALIDATE(facilityCode, componentCode);
@@ -428,6 +433,10 @@ ADUC_Result ExtensionManager::LoadContentDownloaderLibrary(void** contentDownloa
                                            CONTENT_DOWNLOADER__Download__EXPORT_SYMBOL };
     void* extensionLib = nullptr;
     GET_CONTRACT_INFO_PROC getContractInfoFn = nullptr;
+    SetDownloadCancellationCallbackProc setCancellationCallbackFn = nullptr;
+
+    // Payloads may be downloaded in parallel, so serialize the lazy load of the content downloader.
+    std::lock_guard<std::mutex> lock{ _contentDownloaderMutex };
 
     if (_contentDownloader != nullptr)
     {
@@ -486,6 +495,15 @@ ADUC_Result ExtensionManager::LoadContentDownloaderLibrary(void** contentDownloa
             _contentDownloaderContractVersion.minorVer);
     }
 
+    // Optional. Lets the content downloader abandon a download when its workflow is cancelled.
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    setCancellationCallbackFn = reinterpret_cast<SetDownloadCancellationCallbackProc>(
+        ADUCPAL_dlsym(extensionLib, CONTENT_DOWNLOADER__SetDownloadCancellationCallback__EXPORT_SYMBOL));
+    if (setCancellationCallbackFn != nullptr)
+    {
+        setCancellationCallbackFn(ExtensionManager::IsDownloadCancelled);
+    }
+
     *contentDownloaderLibrary = _contentDownloader = extensionLib;
 
     result = { ADUC_Result_Success };
@@ -829,28 +847,194 @@ DownloadProc ExtensionManager::DefaultDownloadProcResolver(void* lib)
     return reinterpret_cast<DownloadProc>(ADUCPAL_dlsym(lib, CONTENT_DOWNLOADER__Download__EXPORT_SYMBOL));
 }
 
+DownloadWithDigestProc ExtensionManager::DefaultDownloadWithDigestProcResolver(void* lib)
+{
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    return reinterpret_cast<DownloadWithDigestProc>(
+        ADUCPAL_dlsym(lib, CONTENT_DOWNLOADER__DownloadWithDigest__EXPORT_SYMBOL));
+}
+
+void ExtensionManager::RegisterActiveDownload(const char* workflowId, ADUC_WorkflowHandle workflowHandle)
+{
+    if (workflowId == nullptr)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock{ _activeDownloadsMutex };
+    _activeDownloads.emplace(workflowId, workflowHandle);
+}
+
+void ExtensionManager::UnregisterActiveDownload(const char* workflowId, ADUC_WorkflowHandle workflowHandle)
+{
+    if (workflowId == nullptr)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock{ _activeDownloadsMutex };
+    auto range = _activeDownloads.equal_range(workflowId);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (it->second == workflowHandle)
+        {
+            _activeDownloads.erase(it);
+            break;
+        }
+    }
+
+    if (_activeDownloads.count(workflowId) == 0)
+    {
+        _cancelledDownloads.erase(workflowId);
+    }
+}
+
+bool ExtensionManager::IsDownloadCancelled(const char* workflowId)
+{
+    if (workflowId == nullptr)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock{ _activeDownloadsMutex };
+    if (_cancelledDownloads.count(workflowId) != 0)
+    {
+        return true;
+    }
+
+    auto range = _activeDownloads.equal_range(workflowId);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        // The agent flags cancellation on the root workflow, and a step handler's Cancel
+        // requests cancellation down the workflow tree, so check both.
+        if (workflow_get_operation_cancel_requested(workflow_get_root(it->second))
+            || workflow_is_cancel_requested(it->second))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ExtensionManager::CancelDownload(const char* downloadId)
+{
+    if (downloadId == nullptr)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock{ _activeDownloadsMutex };
+    if (_activeDownloads.count(downloadId) == 0)
+    {
+        return false;
+    }
+
+    Log_Info("Cancelling download '%s'", downloadId);
+    _cancelledDownloads.emplace(downloadId);
+    return true;
+}
+
 ADUC_Result ExtensionManager::Download(
     const ADUC_FileEntity* entity,
     WorkflowHandle workflowHandle,
     ExtensionManager_Download_Options* options,
     ADUC_DownloadProgressCallback downloadProgressCallback,
-    ADUC_DownloadProcResolver downloadProcResolver)
+    ADUC_DownloadProcResolver downloadProcResolver,
+    ADUC_DownloadWithDigestProcResolver downloadWithDigestProcResolver)
 {
-    void* lib = nullptr;
-    DownloadProc downloadProc = nullptr;
-    SHAversion algVersion;
-
     ADUC_Result result = { /* .ResultCode = */ ADUC_Result_Failure, /* .ExtendedResultCode = */ 0 };
     ADUC::StringUtils::STRING_HANDLE_wrapper targetUpdateFilePath{ nullptr };
+    std::shared_ptr<TargetDownload> targetDownload;
+    std::string expectedHash;
 
     if (!workflow_get_entity_workfolder_filepath(workflowHandle, entity, targetUpdateFilePath.address_of()))
     {
         Log_Error("Cannot construct child manifest file path.");
         result = { /* .ResultCode = */ ADUC_Result_Failure,
                    /* .ExtendedResultCode = */ ADUC_ERC_CONTENT_DOWNLOADER_BAD_CHILD_MANIFEST_FILE_PATH };
-        goto done;
+        return result;
+    }
+
+    {
+        const char* hashType = ADUC_HashUtils_GetHashType(entity->Hash, entity->HashCount, 0);
+        const char* hashValue = ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0);
+        if (hashType != nullptr && hashValue != nullptr)
+        {
+            expectedHash = std::string{ hashType } + ":" + hashValue;
+        }
+    }
+
+    {
+        // Steps that share a payload download it to the same file. Only one download at a time may write that file,
+        // or hash it.
+        std::unique_lock<std::mutex> lock{ _activeDownloadsMutex };
+
+        for (;;)
+        {
+            auto it = _targetDownloads.find(targetUpdateFilePath.c_str());
+            if (it == _targetDownloads.end())
+            {
+                break;
+            }
+
+            std::shared_ptr<TargetDownload> other = it->second;
+            Log_Debug("Waiting for the download in progress to '%s'.", targetUpdateFilePath.c_str());
+            other->completed.wait(lock, [&other] { return other->isDone; });
+
+            if (!expectedHash.empty() && other->expectedHash == expectedHash
+                && IsAducResultCodeSuccess(other->result.ResultCode))
+            {
+                // The same content is in place and verified already.
+                return other->result;
+            }
+
+            // Otherwise, download again once no other download writes the file.
+        }
+
+        targetDownload = std::make_shared<TargetDownload>();
+        targetDownload->expectedHash = expectedHash;
+        _targetDownloads.emplace(targetUpdateFilePath.c_str(), targetDownload);
+    }
+
+    result = DownloadToTarget(
+        entity,
+        workflowHandle,
+        targetUpdateFilePath.c_str(),
+        options,
+        downloadProgressCallback,
+        downloadProcResolver,
+        downloadWithDigestProcResolver);
+
+    {
+        std::lock_guard<std::mutex> lock{ _activeDownloadsMutex };
+        targetDownload->result = result;
+        targetDownload->isDone = true;
+        _targetDownloads.erase(targetUpdateFilePath.c_str());
     }
 
+    targetDownload->completed.notify_all();
+
+    return result;
+}
+
+ADUC_Result ExtensionManager::DownloadToTarget(
+    const ADUC_FileEntity* entity,
+    WorkflowHandle workflowHandle,
+    const char* targetUpdateFilePath,
+    ExtensionManager_Download_Options* options,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    ADUC_DownloadProcResolver downloadProcResolver,
+    ADUC_DownloadWithDigestProcResolver downloadWithDigestProcResolver)
+{
+    void* lib = nullptr;
+    DownloadProc downloadProc = nullptr;
+    DownloadWithDigestProc downloadWithDigestProc = nullptr;
+    SHAversion algVersion;
+    ADUC_VerifiedDigest verifiedDigest{};
+
+    ADUC_Result result = { /* .ResultCode = */ ADUC_Result_Failure, /* .ExtendedResultCode = */ 0 };
+
     result = ExtensionManager::LoadContentDownloaderLibrary(&lib);
     if (IsAducResultCodeFailure(result.ResultCode))
     {
@@ -876,12 +1060,18 @@ ADUC_Result ExtensionManager::Download(
         goto done;
     }
 
+    // Optional. Content downloaders that hash while downloading export this to avoid re-reading the payload.
+    if (downloadWithDigestProcResolver != nullptr)
+    {
+        downloadWithDigestProc = downloadWithDigestProcResolver(lib);
+    }
+
     if (!ADUC_HashUtils_GetShaVersionForTypeString(
             ADUC_HashUtils_GetHashType(entity->Hash, entity->HashCount, 0), &algVersion))
     {
         Log_Error(
             "FileEntity for %s has unsupported hash type %s",
-            targetUpdateFilePath.c_str(),
+            targetUpdateFilePath,
             ADUC_HashUtils_GetHashType(entity->Hash, entity->HashCount, 0));
         result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_FILE_HASH_TYPE_NOT_SUPPORTED;
         goto done;
@@ -889,9 +1079,9 @@ ADUC_Result ExtensionManager::Download(
 
     // If file exists and has a valid hash, then skip download.
     // Otherwise, delete an existing file, then download.
-    Log_Debug("Check whether '%s' has already been download into the work folder.", targetUpdateFilePath.c_str());
+    Log_Debug("Check whether '%s' has already been download into the work folder.", targetUpdateFilePath);
 
-    if (ADUCPAL_access(targetUpdateFilePath.c_str(), F_OK) == 0)
+    if (ADUCPAL_access(targetUpdateFilePath, F_OK) == 0)
     {
         char* hashValue = ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0 /* index */);
         if (hashValue == nullptr)
@@ -904,19 +1094,26 @@ ADUC_Result ExtensionManager::Download(
         // If target file exists, validate file hash.
         // If file is valid, then skip the download.
         bool validHash = ADUC_HashUtils_IsValidFileHash(
-            targetUpdateFilePath.c_str(), hashValue, algVersion, false /* suppressErrorLog */);
+            targetUpdateFilePath, hashValue, algVersion, false /* suppressErrorLog */);
 
-        if (!validHash)
+        if (validHash)
         {
-            // Delete existing file.
-            if (remove(targetUpdateFilePath.c_str()) != 0)
-            {
-                Log_Error("Cannot delete existing file that has invalid hash.");
-                result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_CANNOT_DELETE_EXISTING_FILE;
-                goto done;
-            }
+            result = { /* .ResultCode = */ ADUC_Result_Success, /* .ExtendedResultCode = */ 0 };
+            goto done;
+        }
+
+        // Delete existing file.
+        if (remove(targetUpdateFilePath) != 0)
+        {
+            Log_Error("Cannot delete existing file that has invalid hash.");
+            result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_CANNOT_DELETE_EXISTING_FILE;
+            goto done;
         }
+    }
 
+    // A retry or replacement of the deployment may download a payload that an earlier workflow already downloaded.
+    if (RestoreFromDownloadCache(entity, targetUpdateFilePath))
+    {
         result = { /* .ResultCode = */ ADUC_Result_Success, /* .ExtendedResultCode = */ 0 };
         goto done;
     }
@@ -928,7 +1125,8 @@ ADUC_Result ExtensionManager::Download(
     // download handler exists in the entity (metadata).
     if (!IsNullOrEmpty(entity->DownloadHandlerId))
     {
-        result = ProcessDownloadHandlerExtensibility(workflowHandle, entity, targetUpdateFilePath.c_str());
+        result = ProcessDownloadHandlerExtensibility(
+            workflowHandle, entity, targetUpdateFilePath, &verifiedDigest);
         // continue on to fallback to full content download if necessary
     }
 
@@ -937,10 +1135,15 @@ ADUC_Result ExtensionManager::Download(
         || result.ResultCode == ADUC_Result_Download_Handler_RequiredFullDownload)
     {
         // Either download handler id did not exist, or download handler failed and doing fallback here.
-        const char* workflowId = workflow_peek_id(workflowHandle);
+        verifiedDigest = {};
+
+        // A download with its own id can be cancelled on its own, without cancelling its workflow.
+        const char* downloadId = (options != nullptr && !IsNullOrEmpty(options->downloadId))
+            ? options->downloadId
+            : workflow_peek_id(workflowHandle);
         cstr_wrapper workFolder{ workflow_get_workfolder(workflowHandle) };
 
-        Log_Info("Downloading full target update payload to '%s'", targetUpdateFilePath.c_str());
+        Log_Info("Downloading full target update payload to '%s'", targetUpdateFilePath);
 
         unsigned int timeoutInMinutes = GetDownloadTimeoutInMinutes(options);
 
@@ -948,7 +1151,20 @@ ADUC_Result ExtensionManager::Download(
         // but the content downloader contract version is in terms of seconds.
         unsigned int timeoutInSeconds = 60 * timeoutInMinutes;
 
-        result = downloadProc(entity, workflowId, workFolder.get(), timeoutInSeconds, downloadProgressCallback);
+        RegisterActiveDownload(downloadId, workflowHandle);
+
+        if (downloadWithDigestProc != nullptr)
+        {
+            result = downloadWithDigestProc(
+                entity, downloadId, workFolder.get(), timeoutInSeconds, downloadProgressCallback, &verifiedDigest);
+        }
+        else
+        {
+            result = downloadProc(entity, downloadId, workFolder.get(), timeoutInSeconds, downloadProgressCallback);
+        }
+
+        UnregisterActiveDownload(downloadId, workflowHandle);
+
         if (IsAducResultCodeFailure(result.ResultCode))
         {
             goto done;
@@ -957,17 +1173,34 @@ ADUC_Result ExtensionManager::Download(
 
     if (IsAducResultCodeSuccess(result.ResultCode))
     {
-        if (!ADUC_HashUtils_IsValidFileHash(
-                targetUpdateFilePath.c_str(),
-                ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0),
-                algVersion,
-                false))
+        const char* hashValue = ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0);
+        bool isValidHash = false;
+
+        // A download handler may have verified the file against a stronger hash than this one, so it is hashed again.
+        if (verifiedDigest.algorithm == static_cast<int32_t>(algVersion)
+            && ADUC_HashUtils_IsVerifiedDigestCurrent(&verifiedDigest, targetUpdateFilePath))
+        {
+            // The content was hashed as it was written, and the file has not changed since.
+            Log_Debug("Using verified digest of '%s'.", targetUpdateFilePath);
+            isValidHash = ADUC_HashUtils_IsVerifiedDigestMatch(&verifiedDigest, hashValue, algVersion);
+        }
+        else
+        {
+            isValidHash = ADUC_HashUtils_IsValidFileHash(targetUpdateFilePath, hashValue, algVersion, false);
+        }
+
+        if (!isValidHash)
         {
             result.ResultCode = ADUC_Result_Failure;
             result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_INVALID_FILE_HASH;
 
-            Log_Error("Successful download of '%s' failed hash check.", targetUpdateFilePath.c_str());
-            workflow_add_erc(workflowHandle, result.ExtendedResultCode);
+            Log_Error("Successful download of '%s' failed hash check.", targetUpdateFilePath);
+
+            {
+                // A download handler may download several files of the workflow at once.
+                std::lock_guard<std::mutex> lock{ _workflowErcMutex };
+                workflow_add_erc(workflowHandle, result.ExtendedResultCode);
+            }
 
             goto done;
         }
@@ -978,6 +1211,8 @@ ADUC_Result ExtensionManager::Download(
         goto done;
     }
 
+    AddToDownloadCache(entity, targetUpdateFilePath);
+
     result.ResultCode = ADUC_GeneralResult_Success;
     result.ExtendedResultCode = 0;
 
@@ -1002,6 +1237,11 @@ ADUC_Result ExtensionManager_Download(
     return ExtensionManager::Download(entity, workflowHandle, options, downloadProgressCallback);
 }
 
+bool ExtensionManager_CancelDownload(const char* downloadId)
+{
+    return ExtensionManager::CancelDownload(downloadId);
+}
+
 /**
  * @brief Uninitializes the extension manager.
  */
@@ -9,14 +9,20 @@
 #include "aduc/extension_manager_helper.hpp"
 
 #include <aduc/config_utils.h>
+#include <aduc/download_cache_utils.h>
 #include <aduc/download_handler_factory.hpp>
 #include <aduc/download_handler_plugin.hpp>
+#include <aduc/hash_utils.h> // ADUC_HashUtils_IsValidFileHash
 #include <aduc/result.h>
 #include <aduc/string_c_utils.h>
 #include <aduc/workflow_utils.h>
 
+#include <stdio.h> // remove
+#include <string>
+
 ExtensionManager_Download_Options Default_ExtensionManager_Download_Options = {
-    CONTENT_DOWNLOADER_MAX_TIMEOUT_IN_MINUTES_DEFAULT /* timeoutInMinutes */
+    CONTENT_DOWNLOADER_MAX_TIMEOUT_IN_MINUTES_DEFAULT /* timeoutInMinutes */,
+    NULL /* downloadId */
 };
 
 /**
@@ -25,10 +31,15 @@ ExtensionManager_Download_Options Default_ExtensionManager_Download_Options = {
  * @param workflowHandle The workflow handle.
  * @param entity The file entity with the downloader handler id.
  * @param targetUpdateFilePath The target file path to which to write the resultant update.
+ * @param[out] verifiedDigest Optional. The verified digest of the resultant update, if the download handler hashed it
+ * as it wrote it. Left empty otherwise.
  * @return ADUC_Result The result.
  */
 ADUC_Result ProcessDownloadHandlerExtensibility(
-    ADUC_WorkflowHandle workflowHandle, const ADUC_FileEntity* entity, const char* targetUpdateFilePath) noexcept
+    ADUC_WorkflowHandle workflowHandle,
+    const ADUC_FileEntity* entity,
+    const char* targetUpdateFilePath,
+    ADUC_VerifiedDigest* verifiedDigest) noexcept
 {
     ADUC_Result result = { ADUC_GeneralResult_Failure, 0 };
 
@@ -103,7 +114,7 @@ ADUC_Result ProcessDownloadHandlerExtensibility(
 
     Log_Info("Invoking DownloadHandler plugin ProcessUpdate for '%s'", targetUpdateFilePath);
 
-    result = plugin->ProcessUpdate(workflowHandle, entity, targetUpdateFilePath);
+    result = plugin->ProcessUpdate(workflowHandle, entity, targetUpdateFilePath, verifiedDigest);
     if (IsAducResultCodeFailure(result.ResultCode))
     {
         workflow_add_erc(workflowHandle, result.ExtendedResultCode);
@@ -147,3 +158,111 @@ unsigned int GetDownloadTimeoutInMinutes(const ExtensionManager_Download_Options
 done:
     return ret;
 }
+
+/**
+ * @brief Gets the SHA-256 hash of a file entity, which is the key of the payload in the download cache.
+ *
+ * @param entity The file entity.
+ * @return const char* The base64 encoded hash, or nullptr if the entity has no SHA-256 hash.
+ */
+static const char* GetSha256HashValue(const ADUC_FileEntity* entity)
+{
+    for (size_t i = 0; i < entity->HashCount; ++i)
+    {
+        SHAversion algVersion;
+        if (ADUC_HashUtils_GetShaVersionForTypeString(entity->Hash[i].type, &algVersion) && algVersion == SHA256)
+        {
+            return entity->Hash[i].value;
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief Gets the download cache settings from the config file.
+ * @remark This function requires that the ADUC_ConfigInfo singleton has been initialized.
+ *
+ * @param[out] cacheFolder The download cache folder.
+ * @param[out] maxCacheSizeInBytes The maximum size of the download cache.
+ * @return bool false if the download cache is disabled.
+ */
+static bool GetDownloadCacheSettings(std::string* cacheFolder, uint64_t* maxCacheSizeInBytes)
+{
+    bool enabled = false;
+    const ADUC_ConfigInfo* config = ADUC_ConfigInfo_GetInstance();
+    if (config == nullptr)
+    {
+        return false;
+    }
+
+    if (config->downloadCacheSizeInMB != 0 && config->downloadCacheFolder != nullptr)
+    {
+        *cacheFolder = config->downloadCacheFolder;
+        *maxCacheSizeInBytes = static_cast<uint64_t>(config->downloadCacheSizeInMB) * 1024 * 1024;
+        enabled = true;
+    }
+
+    ADUC_ConfigInfo_ReleaseInstance(config);
+    return enabled;
+}
+
+/**
+ * @brief Produces the payload of a file entity from the download cache, e.g. when a retry or replacement of the
+ * deployment downloads a payload that an earlier workflow downloaded into a work folder that has since been removed.
+ *
+ * @param entity The file entity.
+ * @param targetUpdateFilePath The path of the payload in the work folder. It must not exist.
+ * @return bool true if the payload was produced from the cache and has the hash of the file entity.
+ */
+bool RestoreFromDownloadCache(const ADUC_FileEntity* entity, const char* targetUpdateFilePath) noexcept
+{
+    std::string cacheFolder;
+    uint64_t maxCacheSizeInBytes = 0;
+
+    const char* hashValue = GetSha256HashValue(entity);
+    if (hashValue == nullptr || !GetDownloadCacheSettings(&cacheFolder, &maxCacheSizeInBytes))
+    {
+        return false;
+    }
+
+    if (!ADUC_DownloadCache_Restore(cacheFolder.c_str(), hashValue, targetUpdateFilePath))
+    {
+        return false;
+    }
+
+    // The entry may share its content with a payload of an earlier workflow, so verify it is still intact.
+    if (!ADUC_HashUtils_IsValidFileHash(targetUpdateFilePath, hashValue, SHA256, true /* suppressErrorLog */))
+    {
+        Log_Warn("Download cache entry for '%s' failed hash check. Removing it.", targetUpdateFilePath);
+        (void)remove(targetUpdateFilePath);
+        (void)ADUC_DownloadCache_Remove(cacheFolder.c_str(), hashValue);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Adds the payload of a file entity to the download cache, evicting the least recently used payloads to keep
+ * the cache within its size.
+ *
+ * @param entity The file entity.
+ * @param updateFilePath The path of the payload, which must have the hash of the file entity.
+ */
+void AddToDownloadCache(const ADUC_FileEntity* entity, const char* updateFilePath) noexcept
+{
+    std::string cacheFolder;
+    uint64_t maxCacheSizeInBytes = 0;
+
+    const char* hashValue = GetSha256HashValue(entity);
+    if (hashValue == nullptr || !GetDownloadCacheSettings(&cacheFolder, &maxCacheSizeInBytes))
+    {
+        return;
+    }
+
+    if (!ADUC_DownloadCache_Add(cacheFolder.c_str(), hashValue, updateFilePath, maxCacheSizeInBytes))
+    {
+        Log_Debug("'%s' was not added to the download cache.", updateFilePath);
+    }
+}
@@ -21,6 +21,12 @@ enum class DownloadTestScenario
     Invalid,
     BasicDownloadSuccess,
     BasicDownloadFailure,
+    DownloadWithDigestSuccess,
+    DownloadWithDigestMismatch,
+    DownloadWithStaleDigest,
+    DownloadCancelled,
+    DownloadCancelledById,
+    ConcurrentDownloadsOfSameFile,
 };
 
 class ExtensionManagerDownloadTestCase
@@ -52,6 +58,16 @@ public:
         return expected_result;
     }
 
+    bool IsDownloadCancelledAfterDownload() const
+    {
+        return download_cancelled_after_download;
+    }
+
+    int GetDownloadProcCalls() const
+    {
+        return download_proc_calls;
+    }
+
 private:
     void InitCommon();
     void RunCommon();
@@ -61,8 +77,13 @@ private:
     DownloadTestScenario download_scenario{ DownloadTestScenario::Invalid };
     ADUC_Result actual_result{};
     ADUC_Result expected_result{};
+    bool download_cancelled_after_download{ false };
+    const char* download_id{ nullptr };
+    size_t concurrent_downloads{ 1 };
+    int download_proc_calls{ 0 };
 
     ADUC_DownloadProcResolver mockProcResolver{ nullptr };
+    ADUC_DownloadWithDigestProcResolver mockDigestProcResolver{ nullptr };
 
     ADUC_WorkflowHandle workflowHandle{ nullptr };
 };
@@ -11,6 +11,7 @@
 #include <aduc/calloc_wrapper.hpp> // ADUC::StringUtils::cstr_wrapper
 #include <aduc/extension_manager.hpp>
 #include <aduc/auto_file_entity.hpp>
+#include <aduc/hash_utils.h> // ADUC_HashUtils_StreamContext
 #include <aduc/result.h> // ADUC_Result, ADUC_Result_t
 #include <aduc/system_utils.h> // ADUC_SystemUtils_GetTemporaryPathName
 #include <aduc/types/workflow.h>
@@ -18,13 +19,18 @@
 #include <aduc/workflow_utils.h>
 #include <aducpal/stdio.h> // remove
 #include <aducpal/unistd.h> // UNREFERENCED_PARAMETER
+#include <atomic>
 #include <catch2/catch_all.hpp>
+#include <chrono>
 #include <fstream>
 #include <memory>
 #include <parson.h>
 #include <stdexcept>
 #include <stdio.h>
+#include <string.h> // strlen
 #include <string>
+#include <thread>
+#include <vector>
 
 struct json_value_deleter
 {
@@ -51,6 +57,9 @@ const std::string downloaded_file_path = testWorkfolder + "/" + mockTargetFilena
 
 using unique_json_value = std::unique_ptr<JSON_Value, json_value_deleter>;
 
+// The workflow handle of the download in progress, for mocks that need to act on the workflow.
+static ADUC_WorkflowHandle s_downloadingWorkflowHandle = nullptr;
+
 static ADUC_Result MockDownloadSuccessProc(
     const ADUC_FileEntity* entity,
     const char* workflowId,
@@ -89,18 +98,234 @@ static ADUC_Result MockDownloadFailureProc(
     return result;
 }
 
+/**
+ * @brief Writes the mock payload while hashing it, the way a streaming content downloader does.
+ *
+ * @param entity The file entity.
+ * @param[out] verifiedDigest The verified digest token for the written payload.
+ */
+static void WritePayloadWithDigest(const ADUC_FileEntity* entity, ADUC_VerifiedDigest* verifiedDigest)
+{
+    ADUC_HashUtils_StreamContext hashContext = {};
+    REQUIRE(ADUC_HashUtils_StreamContext_Init(&hashContext, SHA256));
+
+    {
+        std::ofstream fileStream;
+        fileStream.open(downloaded_file_path.c_str(), std::ios::out | std::ios::trunc);
+        fileStream << mockPayloadContent;
+    }
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto* data = reinterpret_cast<const uint8_t*>(mockPayloadContent);
+    REQUIRE(ADUC_HashUtils_StreamContext_Update(&hashContext, data, strlen(mockPayloadContent)));
+    REQUIRE(ADUC_HashUtils_StreamContext_FinalizeToVerifiedDigest(
+        &hashContext,
+        ADUC_HashUtils_GetHashValue(entity->Hash, entity->HashCount, 0),
+        downloaded_file_path.c_str(),
+        verifiedDigest));
+    ADUC_HashUtils_StreamContext_UnInit(&hashContext);
+}
+
+static ADUC_Result MockDownloadWithDigestSuccessProc(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int timeoutInSeconds,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    ADUC_VerifiedDigest* verifiedDigest)
+{
+    UNREFERENCED_PARAMETER(workflowId);
+    UNREFERENCED_PARAMETER(workFolder);
+    UNREFERENCED_PARAMETER(timeoutInSeconds);
+    UNREFERENCED_PARAMETER(downloadProgressCallback);
+
+    WritePayloadWithDigest(entity, verifiedDigest);
+
+    ADUC_Result result{ 1, 0 };
+    return result;
+}
+
+static ADUC_Result MockDownloadWithDigestMismatchProc(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int timeoutInSeconds,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    ADUC_VerifiedDigest* verifiedDigest)
+{
+    UNREFERENCED_PARAMETER(workflowId);
+    UNREFERENCED_PARAMETER(workFolder);
+    UNREFERENCED_PARAMETER(timeoutInSeconds);
+    UNREFERENCED_PARAMETER(downloadProgressCallback);
+
+    WritePayloadWithDigest(entity, verifiedDigest);
+
+    // The file on disk is valid, so a failure proves the token was used instead of re-reading the file.
+    snprintf(verifiedDigest->hashBase64, sizeof(verifiedDigest->hashBase64), "%s", "notTheExpectedHash=");
+
+    ADUC_Result result{ 1, 0 };
+    return result;
+}
+
+static ADUC_Result MockDownloadWithStaleDigestProc(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int timeoutInSeconds,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    ADUC_VerifiedDigest* verifiedDigest)
+{
+    UNREFERENCED_PARAMETER(workflowId);
+    UNREFERENCED_PARAMETER(workFolder);
+    UNREFERENCED_PARAMETER(timeoutInSeconds);
+    UNREFERENCED_PARAMETER(downloadProgressCallback);
+
+    WritePayloadWithDigest(entity, verifiedDigest);
+
+    // Modify the file after the digest was taken, so the token no longer describes it.
+    std::ofstream fileStream;
+    fileStream.open(downloaded_file_path.c_str(), std::ios::out | std::ios::app);
+    fileStream << " world";
+
+    ADUC_Result result{ 1, 0 };
+    return result;
+}
+
+static ADUC_Result MockDownloadCancelledProc(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int timeoutInSeconds,
+    ADUC_DownloadProgressCallback downloadProgressCallback)
+{
+    UNREFERENCED_PARAMETER(entity);
+    UNREFERENCED_PARAMETER(workFolder);
+    UNREFERENCED_PARAMETER(timeoutInSeconds);
+    UNREFERENCED_PARAMETER(downloadProgressCallback);
+
+    ADUC_Result result{ 0, FailureERC };
+
+    if (ExtensionManager::IsDownloadCancelled(workflowId))
+    {
+        return result;
+    }
+
+    // Cancel the way the agent does, then poll the way a content downloader does.
+    workflow_set_operation_cancel_requested(s_downloadingWorkflowHandle, true);
+    if (!ExtensionManager::IsDownloadCancelled(workflowId))
+    {
+        return result;
+    }
+
+    result = { ADUC_Result_Failure_Cancelled, 0 };
+    return result;
+}
+
+static const char* const TestDownloadId = "test-workflow-id/test-file-id";
+
+static ADUC_Result MockDownloadCancelledByIdProc(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int timeoutInSeconds,
+    ADUC_DownloadProgressCallback downloadProgressCallback)
+{
+    UNREFERENCED_PARAMETER(entity);
+    UNREFERENCED_PARAMETER(workFolder);
+    UNREFERENCED_PARAMETER(timeoutInSeconds);
+    UNREFERENCED_PARAMETER(downloadProgressCallback);
+
+    ADUC_Result result{ 0, FailureERC };
+
+    // The content downloader is handed the download id in place of the workflow id.
+    if (strcmp(workflowId, TestDownloadId) != 0 || ExtensionManager::IsDownloadCancelled(workflowId))
+    {
+        return result;
+    }
+
+    // Cancel this download alone, then poll the way a content downloader does.
+    if (!ExtensionManager::CancelDownload(workflowId) || !ExtensionManager::IsDownloadCancelled(workflowId)
+        || workflow_get_operation_cancel_requested(s_downloadingWorkflowHandle))
+    {
+        return result;
+    }
+
+    result = { ADUC_Result_Failure_Cancelled, 0 };
+    return result;
+}
+
+// The calls to the content downloader, for scenarios that check how many downloads took place.
+static std::atomic<int> s_downloadProcCalls{ 0 };
+
+static ADUC_Result MockDownloadSlowSuccessProc(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int timeoutInSeconds,
+    ADUC_DownloadProgressCallback downloadProgressCallback)
+{
+    ++s_downloadProcCalls;
+
+    // Long enough for the other downloads of the file to start meanwhile.
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    return MockDownloadSuccessProc(entity, workflowId, workFolder, timeoutInSeconds, downloadProgressCallback);
+}
+
 static DownloadProc mockDownloadSuccessProcResolver(void* lib)
 {
     UNREFERENCED_PARAMETER(lib);
     return MockDownloadSuccessProc;
 }
 
+static DownloadProc mockDownloadSlowSuccessProcResolver(void* lib)
+{
+    UNREFERENCED_PARAMETER(lib);
+    return MockDownloadSlowSuccessProc;
+}
+
 static DownloadProc mockDownloadFailureProcResolver(void* lib)
 {
     UNREFERENCED_PARAMETER(lib);
     return MockDownloadFailureProc;
 }
 
+static DownloadProc mockDownloadCancelledProcResolver(void* lib)
+{
+    UNREFERENCED_PARAMETER(lib);
+    return MockDownloadCancelledProc;
+}
+
+static DownloadProc mockDownloadCancelledByIdProcResolver(void* lib)
+{
+    UNREFERENCED_PARAMETER(lib);
+    return MockDownloadCancelledByIdProc;
+}
+
+static DownloadWithDigestProc mockNoDownloadWithDigestProcResolver(void* lib)
+{
+    UNREFERENCED_PARAMETER(lib);
+    return nullptr;
+}
+
+static DownloadWithDigestProc mockDownloadWithDigestSuccessProcResolver(void* lib)
+{
+    UNREFERENCED_PARAMETER(lib);
+    return MockDownloadWithDigestSuccessProc;
+}
+
+static DownloadWithDigestProc mockDownloadWithDigestMismatchProcResolver(void* lib)
+{
+    UNREFERENCED_PARAMETER(lib);
+    return MockDownloadWithDigestMismatchProc;
+}
+
+static DownloadWithDigestProc mockDownloadWithStaleDigestProcResolver(void* lib)
+{
+    UNREFERENCED_PARAMETER(lib);
+    return MockDownloadWithStaleDigestProc;
+}
+
 static void setupWorkflowHandle(const char* msgJson, ADUC_WorkflowHandle* outWorkflowHandle)
 {
     ADUC_Result result{ workflow_init(msgJson, false /* validateManifest */, outWorkflowHandle) };
@@ -123,16 +348,62 @@ void ExtensionManagerDownloadTestCase::RunScenario()
     {
     case DownloadTestScenario::BasicDownloadSuccess:
         mockProcResolver = mockDownloadSuccessProcResolver;
+        mockDigestProcResolver = mockNoDownloadWithDigestProcResolver;
         expected_result.ResultCode = 1;
         expected_result.ExtendedResultCode = 0;
         break;
 
     case DownloadTestScenario::BasicDownloadFailure:
         mockProcResolver = mockDownloadFailureProcResolver;
+        mockDigestProcResolver = mockNoDownloadWithDigestProcResolver;
         expected_result.ResultCode = 0;
         expected_result.ExtendedResultCode = FailureERC;
         break;
 
+    case DownloadTestScenario::DownloadWithDigestSuccess:
+        mockProcResolver = mockDownloadFailureProcResolver;
+        mockDigestProcResolver = mockDownloadWithDigestSuccessProcResolver;
+        expected_result.ResultCode = 1;
+        expected_result.ExtendedResultCode = 0;
+        break;
+
+    case DownloadTestScenario::DownloadWithDigestMismatch:
+        mockProcResolver = mockDownloadFailureProcResolver;
+        mockDigestProcResolver = mockDownloadWithDigestMismatchProcResolver;
+        expected_result.ResultCode = 0;
+        expected_result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_INVALID_FILE_HASH;
+        break;
+
+    case DownloadTestScenario::DownloadWithStaleDigest:
+        mockProcResolver = mockDownloadFailureProcResolver;
+        mockDigestProcResolver = mockDownloadWithStaleDigestProcResolver;
+        expected_result.ResultCode = 0;
+        expected_result.ExtendedResultCode = ADUC_ERC_CONTENT_DOWNLOADER_INVALID_FILE_HASH;
+        break;
+
+    case DownloadTestScenario::DownloadCancelled:
+        mockProcResolver = mockDownloadCancelledProcResolver;
+        mockDigestProcResolver = mockNoDownloadWithDigestProcResolver;
+        expected_result.ResultCode = ADUC_Result_Failure_Cancelled;
+        expected_result.ExtendedResultCode = 0;
+        break;
+
+    case DownloadTestScenario::DownloadCancelledById:
+        mockProcResolver = mockDownloadCancelledByIdProcResolver;
+        mockDigestProcResolver = mockNoDownloadWithDigestProcResolver;
+        download_id = TestDownloadId;
+        expected_result.ResultCode = ADUC_Result_Failure_Cancelled;
+        expected_result.ExtendedResultCode = 0;
+        break;
+
+    case DownloadTestScenario::ConcurrentDownloadsOfSameFile:
+        mockProcResolver = mockDownloadSlowSuccessProcResolver;
+        mockDigestProcResolver = mockNoDownloadWithDigestProcResolver;
+        concurrent_downloads = 3;
+        expected_result.ResultCode = 1;
+        expected_result.ExtendedResultCode = 0;
+        break;
+
     default:
         throw std::invalid_argument("invalid scenario");
     }
@@ -166,13 +437,49 @@ void ExtensionManagerDownloadTestCase::RunCommon()
     AutoFileEntity fileEntity;
     REQUIRE(workflow_get_update_file(workflowHandle, 0, &fileEntity));
 
-    ExtensionManager_Download_Options downloadOptions{ 1 /*timeoutInMinutes*/ };
+    ExtensionManager_Download_Options downloadOptions{ 1 /*timeoutInMinutes*/, download_id };
+    s_downloadingWorkflowHandle = workflowHandle;
+    s_downloadProcCalls = 0;
+
+    // The other downloads of the same file, e.g. of steps that share a payload.
+    std::vector<ADUC_Result> otherResults(concurrent_downloads - 1);
+    std::vector<std::thread> otherDownloads;
+    for (auto& otherResult : otherResults)
+    {
+        otherDownloads.emplace_back([&otherResult, &fileEntity, &downloadOptions, this] {
+            otherResult = ExtensionManager::Download(
+                &fileEntity, workflowHandle, &downloadOptions, nullptr, mockProcResolver, mockDigestProcResolver);
+        });
+    }
+
     actual_result = ExtensionManager::Download(
         &fileEntity,
         workflowHandle,
         &downloadOptions,
         nullptr, // downloadProgressCallback
-        mockProcResolver);
+        mockProcResolver,
+        mockDigestProcResolver);
+
+    for (auto& otherDownload : otherDownloads)
+    {
+        otherDownload.join();
+    }
+
+    s_downloadingWorkflowHandle = nullptr;
+    download_proc_calls = s_downloadProcCalls;
+
+    for (const auto& otherResult : otherResults)
+    {
+        if (otherResult.ResultCode != actual_result.ResultCode
+            || otherResult.ExtendedResultCode != actual_result.ExtendedResultCode)
+        {
+            actual_result = otherResult;
+        }
+    }
+
+    // The download is no longer in progress, so it is no longer reported as cancelled.
+    download_cancelled_after_download = ExtensionManager::IsDownloadCancelled(
+        download_id != nullptr ? download_id : workflow_peek_id(workflowHandle));
 }
 
 void ExtensionManagerDownloadTestCase::Cleanup()
@@ -37,3 +37,78 @@ TEST_CASE("ExtensionManager::Download failure should return failure ResultCode a
     CHECK(actual_result.ResultCode == expected_result.ResultCode);
     CHECK(actual_result.ExtendedResultCode == expected_result.ExtendedResultCode);
 }
+
+TEST_CASE("ExtensionManager::Download with verified digest should not need to re-read the file")
+{
+    ExtensionManagerDownloadTestCase testCase{ DownloadTestScenario::DownloadWithDigestSuccess };
+    REQUIRE_NOTHROW(testCase.RunScenario());
+
+    ADUC_Result actual_result = testCase.GetActualResult();
+    ADUC_Result expected_result = testCase.GetExpectedResult();
+
+    CHECK(actual_result.ResultCode == expected_result.ResultCode);
+    CHECK(actual_result.ExtendedResultCode == expected_result.ExtendedResultCode);
+}
+
+TEST_CASE("ExtensionManager::Download should trust a current verified digest")
+{
+    ExtensionManagerDownloadTestCase testCase{ DownloadTestScenario::DownloadWithDigestMismatch };
+    REQUIRE_NOTHROW(testCase.RunScenario());
+
+    ADUC_Result actual_result = testCase.GetActualResult();
+    ADUC_Result expected_result = testCase.GetExpectedResult();
+
+    CHECK(actual_result.ResultCode == expected_result.ResultCode);
+    CHECK(actual_result.ExtendedResultCode == expected_result.ExtendedResultCode);
+}
+
+TEST_CASE("ExtensionManager::Download should re-hash the file when the verified digest is stale")
+{
+    ExtensionManagerDownloadTestCase testCase{ DownloadTestScenario::DownloadWithStaleDigest };
+    REQUIRE_NOTHROW(testCase.RunScenario());
+
+    ADUC_Result actual_result = testCase.GetActualResult();
+    ADUC_Result expected_result = testCase.GetExpectedResult();
+
+    CHECK(actual_result.ResultCode == expected_result.ResultCode);
+    CHECK(actual_result.ExtendedResultCode == expected_result.ExtendedResultCode);
+}
+
+TEST_CASE("ExtensionManager::IsDownloadCancelled should report cancellation of the workflow being downloaded")
+{
+    ExtensionManagerDownloadTestCase testCase{ DownloadTestScenario::DownloadCancelled };
+    REQUIRE_NOTHROW(testCase.RunScenario());
+
+    ADUC_Result actual_result = testCase.GetActualResult();
+    ADUC_Result expected_result = testCase.GetExpectedResult();
+
+    CHECK(actual_result.ResultCode == expected_result.ResultCode);
+    CHECK(actual_result.ExtendedResultCode == expected_result.ExtendedResultCode);
+    CHECK_FALSE(testCase.IsDownloadCancelledAfterDownload());
+}
+
+TEST_CASE("ExtensionManager::CancelDownload should cancel a single download of the workflow")
+{
+    ExtensionManagerDownloadTestCase testCase{ DownloadTestScenario::DownloadCancelledById };
+    REQUIRE_NOTHROW(testCase.RunScenario());
+
+    ADUC_Result actual_result = testCase.GetActualResult();
+    ADUC_Result expected_result = testCase.GetExpectedResult();
+
+    CHECK(actual_result.ResultCode == expected_result.ResultCode);
+    CHECK(actual_result.ExtendedResultCode == expected_result.ExtendedResultCode);
+    CHECK_FALSE(testCase.IsDownloadCancelledAfterDownload());
+}
+
+TEST_CASE("ExtensionManager::Download should download a file shared by concurrent downloads once")
+{
+    ExtensionManagerDownloadTestCase testCase{ DownloadTestScenario::ConcurrentDownloadsOfSameFile };
+    REQUIRE_NOTHROW(testCase.RunScenario());
+
+    ADUC_Result actual_result = testCase.GetActualResult();
+    ADUC_Result expected_result = testCase.GetExpectedResult();
+
+    CHECK(actual_result.ResultCode == expected_result.ResultCode);
+    CHECK(actual_result.ExtendedResultCode == expected_result.ExtendedResultCode);
+    CHECK(testCase.GetDownloadProcCalls() == 1);
+}
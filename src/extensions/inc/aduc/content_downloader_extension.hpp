@@ -21,6 +21,16 @@ typedef ADUC_Result (*DownloadProc)(
     unsigned int timeoutInSeconds,
     ADUC_DownloadProgressCallback downloadProgressCallback);
 
+typedef ADUC_Result (*DownloadWithDigestProc)(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int timeoutInSeconds,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    ADUC_VerifiedDigest* verifiedDigest);
+
+typedef void (*SetDownloadCancellationCallbackProc)(ADUC_DownloadCancellationCallback cancellationCallback);
+
 EXTERN_C_END
 
 #endif // ADUC_CONTENT_DOWNLOADER_EXTENSION_HPP
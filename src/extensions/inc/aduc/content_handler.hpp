@@ -18,6 +18,11 @@ struct tagADUC_WorkflowData;
 /**
  * @interface ContentHandler
  * @brief Interface for content specific handler implementations.
+ * @details The steps handler calls Download and IsInstalled one step at a time, unless the steps opt into concurrent
+ * downloads. They are then called concurrently, on download worker threads, each with its own step workflow, and
+ * implementations must not share mutable state between calls without synchronizing it. Backup, Install, Apply,
+ * Restore and Cancel are called one step at a time, unless the steps opt into concurrent installs (see the steps
+ * handler README).
  */
 class ContentHandler
 {
@@ -45,4 +45,41 @@ ADUC_Result Download(
  */
 #define CONTENT_DOWNLOADER__Download__EXPORT_SYMBOL "Download"
 
+//
+// Optional Content Downloader Extension exports.
+// The agent looks these up when present and falls back to the V1 symbols above otherwise.
+//
+
+/**
+ * @brief The download export that hashes the content while writing it to the work folder.
+ *
+ * @param entity The file entity.
+ * @param workflowId The workflow id.
+ * @param workFolder The work folder for the update payloads.
+ * @param timeoutInSeconds The maximum number of seconds to wait to receive data whilst network stays up before the download will timeout.
+ * @param downloadProgressCallback The download progress callback function.
+ * @param[out] verifiedDigest The verified digest token of the downloaded file. Left empty if the downloader did not hash the content it wrote,
+ * in which case the agent validates the file hash by re-reading the file.
+ * @return ADUC_Result The result.
+ * @details
+ADUC_Result DownloadWithDigest(
+    const ADUC_FileEntity* entity,
+    const char* workflowId,
+    const char* workFolder,
+    unsigned int timeoutInSeconds,
+    ADUC_DownloadProgressCallback downloadProgressCallback,
+    ADUC_VerifiedDigest* verifiedDigest)
+ */
+#define CONTENT_DOWNLOADER__DownloadWithDigest__EXPORT_SYMBOL "DownloadWithDigest"
+
+/**
+ * @brief Registers the callback that the content downloader polls while downloading to find out whether the workflow was cancelled.
+ *
+ * @param cancellationCallback The callback. It is safe to call from any thread for the lifetime of the loaded content downloader.
+ * @remark This may be called more than once with different callbacks, because every agent module that downloads content
+ * registers its own. A download should be abandoned when any of the registered callbacks returns true.
+ * @details void SetDownloadCancellationCallback(ADUC_DownloadCancellationCallback cancellationCallback)
+ */
+#define CONTENT_DOWNLOADER__SetDownloadCancellationCallback__EXPORT_SYMBOL "SetDownloadCancellationCallback"
+
 #endif // EXTENSION_CONTENT_DOWNLOADER_EXPORT_SYMBOLS_H
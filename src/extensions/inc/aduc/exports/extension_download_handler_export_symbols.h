@@ -59,4 +59,22 @@
  */
 #define DOWNLOAD_HANDLER__OnUpdateWorkflowCompleted__EXPORT_SYMBOL "OnUpdateWorkflowCompleted"
 
+//
+// Optional Download Handler Extension exports.
+// The agent looks these up when present and falls back to the V1 symbols above otherwise.
+//
+
+/**
+ * @brief The process update export that also outputs the verified digest of the target update it produced.
+ *
+ * @param[in] workflowHandle The workflow handle.
+ * @param[in] fileEntity The FileEntity metadata of the update content and its related files.
+ * @param[in] targetUpdateFilePath The target update path to write the update content when returning ADUC_Result_Download_Handler_SuccessSkipDownload.
+ * @param[out] verifiedDigest The verified digest token of the target update. Left empty if the download handler did not hash the content it wrote,
+ * in which case the agent validates the file hash by re-reading the file.
+ * @return ADUC_Result The result, as for ProcessUpdate.
+ * @details ADUC_Result ProcessUpdateWithDigest(const ADUC_WorkflowHandle workflowHandle, const ADUC_FileEntity* fileEntity, const char* targetUpdateFilePath, ADUC_VerifiedDigest* verifiedDigest)
+ */
+#define DOWNLOAD_HANDLER__ProcessUpdateWithDigest__EXPORT_SYMBOL "ProcessUpdateWithDigest"
+
 #endif // EXTENSION_DOWNLOAD_HANDLER_EXPORT_SYMBOLS_H
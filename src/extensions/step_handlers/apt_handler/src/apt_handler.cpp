@@ -15,12 +15,12 @@
  */
 #include "aduc/apt_handler.hpp"
 #include "aduc/adu_core_exports.h"
+#include "aduc/adushell_broker_utils.hpp" // ADUC_LaunchAduShell
 #include "aduc/config_utils.h"
 #include "aduc/extension_manager.hpp"
 #include "aduc/installed_criteria_utils.hpp"
 #include "aduc/logging.h"
 #include "aduc/parser_utils.h" // ADUC_FileEntity_Uninit
-#include "aduc/process_utils.hpp"
 #include "aduc/string_c_utils.h"
 #include "aduc/types/update_content.h"
 #include "aduc/workflow_data_utils.h"
@@ -29,6 +29,7 @@
 
 #include <chrono>
 #include <fstream>
+#include <mutex>
 #include <parson.h>
 #include <sstream>
 #include <string>
@@ -38,6 +39,36 @@
 
 namespace adushconst = Adu::Shell::Const;
 
+/**
+ * @brief The most adu-shell output kept in memory. Every line is logged as it is written, so only the tail is needed.
+ */
+static const size_t AduShellOutputMaxSizeInBytes = 64 * 1024;
+
+/**
+ * @brief Serializes the apt-get update and download of concurrent APT steps, as apt-get fails instead of waiting when
+ * another instance holds the package cache lock.
+ */
+static std::mutex s_aptPackageCacheMutex;
+
+/**
+ * @brief Runs an adu-shell task, through the adu-shell broker when one is configured, logging each line of its output
+ * as soon as it is written.
+ *
+ * @param config The configuration, with the adu-shell path and broker socket.
+ * @param args The adu-shell arguments.
+ * @param output The last AduShellOutputMaxSizeInBytes of output.
+ * @return int The adu-shell exit code.
+ */
+static int LaunchAduShell(const ADUC_ConfigInfo* config, const std::vector<std::string>& args, std::string& output)
+{
+    ADUC_ChildProcessOptions options;
+    options.outputLineSink = [](const std::string& line) { Log_Info("%s", line.c_str()); };
+    options.errorLineSink = options.outputLineSink;
+    options.maxOutputSizeInBytes = AduShellOutputMaxSizeInBytes;
+
+    return ADUC_LaunchAduShell(config, args, options, output);
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // BEGIN Shared Library Export Functions
 //
@@ -209,6 +240,7 @@ ADUC_Result AptHandlerImpl::Download(const ADUC_WorkflowData* workflowData)
     }
 
     {
+        std::lock_guard<std::mutex> aptLock{ s_aptPackageCacheMutex };
         std::string aptOutput;
         int aptExitCode = -1;
 
@@ -223,12 +255,7 @@ ADUC_Result AptHandlerImpl::Download(const ADUC_WorkflowData* workflowData)
                 adushconst::update_action_opt, adushconst::update_action_initialize
             };
 
-            aptExitCode = ADUC_LaunchChildProcess(config->aduShellFilePath, args, aptOutput);
-
-            if (!aptOutput.empty())
-            {
-                Log_Info(aptOutput.c_str());
-            }
+            aptExitCode = LaunchAduShell(config, args, aptOutput);
         }
         catch (const std::exception& de)
         {
@@ -261,12 +288,7 @@ ADUC_Result AptHandlerImpl::Download(const ADUC_WorkflowData* workflowData)
             args.emplace_back(adushconst::target_data_opt);
             args.emplace_back(data.str());
 
-            aptExitCode = ADUC_LaunchChildProcess(config->aduShellFilePath, args, aptOutput);
-
-            if (!aptOutput.empty())
-            {
-                Log_Info("\n\nadu-shell logs\n================\n\n%s", aptOutput.c_str());
-            }
+            aptExitCode = LaunchAduShell(config, args, aptOutput);
         }
         catch (const std::exception& de)
         {
@@ -361,12 +383,7 @@ ADUC_Result AptHandlerImpl::Install(const ADUC_WorkflowData* workflowData)
         args.emplace_back(adushconst::target_data_opt);
         args.emplace_back(data.str());
 
-        aptExitCode = ADUC_LaunchChildProcess(config->aduShellFilePath, args, aptOutput);
-
-        if (!aptOutput.empty())
-        {
-            Log_Info("\n\nadu-shell logs\n================\n\n%s", aptOutput.c_str());
-        }
+        aptExitCode = LaunchAduShell(config, args, aptOutput);
     }
     catch (const std::exception& de)
     {
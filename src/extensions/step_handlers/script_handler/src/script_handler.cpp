@@ -6,11 +6,11 @@
  * Licensed under the MIT License.
  */
 #include "aduc/script_handler.hpp"
+#include "aduc/adushell_broker_utils.hpp" // ADUC_LaunchAduShell
 #include "aduc/config_utils.h" // ADUC_ConfigInfo*
 #include "aduc/extension_manager.hpp"
 #include "aduc/logging.h"
 #include "aduc/parser_utils.h" // ADUC_FileEntity_Uninit
-#include "aduc/process_utils.hpp" // ADUC_LaunchChildProcess
 #include "aduc/string_c_utils.h" // IsNullOrEmpty
 #include "aduc/string_utils.hpp" // ADUC::StringUtils::Split
 #include "aduc/system_utils.h" // ADUC_SystemUtils_MkSandboxDirRecursive
@@ -31,6 +31,12 @@
 
 namespace adushconst = Adu::Shell::Const;
 
+/**
+ * @brief The most script output kept for ScriptHandler_PerformAction results. Every line is logged as it is written,
+ * so only the tail is needed to report what went wrong.
+ */
+static const size_t ScriptOutputMaxSizeInBytes = 64 * 1024;
+
 EXTERN_C_BEGIN
 
 extern ExtensionManager_Download_Options Default_ExtensionManager_Download_Options;
@@ -648,11 +654,13 @@ ScriptHandler_PerformAction(const std::string& action, const tagADUC_WorkflowDat
         goto done;
     }
 
-    exitCode = ADUC_LaunchChildProcess(config->aduShellFilePath, aduShellArgs, results.scriptOutput);
-
-    if (!results.scriptOutput.empty())
     {
-        Log_Info(results.scriptOutput.c_str());
+        ADUC_ChildProcessOptions options;
+        options.outputLineSink = [](const std::string& line) { Log_Info("%s", line.c_str()); };
+        options.errorLineSink = options.outputLineSink;
+        options.maxOutputSizeInBytes = ScriptOutputMaxSizeInBytes;
+
+        exitCode = ADUC_LaunchAduShell(config, aduShellArgs, options, results.scriptOutput);
     }
 
     if (exitCode != 0)
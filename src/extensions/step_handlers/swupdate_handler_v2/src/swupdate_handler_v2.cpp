@@ -17,6 +17,7 @@
 #include "aduc/extension_manager.hpp"
 #include "aduc/logging.h"
 #include "aduc/parser_utils.h" // ADUC_FileEntity_Uninit
+#include "aduc/adushell_broker_utils.hpp"
 #include "aduc/process_utils.hpp"
 #include "aduc/string_c_utils.h"
 #include "aduc/string_utils.hpp"
@@ -40,6 +41,11 @@
 
 namespace adushconst = Adu::Shell::Const;
 
+/**
+ * @brief The most adu-shell output kept in memory. Every line is logged as it is written, so only the tail is needed.
+ */
+static const size_t AduShellOutputMaxSizeInBytes = 64 * 1024;
+
 struct JSONValueDeleter
 {
     void operator()(JSON_Value* value)
@@ -249,7 +255,15 @@ ADUC_Result SWUpdateHandler_PerformAction(
         goto done;
     }
 
-    exitCode = ADUC_LaunchChildProcess(config->aduShellFilePath, aduShellArgs, scriptOutput);
+    {
+        ADUC_ChildProcessOptions options;
+        options.outputLineSink = [](const std::string& line) { Log_Info("%s", line.c_str()); };
+        options.errorLineSink = options.outputLineSink;
+        options.maxOutputSizeInBytes = AduShellOutputMaxSizeInBytes;
+
+        exitCode = ADUC_LaunchAduShell(config, aduShellArgs, options, scriptOutput);
+    }
+
     if (exitCode != 0)
     {
         int extendedCode = ADUC_ERC_SWUPDATE_HANDLER_CHILD_FAILURE_PROCESS_EXITCODE(exitCode);
@@ -258,11 +272,6 @@ ADUC_Result SWUpdateHandler_PerformAction(
         result.ExtendedResultCode = extendedCode;
     }
 
-    if (!scriptOutput.empty())
-    {
-        Log_Info(scriptOutput.c_str());
-    }
-
     // Parse result file.
     actionResultValue = json_parse_file(scriptResultFile.c_str());
 
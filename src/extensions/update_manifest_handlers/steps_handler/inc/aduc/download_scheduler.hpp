@@ -0,0 +1,175 @@
+/**
+ * @file download_scheduler.hpp
+ * @brief Defines a scheduler that runs the independent download jobs of a workflow tree in parallel.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_DOWNLOAD_SCHEDULER_HPP
+#define ADUC_DOWNLOAD_SCHEDULER_HPP
+
+#include <aduc/result.h> // ADUC_Result
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ADUC
+{
+/**
+ * @brief The default maximum number of download jobs in flight for the steps of an update, unless their handlers allow
+ * more with the 'maxConcurrentDownloads' handler property.
+ */
+const unsigned int DownloadScheduler_DefaultMaxConcurrentDownloads = 1;
+
+/**
+ * @brief The maximum number of download jobs in flight across the process when du-config.json does not set
+ * maxConcurrentDownloads.
+ */
+const unsigned int DownloadScheduler_MaxConcurrentDownloadsLimit = 4;
+
+/**
+ * @brief Bounds the number of download jobs in flight across every DownloadBatch of the process.
+ * @details Batches can be nested (a reference step downloads its own steps while its siblings are downloading),
+ * so the bound is process-wide rather than per batch. Only jobs hold a slot, never a thread waiting for a batch,
+ * so nested batches cannot deadlock.
+ */
+class DownloadScheduler
+{
+public:
+    /**
+     * @brief Gets the process-wide scheduler.
+     * @details The maximum concurrency is read from the maxConcurrentDownloads setting of du-config.json on first use.
+     * It caps what the handler properties of the steps allow.
+     *
+     * @return DownloadScheduler& The scheduler.
+     */
+    static DownloadScheduler& GetInstance();
+
+    explicit DownloadScheduler(unsigned int maxConcurrency) : _maxConcurrency{ maxConcurrency == 0 ? 1 : maxConcurrency }
+    {
+    }
+
+    DownloadScheduler(const DownloadScheduler&) = delete;
+    DownloadScheduler& operator=(const DownloadScheduler&) = delete;
+    DownloadScheduler(DownloadScheduler&&) = delete;
+    DownloadScheduler& operator=(DownloadScheduler&&) = delete;
+    ~DownloadScheduler() = default;
+
+    unsigned int GetMaxConcurrency() const
+    {
+        return _maxConcurrency;
+    }
+
+    /**
+     * @brief Blocks until fewer than the maximum concurrency jobs are in flight, then takes a slot.
+     */
+    void AcquireSlot();
+
+    /**
+     * @brief Releases a slot taken by AcquireSlot.
+     */
+    void ReleaseSlot();
+
+private:
+    const unsigned int _maxConcurrency;
+    unsigned int _inFlight{ 0 };
+    std::mutex _mutex;
+    std::condition_variable _slotReleased;
+};
+
+/**
+ * @brief A set of download jobs whose results are collected in the order the jobs were added.
+ * @details Pooled jobs run on worker threads of the batch, bounded by the DownloadScheduler and by the maximum
+ * concurrency of the batch. Caller jobs run on the thread that calls Wait(), in order, while the pooled jobs are
+ * running; use them for jobs that start batches of their own. When either allows a single job in flight, every job
+ * runs on the calling thread in the order added, which is the same as downloading sequentially.
+ *
+ * Once a job fails, or the stop predicate returns true, jobs that have not started yet are not run.
+ */
+class DownloadBatch
+{
+public:
+    /**
+     * @brief A download job. It must not throw.
+     */
+    using Job = std::function<ADUC_Result()>;
+
+    /**
+     * @brief The outcome of a job.
+     */
+    struct Outcome
+    {
+        bool ran{ false }; /**< Whether the job ran. */
+        ADUC_Result result{}; /**< The result of the job, if it ran. */
+    };
+
+    /**
+     * @brief Constructs a batch.
+     *
+     * @param scheduler The scheduler that bounds the jobs in flight.
+     * @param shouldStop Called before each job starts. Returns true if the remaining jobs should not run, e.g. when
+     * the workflow was cancelled. May be called from worker threads.
+     * @param maxConcurrency The most pooled jobs of this batch in flight at the same time.
+     */
+    DownloadBatch(DownloadScheduler& scheduler, std::function<bool()> shouldStop, unsigned int maxConcurrency);
+
+    DownloadBatch(const DownloadBatch&) = delete;
+    DownloadBatch& operator=(const DownloadBatch&) = delete;
+    DownloadBatch(DownloadBatch&&) = delete;
+    DownloadBatch& operator=(DownloadBatch&&) = delete;
+
+    /**
+     * @brief Waits for the jobs that are in flight.
+     */
+    ~DownloadBatch();
+
+    /**
+     * @brief Adds a job that runs on a worker thread.
+     *
+     * @param job The job.
+     */
+    void AddPooledJob(Job job);
+
+    /**
+     * @brief Adds a job that runs on the thread that calls Wait().
+     *
+     * @param job The job.
+     */
+    void AddCallerJob(Job job);
+
+    /**
+     * @brief Starts the pooled jobs, runs the caller jobs, and waits for every job to finish.
+     *
+     * @return const std::vector<Outcome>& The outcome of every job, in the order the jobs were added.
+     */
+    const std::vector<Outcome>& Wait();
+
+private:
+    struct Entry
+    {
+        Job job;
+        bool pooled;
+    };
+
+    void RunEntry(size_t index);
+    void WorkerLoop();
+    void JoinWorkers();
+
+    DownloadScheduler& _scheduler;
+    std::function<bool()> _shouldStop;
+    const unsigned int _maxConcurrency;
+    std::vector<Entry> _entries;
+    std::vector<size_t> _pooledIndices;
+    std::vector<Outcome> _outcomes;
+    std::vector<std::thread> _workers;
+    std::atomic<size_t> _nextPooled{ 0 };
+    std::atomic<bool> _stopped{ false };
+};
+
+} // namespace ADUC
+
+#endif // ADUC_DOWNLOAD_SCHEDULER_HPP
@@ -0,0 +1,206 @@
+/**
+ * @file download_scheduler.cpp
+ * @brief Implementation of the scheduler that runs the independent download jobs of a workflow tree in parallel.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/download_scheduler.hpp"
+
+#include "aduc/config_utils.h" // ADUC_ConfigInfo_GetInstance
+#include "aduc/logging.h"
+
+#include <algorithm> // std::min
+#include <system_error>
+
+// keep this last to avoid interfering with system headers
+#include "aduc/aduc_banned.h"
+
+namespace ADUC
+{
+/**
+ * @brief Reads the maximum number of concurrent downloads from du-config.json.
+ *
+ * @return unsigned int The configured value, or the limit when it is not configured.
+ */
+static unsigned int GetConfiguredMaxConcurrentDownloads()
+{
+    unsigned int maxConcurrentDownloads = DownloadScheduler_MaxConcurrentDownloadsLimit;
+    const ADUC_ConfigInfo* config = ADUC_ConfigInfo_GetInstance();
+
+    if (config != nullptr)
+    {
+        if (config->maxConcurrentDownloads != 0)
+        {
+            maxConcurrentDownloads = config->maxConcurrentDownloads;
+        }
+        ADUC_ConfigInfo_ReleaseInstance(config);
+    }
+
+    Log_Info("Downloading up to %u update payloads in parallel, for the steps that allow it.", maxConcurrentDownloads);
+    return maxConcurrentDownloads;
+}
+
+// static
+DownloadScheduler& DownloadScheduler::GetInstance()
+{
+    static DownloadScheduler s_instance{ GetConfiguredMaxConcurrentDownloads() };
+    return s_instance;
+}
+
+void DownloadScheduler::AcquireSlot()
+{
+    std::unique_lock<std::mutex> lock{ _mutex };
+    _slotReleased.wait(lock, [this]() { return _inFlight < _maxConcurrency; });
+    ++_inFlight;
+}
+
+void DownloadScheduler::ReleaseSlot()
+{
+    {
+        std::lock_guard<std::mutex> lock{ _mutex };
+        --_inFlight;
+    }
+    _slotReleased.notify_one();
+}
+
+DownloadBatch::DownloadBatch(
+    DownloadScheduler& scheduler, std::function<bool()> shouldStop, unsigned int maxConcurrency)
+    : _scheduler{ scheduler }, _shouldStop{ std::move(shouldStop) }, _maxConcurrency{ maxConcurrency }
+{
+}
+
+DownloadBatch::~DownloadBatch()
+{
+    _stopped = true;
+    JoinWorkers();
+}
+
+void DownloadBatch::AddPooledJob(Job job)
+{
+    _pooledIndices.push_back(_entries.size());
+    _entries.push_back(Entry{ std::move(job), true });
+}
+
+void DownloadBatch::AddCallerJob(Job job)
+{
+    _entries.push_back(Entry{ std::move(job), false });
+}
+
+void DownloadBatch::RunEntry(size_t index)
+{
+    Entry& entry = _entries[index];
+
+    if (_stopped || (_shouldStop && _shouldStop()))
+    {
+        _stopped = true;
+        return;
+    }
+
+    // Caller jobs start batches of their own, so they must not hold a slot while waiting for them.
+    if (entry.pooled)
+    {
+        _scheduler.AcquireSlot();
+
+        // Another job may have failed while this one waited for a slot.
+        if (_stopped || (_shouldStop && _shouldStop()))
+        {
+            _stopped = true;
+            _scheduler.ReleaseSlot();
+            return;
+        }
+    }
+
+    ADUC_Result result{ ADUC_GeneralResult_Failure, 0 };
+    try
+    {
+        result = entry.job();
+    }
+    catch (...)
+    {
+        Log_Error("Unexpected exception from download job #%lu.", index);
+    }
+
+    if (entry.pooled)
+    {
+        _scheduler.ReleaseSlot();
+    }
+
+    _outcomes[index].ran = true;
+    _outcomes[index].result = result;
+
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        _stopped = true;
+    }
+}
+
+void DownloadBatch::WorkerLoop()
+{
+    for (size_t next = _nextPooled++; next < _pooledIndices.size(); next = _nextPooled++)
+    {
+        RunEntry(_pooledIndices[next]);
+    }
+}
+
+void DownloadBatch::JoinWorkers()
+{
+    for (std::thread& worker : _workers)
+    {
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+    }
+    _workers.clear();
+}
+
+const std::vector<DownloadBatch::Outcome>& DownloadBatch::Wait()
+{
+    _outcomes.assign(_entries.size(), Outcome{});
+
+    const unsigned int maxConcurrency = std::min(_scheduler.GetMaxConcurrency(), _maxConcurrency);
+    if (maxConcurrency <= 1)
+    {
+        // Sequential: run every job in the order it was added.
+        for (size_t i = 0; i < _entries.size(); ++i)
+        {
+            RunEntry(i);
+        }
+        return _outcomes;
+    }
+
+    const size_t workerCount = std::min<size_t>(maxConcurrency, _pooledIndices.size());
+    for (size_t i = 0; i < workerCount; ++i)
+    {
+        try
+        {
+            _workers.emplace_back(&DownloadBatch::WorkerLoop, this);
+        }
+        catch (const std::system_error& e)
+        {
+            Log_Warn("Cannot start download worker thread #%lu: %s", i, e.what());
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < _entries.size(); ++i)
+    {
+        if (!_entries[i].pooled)
+        {
+            RunEntry(i);
+        }
+    }
+
+    // Run the pooled jobs here if no worker thread could be created. Otherwise the worker threads run every one of
+    // them, so that no more than the maximum concurrency are in flight.
+    if (_workers.empty())
+    {
+        WorkerLoop();
+    }
+
+    JoinWorkers();
+    return _outcomes;
+}
+
+} // namespace ADUC
@@ -9,6 +9,7 @@
 
 #include "aduc/calloc_wrapper.hpp" // cstr_wrapper
 #include "aduc/component_enumerator_extension.hpp"
+#include "aduc/download_scheduler.hpp"
 #include "aduc/extension_manager.hpp"
 #include "aduc/extension_manager_download_options.h"
 #include "aduc/logging.h"
@@ -18,11 +19,13 @@
 #include "aduc/system_utils.h"
 #include "aduc/workflow_utils.h"
 
+#include <atomic>
 #include <azure_c_shared_utility/crt_abstractions.h> // mallocAndStrcpy
 #include <azure_c_shared_utility/strings.h> // STRING_*
 #include <parson.h>
 #include <sstream>
 #include <string>
+#include <vector>
 
 // keep this last to avoid interfering with system headers
 #include "aduc/aduc_banned.h"
@@ -31,6 +34,23 @@ using ADUC::StringUtils::cstr_wrapper;
 
 #define DEFAULT_REF_STEP_HANDLER "microsoft/steps:1"
 
+/**
+ * @brief The handler property with which a step allows installing it on several selected components concurrently.
+ * e.g. "maxConcurrentComponents": "8"
+ */
+#define STEP_HANDLER_PROPERTY_MAX_CONCURRENT_COMPONENTS "maxConcurrentComponents"
+
+/**
+ * @brief The handler property with which a step allows downloading it concurrently with the other steps.
+ * e.g. "maxConcurrentDownloads": "4"
+ */
+#define STEP_HANDLER_PROPERTY_MAX_CONCURRENT_DOWNLOADS "maxConcurrentDownloads"
+
+/**
+ * @brief The most components installed concurrently, whatever the steps allow.
+ */
+static const unsigned int StepsHandler_MaxConcurrentComponentsLimit = 32;
+
 EXTERN_C_BEGIN
 extern ExtensionManager_Download_Options Default_ExtensionManager_Download_Options;
 EXTERN_C_END
@@ -125,8 +145,8 @@ ADUC_Result PrepareStepsWorkflowDataObject(ADUC_WorkflowHandle handle)
                 {
                     workflow_set_step_index(childHandle, i);
 
-                    // Inherit parent's selected components.
-                    workflow_set_selected_components(childHandle, workflow_peek_selected_components(handle));
+                    // Inherit parent's selected components, sharing them rather than copying.
+                    workflow_set_selected_component_set(childHandle, workflow_peek_selected_component_set(handle));
                 }
             }
             else
@@ -194,7 +214,6 @@ ADUC_Result PrepareStepsWorkflowDataObject(ADUC_WorkflowHandle handle)
                         ADUC::StringUtils::cstr_wrapper compatibilityString{
                             workflow_get_update_manifest_compatibility(childHandle, 0)
                         };
-                        JSON_Value* compsValue = nullptr;
                         if (compatibilityString.get() == nullptr)
                         {
                             Log_Error("Cannot get compatibility info for components-update #%lu", i);
@@ -212,9 +231,6 @@ ADUC_Result PrepareStepsWorkflowDataObject(ADUC_WorkflowHandle handle)
                             goto done;
                         }
 
-                        compsValue = json_parse_string(output.c_str());
-                        json_value_free(compsValue);
-
                         if (!workflow_set_selected_components(childHandle, output.c_str()))
                         {
                             result.ResultCode = ADUC_Result_Failure;
@@ -284,74 +300,42 @@ ContentHandler* StepsHandlerImpl::CreateContentHandler()
 }
 
 /**
- * @brief Return a json string containing a 'components' array with one component.
- *
- * @param components The source components array.
- * @param index Index of the component to be returned.
- * @return char* Returns nullptr if @p index is invalid.
- *         Otherwise, return a json string containing serialized 'components' data.
- */
-static char* CreateComponentSerializedString(JSON_Array* components, size_t index)
-{
-    JSON_Value* val = json_array_get_value(components, index);
-    if (val == nullptr)
-    {
-        return nullptr;
-    }
-
-    JSON_Value* root = json_value_init_object();
-    JSON_Value* componentClone = json_value_deep_copy(val);
-    JSON_Array* array = json_array(json_value_init_array());
-    json_array_append_value(array, componentClone);
-    json_object_set_value(json_object(root), "components", json_array_get_wrapping_value(array));
-    return json_serialize_to_string_pretty(root);
-}
-
-/**
- * @brief Get a list of selected components for specified workflow @p handle.
+ * @brief Get the set of selected components for specified workflow @p handle.
  *
  * @param handle A workflow data object handle.
- * @param componentsArray Array of selected components.
+ * @param componentSet The set of selected components, borrowed from the workflow.
  * @return ADUC_Result Returns ADUC_Result_Success is succeeded.
  *         Otherwise, returns ADUC_ERC_STEPS_HANDLER_INVALID_COMPONENTS_DATA.
  */
-static ADUC_Result GetSelectedComponentsArray(ADUC_WorkflowHandle handle, JSON_Array** componentsArray)
+static ADUC_Result GetSelectedComponentSet(ADUC_WorkflowHandle handle, ADUC_ComponentSet** componentSet)
 {
     ADUC_Result result = { ADUC_Result_Failure };
-    JSON_Value* rootValue = nullptr;
-    JSON_Object* rootObject = nullptr;
+    ADUC_ComponentSet* selectedComponents = nullptr;
 
-    if (componentsArray == nullptr)
+    if (componentSet == nullptr)
     {
-        workflow_set_result_details(handle, "Invalid parameter - componentsArray");
+        workflow_set_result_details(handle, "Invalid parameter - componentSet");
         return result;
     }
 
-    *componentsArray = nullptr;
+    *componentSet = nullptr;
 
-    // Parse components list. If the list is empty, nothing to install.
-    const char* selectedComponents = workflow_peek_selected_components(handle);
-    if (IsNullOrEmpty(selectedComponents))
+    // The components were parsed at most once, when first selected. If the list is empty, nothing to install.
+    selectedComponents = workflow_peek_selected_component_set(handle);
+    if (IsNullOrEmpty(ADUC_ComponentSet_PeekString(selectedComponents)))
     {
         result.ResultCode = ADUC_Result_Failure;
         result.ExtendedResultCode = 0;
         goto done;
     }
 
-    rootValue = json_parse_string(selectedComponents);
-    if (rootValue == nullptr)
+    if (!ADUC_ComponentSet_IsValid(selectedComponents))
     {
         result.ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_INVALID_COMPONENTS_DATA;
         goto done;
     }
 
-    rootObject = json_object(rootValue);
-    *componentsArray = json_object_get_array(rootObject, "components");
-    if (*componentsArray == nullptr)
-    {
-        result.ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_INVALID_COMPONENTS_DATA;
-        goto done;
-    }
+    *componentSet = selectedComponents;
 
     result.ResultCode = ADUC_Result_Success;
     result.ExtendedResultCode = 0;
@@ -360,11 +344,18 @@ done:
     return result;
 }
 
-static ADUC_Result DoV1DownloadWork(
-    ADUC_WorkflowData* stepWorkflow,
-    ContentHandler* contentHandler,
-    ADUC_WorkflowHandle handle,
-    ADUC_WorkflowHandle stepHandle)
+/**
+ * @brief Downloads the payloads of a step, unless the step is already installed.
+ * @details This runs on a download worker thread, so it only updates the step's workflow.
+ * The parent workflow is updated by AggregateStepsDownloadOutcomes once every step is done.
+ *
+ * @param stepWorkflow A wrapper workflow that holds @p stepHandle.
+ * @param contentHandler The step's handler.
+ * @param stepHandle The step's workflow handle.
+ * @return ADUC_Result The result.
+ */
+static ADUC_Result
+DoV1DownloadWork(ADUC_WorkflowData* stepWorkflow, ContentHandler* contentHandler, ADUC_WorkflowHandle stepHandle)
 {
     ADUC_Result result{};
 
@@ -385,7 +376,6 @@ static ADUC_Result DoV1DownloadWork(
         result.ResultCode = ADUC_Result_Install_Skipped_UpdateAlreadyInstalled;
         result.ExtendedResultCode = 0;
         workflow_set_result(stepHandle, result);
-        workflow_set_result_details(handle, workflow_peek_result_details(stepHandle));
         // The current instance is already up-to-date, continue checking the next instance.
     }
     else
@@ -400,12 +390,75 @@ static ADUC_Result DoV1DownloadWork(
             result.ResultCode = ADUC_Result_Failure;
             result.ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_DOWNLOAD_UNKNOWN_EXCEPTION_DOWNLOAD_CONTENT;
         }
+    }
 
-        if (IsAducResultCodeFailure(result.ResultCode))
+    return result;
+}
+
+/**
+ * @brief Aggregates the download outcome of every step into the parent workflow.
+ * @details The result is the result of the first failed step, in step order, so that it does not depend on the
+ * order in which parallel downloads finished. The ERC of every failed step is added to the parent workflow.
+ *
+ * @param handle The parent workflow handle.
+ * @param outcomes The download outcome of each step, indexed by step.
+ * @return ADUC_Result ADUC_Result_Download_Success if every step was downloaded or already installed,
+ * ADUC_Result_Failure_Cancelled if some steps were not downloaded because the workflow was cancelled,
+ * otherwise the result of the first failed step.
+ */
+static ADUC_Result
+AggregateStepsDownloadOutcomes(ADUC_WorkflowHandle handle, const std::vector<ADUC::DownloadBatch::Outcome>& outcomes)
+{
+    ADUC_Result result{ ADUC_Result_Download_Success, 0 };
+    bool isFailureSet = false;
+    bool isAnyStepNotRun = false;
+
+    for (size_t i = 0; i < outcomes.size(); i++)
+    {
+        const ADUC::DownloadBatch::Outcome& outcome = outcomes[i];
+        ADUC_WorkflowHandle stepHandle = workflow_get_child(handle, i);
+
+        if (!outcome.ran)
         {
-            // Propagate item's resultDetails to parent.
-            workflow_set_result_details(handle, workflow_peek_result_details(stepHandle));
+            isAnyStepNotRun = true;
+            continue;
         }
+
+        if (outcome.result.ResultCode == ADUC_Result_Install_Skipped_UpdateAlreadyInstalled)
+        {
+            if (!isFailureSet)
+            {
+                workflow_set_result_details(handle, workflow_peek_result_details(stepHandle));
+            }
+            continue;
+        }
+
+        if (IsAducResultCodeFailure(outcome.result.ResultCode))
+        {
+            Log_Error(
+                "Download of step #%lu failed (rc:%d, erc:0x%X)",
+                i,
+                outcome.result.ResultCode,
+                outcome.result.ExtendedResultCode);
+
+            if (outcome.result.ExtendedResultCode != 0)
+            {
+                workflow_add_erc(handle, outcome.result.ExtendedResultCode);
+            }
+
+            if (!isFailureSet)
+            {
+                // Propagate item's resultDetails to parent.
+                workflow_set_result_details(handle, workflow_peek_result_details(stepHandle));
+                result = outcome.result;
+                isFailureSet = true;
+            }
+        }
+    }
+
+    if (!isFailureSet && isAnyStepNotRun)
+    {
+        result = { ADUC_Result_Failure_Cancelled, 0 };
     }
 
     return result;
@@ -431,7 +484,7 @@ static ADUC_Result HandleComponents(
     int workflowStep,
     bool isComponentsEnumeratorRegistered,
     ADUC_WorkflowHandle handle,
-    JSON_Array* selectedComponentsArray,
+    ADUC_ComponentSet** selectedComponents,
     int* selectedComponentsCount)
 {
     ADUC_Result result{ ADUC_GeneralResult_Failure, 0 };
@@ -446,7 +499,7 @@ static ADUC_Result HandleComponents(
     else
     {
         // This is a reference step (workflowLevel == 1), this intended for one or more components.
-        result = GetSelectedComponentsArray(handle, &selectedComponentsArray);
+        result = GetSelectedComponentSet(handle, selectedComponents);
         if (IsAducResultCodeFailure(result.ResultCode))
         {
             const char* fmt = "Missing selected components. workflow level %d, step %d";
@@ -455,7 +508,7 @@ static ADUC_Result HandleComponents(
             goto done;
         }
 
-        *selectedComponentsCount = static_cast<int>(json_array_get_count(selectedComponentsArray));
+        *selectedComponentsCount = static_cast<int>(ADUC_ComponentSet_GetCount(*selectedComponents));
 
         if (*selectedComponentsCount == 0)
         {
@@ -484,6 +537,47 @@ done:
     return result;
 }
 
+/**
+ * @brief Gets how many inline steps of @p handle may be downloaded concurrently.
+ * @details Their handlers' IsInstalled and Download then run at the same time on worker threads, so every inline step
+ * must allow it with the 'maxConcurrentDownloads' handler property. The smallest value is used. Reference steps are
+ * downloaded on the calling thread, and the steps of their child update are bounded by their own handler properties.
+ *
+ * @param handle The workflow handle of an update.
+ * @return unsigned int The number of inline steps to download concurrently, or 1 to download them one at a time.
+ */
+static unsigned int GetMaxConcurrentDownloads(ADUC_WorkflowHandle handle)
+{
+    unsigned int maxConcurrentDownloads = 0;
+    size_t stepsCount = workflow_get_children_count(handle);
+
+    for (size_t i = 0; i < stepsCount; i++)
+    {
+        unsigned int stepMaxConcurrentDownloads = 0;
+
+        if (!workflow_is_inline_step(handle, i))
+        {
+            continue;
+        }
+
+        const char* value = workflow_peek_update_manifest_handler_properties_string(
+            workflow_get_child(handle, i), STEP_HANDLER_PROPERTY_MAX_CONCURRENT_DOWNLOADS);
+
+        if (value == nullptr || !atoui(value, &stepMaxConcurrentDownloads) || stepMaxConcurrentDownloads <= 1)
+        {
+            return ADUC::DownloadScheduler_DefaultMaxConcurrentDownloads;
+        }
+
+        if (maxConcurrentDownloads == 0 || stepMaxConcurrentDownloads < maxConcurrentDownloads)
+        {
+            maxConcurrentDownloads = stepMaxConcurrentDownloads;
+        }
+    }
+
+    return maxConcurrentDownloads == 0 ? ADUC::DownloadScheduler_DefaultMaxConcurrentDownloads
+                                       : maxConcurrentDownloads;
+}
+
 /**
  * @brief Performs 'Download' task by iterating through all steps and invoke each step's handler
  * to download file(s), if needed.
@@ -504,13 +598,14 @@ static ADUC_Result StepsHandler_Download(const tagADUC_WorkflowData* workflowDat
     ADUC_WorkflowHandle handle = workflowData->WorkflowHandle;
     ADUC_WorkflowHandle stepHandle = nullptr;
     char* workFolder = workflow_get_workfolder(handle);
-    JSON_Array* selectedComponentsArray = nullptr;
+    ADUC_ComponentSet* selectedComponents = nullptr;
     int workflowLevel = workflow_get_level(handle);
     int workflowStep = workflow_get_step_index(handle);
     int selectedComponentsCount = 0;
-    char* serializedComponentString = nullptr;
+    ADUC_ComponentSet* component = nullptr;
     bool isComponentsEnumeratorRegistered = ExtensionManager::IsComponentsEnumeratorRegistered();
     int createResult = 0;
+    unsigned int maxConcurrentDownloads = ADUC::DownloadScheduler_DefaultMaxConcurrentDownloads;
 
     if (workflow_is_cancel_requested(handle))
     {
@@ -546,7 +641,7 @@ static ADUC_Result StepsHandler_Download(const tagADUC_WorkflowData* workflowDat
         workflowStep,
         isComponentsEnumeratorRegistered,
         handle,
-        selectedComponentsArray,
+        &selectedComponents,
         &selectedComponentsCount);
 
     if (IsAducResultCodeFailure(result.ResultCode))
@@ -554,15 +649,23 @@ static ADUC_Result StepsHandler_Download(const tagADUC_WorkflowData* workflowDat
         goto done;
     }
 
-    // For each selected component, perform step's backup, install & apply phase, restore phase if needed, in order.
+    maxConcurrentDownloads = GetMaxConcurrentDownloads(handle);
+
+    // For each selected component, download every step's payloads.
     for (size_t iCom = 0, stepsCount = workflow_get_children_count(handle); iCom < selectedComponentsCount; iCom++)
     {
-        serializedComponentString = CreateComponentSerializedString(selectedComponentsArray, iCom);
+        component = ADUC_ComponentSet_CreateSingle(selectedComponents, iCom);
+
+        // Steps do not depend on each other's payloads, so the downloads of steps that allow it run in parallel,
+        // bounded by the process-wide scheduler. A reference step runs on this thread, because it downloads its own
+        // steps through the same scheduler. Downloads that have not started yet are skipped once a step fails or the
+        // workflow is cancelled.
+        ADUC::DownloadBatch batch{ ADUC::DownloadScheduler::GetInstance(),
+                                   [handle]() {
+                                       return workflow_get_operation_cancel_requested(workflow_get_root(handle));
+                                   },
+                                   maxConcurrentDownloads };
 
-        //
-        // For each step (child workflow), invoke backup, install and apply actions.
-        // if install or apply fails, invoke restore action.
-        //
         for (size_t i = 0; i < stepsCount; i++)
         {
             if (IsStepsHandlerExtraDebugLogsEnabled())
@@ -571,12 +674,9 @@ static ADUC_Result StepsHandler_Download(const tagADUC_WorkflowData* workflowDat
                     "Perform download action of child step #%lu on component #%d.\n#### Component ####\n%s\n###################\n",
                     i,
                     iCom,
-                    serializedComponentString);
+                    ADUC_ComponentSet_PeekString(component));
             }
 
-            // Use a wrapper workflow to hold a stepHandle.
-            ADUC_WorkflowData stepWorkflow = {};
-
             stepHandle = workflow_get_child(handle, i);
             if (stepHandle == nullptr)
             {
@@ -586,12 +686,11 @@ static ADUC_Result StepsHandler_Download(const tagADUC_WorkflowData* workflowDat
                 workflow_set_result_details(handle, errorFmt, i);
                 goto done;
             }
-            stepWorkflow.WorkflowHandle = stepHandle;
 
             // For inline step - set current component info on the workflow.
-            if (serializedComponentString != nullptr && workflow_is_inline_step(handle, i))
+            if (component != nullptr && workflow_is_inline_step(handle, i))
             {
-                if (!workflow_set_selected_components(stepHandle, serializedComponentString))
+                if (!workflow_set_selected_component_set(stepHandle, component))
                 {
                     result.ResultCode = ADUC_Result_Failure;
                     result.ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_SET_SELECTED_COMPONENTS_FAILURE;
@@ -619,45 +718,40 @@ static ADUC_Result StepsHandler_Download(const tagADUC_WorkflowData* workflowDat
             }
 
             ADUC_ExtensionContractInfo contractInfo = contentHandler->GetContractInfo();
-            if (ADUC_ContractUtils_IsV1Contract(&contractInfo))
+            if (!ADUC_ContractUtils_IsV1Contract(&contractInfo))
             {
-                result = DoV1DownloadWork(&stepWorkflow, contentHandler, handle, stepHandle);
+                result = handleUnsupportedContractVersion(&contractInfo, stepUpdateType, handle);
+                goto done;
+            }
 
-                if (IsAducResultCodeFailure(result.ResultCode))
-                {
-                    goto done;
-                }
+            ADUC::DownloadBatch::Job job = [contentHandler, stepHandle]() {
+                // Use a wrapper workflow to hold a stepHandle.
+                ADUC_WorkflowData stepWorkflow = {};
+                stepWorkflow.WorkflowHandle = stepHandle;
+                return DoV1DownloadWork(&stepWorkflow, contentHandler, stepHandle);
+            };
 
-                if (result.ResultCode == ADUC_Result_Install_Skipped_UpdateAlreadyInstalled)
-                {
-                    goto instanceDone;
-                }
+            if (workflow_is_inline_step(handle, i))
+            {
+                batch.AddPooledJob(std::move(job));
             }
             else
             {
-                result = handleUnsupportedContractVersion(&contractInfo, stepUpdateType, handle);
-                goto done;
+                batch.AddCallerJob(std::move(job));
             }
+        } // steps loop
 
-        instanceDone:
-            stepHandle = nullptr;
+        stepHandle = nullptr;
 
-            if (IsAducResultCodeFailure(result.ResultCode))
-            {
-                goto componentDone;
-            }
-        } // instances loop
+        result = AggregateStepsDownloadOutcomes(handle, batch.Wait());
 
-    componentDone:
-        json_free_serialized_string(serializedComponentString);
-        serializedComponentString = nullptr;
+        ADUC_ComponentSet_Release(component);
+        component = nullptr;
 
         if (IsAducResultCodeFailure(result.ResultCode))
         {
             goto done;
         }
-
-        // Set step's result.
     }
 
     result.ResultCode = ADUC_Result_Download_Success;
@@ -682,7 +776,7 @@ done:
         workflow_set_state(handle, ADUCITF_State_Failed);
     }
 
-    json_free_serialized_string(serializedComponentString);
+    ADUC_ComponentSet_Release(component);
     workflow_free_string(workFolder);
 
     Log_Debug("Steps_Handler Download end (level %d).", workflowLevel);
@@ -705,6 +799,432 @@ ADUC_Result StepsHandlerImpl::Download(const tagADUC_WorkflowData* workflowData)
     return StepsHandler_Download(workflowData);
 }
 
+/**
+ * @brief Gets how many selected components the steps of @p handle may be installed on concurrently.
+ * @details The steps of different components then run at the same time, through the same handlers, so every step
+ * must allow it with the 'maxConcurrentComponents' handler property. The smallest value is used.
+ *
+ * @param handle The workflow handle of a child update.
+ * @return unsigned int The number of components to install concurrently, or 1 to install them one at a time.
+ */
+static unsigned int GetMaxConcurrentComponents(ADUC_WorkflowHandle handle)
+{
+    unsigned int maxConcurrentComponents = StepsHandler_MaxConcurrentComponentsLimit;
+    size_t stepsCount = workflow_get_children_count(handle);
+
+    for (size_t i = 0; i < stepsCount; i++)
+    {
+        unsigned int stepMaxConcurrentComponents = 0;
+        const char* value = workflow_peek_update_manifest_handler_properties_string(
+            workflow_get_child(handle, i), STEP_HANDLER_PROPERTY_MAX_CONCURRENT_COMPONENTS);
+
+        if (!workflow_is_inline_step(handle, i) || value == nullptr || !atoui(value, &stepMaxConcurrentComponents)
+            || stepMaxConcurrentComponents <= 1)
+        {
+            return 1;
+        }
+
+        if (stepMaxConcurrentComponents < maxConcurrentComponents)
+        {
+            maxConcurrentComponents = stepMaxConcurrentComponents;
+        }
+    }
+
+    return stepsCount == 0 ? 1 : maxConcurrentComponents;
+}
+
+/**
+ * @brief The steps of one selected component, installed apart from the other components.
+ */
+struct ComponentSteps
+{
+    std::vector<ADUC_WorkflowHandle> stepHandles; /**< The component's own workflow for each step. */
+    size_t lastStep = 0; /**< The index of the last step that ran. */
+};
+
+/**
+ * @brief Performs the backup, install and apply actions of every step on one component, in order, the same way
+ * StepsHandler_Install does for each component.
+ * @details This runs on a worker thread, so it only updates the component's own step workflows. The parent workflow is
+ * updated by AggregateComponentsInstallOutcomes once every component is done.
+ *
+ * @param handle The parent workflow handle. Only used to check for cancellation.
+ * @param contentHandlers The handler of each step.
+ * @param component The component's steps.
+ * @return ADUC_Result The result of the last step that ran.
+ */
+static ADUC_Result InstallStepsOnComponent(
+    ADUC_WorkflowHandle handle, const std::vector<ContentHandler*>& contentHandlers, ComponentSteps* component)
+{
+    ADUC_Result result{ ADUC_Result_Install_Success, 0 };
+
+    for (size_t i = 0; i < component->stepHandles.size(); i++)
+    {
+        ADUC_WorkflowHandle stepHandle = component->stepHandles[i];
+        ContentHandler* contentHandler = contentHandlers[i];
+
+        // Use a wrapper workflow to hold a stepHandle.
+        ADUC_WorkflowData stepWorkflow = {};
+        stepWorkflow.WorkflowHandle = stepHandle;
+
+        if (workflow_get_operation_cancel_requested(workflow_get_root(handle)))
+        {
+            result = { ADUC_Result_Failure_Cancelled, 0 };
+            break;
+        }
+
+        component->lastStep = i;
+
+        // If this item is already installed, skip to the next one.
+        try
+        {
+            result = contentHandler->IsInstalled(&stepWorkflow);
+        }
+        catch (...)
+        {
+            result = { ADUC_Result_IsInstalled_NotInstalled, 0 };
+        }
+
+        if (result.ResultCode == ADUC_Result_IsInstalled_Installed)
+        {
+            result = { ADUC_Result_Install_Skipped_UpdateAlreadyInstalled, 0 };
+            workflow_set_result(stepHandle, result);
+            continue;
+        }
+
+        try
+        {
+            result = contentHandler->Backup(&stepWorkflow);
+        }
+        catch (...)
+        {
+            result = { ADUC_Result_Failure, ADUC_ERC_STEPS_HANDLER_INSTALL_UNKNOWN_EXCEPTION_BACKUP_CHILD_STEP };
+        }
+
+        if (IsAducResultCodeFailure(result.ResultCode))
+        {
+            break;
+        }
+
+        try
+        {
+            result = contentHandler->Install(&stepWorkflow);
+        }
+        catch (...)
+        {
+            Log_Error("The handler throws an exception inside Install().");
+            result = { ADUC_Result_Failure, ADUC_ERC_STEPS_HANDLER_INSTALL_UNKNOWN_EXCEPTION_INSTALL_CHILD_STEP };
+            break;
+        }
+
+        if (workflow_is_immediate_reboot_requested(stepHandle)
+            || workflow_is_immediate_agent_restart_requested(stepHandle))
+        {
+            break;
+        }
+
+        if (result.ResultCode != ADUC_Result_Install_Skipped_UpdateAlreadyInstalled
+            && result.ResultCode != ADUC_Result_Install_Skipped_NoMatchingComponents)
+        {
+            if (IsAducResultCodeFailure(result.ResultCode))
+            {
+                try
+                {
+                    contentHandler->Restore(&stepWorkflow);
+                }
+                catch (...)
+                {
+                    Log_Warn("Unexpected error happened during restore action.");
+                }
+                break;
+            }
+
+            try
+            {
+                result = contentHandler->Apply(&stepWorkflow);
+            }
+            catch (...)
+            {
+                Log_Error("The handler throws an exception inside Apply().");
+                result = { ADUC_Result_Failure, ADUC_ERC_STEPS_HANDLER_INSTALL_UNKNOWN_EXCEPTION_APPLY_CHILD_STEP };
+                break;
+            }
+
+            if (IsAducResultCodeFailure(result.ResultCode))
+            {
+                try
+                {
+                    Log_Info("Failed to install or apply. Try to restore now...");
+                    contentHandler->Restore(&stepWorkflow);
+                }
+                catch (...)
+                {
+                    Log_Warn("Unexpected error happened during restore action.");
+                    break;
+                }
+            }
+        }
+
+        // A reboot or an agent restart skips the component's remaining steps.
+        if (workflow_is_immediate_reboot_requested(stepHandle)
+            || workflow_is_immediate_agent_restart_requested(stepHandle) || workflow_is_reboot_requested(stepHandle)
+            || workflow_is_agent_restart_requested(stepHandle))
+        {
+            break;
+        }
+
+        workflow_set_result(stepHandle, result);
+
+        if (IsAducResultCodeFailure(result.ResultCode))
+        {
+            break;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief Aggregates the install outcome of every component into the parent workflow.
+ * @details Components are aggregated in component order, so that the outcome does not depend on the order in which
+ * they finished. The result is the result of the first component that failed or requested an immediate reboot or
+ * agent restart, and the parent's step workflows take that component's step results; otherwise they take the last
+ * component's. The ERC of every failed component, and the reboot and agent restart requests of every component, are
+ * added to the parent workflow.
+ *
+ * @param handle The parent workflow handle.
+ * @param components The steps of each component, indexed by component.
+ * @param outcomes The install outcome of each component, indexed by component.
+ * @return ADUC_Result ADUC_Result_Install_Success if every component was installed, ADUC_Result_Failure_Cancelled if
+ * some components were not installed because the workflow was cancelled, otherwise the result of the first component
+ * that failed or requested an immediate reboot or agent restart.
+ */
+static ADUC_Result AggregateComponentsInstallOutcomes(
+    ADUC_WorkflowHandle handle,
+    const std::vector<ComponentSteps>& components,
+    const std::vector<ADUC::DownloadBatch::Outcome>& outcomes)
+{
+    ADUC_Result result{ ADUC_Result_Install_Success, 0 };
+    const ComponentSteps* reportedComponent = nullptr;
+    bool isResultSet = false;
+    bool isAnyComponentNotRun = false;
+
+    for (size_t iCom = 0; iCom < outcomes.size(); iCom++)
+    {
+        const ADUC::DownloadBatch::Outcome& outcome = outcomes[iCom];
+        const ComponentSteps& component = components[iCom];
+        bool isImmediateRequested = false;
+
+        if (!outcome.ran)
+        {
+            isAnyComponentNotRun = true;
+            continue;
+        }
+
+        for (ADUC_WorkflowHandle stepHandle : component.stepHandles)
+        {
+            if (workflow_is_immediate_reboot_requested(stepHandle))
+            {
+                workflow_request_immediate_reboot(handle);
+                isImmediateRequested = true;
+            }
+
+            if (workflow_is_immediate_agent_restart_requested(stepHandle))
+            {
+                workflow_request_immediate_agent_restart(handle);
+                isImmediateRequested = true;
+            }
+
+            if (workflow_is_reboot_requested(stepHandle))
+            {
+                workflow_request_reboot(handle);
+            }
+
+            if (workflow_is_agent_restart_requested(stepHandle))
+            {
+                workflow_request_agent_restart(handle);
+            }
+        }
+
+        if (IsAducResultCodeFailure(outcome.result.ResultCode))
+        {
+            Log_Error(
+                "Install on component #%lu failed (rc:%d, erc:0x%X)",
+                iCom,
+                outcome.result.ResultCode,
+                outcome.result.ExtendedResultCode);
+
+            if (outcome.result.ExtendedResultCode != 0)
+            {
+                workflow_add_erc(handle, outcome.result.ExtendedResultCode);
+            }
+        }
+
+        if (isResultSet)
+        {
+            continue;
+        }
+
+        reportedComponent = &component;
+        ADUC_WorkflowHandle lastStepHandle = component.stepHandles[component.lastStep];
+
+        if (IsAducResultCodeFailure(outcome.result.ResultCode) || isImmediateRequested)
+        {
+            // Propagate item's resultDetails to parent.
+            workflow_set_result_details(handle, workflow_peek_result_details(lastStepHandle));
+            result = outcome.result;
+            isResultSet = true;
+        }
+        else if (outcome.result.ResultCode == ADUC_Result_Install_Skipped_UpdateAlreadyInstalled)
+        {
+            workflow_set_result_details(handle, workflow_peek_result_details(lastStepHandle));
+        }
+    }
+
+    if (reportedComponent != nullptr)
+    {
+        for (size_t i = 0; i < reportedComponent->stepHandles.size(); i++)
+        {
+            ADUC_WorkflowHandle stepHandle = workflow_get_child(handle, i);
+            workflow_set_result(stepHandle, workflow_get_result(reportedComponent->stepHandles[i]));
+            workflow_set_result_details(stepHandle, workflow_peek_result_details(reportedComponent->stepHandles[i]));
+        }
+    }
+
+    if (!isResultSet && isAnyComponentNotRun)
+    {
+        result = { ADUC_Result_Failure_Cancelled, 0 };
+    }
+
+    return result;
+}
+
+/**
+ * @brief Performs the backup, install and apply actions of every step on the selected components, installing up to
+ * @p maxConcurrentComponents components at the same time.
+ * @details Each component gets its own workflow for each step, so that the steps of different components do not share
+ * any state. The steps of a component run in order. Components that have not started yet are skipped once a component
+ * fails or requests an immediate reboot or agent restart, or the workflow is cancelled.
+ *
+ * @param handle The parent workflow handle.
+ * @param selectedComponents The selected components.
+ * @param selectedComponentsCount The number of selected components.
+ * @param maxConcurrentComponents The most components to install at the same time.
+ * @return ADUC_Result The install result.
+ */
+static ADUC_Result InstallComponentsConcurrently(
+    ADUC_WorkflowHandle handle,
+    ADUC_ComponentSet* selectedComponents,
+    size_t selectedComponentsCount,
+    unsigned int maxConcurrentComponents)
+{
+    ADUC_Result result{ ADUC_Result_Failure, 0 };
+    size_t stepsCount = workflow_get_children_count(handle);
+    std::vector<ContentHandler*> contentHandlers(stepsCount, nullptr);
+    std::vector<ComponentSteps> components(selectedComponentsCount);
+    std::atomic<bool> isImmediateRequested{ false };
+
+    Log_Info(
+        "Installing %lu step(s) on %lu component(s), up to %u component(s) at a time.",
+        stepsCount,
+        selectedComponentsCount,
+        maxConcurrentComponents);
+
+    // Load every handler before any component starts.
+    for (size_t i = 0; i < stepsCount; i++)
+    {
+        const char* stepUpdateType = workflow_peek_update_manifest_step_handler(handle, i);
+
+        Log_Info("Loading handler for child step #%lu (handler: '%s')", i, stepUpdateType);
+
+        result = ExtensionManager::LoadUpdateContentHandlerExtension(stepUpdateType, &contentHandlers[i]);
+
+        if (IsAducResultCodeFailure(result.ResultCode))
+        {
+            const char* errorFmt = "Cannot load a handler for step #%lu (handler :%s)";
+            Log_Error(errorFmt, i, stepUpdateType);
+            workflow_set_result(workflow_get_child(handle, i), result);
+            workflow_set_result_details(handle, errorFmt, i, stepUpdateType == nullptr ? "NULL" : stepUpdateType);
+            goto done;
+        }
+    }
+
+    for (size_t iCom = 0; iCom < selectedComponentsCount; iCom++)
+    {
+        ADUC_ComponentSet* component = ADUC_ComponentSet_CreateSingle(selectedComponents, iCom);
+
+        for (size_t i = 0; i < stepsCount; i++)
+        {
+            ADUC_WorkflowHandle stepHandle = nullptr;
+
+            result = workflow_create_detached_from_inline_step(handle, i, &stepHandle);
+            if (IsAducResultCodeFailure(result.ResultCode))
+            {
+                const char* errorFmt = "Cannot create workflow for step #%lu on component #%lu";
+                Log_Error(errorFmt, i, iCom);
+                workflow_set_result_details(handle, errorFmt, i, iCom);
+                ADUC_ComponentSet_Release(component);
+                goto done;
+            }
+
+            components[iCom].stepHandles.push_back(stepHandle);
+            workflow_set_step_index(stepHandle, i);
+            workflow_set_id(stepHandle, std::to_string(i).c_str());
+
+            if (!workflow_set_selected_component_set(stepHandle, component))
+            {
+                result = { ADUC_Result_Failure, ADUC_ERC_STEPS_HANDLER_SET_SELECTED_COMPONENTS_FAILURE };
+                workflow_set_result_details(handle, "Cannot set target component(s) for step #%lu", i);
+                ADUC_ComponentSet_Release(component);
+                goto done;
+            }
+        }
+
+        ADUC_ComponentSet_Release(component);
+    }
+
+    {
+        // The bound is only for this batch: the steps of the components do not download anything.
+        ADUC::DownloadScheduler scheduler{ maxConcurrentComponents };
+        ADUC::DownloadBatch batch{ scheduler,
+                                   [handle, &isImmediateRequested]() {
+                                       return isImmediateRequested
+                                           || workflow_get_operation_cancel_requested(workflow_get_root(handle));
+                                   },
+                                   maxConcurrentComponents };
+
+        for (ComponentSteps& component : components)
+        {
+            ComponentSteps* componentSteps = &component;
+            batch.AddPooledJob([handle, &contentHandlers, componentSteps, &isImmediateRequested]() {
+                ADUC_Result componentResult = InstallStepsOnComponent(handle, contentHandlers, componentSteps);
+
+                ADUC_WorkflowHandle lastStepHandle = componentSteps->stepHandles[componentSteps->lastStep];
+                if (workflow_is_immediate_reboot_requested(lastStepHandle)
+                    || workflow_is_immediate_agent_restart_requested(lastStepHandle))
+                {
+                    isImmediateRequested = true;
+                }
+
+                return componentResult;
+            });
+        }
+
+        result = AggregateComponentsInstallOutcomes(handle, components, batch.Wait());
+    }
+
+done:
+    for (ComponentSteps& component : components)
+    {
+        for (ADUC_WorkflowHandle stepHandle : component.stepHandles)
+        {
+            workflow_free(stepHandle);
+        }
+    }
+
+    return result;
+}
+
 /**
  * @brief Performs 'Install' phase.
  * All files required for installation must be downloaded in to sandbox.
@@ -729,6 +1249,8 @@ ADUC_Result StepsHandlerImpl::Download(const tagADUC_WorkflowData* workflowData)
  *              - If no components matched, the reference step are considered "optional".
  *                   - Install resultCode for optional step is ADUC_Result_Install_Skipped_NoMatchingComponents (604)
  *              - For each selected component [Process the step]
+ *                   (If every step allows it with the 'maxConcurrentComponents' handler property, components are
+ *                    processed concurrently, each with its own step workflows. See InstallComponentsConcurrently.)
  *                   - Load step handler
  *                   - Invoke contentHandler::Install
  *                      - If failed, return with 'Install' result.
@@ -755,13 +1277,14 @@ static ADUC_Result StepsHandler_Install(const tagADUC_WorkflowData* workflowData
 
     const char* workflowId = workflow_peek_id(handle);
     char* workFolder = workflow_get_workfolder(handle);
-    JSON_Array* selectedComponentsArray = nullptr;
+    ADUC_ComponentSet* selectedComponents = nullptr;
     int workflowLevel = workflow_get_level(handle);
     int workflowStep = workflow_get_step_index(handle);
     int selectedComponentsCount = 0;
-    char* serializedComponentString = nullptr;
+    ADUC_ComponentSet* component = nullptr;
     bool isComponentsEnumeratorRegistered = ExtensionManager::IsComponentsEnumeratorRegistered();
     int createResult = 0;
+    unsigned int maxConcurrentComponents = 1;
 
     if (workflow_is_cancel_requested(handle))
     {
@@ -808,7 +1331,7 @@ static ADUC_Result StepsHandler_Install(const tagADUC_WorkflowData* workflowData
     else
     {
         // This is a reference step (workflowLevel == 1), this intended for one or more components.
-        result = GetSelectedComponentsArray(handle, &selectedComponentsArray);
+        result = GetSelectedComponentSet(handle, &selectedComponents);
         if (IsAducResultCodeFailure(result.ResultCode))
         {
             const char* fmt = "Missing selected components. workflow level %d, step %d";
@@ -817,7 +1340,7 @@ static ADUC_Result StepsHandler_Install(const tagADUC_WorkflowData* workflowData
             goto done;
         }
 
-        selectedComponentsCount = static_cast<int>(json_array_get_count(selectedComponentsArray));
+        selectedComponentsCount = static_cast<int>(ADUC_ComponentSet_GetCount(selectedComponents));
 
         if (selectedComponentsCount == 0)
         {
@@ -842,10 +1365,26 @@ static ADUC_Result StepsHandler_Install(const tagADUC_WorkflowData* workflowData
         }
     }
 
+    if (selectedComponentsCount > 1)
+    {
+        maxConcurrentComponents = GetMaxConcurrentComponents(handle);
+        if (maxConcurrentComponents > 1)
+        {
+            result = InstallComponentsConcurrently(
+                handle, selectedComponents, static_cast<size_t>(selectedComponentsCount), maxConcurrentComponents);
+
+            if (IsAducResultCodeSuccess(result.ResultCode) && workflow_is_cancel_requested(handle))
+            {
+                result = { ADUC_Result_Failure_Cancelled, 0 };
+            }
+            goto done;
+        }
+    }
+
     // For each selected component, perform step's backup, install & apply phase, restore phase if needed, in order.
     for (size_t iCom = 0, stepsCount = workflow_get_children_count(handle); iCom < selectedComponentsCount; iCom++)
     {
-        serializedComponentString = CreateComponentSerializedString(selectedComponentsArray, iCom);
+        component = ADUC_ComponentSet_CreateSingle(selectedComponents, iCom);
 
         //
         // For each step (child workflow), invoke backup, install and apply actions.
@@ -859,7 +1398,7 @@ static ADUC_Result StepsHandler_Install(const tagADUC_WorkflowData* workflowData
                     "Perform install action of child step #%d on component #%d.\n#### Component ####\n%s\n###################\n",
                     i,
                     iCom,
-                    serializedComponentString);
+                    ADUC_ComponentSet_PeekString(component));
             }
 
             // Use a wrapper workflow to hold a stepHandle.
@@ -877,9 +1416,9 @@ static ADUC_Result StepsHandler_Install(const tagADUC_WorkflowData* workflowData
             stepWorkflow.WorkflowHandle = stepHandle;
 
             // For inline step - set current component info on the workflow.
-            if (serializedComponentString != nullptr && workflow_is_inline_step(handle, i))
+            if (component != nullptr && workflow_is_inline_step(handle, i))
             {
-                if (!workflow_set_selected_components(stepHandle, serializedComponentString))
+                if (!workflow_set_selected_component_set(stepHandle, component))
                 {
                     result.ResultCode = ADUC_Result_Failure;
                     result.ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_SET_SELECTED_COMPONENTS_FAILURE;
@@ -1085,8 +1624,8 @@ static ADUC_Result StepsHandler_Install(const tagADUC_WorkflowData* workflowData
         } // steps
 
     componentDone:
-        json_free_serialized_string(serializedComponentString);
-        serializedComponentString = nullptr;
+        ADUC_ComponentSet_Release(component);
+        component = nullptr;
 
         if (IsAducResultCodeFailure(result.ResultCode))
         {
@@ -1124,7 +1663,7 @@ done:
         workflow_set_state(handle, ADUCITF_State_Failed);
     }
 
-    json_free_serialized_string(serializedComponentString);
+    ADUC_ComponentSet_Release(component);
     workflow_free_string(workFolder);
 
     Log_Debug("Steps_Handler Install end (level %d).", workflowLevel);
@@ -1265,11 +1804,11 @@ static ADUC_Result StepsHandler_IsInstalled(const tagADUC_WorkflowData* workflow
     ADUC_WorkflowHandle stepHandle = nullptr;
 
     char* workFolder = workflow_get_workfolder(handle);
-    JSON_Array* selectedComponentsArray = nullptr;
+    ADUC_ComponentSet* selectedComponents = nullptr;
     int workflowLevel = workflow_get_level(handle);
     int workflowStep = workflow_get_step_index(handle);
     int selectedComponentsCount = 0;
-    char* serializedComponentString = nullptr;
+    ADUC_ComponentSet* component = nullptr;
     bool isComponentsEnumeratorRegistered = ExtensionManager::IsComponentsEnumeratorRegistered();
 
     Log_Debug("Evaluating is-installed state of the workflow (level %d, step %d).", workflowLevel, workflowStep);
@@ -1299,7 +1838,7 @@ static ADUC_Result StepsHandler_IsInstalled(const tagADUC_WorkflowData* workflow
     else
     {
         // This is a reference step (workflowLevel == 1), this intended for one or more components.
-        result = GetSelectedComponentsArray(handle, &selectedComponentsArray);
+        result = GetSelectedComponentSet(handle, &selectedComponents);
         if (IsAducResultCodeFailure(result.ResultCode))
         {
             const char* fmt = "Missing selected components. workflow level %d, step %d";
@@ -1308,7 +1847,7 @@ static ADUC_Result StepsHandler_IsInstalled(const tagADUC_WorkflowData* workflow
             goto done;
         }
 
-        selectedComponentsCount = static_cast<int>(json_array_get_count(selectedComponentsArray));
+        selectedComponentsCount = static_cast<int>(ADUC_ComponentSet_GetCount(selectedComponents));
 
         if (selectedComponentsCount == 0)
         {
@@ -1336,7 +1875,7 @@ static ADUC_Result StepsHandler_IsInstalled(const tagADUC_WorkflowData* workflow
     // For each selected component, check whether the update has been installed.
     for (size_t iCom = 0, stepsCount = workflow_get_children_count(handle); iCom < selectedComponentsCount; iCom++)
     {
-        serializedComponentString = CreateComponentSerializedString(selectedComponentsArray, iCom);
+        component = ADUC_ComponentSet_CreateSingle(selectedComponents, iCom);
 
         // For each step (child workflow), invoke IsInstalled().
         for (size_t i = 0; i < stepsCount; i++)
@@ -1347,7 +1886,7 @@ static ADUC_Result StepsHandler_IsInstalled(const tagADUC_WorkflowData* workflow
                     "Evaluating child step #%d on component #%d.\n#### Component ####\n%s\n###################\n",
                     i,
                     iCom,
-                    serializedComponentString);
+                    ADUC_ComponentSet_PeekString(component));
             }
 
             // Use a wrapper workflow to hold a stepHandle.
@@ -1365,9 +1904,9 @@ static ADUC_Result StepsHandler_IsInstalled(const tagADUC_WorkflowData* workflow
             stepWorkflow.WorkflowHandle = stepHandle;
 
             // For inline step - set current component info on the workflow.
-            if (serializedComponentString != nullptr && workflow_is_inline_step(handle, i))
+            if (component != nullptr && workflow_is_inline_step(handle, i))
             {
-                if (!workflow_set_selected_components(stepHandle, serializedComponentString))
+                if (!workflow_set_selected_component_set(stepHandle, component))
                 {
                     result.ResultCode = ADUC_Result_Failure;
                     result.ExtendedResultCode = ADUC_ERC_STEPS_HANDLER_SET_SELECTED_COMPONENTS_FAILURE;
@@ -1438,6 +1977,9 @@ static ADUC_Result StepsHandler_IsInstalled(const tagADUC_WorkflowData* workflow
             }
 
         } // steps
+
+        ADUC_ComponentSet_Release(component);
+        component = nullptr;
     } // components
 
     result.ResultCode = ADUC_Result_IsInstalled_Installed;
@@ -1459,7 +2001,7 @@ static ADUC_Result StepsHandler_IsInstalled(const tagADUC_WorkflowData* workflow
 
 done:
 
-    json_free_serialized_string(serializedComponentString);
+    ADUC_ComponentSet_Release(component);
     workflow_free_string(workFolder);
 
     Log_Debug("Workflow lvl %d step #%d is-installed state %d", workflowLevel, workflowStep, result.ResultCode);
@@ -132,6 +132,7 @@ typedef enum tagADUC_FACILITY_EXTENSION_CONTENT_DOWNLOADER_Components
     ADUC_CONTENT_DOWNLOADER_DELIVERY_OPTIMIZATION=1, //!< ADUC_CONTENT_DOWNLOADER_DELIVERY_OPTIMIZATION : 1, indicates errors from Delivery Optimization agent. 
     ADUC_CONTENT_DOWNLOADER_SIMPLE_HTTP_DOWNLOADER=2, //!< ADUC_CONTENT_DOWNLOADER_SIMPLE_HTTP_DOWNLOADER : 2, indicates errors from Simple Http Downloader.  
     ADUC_CONTENT_DOWNLOADER_CURL_DOWNLOADER=3, //!< ADUC_CONTENT_DOWNLOADER_CURL_DOWNLOADER : 3, indicates errors from Curl Downloader.
+    ADUC_CONTENT_DOWNLOADER_LIBCURL_DOWNLOADER=4, //!< ADUC_CONTENT_DOWNLOADER_LIBCURL_DOWNLOADER : 4, indicates errors from libcurl Downloader.
 } ADUC_FACILITY_EXTENSION_CONTENT_DOWNLOADER_Components;
 
 typedef enum tagADUC_FACILITY_EXTENSION_COMPONENT_ENUMERATOR_Components
@@ -344,6 +345,14 @@ static inline ADUC_Result_t MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONT
     return MAKE_ADUC_EXTENDEDRESULTCODE_FOR_FACILITY_ADUC_FACILITY_EXTENSION_CONTENT_DOWNLOADER(ADUC_CONTENT_DOWNLOADER_CURL_DOWNLOADER, value);
 }
 
+/**
+* @brief Function for generating Extended Result Codes for ADUC_CONTENT_DOWNLOADER_LIBCURL_DOWNLOADER Component
+*/
+static inline ADUC_Result_t MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONTENT_DOWNLOADER_LIBCURL_DOWNLOADER(const int32_t value)
+{
+    return MAKE_ADUC_EXTENDEDRESULTCODE_FOR_FACILITY_ADUC_FACILITY_EXTENSION_CONTENT_DOWNLOADER(ADUC_CONTENT_DOWNLOADER_LIBCURL_DOWNLOADER, value);
+}
+
 /**
  * @brief Extended Result Codes for ADUC_FACILITY_EXTENSION_COMMUNICATION_PROVIDER Facility
 */
@@ -1293,6 +1302,31 @@ static inline ADUC_Result_t MAKE_ADUC_EXTENDEDRESULTCODE_FOR_FACILITY_ADUC_FACIL
  */
  #define ADUC_ERROR_CURL_DOWNLOADER_INVALID_FILE_HASH MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONTENT_DOWNLOADER_CURL_DOWNLOADER(1)
 
+/**
+ * @brief ADUC_ERROR_CURL_DOWNLOADER_CANNOT_WRITE_FILE, ERC Value: 1076887554 (0x40300002)
+ */
+ #define ADUC_ERROR_CURL_DOWNLOADER_CANNOT_WRITE_FILE MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONTENT_DOWNLOADER_CURL_DOWNLOADER(2)
+
+/**
+ * @brief ADUC_ERROR_LIBCURL_DOWNLOADER_INIT_FAILURE, ERC Value: 1077936129 (0x40400001)
+ */
+ #define ADUC_ERROR_LIBCURL_DOWNLOADER_INIT_FAILURE MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONTENT_DOWNLOADER_LIBCURL_DOWNLOADER(1)
+
+/**
+ * @brief ADUC_ERROR_LIBCURL_DOWNLOADER_CANNOT_WRITE_FILE, ERC Value: 1077936130 (0x40400002)
+ */
+ #define ADUC_ERROR_LIBCURL_DOWNLOADER_CANNOT_WRITE_FILE MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONTENT_DOWNLOADER_LIBCURL_DOWNLOADER(2)
+
+/**
+ * @brief ADUC_ERROR_LIBCURL_DOWNLOADER_CANNOT_READ_PARTIAL_FILE, ERC Value: 1077936131 (0x40400003)
+ */
+ #define ADUC_ERROR_LIBCURL_DOWNLOADER_CANNOT_READ_PARTIAL_FILE MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONTENT_DOWNLOADER_LIBCURL_DOWNLOADER(3)
+
+/**
+ * @brief ADUC_ERROR_LIBCURL_DOWNLOADER_HTTP_FAILURE, ERC Value: 1077936132 (0x40400004)
+ */
+ #define ADUC_ERROR_LIBCURL_DOWNLOADER_HTTP_FAILURE MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONTENT_DOWNLOADER_LIBCURL_DOWNLOADER(4)
+
 /**
  * @brief ADUC_ERC_COMPONENT_ENUMERATOR_GETALLCOMPONENTS_NOTIMP, ERC Value: 1879048193 (0x70000001)
  */
@@ -1898,6 +1932,21 @@ static inline ADUC_Result_t MAKE_ADUC_EXTENDEDRESULTCODE_FOR_FACILITY_ADUC_FACIL
  */
  #define ADUC_ERC_DDH_SOURCE_UPDATE_CACHE_MISS MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_COMPONENT_DELTA_DOWNLOAD_HANDLER_COMMON(8)
 
+/**
+ * @brief ADUC_ERC_DDH_TARGET_UPDATE_HASH_MISMATCH, ERC Value: 2424307721 (0x90800009)
+ */
+ #define ADUC_ERC_DDH_TARGET_UPDATE_HASH_MISMATCH MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_COMPONENT_DELTA_DOWNLOAD_HANDLER_COMMON(9)
+
+/**
+ * @brief ADUC_ERC_DDH_MOVE_TARGET_UPDATE, ERC Value: 2424307722 (0x9080000a)
+ */
+ #define ADUC_ERC_DDH_MOVE_TARGET_UPDATE MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_COMPONENT_DELTA_DOWNLOAD_HANDLER_COMMON(10)
+
+/**
+ * @brief ADUC_ERC_DDH_STREAM_TARGET_UPDATE, ERC Value: 2424307723 (0x9080000b)
+ */
+ #define ADUC_ERC_DDH_STREAM_TARGET_UPDATE MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_COMPONENT_DELTA_DOWNLOAD_HANDLER_COMMON(11)
+
 /**
  * @brief ADUC_ERC_MOVE_PREPURGE, ERC Value: 2425356289 (0x90900001)
  */
@@ -2037,4 +2086,6 @@ static inline ADUC_Result_t MAKE_ADUC_DELIVERY_OPTIMIZATION_EXTENDEDRESULTCODE(c
 
 #define ADUC_ERROR_CURL_DOWNLOADER_EXTERNAL_FAILURE(exitCode) MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONTENT_DOWNLOADER_CURL_DOWNLOADER((0x1000 + exitCode))
 
+#define ADUC_ERROR_LIBCURL_DOWNLOADER_CURL_FAILURE(curlCode) MAKE_ADUC_EXTENDEDRESULTCODE_FOR_COMPONENT_ADUC_CONTENT_DOWNLOADER_LIBCURL_DOWNLOADER((0x1000 + curlCode))
+
 #endif // ADUC_RESULT_H
@@ -31,10 +31,27 @@
 // In practice: flush size < .8 * BUFFER_SIZE
 #define ZLOG_BUFFER_FLUSH_MAXLINES (0.8 * ZLOG_BUFFER_MAXLINES)
 
-// Maximum number of log files to keep
-#define ZLOG_MAX_FILE_COUNT 3
-
-// Maximum size in KB per logfile.
+// Maximum size in KB per logfile. Rotated log files are compressed with gzip in the background.
 #define ZLOG_FILE_MAX_SIZE_KB 50
 
+// Maximum total size in KB of the log files, the one being written counting for ZLOG_FILE_MAX_SIZE_KB. The oldest
+// files are deleted beyond that.
+#define ZLOG_MAX_TOTAL_SIZE_KB 256
+
+// Maximum number of log files to keep, whatever their size. Keeps the log folder small enough for the diagnostics
+// log collector to scan.
+#define ZLOG_MAX_FILE_COUNT 50
+
+// Hand log records to a background writer thread through a lock-free queue, instead of formatting and writing them
+// on the caller's thread. Only supported on Linux. Comment out to log synchronously.
+#define ZLOG_ASYNC
+
+// Number of records the queue holds. Must be a power of 2. Records logged while the queue is full are dropped and
+// counted. A record takes about 240 bytes.
+#define ZLOG_ASYNC_QUEUE_CAPACITY 256
+
+// Maximum total size of the queued messages too long for a record, which are copied to the heap. Beyond that, long
+// messages are truncated.
+#define ZLOG_ASYNC_MAX_LONG_MESSAGE_BYTES (256 * 1024)
+
 #endif // ZLOG_CONFIG_H
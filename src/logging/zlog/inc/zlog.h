@@ -57,6 +57,8 @@ void zlog_finish(void);
 void zlog_flush_buffer(void);
 // log an entry with the function scope and timestamp
 void zlog_log(enum ZLOG_SEVERITY msg_level, const char* func, unsigned int line, const char* fmt, ...);
+// get the number of entries dropped because the asynchronous writer's queue was full
+unsigned long long zlog_get_dropped_count(void);
 
 // End API
 
@@ -8,7 +8,6 @@
  * Licensed under the MIT License.
  */
 
-#include <aducpal/dirent.h>
 #include <aducpal/sys_time.h> // gettimeofday
 #include <aducpal/time.h> // clock_gettime, gmtime_r
 #include <aducpal/unistd.h> // getpid, sleep, syscall
@@ -26,6 +25,15 @@
 
 #include "zlog-config.h"
 #include "zlog.h"
+#include "zlog_retention.h"
+
+#if defined(ZLOG_ASYNC) && defined(__linux__)
+#    define ZLOG_ASYNC_ENABLED
+#    include <sched.h> // sched_yield
+#    include <semaphore.h>
+#    include <signal.h> // sigfillset, pthread_sigmask
+#    include <stdint.h> // intptr_t
+#endif
 
 typedef enum tagCONSOLE_LOGGING_MODE
 {
@@ -47,8 +55,10 @@ static struct
 static const char level_names[] = { 'D', 'I', 'W', 'E' }; // Must align with ZLOG_SEVERITY enum in zlog.h
 
 static FILE* zlog_fout = NULL;
+static bool zlog_file_log_enabled = false;
 static char* zlog_file_log_dir = NULL;
 static char* zlog_file_log_prefix = NULL;
+static char zlog_file_log_fullpath[512]; // The file being written.
 static time_t zlog_last_flushed = 0;
 
 char _zlog_buffer[ZLOG_BUFFER_MAXLINES][ZLOG_BUFFER_LINE_MAXCHARS];
@@ -63,13 +73,37 @@ static void _zlog_roll_over_if_file_size_too_large(size_t additional_log_len);
 static void _zlog_flush_buffer(void);
 static inline char* zlog_lock_and_get_buffer(void);
 static inline void zlog_finish_buffer_and_unlock(void);
-void zlog_ensure_at_most_n_logfiles(int max_num);
 
 static bool zlog_is_file_log_open()
 {
     return zlog_fout != NULL;
 }
 
+// The name of the file being written, without the folder.
+static const char* zlog_file_log_name()
+{
+    return zlog_file_log_fullpath + strlen(zlog_file_log_dir) + 1;
+}
+
+// Open a new log file, named after the current time, and add it to the log files index.
+static bool zlog_open_new_file_log(const char* mode)
+{
+    if (!get_current_utctime_filename(zlog_file_log_fullpath, sizeof(zlog_file_log_fullpath)))
+    {
+        // When error occurs to snprintf filepath, return false
+        return false;
+    }
+
+    zlog_fout = fopen(zlog_file_log_fullpath, mode);
+    if (zlog_fout == NULL)
+    {
+        return false;
+    }
+
+    zlog_retention_file_opened(zlog_file_log_name(), fileno(zlog_fout));
+    return true;
+}
+
 static void zlog_close_file_log()
 {
     if (zlog_is_file_log_open())
@@ -111,6 +145,623 @@ static bool zlog_term_supports_color()
     return false;
 }
 
+#define MAX_FUNCTION_NAME 64
+
+// Note: [%.64s] below match the MAX_FUNCTION_NAME above.
+// (prelude, level, buffer, func, line)
+#define LOG_FORMAT "%s [%c] %s [%.64s:%u]\n"
+
+// Format: DateTime ProcessID[ThreadID]
+// Note: 4194304 = PID_MAX_LIMIT = 4 * 1024 * 1024 = 2^22
+//       Max numeric assignable is in /proc/sys/kernel/pid_max but that
+//       could change while running, so using PID_MAX_LIMIT as defined
+//       in Linux kernel include/linux/threads.h
+#define PRELUDE_FORMAT "%04d-%02d-%02dT%02d:%02d:%02d.%04dZ %d[%d]"
+#define PRELUDE_SAMPLE "2020-07-01T18:21:26.1234Z 4194304[4194304]"
+#define PRELUDE_BUFFER_SIZE sizeof(PRELUDE_SAMPLE)
+
+#define RESERVED_INFO_SIZE (sizeof(LOG_FORMAT) + PRELUDE_BUFFER_SIZE + sizeof(level_names[0]) + MAX_FUNCTION_NAME)
+
+// Log content buffer must be smaller than the zlog line buffer - reserved info size.
+#define LOG_CONTENT_BUFFER_SIZE (ZLOG_BUFFER_LINE_MAXCHARS - RESERVED_INFO_SIZE)
+
+// (prelude, level, func, line)
+#define MULTILINE_BEGIN_FORMAT "\n\n%s [%c] [%s:%u] ==== MULTI-LINE LOG BEGIN ====\n"
+// (prelude, level, func, line)
+#define MULTILINE_END_FORMAT "%s [%c] [%s:%u] ==== MULTI-LINE LOG END ====\n\n"
+
+// Format the prelude of a log line, for a log taken at time by thread tid.
+// Return false on error.
+static bool zlog_format_prelude(char* prelude_buffer, const struct timespec* time, pid_t tid)
+{
+    const time_t seconds = time->tv_sec;
+
+    struct tm gmtval;
+    struct tm* tmval = ADUCPAL_gmtime_r(&seconds, &gmtval);
+
+    prelude_buffer[0] = '\0';
+
+    if (tmval != NULL)
+    {
+        // % 100 below to ensure the values fit in 2-digits template.
+        int ret = snprintf(
+            prelude_buffer,
+            PRELUDE_BUFFER_SIZE,
+            PRELUDE_FORMAT,
+            tmval->tm_year + 1900,
+            tmval->tm_mon + 1,
+            tmval->tm_mday % 100,
+            tmval->tm_hour % 100,
+            tmval->tm_min % 100,
+            tmval->tm_sec % 100,
+            (int)(time->tv_nsec / 100000),
+            ADUCPAL_getpid(),
+            tid);
+
+        if (ret < 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Output a formatted log line to the console.
+static void zlog_write_console(
+    enum ZLOG_SEVERITY msg_level, const char* prelude, const char* message, const char* func, unsigned int line)
+{
+    const char* color_prefix;
+    const char* color_suffix;
+
+    if (log_setting.console_logging_mode != ZLOG_CLM_ENABLED_TTYCOLOR)
+    {
+        color_prefix = "";
+        color_suffix = "";
+    }
+    else
+    {
+        // Use Bold Red for error, Bold Yellow for warn.
+        color_prefix = (msg_level == ZLOG_ERROR) ? "\033[1;31m" : (msg_level == ZLOG_WARN) ? "\033[1;33m" : "";
+        color_suffix = "\033[m";
+    }
+
+    fprintf(
+        msg_level == ZLOG_ERROR ? stderr : stdout,
+        "%s %s[%c]%s %s [%s:%u]\n",
+        prelude,
+        color_prefix,
+        level_names[msg_level],
+        color_suffix,
+        message,
+        func,
+        line);
+}
+
+#ifdef ZLOG_ASYNC_ENABLED
+
+// ------------------------- Asynchronous Logging -------------------------
+//
+// zlog_log formats the message into a record of a bounded lock-free queue, and a writer thread formats the prelude
+// and writes the record to the console and the log file. The log file is only accessed by the writer thread then,
+// which flushes it after an error, on zlog_flush_buffer, or every ZLOG_FLUSH_INTERVAL_SEC seconds.
+//
+// The queue is D. Vyukov's bounded queue: a producer claims the record at zlog_async_enqueue_pos by advancing the
+// position, fills it, then publishes it by setting its sequence to its position + 1. The writer, the only consumer,
+// takes records in order and releases each by setting its sequence to its position + the capacity.
+
+#    if (ZLOG_ASYNC_QUEUE_CAPACITY & (ZLOG_ASYNC_QUEUE_CAPACITY - 1)) != 0
+#        error ZLOG_ASYNC_QUEUE_CAPACITY must be a power of 2
+#    endif
+
+typedef struct tagZLOG_ASYNC_RECORD
+{
+    size_t sequence; // Only accessed atomically.
+    struct timespec time;
+    pid_t tid;
+    enum ZLOG_SEVERITY level;
+    bool to_console;
+    bool to_file;
+    const char* func;
+    unsigned int line;
+    char* long_message; // The message, when too long for the record. Allocated on the heap.
+    char message[LOG_CONTENT_BUFFER_SIZE];
+} ZLOG_ASYNC_RECORD;
+
+static ZLOG_ASYNC_RECORD zlog_async_queue[ZLOG_ASYNC_QUEUE_CAPACITY];
+static size_t zlog_async_enqueue_pos = 0;
+static size_t zlog_async_dequeue_pos = 0; // Only used by the writer thread.
+
+// The losses counted before the writer thread started, which it does not report again. The counters are not reset.
+static unsigned long long zlog_async_start_dropped = 0;
+static unsigned long long zlog_async_start_truncated = 0;
+
+// The flags and counters below are only accessed atomically.
+static bool zlog_async_running = false; // Whether zlog_log queues records.
+static bool zlog_async_stop_requested = false;
+static bool zlog_async_writer_sleeping = false;
+static unsigned int zlog_async_producers = 0; // zlog_log calls that may be queuing a record.
+static unsigned long long zlog_async_dropped = 0;
+static unsigned long long zlog_async_truncated = 0;
+static size_t zlog_async_long_message_bytes = 0;
+
+static pthread_t zlog_async_writer;
+static sem_t zlog_async_wakeup;
+
+// zlog_flush_buffer requests.
+static pthread_mutex_t zlog_async_flush_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t zlog_async_flush_cond = PTHREAD_COND_INITIALIZER;
+static unsigned long long zlog_async_flush_requested = 0;
+static unsigned long long zlog_async_flush_completed = 0;
+static bool zlog_async_writer_exited = true;
+
+static pid_t zlog_get_tid(void)
+{
+    // Cached, as gettid is a system call.
+    static __thread pid_t tid = 0;
+
+    if (tid == 0)
+    {
+        tid = (pid_t)ADUCPAL_syscall(SYS_gettid); /* cannot call gettid() directly */
+    }
+
+    return tid;
+}
+
+static time_t zlog_get_monotonic_seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+static void zlog_async_wake_writer(void)
+{
+    if (__atomic_exchange_n(&zlog_async_writer_sleeping, false, __ATOMIC_SEQ_CST))
+    {
+        sem_post(&zlog_async_wakeup);
+    }
+}
+
+// Queue a log record for the writer thread. The record is dropped if the queue is full.
+// Return false if the writer thread is not running, in which case the caller logs synchronously.
+static bool zlog_async_log(
+    enum ZLOG_SEVERITY msg_level,
+    bool to_console,
+    bool to_file,
+    const char* func,
+    unsigned int line,
+    const char* fmt,
+    va_list va)
+{
+    ZLOG_ASYNC_RECORD* record = NULL;
+    size_t pos = 0;
+    int message_len = 0;
+    va_list va_long;
+
+    // Counted before checking zlog_async_running, so that zlog_async_stop can wait for the record to be queued.
+    __atomic_add_fetch(&zlog_async_producers, 1, __ATOMIC_SEQ_CST);
+
+    if (!__atomic_load_n(&zlog_async_running, __ATOMIC_SEQ_CST))
+    {
+        __atomic_sub_fetch(&zlog_async_producers, 1, __ATOMIC_SEQ_CST);
+        return false;
+    }
+
+    pos = __atomic_load_n(&zlog_async_enqueue_pos, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        ZLOG_ASYNC_RECORD* candidate = &zlog_async_queue[pos & (ZLOG_ASYNC_QUEUE_CAPACITY - 1)];
+        const size_t sequence = __atomic_load_n(&candidate->sequence, __ATOMIC_ACQUIRE);
+        const intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+        if (diff == 0)
+        {
+            // On failure, pos is updated to the current position.
+            if (__atomic_compare_exchange_n(
+                    &zlog_async_enqueue_pos, &pos, pos + 1, true /* weak */, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                record = candidate;
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // The writer has not released this record yet: the queue is full.
+            break;
+        }
+        else
+        {
+            pos = __atomic_load_n(&zlog_async_enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    if (record == NULL)
+    {
+        __atomic_add_fetch(&zlog_async_dropped, 1, __ATOMIC_RELAXED);
+        goto done;
+    }
+
+    ADUCPAL_clock_gettime(CLOCK_REALTIME, &record->time);
+    record->tid = zlog_get_tid();
+    record->level = msg_level;
+    record->to_console = to_console;
+    record->to_file = to_file;
+    record->func = func;
+    record->line = line;
+    record->long_message = NULL;
+
+    va_copy(va_long, va);
+    message_len = vsnprintf(record->message, sizeof(record->message), fmt, va);
+    if (message_len < 0)
+    {
+        record->message[0] = '\0';
+    }
+    else if ((size_t)message_len >= sizeof(record->message))
+    {
+        // Too long for the record: copy it to the heap, within the limit for long messages.
+        const size_t size = (size_t)message_len + 1;
+
+        if (__atomic_add_fetch(&zlog_async_long_message_bytes, size, __ATOMIC_RELAXED)
+            <= ZLOG_ASYNC_MAX_LONG_MESSAGE_BYTES)
+        {
+            record->long_message = (char*)malloc(size);
+        }
+
+        if (record->long_message != NULL)
+        {
+            (void)vsnprintf(record->long_message, size, fmt, va_long);
+        }
+        else
+        {
+            __atomic_sub_fetch(&zlog_async_long_message_bytes, size, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&zlog_async_truncated, 1, __ATOMIC_RELAXED);
+        }
+    }
+    va_end(va_long);
+
+    // Publish the record.
+    __atomic_store_n(&record->sequence, pos + 1, __ATOMIC_SEQ_CST);
+
+done:
+    __atomic_sub_fetch(&zlog_async_producers, 1, __ATOMIC_SEQ_CST);
+
+    if (record != NULL)
+    {
+        zlog_async_wake_writer();
+    }
+
+    return true;
+}
+
+// Write a log line, formatted with the prelude, to the log file.
+// Only called by the writer thread.
+static void zlog_async_write_file(
+    enum ZLOG_SEVERITY msg_level, const char* prelude, const char* message, const char* func, unsigned int line)
+{
+    const size_t message_len = strlen(message);
+
+    if (message_len + RESERVED_INFO_SIZE < ZLOG_BUFFER_LINE_MAXCHARS)
+    {
+        _zlog_roll_over_if_file_size_too_large(message_len + RESERVED_INFO_SIZE);
+        if (zlog_is_file_log_open())
+        {
+            fprintf(zlog_fout, LOG_FORMAT, prelude, level_names[msg_level], message, func, line);
+        }
+    }
+    else
+    {
+        _zlog_roll_over_if_file_size_too_large(
+            message_len + sizeof(MULTILINE_BEGIN_FORMAT) + sizeof(MULTILINE_END_FORMAT)
+            + (PRELUDE_BUFFER_SIZE + MAX_FUNCTION_NAME) * 2);
+        if (zlog_is_file_log_open())
+        {
+            fprintf(zlog_fout, MULTILINE_BEGIN_FORMAT, prelude, level_names[msg_level], func, line);
+            fputs(message, zlog_fout);
+            fprintf(zlog_fout, MULTILINE_END_FORMAT, prelude, level_names[msg_level], func, line);
+        }
+    }
+}
+
+// Write the published records, in order.
+// Return the number of records written. Set *error_written if one of them was an error.
+static size_t zlog_async_drain(bool* error_written)
+{
+    size_t count = 0;
+
+    for (;;)
+    {
+        ZLOG_ASYNC_RECORD* record = &zlog_async_queue[zlog_async_dequeue_pos & (ZLOG_ASYNC_QUEUE_CAPACITY - 1)];
+        char prelude_buffer[PRELUDE_BUFFER_SIZE];
+        const char* message = NULL;
+
+        if (__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) != zlog_async_dequeue_pos + 1)
+        {
+            break;
+        }
+
+        message = (record->long_message != NULL) ? record->long_message : record->message;
+
+        if (zlog_format_prelude(prelude_buffer, &record->time, record->tid))
+        {
+            if (record->to_console)
+            {
+                zlog_write_console(record->level, prelude_buffer, message, record->func, record->line);
+            }
+
+            if (record->to_file)
+            {
+                zlog_async_write_file(record->level, prelude_buffer, message, record->func, record->line);
+            }
+        }
+
+        if (record->level == ZLOG_ERROR)
+        {
+            *error_written = true;
+        }
+
+        if (record->long_message != NULL)
+        {
+            __atomic_sub_fetch(&zlog_async_long_message_bytes, strlen(record->long_message) + 1, __ATOMIC_RELAXED);
+            free(record->long_message);
+            record->long_message = NULL;
+        }
+
+        // Release the record to the producers.
+        __atomic_store_n(
+            &record->sequence, zlog_async_dequeue_pos + ZLOG_ASYNC_QUEUE_CAPACITY, __ATOMIC_RELEASE);
+        zlog_async_dequeue_pos++;
+        count++;
+    }
+
+    return count;
+}
+
+static bool zlog_async_has_record(void)
+{
+    const ZLOG_ASYNC_RECORD* record = &zlog_async_queue[zlog_async_dequeue_pos & (ZLOG_ASYNC_QUEUE_CAPACITY - 1)];
+    return __atomic_load_n(&record->sequence, __ATOMIC_SEQ_CST) == zlog_async_dequeue_pos + 1;
+}
+
+// Log how many records were dropped or truncated since the last report.
+// Return true if something was logged.
+static bool zlog_async_report_losses(unsigned long long* reported_dropped, unsigned long long* reported_truncated)
+{
+    const unsigned long long dropped = __atomic_load_n(&zlog_async_dropped, __ATOMIC_RELAXED);
+    const unsigned long long truncated = __atomic_load_n(&zlog_async_truncated, __ATOMIC_RELAXED);
+    char prelude_buffer[PRELUDE_BUFFER_SIZE];
+    char message[128];
+    struct timespec curtime;
+
+    if (dropped == *reported_dropped && truncated == *reported_truncated)
+    {
+        return false;
+    }
+
+    (void)snprintf(
+        message,
+        sizeof(message),
+        "Log queue overflow: %llu log(s) dropped, %llu truncated.",
+        dropped - *reported_dropped,
+        truncated - *reported_truncated);
+    *reported_dropped = dropped;
+    *reported_truncated = truncated;
+
+    ADUCPAL_clock_gettime(CLOCK_REALTIME, &curtime);
+    if (!zlog_format_prelude(prelude_buffer, &curtime, zlog_get_tid()))
+    {
+        return false;
+    }
+
+    if (log_setting.console_logging_mode != ZLOG_CLM_DISABLED)
+    {
+        zlog_write_console(ZLOG_WARN, prelude_buffer, message, __FUNCTION__, __LINE__);
+    }
+
+    if (zlog_file_log_enabled)
+    {
+        zlog_async_write_file(ZLOG_WARN, prelude_buffer, message, __FUNCTION__, __LINE__);
+    }
+
+    return true;
+}
+
+static void* zlog_async_writer_main(void* arg)
+{
+    unsigned long long reported_dropped = zlog_async_start_dropped;
+    unsigned long long reported_truncated = zlog_async_start_truncated;
+    unsigned long long flush_requested = 0;
+    time_t last_flushed = zlog_get_monotonic_seconds();
+    bool unflushed = false;
+
+    (void)arg;
+
+    for (;;)
+    {
+        const bool stopping = __atomic_load_n(&zlog_async_stop_requested, __ATOMIC_SEQ_CST);
+        bool error_written = false;
+        time_t now = 0;
+
+        if (stopping)
+        {
+            // zlog_log no longer queues records. Wait for those being queued, so that they are written too.
+            while (__atomic_load_n(&zlog_async_producers, __ATOMIC_SEQ_CST) != 0)
+            {
+                sched_yield();
+            }
+        }
+
+        pthread_mutex_lock(&zlog_async_flush_mutex);
+        flush_requested = zlog_async_flush_requested;
+        pthread_mutex_unlock(&zlog_async_flush_mutex);
+
+        if (zlog_async_drain(&error_written) > 0)
+        {
+            unflushed = true;
+        }
+
+        if (zlog_async_report_losses(&reported_dropped, &reported_truncated))
+        {
+            unflushed = true;
+        }
+
+        now = zlog_get_monotonic_seconds();
+        if (unflushed
+            && (error_written || stopping || flush_requested != zlog_async_flush_completed
+                || (now - last_flushed) >= ZLOG_FLUSH_INTERVAL_SEC))
+        {
+            if (zlog_is_file_log_open())
+            {
+                fflush(zlog_fout);
+            }
+            fflush(stdout);
+
+            unflushed = false;
+            last_flushed = now;
+        }
+
+        if (flush_requested != zlog_async_flush_completed)
+        {
+            pthread_mutex_lock(&zlog_async_flush_mutex);
+            zlog_async_flush_completed = flush_requested;
+            pthread_cond_broadcast(&zlog_async_flush_cond);
+            pthread_mutex_unlock(&zlog_async_flush_mutex);
+        }
+
+        if (stopping)
+        {
+            break;
+        }
+
+        // Sleep until a record is queued, a flush is requested, or the unflushed logs are due to be flushed.
+        // zlog_async_wake_writer posts the semaphore if it sees the flag set after queuing a record, and the queue is
+        // checked after setting it, so no record is missed.
+        __atomic_store_n(&zlog_async_writer_sleeping, true, __ATOMIC_SEQ_CST);
+
+        if (!zlog_async_has_record())
+        {
+            if (unflushed)
+            {
+                struct timespec deadline;
+                ADUCPAL_clock_gettime(CLOCK_REALTIME, &deadline);
+                deadline.tv_sec += ZLOG_FLUSH_INTERVAL_SEC - (now - last_flushed);
+                (void)sem_timedwait(&zlog_async_wakeup, &deadline);
+            }
+            else
+            {
+                (void)sem_wait(&zlog_async_wakeup);
+            }
+        }
+
+        __atomic_store_n(&zlog_async_writer_sleeping, false, __ATOMIC_SEQ_CST);
+    }
+
+    pthread_mutex_lock(&zlog_async_flush_mutex);
+    zlog_async_flush_completed = zlog_async_flush_requested;
+    zlog_async_writer_exited = true;
+    pthread_cond_broadcast(&zlog_async_flush_cond);
+    pthread_mutex_unlock(&zlog_async_flush_mutex);
+
+    return NULL;
+}
+
+// Start the writer thread. Logs are written synchronously if it cannot be started.
+static void zlog_async_start(void)
+{
+    sigset_t all_signals;
+    sigset_t old_signals;
+    int ret = 0;
+
+    if (__atomic_load_n(&zlog_async_running, __ATOMIC_SEQ_CST))
+    {
+        return;
+    }
+
+    // Write what was logged synchronously so far, so that it comes first.
+    zlog_flush_buffer();
+
+    for (size_t i = 0; i < ZLOG_ASYNC_QUEUE_CAPACITY; ++i)
+    {
+        zlog_async_queue[i].sequence = i;
+        zlog_async_queue[i].long_message = NULL;
+    }
+    zlog_async_enqueue_pos = 0;
+    zlog_async_dequeue_pos = 0;
+    zlog_async_stop_requested = false;
+    zlog_async_writer_sleeping = false;
+    zlog_async_flush_requested = 0;
+    zlog_async_flush_completed = 0;
+    zlog_async_start_dropped = __atomic_load_n(&zlog_async_dropped, __ATOMIC_RELAXED);
+    zlog_async_start_truncated = __atomic_load_n(&zlog_async_truncated, __ATOMIC_RELAXED);
+
+    if (sem_init(&zlog_async_wakeup, 0 /* pshared */, 0 /* value */) != 0)
+    {
+        return;
+    }
+
+    // The writer thread inherits the signal mask: leave signal handling to the other threads.
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+    ret = pthread_create(&zlog_async_writer, NULL, zlog_async_writer_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+    if (ret != 0)
+    {
+        sem_destroy(&zlog_async_wakeup);
+        return;
+    }
+
+    pthread_mutex_lock(&zlog_async_flush_mutex);
+    zlog_async_writer_exited = false;
+    pthread_mutex_unlock(&zlog_async_flush_mutex);
+
+    __atomic_store_n(&zlog_async_running, true, __ATOMIC_SEQ_CST);
+}
+
+// Stop the writer thread, once it has written all the queued records.
+static void zlog_async_stop(void)
+{
+    if (!__atomic_load_n(&zlog_async_running, __ATOMIC_SEQ_CST))
+    {
+        return;
+    }
+
+    __atomic_store_n(&zlog_async_running, false, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&zlog_async_stop_requested, true, __ATOMIC_SEQ_CST);
+    sem_post(&zlog_async_wakeup);
+
+    pthread_join(zlog_async_writer, NULL);
+    sem_destroy(&zlog_async_wakeup);
+}
+
+// Wait until the writer thread has written and flushed the records queued so far.
+// Return false if the writer thread is not running.
+static bool zlog_async_flush(void)
+{
+    unsigned long long request = 0;
+
+    pthread_mutex_lock(&zlog_async_flush_mutex);
+
+    if (zlog_async_writer_exited)
+    {
+        pthread_mutex_unlock(&zlog_async_flush_mutex);
+        return false;
+    }
+
+    request = ++zlog_async_flush_requested;
+    sem_post(&zlog_async_wakeup);
+
+    while (zlog_async_flush_completed < request && !zlog_async_writer_exited)
+    {
+        pthread_cond_wait(&zlog_async_flush_cond, &zlog_async_flush_mutex);
+    }
+
+    pthread_mutex_unlock(&zlog_async_flush_mutex);
+    return true;
+}
+
+#endif // ZLOG_ASYNC_ENABLED
+
 // ------------------------- Logging Utilities -------------------------
 
 // Initialize zlog logging settings:
@@ -169,29 +820,34 @@ int zlog_init(
         strcpy(zlog_file_log_prefix, log_file); // NOLINT(clang-analyzer-security.insecureAPI.strcpy)
         strcat(zlog_file_log_prefix, "."); // NOLINT(clang-analyzer-security.insecureAPI.strcpy)
 
-        // Timestamp the log file
-        char zlog_file_log_fullpath[512];
-        if (!get_current_utctime_filename(zlog_file_log_fullpath, sizeof(zlog_file_log_fullpath)))
-        {
-            // When error occurs to snprintf filepath, return false
-            return -1;
-        }
+        // Index the existing log files once, and compress those of previous runs.
+        (void)zlog_retention_init(zlog_file_log_dir, zlog_file_log_prefix);
 
-        zlog_fout = fopen(zlog_file_log_fullpath, "a+");
-        if (zlog_fout == NULL)
+        // Timestamp the log file
+        if (!zlog_open_new_file_log("a+"))
         {
             return -1;
         }
+        zlog_file_log_enabled = true;
         log_debug("Log file created: %s", zlog_file_log_fullpath);
-
-        zlog_ensure_at_most_n_logfiles(ZLOG_MAX_FILE_COUNT);
     }
+
+#ifdef ZLOG_ASYNC_ENABLED
+    zlog_async_start();
+#endif
     return 0;
 }
 
 // Caller should NOT hold the lock
 void zlog_flush_buffer(void)
 {
+#ifdef ZLOG_ASYNC_ENABLED
+    if (zlog_async_flush())
+    {
+        return;
+    }
+#endif
+
     _zlog_buffer_lock();
     _zlog_flush_buffer();
     _zlog_buffer_unlock();
@@ -200,44 +856,39 @@ void zlog_flush_buffer(void)
 // Caller should NOT hold the lock
 void zlog_finish(void)
 {
+#ifdef ZLOG_ASYNC_ENABLED
+    // Writes all the queued records first.
+    zlog_async_stop();
+#endif
+
     zlog_flush_buffer();
 
+    zlog_file_log_enabled = false;
     zlog_close_file_log();
 
+    // Lets the file being compressed, if any, complete.
+    zlog_retention_finish();
+
     free(zlog_file_log_dir);
+    zlog_file_log_dir = NULL;
     free(zlog_file_log_prefix);
+    zlog_file_log_prefix = NULL;
 }
 
-#define MAX_FUNCTION_NAME 64
-
-// Note: [%.64s] below match the MAX_FUNCTION_NAME above.
-// (prelude, level, buffer, func, line)
-#define LOG_FORMAT "%s [%c] %s [%.64s:%u]\n"
-
-// Format: DateTime ProcessID[ThreadID]
-// Note: 4194304 = PID_MAX_LIMIT = 4 * 1024 * 1024 = 2^22
-//       Max numeric assignable is in /proc/sys/kernel/pid_max but that
-//       could change while running, so using PID_MAX_LIMIT as defined
-//       in Linux kernel include/linux/threads.h
-#define PRELUDE_FORMAT "%04d-%02d-%02dT%02d:%02d:%02d.%04dZ %d[%d]"
-#define PRELUDE_SAMPLE "2020-07-01T18:21:26.1234Z 4194304[4194304]"
-#define PRELUDE_BUFFER_SIZE sizeof(PRELUDE_SAMPLE)
-
-#define RESERVED_INFO_SIZE (sizeof(LOG_FORMAT) + PRELUDE_BUFFER_SIZE + sizeof(level_names[0]) + MAX_FUNCTION_NAME)
-
-// Log content buffer must be smaller than the zlog line buffer - reserved info size.
-#define LOG_CONTENT_BUFFER_SIZE (ZLOG_BUFFER_LINE_MAXCHARS - RESERVED_INFO_SIZE)
-
-// (prelude, level, func, line)
-#define MULTILINE_BEGIN_FORMAT "\n\n%s [%c] [%s:%u] ==== MULTI-LINE LOG BEGIN ====\n"
-// (prelude, level, func, line)
-#define MULTILINE_END_FORMAT "%s [%c] [%s:%u] ==== MULTI-LINE LOG END ====\n\n"
+unsigned long long zlog_get_dropped_count(void)
+{
+#ifdef ZLOG_ASYNC_ENABLED
+    return __atomic_load_n(&zlog_async_dropped, __ATOMIC_RELAXED);
+#else
+    return 0;
+#endif
+}
 
 void zlog_log(enum ZLOG_SEVERITY msg_level, const char* func, unsigned int line, const char* fmt, ...)
 {
     const bool console_log_needed =
         (log_setting.console_logging_mode != ZLOG_CLM_DISABLED) && (msg_level >= log_setting.console_level);
-    const bool file_log_needed = zlog_is_file_log_open() && (msg_level >= log_setting.file_level);
+    const bool file_log_needed = zlog_file_log_enabled && (msg_level >= log_setting.file_level);
 
     if (!console_log_needed && !file_log_needed)
     {
@@ -245,39 +896,32 @@ void zlog_log(enum ZLOG_SEVERITY msg_level, const char* func, unsigned int line,
         return;
     }
 
+#ifdef ZLOG_ASYNC_ENABLED
+    {
+        va_list va_async;
+        va_start(va_async, fmt);
+        const bool queued =
+            zlog_async_log(msg_level, console_log_needed, file_log_needed, func, line, fmt, va_async);
+        va_end(va_async);
+
+        if (queued)
+        {
+            return;
+        }
+    }
+#endif
+
     char prelude_buffer[PRELUDE_BUFFER_SIZE];
-    prelude_buffer[0] = '\0';
 
     struct timespec curtime;
     ADUCPAL_clock_gettime(CLOCK_REALTIME, &curtime);
 
     const time_t seconds = curtime.tv_sec;
 
-    struct tm gmtval;
-    struct tm* tmval = ADUCPAL_gmtime_r(&seconds, &gmtval);
-
-    if (tmval != NULL)
+    if (!zlog_format_prelude(
+            prelude_buffer, &curtime, (pid_t)ADUCPAL_syscall(SYS_gettid) /* cannot call gettid() directly */))
     {
-        // % 100 below to ensure the values fit in 2-digits template.
-        int ret = snprintf(
-            prelude_buffer,
-            PRELUDE_BUFFER_SIZE,
-            PRELUDE_FORMAT,
-            tmval->tm_year + 1900,
-            tmval->tm_mon + 1,
-            tmval->tm_mday % 100,
-            tmval->tm_hour % 100,
-            tmval->tm_min % 100,
-            tmval->tm_sec % 100,
-            (int)(curtime.tv_nsec / 100000),
-            ADUCPAL_getpid(),
-            (pid_t)ADUCPAL_syscall(SYS_gettid) /* cannot call gettid() directly */
-        );
-
-        if (ret < 0)
-        {
-            return;
-        }
+        return;
     }
 
     char va_buffer[LOG_CONTENT_BUFFER_SIZE];
@@ -333,16 +977,7 @@ void zlog_log(enum ZLOG_SEVERITY msg_level, const char* func, unsigned int line,
         }
         else
         {
-            fprintf(
-                msg_level == ZLOG_ERROR ? stderr : stdout,
-                "%s %s[%c]%s %s [%s:%u]\n",
-                prelude_buffer,
-                color_prefix,
-                level_names[msg_level],
-                color_suffix,
-                va_buffer,
-                func,
-                line);
+            zlog_write_console(msg_level, prelude_buffer, va_buffer, func, line);
         }
     }
 
@@ -374,6 +1009,13 @@ void zlog_log(enum ZLOG_SEVERITY msg_level, const char* func, unsigned int line,
             _zlog_roll_over_if_file_size_too_large(
                 full_log_len + sizeof(MULTILINE_BEGIN_FORMAT) + sizeof(MULTILINE_END_FORMAT)
                 + (PRELUDE_BUFFER_SIZE + MAX_FUNCTION_NAME) * 2);
+            if (!zlog_is_file_log_open())
+            {
+                // The roll over failed to open a new log file.
+                _zlog_buffer_unlock();
+                return;
+            }
+
             fprintf(zlog_fout, MULTILINE_BEGIN_FORMAT, prelude_buffer, level_names[msg_level], func, line);
 
             va_start(va, fmt);
@@ -395,12 +1037,6 @@ void zlog_log(enum ZLOG_SEVERITY msg_level, const char* func, unsigned int line,
 }
 
 // ------------------------- Helper Functions ---------------------------
-static int file_select(const struct dirent* logfile)
-{
-    // Filter: 1. File and 2. filename contains the log file pattern
-    return (logfile->d_type == DT_REG && strstr(logfile->d_name, zlog_file_log_prefix) != NULL);
-}
-
 static inline void _zlog_buffer_lock(void)
 {
     pthread_mutex_lock(&_zlog_buffer_mutex);
@@ -420,6 +1056,16 @@ bool get_current_utctime_filename(char* fullpath, size_t fullpath_len)
 
     strftime(timebuf, sizeof(timebuf), "%Y%m%d-%H%M%S", tm);
     int res = snprintf(fullpath, fullpath_len, "%s/%s%s.log", zlog_file_log_dir, zlog_file_log_prefix, timebuf);
+
+    // Files rotated within the same second get a sequence number, as rotated files are compressed in the background.
+    for (unsigned int i = 1; res >= 0 && (size_t)res < fullpath_len
+         && zlog_retention_has_file(fullpath + strlen(zlog_file_log_dir) + 1);
+         ++i)
+    {
+        res = snprintf(
+            fullpath, fullpath_len, "%s/%s%s-%u.log", zlog_file_log_dir, zlog_file_log_prefix, timebuf, i);
+    }
+
     if (res < 0 || res >= fullpath_len)
     {
         // When error occurs to snprintf filepath, return false
@@ -449,18 +1095,12 @@ static void _zlog_roll_over_if_file_size_too_large(size_t additional_log_len)
     {
         zlog_close_file_log();
 
-        // Clean up the log folder
-        zlog_ensure_at_most_n_logfiles(ZLOG_MAX_FILE_COUNT);
+        // Compress it in the background, and clean up the log folder.
+        zlog_retention_file_closed(zlog_file_log_name(), (size_t)ftellVal);
 
         // Timestamp the new log file
-        char zlog_file_log_fullpath[512];
-        if (!get_current_utctime_filename(zlog_file_log_fullpath, sizeof(zlog_file_log_fullpath)))
-        {
-            return;
-        }
-
         // INVARIANT: zlog_fout == NULL due to zlog_close_file_log() call above.
-        zlog_fout = fopen(zlog_file_log_fullpath, "a");
+        (void)zlog_open_new_file_log("a");
     }
 }
 
@@ -509,39 +1149,3 @@ static inline void zlog_finish_buffer_and_unlock()
 #endif
     _zlog_buffer_unlock();
 }
-
-// Clean up until max of num old log files left
-// Caller should hold the lock
-void zlog_ensure_at_most_n_logfiles(int max_num)
-{
-    struct dirent** logfiles;
-
-    // List the files specified by file_select in alphabetical order
-    const int total = ADUCPAL_scandir(zlog_file_log_dir, &logfiles, file_select, ADUCPAL_alphasort);
-    if (total == -1)
-    {
-        return;
-    }
-
-    if (total > max_num)
-    {
-        // Delete until only max_num of files left
-        for (int i = 0; i < total - max_num; ++i)
-        {
-            char filepath[512];
-            const unsigned int max_filepath = sizeof(filepath) / sizeof(filepath[0]);
-            int res = snprintf(filepath, max_filepath, "%s/%s", zlog_file_log_dir, logfiles[i]->d_name);
-            if (res > 0 && res < (int)max_filepath)
-            {
-                remove(filepath);
-            }
-        }
-    }
-
-    // Free memory allocated by scandir.
-    for (int i = 0; i < total; ++i)
-    {
-        free(logfiles[i]);
-    }
-    free(logfiles);
-}
@@ -0,0 +1,682 @@
+/**
+ * @file zlog_retention.c
+ * @brief Keeps the index of the zlog log files, compresses the rotated ones, and deletes the oldest ones beyond the
+ * total size budget.
+ *
+ * The directory is scanned once, by zlog_retention_init. After that, the index is updated as log files are opened,
+ * rotated, compressed, and deleted, so rotating a log file does not rescan the directory.
+ *
+ * Rotated files are compressed with gzip, by a background thread, to <name>.gz. The compressed file keeps the
+ * modification time of the original, so that sorting by time, as the diagnostics log collector does, keeps the order
+ * of the logs.
+ *
+ * Several processes may log to the same folder with the same prefix, e.g. concurrent adu-shell runs. A process holds
+ * a shared flock on the file it writes, and an exclusive one on a file it compresses or deletes, so it never
+ * compresses or deletes a file another process writes or compresses. Compressions write to a unique temporary file,
+ * which is also locked until it is renamed.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#include "zlog_retention.h"
+
+#include <aducpal/dirent.h>
+
+#include <errno.h>
+#include <fcntl.h> // AT_FDCWD, open
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#if defined(__linux__)
+#    include <sys/file.h> // flock
+#    include <unistd.h> // close, dup
+#endif
+
+#include "zlog-config.h"
+
+#define COMPRESSED_FILE_SUFFIX ".gz"
+#define TEMP_FILE_SUFFIX ".tmp"
+
+// Makes the name of a temporary compressed file unique. See mkstemps.
+#define TEMP_FILE_UNIQUE_PART ".XXXXXX"
+
+// Size of the buffer used to read the files to compress.
+#define COMPRESSION_BUFFER_SIZE (64 * 1024)
+
+typedef struct tagZLOG_LOG_FILE
+{
+    char* name;
+    size_t size;
+    struct timespec mtime;
+    bool current; // Being written.
+    bool compressing; // Being compressed. Not deleted until done.
+    bool compressible; // Rotated, uncompressed, not written by another process, and no compression failed.
+} ZLOG_LOG_FILE;
+
+static pthread_mutex_t s_index_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_index_cond = PTHREAD_COND_INITIALIZER;
+
+// Oldest first. Protected by s_index_mutex, as are the variables below.
+static ZLOG_LOG_FILE* s_files = NULL;
+static size_t s_file_count = 0;
+static size_t s_file_capacity = 0;
+
+static char* s_log_dir = NULL;
+static const char* s_file_prefix = NULL; // Only used while scanning the directory.
+static bool s_stop_requested = false;
+static bool s_compressor_started = false;
+static pthread_t s_compressor;
+
+static bool ends_with(const char* str, const char* suffix)
+{
+    const size_t str_len = strlen(str);
+    const size_t suffix_len = strlen(suffix);
+    return str_len >= suffix_len && strcmp(str + str_len - suffix_len, suffix) == 0;
+}
+
+// Format the path of file_name, with an optional suffix. Return false if it does not fit.
+static bool format_path(char* path, size_t path_len, const char* file_name, const char* suffix)
+{
+    const int res = snprintf(path, path_len, "%s/%s%s", s_log_dir, file_name, suffix);
+    return res > 0 && (size_t)res < path_len;
+}
+
+// Claim the file at path for compressing or deleting it: open it, and take an exclusive flock on it, which fails if
+// another process writes it (see zlog_retention_file_opened) or claimed it. The claim lasts until release_file.
+// Return false, with errno ENOENT if the file no longer exists, or EWOULDBLOCK if it is in use.
+static bool claim_file(const char* path, int* fd)
+{
+#if defined(__linux__)
+    struct stat fd_st;
+    struct stat path_st;
+
+    *fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (*fd < 0)
+    {
+        return false;
+    }
+
+    if (flock(*fd, LOCK_EX | LOCK_NB) != 0)
+    {
+        const int err = errno;
+        close(*fd);
+        *fd = -1;
+        errno = (err == EINTR) ? EWOULDBLOCK : err;
+        return false;
+    }
+
+    // Another process may have deleted the file, or renamed another over it, before the lock was taken.
+    if (fstat(*fd, &fd_st) != 0 || stat(path, &path_st) != 0 || fd_st.st_dev != path_st.st_dev
+        || fd_st.st_ino != path_st.st_ino)
+    {
+        close(*fd);
+        *fd = -1;
+        errno = ENOENT;
+        return false;
+    }
+#else
+    (void)path;
+    *fd = -1;
+#endif
+
+    return true;
+}
+
+static void release_file(int fd)
+{
+#if defined(__linux__)
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+#else
+    (void)fd;
+#endif
+}
+
+static int compare_files(const void* a, const void* b)
+{
+    const ZLOG_LOG_FILE* file_a = (const ZLOG_LOG_FILE*)a;
+    const ZLOG_LOG_FILE* file_b = (const ZLOG_LOG_FILE*)b;
+
+    if (file_a->mtime.tv_sec != file_b->mtime.tv_sec)
+    {
+        return file_a->mtime.tv_sec < file_b->mtime.tv_sec ? -1 : 1;
+    }
+
+    if (file_a->mtime.tv_nsec != file_b->mtime.tv_nsec)
+    {
+        return file_a->mtime.tv_nsec < file_b->mtime.tv_nsec ? -1 : 1;
+    }
+
+    return strcmp(file_a->name, file_b->name);
+}
+
+// Caller should hold s_index_mutex
+static ZLOG_LOG_FILE* find_file(const char* file_name)
+{
+    for (size_t i = 0; i < s_file_count; ++i)
+    {
+        if (strcmp(s_files[i].name, file_name) == 0)
+        {
+            return &s_files[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Caller should hold s_index_mutex
+static bool add_file(const char* file_name, size_t size, const struct timespec* mtime, bool current)
+{
+    ZLOG_LOG_FILE* file = NULL;
+
+    if (s_file_count == s_file_capacity)
+    {
+        const size_t new_capacity = s_file_capacity == 0 ? 16 : s_file_capacity * 2;
+        ZLOG_LOG_FILE* new_files = (ZLOG_LOG_FILE*)realloc(s_files, new_capacity * sizeof(*new_files));
+        if (new_files == NULL)
+        {
+            return false;
+        }
+
+        s_files = new_files;
+        s_file_capacity = new_capacity;
+    }
+
+    file = &s_files[s_file_count];
+    memset(file, 0, sizeof(*file));
+
+    file->name = strdup(file_name);
+    if (file->name == NULL)
+    {
+        return false;
+    }
+
+    file->size = size;
+    file->mtime = *mtime;
+    file->current = current;
+    file->compressible = !current && !ends_with(file_name, COMPRESSED_FILE_SUFFIX);
+    ++s_file_count;
+    return true;
+}
+
+// Caller should hold s_index_mutex
+static void remove_file_at(size_t index)
+{
+    free(s_files[index].name);
+    memmove(&s_files[index], &s_files[index + 1], (s_file_count - index - 1) * sizeof(s_files[0]));
+    --s_file_count;
+}
+
+// Delete the oldest files until the total size fits in the budget, and there are at most ZLOG_MAX_FILE_COUNT files.
+// The file being written counts for its maximum size, and is never deleted.
+// Caller should hold s_index_mutex
+static void enforce_size_budget(void)
+{
+    size_t total_size = 0;
+    size_t index = 0;
+
+    for (size_t i = 0; i < s_file_count; ++i)
+    {
+        total_size += s_files[i].current ? (size_t)ZLOG_FILE_MAX_SIZE_KB * 1024 : s_files[i].size;
+    }
+
+    while ((total_size > (size_t)ZLOG_MAX_TOTAL_SIZE_KB * 1024 || s_file_count > ZLOG_MAX_FILE_COUNT)
+           && index < s_file_count)
+    {
+        char path[512];
+        int fd = -1;
+        ZLOG_LOG_FILE* file = &s_files[index];
+
+        if (file->current || file->compressing)
+        {
+            // Checked again once the compression is done.
+            ++index;
+            continue;
+        }
+
+        if (format_path(path, sizeof(path), file->name, ""))
+        {
+            if (!claim_file(path, &fd) && errno != ENOENT)
+            {
+                // Another process writes or compresses it. Checked again on the next rotation.
+                ++index;
+                continue;
+            }
+
+            remove(path);
+            release_file(fd);
+        }
+
+        total_size -= file->size;
+        remove_file_at(index);
+    }
+}
+
+// Compress the file at path, which the caller claimed, to path.gz, through a temporary file. The compressed file
+// keeps the original's modification time.
+// Return the size of the compressed file, or 0 on failure.
+static size_t compress_file(const char* path, const struct timespec* mtime)
+{
+    char temp_path[512 + sizeof(COMPRESSED_FILE_SUFFIX TEMP_FILE_UNIQUE_PART TEMP_FILE_SUFFIX)];
+    char compressed_path[512 + sizeof(COMPRESSED_FILE_SUFFIX)];
+    FILE* source = NULL;
+    gzFile destination = NULL;
+    char* buffer = NULL;
+    int temp_fd = -1;
+    bool temp_created = false;
+    size_t compressed_size = 0;
+    bool succeeded = false;
+    struct stat st;
+
+    if (snprintf(
+            temp_path, sizeof(temp_path), "%s" COMPRESSED_FILE_SUFFIX TEMP_FILE_UNIQUE_PART TEMP_FILE_SUFFIX, path)
+            <= 0
+        || snprintf(compressed_path, sizeof(compressed_path), "%s" COMPRESSED_FILE_SUFFIX, path) <= 0)
+    {
+        return 0;
+    }
+
+    buffer = (char*)malloc(COMPRESSION_BUFFER_SIZE);
+    if (buffer == NULL)
+    {
+        goto done;
+    }
+
+    source = fopen(path, "rb");
+    if (source == NULL)
+    {
+        goto done;
+    }
+
+#if defined(__linux__)
+    // Locked until renamed, so that zlog_retention_init of another process does not delete it.
+    temp_fd = mkstemps(temp_path, sizeof(TEMP_FILE_SUFFIX) - 1);
+    if (temp_fd < 0)
+    {
+        goto done;
+    }
+
+    temp_created = true;
+
+    if (flock(temp_fd, LOCK_EX) != 0 || fstat(fileno(source), &st) != 0 || fchmod(temp_fd, st.st_mode & 0777) != 0)
+    {
+        goto done;
+    }
+
+    {
+        const int gz_fd = dup(temp_fd);
+        if (gz_fd < 0)
+        {
+            goto done;
+        }
+
+        destination = gzdopen(gz_fd, "wb");
+        if (destination == NULL)
+        {
+            close(gz_fd);
+            goto done;
+        }
+    }
+#else
+    // Without flock, a fixed name: the caller's process is the only one compressing the file.
+    if (snprintf(temp_path, sizeof(temp_path), "%s" COMPRESSED_FILE_SUFFIX TEMP_FILE_SUFFIX, path) <= 0)
+    {
+        goto done;
+    }
+
+    destination = gzopen(temp_path, "wb");
+    if (destination == NULL)
+    {
+        goto done;
+    }
+
+    temp_created = true;
+#endif
+
+    for (;;)
+    {
+        const size_t read_len = fread(buffer, 1, COMPRESSION_BUFFER_SIZE, source);
+
+        if (read_len > 0 && gzwrite(destination, buffer, (unsigned int)read_len) != (int)read_len)
+        {
+            goto done;
+        }
+
+        if (read_len < COMPRESSION_BUFFER_SIZE)
+        {
+            if (ferror(source))
+            {
+                goto done;
+            }
+
+            break;
+        }
+    }
+
+    {
+        const int close_result = gzclose(destination);
+        destination = NULL;
+        if (close_result != Z_OK)
+        {
+            goto done;
+        }
+    }
+
+#if defined(__linux__)
+    {
+        const struct timespec times[2] = { *mtime, *mtime };
+        (void)utimensat(AT_FDCWD, temp_path, times, 0);
+    }
+#else
+    (void)mtime;
+#endif
+
+    if (stat(temp_path, &st) != 0 || rename(temp_path, compressed_path) != 0)
+    {
+        goto done;
+    }
+
+    compressed_size = (st.st_size > 0) ? (size_t)st.st_size : 1;
+    succeeded = true;
+
+done:
+    if (destination != NULL)
+    {
+        gzclose(destination);
+    }
+
+    if (source != NULL)
+    {
+        fclose(source);
+    }
+
+    free(buffer);
+
+    if (succeeded)
+    {
+        remove(path);
+    }
+    else if (temp_created)
+    {
+        remove(temp_path);
+    }
+
+#if defined(__linux__)
+    if (temp_fd >= 0)
+    {
+        close(temp_fd);
+    }
+#endif
+
+    return compressed_size;
+}
+
+static void* compressor_main(void* arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&s_index_mutex);
+
+    while (!s_stop_requested)
+    {
+        ZLOG_LOG_FILE* file = NULL;
+        char* file_name = NULL;
+        struct timespec mtime;
+        char path[512];
+        size_t compressed_size = 0;
+        int claim_errno = 0;
+
+        for (size_t i = 0; i < s_file_count; ++i)
+        {
+            if (s_files[i].compressible && !s_files[i].current)
+            {
+                file = &s_files[i];
+                break;
+            }
+        }
+
+        if (file == NULL)
+        {
+            pthread_cond_wait(&s_index_cond, &s_index_mutex);
+            continue;
+        }
+
+        file->compressible = false;
+        file->compressing = true;
+        file_name = strdup(file->name);
+        mtime = file->mtime;
+
+        pthread_mutex_unlock(&s_index_mutex);
+
+        if (file_name != NULL && format_path(path, sizeof(path), file_name, ""))
+        {
+            int fd = -1;
+
+            if (claim_file(path, &fd))
+            {
+                compressed_size = compress_file(path, &mtime);
+                release_file(fd);
+            }
+            else
+            {
+                // Another process writes it, and compresses it once rotated, or already compressed or deleted it.
+                claim_errno = errno;
+            }
+        }
+
+        pthread_mutex_lock(&s_index_mutex);
+
+        // The index may have moved while unlocked, but the file was not removed from it.
+        file = (file_name != NULL) ? find_file(file_name) : NULL;
+        if (file != NULL && claim_errno == ENOENT)
+        {
+            remove_file_at((size_t)(file - s_files));
+        }
+        else if (file != NULL)
+        {
+            file->compressing = false;
+
+            if (compressed_size != 0)
+            {
+                char* compressed_name = (char*)malloc(strlen(file_name) + sizeof(COMPRESSED_FILE_SUFFIX));
+                if (compressed_name != NULL)
+                {
+                    strcpy(compressed_name, file_name); // NOLINT(clang-analyzer-security.insecureAPI.strcpy)
+                    strcat(compressed_name, COMPRESSED_FILE_SUFFIX); // NOLINT(clang-analyzer-security.insecureAPI.strcpy)
+                    free(file->name);
+                    file->name = compressed_name;
+                }
+
+                file->size = compressed_size;
+            }
+
+            enforce_size_budget();
+        }
+
+        free(file_name);
+    }
+
+    pthread_mutex_unlock(&s_index_mutex);
+    return NULL;
+}
+
+static int file_select(const struct dirent* logfile)
+{
+    // Filter: 1. File and 2. filename contains the log file pattern
+    return (logfile->d_type == DT_REG && strstr(logfile->d_name, s_file_prefix) != NULL);
+}
+
+bool zlog_retention_init(const char* log_dir, const char* file_prefix)
+{
+    struct dirent** logfiles = NULL;
+    int total = 0;
+
+    pthread_mutex_lock(&s_index_mutex);
+
+    s_log_dir = strdup(log_dir);
+    if (s_log_dir == NULL)
+    {
+        pthread_mutex_unlock(&s_index_mutex);
+        return false;
+    }
+
+    s_file_prefix = file_prefix;
+    total = ADUCPAL_scandir(log_dir, &logfiles, file_select, ADUCPAL_alphasort);
+    s_file_prefix = NULL;
+
+    for (int i = 0; i < total; ++i)
+    {
+        char path[512];
+        struct stat st;
+
+        if (format_path(path, sizeof(path), logfiles[i]->d_name, "") && stat(path, &st) == 0)
+        {
+            if (ends_with(logfiles[i]->d_name, TEMP_FILE_SUFFIX))
+            {
+                // An interrupted compression, unless another process is still writing it.
+                int fd = -1;
+                if (claim_file(path, &fd))
+                {
+                    remove(path);
+                    release_file(fd);
+                }
+            }
+            else
+            {
+#if defined(__linux__)
+                const struct timespec mtime = st.st_mtim;
+#else
+                const struct timespec mtime = { st.st_mtime, 0 };
+#endif
+                (void)add_file(logfiles[i]->d_name, (size_t)st.st_size, &mtime, false /* current */);
+            }
+        }
+
+        free(logfiles[i]);
+    }
+    free(logfiles);
+
+    if (s_file_count > 1)
+    {
+        qsort(s_files, s_file_count, sizeof(s_files[0]), compare_files);
+    }
+
+    enforce_size_budget();
+
+    s_stop_requested = false;
+    s_compressor_started = (pthread_create(&s_compressor, NULL, compressor_main, NULL) == 0);
+
+    pthread_mutex_unlock(&s_index_mutex);
+
+    return total != -1;
+}
+
+void zlog_retention_finish(void)
+{
+    pthread_mutex_lock(&s_index_mutex);
+    s_stop_requested = true;
+    pthread_cond_signal(&s_index_cond);
+    pthread_mutex_unlock(&s_index_mutex);
+
+    if (s_compressor_started)
+    {
+        pthread_join(s_compressor, NULL);
+        s_compressor_started = false;
+    }
+
+    pthread_mutex_lock(&s_index_mutex);
+
+    while (s_file_count > 0)
+    {
+        remove_file_at(s_file_count - 1);
+    }
+
+    free(s_files);
+    s_files = NULL;
+    s_file_capacity = 0;
+
+    free(s_log_dir);
+    s_log_dir = NULL;
+
+    pthread_mutex_unlock(&s_index_mutex);
+}
+
+bool zlog_retention_has_file(const char* file_name)
+{
+    bool found = false;
+    char compressed_name[512];
+
+    pthread_mutex_lock(&s_index_mutex);
+
+    found = find_file(file_name) != NULL;
+    if (!found && snprintf(compressed_name, sizeof(compressed_name), "%s" COMPRESSED_FILE_SUFFIX, file_name) > 0)
+    {
+        found = find_file(compressed_name) != NULL;
+    }
+
+    pthread_mutex_unlock(&s_index_mutex);
+
+    return found;
+}
+
+void zlog_retention_file_opened(const char* file_name, int fd)
+{
+    struct timespec now;
+
+#if defined(__linux__)
+    // Keeps other processes from compressing or deleting it until it is closed.
+    (void)flock(fd, LOCK_SH);
+#else
+    (void)fd;
+#endif
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    pthread_mutex_lock(&s_index_mutex);
+
+    if (s_log_dir != NULL)
+    {
+        (void)add_file(file_name, 0, &now, true /* current */);
+        enforce_size_budget();
+    }
+
+    pthread_mutex_unlock(&s_index_mutex);
+}
+
+void zlog_retention_file_closed(const char* file_name, size_t size)
+{
+    pthread_mutex_lock(&s_index_mutex);
+
+    ZLOG_LOG_FILE* file = find_file(file_name);
+    if (file != NULL)
+    {
+        char path[512];
+        struct stat st;
+
+        file->current = false;
+        file->compressible = true;
+        file->size = size;
+
+        // The time of the last write.
+        if (format_path(path, sizeof(path), file_name, "") && stat(path, &st) == 0)
+        {
+#if defined(__linux__)
+            file->mtime = st.st_mtim;
+#else
+            file->mtime.tv_sec = st.st_mtime;
+#endif
+        }
+
+        enforce_size_budget();
+        pthread_cond_signal(&s_index_cond);
+    }
+
+    pthread_mutex_unlock(&s_index_mutex);
+}
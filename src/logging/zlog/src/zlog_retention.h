@@ -0,0 +1,37 @@
+/**
+ * @file zlog_retention.h
+ * @brief Keeps the index of the zlog log files, compresses the rotated ones, and deletes the oldest ones beyond the
+ * total size budget.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#ifndef ZLOG_RETENTION_H
+#define ZLOG_RETENTION_H
+
+#include <stdbool.h>
+#include <stddef.h> // size_t
+
+// Index the log files in log_dir whose name contains file_prefix, and start compressing the uncompressed ones on a
+// background thread. Leftovers of interrupted compressions are deleted. Files other processes write or compress are
+// left to them.
+// Return false if the directory cannot be scanned; the index is empty then.
+bool zlog_retention_init(const char* log_dir, const char* file_prefix);
+
+// Stop the compression thread, once the file being compressed is done, and release the index.
+// Files left uncompressed are compressed after the next zlog_retention_init.
+void zlog_retention_finish(void);
+
+// Return true if file_name, compressed or not, is in the index.
+bool zlog_retention_has_file(const char* file_name);
+
+// Add file_name, open as fd, to the index, as the file being written. Other processes do not compress or delete it
+// while fd is open.
+void zlog_retention_file_opened(const char* file_name, int fd);
+
+// Mark file_name, of size bytes, as rotated: it is compressed in the background, and the oldest files are deleted
+// until the total size fits in ZLOG_MAX_TOTAL_SIZE_KB.
+void zlog_retention_file_closed(const char* file_name, size_t size);
+
+#endif // ZLOG_RETENTION_H
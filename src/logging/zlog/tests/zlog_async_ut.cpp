@@ -0,0 +1,241 @@
+/**
+ * @file zlog_async_ut.cpp
+ * @brief Unit Tests for the queue of the zlog background writer.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "zlog.h"
+#include "zlog-config.h" // ZLOG_ASYNC_QUEUE_CAPACITY
+
+#include <aduc/system_utils.h> // ADUC_SystemUtils_MkDirRecursiveDefault, ADUC_SystemUtils_RmDirRecursive
+
+#include <catch2/catch_all.hpp>
+
+#include <cstdio>
+#include <cstring> // strlen
+#include <dirent.h>
+#include <fcntl.h> // open
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unistd.h> // dup, dup2, close
+#include <vector>
+
+static const char* k_logFile = "du-agent";
+
+class AsyncLogTestFixture
+{
+public:
+    AsyncLogTestFixture() : m_logDir{ std::string{ ADUC_SystemUtils_GetTemporaryPathName() } + "/zlog_async_ut" }
+    {
+        (void)ADUC_SystemUtils_RmDirRecursive(m_logDir.c_str());
+        REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault(m_logDir.c_str()) == 0);
+    }
+
+    ~AsyncLogTestFixture()
+    {
+        (void)ADUC_SystemUtils_RmDirRecursive(m_logDir.c_str());
+    }
+
+    AsyncLogTestFixture(const AsyncLogTestFixture&) = delete;
+    AsyncLogTestFixture& operator=(const AsyncLogTestFixture&) = delete;
+    AsyncLogTestFixture(AsyncLogTestFixture&&) = delete;
+    AsyncLogTestFixture& operator=(AsyncLogTestFixture&&) = delete;
+
+    const std::string& LogDir() const
+    {
+        return m_logDir;
+    }
+
+    // The lines of the log files, which stay below the size at which they are rotated.
+    std::vector<std::string> ReadLogLines() const
+    {
+        std::vector<std::string> lines;
+        DIR* dir = opendir(m_logDir.c_str());
+        REQUIRE(dir != nullptr);
+
+        for (const dirent* entry = readdir(dir); entry != nullptr; entry = readdir(dir))
+        {
+            const std::string name{ entry->d_name };
+            if (name.compare(0, strlen(k_logFile), k_logFile) != 0)
+            {
+                continue;
+            }
+
+            std::ifstream file{ m_logDir + "/" + name };
+            std::string line;
+            while (std::getline(file, line))
+            {
+                lines.push_back(line);
+            }
+        }
+
+        closedir(dir);
+        return lines;
+    }
+
+    // The (producer, index) of the lines logged with LogRecord, in the order they were written.
+    std::vector<std::pair<int, int>> ReadRecords() const
+    {
+        std::vector<std::pair<int, int>> records;
+
+        for (const std::string& line : ReadLogLines())
+        {
+            const size_t pos = line.find("] record ");
+            int producer = 0;
+            int index = 0;
+            if (pos != std::string::npos && sscanf(line.c_str() + pos, "] record %d %d", &producer, &index) == 2)
+            {
+                records.emplace_back(producer, index);
+            }
+        }
+
+        return records;
+    }
+
+    static void LogRecord(int producer, int index)
+    {
+        log_info("record %d %d", producer, index);
+    }
+
+private:
+    std::string m_logDir;
+};
+
+TEST_CASE_METHOD(AsyncLogTestFixture, "zlog writes the queued records in the order they were logged")
+{
+    // Fewer than the queue holds, so that none is dropped.
+    const int recordCount = ZLOG_ASYNC_QUEUE_CAPACITY - 16;
+    const unsigned long long droppedBefore = zlog_get_dropped_count();
+
+    REQUIRE(zlog_init(LogDir().c_str(), k_logFile, ZLOG_DISABLED, ZLOG_ENABLED, ZLOG_INFO, ZLOG_INFO) == 0);
+
+    for (int i = 0; i < recordCount; ++i)
+    {
+        LogRecord(0, i);
+    }
+
+    // Written once flushed, before zlog_finish.
+    zlog_flush_buffer();
+    const std::vector<std::pair<int, int>> records = ReadRecords();
+    zlog_finish();
+
+    CHECK(zlog_get_dropped_count() == droppedBefore);
+    REQUIRE(records.size() == static_cast<size_t>(recordCount));
+    for (int i = 0; i < recordCount; ++i)
+    {
+        CHECK(records[static_cast<size_t>(i)] == std::make_pair(0, i));
+    }
+}
+
+TEST_CASE_METHOD(AsyncLogTestFixture, "zlog_finish writes every queued record")
+{
+    const int recordCount = ZLOG_ASYNC_QUEUE_CAPACITY - 16;
+
+    REQUIRE(zlog_init(LogDir().c_str(), k_logFile, ZLOG_DISABLED, ZLOG_ENABLED, ZLOG_INFO, ZLOG_INFO) == 0);
+
+    for (int i = 0; i < recordCount; ++i)
+    {
+        LogRecord(0, i);
+    }
+
+    zlog_finish();
+
+    const std::vector<std::pair<int, int>> records = ReadRecords();
+    REQUIRE(records.size() == static_cast<size_t>(recordCount));
+    CHECK(records.front() == std::make_pair(0, 0));
+    CHECK(records.back() == std::make_pair(0, recordCount - 1));
+}
+
+TEST_CASE_METHOD(AsyncLogTestFixture, "zlog queues the records of concurrent threads")
+{
+    const int producerCount = 4;
+    const int recordsPerProducer = 80;
+    const unsigned long long droppedBefore = zlog_get_dropped_count();
+    std::vector<std::thread> producers;
+
+    REQUIRE(zlog_init(LogDir().c_str(), k_logFile, ZLOG_DISABLED, ZLOG_ENABLED, ZLOG_INFO, ZLOG_INFO) == 0);
+
+    for (int producer = 0; producer < producerCount; ++producer)
+    {
+        producers.emplace_back([producer]() {
+            for (int i = 0; i < recordsPerProducer; ++i)
+            {
+                LogRecord(producer, i);
+            }
+        });
+    }
+
+    for (std::thread& producer : producers)
+    {
+        producer.join();
+    }
+
+    zlog_finish();
+
+    // Each record is either written once or counted as dropped, and the records of a thread keep their order.
+    const std::vector<std::pair<int, int>> records = ReadRecords();
+    const unsigned long long dropped = zlog_get_dropped_count() - droppedBefore;
+    std::vector<int> nextIndex(producerCount, 0);
+
+    CHECK(records.size() + dropped == static_cast<size_t>(producerCount * recordsPerProducer));
+    for (const std::pair<int, int>& record : records)
+    {
+        REQUIRE(record.first >= 0);
+        REQUIRE(record.first < producerCount);
+        CHECK(record.second >= nextIndex[static_cast<size_t>(record.first)]);
+        nextIndex[static_cast<size_t>(record.first)] = record.second + 1;
+    }
+}
+
+TEST_CASE_METHOD(AsyncLogTestFixture, "zlog drops and counts the records logged while the queue is full")
+{
+    const int droppedCount = 44;
+    const int recordCount = ZLOG_ASYNC_QUEUE_CAPACITY + droppedCount;
+    const unsigned long long droppedBefore = zlog_get_dropped_count();
+    unsigned long long dropped = 0;
+
+    // The writer writes to the console first: while stdout is locked, it holds the first record, and the queue fills
+    // up. The console output goes to a file.
+    const std::string consolePath = LogDir() + "/console.txt";
+    fflush(stdout);
+    const int consoleFd = open(consolePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    const int stdoutFd = dup(STDOUT_FILENO);
+    REQUIRE(consoleFd >= 0);
+    REQUIRE(stdoutFd >= 0);
+    REQUIRE(dup2(consoleFd, STDOUT_FILENO) == STDOUT_FILENO);
+    close(consoleFd);
+
+    REQUIRE(zlog_init(LogDir().c_str(), k_logFile, ZLOG_ENABLED, ZLOG_ENABLED, ZLOG_INFO, ZLOG_INFO) == 0);
+
+    flockfile(stdout);
+    for (int i = 0; i < recordCount; ++i)
+    {
+        LogRecord(0, i);
+    }
+    dropped = zlog_get_dropped_count() - droppedBefore;
+    funlockfile(stdout);
+
+    zlog_finish();
+
+    fflush(stdout);
+    REQUIRE(dup2(stdoutFd, STDOUT_FILENO) == STDOUT_FILENO);
+    close(stdoutFd);
+
+    CHECK(dropped == static_cast<unsigned long long>(droppedCount));
+
+    // The records queued before it was full are written, and the loss is reported.
+    const std::vector<std::pair<int, int>> records = ReadRecords();
+    REQUIRE(records.size() == static_cast<size_t>(ZLOG_ASYNC_QUEUE_CAPACITY));
+    CHECK(records.front() == std::make_pair(0, 0));
+    CHECK(records.back() == std::make_pair(0, ZLOG_ASYNC_QUEUE_CAPACITY - 1));
+
+    bool lossReported = false;
+    for (const std::string& line : ReadLogLines())
+    {
+        lossReported = lossReported
+            || line.find("Log queue overflow: " + std::to_string(droppedCount) + " log(s) dropped") != std::string::npos;
+    }
+    CHECK(lossReported);
+}
@@ -0,0 +1,238 @@
+/**
+ * @file zlog_retention_ut.cpp
+ * @brief Unit Tests for the compression and deletion of the zlog log files.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+extern "C"
+{
+#include "zlog_retention.h"
+}
+
+#include <aduc/system_utils.h> // ADUC_SystemUtils_MkDirRecursiveDefault, ADUC_SystemUtils_RmDirRecursive
+
+#include <catch2/catch_all.hpp>
+
+#include <chrono>
+#include <fcntl.h> // open, AT_FDCWD
+#include <fstream>
+#include <functional>
+#include <string>
+#include <sys/file.h> // flock
+#include <sys/stat.h> // utimensat
+#include <sys/wait.h> // waitpid
+#include <thread>
+#include <unistd.h> // close, fork
+#include <vector>
+#include <zlib.h>
+
+static const char* k_prefix = "du-agent.";
+
+class RetentionTestFixture
+{
+public:
+    RetentionTestFixture() : m_logDir{ std::string{ ADUC_SystemUtils_GetTemporaryPathName() } + "/zlog_retention_ut" }
+    {
+        (void)ADUC_SystemUtils_RmDirRecursive(m_logDir.c_str());
+        REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault(m_logDir.c_str()) == 0);
+    }
+
+    ~RetentionTestFixture()
+    {
+        for (int fd : m_lockFds)
+        {
+            close(fd);
+        }
+
+        (void)ADUC_SystemUtils_RmDirRecursive(m_logDir.c_str());
+    }
+
+    RetentionTestFixture(const RetentionTestFixture&) = delete;
+    RetentionTestFixture& operator=(const RetentionTestFixture&) = delete;
+    RetentionTestFixture(RetentionTestFixture&&) = delete;
+    RetentionTestFixture& operator=(RetentionTestFixture&&) = delete;
+
+    const std::string& LogDir() const
+    {
+        return m_logDir;
+    }
+
+    std::string PathOf(const std::string& name) const
+    {
+        return m_logDir + "/" + name;
+    }
+
+    void WriteFile(const std::string& name, const std::string& content, time_t lastModified) const
+    {
+        {
+            std::ofstream file{ PathOf(name), std::ios::binary };
+            file << content;
+        }
+
+        const struct timespec times[2] = { { lastModified, 0 }, { lastModified, 0 } };
+        REQUIRE(utimensat(AT_FDCWD, PathOf(name).c_str(), times, 0) == 0);
+    }
+
+    bool Exists(const std::string& name) const
+    {
+        struct stat st = {};
+        return stat(PathOf(name).c_str(), &st) == 0;
+    }
+
+    std::string ReadCompressedFile(const std::string& name) const
+    {
+        std::string content;
+        char buffer[4096];
+        int readLen = 0;
+
+        gzFile file = gzopen(PathOf(name).c_str(), "rb");
+        REQUIRE(file != nullptr);
+        while ((readLen = gzread(file, buffer, sizeof(buffer))) > 0)
+        {
+            content.append(buffer, static_cast<size_t>(readLen));
+        }
+        gzclose(file);
+
+        return content;
+    }
+
+    // Holds a flock on the file, as another process writing (LOCK_SH) or compressing (LOCK_EX) it would.
+    void LockFile(const std::string& name, int operation)
+    {
+        const int fd = open(PathOf(name).c_str(), O_RDONLY | O_CLOEXEC);
+        REQUIRE(fd >= 0);
+        m_lockFds.push_back(fd);
+        REQUIRE(flock(fd, operation) == 0);
+    }
+
+    static bool WaitUntil(const std::function<bool()>& condition)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!condition())
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+            {
+                return false;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        return true;
+    }
+
+private:
+    std::string m_logDir;
+    std::vector<int> m_lockFds;
+};
+
+TEST_CASE_METHOD(RetentionTestFixture, "zlog_retention_init compresses the rotated log files")
+{
+    const std::string content(100 * 1024, 'a');
+    WriteFile("du-agent.20200101-000000.log", content, 1000);
+    WriteFile("du-agent.20200101-000000.log.gz.tmp", "interrupted", 1000);
+
+    REQUIRE(zlog_retention_init(LogDir().c_str(), k_prefix));
+
+    CHECK(WaitUntil([this]() { return !Exists("du-agent.20200101-000000.log"); }));
+    zlog_retention_finish();
+
+    CHECK(ReadCompressedFile("du-agent.20200101-000000.log.gz") == content);
+    CHECK_FALSE(Exists("du-agent.20200101-000000.log.gz.tmp"));
+
+    struct stat st = {};
+    REQUIRE(stat(PathOf("du-agent.20200101-000000.log.gz").c_str(), &st) == 0);
+    CHECK(st.st_mtime == 1000);
+}
+
+TEST_CASE_METHOD(RetentionTestFixture, "zlog_retention_init leaves the files of other processes")
+{
+    // Written by another process.
+    WriteFile("du-agent.20200101-000000.log", "written", 1000);
+    LockFile("du-agent.20200101-000000.log", LOCK_SH);
+
+    // Being compressed by another process.
+    WriteFile("du-agent.20200101-000001.log.gz.a1b2c3.tmp", "compressing", 1001);
+    LockFile("du-agent.20200101-000001.log.gz.a1b2c3.tmp", LOCK_EX);
+
+    // Newer, so compressed after the others were tried.
+    WriteFile("du-agent.20200101-000002.log", "rotated", 1002);
+
+    REQUIRE(zlog_retention_init(LogDir().c_str(), k_prefix));
+
+    CHECK(WaitUntil([this]() { return !Exists("du-agent.20200101-000002.log"); }));
+    zlog_retention_finish();
+
+    CHECK(Exists("du-agent.20200101-000000.log"));
+    CHECK_FALSE(Exists("du-agent.20200101-000000.log.gz"));
+    CHECK(Exists("du-agent.20200101-000001.log.gz.a1b2c3.tmp"));
+    CHECK(ReadCompressedFile("du-agent.20200101-000002.log.gz") == "rotated");
+}
+
+TEST_CASE_METHOD(RetentionTestFixture, "zlog_retention_init deletes the oldest files beyond the size budget")
+{
+    // Compressed already, so that the compression does not change the sizes.
+    const std::string content(100 * 1024, 'a');
+    WriteFile("du-agent.20200101-000000.log.gz", content, 1000);
+    WriteFile("du-agent.20200101-000001.log.gz", content, 2000);
+    WriteFile("du-agent.20200101-000002.log.gz", content, 3000);
+    WriteFile("du-agent.20200101-000003.log.gz", content, 4000);
+
+    SECTION("Oldest first")
+    {
+        REQUIRE(zlog_retention_init(LogDir().c_str(), k_prefix));
+        zlog_retention_finish();
+
+        CHECK_FALSE(Exists("du-agent.20200101-000000.log.gz"));
+        CHECK_FALSE(Exists("du-agent.20200101-000001.log.gz"));
+        CHECK(Exists("du-agent.20200101-000002.log.gz"));
+        CHECK(Exists("du-agent.20200101-000003.log.gz"));
+    }
+
+    SECTION("Except the files in use by another process")
+    {
+        LockFile("du-agent.20200101-000000.log.gz", LOCK_SH);
+
+        REQUIRE(zlog_retention_init(LogDir().c_str(), k_prefix));
+        zlog_retention_finish();
+
+        CHECK(Exists("du-agent.20200101-000000.log.gz"));
+        CHECK_FALSE(Exists("du-agent.20200101-000001.log.gz"));
+        CHECK_FALSE(Exists("du-agent.20200101-000002.log.gz"));
+        CHECK(Exists("du-agent.20200101-000003.log.gz"));
+    }
+}
+
+TEST_CASE_METHOD(RetentionTestFixture, "zlog_retention_init of two processes compresses each file once")
+{
+    // Within the size budget once compressed.
+    std::string content;
+    for (size_t i = 0; content.size() < 200 * 1024; ++i)
+    {
+        content += std::to_string(i);
+    }
+
+    WriteFile("du-agent.20200101-000000.log", content, 1000);
+
+    const pid_t child = fork();
+    REQUIRE(child >= 0);
+    if (child == 0)
+    {
+        const bool initialized = zlog_retention_init(LogDir().c_str(), k_prefix);
+        const bool compressed = WaitUntil([this]() { return !Exists("du-agent.20200101-000000.log"); });
+        zlog_retention_finish();
+        _exit(initialized && compressed ? 0 : 1);
+    }
+
+    REQUIRE(zlog_retention_init(LogDir().c_str(), k_prefix));
+    CHECK(WaitUntil([this]() { return !Exists("du-agent.20200101-000000.log"); }));
+    zlog_retention_finish();
+
+    int status = 0;
+    REQUIRE(waitpid(child, &status, 0) == child);
+    CHECK(WIFEXITED(status));
+    CHECK(WEXITSTATUS(status) == 0);
+
+    CHECK(ReadCompressedFile("du-agent.20200101-000000.log.gz") == content);
+}
@@ -0,0 +1,153 @@
+/**
+ * @file adushell_broker_utils.hpp
+ * @brief The protocol spoken between the agent and a long-lived adu-shell broker, and the agent side of it.
+ *
+ * @details A broker is an adu-shell process, started once with root privileges, that runs adu-shell tasks on
+ * behalf of the agent. It saves the exec, configuration parsing, logging setup and permission checks that a
+ * fresh adu-shell process does for every action.
+ *
+ * Each task uses its own connection to the broker's Unix domain socket:
+ *   agent  -> broker  Request frame: the adu-shell command-line arguments, separated by NUL characters.
+ *   broker -> agent   Output frames: one line of task output each, as it is written.
+ *   broker -> agent   Exit frame: the 32-bit big-endian exit status of the task.
+ *
+ * Both ends authenticate each other with the peer credentials of the socket: the broker only serves adu-shell
+ * trusted users and members of the adu-shell group, and the agent only talks to a broker run by root (or by its
+ * own user, which cannot give it any privilege it doesn't have).
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_ADUSHELL_BROKER_UTILS_HPP
+#define ADUC_ADUSHELL_BROKER_UTILS_HPP
+
+#include <aduc/config_utils.h> // ADUC_ConfigInfo
+#include <aduc/process_utils.hpp> // ADUC_ChildProcessOptions
+#include <aducpal/sys_types.h> // uid_t, gid_t
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The version of the broker protocol, sent in the header of every frame.
+ */
+#define ADUSHELL_BROKER_PROTOCOL_VERSION 1
+
+/**
+ * @brief The size of the largest frame payload either end accepts.
+ */
+#define ADUSHELL_BROKER_MAX_FRAME_SIZE (1024 * 1024)
+
+/**
+ * @brief The kinds of frame in the broker protocol.
+ */
+enum class ADUShellBrokerFrameType : uint8_t
+{
+    Request = 'Q', /**< The adu-shell arguments of a task. */
+    Output = 'O', /**< A line of output from a running task. */
+    Exit = 'X', /**< The exit status of a completed task. */
+};
+
+/**
+ * @brief How far a task sent to the broker got.
+ */
+enum class ADUShellBrokerTaskState
+{
+    Unavailable, /**< The broker could not be reached, so the task was not started. */
+    Failed, /**< The task was sent, but the connection to the broker failed before it completed. */
+    Completed, /**< The task completed, and its exit status is known. */
+};
+
+/**
+ * @brief Writes a frame to a connected socket.
+ *
+ * @param fd The socket.
+ * @param type The frame type.
+ * @param data The frame payload.
+ * @param size The size of @p data, at most ADUSHELL_BROKER_MAX_FRAME_SIZE.
+ * @return bool true if the whole frame was written.
+ */
+bool ADUShellBroker_WriteFrame(int fd, ADUShellBrokerFrameType type, const void* data, size_t size);
+
+/**
+ * @brief Reads a frame from a connected socket.
+ *
+ * @param fd The socket.
+ * @param[out] type The frame type.
+ * @param[out] payload The frame payload.
+ * @return bool true if a whole frame of a supported protocol version was read.
+ */
+bool ADUShellBroker_ReadFrame(int fd, ADUShellBrokerFrameType* type, std::string& payload);
+
+/**
+ * @brief Writes the exit frame that completes a task.
+ *
+ * @param fd The socket.
+ * @param exitCode The exit status of the task.
+ * @return bool true if the whole frame was written.
+ */
+bool ADUShellBroker_WriteExitFrame(int fd, int exitCode);
+
+/**
+ * @brief Encodes adu-shell arguments as the payload of a request frame.
+ *
+ * @param args The arguments, which must not contain NUL characters.
+ * @return std::string The payload.
+ */
+std::string ADUShellBroker_EncodeArgs(const std::vector<std::string>& args);
+
+/**
+ * @brief Decodes the payload of a request frame.
+ *
+ * @param payload The payload.
+ * @param[out] args The arguments.
+ */
+void ADUShellBroker_DecodeArgs(const std::string& payload, std::vector<std::string>& args);
+
+/**
+ * @brief Gets the credentials of the process at the other end of a connected Unix domain socket.
+ *
+ * @param fd The socket.
+ * @param[out] uid The user id of the peer.
+ * @param[out] gid The group id of the peer.
+ * @return bool true on success.
+ */
+bool ADUShellBroker_GetPeerCredentials(int fd, uid_t* uid, gid_t* gid);
+
+/**
+ * @brief Runs an adu-shell task in the broker listening on @p socketPath.
+ * @details Output lines go to the line sinks of @p options as they arrive. The timeout and cancellation check of
+ * @p options are not supported by the broker and are ignored.
+ *
+ * @param socketPath The socket of the broker.
+ * @param args The adu-shell arguments.
+ * @param options The line sinks and output limit.
+ * @param[out] output The output of the task, or its tail when over the limit.
+ * @param[out] exitCode The exit status of the task, when it completed.
+ * @return ADUShellBrokerTaskState How far the task got.
+ */
+ADUShellBrokerTaskState ADUShellBroker_RunTask(
+    const char* socketPath,
+    const std::vector<std::string>& args,
+    const ADUC_ChildProcessOptions& options,
+    std::string& output,
+    int* exitCode);
+
+/**
+ * @brief Runs an adu-shell task, in the configured broker when it is available, or in a new adu-shell process.
+ * @details A task is never run twice: when the broker fails after the task was sent, the task fails.
+ *
+ * @param config The agent configuration.
+ * @param args The adu-shell arguments.
+ * @param options The line sinks, output limit, timeout and cancellation check.
+ * @param[out] output The output of the task, or its tail when over the limit.
+ * @return int The adu-shell exit code.
+ */
+int ADUC_LaunchAduShell(
+    const ADUC_ConfigInfo* config,
+    const std::vector<std::string>& args,
+    const ADUC_ChildProcessOptions& options,
+    std::string& output);
+
+#endif // ADUC_ADUSHELL_BROKER_UTILS_HPP
@@ -0,0 +1,346 @@
+/**
+ * @file adushell_broker_utils.cpp
+ * @brief Implements the adu-shell broker protocol and the agent side of it.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/adushell_broker_utils.hpp"
+
+#include <aduc/logging.h>
+#include <aduc/string_c_utils.h> // IsNullOrEmpty
+
+#include <chrono>
+
+#ifndef WIN32
+#    include <errno.h>
+#    include <string.h>
+#    include <sys/socket.h>
+#    include <sys/un.h>
+#    include <unistd.h>
+#endif
+
+#ifndef WIN32 // Note: There is no adu-shell, and so no broker, on Windows.
+
+/**
+ * @brief The size of a frame header: version, type, two reserved bytes, and the big-endian payload size.
+ */
+#define ADUSHELL_BROKER_FRAME_HEADER_SIZE 8
+
+/**
+ * @brief Reads exactly @p size bytes from @p fd.
+ *
+ * @return bool false on error, or when the peer closed the connection first.
+ */
+static bool ReadAll(int fd, void* data, size_t size)
+{
+    auto* next = static_cast<uint8_t*>(data);
+    while (size > 0)
+    {
+        const ssize_t count = read(fd, next, size);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (count <= 0)
+        {
+            return false;
+        }
+
+        next += count;
+        size -= static_cast<size_t>(count);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Writes exactly @p size bytes to the socket @p fd, without raising SIGPIPE when the peer is gone.
+ */
+static bool SendAll(int fd, const void* data, size_t size)
+{
+    const auto* next = static_cast<const uint8_t*>(data);
+    while (size > 0)
+    {
+        const ssize_t count = send(fd, next, size, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (count <= 0)
+        {
+            return false;
+        }
+
+        next += count;
+        size -= static_cast<size_t>(count);
+    }
+
+    return true;
+}
+
+bool ADUShellBroker_WriteFrame(int fd, ADUShellBrokerFrameType type, const void* data, size_t size)
+{
+    if (size > ADUSHELL_BROKER_MAX_FRAME_SIZE)
+    {
+        Log_Error("adu-shell broker frame of %zu bytes is too large.", size);
+        return false;
+    }
+
+    // Write the header and payload at once, so that a frame is never split across two small segments.
+    std::string frame(ADUSHELL_BROKER_FRAME_HEADER_SIZE, '\0');
+    frame[0] = static_cast<char>(ADUSHELL_BROKER_PROTOCOL_VERSION);
+    frame[1] = static_cast<char>(type);
+    frame[4] = static_cast<char>((size >> 24) & 0xFF);
+    frame[5] = static_cast<char>((size >> 16) & 0xFF);
+    frame[6] = static_cast<char>((size >> 8) & 0xFF);
+    frame[7] = static_cast<char>(size & 0xFF);
+    frame.append(static_cast<const char*>(data), size);
+
+    return SendAll(fd, frame.data(), frame.size());
+}
+
+bool ADUShellBroker_ReadFrame(int fd, ADUShellBrokerFrameType* type, std::string& payload)
+{
+    uint8_t header[ADUSHELL_BROKER_FRAME_HEADER_SIZE];
+
+    if (!ReadAll(fd, header, sizeof(header)))
+    {
+        return false;
+    }
+
+    if (header[0] != ADUSHELL_BROKER_PROTOCOL_VERSION)
+    {
+        Log_Error("Unsupported adu-shell broker protocol version %u.", header[0]);
+        return false;
+    }
+
+    const size_t size = (static_cast<size_t>(header[4]) << 24) | (static_cast<size_t>(header[5]) << 16)
+        | (static_cast<size_t>(header[6]) << 8) | static_cast<size_t>(header[7]);
+    if (size > ADUSHELL_BROKER_MAX_FRAME_SIZE)
+    {
+        Log_Error("adu-shell broker frame of %zu bytes is too large.", size);
+        return false;
+    }
+
+    *type = static_cast<ADUShellBrokerFrameType>(header[1]);
+    payload.resize(size);
+
+    return size == 0 || ReadAll(fd, &payload[0], size);
+}
+
+bool ADUShellBroker_WriteExitFrame(int fd, int exitCode)
+{
+    const auto status = static_cast<uint32_t>(exitCode);
+    const uint8_t payload[] = { static_cast<uint8_t>((status >> 24) & 0xFF),
+                                static_cast<uint8_t>((status >> 16) & 0xFF),
+                                static_cast<uint8_t>((status >> 8) & 0xFF),
+                                static_cast<uint8_t>(status & 0xFF) };
+
+    return ADUShellBroker_WriteFrame(fd, ADUShellBrokerFrameType::Exit, payload, sizeof(payload));
+}
+
+std::string ADUShellBroker_EncodeArgs(const std::vector<std::string>& args)
+{
+    std::string payload;
+    for (const std::string& arg : args)
+    {
+        payload += arg;
+        payload += '\0';
+    }
+
+    return payload;
+}
+
+void ADUShellBroker_DecodeArgs(const std::string& payload, std::vector<std::string>& args)
+{
+    args.clear();
+
+    size_t start = 0;
+    while (start < payload.size())
+    {
+        size_t end = payload.find('\0', start);
+        if (end == std::string::npos)
+        {
+            end = payload.size();
+        }
+
+        args.emplace_back(payload, start, end - start);
+        start = end + 1;
+    }
+}
+
+bool ADUShellBroker_GetPeerCredentials(int fd, uid_t* uid, gid_t* gid)
+{
+    struct ucred credentials = {};
+    socklen_t size = sizeof(credentials);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) != 0)
+    {
+        Log_Error("Cannot get the peer credentials of the adu-shell broker connection, error %d", errno);
+        return false;
+    }
+
+    *uid = credentials.uid;
+    *gid = credentials.gid;
+    return true;
+}
+
+ADUShellBrokerTaskState ADUShellBroker_RunTask(
+    const char* socketPath,
+    const std::vector<std::string>& args,
+    const ADUC_ChildProcessOptions& options,
+    std::string& output,
+    int* exitCode)
+{
+    ADUShellBrokerTaskState state = ADUShellBrokerTaskState::Unavailable;
+    struct sockaddr_un address = {};
+    uid_t brokerUid = 0;
+    gid_t brokerGid = 0;
+    ADUShellBrokerFrameType type = ADUShellBrokerFrameType::Request;
+    std::string payload;
+    const size_t maxOutputSize = options.maxOutputSizeInBytes;
+
+    output.clear();
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        Log_Error("Cannot create adu-shell broker socket, error %d", errno);
+        goto done;
+    }
+
+    if (strlen(socketPath) >= sizeof(address.sun_path))
+    {
+        Log_Error("adu-shell broker socket path '%s' is too long.", socketPath);
+        goto done;
+    }
+
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        Log_Debug("Cannot connect to adu-shell broker at '%s', error %d", socketPath, errno);
+        goto done;
+    }
+
+    if (!ADUShellBroker_GetPeerCredentials(fd, &brokerUid, &brokerGid))
+    {
+        goto done;
+    }
+
+    if (brokerUid != 0 && brokerUid != geteuid())
+    {
+        Log_Error("adu-shell broker at '%s' is run by untrusted user %d.", socketPath, static_cast<int>(brokerUid));
+        goto done;
+    }
+
+    payload = ADUShellBroker_EncodeArgs(args);
+
+    // The broker only starts a task once it has read the whole request, so a failed write means it did not start.
+    if (!ADUShellBroker_WriteFrame(fd, ADUShellBrokerFrameType::Request, payload.data(), payload.size()))
+    {
+        Log_Warn("Cannot send task to adu-shell broker at '%s', error %d", socketPath, errno);
+        goto done;
+    }
+
+    state = ADUShellBrokerTaskState::Failed;
+
+    while (ADUShellBroker_ReadFrame(fd, &type, payload))
+    {
+        if (type == ADUShellBrokerFrameType::Output)
+        {
+            if (options.outputLineSink)
+            {
+                options.outputLineSink(payload);
+            }
+
+            output += payload;
+            output += '\n';
+
+            // Trim only once the output is twice the limit, so that each byte is moved at most once or twice.
+            if (maxOutputSize != 0 && output.size() > 2 * maxOutputSize)
+            {
+                output.erase(0, output.size() - maxOutputSize);
+            }
+        }
+        else if (type == ADUShellBrokerFrameType::Exit && payload.size() == 4)
+        {
+            const auto* status = reinterpret_cast<const uint8_t*>(payload.data());
+            *exitCode = static_cast<int>(
+                (static_cast<uint32_t>(status[0]) << 24) | (static_cast<uint32_t>(status[1]) << 16)
+                | (static_cast<uint32_t>(status[2]) << 8) | static_cast<uint32_t>(status[3]));
+            state = ADUShellBrokerTaskState::Completed;
+            break;
+        }
+        else
+        {
+            Log_Error("Unexpected adu-shell broker frame, type %d size %zu.", static_cast<int>(type), payload.size());
+            break;
+        }
+    }
+
+    if (state == ADUShellBrokerTaskState::Failed)
+    {
+        Log_Error("Lost the connection to adu-shell broker at '%s' while a task was running.", socketPath);
+    }
+
+    if (maxOutputSize != 0 && output.size() > maxOutputSize)
+    {
+        output.erase(0, output.size() - maxOutputSize);
+    }
+
+done:
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    return state;
+}
+
+#endif // #ifndef WIN32
+
+int ADUC_LaunchAduShell(
+    const ADUC_ConfigInfo* config,
+    const std::vector<std::string>& args,
+    const ADUC_ChildProcessOptions& options,
+    std::string& output)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const auto elapsedMilliseconds = [&start]() {
+        return static_cast<long long>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+    };
+
+#ifndef WIN32
+    if (!IsNullOrEmpty(config->aduShellBrokerSocketPath))
+    {
+        int exitCode = EXIT_FAILURE;
+
+        switch (ADUShellBroker_RunTask(config->aduShellBrokerSocketPath, args, options, output, &exitCode))
+        {
+        case ADUShellBrokerTaskState::Completed:
+            Log_Debug("adu-shell broker task exited with %d after %lld ms.", exitCode, elapsedMilliseconds());
+            return exitCode;
+
+        case ADUShellBrokerTaskState::Failed:
+            return EXIT_FAILURE;
+
+        case ADUShellBrokerTaskState::Unavailable:
+            Log_Warn(
+                "adu-shell broker at '%s' is unavailable, launching adu-shell instead.",
+                config->aduShellBrokerSocketPath);
+            break;
+        }
+    }
+#endif // #ifndef WIN32
+
+    const int exitCode = ADUC_LaunchChildProcessWithOptions(config->aduShellFilePath, args, options, output);
+    Log_Debug("adu-shell exited with %d after %lld ms.", exitCode, elapsedMilliseconds());
+
+    return exitCode;
+}
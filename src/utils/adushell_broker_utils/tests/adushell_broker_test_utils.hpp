@@ -0,0 +1,102 @@
+/**
+ * @file adushell_broker_test_utils.hpp
+ * @brief A stand-in for the adu-shell broker, serving connections on a temporary socket with a test handler.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUSHELL_BROKER_TEST_UTILS_HPP
+#define ADUSHELL_BROKER_TEST_UTILS_HPP
+
+#include "aduc/adushell_broker_utils.hpp"
+
+#include <cstdlib> // mkdtemp
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+class FakeAduShellBroker
+{
+public:
+    explicit FakeAduShellBroker(std::function<void(int fd)> handler) : _handler(std::move(handler))
+    {
+        char folder[] = "/tmp/adushell_broker_ut_XXXXXX";
+        if (mkdtemp(folder) == nullptr)
+        {
+            throw std::runtime_error("mkdtemp failed");
+        }
+
+        _folder = folder;
+        _socketPath = _folder + "/broker.sock";
+
+        struct sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, _socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+        _listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (_listenFd < 0
+            || bind(_listenFd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0
+            || listen(_listenFd, 16) != 0)
+        {
+            throw std::runtime_error("cannot listen on fake broker socket");
+        }
+
+        _thread = std::thread{ [this]() {
+            for (;;)
+            {
+                const int fd = accept4(_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd < 0)
+                {
+                    return;
+                }
+
+                _handler(fd);
+                close(fd);
+            }
+        } };
+    }
+
+    FakeAduShellBroker(const FakeAduShellBroker&) = delete;
+    FakeAduShellBroker& operator=(const FakeAduShellBroker&) = delete;
+    FakeAduShellBroker(FakeAduShellBroker&&) = delete;
+    FakeAduShellBroker& operator=(FakeAduShellBroker&&) = delete;
+
+    ~FakeAduShellBroker()
+    {
+        // Wakes the blocked accept4.
+        shutdown(_listenFd, SHUT_RDWR);
+        _thread.join();
+        close(_listenFd);
+        unlink(_socketPath.c_str());
+        rmdir(_folder.c_str());
+    }
+
+    const char* SocketPath() const
+    {
+        return _socketPath.c_str();
+    }
+
+    static void WriteOutput(int fd, const std::string& line)
+    {
+        ADUShellBroker_WriteFrame(fd, ADUShellBrokerFrameType::Output, line.data(), line.size());
+    }
+
+    static void WriteExit(int fd, int exitCode)
+    {
+        ADUShellBroker_WriteExitFrame(fd, exitCode);
+    }
+
+private:
+    std::function<void(int fd)> _handler;
+    std::string _folder;
+    std::string _socketPath;
+    int _listenFd = -1;
+    std::thread _thread;
+};
+
+#endif // ADUSHELL_BROKER_TEST_UTILS_HPP
@@ -0,0 +1,66 @@
+/**
+ * @file adushell_broker_utils_benchmark.cpp
+ * @brief Compares the per-action overhead of sending a task to an adu-shell broker with launching a process for it.
+ *
+ * @details Hidden from the default run. Run it with:
+ *   adushell_broker_utils_unit_tests "[benchmark]"
+ *
+ * Both sides do no work: the process is 'true', and the broker replies with the exit frame straight away. A real
+ * adu-shell launch costs more than 'true', as it also reads du-config.json, sets up logging and checks the trusted
+ * users, so the launch figures are a lower bound of what the broker saves.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/adushell_broker_utils.hpp"
+#include "adushell_broker_test_utils.hpp"
+
+#include <catch2/catch_all.hpp>
+
+#include <chrono>
+#include <cstdio> // printf
+#include <string>
+#include <vector>
+
+TEST_CASE("adu-shell per-action latency, broker and launch", "[.hide][benchmark]")
+{
+    const int iterations = 500;
+    const std::vector<std::string> args{ "--update-type", "common", "--update-action", "reboot" };
+    const ADUC_ChildProcessOptions options;
+    std::string output;
+
+    FakeAduShellBroker broker{ [](int fd) {
+        ADUShellBrokerFrameType type = ADUShellBrokerFrameType::Exit;
+        std::string payload;
+        if (ADUShellBroker_ReadFrame(fd, &type, payload))
+        {
+            FakeAduShellBroker::WriteExit(fd, 0);
+        }
+    } };
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        int exitCode = -1;
+        REQUIRE(
+            ADUShellBroker_RunTask(broker.SocketPath(), args, options, output, &exitCode)
+            == ADUShellBrokerTaskState::Completed);
+    }
+    const auto brokerDuration = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        REQUIRE(ADUC_LaunchChildProcessWithOptions("true", args, options, output) == 0);
+    }
+    const auto launchDuration = std::chrono::steady_clock::now() - start;
+
+    const auto perAction = [iterations](std::chrono::steady_clock::duration duration) {
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count())
+            / iterations;
+    };
+
+    printf("%-10s %14s\n", "path", "us per action");
+    printf("%-10s %14.1f\n", "broker", perAction(brokerDuration));
+    printf("%-10s %14.1f\n", "launch", perAction(launchDuration));
+}
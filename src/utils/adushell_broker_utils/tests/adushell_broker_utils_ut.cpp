@@ -0,0 +1,186 @@
+/**
+ * @file adushell_broker_utils_ut.cpp
+ * @brief Unit Tests for adushell_broker_utils library
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/adushell_broker_utils.hpp"
+#include "adushell_broker_test_utils.hpp"
+
+#include <catch2/catch_all.hpp>
+
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+using Catch::Matchers::Equals;
+
+TEST_CASE("ADUShellBroker_EncodeArgs and ADUShellBroker_DecodeArgs")
+{
+    const std::vector<std::string> args{ "--update-type", "microsoft/apt", "--target-data", "", "a b c" };
+    std::vector<std::string> decoded;
+
+    ADUShellBroker_DecodeArgs(ADUShellBroker_EncodeArgs(args), decoded);
+
+    CHECK(decoded == args);
+}
+
+TEST_CASE("ADUShellBroker_WriteFrame and ADUShellBroker_ReadFrame")
+{
+    int fds[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    SECTION("Round trip")
+    {
+        const std::string line{ "Reading package lists..." };
+        ADUShellBrokerFrameType type = ADUShellBrokerFrameType::Request;
+        std::string payload;
+
+        REQUIRE(ADUShellBroker_WriteFrame(fds[0], ADUShellBrokerFrameType::Output, line.data(), line.size()));
+        REQUIRE(ADUShellBroker_WriteFrame(fds[0], ADUShellBrokerFrameType::Exit, "\0\0\0\0", 4));
+
+        REQUIRE(ADUShellBroker_ReadFrame(fds[1], &type, payload));
+        CHECK(type == ADUShellBrokerFrameType::Output);
+        CHECK_THAT(payload, Equals(line));
+
+        REQUIRE(ADUShellBroker_ReadFrame(fds[1], &type, payload));
+        CHECK(type == ADUShellBrokerFrameType::Exit);
+        CHECK(payload.size() == 4);
+    }
+
+    SECTION("Oversized frame is not written")
+    {
+        const std::string tooLarge(ADUSHELL_BROKER_MAX_FRAME_SIZE + 1, 'x');
+        CHECK_FALSE(
+            ADUShellBroker_WriteFrame(fds[0], ADUShellBrokerFrameType::Output, tooLarge.data(), tooLarge.size()));
+    }
+
+    SECTION("Unknown protocol version is rejected")
+    {
+        const uint8_t header[] = { ADUSHELL_BROKER_PROTOCOL_VERSION + 1, 'O', 0, 0, 0, 0, 0, 0 };
+        ADUShellBrokerFrameType type = ADUShellBrokerFrameType::Request;
+        std::string payload;
+
+        REQUIRE(write(fds[0], header, sizeof(header)) == sizeof(header));
+        CHECK_FALSE(ADUShellBroker_ReadFrame(fds[1], &type, payload));
+    }
+
+    SECTION("Truncated frame is rejected")
+    {
+        const uint8_t header[] = { ADUSHELL_BROKER_PROTOCOL_VERSION, 'O', 0, 0, 0, 0, 0, 10, 'a', 'b' };
+        ADUShellBrokerFrameType type = ADUShellBrokerFrameType::Request;
+        std::string payload;
+
+        REQUIRE(write(fds[0], header, sizeof(header)) == sizeof(header));
+        close(fds[0]);
+        fds[0] = -1;
+        CHECK_FALSE(ADUShellBroker_ReadFrame(fds[1], &type, payload));
+    }
+
+    if (fds[0] >= 0)
+    {
+        close(fds[0]);
+    }
+    close(fds[1]);
+}
+
+TEST_CASE("ADUShellBroker_RunTask")
+{
+    ADUC_ChildProcessOptions options;
+    std::vector<std::string> lines;
+    options.outputLineSink = [&lines](const std::string& line) { lines.push_back(line); };
+
+    const std::vector<std::string> args{ "--update-type", "microsoft/script", "--update-action", "execute" };
+    std::string output;
+    int exitCode = -1;
+
+    SECTION("Streams output and returns the exit status")
+    {
+        std::vector<std::string> receivedArgs;
+        FakeAduShellBroker broker{ [&receivedArgs](int fd) {
+            ADUShellBrokerFrameType type = ADUShellBrokerFrameType::Exit;
+            std::string payload;
+            if (ADUShellBroker_ReadFrame(fd, &type, payload) && type == ADUShellBrokerFrameType::Request)
+            {
+                ADUShellBroker_DecodeArgs(payload, receivedArgs);
+                FakeAduShellBroker::WriteOutput(fd, "first");
+                FakeAduShellBroker::WriteOutput(fd, "second");
+                FakeAduShellBroker::WriteExit(fd, 42);
+            }
+        } };
+
+        const ADUShellBrokerTaskState state =
+            ADUShellBroker_RunTask(broker.SocketPath(), args, options, output, &exitCode);
+
+        CHECK(state == ADUShellBrokerTaskState::Completed);
+        CHECK(exitCode == 42);
+        CHECK(receivedArgs == args);
+        CHECK(lines == std::vector<std::string>{ "first", "second" });
+        CHECK_THAT(output, Equals("first\nsecond\n"));
+    }
+
+    SECTION("Keeps the tail of the output")
+    {
+        options.maxOutputSizeInBytes = 16;
+        FakeAduShellBroker broker{ [](int fd) {
+            ADUShellBrokerFrameType type = ADUShellBrokerFrameType::Exit;
+            std::string payload;
+            if (ADUShellBroker_ReadFrame(fd, &type, payload))
+            {
+                for (int i = 0; i < 100; ++i)
+                {
+                    FakeAduShellBroker::WriteOutput(fd, "line " + std::to_string(i));
+                }
+                FakeAduShellBroker::WriteExit(fd, 0);
+            }
+        } };
+
+        CHECK(
+            ADUShellBroker_RunTask(broker.SocketPath(), args, options, output, &exitCode)
+            == ADUShellBrokerTaskState::Completed);
+        CHECK(lines.size() == 100);
+        CHECK_THAT(output, Equals("line 98\nline 99\n"));
+    }
+
+    SECTION("Broker that goes away during the task fails it")
+    {
+        FakeAduShellBroker broker{ [](int fd) {
+            ADUShellBrokerFrameType type = ADUShellBrokerFrameType::Exit;
+            std::string payload;
+            if (ADUShellBroker_ReadFrame(fd, &type, payload))
+            {
+                FakeAduShellBroker::WriteOutput(fd, "partial");
+            }
+        } };
+
+        CHECK(
+            ADUShellBroker_RunTask(broker.SocketPath(), args, options, output, &exitCode)
+            == ADUShellBrokerTaskState::Failed);
+        CHECK(lines == std::vector<std::string>{ "partial" });
+    }
+
+    SECTION("Missing broker is unavailable")
+    {
+        CHECK(
+            ADUShellBroker_RunTask("/nonexistent/adu-shell-broker.sock", args, options, output, &exitCode)
+            == ADUShellBrokerTaskState::Unavailable);
+        CHECK(lines.empty());
+    }
+}
+
+TEST_CASE("ADUC_LaunchAduShell launches adu-shell when the broker is unavailable")
+{
+    ADUC_ConfigInfo config = {};
+    char aduShellFilePath[] = "echo";
+    config.aduShellFilePath = aduShellFilePath;
+    config.aduShellBrokerSocketPath = "/nonexistent/adu-shell-broker.sock";
+
+    std::string output;
+    const int exitCode =
+        ADUC_LaunchAduShell(&config, std::vector<std::string>{ "launched" }, ADUC_ChildProcessOptions{}, output);
+
+    CHECK(exitCode == 0);
+    CHECK_THAT(output, Equals("launched\n"));
+}
@@ -0,0 +1,68 @@
+/**
+ * @file component_index.hpp
+ * @brief Per-property inverted indexes over a set of components, and component selectors compiled against them.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_COMPONENT_INDEX_HPP
+#define ADUC_COMPONENT_INDEX_HPP
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ADUC
+{
+/**
+ * @brief The string properties of a component, or of a selector, as name-value pairs.
+ */
+using ComponentProperties = std::vector<std::pair<std::string, std::string>>;
+
+/**
+ * @brief A selector compiled against a ComponentIndex: the posting lists to intersect, smallest first.
+ * @details It is only valid until the index it was compiled against is rebuilt.
+ */
+struct CompiledComponentSelector
+{
+    bool matchesNothing = false; /**< A property of the selector is not in any component. */
+    std::vector<const std::vector<uint32_t>*> postings; /**< Empty when the selector matches all components. */
+};
+
+/**
+ * @brief Maps each property name and value to the ascending positions of the components that have it.
+ */
+class ComponentIndex
+{
+public:
+    /**
+     * @brief Replaces the index with one over @p components. A component's position is its index in @p components.
+     */
+    void Build(const std::vector<ComponentProperties>& components);
+
+    /**
+     * @brief Compiles a selector, which matches the components that have all its properties.
+     * @details An empty selector matches all components. A property with an empty name or value matches none.
+     */
+    CompiledComponentSelector Compile(const ComponentProperties& selector) const;
+
+    /**
+     * @brief Gets the ascending positions of the components that match a selector compiled against this index.
+     */
+    std::vector<uint32_t> Select(const CompiledComponentSelector& selector) const;
+
+    size_t GetComponentCount() const
+    {
+        return _componentCount;
+    }
+
+private:
+    size_t _componentCount = 0;
+    std::unordered_map<std::string, std::unordered_map<std::string, std::vector<uint32_t>>> _postings;
+};
+
+} // namespace ADUC
+
+#endif // ADUC_COMPONENT_INDEX_HPP
@@ -0,0 +1,103 @@
+/**
+ * @file component_inventory.hpp
+ * @brief An in-memory component inventory for component enumerators, indexed by property and reloaded only when the
+ * files it was loaded from change.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_COMPONENT_INVENTORY_HPP
+#define ADUC_COMPONENT_INVENTORY_HPP
+
+#include "aduc/component_index.hpp"
+#include "aduc/file_change_watch.hpp"
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <parson.h>
+
+namespace ADUC
+{
+/**
+ * @brief The components of a device, as loaded by a component enumerator.
+ * @details The loader returns a JSON value whose "components" array holds one object per component, and reports the
+ * files it read. The components' top-level string properties are indexed, and each distinct selector is compiled once
+ * into an intersection of those indexes. The inventory is loaded again on the first call after any of the files
+ * changes, and all compiled selectors are dropped with it.
+ *
+ * All methods are thread-safe.
+ */
+class ComponentInventory
+{
+public:
+    /**
+     * @brief Loads the components, adding the path of each file it reads, or would read if it existed, to
+     * @p sourceFiles. Returns nullptr on failure. The inventory takes ownership of the value.
+     */
+    using Loader = std::function<JSON_Value*(std::vector<std::string>& sourceFiles)>;
+
+    explicit ComponentInventory(Loader loader);
+    ~ComponentInventory();
+
+    ComponentInventory(const ComponentInventory&) = delete;
+    ComponentInventory& operator=(const ComponentInventory&) = delete;
+    ComponentInventory(ComponentInventory&&) = delete;
+    ComponentInventory& operator=(ComponentInventory&&) = delete;
+
+    /**
+     * @brief Selects the components that have all the string properties of @p selectorJson.
+     * @details An empty selector object selects all components. A selector property that is not a non-empty string
+     * selects none.
+     *
+     * @param selectorJson A stringified JSON object, e.g. "{\"group\":\"motors\"}".
+     * @return char* A serialized JSON object with a "components" array of the selected components, in inventory
+     * order, or nullptr if the selector is not a JSON object or the inventory cannot be loaded. Caller must free it
+     * with json_free_serialized_string.
+     */
+    char* SelectComponents(const char* selectorJson);
+
+    /**
+     * @brief Gets the whole inventory.
+     *
+     * @return char* The serialized JSON value from the loader, or nullptr if it cannot be loaded. Caller must free it
+     * with json_free_serialized_string.
+     */
+    char* GetAllComponents();
+
+    /**
+     * @brief Gets the number of components, loading the inventory if needed.
+     */
+    size_t GetComponentCount();
+
+    /**
+     * @brief Makes the next call load the inventory again, e.g. after a change the watched files do not show.
+     */
+    void Invalidate();
+
+    /**
+     * @brief Sets how many compiled selectors are kept. They are all dropped when more are needed.
+     */
+    void SetMaxCompiledSelectors(size_t maxCompiledSelectors);
+
+private:
+    bool EnsureLoaded();
+    void Unload();
+
+    Loader _loader;
+    std::mutex _mutex;
+    bool _loaded = false;
+    JSON_Value* _rootValue = nullptr;
+    JSON_Array* _components = nullptr;
+    ComponentIndex _index;
+    FileChangeWatch _watch;
+    std::unordered_map<std::string, CompiledComponentSelector> _compiledSelectors;
+    size_t _maxCompiledSelectors = 256;
+};
+
+} // namespace ADUC
+
+#endif // ADUC_COMPONENT_INVENTORY_HPP
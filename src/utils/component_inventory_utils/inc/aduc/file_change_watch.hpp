@@ -0,0 +1,93 @@
+/**
+ * @file file_change_watch.hpp
+ * @brief Tells whether any of a set of files was created, changed, replaced or removed since it was last loaded.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_FILE_CHANGE_WATCH_HPP
+#define ADUC_FILE_CHANGE_WATCH_HPP
+
+#include <ctime> // timespec
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace ADUC
+{
+/**
+ * @brief Watches the files that some loaded data came from.
+ * @details The folders of the files are watched with inotify, so that checking for a change costs one non-blocking
+ * read. When a folder cannot be watched, e.g. it does not exist or the inotify watch limit is reached, each check
+ * stat's every file instead.
+ */
+class FileChangeWatch
+{
+public:
+    FileChangeWatch() = default;
+    ~FileChangeWatch();
+
+    FileChangeWatch(const FileChangeWatch&) = delete;
+    FileChangeWatch& operator=(const FileChangeWatch&) = delete;
+    FileChangeWatch(FileChangeWatch&&) = delete;
+    FileChangeWatch& operator=(FileChangeWatch&&) = delete;
+
+    /**
+     * @brief Gets the time to pass to Watch, taken just before the files are read.
+     */
+    static struct timespec Now();
+
+    /**
+     * @brief Starts watching @p filePaths, replacing the files watched before.
+     *
+     * @param filePaths The files that were read. They do not have to exist.
+     * @param readStartTime The time from Now, taken before the files were read. A file changed after it counts as
+     * changed straight away, as it may have changed after it was read.
+     */
+    void Watch(const std::vector<std::string>& filePaths, const struct timespec& readStartTime);
+
+    /**
+     * @brief Tells whether a watched file changed since Watch. Once true, it stays true until the next Watch.
+     */
+    bool HasChanged();
+
+    /**
+     * @brief Tells whether the files are watched with inotify rather than stat'ed. Used by tests.
+     */
+    bool IsUsingNotifications() const
+    {
+        return _notifyFd >= 0;
+    }
+
+private:
+    /**
+     * @brief The stat of a file when it was watched, or a missing file.
+     */
+    struct FileState
+    {
+        bool exists = false;
+        unsigned long long device = 0;
+        unsigned long long inode = 0;
+        long long size = 0;
+        struct timespec changeTime = {};
+        struct timespec modifyTime = {};
+    };
+
+    static FileState GetFileState(const std::string& filePath);
+    static bool IsSameFileState(const FileState& a, const FileState& b);
+
+    bool StartNotifications(const std::vector<std::string>& filePaths);
+    void StopNotifications();
+    bool ReadNotifications();
+
+    bool _changed = false;
+    std::vector<std::pair<std::string, FileState>> _files;
+    int _notifyFd = -1;
+    std::unordered_map<int, std::unordered_set<std::string>> _watchedNames; /**< Watched file names by folder. */
+};
+
+} // namespace ADUC
+
+#endif // ADUC_FILE_CHANGE_WATCH_HPP
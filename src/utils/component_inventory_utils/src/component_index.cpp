@@ -0,0 +1,129 @@
+/**
+ * @file component_index.cpp
+ * @brief Implements the per-property inverted indexes over a set of components.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/component_index.hpp"
+
+#include <algorithm>
+
+namespace ADUC
+{
+void ComponentIndex::Build(const std::vector<ComponentProperties>& components)
+{
+    _postings.clear();
+    _componentCount = components.size();
+
+    for (size_t i = 0; i < components.size(); ++i)
+    {
+        const auto position = static_cast<uint32_t>(i);
+        for (const auto& property : components[i])
+        {
+            // Components are visited in order, so each posting list is built already sorted.
+            std::vector<uint32_t>& posting = _postings[property.first][property.second];
+            if (posting.empty() || posting.back() != position)
+            {
+                posting.push_back(position);
+            }
+        }
+    }
+}
+
+CompiledComponentSelector ComponentIndex::Compile(const ComponentProperties& selector) const
+{
+    CompiledComponentSelector compiled;
+
+    for (const auto& property : selector)
+    {
+        if (property.first.empty() || property.second.empty())
+        {
+            compiled.matchesNothing = true;
+            break;
+        }
+
+        const auto values = _postings.find(property.first);
+        if (values == _postings.end())
+        {
+            compiled.matchesNothing = true;
+            break;
+        }
+
+        const auto posting = values->second.find(property.second);
+        if (posting == values->second.end())
+        {
+            compiled.matchesNothing = true;
+            break;
+        }
+
+        compiled.postings.push_back(&posting->second);
+    }
+
+    if (compiled.matchesNothing)
+    {
+        compiled.postings.clear();
+        return compiled;
+    }
+
+    // Intersecting from the smallest list bounds the work by the most selective property.
+    std::sort(
+        compiled.postings.begin(),
+        compiled.postings.end(),
+        [](const std::vector<uint32_t>* a, const std::vector<uint32_t>* b) { return a->size() < b->size(); });
+
+    compiled.postings.erase(
+        std::unique(compiled.postings.begin(), compiled.postings.end()), compiled.postings.end());
+
+    return compiled;
+}
+
+std::vector<uint32_t> ComponentIndex::Select(const CompiledComponentSelector& selector) const
+{
+    std::vector<uint32_t> selected;
+
+    if (selector.matchesNothing)
+    {
+        return selected;
+    }
+
+    if (selector.postings.empty())
+    {
+        selected.resize(_componentCount);
+        for (size_t i = 0; i < _componentCount; ++i)
+        {
+            selected[i] = static_cast<uint32_t>(i);
+        }
+        return selected;
+    }
+
+    selected = *selector.postings[0];
+
+    for (size_t p = 1; p < selector.postings.size() && !selected.empty(); ++p)
+    {
+        const std::vector<uint32_t>& posting = *selector.postings[p];
+        auto next = posting.begin();
+        size_t kept = 0;
+
+        // Both lists are ascending, so each search starts where the previous one stopped.
+        for (const uint32_t position : selected)
+        {
+            next = std::lower_bound(next, posting.end(), position);
+            if (next == posting.end())
+            {
+                break;
+            }
+
+            if (*next == position)
+            {
+                selected[kept++] = position;
+            }
+        }
+
+        selected.resize(kept);
+    }
+
+    return selected;
+}
+
+} // namespace ADUC
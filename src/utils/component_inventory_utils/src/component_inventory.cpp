@@ -0,0 +1,201 @@
+/**
+ * @file component_inventory.cpp
+ * @brief Implements the in-memory component inventory for component enumerators.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/component_inventory.hpp"
+
+#include <utility>
+
+namespace ADUC
+{
+ComponentInventory::ComponentInventory(Loader loader) : _loader(std::move(loader))
+{
+}
+
+ComponentInventory::~ComponentInventory()
+{
+    Unload();
+}
+
+char* ComponentInventory::SelectComponents(const char* selectorJson)
+{
+    char* outputString = nullptr;
+    JSON_Value* selectorValue = nullptr;
+    JSON_Value* outputValue = nullptr;
+    JSON_Value* selectedValue = nullptr;
+    JSON_Array* selected = nullptr;
+    std::vector<uint32_t> positions;
+
+    std::lock_guard<std::mutex> lock{ _mutex };
+
+    if (selectorJson == nullptr || !EnsureLoaded())
+    {
+        goto done;
+    }
+
+    {
+        auto compiled = _compiledSelectors.find(selectorJson);
+        if (compiled == _compiledSelectors.end())
+        {
+            // Only selectors that parse are kept, so a selector seen before is not parsed again.
+            selectorValue = json_parse_string(selectorJson);
+            JSON_Object* selectorObject = json_object(selectorValue);
+            if (selectorObject == nullptr)
+            {
+                goto done;
+            }
+
+            ComponentProperties selector;
+            for (size_t i = 0; i < json_object_get_count(selectorObject); ++i)
+            {
+                const char* name = json_object_get_name(selectorObject, i);
+                const char* value = json_string(json_object_get_value_at(selectorObject, i));
+                selector.emplace_back(name == nullptr ? "" : name, value == nullptr ? "" : value);
+            }
+
+            if (_compiledSelectors.size() >= _maxCompiledSelectors)
+            {
+                _compiledSelectors.clear();
+            }
+
+            compiled = _compiledSelectors.emplace(selectorJson, _index.Compile(selector)).first;
+        }
+
+        positions = _index.Select(compiled->second);
+    }
+
+    outputValue = json_value_init_object();
+    selectedValue = json_value_init_array();
+    selected = json_array(selectedValue);
+    if (outputValue == nullptr || selected == nullptr)
+    {
+        goto done;
+    }
+
+    for (const uint32_t position : positions)
+    {
+        JSON_Value* component = json_value_deep_copy(json_array_get_value(_components, position));
+        if (component == nullptr || json_array_append_value(selected, component) != JSONSuccess)
+        {
+            json_value_free(component);
+            goto done;
+        }
+    }
+
+    if (json_object_set_value(json_object(outputValue), "components", selectedValue) != JSONSuccess)
+    {
+        goto done;
+    }
+
+    selectedValue = nullptr;
+
+    outputString = json_serialize_to_string_pretty(outputValue);
+
+done:
+    json_value_free(selectorValue);
+    json_value_free(selectedValue);
+    json_value_free(outputValue);
+
+    return outputString;
+}
+
+char* ComponentInventory::GetAllComponents()
+{
+    std::lock_guard<std::mutex> lock{ _mutex };
+
+    if (!EnsureLoaded())
+    {
+        return nullptr;
+    }
+
+    return json_serialize_to_string_pretty(_rootValue);
+}
+
+size_t ComponentInventory::GetComponentCount()
+{
+    std::lock_guard<std::mutex> lock{ _mutex };
+
+    return EnsureLoaded() ? _index.GetComponentCount() : 0;
+}
+
+void ComponentInventory::Invalidate()
+{
+    std::lock_guard<std::mutex> lock{ _mutex };
+
+    Unload();
+}
+
+void ComponentInventory::SetMaxCompiledSelectors(size_t maxCompiledSelectors)
+{
+    std::lock_guard<std::mutex> lock{ _mutex };
+
+    _maxCompiledSelectors = maxCompiledSelectors > 0 ? maxCompiledSelectors : 1;
+    _compiledSelectors.clear();
+}
+
+/**
+ * @brief Loads and indexes the inventory, unless it is loaded and none of its files changed. Called with the lock
+ * held.
+ *
+ * @return bool true if the inventory is loaded.
+ */
+bool ComponentInventory::EnsureLoaded()
+{
+    if (_loaded && !_watch.HasChanged())
+    {
+        return true;
+    }
+
+    Unload();
+
+    std::vector<std::string> sourceFiles;
+    const struct timespec readStartTime = FileChangeWatch::Now();
+
+    JSON_Value* rootValue = _loader(sourceFiles);
+    JSON_Array* components = json_object_get_array(json_object(rootValue), "components");
+    if (components == nullptr)
+    {
+        json_value_free(rootValue);
+        return false;
+    }
+
+    std::vector<ComponentProperties> properties(json_array_get_count(components));
+    for (size_t i = 0; i < properties.size(); ++i)
+    {
+        JSON_Object* component = json_array_get_object(components, i);
+        for (size_t p = 0; p < json_object_get_count(component); ++p)
+        {
+            const char* value = json_string(json_object_get_value_at(component, p));
+            if (value != nullptr)
+            {
+                properties[i].emplace_back(json_object_get_name(component, p), value);
+            }
+        }
+    }
+
+    _index.Build(properties);
+    _watch.Watch(sourceFiles, readStartTime);
+
+    _rootValue = rootValue;
+    _components = components;
+    _loaded = true;
+
+    return true;
+}
+
+/**
+ * @brief Drops the inventory and the selectors compiled against it. Called with the lock held.
+ */
+void ComponentInventory::Unload()
+{
+    _compiledSelectors.clear();
+    json_value_free(_rootValue);
+    _rootValue = nullptr;
+    _components = nullptr;
+    _loaded = false;
+}
+
+} // namespace ADUC
@@ -0,0 +1,204 @@
+/**
+ * @file file_change_watch.cpp
+ * @brief Implements the watch over the files that some loaded data came from.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/file_change_watch.hpp"
+
+#include <errno.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief The folder events that may mean a watched file in it was created, changed, replaced or removed.
+ */
+#define FILE_CHANGE_WATCH_FOLDER_EVENTS                                                                          \
+    (IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MODIFY | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF \
+     | IN_MOVE_SELF | IN_ONLYDIR)
+
+namespace ADUC
+{
+FileChangeWatch::~FileChangeWatch()
+{
+    StopNotifications();
+}
+
+struct timespec FileChangeWatch::Now()
+{
+    struct timespec now = {};
+
+    // File times come from the coarse clock, so a fine-grained time could be later than a change made after it.
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    return now;
+}
+
+void FileChangeWatch::Watch(const std::vector<std::string>& filePaths, const struct timespec& readStartTime)
+{
+    StopNotifications();
+
+    _changed = false;
+    _files.clear();
+
+    // Notifications start before the files are stat'ed, so that a change is either in the stat or notified.
+    if (!StartNotifications(filePaths))
+    {
+        StopNotifications();
+    }
+
+    for (const std::string& filePath : filePaths)
+    {
+        FileState state = GetFileState(filePath);
+
+        if (state.exists
+            && (state.changeTime.tv_sec > readStartTime.tv_sec
+                || (state.changeTime.tv_sec == readStartTime.tv_sec
+                    && state.changeTime.tv_nsec >= readStartTime.tv_nsec)))
+        {
+            _changed = true;
+        }
+
+        _files.emplace_back(filePath, state);
+    }
+}
+
+bool FileChangeWatch::HasChanged()
+{
+    if (_changed)
+    {
+        return true;
+    }
+
+    if (_notifyFd >= 0)
+    {
+        _changed = ReadNotifications();
+        return _changed;
+    }
+
+    for (const auto& file : _files)
+    {
+        if (!IsSameFileState(file.second, GetFileState(file.first)))
+        {
+            _changed = true;
+            break;
+        }
+    }
+
+    return _changed;
+}
+
+FileChangeWatch::FileState FileChangeWatch::GetFileState(const std::string& filePath)
+{
+    FileState state;
+    struct stat st = {};
+
+    if (stat(filePath.c_str(), &st) == 0)
+    {
+        state.exists = true;
+        state.device = static_cast<unsigned long long>(st.st_dev);
+        state.inode = static_cast<unsigned long long>(st.st_ino);
+        state.size = static_cast<long long>(st.st_size);
+        state.changeTime = st.st_ctim;
+        state.modifyTime = st.st_mtim;
+    }
+
+    return state;
+}
+
+bool FileChangeWatch::IsSameFileState(const FileState& a, const FileState& b)
+{
+    if (!a.exists || !b.exists)
+    {
+        return a.exists == b.exists;
+    }
+
+    return a.device == b.device && a.inode == b.inode && a.size == b.size
+        && a.changeTime.tv_sec == b.changeTime.tv_sec && a.changeTime.tv_nsec == b.changeTime.tv_nsec
+        && a.modifyTime.tv_sec == b.modifyTime.tv_sec && a.modifyTime.tv_nsec == b.modifyTime.tv_nsec;
+}
+
+bool FileChangeWatch::StartNotifications(const std::vector<std::string>& filePaths)
+{
+    _notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_notifyFd < 0)
+    {
+        return false;
+    }
+
+    for (const std::string& filePath : filePaths)
+    {
+        // The folder is watched rather than the file, so that a file that is created, or replaced by a rename, is
+        // noticed too. Watching a folder again returns the same descriptor.
+        const size_t separator = filePath.find_last_of('/');
+        const std::string folder = separator == std::string::npos ? "." : filePath.substr(0, separator + 1);
+        const std::string name = separator == std::string::npos ? filePath : filePath.substr(separator + 1);
+
+        const int wd = inotify_add_watch(_notifyFd, folder.c_str(), FILE_CHANGE_WATCH_FOLDER_EVENTS);
+        if (wd < 0)
+        {
+            return false;
+        }
+
+        _watchedNames[wd].insert(name);
+    }
+
+    return true;
+}
+
+void FileChangeWatch::StopNotifications()
+{
+    if (_notifyFd >= 0)
+    {
+        close(_notifyFd);
+        _notifyFd = -1;
+    }
+
+    _watchedNames.clear();
+}
+
+bool FileChangeWatch::ReadNotifications()
+{
+    alignas(struct inotify_event) char buffer[4096];
+
+    for (;;)
+    {
+        const ssize_t size = read(_notifyFd, buffer, sizeof(buffer));
+        if (size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return false;
+        }
+
+        if (size <= 0)
+        {
+            // The notifications can no longer be trusted to report every change.
+            return true;
+        }
+
+        for (ssize_t offset = 0; offset < size;)
+        {
+            const auto* event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+            offset += static_cast<ssize_t>(sizeof(struct inotify_event) + event->len);
+
+            // The folder itself went away, or events were dropped.
+            if ((event->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT)) != 0)
+            {
+                return true;
+            }
+
+            const auto names = _watchedNames.find(event->wd);
+            if (event->len > 0 && names != _watchedNames.end() && names->second.count(event->name) != 0)
+            {
+                return true;
+            }
+        }
+    }
+}
+
+} // namespace ADUC
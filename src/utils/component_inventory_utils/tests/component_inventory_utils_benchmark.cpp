@@ -0,0 +1,236 @@
+/**
+ * @file component_inventory_utils_benchmark.cpp
+ * @brief Compares component selection at 10k components: a linear scan, as component enumerators did on every call,
+ * against the component index and the cached component inventory.
+ *
+ * @details Hidden from the default run. Run it with:
+ *   component_inventory_utils_unit_tests "[benchmark]"
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/component_index.hpp"
+#include "aduc/component_inventory.hpp"
+
+#include <catch2/catch_all.hpp>
+
+#include <chrono>
+#include <cstdio> // printf, remove
+#include <cstdlib> // mkdtemp
+#include <cstring> // strcmp
+#include <string>
+#include <unistd.h> // rmdir
+#include <vector>
+
+using ADUC::ComponentIndex;
+using ADUC::ComponentInventory;
+using ADUC::ComponentProperties;
+
+namespace
+{
+const size_t ComponentCount = 10000;
+const int Iterations = 200;
+
+/**
+ * @brief A gateway's downstream sensors: 100 groups, 5 manufacturers with 10 models each, and a unique name.
+ */
+ComponentProperties MakeComponent(size_t i)
+{
+    return { { "id", std::to_string(i) },
+             { "name", "sensor-" + std::to_string(i) },
+             { "group", "group-" + std::to_string(i % 100) },
+             { "manufacturer", "contoso-" + std::to_string(i % 5) },
+             { "model", "model-" + std::to_string(i % 50) },
+             { "status", "ok" } };
+}
+
+/**
+ * @brief The selectors of a deployment: one device, a group (1%), and a manufacturer and model (2%).
+ */
+const std::vector<ComponentProperties>& GetSelectors()
+{
+    static const std::vector<ComponentProperties> selectors{
+        { { "name", "sensor-4242" } },
+        { { "group", "group-42" } },
+        { { "manufacturer", "contoso-2" }, { "model", "model-7" } },
+    };
+    return selectors;
+}
+
+bool HasAllProperties(const ComponentProperties& component, const ComponentProperties& selector)
+{
+    for (const auto& wanted : selector)
+    {
+        bool found = false;
+        for (const auto& property : component)
+        {
+            if (property == wanted)
+            {
+                found = true;
+                break;
+            }
+        }
+
+        if (!found)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+double MicrosecondsPerCall(std::chrono::steady_clock::duration duration, int calls)
+{
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count()) / calls;
+}
+
+std::string SelectorJson(const ComponentProperties& selector)
+{
+    std::string json = "{";
+    for (const auto& property : selector)
+    {
+        json += (json.size() > 1 ? ",\"" : "\"") + property.first + "\":\"" + property.second + "\"";
+    }
+    return json + "}";
+}
+
+} // namespace
+
+TEST_CASE("Component selection at 10k components, linear scan and index", "[.hide][benchmark]")
+{
+    std::vector<ComponentProperties> components;
+    for (size_t i = 0; i < ComponentCount; ++i)
+    {
+        components.push_back(MakeComponent(i));
+    }
+
+    const auto& selectors = GetSelectors();
+    const int calls = Iterations * static_cast<int>(selectors.size());
+    size_t scanned = 0;
+    size_t indexed = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < Iterations; ++i)
+    {
+        for (const auto& selector : selectors)
+        {
+            for (const auto& component : components)
+            {
+                scanned += HasAllProperties(component, selector) ? 1 : 0;
+            }
+        }
+    }
+    const auto scanDuration = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    ComponentIndex index;
+    index.Build(components);
+    const auto buildDuration = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < Iterations; ++i)
+    {
+        for (const auto& selector : selectors)
+        {
+            indexed += index.Select(index.Compile(selector)).size();
+        }
+    }
+    const auto indexDuration = std::chrono::steady_clock::now() - start;
+
+    CHECK(indexed == scanned);
+
+    printf("%-22s %14s\n", "10k components", "us per call");
+    printf("%-22s %14.1f\n", "linear scan", MicrosecondsPerCall(scanDuration, calls));
+    printf("%-22s %14.1f\n", "index build (once)", MicrosecondsPerCall(buildDuration, 1));
+    printf("%-22s %14.1f\n", "compile and select", MicrosecondsPerCall(indexDuration, calls));
+}
+
+TEST_CASE("Component inventory selection at 10k components, reparse and cached", "[.hide][benchmark]")
+{
+    char folder[] = "/tmp/component_inventory_benchmark_XXXXXX";
+    REQUIRE(mkdtemp(folder) != nullptr);
+    const std::string inventoryFile = std::string{ folder } + "/components-inventory.json";
+
+    JSON_Value* inventoryValue = json_value_init_object();
+    JSON_Value* componentsValue = json_value_init_array();
+    for (size_t i = 0; i < ComponentCount; ++i)
+    {
+        JSON_Value* componentValue = json_value_init_object();
+        for (const auto& property : MakeComponent(i))
+        {
+            json_object_set_string(json_object(componentValue), property.first.c_str(), property.second.c_str());
+        }
+        json_array_append_value(json_array(componentsValue), componentValue);
+    }
+    json_object_set_value(json_object(inventoryValue), "components", componentsValue);
+    REQUIRE(json_serialize_to_file_pretty(inventoryValue, inventoryFile.c_str()) == JSONSuccess);
+    json_value_free(inventoryValue);
+
+    std::vector<std::string> selectorJsons;
+    for (const auto& selector : GetSelectors())
+    {
+        selectorJsons.push_back(SelectorJson(selector));
+    }
+
+    const int calls = Iterations / 10 * static_cast<int>(selectorJsons.size());
+
+    // What a component enumerator did on every call: parse the inventory, then filter it with a linear scan.
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < Iterations / 10; ++i)
+    {
+        for (const std::string& selectorJson : selectorJsons)
+        {
+            JSON_Value* allValue = json_parse_file(inventoryFile.c_str());
+            JSON_Value* selectorValue = json_parse_string(selectorJson.c_str());
+            JSON_Object* selector = json_object(selectorValue);
+            JSON_Array* components = json_object_get_array(json_object(allValue), "components");
+            for (size_t c = json_array_get_count(components); c-- > 0;)
+            {
+                JSON_Object* component = json_array_get_object(components, c);
+                for (size_t s = 0; s < json_object_get_count(selector); ++s)
+                {
+                    const char* value = json_object_get_string(component, json_object_get_name(selector, s));
+                    if (value == nullptr || strcmp(value, json_string(json_object_get_value_at(selector, s))) != 0)
+                    {
+                        json_array_remove(components, c);
+                        break;
+                    }
+                }
+            }
+            json_free_serialized_string(json_serialize_to_string_pretty(allValue));
+            json_value_free(selectorValue);
+            json_value_free(allValue);
+        }
+    }
+    const auto reparseDuration = std::chrono::steady_clock::now() - start;
+
+    ComponentInventory inventory{ [&inventoryFile](std::vector<std::string>& sourceFiles) {
+        sourceFiles.push_back(inventoryFile);
+        return json_parse_file(inventoryFile.c_str());
+    } };
+
+    start = std::chrono::steady_clock::now();
+    REQUIRE(inventory.GetComponentCount() == ComponentCount);
+    const auto loadDuration = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < Iterations / 10; ++i)
+    {
+        for (const std::string& selectorJson : selectorJsons)
+        {
+            char* output = inventory.SelectComponents(selectorJson.c_str());
+            REQUIRE(output != nullptr);
+            json_free_serialized_string(output);
+        }
+    }
+    const auto cachedDuration = std::chrono::steady_clock::now() - start;
+
+    std::remove(inventoryFile.c_str());
+    rmdir(folder);
+
+    printf("%-22s %14s\n", "10k components", "us per call");
+    printf("%-22s %14.1f\n", "reparse and scan", MicrosecondsPerCall(reparseDuration, calls));
+    printf("%-22s %14.1f\n", "inventory load (once)", MicrosecondsPerCall(loadDuration, 1));
+    printf("%-22s %14.1f\n", "cached inventory", MicrosecondsPerCall(cachedDuration, calls));
+}
@@ -0,0 +1,287 @@
+/**
+ * @file component_inventory_utils_ut.cpp
+ * @brief Unit tests for the component index, the file change watch and the component inventory.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/component_index.hpp"
+#include "aduc/component_inventory.hpp"
+#include "aduc/file_change_watch.hpp"
+
+#include <catch2/catch_all.hpp>
+
+#include <chrono>
+#include <cstdio> // rename, remove
+#include <cstdlib> // mkdtemp
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unistd.h> // rmdir
+#include <vector>
+
+using ADUC::ComponentIndex;
+using ADUC::ComponentInventory;
+using ADUC::ComponentProperties;
+using ADUC::FileChangeWatch;
+
+namespace
+{
+class TempFolder
+{
+public:
+    TempFolder()
+    {
+        char folder[] = "/tmp/component_inventory_ut_XXXXXX";
+        REQUIRE(mkdtemp(folder) != nullptr);
+        _path = folder;
+    }
+
+    TempFolder(const TempFolder&) = delete;
+    TempFolder& operator=(const TempFolder&) = delete;
+    TempFolder(TempFolder&&) = delete;
+    TempFolder& operator=(TempFolder&&) = delete;
+
+    ~TempFolder()
+    {
+        for (const std::string& file : _files)
+        {
+            std::remove(file.c_str());
+        }
+        rmdir(_path.c_str());
+    }
+
+    std::string File(const std::string& name)
+    {
+        _files.push_back(_path + "/" + name);
+        return _files.back();
+    }
+
+private:
+    std::string _path;
+    std::vector<std::string> _files;
+};
+
+void WriteFile(const std::string& path, const std::string& content)
+{
+    std::ofstream file{ path, std::ios::trunc };
+    file << content;
+}
+
+// File times come from a coarse clock, so a file written within the same tick as the read counts as changed.
+void WaitForClockTick()
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+}
+
+std::vector<uint32_t> Select(const ComponentIndex& index, const ComponentProperties& selector)
+{
+    return index.Select(index.Compile(selector));
+}
+
+} // namespace
+
+TEST_CASE("ComponentIndex selects the components that have all the selector properties")
+{
+    ComponentIndex index;
+    index.Build({ { { "name", "left-motor" }, { "group", "motors" }, { "model", "m1" } },
+                  { { "name", "right-motor" }, { "group", "motors" }, { "model", "m2" } },
+                  { { "name", "front-camera" }, { "group", "cameras" }, { "model", "m1" } },
+                  { { "name", "rear-motor" }, { "group", "motors" }, { "model", "m1" }, { "model", "m1" } } });
+
+    CHECK(index.GetComponentCount() == 4);
+
+    SECTION("One property")
+    {
+        CHECK(Select(index, { { "group", "motors" } }) == std::vector<uint32_t>{ 0, 1, 3 });
+        CHECK(Select(index, { { "name", "front-camera" } }) == std::vector<uint32_t>{ 2 });
+    }
+
+    SECTION("All properties must match")
+    {
+        CHECK(Select(index, { { "group", "motors" }, { "model", "m1" } }) == std::vector<uint32_t>{ 0, 3 });
+        CHECK(Select(index, { { "model", "m1" }, { "group", "cameras" } }) == std::vector<uint32_t>{ 2 });
+        CHECK(Select(index, { { "group", "motors" }, { "group", "motors" } }) == std::vector<uint32_t>{ 0, 1, 3 });
+        CHECK(Select(index, { { "group", "cameras" }, { "model", "m2" } }).empty());
+    }
+
+    SECTION("An empty selector matches all components")
+    {
+        CHECK(Select(index, {}) == std::vector<uint32_t>{ 0, 1, 2, 3 });
+    }
+
+    SECTION("Unknown or empty properties match no component")
+    {
+        CHECK(Select(index, { { "group", "sensors" } }).empty());
+        CHECK(Select(index, { { "color", "red" } }).empty());
+        CHECK(Select(index, { { "group", "" } }).empty());
+        CHECK(Select(index, { { "", "motors" } }).empty());
+        CHECK(Select(index, { { "group", "motors" }, { "group", "" } }).empty());
+    }
+
+    SECTION("Rebuilding replaces the index")
+    {
+        index.Build({ { { "group", "cameras" } } });
+        CHECK(index.GetComponentCount() == 1);
+        CHECK(Select(index, { { "group", "motors" } }).empty());
+        CHECK(Select(index, { { "group", "cameras" } }) == std::vector<uint32_t>{ 0 });
+    }
+}
+
+TEST_CASE("FileChangeWatch notices changes to the watched files only")
+{
+    TempFolder folder;
+    const std::string watched = folder.File("inventory.json");
+    const std::string missing = folder.File("firmware.json");
+    const std::string other = folder.File("other.json");
+
+    WriteFile(watched, "{}");
+    WriteFile(other, "{}");
+    WaitForClockTick();
+
+    FileChangeWatch watch;
+    watch.Watch({ watched, missing }, FileChangeWatch::Now());
+
+    CHECK(watch.IsUsingNotifications());
+    CHECK_FALSE(watch.HasChanged());
+
+    SECTION("Another file in the folder")
+    {
+        WriteFile(other, "{ \"changed\": true }");
+        CHECK_FALSE(watch.HasChanged());
+    }
+
+    SECTION("Changed")
+    {
+        WriteFile(watched, "{ \"changed\": true }");
+        CHECK(watch.HasChanged());
+        CHECK(watch.HasChanged());
+    }
+
+    SECTION("Created")
+    {
+        WriteFile(missing, "{}");
+        CHECK(watch.HasChanged());
+    }
+
+    SECTION("Replaced")
+    {
+        REQUIRE(std::rename(other.c_str(), watched.c_str()) == 0);
+        CHECK(watch.HasChanged());
+    }
+
+    SECTION("Removed")
+    {
+        REQUIRE(std::remove(watched.c_str()) == 0);
+        CHECK(watch.HasChanged());
+    }
+
+    SECTION("Watching again")
+    {
+        WriteFile(watched, "{ \"changed\": true }");
+        REQUIRE(watch.HasChanged());
+
+        WaitForClockTick();
+        watch.Watch({ watched, missing }, FileChangeWatch::Now());
+        CHECK_FALSE(watch.HasChanged());
+    }
+}
+
+TEST_CASE("FileChangeWatch counts a change made while the files were read")
+{
+    TempFolder folder;
+    const std::string watched = folder.File("inventory.json");
+
+    const struct timespec readStartTime = FileChangeWatch::Now();
+    WriteFile(watched, "{}");
+
+    FileChangeWatch watch;
+    watch.Watch({ watched }, readStartTime);
+
+    CHECK(watch.HasChanged());
+}
+
+TEST_CASE("FileChangeWatch stats the files when a folder cannot be watched")
+{
+    TempFolder folder;
+    const std::string watched = folder.File("inventory.json");
+
+    WriteFile(watched, "{}");
+    WaitForClockTick();
+
+    FileChangeWatch watch;
+    watch.Watch({ watched, "/nonexistent-component-inventory-folder/firmware.json" }, FileChangeWatch::Now());
+
+    CHECK_FALSE(watch.IsUsingNotifications());
+    CHECK_FALSE(watch.HasChanged());
+
+    WriteFile(watched, "{ \"changed\": true }");
+    CHECK(watch.HasChanged());
+}
+
+TEST_CASE("ComponentInventory selects from the loaded inventory until its file changes")
+{
+    TempFolder folder;
+    const std::string inventoryFile = folder.File("components-inventory.json");
+
+    WriteFile(
+        inventoryFile,
+        R"({ "components": [
+            { "id": "0", "name": "left-motor", "group": "motors", "properties": { "path": "/tmp" } },
+            { "id": "1", "name": "right-motor", "group": "motors", "order": 1 },
+            { "id": "2", "name": "front-camera", "group": "cameras" } ] })");
+    WaitForClockTick();
+
+    int loadCount = 0;
+    ComponentInventory inventory{ [&inventoryFile, &loadCount](std::vector<std::string>& sourceFiles) {
+        ++loadCount;
+        sourceFiles.push_back(inventoryFile);
+        return json_parse_file(inventoryFile.c_str());
+    } };
+
+    const auto selectIds = [&inventory](const char* selector) {
+        std::vector<std::string> ids;
+        char* output = inventory.SelectComponents(selector);
+        JSON_Value* value = json_parse_string(output);
+        JSON_Array* components = json_object_get_array(json_object(value), "components");
+        for (size_t i = 0; i < json_array_get_count(components); ++i)
+        {
+            ids.emplace_back(json_object_get_string(json_array_get_object(components, i), "id"));
+        }
+        json_value_free(value);
+        json_free_serialized_string(output);
+        return ids;
+    };
+
+    CHECK(selectIds(R"({ "group": "motors" })") == std::vector<std::string>{ "0", "1" });
+    CHECK(selectIds(R"({ "group": "motors", "name": "right-motor" })") == std::vector<std::string>{ "1" });
+    CHECK(selectIds("{}") == std::vector<std::string>{ "0", "1", "2" });
+    CHECK(selectIds(R"({ "order": 1 })").empty());
+    CHECK(selectIds(R"({ "group": "sensors" })").empty());
+    CHECK(inventory.SelectComponents("[]") == nullptr);
+    CHECK(inventory.SelectComponents("not json") == nullptr);
+    CHECK(inventory.GetComponentCount() == 3);
+    CHECK(loadCount == 1);
+
+    WriteFile(inventoryFile, R"({ "components": [ { "id": "3", "name": "rear-motor", "group": "motors" } ] })");
+
+    CHECK(selectIds(R"({ "group": "motors" })") == std::vector<std::string>{ "3" });
+    CHECK(loadCount == 2);
+
+    inventory.Invalidate();
+    CHECK(inventory.GetComponentCount() == 1);
+    CHECK(loadCount == 3);
+}
+
+TEST_CASE("ComponentInventory fails until the inventory can be loaded")
+{
+    int loadCount = 0;
+    ComponentInventory inventory{ [&loadCount](std::vector<std::string>& /*sourceFiles*/) {
+        ++loadCount;
+        return json_parse_string(R"({ "devices": [] })");
+    } };
+
+    CHECK(inventory.SelectComponents("{}") == nullptr);
+    CHECK(inventory.GetAllComponents() == nullptr);
+    CHECK(loadCount == 2);
+}
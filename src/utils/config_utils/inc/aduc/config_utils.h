@@ -80,16 +80,33 @@ typedef struct tagADUC_ConfigInfo
     unsigned int
         downloadTimeoutInMinutes; /**< The timeout for downloading an update payload. A value of zero means to use the default. */
 
+    unsigned int
+        maxConcurrentDownloads; /**< The maximum number of update payloads downloaded in parallel, for the steps that allow it. A value of zero means to use the default. */
+
+    unsigned int
+        downloadSegmentCount; /**< The maximum number of byte ranges of a payload downloaded in parallel. A value of zero means to use the default. */
+
+    unsigned int
+        downloadMinSegmentSizeInMB; /**< The minimum size of a byte range of a payload downloaded in parallel. A value of zero means to use the default. */
+
+    unsigned int
+        downloadCacheSizeInMB; /**< The maximum size of the cache of downloaded payloads. When not configured, or zero, the cache is disabled. */
+
     const char* aduShellFolder; /**< The folder where ADU shell is installed. */
 
     char* aduShellFilePath; /**< The full path to ADU shell binary. */
 
+    const char*
+        aduShellBrokerSocketPath; /**< The socket of a long-lived adu-shell broker. When not configured, adu-shell is launched for each action. */
+
     char* configFolder; /**< The folder where ADU stores its configuration. */
 
     const char* dataFolder; /**< The folder where ADU stores its data. */
 
     const char* downloadsFolder; /**< The folder where ADU stores downloaded payloads. */
 
+    const char* downloadCacheFolder; /**< The folder where ADU caches downloaded payloads across workflows. */
+
     const char* extensionsFolder; /**< The folder where ADU stores its extensions. */
 
     char* extensionsComponentEnumeratorFolder; /**< The folder where ADU stores its component enumerator extensions. */
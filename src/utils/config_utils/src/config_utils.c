@@ -36,11 +36,14 @@ static inline void s_config_unlock(void)
 }
 
 static const char* CONFIG_ADU_SHELL_FOLDER = "aduShellFolder";
+static const char* CONFIG_ADU_SHELL_BROKER_SOCKET_PATH = "aduShellBrokerSocketPath";
 static const char* CONFIG_ADU_DATA_FOLDER = "dataFolder";
 static const char* CONFIG_ADU_EXTENSIONS_FOLDER = "extensionsFolder";
 static const char* CONFIG_ADU_DOWNLOADS_FOLDER = "downloadsFolder";
+static const char* CONFIG_ADU_DOWNLOAD_CACHE_FOLDER = "downloadCacheFolder";
 
 static const char* DOWNLOADS_PATH_SEGMENT = "downloads";
+static const char* DOWNLOAD_CACHE_PATH_SEGMENT = "downloadcache";
 static const char* EXTENSIONS_PATH_SEGMENT = "extensions";
 
 static const char* CONFIG_IOT_HUB_PROTOCOL = "iotHubProtocol";
@@ -51,6 +54,16 @@ static const char* CONFIG_MANUFACTURER = "manufacturer";
 static const char* CONFIG_MODEL = "model";
 static const char* CONFIG_SCHEMA_VERSION = "schemaVersion";
 static const char* CONFIG_DOWNLOAD_TIMEOUT_IN_MINUTES = "downloadTimeoutInMinutes";
+static const char* CONFIG_MAX_CONCURRENT_DOWNLOADS = "maxConcurrentDownloads";
+static const char* CONFIG_DOWNLOAD_SEGMENT_COUNT = "downloadSegmentCount";
+static const char* CONFIG_DOWNLOAD_MIN_SEGMENT_SIZE_IN_MB = "downloadMinSegmentSizeInMB";
+static const char* CONFIG_DOWNLOAD_CACHE_SIZE_IN_MB = "downloadCacheSizeInMB";
+
+/**
+ * @brief The maximum size of the download cache when du-config.json does not set downloadCacheSizeInMB. The cache is
+ * opt-in, as it keeps payloads in the data folder after their workflows completed, and devices may be short of space.
+ */
+static const unsigned int DEFAULT_DOWNLOAD_CACHE_SIZE_IN_MB = 0;
 
 static const char* CONFIG_NAME = "name";
 static const char* CONFIG_RUN_AS = "runas";
@@ -413,6 +426,24 @@ bool ADUC_ConfigInfo_Init(ADUC_ConfigInfo* config, const char* configFolder)
     ADUC_JSON_GetUnsignedIntegerField(
         config->rootJsonValue, CONFIG_DOWNLOAD_TIMEOUT_IN_MINUTES, &(config->downloadTimeoutInMinutes));
 
+    // Note: max concurrent downloads is optional.
+    ADUC_JSON_GetUnsignedIntegerField(
+        config->rootJsonValue, CONFIG_MAX_CONCURRENT_DOWNLOADS, &(config->maxConcurrentDownloads));
+
+    // Note: download segment count and minimum segment size are optional.
+    ADUC_JSON_GetUnsignedIntegerField(
+        config->rootJsonValue, CONFIG_DOWNLOAD_SEGMENT_COUNT, &(config->downloadSegmentCount));
+    ADUC_JSON_GetUnsignedIntegerField(
+        config->rootJsonValue, CONFIG_DOWNLOAD_MIN_SEGMENT_SIZE_IN_MB, &(config->downloadMinSegmentSizeInMB));
+
+    // Note: download cache size is optional. An explicit 0 disables the download cache.
+    config->downloadCacheSizeInMB = DEFAULT_DOWNLOAD_CACHE_SIZE_IN_MB;
+    if (json_object_has_value(root_object, CONFIG_DOWNLOAD_CACHE_SIZE_IN_MB))
+    {
+        ADUC_JSON_GetUnsignedIntegerField(
+            config->rootJsonValue, CONFIG_DOWNLOAD_CACHE_SIZE_IN_MB, &(config->downloadCacheSizeInMB));
+    }
+
     // Ensure that adu-shell folder is valid.
     config->aduShellFolder = ADUC_JSON_GetStringFieldPtr(config->rootJsonValue, CONFIG_ADU_SHELL_FOLDER);
 
@@ -433,6 +464,10 @@ bool ADUC_ConfigInfo_Init(ADUC_ConfigInfo* config, const char* configFolder)
         goto done;
     }
 
+    // Note: adu-shell broker socket path is optional.
+    config->aduShellBrokerSocketPath =
+        ADUC_JSON_GetStringFieldPtr(config->rootJsonValue, CONFIG_ADU_SHELL_BROKER_SOCKET_PATH);
+
     config->dataFolder = ADUC_JSON_GetStringFieldPtr(config->rootJsonValue, CONFIG_ADU_DATA_FOLDER);
 
     if (config->dataFolder == NULL)
@@ -455,6 +490,16 @@ bool ADUC_ConfigInfo_Init(ADUC_ConfigInfo* config, const char* configFolder)
         goto done;
     }
 
+    if (!EnsureDataSubFolderSpecifiedOrSetDefaultValue(
+            config->rootJsonValue,
+            CONFIG_ADU_DOWNLOAD_CACHE_FOLDER,
+            &config->downloadCacheFolder,
+            config->dataFolder,
+            DOWNLOAD_CACHE_PATH_SEGMENT))
+    {
+        goto done;
+    }
+
     if (!EnsureDataSubFolderSpecifiedOrSetDefaultValue(
             config->rootJsonValue,
             CONFIG_ADU_EXTENSIONS_FOLDER,
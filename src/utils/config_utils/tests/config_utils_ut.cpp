@@ -306,6 +306,41 @@ static const char* validConfigContentDownloadTimeout =
         R"(])"
     R"(})";
 
+static const char* validConfigContentDownloadConcurrency =
+    R"({)"
+        R"("schemaVersion": "1.1",)"
+        R"("aduShellTrustedUsers": ["adu","do"],)"
+        R"("manufacturer": "device_info_manufacturer",)"
+        R"("model": "device_info_model",)"
+        R"("maxConcurrentDownloads": 8,)"
+        R"("downloadSegmentCount": 6,)"
+        R"("downloadMinSegmentSizeInMB": 32,)"
+        R"("downloadCacheSizeInMB": 512,)"
+        R"("compatPropertyNames": "manufacturer,model",)"
+        R"("agents": [)"
+            R"({ )"
+            R"("name": "host-update",)"
+            R"("runas": "adu",)"
+            R"("connectionSource": {)"
+                R"("connectionType": "AIS",)"
+                R"("connectionData": "iotHubDeviceUpdate")"
+            R"(},)"
+            R"("manufacturer": "Contoso",)"
+            R"("model": "Smart-Box")"
+            R"(},)"
+            R"({)"
+            R"("name": "leaf-update",)"
+            R"("runas": "adu",)"
+            R"("connectionSource": {)"
+                R"("connectionType": "string",)"
+                R"("connectionData": "HOSTNAME=...")"
+            R"(},)"
+            R"("manufacturer": "Fabrikam",)"
+            R"("model": "Camera")"
+            R"(})"
+        R"(])"
+    R"(})";
+
 static const char* validConfigWithOverrideFolder =
     R"({)"
         R"("schemaVersion": "1.1",)"
@@ -314,6 +349,7 @@ static const char* validConfigWithOverrideFolder =
         R"("model": "device_info_model",)"
         R"("downloadTimeoutInMinutes": 1440,)"
         R"("aduShellFolder": "/usr/mybin",)"
+        R"("aduShellBrokerSocketPath": "/run/adu-shell/broker.sock",)"
         R"("dataFolder": "/var/lib/adu/mydata",)"
         R"("extensionsFolder": "/var/lib/adu/myextensions",)"
         R"("compatPropertyNames": "manufacturer,model",)"
@@ -535,6 +571,38 @@ TEST_CASE_METHOD(GlobalMockHookTestCaseFixture, "ADUC_ConfigInfo_Init Functional
         ADUC_ConfigInfo_UnInit(&config);
     }
 
+    SECTION("Valid config content, download concurrency settings")
+    {
+        REQUIRE(mallocAndStrcpy_s(&g_configContentString, validConfigContentDownloadConcurrency) == 0);
+        ADUC::StringUtils::cstr_wrapper configStr{ g_configContentString };
+
+        ADUC_ConfigInfo config = {};
+
+        CHECK(ADUC_ConfigInfo_Init(&config, "/etc/adu"));
+        CHECK(config.maxConcurrentDownloads == 8);
+        CHECK(config.downloadSegmentCount == 6);
+        CHECK(config.downloadMinSegmentSizeInMB == 32);
+        CHECK(config.downloadCacheSizeInMB == 512);
+
+        ADUC_ConfigInfo_UnInit(&config);
+    }
+
+    SECTION("Valid config content, download concurrency settings not set")
+    {
+        REQUIRE(mallocAndStrcpy_s(&g_configContentString, validConfigContentDownloadTimeout) == 0);
+        ADUC::StringUtils::cstr_wrapper configStr{ g_configContentString };
+
+        ADUC_ConfigInfo config = {};
+
+        CHECK(ADUC_ConfigInfo_Init(&config, "/etc/adu"));
+        CHECK(config.maxConcurrentDownloads == 0);
+        CHECK(config.downloadSegmentCount == 0);
+        CHECK(config.downloadMinSegmentSizeInMB == 0);
+        CHECK(config.downloadCacheSizeInMB == 0);
+
+        ADUC_ConfigInfo_UnInit(&config);
+    }
+
     SECTION("Valid config content, mqtt iotHubProtocol")
     {
         REQUIRE(mallocAndStrcpy_s(&g_configContentString, validConfigContentMqttIotHubProtocol) == 0);
@@ -614,6 +682,8 @@ TEST_CASE_METHOD(GlobalMockHookTestCaseFixture, "ADUC_ConfigInfo_Init Functional
         CHECK_THAT(config->extensionsStepHandlerFolder, Equals("/var/lib/adu/extensions/update_content_handlers"));
         CHECK_THAT(config->extensionsDownloadHandlerFolder, Equals("/var/lib/adu/extensions/download_handlers"));
         CHECK_THAT(config->downloadsFolder, Equals("/var/lib/adu/downloads"));
+        CHECK_THAT(config->downloadCacheFolder, Equals("/var/lib/adu/downloadcache"));
+        CHECK(config->aduShellBrokerSocketPath == nullptr);
         ADUC_ConfigInfo_ReleaseInstance(config);
         CHECK(config->refCount == 0);
     }
@@ -638,6 +708,8 @@ TEST_CASE_METHOD(GlobalMockHookTestCaseFixture, "ADUC_ConfigInfo_Init Functional
         CHECK_THAT(config->extensionsStepHandlerFolder, Equals("/var/lib/adu/myextensions/update_content_handlers"));
         CHECK_THAT(config->extensionsDownloadHandlerFolder, Equals("/var/lib/adu/myextensions/download_handlers"));
         CHECK_THAT(config->downloadsFolder, Equals("/var/lib/adu/mydata/downloads"));
+        CHECK_THAT(config->downloadCacheFolder, Equals("/var/lib/adu/mydata/downloadcache"));
+        CHECK_THAT(config->aduShellBrokerSocketPath, Equals("/run/adu-shell/broker.sock"));
         ADUC_ConfigInfo_ReleaseInstance(config);
         CHECK(config->refCount == 0);
     }
@@ -11,6 +11,7 @@
 #include "aduc/c_utils.h"
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h> // uint64_t
 
 #include <aducpal/time.h> // time_t
 
@@ -130,6 +131,7 @@ typedef struct _tagADUC_D2C_Message
     void* userData; /**< A data provided by caller */
     int lastHttpStatus; /**< The latest http status code received for this message */
     unsigned int attempts; /**< Total number of a send attempts */
+    uint64_t submitTimeMs; /**< Submit time, in milliseconds of a monotonic clock. Used for the latency statistics */
 } ADUC_D2C_Message;
 
 /**
@@ -166,7 +168,8 @@ void ADUC_D2C_Messaging_Uninit();
 /**
  * @brief Performs messaging processing tasks.
  *
- * Note: must call this function every 100ms - 200ms to ensure that the Device to Cloud messages are processed in timely manner.
+ * Note: the main loop calls this function whenever it wakes up. It requests the next wake-up it needs with
+ *       ADUC_EventLoop_RequestWakeIn, and submitting a message wakes the main loop.
  *
  **/
 void ADUC_D2C_Messaging_DoWork();
@@ -217,6 +220,52 @@ void ADUC_D2C_Messaging_Set_Transport(ADUC_D2C_Message_Type type, ADUC_D2C_MESSA
  */
 void ADUC_D2C_Messaging_Set_Retry_Strategy(ADUC_D2C_Message_Type type, ADUC_D2C_RetryStrategy* strategy);
 
+/**
+ * @brief Sets how long messages are held after a send, so that those submitted meanwhile are sent together.
+ *
+ * @details A message submitted when nothing was sent within the window is sent on the next DoWork call. Otherwise it
+ * is held until the window ends, and the reported properties patches of all the messages that are due then are merged
+ * into a single transport call. Each message keeps its own retries and callbacks.
+ *
+ * @param windowMs The window, in milliseconds. 0 sends each message as soon as possible, on its own. The default is
+ * 200 milliseconds.
+ */
+void ADUC_D2C_Messaging_Set_Batch_Window(unsigned int windowMs);
+
+/**
+ * @brief Resends the messages that were not delivered when the connection to the cloud was re-created.
+ *
+ * @details A message sent on the previous connection never gets a response, and one waiting to be retried may be
+ * waiting for a long back-off. Both are sent again on the next DoWork call, keeping their retries count and callbacks.
+ * Messages that were not sent yet are not affected.
+ *
+ * Note: call this once the new connection's handle is set, before the next ADUC_D2C_Messaging_DoWork call.
+ */
+void ADUC_D2C_Messaging_OnReconnected();
+
+/**
+ * @brief Counters of the D2C messages processed since ADUC_D2C_Messaging_Init.
+ */
+typedef struct _tagADUC_D2C_Messaging_Statistics
+{
+    unsigned long long messagesSubmitted; /**< Messages passed to ADUC_D2C_Message_SendAsync */
+    unsigned long long messagesReplaced; /**< Messages replaced by a newer one of the same type before being sent */
+    unsigned long long messagesDelivered; /**< Messages the cloud acknowledged */
+    unsigned long long sendAttempts; /**< Send attempts, counting each message of a batch */
+    unsigned long long transportCalls; /**< Calls of the transport functions */
+    unsigned long long batchedMessages; /**< Send attempts that were merged with other messages */
+    unsigned long long bytesSent; /**< Total size of the content passed to the transport functions */
+    unsigned long long totalDeliveryLatencyMs; /**< Sum of the times from submission to acknowledgement */
+    unsigned long long maxDeliveryLatencyMs; /**< Longest time from submission to acknowledgement */
+} ADUC_D2C_Messaging_Statistics;
+
+/**
+ * @brief Gets the statistics of the messages processed since ADUC_D2C_Messaging_Init.
+ *
+ * @param[out] statistics The statistics.
+ */
+void ADUC_D2C_Messaging_GetStatistics(ADUC_D2C_Messaging_Statistics* statistics);
+
 /**
  * @brief The default message transport function.
  *
@@ -7,11 +7,14 @@
  */
 #include "aduc/d2c_messaging.h"
 #include "aduc/client_handle_helper.h"
+#include "aduc/event_loop_utils.h"
 #include "aduc/retry_utils.h"
 
 #include <limits.h>
 #include <math.h>
+#include <parson.h>
 #include <stdbool.h>
+#include <string.h> // memset, strlen
 
 #include <aducpal/sys_time.h> // ADUCPAL_clock_gettime
 #include <aducpal/unistd.h>
@@ -31,13 +34,40 @@
 #define FATAL_ERROR_WAIT_TIME_SEC 10 // 10 seconds
 #define ONE_DAY_IN_SECONDS (1 * 24 * 60 * 60)
 
+// How soon to process the messages again while a response is awaited. The response arrives in the IoT Hub client's
+// DoWork, which the main loop calls along with ADUC_D2C_Messaging_DoWork.
+#define RESPONSE_WAIT_INTERVAL_MS 100
+
+// Default for ADUC_D2C_Messaging_Set_Batch_Window.
+#define DEFAULT_BATCH_WINDOW_MS 200
+
+// The largest merged content sent in one batch. The IoT Hub limits the whole reported properties document to 32 KB.
+#define MAX_BATCH_CONTENT_SIZE (16 * 1024)
+
+/**
+ * @brief Messages of different types merged into a single call of the transport function.
+ */
+typedef struct _tagADUC_D2C_Message_Batch
+{
+    ADUC_D2C_Message_Processing_Context context; /**< Passed to the transport function, with the merged content. */
+    ADUC_D2C_Message_Processing_Context* members[ADUC_D2C_Message_Type_Max]; /**< The merged messages' contexts. */
+    size_t memberCount; /**< Number of entries in members. */
+} ADUC_D2C_Message_Batch;
+
 static pthread_mutex_t s_pendingMessageStoreMutex = PTHREAD_MUTEX_INITIALIZER;
 static bool s_core_initialized = false;
 
 static ADUC_D2C_Message s_pendingMessageStore[ADUC_D2C_Message_Type_Max];
 static ADUC_D2C_Message_Processing_Context s_messageProcessingContext[ADUC_D2C_Message_Type_Max];
 
-static void ProcessMessage(ADUC_D2C_Message_Processing_Context* context);
+// Batching state, only used on the thread that calls ADUC_D2C_Messaging_DoWork.
+static unsigned int s_batchWindowMs = DEFAULT_BATCH_WINDOW_MS;
+static uint64_t s_lastSendTimeMs = 0;
+
+static pthread_mutex_t s_statisticsMutex = PTHREAD_MUTEX_INITIALIZER;
+static ADUC_D2C_Messaging_Statistics s_statistics;
+
+static bool ProcessMessage(ADUC_D2C_Message_Processing_Context* context, bool canSend);
 
 static time_t GetTimeSinceEpochInSeconds()
 {
@@ -48,6 +78,22 @@ static time_t GetTimeSinceEpochInSeconds()
     return timeSinceEpoch.tv_sec;
 }
 
+/**
+ * @brief Gets a time in milliseconds, for measuring intervals. Uses a monotonic clock where there is one.
+ */
+static uint64_t GetTimeInMilliseconds()
+{
+    struct timespec now;
+
+#ifdef CLOCK_MONOTONIC
+    ADUCPAL_clock_gettime(CLOCK_MONOTONIC, &now);
+#else
+    ADUCPAL_clock_gettime(CLOCK_REALTIME, &now);
+#endif
+
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
 /**
  * @brief The retry strategy for all each http response status code from the Azure IoT Hub.
  */
@@ -243,11 +289,21 @@ static void DefaultIoTHubSendReportedStateCompletedCallback(int http_status_code
     {
         // The callback indicates that no retries needed.
         // We're done with this message.
+        const uint64_t latencyMs = GetTimeInMilliseconds() - message_processing_context->message.submitTimeMs;
+
         Log_Debug(
-            "D2C message processed successfully (t:%d, r:%d, content:0x%x )",
+            "D2C message processed successfully (t:%d, r:%d, content:0x%x, %llu ms)",
             message_processing_context->type,
             message_processing_context->retries,
-            message_processing_context->message.content);
+            message_processing_context->message.content,
+            (unsigned long long)latencyMs);
+
+        pthread_mutex_lock(&s_statisticsMutex);
+        s_statistics.messagesDelivered++;
+        s_statistics.totalDeliveryLatencyMs += latencyMs;
+        s_statistics.maxDeliveryLatencyMs = MAX(s_statistics.maxDeliveryLatencyMs, latencyMs);
+        pthread_mutex_unlock(&s_statisticsMutex);
+
         OnMessageProcessingCompleted(&message_processing_context->message, ADUC_D2C_Message_Status_Success);
         goto done;
     }
@@ -326,29 +382,424 @@ done:
     pthread_mutex_unlock(&message_processing_context->mutex);
 }
 
+/**
+ * @brief Requests that the main loop calls ADUC_D2C_Messaging_DoWork again when the next message is due to be
+ * retried, or soon if a response is awaited. New messages wake the main loop when they are submitted.
+ *
+ * @param holdMs How long messages that are due are held for the batch window.
+ */
+static void RequestNextWakeUp(unsigned int holdMs)
+{
+    const time_t now = GetTimeSinceEpochInSeconds();
+    unsigned int delayMs = UINT_MAX;
+
+    for (int i = 0; i < ADUC_D2C_Message_Type_Max; i++)
+    {
+        ADUC_D2C_Message_Processing_Context* message_processing_context = &s_messageProcessingContext[i];
+        unsigned int messageDelayMs = UINT_MAX;
+
+        if (!message_processing_context->initialized)
+        {
+            continue;
+        }
+
+        pthread_mutex_lock(&message_processing_context->mutex);
+
+        if (message_processing_context->message.content != NULL)
+        {
+            if (message_processing_context->message.status == ADUC_D2C_Message_Status_Waiting_For_Response)
+            {
+                messageDelayMs = RESPONSE_WAIT_INTERVAL_MS;
+            }
+            else if (message_processing_context->nextRetryTimeStampEpoch <= now)
+            {
+                messageDelayMs = (holdMs != 0) ? holdMs : RESPONSE_WAIT_INTERVAL_MS;
+            }
+            else if (message_processing_context->message.status == ADUC_D2C_Message_Status_In_Progress)
+            {
+                const time_t delaySecs = message_processing_context->nextRetryTimeStampEpoch - now;
+                messageDelayMs = (delaySecs < (time_t)(UINT_MAX / 1000)) ? (unsigned int)delaySecs * 1000 : UINT_MAX;
+            }
+        }
+
+        pthread_mutex_unlock(&message_processing_context->mutex);
+
+        delayMs = MIN(delayMs, messageDelayMs);
+    }
+
+    if (delayMs != UINT_MAX)
+    {
+        ADUC_EventLoop_RequestWakeIn(delayMs);
+    }
+}
+
+/**
+ * @brief Gets how long messages must still be held, so that those submitted within the batch window after the last
+ * send are sent together. The first message after a quiet period is sent immediately.
+ *
+ * @return unsigned int The time, in milliseconds, or 0 if messages can be sent now.
+ */
+static unsigned int GetBatchHoldTimeMs()
+{
+    uint64_t elapsedMs = 0;
+
+    if (s_batchWindowMs == 0 || s_lastSendTimeMs == 0)
+    {
+        return 0;
+    }
+
+    elapsedMs = GetTimeInMilliseconds() - s_lastSendTimeMs;
+    return (elapsedMs >= s_batchWindowMs) ? 0 : (unsigned int)(s_batchWindowMs - elapsedMs);
+}
+
+/**
+ * @brief Sends a message on its own.
+ *
+ * @param message_processing_context The message processing context. The caller must hold its mutex.
+ */
+static void SendMessage(ADUC_D2C_Message_Processing_Context* message_processing_context)
+{
+    if (message_processing_context->transportFunc == NULL)
+    {
+        Log_Error(
+            "Cannot send message. Transport function is NULL. Will retry in the next %d seconds. (t:%d)",
+            FATAL_ERROR_WAIT_TIME_SEC,
+            message_processing_context->type);
+        message_processing_context->nextRetryTimeStampEpoch += FATAL_ERROR_WAIT_TIME_SEC;
+        return;
+    }
+
+    pthread_mutex_lock(&s_statisticsMutex);
+    s_statistics.sendAttempts++;
+    s_statistics.transportCalls++;
+    s_statistics.bytesSent += strlen(message_processing_context->message.content);
+    pthread_mutex_unlock(&s_statisticsMutex);
+
+    message_processing_context->message.attempts++;
+    Log_Debug(
+        "Sending D2C message (t:%d, retries:%d).", message_processing_context->type, message_processing_context->retries);
+    if (message_processing_context->transportFunc(
+            message_processing_context->message.cloudServiceHandle,
+            message_processing_context,
+            DefaultIoTHubSendReportedStateCompletedCallback)
+        != 0)
+    {
+        message_processing_context->nextRetryTimeStampEpoch += FATAL_ERROR_WAIT_TIME_SEC;
+        Log_Error(
+            "Failed to send message. Will retry in the next %d seconds. (t:%d)",
+            FATAL_ERROR_WAIT_TIME_SEC,
+            message_processing_context->type);
+    }
+}
+
+/**
+ * @brief Merges the reported properties patch @p patch into @p target. Objects are merged recursively, and other
+ * values of @p patch replace those of @p target, so that sending @p target has the same effect as sending the original
+ * @p target, then @p patch.
+ *
+ * @return bool true on success.
+ */
+static bool MergeReportedPropertiesPatch(JSON_Object* target, const JSON_Object* patch)
+{
+    for (size_t i = 0; i < json_object_get_count(patch); i++)
+    {
+        const char* name = json_object_get_name(patch, i);
+        const JSON_Value* value = json_object_get_value_at(patch, i);
+        JSON_Object* targetObject = json_object_get_object(target, name);
+
+        if (json_value_get_type(value) == JSONObject && targetObject != NULL)
+        {
+            if (!MergeReportedPropertiesPatch(targetObject, json_value_get_object(value)))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            JSON_Value* valueCopy = json_value_deep_copy(value);
+            if (valueCopy == NULL || json_object_set_value(target, name, valueCopy) != JSONSuccess)
+            {
+                json_value_free(valueCopy);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Called when the response to a batch is received. Handles it as the response to each message of the batch.
+ *
+ * @param http_status_code A HTTP Status Code
+ * @param context A pointer to the ADUC_D2C_Message_Batch object.
+ */
+static void OnBatchResponse(int http_status_code, void* context)
+{
+    ADUC_D2C_Message_Batch* batch = (ADUC_D2C_Message_Batch*)context;
+
+    for (size_t i = 0; i < batch->memberCount; i++)
+    {
+        DefaultIoTHubSendReportedStateCompletedCallback(http_status_code, batch->members[i]);
+    }
+
+    DestroyMessageData(&batch->context.message);
+    free(batch);
+}
+
+/**
+ * @brief Sends messages of different types as a single reported properties patch.
+ *
+ * @param members The messages' contexts, in submission order. The caller must hold their mutexes.
+ * @param patches The messages' content, parsed.
+ * @param memberCount The number of messages.
+ */
+static void SendBatch(ADUC_D2C_Message_Processing_Context** members, JSON_Value** patches, size_t memberCount)
+{
+    ADUC_D2C_Message_Batch* batch = NULL;
+    JSON_Value* mergedValue = json_value_init_object();
+    ADUC_D2C_Message_Processing_Context* leader = members[0];
+    size_t i = 0;
+
+    if (mergedValue == NULL)
+    {
+        goto fallback;
+    }
+
+    for (i = 0; i < memberCount; i++)
+    {
+        if (!MergeReportedPropertiesPatch(json_value_get_object(mergedValue), json_value_get_object(patches[i])))
+        {
+            goto fallback;
+        }
+    }
+
+    batch = calloc(1, sizeof(*batch));
+    if (batch == NULL)
+    {
+        goto fallback;
+    }
+
+    batch->context.type = leader->type;
+    batch->context.initialized = true;
+    batch->context.transportFunc = leader->transportFunc;
+    batch->context.retryStrategy = leader->retryStrategy;
+    batch->context.message.cloudServiceHandle = leader->message.cloudServiceHandle;
+    batch->context.message.status = ADUC_D2C_Message_Status_In_Progress;
+    batch->context.message.content = json_serialize_to_string(mergedValue);
+    if (batch->context.message.content == NULL)
+    {
+        goto fallback;
+    }
+
+    for (i = 0; i < memberCount; i++)
+    {
+        batch->members[i] = members[i];
+        members[i]->message.attempts++;
+    }
+    batch->memberCount = memberCount;
+
+    pthread_mutex_lock(&s_statisticsMutex);
+    s_statistics.sendAttempts += memberCount;
+    s_statistics.batchedMessages += memberCount;
+    s_statistics.transportCalls++;
+    s_statistics.bytesSent += strlen(batch->context.message.content);
+    pthread_mutex_unlock(&s_statisticsMutex);
+
+    Log_Debug("Sending %u D2C messages as one (t:%d).", (unsigned int)memberCount, leader->type);
+
+    if (batch->context.transportFunc(batch->context.message.cloudServiceHandle, &batch->context, OnBatchResponse)
+        == 0)
+    {
+        // OnBatchResponse releases the batch.
+        for (i = 0; i < memberCount; i++)
+        {
+            SetMessageStatus(&members[i]->message, ADUC_D2C_Message_Status_Waiting_For_Response);
+        }
+
+        json_value_free(mergedValue);
+        return;
+    }
+
+    for (i = 0; i < memberCount; i++)
+    {
+        if (batch->context.message.content == NULL)
+        {
+            // The transport function gave up on the content.
+            OnMessageProcessingCompleted(&members[i]->message, ADUC_D2C_Message_Status_Failed);
+        }
+        else
+        {
+            members[i]->nextRetryTimeStampEpoch += FATAL_ERROR_WAIT_TIME_SEC;
+        }
+    }
+
+    Log_Error(
+        "Failed to send messages. Will retry in the next %d seconds. (t:%d)", FATAL_ERROR_WAIT_TIME_SEC, leader->type);
+
+    DestroyMessageData(&batch->context.message);
+    free(batch);
+    json_value_free(mergedValue);
+    return;
+
+fallback:
+    Log_Warn("Cannot merge D2C messages. Sending them separately.");
+
+    if (batch != NULL)
+    {
+        DestroyMessageData(&batch->context.message);
+        free(batch);
+    }
+
+    json_value_free(mergedValue);
+
+    for (i = 0; i < memberCount; i++)
+    {
+        SendMessage(members[i]);
+    }
+}
+
+/**
+ * @brief Sends the messages that are due. Those that are reported properties patches (JSON objects) for the same
+ * transport are merged and sent at once, in a single twin update.
+ *
+ * @param readyContexts The contexts of the messages that are due, by type.
+ * @param readyCount The number of contexts.
+ */
+static void SendMessages(ADUC_D2C_Message_Processing_Context** readyContexts, size_t readyCount)
+{
+    ADUC_D2C_Message_Processing_Context* batchMembers[ADUC_D2C_Message_Type_Max];
+    JSON_Value* batchPatches[ADUC_D2C_Message_Type_Max];
+    ADUC_D2C_Message_Processing_Context* soloMembers[ADUC_D2C_Message_Type_Max];
+    size_t batchCount = 0;
+    size_t soloCount = 0;
+    size_t batchContentSize = 0;
+    size_t i = 0;
+
+    // Lock in the same order as ADUC_D2C_Messaging_Uninit.
+    pthread_mutex_lock(&s_pendingMessageStoreMutex);
+    for (i = 0; i < readyCount; i++)
+    {
+        pthread_mutex_lock(&readyContexts[i]->mutex);
+    }
+
+    for (i = 0; i < readyCount; i++)
+    {
+        ADUC_D2C_Message_Processing_Context* message_processing_context = readyContexts[i];
+        JSON_Value* patch = NULL;
+        size_t contentSize = 0;
+
+        // The message may have been canceled since it was found to be due.
+        if (message_processing_context->message.content == NULL
+            || message_processing_context->message.status != ADUC_D2C_Message_Status_In_Progress)
+        {
+            continue;
+        }
+
+        contentSize = strlen(message_processing_context->message.content);
+
+        if (s_batchWindowMs != 0 && message_processing_context->transportFunc != NULL
+            && batchContentSize + contentSize <= MAX_BATCH_CONTENT_SIZE
+            && (batchCount == 0
+                || (message_processing_context->transportFunc == batchMembers[0]->transportFunc
+                    && message_processing_context->message.cloudServiceHandle
+                        == batchMembers[0]->message.cloudServiceHandle)))
+        {
+            patch = json_parse_string(message_processing_context->message.content);
+        }
+
+        if (json_value_get_type(patch) != JSONObject)
+        {
+            json_value_free(patch);
+            soloMembers[soloCount++] = message_processing_context;
+            continue;
+        }
+
+        // Keep the batch in submission order, so that later patches win.
+        size_t position = batchCount;
+        while (position > 0
+               && batchMembers[position - 1]->message.submitTimeMs > message_processing_context->message.submitTimeMs)
+        {
+            batchMembers[position] = batchMembers[position - 1];
+            batchPatches[position] = batchPatches[position - 1];
+            position--;
+        }
+
+        batchMembers[position] = message_processing_context;
+        batchPatches[position] = patch;
+        batchCount++;
+        batchContentSize += contentSize;
+    }
+
+    if (batchCount == 1)
+    {
+        // Nothing to merge with, so send the content as it is.
+        soloMembers[soloCount++] = batchMembers[0];
+    }
+    else if (batchCount > 1)
+    {
+        SendBatch(batchMembers, batchPatches, batchCount);
+    }
+
+    for (i = 0; i < batchCount; i++)
+    {
+        json_value_free(batchPatches[i]);
+    }
+
+    for (i = 0; i < soloCount; i++)
+    {
+        SendMessage(soloMembers[i]);
+    }
+
+    if (batchCount + soloCount > 0)
+    {
+        s_lastSendTimeMs = GetTimeInMilliseconds();
+    }
+
+    for (i = readyCount; i > 0; i--)
+    {
+        pthread_mutex_unlock(&readyContexts[i - 1]->mutex);
+    }
+    pthread_mutex_unlock(&s_pendingMessageStoreMutex);
+}
+
 /**
  * @brief Performs messages processing tasks.
  *
- * Note: must call this function every 100ms - 200ms to ensure that the Device to Cloud messages
- *       are processed in timely manner.
+ * Note: the main loop calls this function whenever it wakes up. It requests the next wake-up it needs with
+ *       ADUC_EventLoop_RequestWakeIn, and submitting a message wakes the main loop.
  *
  **/
 void ADUC_D2C_Messaging_DoWork()
 {
+    ADUC_D2C_Message_Processing_Context* readyContexts[ADUC_D2C_Message_Type_Max];
+    size_t readyCount = 0;
+    const unsigned int holdMs = GetBatchHoldTimeMs();
+
     for (int i = 0; i < ADUC_D2C_Message_Type_Max; i++)
     {
-        ProcessMessage(&s_messageProcessingContext[i]);
+        if (ProcessMessage(&s_messageProcessingContext[i], holdMs == 0))
+        {
+            readyContexts[readyCount++] = &s_messageProcessingContext[i];
+        }
+    }
+
+    if (readyCount > 0)
+    {
+        SendMessages(readyContexts, readyCount);
     }
+
+    RequestNextWakeUp(holdMs);
 }
 
 /**
  * @brief Processes the message.
  * @param message_processing_context The message processing context.
- * @return Returns true if the message is sent.
- * @remark This function must be called every 100ms - 200ms to ensure that the Device to Cloud messages
- *        are processed in timely manner but also yield the CPU to other tasks.
+ * @param canSend Whether the message can be sent now, if it is due.
+ * @return Returns true if the message is due and can be sent now.
+ * @remark Called from ADUC_D2C_Messaging_DoWork whenever the main loop wakes up.
  */
-static void ProcessMessage(ADUC_D2C_Message_Processing_Context* message_processing_context)
+static bool ProcessMessage(ADUC_D2C_Message_Processing_Context* message_processing_context, bool canSend)
 {
     bool shouldSend = false;
     time_t now = GetTimeSinceEpochInSeconds();
@@ -356,13 +807,13 @@ static void ProcessMessage(ADUC_D2C_Message_Processing_Context* message_processi
     if (message_processing_context == NULL)
     {
         Log_Error("context is NULL");
-        return;
+        return false;
     }
 
     if (!message_processing_context->initialized)
     {
         Log_Warn("Message processing context (0x%x) is not initialized.", message_processing_context);
-        return;
+        return false;
     }
 
     pthread_mutex_lock(&s_pendingMessageStoreMutex);
@@ -383,6 +834,11 @@ static void ProcessMessage(ADUC_D2C_Message_Processing_Context* message_processi
                 "New D2C message content (t:%d, content:0x%x).",
                 message_processing_context->type,
                 s_pendingMessageStore[message_processing_context->type].content);
+
+            pthread_mutex_lock(&s_statisticsMutex);
+            s_statistics.messagesReplaced++;
+            pthread_mutex_unlock(&s_statisticsMutex);
+
             OnMessageProcessingCompleted(&message_processing_context->message, ADUC_D2C_Message_Status_Replaced);
         }
 
@@ -407,41 +863,11 @@ static void ProcessMessage(ADUC_D2C_Message_Processing_Context* message_processi
         shouldSend = true;
     }
 
-    if (shouldSend)
-    {
-        if (message_processing_context->transportFunc == NULL)
-        {
-            Log_Error(
-                "Cannot send message. Transport function is NULL. Will retry in the next %d seconds. (t:%d)",
-                FATAL_ERROR_WAIT_TIME_SEC,
-                message_processing_context->type);
-            message_processing_context->nextRetryTimeStampEpoch += FATAL_ERROR_WAIT_TIME_SEC;
-        }
-        else
-        {
-            message_processing_context->message.attempts++;
-            Log_Debug(
-                "Sending D2C message (t:%d, retries:%d).",
-                message_processing_context->type,
-                message_processing_context->retries);
-            if (message_processing_context->transportFunc(
-                    message_processing_context->message.cloudServiceHandle,
-                    message_processing_context,
-                    DefaultIoTHubSendReportedStateCompletedCallback)
-                != 0)
-            {
-                message_processing_context->nextRetryTimeStampEpoch += FATAL_ERROR_WAIT_TIME_SEC;
-                Log_Error(
-                    "Failed to send message. Will retry in the next %d seconds. (t:%d)",
-                    FATAL_ERROR_WAIT_TIME_SEC,
-                    message_processing_context->type);
-            }
-        }
-    }
-
 done:
     pthread_mutex_unlock(&message_processing_context->mutex);
     pthread_mutex_unlock(&s_pendingMessageStoreMutex);
+
+    return shouldSend && canSend;
 }
 
 /**
@@ -472,6 +898,12 @@ bool ADUC_D2C_Messaging_Init()
             s_messageProcessingContext[i].initialized = true;
             Log_Debug("Message processing context initialized. (t:%d)", i);
         }
+        s_lastSendTimeMs = 0;
+
+        pthread_mutex_lock(&s_statisticsMutex);
+        memset(&s_statistics, 0, sizeof(s_statistics));
+        pthread_mutex_unlock(&s_statisticsMutex);
+
         s_core_initialized = true;
     }
     success = true;
@@ -490,6 +922,21 @@ void ADUC_D2C_Messaging_Uninit()
     pthread_mutex_lock(&s_pendingMessageStoreMutex);
     if (s_core_initialized)
     {
+        ADUC_D2C_Messaging_Statistics statistics;
+        ADUC_D2C_Messaging_GetStatistics(&statistics);
+        Log_Info(
+            "D2C messages: %llu submitted, %llu replaced, %llu delivered (avg %llu ms, max %llu ms), "
+            "%llu sent in %llu transport calls (%llu batched, %llu bytes).",
+            statistics.messagesSubmitted,
+            statistics.messagesReplaced,
+            statistics.messagesDelivered,
+            statistics.messagesDelivered == 0 ? 0 : statistics.totalDeliveryLatencyMs / statistics.messagesDelivered,
+            statistics.maxDeliveryLatencyMs,
+            statistics.sendAttempts,
+            statistics.transportCalls,
+            statistics.batchedMessages,
+            statistics.bytesSent);
+
         // Cancel pending messages
         for (int i = 0; i < ADUC_D2C_Message_Type_Max && s_messageProcessingContext[i].initialized; i++)
         {
@@ -548,6 +995,14 @@ bool ADUC_D2C_Message_SendAsync(
     }
     pthread_mutex_lock(&s_pendingMessageStoreMutex);
 
+    pthread_mutex_lock(&s_statisticsMutex);
+    s_statistics.messagesSubmitted++;
+    if (s_pendingMessageStore[type].content != NULL)
+    {
+        s_statistics.messagesReplaced++;
+    }
+    pthread_mutex_unlock(&s_statisticsMutex);
+
     // Replace pending message if exist.
     if (s_pendingMessageStore[type].content != NULL)
     {
@@ -567,9 +1022,13 @@ bool ADUC_D2C_Message_SendAsync(
     s_pendingMessageStore[type].completedCallback = completedCallback;
     s_pendingMessageStore[type].statusChangedCallback = statusChangedCallback;
     s_pendingMessageStore[type].contentSubmitTime = GetTimeSinceEpochInSeconds();
+    s_pendingMessageStore[type].submitTimeMs = GetTimeInMilliseconds();
     s_pendingMessageStore[type].userData = userData;
     SetMessageStatus(&s_pendingMessageStore[type], ADUC_D2C_Message_Status_Pending);
     pthread_mutex_unlock(&s_pendingMessageStoreMutex);
+
+    // Send it now, rather than on the main loop's next wake-up.
+    ADUC_EventLoop_Wake();
     return true;
 }
 
@@ -652,3 +1111,67 @@ void ADUC_D2C_Messaging_Set_Retry_Strategy(ADUC_D2C_Message_Type type, ADUC_D2C_
     s_messageProcessingContext[type].retryStrategy = strategy;
     pthread_mutex_unlock(&s_messageProcessingContext[type].mutex);
 }
+
+/**
+ * @brief Sets how long messages are held after a send, so that those submitted meanwhile are sent together.
+ *
+ * @param windowMs The window, in milliseconds. 0 sends each message as soon as possible, on its own.
+ */
+void ADUC_D2C_Messaging_Set_Batch_Window(unsigned int windowMs)
+{
+    s_batchWindowMs = windowMs;
+}
+
+/**
+ * @brief Resends the messages that were not delivered when the connection to the cloud was re-created.
+ */
+void ADUC_D2C_Messaging_OnReconnected()
+{
+    const time_t now = GetTimeSinceEpochInSeconds();
+    bool hasResend = false;
+
+    for (int i = 0; i < ADUC_D2C_Message_Type_Max; i++)
+    {
+        ADUC_D2C_Message_Processing_Context* message_processing_context = &s_messageProcessingContext[i];
+
+        if (!message_processing_context->initialized)
+        {
+            continue;
+        }
+
+        pthread_mutex_lock(&message_processing_context->mutex);
+
+        if (message_processing_context->message.content != NULL
+            && (message_processing_context->message.status == ADUC_D2C_Message_Status_Waiting_For_Response
+                || message_processing_context->message.status == ADUC_D2C_Message_Status_In_Progress))
+        {
+            Log_Info(
+                "Resending D2C message on the new connection (t:%d, r:%d).",
+                message_processing_context->type,
+                message_processing_context->retries);
+
+            message_processing_context->nextRetryTimeStampEpoch = now;
+            SetMessageStatus(&message_processing_context->message, ADUC_D2C_Message_Status_In_Progress);
+            hasResend = true;
+        }
+
+        pthread_mutex_unlock(&message_processing_context->mutex);
+    }
+
+    if (hasResend)
+    {
+        ADUC_EventLoop_Wake();
+    }
+}
+
+/**
+ * @brief Gets the statistics of the messages processed since ADUC_D2C_Messaging_Init.
+ *
+ * @param[out] statistics The statistics.
+ */
+void ADUC_D2C_Messaging_GetStatistics(ADUC_D2C_Messaging_Statistics* statistics)
+{
+    pthread_mutex_lock(&s_statisticsMutex);
+    *statistics = s_statistics;
+    pthread_mutex_unlock(&s_statisticsMutex);
+}
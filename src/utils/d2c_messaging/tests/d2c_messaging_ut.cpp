@@ -6,6 +6,9 @@
 
 #include <catch2/catch_all.hpp>
 #include <stdexcept> // runtime_error
+#include <string>
+#include <utility> // move, pair
+#include <vector>
 #include <string.h>
 
 #include <aducpal/time.h> // nanosleep
@@ -765,3 +768,166 @@ TEST_CASE("30 retries - httpStatus 401", "[.][functional]")
     ADUC_D2C_Messaging_Uninit();
     g_testCaseSyncMutex.unlock();
 }
+
+static std::vector<std::string> g_batchTestSentContents;
+static std::vector<std::pair<ADUC_C2D_RESPONSE_HANDLER_FUNCTION, void*>> g_batchTestPendingResponses;
+
+static int BatchTestTransportFunc(
+    void* cloudServiceHandle, void* context, ADUC_C2D_RESPONSE_HANDLER_FUNCTION c2dResponseHandlerFunc)
+{
+    UNREFERENCED_PARAMETER(cloudServiceHandle);
+    auto message_processing_context = static_cast<ADUC_D2C_Message_Processing_Context*>(context);
+    g_batchTestSentContents.emplace_back(message_processing_context->message.content);
+    g_batchTestPendingResponses.emplace_back(c2dResponseHandlerFunc, context);
+    return 0;
+}
+
+static void BatchTestRespond(int httpStatus)
+{
+    auto responses = std::move(g_batchTestPendingResponses);
+    g_batchTestPendingResponses.clear();
+    for (const auto& response : responses)
+    {
+        response.first(httpStatus, response.second);
+    }
+}
+
+static void OnBatchTestMessageStatusChanged(void* context, ADUC_D2C_Message_Status status)
+{
+    auto message = static_cast<ADUC_D2C_Message*>(context);
+    *static_cast<ADUC_D2C_Message_Status*>(message->userData) = status;
+}
+
+TEST_CASE("Messages submitted within the batch window are merged")
+{
+    g_testCaseSyncMutex.lock();
+
+    auto handle = static_cast<ADUC_ClientHandle>((void*)(1)); // We don't need real handle.
+    ADUC_D2C_Message_Status firstStatus = ADUC_D2C_Message_Status_Pending;
+    ADUC_D2C_Message_Status resultStatus = ADUC_D2C_Message_Status_Pending;
+    ADUC_D2C_Message_Status propertiesStatus = ADUC_D2C_Message_Status_Pending;
+    ADUC_D2C_Messaging_Statistics statistics;
+    timespec t;
+
+    g_batchTestSentContents.clear();
+    g_batchTestPendingResponses.clear();
+
+    ADUC_D2C_Messaging_Init();
+    ADUC_D2C_Messaging_Set_Batch_Window(200);
+    ADUC_D2C_Messaging_Set_Transport(ADUC_D2C_Message_Type_Device_Update_Result, BatchTestTransportFunc);
+    ADUC_D2C_Messaging_Set_Transport(ADUC_D2C_Message_Type_Device_Properties, BatchTestTransportFunc);
+
+    // The first message is sent right away, on its own.
+    ADUC_D2C_Message_SendAsync(
+        ADUC_D2C_Message_Type_Device_Update_Result,
+        &handle,
+        R"({"deviceUpdate":{"__t":"c","agent":{"state":0}}})",
+        nullptr /* responseCallback */,
+        OnBatchTestMessageStatusChanged,
+        OnBatchTestMessageStatusChanged,
+        &firstStatus);
+    ADUC_D2C_Messaging_DoWork();
+    REQUIRE(g_batchTestSentContents.size() == 1);
+    CHECK(g_batchTestSentContents[0] == R"({"deviceUpdate":{"__t":"c","agent":{"state":0}}})");
+    BatchTestRespond(200);
+    CHECK(firstStatus == ADUC_D2C_Message_Status_Success);
+
+    // Those that follow within the window are held, then sent together.
+    ADUC_D2C_Message_SendAsync(
+        ADUC_D2C_Message_Type_Device_Update_Result,
+        &handle,
+        R"({"deviceUpdate":{"__t":"c","agent":{"state":6}}})",
+        nullptr /* responseCallback */,
+        OnBatchTestMessageStatusChanged,
+        OnBatchTestMessageStatusChanged,
+        &resultStatus);
+    ADUC_D2C_Message_SendAsync(
+        ADUC_D2C_Message_Type_Device_Properties,
+        &handle,
+        R"({"deviceUpdate":{"__t":"c","agent":{"deviceProperties":{"interfaceId":"x"}}}})",
+        nullptr /* responseCallback */,
+        OnBatchTestMessageStatusChanged,
+        OnBatchTestMessageStatusChanged,
+        &propertiesStatus);
+    ADUC_D2C_Messaging_DoWork();
+    CHECK(g_batchTestSentContents.size() == 1);
+
+    set_timespec_ms(&t, 300);
+    (void)ADUCPAL_nanosleep(&t, nullptr);
+    ADUC_D2C_Messaging_DoWork();
+    REQUIRE(g_batchTestSentContents.size() == 2);
+    CHECK(
+        g_batchTestSentContents[1]
+        == R"({"deviceUpdate":{"__t":"c","agent":{"state":6,"deviceProperties":{"interfaceId":"x"}}}})");
+    CHECK(resultStatus == ADUC_D2C_Message_Status_Waiting_For_Response);
+    CHECK(propertiesStatus == ADUC_D2C_Message_Status_Waiting_For_Response);
+
+    BatchTestRespond(200);
+    CHECK(resultStatus == ADUC_D2C_Message_Status_Success);
+    CHECK(propertiesStatus == ADUC_D2C_Message_Status_Success);
+
+    ADUC_D2C_Messaging_GetStatistics(&statistics);
+    CHECK(statistics.messagesSubmitted == 3);
+    CHECK(statistics.messagesDelivered == 3);
+    CHECK(statistics.sendAttempts == 3);
+    CHECK(statistics.transportCalls == 2);
+    CHECK(statistics.batchedMessages == 2);
+
+    ADUC_D2C_Messaging_Uninit();
+    g_testCaseSyncMutex.unlock();
+}
+
+TEST_CASE("Messages awaiting a response are resent on reconnection")
+{
+    g_testCaseSyncMutex.lock();
+
+    auto handle = static_cast<ADUC_ClientHandle>((void*)(1)); // We don't need real handle.
+    ADUC_D2C_Message_Status resultStatus = ADUC_D2C_Message_Status_Pending;
+    ADUC_D2C_Messaging_Statistics statistics;
+
+    g_batchTestSentContents.clear();
+    g_batchTestPendingResponses.clear();
+
+    ADUC_D2C_Messaging_Init();
+    ADUC_D2C_Messaging_Set_Batch_Window(0);
+    ADUC_D2C_Messaging_Set_Transport(ADUC_D2C_Message_Type_Device_Update_Result, BatchTestTransportFunc);
+
+    ADUC_D2C_Message_SendAsync(
+        ADUC_D2C_Message_Type_Device_Update_Result,
+        &handle,
+        R"({"deviceUpdate":{"__t":"c","agent":{"state":6}}})",
+        nullptr /* responseCallback */,
+        OnBatchTestMessageStatusChanged,
+        OnBatchTestMessageStatusChanged,
+        &resultStatus);
+    ADUC_D2C_Messaging_DoWork();
+    REQUIRE(g_batchTestSentContents.size() == 1);
+    CHECK(resultStatus == ADUC_D2C_Message_Status_Waiting_For_Response);
+
+    // The connection is re-created: the response to the first send never comes.
+    g_batchTestPendingResponses.clear();
+    ADUC_D2C_Messaging_DoWork();
+    CHECK(g_batchTestSentContents.size() == 1);
+
+    ADUC_D2C_Messaging_OnReconnected();
+    CHECK(resultStatus == ADUC_D2C_Message_Status_In_Progress);
+
+    ADUC_D2C_Messaging_DoWork();
+    REQUIRE(g_batchTestSentContents.size() == 2);
+    CHECK(g_batchTestSentContents[1] == R"({"deviceUpdate":{"__t":"c","agent":{"state":6}}})");
+
+    BatchTestRespond(200);
+    CHECK(resultStatus == ADUC_D2C_Message_Status_Success);
+
+    // Nothing is left to resend.
+    ADUC_D2C_Messaging_OnReconnected();
+    ADUC_D2C_Messaging_DoWork();
+    CHECK(g_batchTestSentContents.size() == 2);
+
+    ADUC_D2C_Messaging_GetStatistics(&statistics);
+    CHECK(statistics.messagesDelivered == 1);
+    CHECK(statistics.sendAttempts == 2);
+
+    ADUC_D2C_Messaging_Uninit();
+    g_testCaseSyncMutex.unlock();
+}
@@ -0,0 +1,74 @@
+/**
+ * @file download_cache_utils.h
+ * @brief Content-addressed cache of downloaded update payloads, shared across workflows.
+ *
+ * @details Entries are keyed by the SHA-256 hash of the payload. The cache is bounded in size, and the least recently
+ * used entries are evicted first.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_DOWNLOAD_CACHE_UTILS_H
+#define ADUC_DOWNLOAD_CACHE_UTILS_H
+
+#include "aduc/c_utils.h"
+
+#include <stdbool.h> // for bool
+#include <stdint.h> // for uint64_t
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief Gets the path of the cache entry for a payload.
+ *
+ * @param cacheFolder The download cache folder.
+ * @param sha256HashBase64 The base64 encoded SHA-256 hash of the payload.
+ * @return char* The path of the entry, which may not exist, or NULL if the hash is not a base64 encoded SHA-256 hash.
+ * Caller must free.
+ */
+char* ADUC_DownloadCache_GetEntryPath(const char* cacheFolder, const char* sha256HashBase64);
+
+/**
+ * @brief Produces a payload from the cache as a clone or a copy of its entry (see ADUC_SystemUtils_CopyFile).
+ *
+ * @param cacheFolder The download cache folder.
+ * @param sha256HashBase64 The base64 encoded SHA-256 hash of the payload.
+ * @param targetFilePath The path of the file to produce. It must not exist.
+ * @return bool true if the payload was in the cache and the file was produced.
+ */
+bool ADUC_DownloadCache_Restore(const char* cacheFolder, const char* sha256HashBase64, const char* targetFilePath);
+
+/**
+ * @brief Adds a payload to the cache as a clone or a copy (see ADUC_SystemUtils_CopyFile), and evicts the least
+ * recently used entries to keep the cache within its size.
+ *
+ * @param cacheFolder The download cache folder. It is created if it does not exist.
+ * @param sha256HashBase64 The base64 encoded SHA-256 hash of the payload. The caller must have verified it.
+ * @param filePath The path of the payload.
+ * @param maxCacheSizeInBytes The maximum total size of the entries in the cache.
+ * @return bool true if the payload is in the cache.
+ */
+bool ADUC_DownloadCache_Add(
+    const char* cacheFolder, const char* sha256HashBase64, const char* filePath, uint64_t maxCacheSizeInBytes);
+
+/**
+ * @brief Removes the entry for a payload from the cache, e.g. when its content is found to be corrupted.
+ *
+ * @param cacheFolder The download cache folder.
+ * @param sha256HashBase64 The base64 encoded SHA-256 hash of the payload.
+ * @return bool true if the cache no longer has an entry for the payload.
+ */
+bool ADUC_DownloadCache_Remove(const char* cacheFolder, const char* sha256HashBase64);
+
+/**
+ * @brief Evicts the least recently used entries until the total size of the entries is at most @p maxCacheSizeInBytes.
+ *
+ * @param cacheFolder The download cache folder.
+ * @param maxCacheSizeInBytes The maximum total size of the entries in the cache.
+ * @return bool true on success.
+ */
+bool ADUC_DownloadCache_Trim(const char* cacheFolder, uint64_t maxCacheSizeInBytes);
+
+EXTERN_C_END
+
+#endif // ADUC_DOWNLOAD_CACHE_UTILS_H
@@ -0,0 +1,335 @@
+/**
+ * @file download_cache_utils.cpp
+ * @brief Content-addressed cache of downloaded update payloads, shared across workflows.
+ *
+ * @details Each entry is a file named "sha256-<hash>" in the cache folder, where <hash> is the base64url encoding of
+ * the SHA-256 hash of the payload. The last modified time of an entry is updated whenever it is used, and the entries
+ * with the oldest last modified time are evicted first.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#include "aduc/download_cache_utils.h"
+
+#include <aduc/auto_opendir.hpp> // aduc::AutoOpenDir
+#include <aduc/logging.h>
+#include <aduc/string_c_utils.h> // ADUC_StringFormat
+#include <aduc/system_utils.h> // ADUC_SystemUtils_CopyFile, ADUC_SystemUtils_MkDirRecursiveDefault
+
+#include <algorithm> // std::sort
+#include <errno.h>
+#include <fcntl.h> // AT_FDCWD
+#include <mutex>
+#include <stdio.h> // rename, remove
+#include <stdlib.h> // free
+#include <string.h> // strchr, strncmp, strlen
+#include <string>
+#include <sys/stat.h> // stat, utimensat
+#include <unistd.h> // access, unlink
+#include <vector>
+
+// keep this last to minimize chance to interfere with system header includes.
+#include "aduc/aduc_banned.h"
+
+/**
+ * @brief The prefix of the file name of every cache entry.
+ */
+static const char k_entryPrefix[] = "sha256-";
+
+/**
+ * @brief The length of a base64 encoded SHA-256 hash, including its padding character.
+ */
+static const size_t k_sha256Base64Length = 44;
+
+// Payloads of a workflow are downloaded in parallel, so serialize the changes to the cache of this module.
+static std::mutex s_cacheMutex;
+
+/**
+ * @brief A cache entry, for choosing the entries to evict.
+ */
+struct DownloadCacheEntry
+{
+    std::string path; /**< The path of the entry. */
+    struct timespec lastUsed; /**< The last modified time of the entry. */
+    uint64_t sizeInBytes; /**< The size of the entry. */
+};
+
+/**
+ * @brief Converts a base64 encoded SHA-256 hash to the base64url encoding without padding, which is a valid file name.
+ *
+ * @param sha256HashBase64 The base64 encoded hash.
+ * @param[out] key The file name key.
+ * @return bool false if the hash is not a base64 encoded SHA-256 hash.
+ */
+static bool GetEntryKey(const char* sha256HashBase64, std::string* key)
+{
+    if (sha256HashBase64 == nullptr || strlen(sha256HashBase64) != k_sha256Base64Length
+        || sha256HashBase64[k_sha256Base64Length - 1] != '=')
+    {
+        return false;
+    }
+
+    key->clear();
+    for (size_t i = 0; i < k_sha256Base64Length - 1; ++i)
+    {
+        const char c = sha256HashBase64[i];
+        if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
+        {
+            key->push_back(c);
+        }
+        else if (c == '+')
+        {
+            key->push_back('-');
+        }
+        else if (c == '/')
+        {
+            key->push_back('_');
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Marks an entry as used now, so that it is evicted after the entries used before it.
+ *
+ * @param entryPath The path of the entry.
+ */
+static void TouchEntry(const char* entryPath)
+{
+    if (utimensat(AT_FDCWD, entryPath, nullptr /* now */, 0) != 0)
+    {
+        Log_Warn("Cannot update last used time of '%s', errno %d", entryPath, errno);
+    }
+}
+
+/**
+ * @brief Lists the entries of the cache.
+ *
+ * @param cacheFolder The download cache folder.
+ * @param[out] entries The entries.
+ * @param[out] totalSizeInBytes The total size of the entries.
+ */
+static void ListEntries(const char* cacheFolder, std::vector<DownloadCacheEntry>* entries, uint64_t* totalSizeInBytes)
+{
+    aduc::AutoOpenDir dir{ cacheFolder };
+    struct dirent* dirEntry = nullptr;
+
+    entries->clear();
+    *totalSizeInBytes = 0;
+
+    if (dir.GetDirectoryStreamHandle() == nullptr)
+    {
+        return;
+    }
+
+    while ((dirEntry = dir.NextDirEntry()) != nullptr)
+    {
+        // Skip files that are not entries, including entries still being added under a temporary name.
+        if (strncmp(dirEntry->d_name, k_entryPrefix, sizeof(k_entryPrefix) - 1) != 0
+            || strchr(dirEntry->d_name, '.') != nullptr)
+        {
+            continue;
+        }
+
+        std::string path = std::string{ cacheFolder } + "/" + dirEntry->d_name;
+        struct stat st = {};
+        if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            continue;
+        }
+
+        entries->push_back(DownloadCacheEntry{ std::move(path), st.st_mtim, static_cast<uint64_t>(st.st_size) });
+        *totalSizeInBytes += static_cast<uint64_t>(st.st_size);
+    }
+}
+
+/**
+ * @brief Evicts the least recently used entries until the total size of the entries is at most maxCacheSizeInBytes.
+ * The caller must hold s_cacheMutex.
+ *
+ * @param cacheFolder The download cache folder.
+ * @param maxCacheSizeInBytes The maximum total size of the entries.
+ * @return bool true on success.
+ */
+static bool TrimLocked(const char* cacheFolder, uint64_t maxCacheSizeInBytes)
+{
+    std::vector<DownloadCacheEntry> entries;
+    uint64_t totalSizeInBytes = 0;
+
+    ListEntries(cacheFolder, &entries, &totalSizeInBytes);
+    if (totalSizeInBytes <= maxCacheSizeInBytes)
+    {
+        return true;
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const DownloadCacheEntry& first, const DownloadCacheEntry& second) {
+        return first.lastUsed.tv_sec != second.lastUsed.tv_sec ? first.lastUsed.tv_sec < second.lastUsed.tv_sec
+                                                                : first.lastUsed.tv_nsec < second.lastUsed.tv_nsec;
+    });
+
+    for (const DownloadCacheEntry& entry : entries)
+    {
+        if (totalSizeInBytes <= maxCacheSizeInBytes)
+        {
+            break;
+        }
+
+        if (unlink(entry.path.c_str()) != 0 && errno != ENOENT)
+        {
+            Log_Warn("Cannot evict '%s' from download cache, errno %d", entry.path.c_str(), errno);
+            continue;
+        }
+
+        Log_Debug("Evicted '%s' from download cache.", entry.path.c_str());
+        totalSizeInBytes -= entry.sizeInBytes;
+    }
+
+    return totalSizeInBytes <= maxCacheSizeInBytes;
+}
+
+EXTERN_C_BEGIN
+
+char* ADUC_DownloadCache_GetEntryPath(const char* cacheFolder, const char* sha256HashBase64)
+{
+    std::string key;
+
+    if (cacheFolder == nullptr || !GetEntryKey(sha256HashBase64, &key))
+    {
+        return nullptr;
+    }
+
+    return ADUC_StringFormat("%s/%s%s", cacheFolder, k_entryPrefix, key.c_str());
+}
+
+bool ADUC_DownloadCache_Restore(const char* cacheFolder, const char* sha256HashBase64, const char* targetFilePath)
+{
+    bool succeeded = false;
+    char* entryPath = ADUC_DownloadCache_GetEntryPath(cacheFolder, sha256HashBase64);
+
+    if (entryPath == nullptr || targetFilePath == nullptr)
+    {
+        goto done;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{ s_cacheMutex };
+
+        if (access(entryPath, R_OK) != 0)
+        {
+            goto done;
+        }
+
+        // The produced file must not share its inode with the entry, or changes to the file would corrupt the entry.
+        if (ADUC_SystemUtils_CopyFile(entryPath, targetFilePath, false /* overwriteExistingFile */, nullptr) != 0)
+        {
+            Log_Warn("Cannot produce '%s' from download cache entry '%s', errno %d", targetFilePath, entryPath, errno);
+            goto done;
+        }
+
+        TouchEntry(entryPath);
+    }
+
+    Log_Info("Produced '%s' from download cache.", targetFilePath);
+    succeeded = true;
+
+done:
+    free(entryPath);
+    return succeeded;
+}
+
+bool ADUC_DownloadCache_Add(
+    const char* cacheFolder, const char* sha256HashBase64, const char* filePath, uint64_t maxCacheSizeInBytes)
+{
+    bool succeeded = false;
+    struct stat st = {};
+    std::string tempEntryPath;
+    char* entryPath = ADUC_DownloadCache_GetEntryPath(cacheFolder, sha256HashBase64);
+
+    if (entryPath == nullptr || filePath == nullptr)
+    {
+        goto done;
+    }
+
+    if (stat(filePath, &st) != 0 || static_cast<uint64_t>(st.st_size) > maxCacheSizeInBytes)
+    {
+        goto done;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{ s_cacheMutex };
+
+        if (access(entryPath, F_OK) == 0)
+        {
+            TouchEntry(entryPath);
+            succeeded = true;
+            goto done;
+        }
+
+        if (ADUC_SystemUtils_MkDirRecursiveDefault(cacheFolder) != 0)
+        {
+            Log_Warn("Cannot create download cache folder '%s'", cacheFolder);
+            goto done;
+        }
+
+        // Make room for the payload before adding it, so that the cache never exceeds its size.
+        if (!TrimLocked(cacheFolder, maxCacheSizeInBytes - static_cast<uint64_t>(st.st_size)))
+        {
+            goto done;
+        }
+
+        // The entry must not share its inode with the payload, as handlers may change the payload in place after the
+        // download. Clone or copy it under a temporary name, so that an entry is never incomplete.
+        tempEntryPath = std::string{ entryPath } + ".tmp";
+        unlink(tempEntryPath.c_str());
+
+        if (ADUC_SystemUtils_CopyFile(filePath, tempEntryPath.c_str(), true /* overwriteExistingFile */, nullptr) != 0
+            || rename(tempEntryPath.c_str(), entryPath) != 0)
+        {
+            Log_Warn("Cannot add '%s' to download cache, errno %d", filePath, errno);
+            unlink(tempEntryPath.c_str());
+            goto done;
+        }
+
+        TouchEntry(entryPath);
+    }
+
+    Log_Debug("Added '%s' to download cache as '%s'.", filePath, entryPath);
+    succeeded = true;
+
+done:
+    free(entryPath);
+    return succeeded;
+}
+
+bool ADUC_DownloadCache_Remove(const char* cacheFolder, const char* sha256HashBase64)
+{
+    char* entryPath = ADUC_DownloadCache_GetEntryPath(cacheFolder, sha256HashBase64);
+    if (entryPath == nullptr)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock{ s_cacheMutex };
+    const bool succeeded = (unlink(entryPath) == 0 || errno == ENOENT);
+    free(entryPath);
+    return succeeded;
+}
+
+bool ADUC_DownloadCache_Trim(const char* cacheFolder, uint64_t maxCacheSizeInBytes)
+{
+    if (cacheFolder == nullptr)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock{ s_cacheMutex };
+    return TrimLocked(cacheFolder, maxCacheSizeInBytes);
+}
+
+EXTERN_C_END
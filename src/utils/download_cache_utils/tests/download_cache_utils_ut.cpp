@@ -0,0 +1,194 @@
+/**
+ * @file download_cache_utils_ut.cpp
+ * @brief Unit Tests for download_cache_utils library
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/download_cache_utils.h"
+
+#include <aduc/calloc_wrapper.hpp> // ADUC::StringUtils::cstr_wrapper
+#include <aduc/system_utils.h>
+
+#include <catch2/catch_all.hpp>
+using Catch::Matchers::Equals;
+
+#include <fcntl.h> // AT_FDCWD
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h> // stat, utimensat
+
+// The cache trusts the caller to have verified the hashes, so these do not need to match the content.
+static const char* k_hashA = "47DEQpj8HBSa+/TImW+5JCeuQeRkm5NMpJWZG3hSuFU=";
+static const char* k_hashB = "ypeBEsobvcr6wjGzmiPcTaeG7/gUfE5yuYB3ha/uSLs=";
+static const char* k_hashC = "LCa0a2j/xo/5m0U8HTBBNBNCLXBkg7+g+YpeiGJm564=";
+
+class TestCaseFixture
+{
+public:
+    TestCaseFixture() : m_testPath{ ADUC_SystemUtils_GetTemporaryPathName() }
+    {
+        m_testPath += "/download_cache_utils_ut";
+
+        (void)ADUC_SystemUtils_RmDirRecursive(m_testPath.c_str());
+        REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault(WorkFolder().c_str()) == 0);
+    }
+
+    ~TestCaseFixture()
+    {
+        (void)ADUC_SystemUtils_RmDirRecursive(m_testPath.c_str());
+    }
+
+    std::string CacheFolder() const
+    {
+        return m_testPath + "/cache";
+    }
+
+    std::string WorkFolder() const
+    {
+        return m_testPath + "/work";
+    }
+
+    std::string CreatePayload(const std::string& name, const std::string& content) const
+    {
+        const std::string path = WorkFolder() + "/" + name;
+        std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+        file << content;
+        return path;
+    }
+
+    static std::string ReadFile(const std::string& path)
+    {
+        std::ifstream file{ path, std::ios::binary };
+        std::stringstream content;
+        content << file.rdbuf();
+        return content.str();
+    }
+
+    std::string EntryPath(const char* hash) const
+    {
+        ADUC::StringUtils::cstr_wrapper entryPath{ ADUC_DownloadCache_GetEntryPath(CacheFolder().c_str(), hash) };
+        REQUIRE(entryPath.get() != nullptr);
+        return entryPath.get();
+    }
+
+    static ino_t Inode(const std::string& path)
+    {
+        struct stat st = {};
+        REQUIRE(stat(path.c_str(), &st) == 0);
+        return st.st_ino;
+    }
+
+    void SetLastUsed(const char* hash, time_t seconds) const
+    {
+        const struct timespec times[2] = { { seconds, 0 }, { seconds, 0 } };
+        REQUIRE(utimensat(AT_FDCWD, EntryPath(hash).c_str(), times, 0) == 0);
+    }
+
+private:
+    std::string m_testPath;
+};
+
+TEST_CASE("ADUC_DownloadCache_GetEntryPath")
+{
+    SECTION("Maps the hash to a file name in the cache folder")
+    {
+        ADUC::StringUtils::cstr_wrapper entryPath{ ADUC_DownloadCache_GetEntryPath("/cache", k_hashA) };
+        REQUIRE(entryPath.get() != nullptr);
+        CHECK_THAT(entryPath.get(), Equals("/cache/sha256-47DEQpj8HBSa-_TImW-5JCeuQeRkm5NMpJWZG3hSuFU"));
+    }
+
+    SECTION("Rejects values that are not base64 encoded SHA-256 hashes")
+    {
+        CHECK(ADUC_DownloadCache_GetEntryPath("/cache", nullptr) == nullptr);
+        CHECK(ADUC_DownloadCache_GetEntryPath("/cache", "") == nullptr);
+        CHECK(ADUC_DownloadCache_GetEntryPath("/cache", "47DEQpj8HBSa+/TImW+5JCeuQeRkm5NMpJWZG3hSuFU") == nullptr);
+        CHECK(ADUC_DownloadCache_GetEntryPath("/cache", "../../../../../etc/passwd/////////////////=") == nullptr);
+        CHECK(ADUC_DownloadCache_GetEntryPath("/cache", "47DEQpj8HBSa+/TImW+5JCeuQeRkm5NMpJWZG3hSuFU==") == nullptr);
+    }
+}
+
+TEST_CASE_METHOD(TestCaseFixture, "ADUC_DownloadCache_Add and ADUC_DownloadCache_Restore")
+{
+    const std::string payload = CreatePayload("payloadA.bin", "payload A content");
+
+    SECTION("Restores an added payload")
+    {
+        REQUIRE(ADUC_DownloadCache_Add(CacheFolder().c_str(), k_hashA, payload.c_str(), 1024));
+
+        // The work folder is removed when the workflow ends.
+        REQUIRE(remove(payload.c_str()) == 0);
+
+        const std::string target = WorkFolder() + "/restored.bin";
+        REQUIRE(ADUC_DownloadCache_Restore(CacheFolder().c_str(), k_hashA, target.c_str()));
+        CHECK_THAT(ReadFile(target), Equals("payload A content"));
+    }
+
+    SECTION("Does not share the content of the payload with the entry")
+    {
+        REQUIRE(ADUC_DownloadCache_Add(CacheFolder().c_str(), k_hashA, payload.c_str(), 1024));
+
+        // Handlers may change the payload in place after the download.
+        CreatePayload("payloadA.bin", "changed");
+
+        const std::string target = WorkFolder() + "/restored.bin";
+        REQUIRE(ADUC_DownloadCache_Restore(CacheFolder().c_str(), k_hashA, target.c_str()));
+        CHECK_THAT(ReadFile(target), Equals("payload A content"));
+        CHECK(Inode(target) != Inode(EntryPath(k_hashA)));
+    }
+
+    SECTION("Does not restore a payload that is not cached")
+    {
+        const std::string target = WorkFolder() + "/restored.bin";
+        CHECK_FALSE(ADUC_DownloadCache_Restore(CacheFolder().c_str(), k_hashB, target.c_str()));
+        CHECK_FALSE(ADUC_SystemUtils_Exists(target.c_str()));
+    }
+
+    SECTION("Does not add a payload larger than the cache")
+    {
+        CHECK_FALSE(ADUC_DownloadCache_Add(CacheFolder().c_str(), k_hashA, payload.c_str(), 4));
+        CHECK_FALSE(ADUC_SystemUtils_Exists(EntryPath(k_hashA).c_str()));
+    }
+
+    SECTION("Removes a payload")
+    {
+        REQUIRE(ADUC_DownloadCache_Add(CacheFolder().c_str(), k_hashA, payload.c_str(), 1024));
+        CHECK(ADUC_DownloadCache_Remove(CacheFolder().c_str(), k_hashA));
+
+        const std::string target = WorkFolder() + "/restored.bin";
+        CHECK_FALSE(ADUC_DownloadCache_Restore(CacheFolder().c_str(), k_hashA, target.c_str()));
+    }
+}
+
+TEST_CASE_METHOD(TestCaseFixture, "ADUC_DownloadCache_Add evicts the least recently used payloads")
+{
+    const std::string payloadA = CreatePayload("payloadA.bin", std::string(10, 'a'));
+    const std::string payloadB = CreatePayload("payloadB.bin", std::string(10, 'b'));
+    const std::string payloadC = CreatePayload("payloadC.bin", std::string(10, 'c'));
+
+    REQUIRE(ADUC_DownloadCache_Add(CacheFolder().c_str(), k_hashA, payloadA.c_str(), 25));
+    REQUIRE(ADUC_DownloadCache_Add(CacheFolder().c_str(), k_hashB, payloadB.c_str(), 25));
+    SetLastUsed(k_hashA, 1000);
+    SetLastUsed(k_hashB, 2000);
+
+    // Using A makes B the least recently used payload.
+    const std::string target = WorkFolder() + "/restoredA.bin";
+    REQUIRE(ADUC_DownloadCache_Restore(CacheFolder().c_str(), k_hashA, target.c_str()));
+
+    REQUIRE(ADUC_DownloadCache_Add(CacheFolder().c_str(), k_hashC, payloadC.c_str(), 25));
+
+    CHECK(ADUC_SystemUtils_Exists(EntryPath(k_hashA).c_str()));
+    CHECK_FALSE(ADUC_SystemUtils_Exists(EntryPath(k_hashB).c_str()));
+    CHECK(ADUC_SystemUtils_Exists(EntryPath(k_hashC).c_str()));
+
+    SECTION("Trim evicts down to the given size")
+    {
+        SetLastUsed(k_hashA, 3000);
+        SetLastUsed(k_hashC, 4000);
+
+        CHECK(ADUC_DownloadCache_Trim(CacheFolder().c_str(), 10));
+        CHECK_FALSE(ADUC_SystemUtils_Exists(EntryPath(k_hashA).c_str()));
+        CHECK(ADUC_SystemUtils_Exists(EntryPath(k_hashC).c_str()));
+    }
+}
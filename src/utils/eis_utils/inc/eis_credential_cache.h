@@ -0,0 +1,94 @@
+/**
+ * @file eis_credential_cache.h
+ * @brief Header file for the cache of the connection credentials provisioned by the Edge Identity Service (EIS)
+ *
+ * @details Reconnecting to the IoT Hub reuses the cached connection information while its SAS token is valid, instead
+ * of requesting a new one from EIS each time. Once started, a background thread renews the credential ahead of its
+ * expiry, so that a reconnection does not have to wait for EIS either.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include <aduc/adu_types.h>
+#include <aduc/c_utils.h>
+#include <eis_err.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef EIS_CREDENTIAL_CACHE_H
+#    define EIS_CREDENTIAL_CACHE_H
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief A callback to be called when the background thread renewed the credential.
+ * @details Called on the background thread, so it must only do thread-safe work, such as waking the main loop.
+ * @param context the context passed to EISCredentialCache_Start()
+ */
+typedef void (*EIS_CREDENTIAL_RENEWED_CALLBACK)(void* context);
+
+/**
+ * @brief Counters of the credential requests since the process started.
+ */
+typedef struct tagEISCredentialCache_Statistics
+{
+    unsigned long long cacheHits; /**< Connection information returned from the cache */
+    unsigned long long fetches; /**< Requests to EIS for a new credential */
+    unsigned long long fetchFailures; /**< Requests to EIS that failed */
+    unsigned long long backgroundRenewals; /**< Credentials renewed by the background thread */
+    unsigned long long lastFetchDurationMs; /**< Duration of the last request to EIS */
+    unsigned long long maxFetchDurationMs; /**< Longest request to EIS */
+} EISCredentialCache_Statistics;
+
+/**
+ * @brief Gets the connection information, from the cache if its credential is valid for long enough, otherwise from
+ * EIS.
+ * @details Concurrent callers that find no valid credential wait for a single request to EIS. Caller is required to
+ * call ADUC_ConnectionInfo_DeAlloc() to deallocate @p info
+ * @param[in] timeoutMS the timeout in milliseconds for each call to EIS
+ * @param[out] info the connection information
+ * @returns the result of the request to EIS, or EISErr_Ok with EISService_Utils if the cache was used
+ */
+EISUtilityResult EISCredentialCache_GetConnectionInfo(uint32_t timeoutMS, ADUC_ConnectionInfo* info);
+
+/**
+ * @brief Drops the cached credential, e.g. because the IoT Hub rejected it. The next call to
+ * EISCredentialCache_GetConnectionInfo() requests a new one.
+ */
+void EISCredentialCache_Invalidate();
+
+/**
+ * @brief Starts the background thread that renews the credential ahead of its expiry.
+ * @param timeoutMS the timeout in milliseconds for each call to EIS
+ * @param renewedCallback an optional callback to be called after each renewal
+ * @param context the context passed to @p renewedCallback
+ * @returns true on success, or if the thread is already started
+ */
+bool EISCredentialCache_Start(uint32_t timeoutMS, EIS_CREDENTIAL_RENEWED_CALLBACK renewedCallback, void* context);
+
+/**
+ * @brief Stops the background renewal thread, and drops the cached credential.
+ */
+void EISCredentialCache_Stop();
+
+/**
+ * @brief Sets how long each requested SAS token is valid for.
+ * @param lifetimeSecs the lifetime in seconds. The default is EIS_TOKEN_EXPIRY_TIME_IN_SECONDS.
+ */
+void EISCredentialCache_SetTokenLifetime(unsigned int lifetimeSecs);
+
+/**
+ * @brief Sets how long before the expiry of the cached credential the background thread renews it.
+ * @param marginSecs the margin in seconds, capped at half the token lifetime. The default is one hour.
+ */
+void EISCredentialCache_SetRenewalMargin(unsigned int marginSecs);
+
+/**
+ * @brief Gets the statistics of the credential requests since the process started.
+ * @param[out] statistics the statistics
+ */
+void EISCredentialCache_GetStatistics(EISCredentialCache_Statistics* statistics);
+
+EXTERN_C_END
+
+#endif
@@ -8,6 +8,7 @@
 
 #include "eis_coms.h"
 
+#include <aduc/logging.h>
 #include <aduc/string_c_utils.h>
 #include <azure_c_shared_utility/azure_base64.h>
 #include <azure_c_shared_utility/buffer_.h>
@@ -19,6 +20,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <time.h> // clock_gettime
 #include <umock_c/umock_c_prod.h>
 
 #ifdef ENABLE_MOCKS
@@ -142,6 +144,18 @@ typedef struct tagEIS_HTTP_WORKLOAD_CONTEXT
  */
 #define EIS_RESP_SIZE_MAX 4096
 
+/**
+ * @brief Gets the time of the monotonic clock, which system time changes do not affect.
+ *
+ * @return uint64_t The time, in milliseconds.
+ */
+static uint64_t GetMonotonicTimeMs()
+{
+    struct timespec now = { 0 };
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
 //
 // HTTP Functions
 //
@@ -269,6 +283,7 @@ EISErr SendEISRequest(
     char** responseBuff)
 {
     EISErr result = EISErr_Failed;
+    const uint64_t requestStartTimeMs = GetMonotonicTimeMs();
 
     if (udsSocketPath == NULL || apiUriPath == NULL || responseBuff == NULL)
     {
@@ -352,13 +367,12 @@ EISErr SendEISRequest(
         goto done;
     }
 
-    time_t startTime = get_time(NULL);
     bool timedOut = false;
 
     do
     {
         uhttp_client_dowork(clientHandle);
-        timedOut = (difftime(get_time(NULL), startTime) > timeoutMS);
+        timedOut = (GetMonotonicTimeMs() - requestStartTimeMs > timeoutMS);
 
     } while (workloadCtx.continue_running == true && !timedOut);
 
@@ -419,6 +433,13 @@ done:
 
     *responseBuff = response;
 
+    Log_Info(
+        "EIS request %s on %s: %s in %llu ms.",
+        apiUriPath == NULL ? "(null)" : apiUriPath,
+        udsSocketPath == NULL ? "(null)" : udsSocketPath,
+        EISErr_ErrToString(result),
+        (unsigned long long)(GetMonotonicTimeMs() - requestStartTimeMs));
+
     return result;
 }
 
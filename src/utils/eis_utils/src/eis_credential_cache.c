@@ -0,0 +1,401 @@
+/**
+ * @file eis_credential_cache.c
+ * @brief Implements the cache of the connection credentials provisioned by the Edge Identity Service (EIS)
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+
+#include "eis_credential_cache.h"
+#include "eis_utils.h"
+#include <aduc/logging.h>
+#include <azure_c_shared_utility/crt_abstractions.h> // mallocAndStrcpy_s
+#include <pthread.h>
+#include <string.h> // memset
+#include <time.h>
+
+/**
+ * @brief How long a cached credential must still be valid for to be returned. The connection must be established,
+ * and the IoT Hub must accept the token, before it expires.
+ */
+#define EIS_CREDENTIAL_MIN_VALIDITY_SECONDS 60
+
+/**
+ * @brief Default for EISCredentialCache_SetRenewalMargin()
+ */
+#define EIS_CREDENTIAL_DEFAULT_RENEWAL_MARGIN_SECONDS (60 * 60)
+
+/**
+ * @brief The first and the longest delays before the background thread retries a renewal that failed.
+ */
+#define EIS_CREDENTIAL_RENEWAL_RETRY_MIN_DELAY_SECONDS 15
+#define EIS_CREDENTIAL_RENEWAL_RETRY_MAX_DELAY_SECONDS (5 * 60)
+
+/**
+ * @brief Protects all the state below, and is the mutex of s_cond.
+ */
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Signaled when a request to EIS completes, the credential is invalidated, or the thread is asked to stop.
+ */
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+
+static ADUC_ConnectionInfo s_info; //!< The cached connection information, if s_hasInfo
+static bool s_hasInfo = false; //!< Whether s_info holds a credential
+static time_t s_expiry = 0; //!< The expiry of the cached credential, in seconds since the epoch
+static bool s_isFetching = false; //!< Whether a request to EIS is in progress
+
+static unsigned int s_lifetimeSecs = EIS_TOKEN_EXPIRY_TIME_IN_SECONDS;
+static unsigned int s_renewalMarginSecs = EIS_CREDENTIAL_DEFAULT_RENEWAL_MARGIN_SECONDS;
+
+static bool s_isStarted = false; //!< Whether the background renewal thread is running
+static bool s_stopRequested = false; //!< Whether the background renewal thread is asked to stop
+static pthread_t s_renewalThread;
+static uint32_t s_renewalTimeoutMS = 0;
+static EIS_CREDENTIAL_RENEWED_CALLBACK s_renewedCallback = NULL;
+static void* s_renewedCallbackContext = NULL;
+static time_t s_nextRenewalRetryTime = 0; //!< When to retry a renewal that failed, or 0
+static unsigned int s_failedRenewals = 0; //!< The renewals that failed in a row
+
+static EISCredentialCache_Statistics s_statistics;
+
+/**
+ * @brief Gets the time of the monotonic clock, which system time changes do not affect.
+ *
+ * @return uint64_t The time, in milliseconds.
+ */
+static uint64_t GetMonotonicTimeMs()
+{
+    struct timespec now = { 0 };
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Copies the connection information @p src into @p dst
+ * @details Caller is required to call ADUC_ConnectionInfo_DeAlloc() to deallocate @p dst
+ * @returns true on success
+ */
+static bool CopyConnectionInfo(ADUC_ConnectionInfo* dst, const ADUC_ConnectionInfo* src)
+{
+    memset(dst, 0, sizeof(*dst));
+
+    dst->authType = src->authType;
+    dst->connType = src->connType;
+
+    if ((src->connectionString != NULL && mallocAndStrcpy_s(&dst->connectionString, src->connectionString) != 0)
+        || (src->certificateString != NULL && mallocAndStrcpy_s(&dst->certificateString, src->certificateString) != 0)
+        || (src->opensslEngine != NULL && mallocAndStrcpy_s(&dst->opensslEngine, src->opensslEngine) != 0)
+        || (src->opensslPrivateKey != NULL && mallocAndStrcpy_s(&dst->opensslPrivateKey, src->opensslPrivateKey) != 0))
+    {
+        ADUC_ConnectionInfo_DeAlloc(dst);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Drops the cached credential. Called with s_mutex held.
+ */
+static void ClearCachedInfo()
+{
+    if (s_hasInfo)
+    {
+        ADUC_ConnectionInfo_DeAlloc(&s_info);
+    }
+
+    memset(&s_info, 0, sizeof(s_info));
+    s_hasInfo = false;
+    s_expiry = 0;
+}
+
+/**
+ * @brief Tells whether the cached credential can be returned. Called with s_mutex held.
+ */
+static bool IsCachedInfoValid(time_t now)
+{
+    return s_hasInfo && s_expiry - now >= EIS_CREDENTIAL_MIN_VALIDITY_SECONDS;
+}
+
+/**
+ * @brief Requests a new credential from EIS, and caches it. Called with s_mutex held, and no request in progress.
+ * @details The mutex is released during the request, so that cache hits are not held up. Callers that need a
+ * credential meanwhile wait on s_cond for this request instead of sending their own.
+ * @param timeoutMS the timeout in milliseconds for each call to EIS
+ * @returns the result of the request
+ */
+static EISUtilityResult FetchLocked(uint32_t timeoutMS)
+{
+    ADUC_ConnectionInfo fetched;
+    const time_t expiry = time(NULL) + (time_t)s_lifetimeSecs;
+    uint64_t durationMs = 0;
+
+    s_isFetching = true;
+    pthread_mutex_unlock(&s_mutex);
+
+    const uint64_t startTimeMs = GetMonotonicTimeMs();
+    EISUtilityResult result = RequestConnectionStringFromEISWithExpiry(expiry, timeoutMS, &fetched);
+    durationMs = GetMonotonicTimeMs() - startTimeMs;
+
+    pthread_mutex_lock(&s_mutex);
+    s_isFetching = false;
+
+    s_statistics.fetches++;
+    s_statistics.lastFetchDurationMs = durationMs;
+    if (durationMs > s_statistics.maxFetchDurationMs)
+    {
+        s_statistics.maxFetchDurationMs = durationMs;
+    }
+
+    if (result.err == EISErr_Ok)
+    {
+        ClearCachedInfo();
+        s_info = fetched;
+        s_hasInfo = true;
+        s_expiry = expiry;
+
+        Log_Info(
+            "Requested a new credential from EIS in %llu ms (valid for %u seconds).",
+            (unsigned long long)durationMs,
+            s_lifetimeSecs);
+    }
+    else
+    {
+        s_statistics.fetchFailures++;
+
+        Log_Warn(
+            "Failed to request a credential from EIS in %llu ms, error %s on service %s.",
+            (unsigned long long)durationMs,
+            EISErr_ErrToString(result.err),
+            EISService_ServiceToString(result.service));
+    }
+
+    pthread_cond_broadcast(&s_cond);
+    return result;
+}
+
+EISUtilityResult EISCredentialCache_GetConnectionInfo(uint32_t timeoutMS, ADUC_ConnectionInfo* info)
+{
+    EISUtilityResult result = { EISErr_Ok, EISService_Utils };
+
+    if (info == NULL)
+    {
+        result.err = EISErr_InvalidArg;
+        return result;
+    }
+
+    memset(info, 0, sizeof(*info));
+
+    pthread_mutex_lock(&s_mutex);
+
+    // Wait for a request in progress rather than send another one.
+    while (!IsCachedInfoValid(time(NULL)) && s_isFetching)
+    {
+        pthread_cond_wait(&s_cond, &s_mutex);
+    }
+
+    if (IsCachedInfoValid(time(NULL)))
+    {
+        s_statistics.cacheHits++;
+    }
+    else
+    {
+        result = FetchLocked(timeoutMS);
+        if (result.err != EISErr_Ok)
+        {
+            goto done;
+        }
+    }
+
+    if (!CopyConnectionInfo(info, &s_info))
+    {
+        result.err = EISErr_ContentAllocErr;
+        result.service = EISService_Utils;
+    }
+
+done:
+    pthread_mutex_unlock(&s_mutex);
+
+    return result;
+}
+
+void EISCredentialCache_Invalidate()
+{
+    pthread_mutex_lock(&s_mutex);
+
+    if (s_hasInfo)
+    {
+        Log_Info("Dropping the cached EIS credential.");
+        ClearCachedInfo();
+    }
+
+    // The renewal thread requests a new one right away.
+    s_nextRenewalRetryTime = 0;
+    s_failedRenewals = 0;
+    pthread_cond_broadcast(&s_cond);
+
+    pthread_mutex_unlock(&s_mutex);
+}
+
+/**
+ * @brief Gets when the background thread should request a new credential. Called with s_mutex held.
+ */
+static time_t GetRenewalTime()
+{
+    const unsigned int marginSecs =
+        (s_renewalMarginSecs < s_lifetimeSecs / 2) ? s_renewalMarginSecs : s_lifetimeSecs / 2;
+    const time_t renewalTime = s_hasInfo ? s_expiry - (time_t)marginSecs : 0;
+
+    return (renewalTime > s_nextRenewalRetryTime) ? renewalTime : s_nextRenewalRetryTime;
+}
+
+/**
+ * @brief Renews the credential ahead of its expiry until the thread is asked to stop.
+ */
+static void* RenewalThreadProc(void* arg)
+{
+    UNREFERENCED_PARAMETER(arg);
+
+    pthread_mutex_lock(&s_mutex);
+
+    while (!s_stopRequested)
+    {
+        const time_t now = time(NULL);
+        const time_t renewalTime = GetRenewalTime();
+
+        if (s_isFetching)
+        {
+            pthread_cond_wait(&s_cond, &s_mutex);
+            continue;
+        }
+
+        if (now < renewalTime)
+        {
+            struct timespec wakeTime = { 0 };
+            wakeTime.tv_sec = renewalTime;
+            (void)pthread_cond_timedwait(&s_cond, &s_mutex, &wakeTime);
+            continue;
+        }
+
+        if (FetchLocked(s_renewalTimeoutMS).err != EISErr_Ok)
+        {
+            // Doubles the delay after each failure in a row; a few doublings already reach the longest delay.
+            const unsigned int doublings = (s_failedRenewals < 8) ? s_failedRenewals : 8;
+            unsigned int delaySecs = EIS_CREDENTIAL_RENEWAL_RETRY_MIN_DELAY_SECONDS << doublings;
+
+            if (delaySecs > EIS_CREDENTIAL_RENEWAL_RETRY_MAX_DELAY_SECONDS)
+            {
+                delaySecs = EIS_CREDENTIAL_RENEWAL_RETRY_MAX_DELAY_SECONDS;
+            }
+
+            s_failedRenewals++;
+            s_nextRenewalRetryTime = time(NULL) + (time_t)delaySecs;
+            Log_Warn("Will retry renewing the EIS credential in %u seconds.", delaySecs);
+            continue;
+        }
+
+        s_failedRenewals = 0;
+        s_nextRenewalRetryTime = 0;
+        s_statistics.backgroundRenewals++;
+
+        if (s_renewedCallback != NULL)
+        {
+            EIS_CREDENTIAL_RENEWED_CALLBACK callback = s_renewedCallback;
+            void* context = s_renewedCallbackContext;
+
+            pthread_mutex_unlock(&s_mutex);
+            callback(context);
+            pthread_mutex_lock(&s_mutex);
+        }
+    }
+
+    pthread_mutex_unlock(&s_mutex);
+
+    return NULL;
+}
+
+bool EISCredentialCache_Start(uint32_t timeoutMS, EIS_CREDENTIAL_RENEWED_CALLBACK renewedCallback, void* context)
+{
+    bool succeeded = false;
+
+    pthread_mutex_lock(&s_mutex);
+
+    if (s_isStarted)
+    {
+        succeeded = true;
+        goto done;
+    }
+
+    s_stopRequested = false;
+    s_renewalTimeoutMS = timeoutMS;
+    s_renewedCallback = renewedCallback;
+    s_renewedCallbackContext = context;
+    s_nextRenewalRetryTime = 0;
+    s_failedRenewals = 0;
+
+    if (pthread_create(&s_renewalThread, NULL, RenewalThreadProc, NULL) != 0)
+    {
+        Log_Error("Cannot start the EIS credential renewal thread.");
+        s_renewedCallback = NULL;
+        s_renewedCallbackContext = NULL;
+        goto done;
+    }
+
+    s_isStarted = true;
+    succeeded = true;
+
+done:
+    pthread_mutex_unlock(&s_mutex);
+
+    return succeeded;
+}
+
+void EISCredentialCache_Stop()
+{
+    pthread_mutex_lock(&s_mutex);
+
+    if (s_isStarted)
+    {
+        s_stopRequested = true;
+        pthread_cond_broadcast(&s_cond);
+        pthread_mutex_unlock(&s_mutex);
+
+        pthread_join(s_renewalThread, NULL);
+
+        pthread_mutex_lock(&s_mutex);
+        s_isStarted = false;
+        s_stopRequested = false;
+        s_renewedCallback = NULL;
+        s_renewedCallbackContext = NULL;
+    }
+
+    ClearCachedInfo();
+
+    pthread_mutex_unlock(&s_mutex);
+}
+
+void EISCredentialCache_SetTokenLifetime(unsigned int lifetimeSecs)
+{
+    pthread_mutex_lock(&s_mutex);
+    s_lifetimeSecs = (lifetimeSecs > EIS_CREDENTIAL_MIN_VALIDITY_SECONDS) ? lifetimeSecs
+                                                                          : EIS_CREDENTIAL_MIN_VALIDITY_SECONDS + 1;
+    pthread_cond_broadcast(&s_cond);
+    pthread_mutex_unlock(&s_mutex);
+}
+
+void EISCredentialCache_SetRenewalMargin(unsigned int marginSecs)
+{
+    pthread_mutex_lock(&s_mutex);
+    s_renewalMarginSecs = marginSecs;
+    pthread_cond_broadcast(&s_cond);
+    pthread_mutex_unlock(&s_mutex);
+}
+
+void EISCredentialCache_GetStatistics(EISCredentialCache_Statistics* statistics)
+{
+    pthread_mutex_lock(&s_mutex);
+    *statistics = s_statistics;
+    pthread_mutex_unlock(&s_mutex);
+}
@@ -5,6 +5,7 @@
  * @copyright Copyright (c) Microsoft Corporation.
  * Licensed under the MIT License.
  */
+#include "eis_credential_cache.h"
 #include "eis_utils.h"
 #include "umock_c/umock_c.h"
 #include <aduc/adu_types.h>
@@ -14,6 +15,7 @@
 #include <cstring>
 #include <iostream>
 #include <sstream>
+#include <string>
 #include <string.h>
 #include <time.h>
 
@@ -479,3 +481,106 @@ TEST_CASE_METHOD(GlobalMockHookTestCaseFixture, "RequestConnectionStringFromEISW
         ADUC_ConnectionInfo_DeAlloc(&outInfo);
     }
 }
+
+TEST_CASE_METHOD(GlobalMockHookTestCaseFixture, "EISCredentialCache_GetConnectionInfo Functional Tests")
+{
+    const uint32_t timeout = 5000;
+    EISCredentialCache_Statistics before = {};
+    EISCredentialCache_Statistics after = {};
+
+    EISCredentialCache_Stop();
+    EISCredentialCache_SetTokenLifetime(EIS_TOKEN_EXPIRY_TIME_IN_SECONDS);
+
+    // Note: These do not need to be freed! They are freed by the request to EIS that consumes them.
+    REQUIRE(mallocAndStrcpy_s(&g_identityResp, validDeviceSasIdentityResponseStr) == 0);
+    REQUIRE(mallocAndStrcpy_s(&g_signatureResp, validSignatureResponseStr) == 0);
+
+    ADUC_ConnectionInfo firstInfo = { ADUC_AuthType_NotSet, ADUC_ConnType_NotSet, nullptr, nullptr, nullptr, nullptr };
+
+    EISCredentialCache_GetStatistics(&before);
+    EISUtilityResult result = EISCredentialCache_GetConnectionInfo(timeout, &firstInfo);
+    EISCredentialCache_GetStatistics(&after);
+
+    REQUIRE(result.err == EISErr_Ok);
+    REQUIRE(firstInfo.connectionString != nullptr);
+    CHECK(firstInfo.authType == ADUC_AuthType_SASToken);
+    CHECK(after.fetches == before.fetches + 1);
+    CHECK(after.cacheHits == before.cacheHits);
+
+    SECTION("A valid credential is returned from the cache")
+    {
+        // Any request to EIS would fail to parse these.
+        g_identityResp = nullptr;
+        g_signatureResp = nullptr;
+
+        ADUC_ConnectionInfo secondInfo = {
+            ADUC_AuthType_NotSet, ADUC_ConnType_NotSet, nullptr, nullptr, nullptr, nullptr
+        };
+
+        EISCredentialCache_GetStatistics(&before);
+        result = EISCredentialCache_GetConnectionInfo(timeout, &secondInfo);
+        EISCredentialCache_GetStatistics(&after);
+
+        REQUIRE(result.err == EISErr_Ok);
+        CHECK(after.fetches == before.fetches);
+        CHECK(after.cacheHits == before.cacheHits + 1);
+
+        // The caller owns a copy.
+        REQUIRE(secondInfo.connectionString != nullptr);
+        CHECK(secondInfo.connectionString != firstInfo.connectionString);
+        CHECK(std::string{ secondInfo.connectionString } == firstInfo.connectionString);
+        CHECK(secondInfo.authType == firstInfo.authType);
+        CHECK(secondInfo.connType == firstInfo.connType);
+
+        ADUC_ConnectionInfo_DeAlloc(&secondInfo);
+    }
+
+    SECTION("An invalidated credential is requested again")
+    {
+        REQUIRE(mallocAndStrcpy_s(&g_identityResp, validDeviceSasIdentityResponseStr) == 0);
+        REQUIRE(mallocAndStrcpy_s(&g_signatureResp, validSignatureResponseStr) == 0);
+
+        ADUC_ConnectionInfo secondInfo = {
+            ADUC_AuthType_NotSet, ADUC_ConnType_NotSet, nullptr, nullptr, nullptr, nullptr
+        };
+
+        EISCredentialCache_Invalidate();
+
+        EISCredentialCache_GetStatistics(&before);
+        result = EISCredentialCache_GetConnectionInfo(timeout, &secondInfo);
+        EISCredentialCache_GetStatistics(&after);
+
+        REQUIRE(result.err == EISErr_Ok);
+        CHECK(secondInfo.connectionString != nullptr);
+        CHECK(after.fetches == before.fetches + 1);
+        CHECK(after.cacheHits == before.cacheHits);
+
+        ADUC_ConnectionInfo_DeAlloc(&secondInfo);
+    }
+
+    SECTION("A failed request is not cached")
+    {
+        REQUIRE(mallocAndStrcpy_s(&g_identityResp, invalidIdentityResponseStr) == 0);
+        g_signatureResp = nullptr;
+
+        ADUC_ConnectionInfo secondInfo = {
+            ADUC_AuthType_NotSet, ADUC_ConnType_NotSet, nullptr, nullptr, nullptr, nullptr
+        };
+
+        EISCredentialCache_Invalidate();
+
+        EISCredentialCache_GetStatistics(&before);
+        result = EISCredentialCache_GetConnectionInfo(timeout, &secondInfo);
+        EISCredentialCache_GetStatistics(&after);
+
+        CHECK(result.err != EISErr_Ok);
+        CHECK(secondInfo.connectionString == nullptr);
+        CHECK(after.fetches == before.fetches + 1);
+        CHECK(after.fetchFailures == before.fetchFailures + 1);
+
+        ADUC_ConnectionInfo_DeAlloc(&secondInfo);
+    }
+
+    ADUC_ConnectionInfo_DeAlloc(&firstInfo);
+    EISCredentialCache_Stop();
+}
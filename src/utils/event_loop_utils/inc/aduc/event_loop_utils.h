@@ -0,0 +1,65 @@
+/**
+ * @file event_loop_utils.h
+ * @brief Lets the agent's main loop sleep until there is work to do, instead of polling at a fixed interval.
+ *
+ * @details The main loop calls the components' DoWork functions, then ADUC_EventLoop_Wait. A component that needs to
+ * be called again at a given time requests it with ADUC_EventLoop_RequestWakeIn from its DoWork function. Code running
+ * on other threads, or in signal handlers, that produces work for the main loop calls ADUC_EventLoop_Wake.
+ *
+ * On Linux, the wait blocks in epoll on an eventfd, for wake-ups, and a timerfd armed for the earliest requested
+ * deadline. Elsewhere, or if those cannot be created, it sleeps in steps of at most 100 milliseconds.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_EVENT_LOOP_UTILS_H
+#define ADUC_EVENT_LOOP_UTILS_H
+
+#include "aduc/c_utils.h"
+
+#include <stdbool.h> // for bool
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief Creates the wake-up event and timer of the event loop.
+ *
+ * @return bool true on success. On failure, ADUC_EventLoop_Wait falls back to polling.
+ */
+bool ADUC_EventLoop_Init();
+
+/**
+ * @brief Releases the wake-up event and timer of the event loop.
+ */
+void ADUC_EventLoop_Deinit();
+
+/**
+ * @brief Makes the current or next ADUC_EventLoop_Wait return immediately.
+ *
+ * @remark Thread-safe, and async-signal-safe.
+ */
+void ADUC_EventLoop_Wake();
+
+/**
+ * @brief Requests that the main loop calls the components' DoWork functions again in at most @p delayMs milliseconds.
+ *
+ * @details Requests are combined: the next ADUC_EventLoop_Wait returns at the earliest requested time. They apply to
+ * the next wait only, so a component that needs to be called periodically requests it from each DoWork call.
+ *
+ * @param delayMs The delay, in milliseconds.
+ * @remark Thread-safe.
+ */
+void ADUC_EventLoop_RequestWakeIn(unsigned int delayMs);
+
+/**
+ * @brief Waits until ADUC_EventLoop_Wake is called, or the earliest time requested with ADUC_EventLoop_RequestWakeIn,
+ * or @p maxWaitMs milliseconds have passed, whichever comes first.
+ *
+ * @param maxWaitMs The maximum wait, in milliseconds.
+ * @return bool true if the wait ended because ADUC_EventLoop_Wake was called.
+ */
+bool ADUC_EventLoop_Wait(unsigned int maxWaitMs);
+
+EXTERN_C_END
+
+#endif // ADUC_EVENT_LOOP_UTILS_H
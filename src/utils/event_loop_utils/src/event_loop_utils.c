@@ -0,0 +1,351 @@
+/**
+ * @file event_loop_utils.c
+ * @brief Implements the wake-up event and timer the agent's main loop waits on.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/event_loop_utils.h"
+
+#include <aduc/logging.h>
+
+#include <aducpal/time.h> // ADUCPAL_clock_gettime, ADUCPAL_nanosleep
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h> // sig_atomic_t
+#include <stdint.h> // uint64_t, UINT64_MAX
+
+#if defined(__linux__)
+#    include <sys/epoll.h>
+#    include <sys/eventfd.h>
+#    include <sys/timerfd.h>
+#    include <unistd.h> // close, read, write
+#endif
+
+/**
+ * @brief The value of a deadline when none is requested.
+ */
+#define NO_DEADLINE UINT64_MAX
+
+/**
+ * @brief The longest the wait sleeps at once when it cannot block on the wake-up event, which bounds the latency of
+ * ADUC_EventLoop_Wake.
+ */
+#define POLLING_INTERVAL_MS 100
+
+/**
+ * @brief Protects the deadlines below.
+ */
+static pthread_mutex_t s_deadlineMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief The earliest deadline requested for the next wait, in milliseconds of the monotonic clock.
+ */
+static uint64_t s_requestedDeadlineMs = NO_DEADLINE;
+
+/**
+ * @brief Whether a wait is in progress.
+ */
+static bool s_isWaiting = false;
+
+/**
+ * @brief The deadline of the wait in progress.
+ */
+static uint64_t s_waitDeadlineMs = NO_DEADLINE;
+
+/**
+ * @brief Whether ADUC_EventLoop_Wake was called since the last wait, when polling.
+ */
+static volatile sig_atomic_t s_wakePending = 0;
+
+#if defined(__linux__)
+static int s_epollFd = -1;
+static volatile int s_eventFd = -1;
+static int s_timerFd = -1;
+
+/**
+ * @brief Whether ADUC_EventLoop_Wake could not signal the wake-up event. The waits poll from then on.
+ */
+static volatile sig_atomic_t s_wakeSignalFailed = 0;
+#endif
+
+/**
+ * @brief Gets the time of the monotonic clock, which system time changes do not affect.
+ *
+ * @return uint64_t The time, in milliseconds.
+ */
+static uint64_t GetMonotonicTimeMs()
+{
+    struct timespec now = { 0 };
+#if defined(__linux__)
+    clock_gettime(CLOCK_MONOTONIC, &now);
+#else
+    ADUCPAL_clock_gettime(CLOCK_REALTIME, &now);
+#endif
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+bool ADUC_EventLoop_Init()
+{
+#if defined(__linux__)
+    struct epoll_event event = { 0 };
+
+    if (s_epollFd != -1)
+    {
+        return true;
+    }
+
+    s_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (s_epollFd == -1)
+    {
+        goto done;
+    }
+
+    s_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (s_eventFd == -1)
+    {
+        goto done;
+    }
+
+    event.events = EPOLLIN;
+    event.data.fd = s_eventFd;
+    if (epoll_ctl(s_epollFd, EPOLL_CTL_ADD, s_eventFd, &event) != 0)
+    {
+        goto done;
+    }
+
+    s_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (s_timerFd == -1)
+    {
+        goto done;
+    }
+
+    event.events = EPOLLIN;
+    event.data.fd = s_timerFd;
+    if (epoll_ctl(s_epollFd, EPOLL_CTL_ADD, s_timerFd, &event) != 0)
+    {
+        goto done;
+    }
+
+    s_wakeSignalFailed = 0;
+    return true;
+
+done:
+    Log_Warn("Cannot create the event loop, errno %d. The main loop will poll instead.", errno);
+    ADUC_EventLoop_Deinit();
+    return false;
+#else
+    return true;
+#endif
+}
+
+void ADUC_EventLoop_Deinit()
+{
+#if defined(__linux__)
+    const int eventFd = s_eventFd;
+
+    // Stop ADUC_EventLoop_Wake from using the event before closing it.
+    s_eventFd = -1;
+
+    if (eventFd != -1)
+    {
+        close(eventFd);
+    }
+
+    if (s_timerFd != -1)
+    {
+        close(s_timerFd);
+        s_timerFd = -1;
+    }
+
+    if (s_epollFd != -1)
+    {
+        close(s_epollFd);
+        s_epollFd = -1;
+    }
+#endif
+
+    pthread_mutex_lock(&s_deadlineMutex);
+    s_requestedDeadlineMs = NO_DEADLINE;
+    pthread_mutex_unlock(&s_deadlineMutex);
+}
+
+void ADUC_EventLoop_Wake()
+{
+    // Only async-signal-safe calls here, as the shutdown signal handlers call this.
+    s_wakePending = 1;
+
+#if defined(__linux__)
+    const int eventFd = s_eventFd;
+    if (eventFd != -1)
+    {
+        const int savedErrno = errno;
+        const uint64_t one = 1;
+        const ssize_t written = write(eventFd, &one, sizeof(one));
+
+        // EAGAIN means the counter is full, so the event is signaled already. The wait cannot be woken otherwise:
+        // it is left to the polling, which does not need the event.
+        if (written != (ssize_t)sizeof(one) && !(written == -1 && errno == EAGAIN))
+        {
+            s_wakeSignalFailed = 1;
+        }
+
+        errno = savedErrno;
+    }
+#endif
+}
+
+void ADUC_EventLoop_RequestWakeIn(unsigned int delayMs)
+{
+    const uint64_t deadlineMs = GetMonotonicTimeMs() + delayMs;
+    bool wakeWait = false;
+
+    pthread_mutex_lock(&s_deadlineMutex);
+
+    if (deadlineMs < s_requestedDeadlineMs)
+    {
+        s_requestedDeadlineMs = deadlineMs;
+    }
+
+    // A request from another thread can be earlier than the deadline the wait in progress is armed for.
+    wakeWait = s_isWaiting && deadlineMs < s_waitDeadlineMs;
+
+    pthread_mutex_unlock(&s_deadlineMutex);
+
+    if (wakeWait)
+    {
+        ADUC_EventLoop_Wake();
+    }
+}
+
+#if defined(__linux__)
+/**
+ * @brief Blocks until the wake-up event is signaled or the timer expires at @p deadlineMs.
+ *
+ * @return int 1 if the event was signaled, 0 if the timer expired, -1 on error.
+ */
+static int WaitForEvent(uint64_t deadlineMs)
+{
+    struct itimerspec timerSpec = { 0 };
+    struct epoll_event events[2];
+    int woken = 0;
+    int eventCount = 0;
+
+    // An absolute deadline, so that time spent before blocking does not extend the wait. One already passed expires
+    // immediately.
+    timerSpec.it_value.tv_sec = (time_t)(deadlineMs / 1000);
+    timerSpec.it_value.tv_nsec = (long)(deadlineMs % 1000) * 1000000;
+    if (timerSpec.it_value.tv_sec == 0 && timerSpec.it_value.tv_nsec == 0)
+    {
+        timerSpec.it_value.tv_nsec = 1;
+    }
+
+    if (timerfd_settime(s_timerFd, TFD_TIMER_ABSTIME, &timerSpec, NULL) != 0)
+    {
+        return -1;
+    }
+
+    do
+    {
+        eventCount = epoll_wait(s_epollFd, events, sizeof(events) / sizeof(events[0]), -1 /* timeout */);
+    } while (eventCount == -1 && errno == EINTR);
+
+    if (eventCount == -1)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < eventCount; ++i)
+    {
+        uint64_t count = 0;
+
+        // Both are non-blocking counters, which a read resets. EAGAIN means the counter was reset already.
+        const ssize_t readSize = read(events[i].data.fd, &count, sizeof(count));
+        if (readSize != (ssize_t)sizeof(count) && !(readSize == -1 && (errno == EAGAIN || errno == EINTR)))
+        {
+            return -1;
+        }
+
+        if (events[i].data.fd != s_timerFd)
+        {
+            woken = 1;
+        }
+    }
+
+    return woken;
+}
+#endif
+
+bool ADUC_EventLoop_Wait(unsigned int maxWaitMs)
+{
+    const uint64_t nowMs = GetMonotonicTimeMs();
+    uint64_t deadlineMs = nowMs + maxWaitMs;
+    bool woken = false;
+
+    pthread_mutex_lock(&s_deadlineMutex);
+
+    if (s_requestedDeadlineMs < deadlineMs)
+    {
+        deadlineMs = s_requestedDeadlineMs;
+    }
+
+    s_requestedDeadlineMs = NO_DEADLINE;
+    s_isWaiting = true;
+    s_waitDeadlineMs = deadlineMs;
+
+    pthread_mutex_unlock(&s_deadlineMutex);
+
+#if defined(__linux__)
+    if (s_epollFd != -1 && s_wakeSignalFailed != 0)
+    {
+        Log_Warn("Cannot signal the event loop. Polling instead.");
+        ADUC_EventLoop_Deinit();
+    }
+
+    if (s_epollFd != -1)
+    {
+        const int waitResult = WaitForEvent(deadlineMs);
+        if (waitResult != -1)
+        {
+            woken = (waitResult == 1);
+            s_wakePending = 0;
+            goto done;
+        }
+
+        Log_Warn("Cannot wait for events, errno %d. Polling instead.", errno);
+    }
+#endif
+
+    while (s_wakePending == 0)
+    {
+        const uint64_t currentMs = GetMonotonicTimeMs();
+        uint64_t sleepMs = POLLING_INTERVAL_MS;
+        struct timespec sleepTime = { 0 };
+
+        if (currentMs >= deadlineMs)
+        {
+            break;
+        }
+
+        if (deadlineMs - currentMs < sleepMs)
+        {
+            sleepMs = deadlineMs - currentMs;
+        }
+
+        sleepTime.tv_sec = (time_t)(sleepMs / 1000);
+        sleepTime.tv_nsec = (long)(sleepMs % 1000) * 1000000;
+        ADUCPAL_nanosleep(&sleepTime, NULL);
+    }
+
+    woken = (s_wakePending != 0);
+    s_wakePending = 0;
+
+#if defined(__linux__)
+done:
+#endif
+    pthread_mutex_lock(&s_deadlineMutex);
+    s_isWaiting = false;
+    pthread_mutex_unlock(&s_deadlineMutex);
+
+    return woken;
+}
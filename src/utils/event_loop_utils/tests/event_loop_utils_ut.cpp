@@ -0,0 +1,118 @@
+/**
+ * @file event_loop_utils_ut.cpp
+ * @brief Unit Tests for event_loop_utils library
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/event_loop_utils.h"
+
+#include <catch2/catch_all.hpp>
+
+#include <chrono>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+/**
+ * @brief Initializes the event loop for a test, and releases it afterwards.
+ */
+class EventLoopFixture
+{
+public:
+    EventLoopFixture()
+    {
+        REQUIRE(ADUC_EventLoop_Init());
+    }
+
+    EventLoopFixture(const EventLoopFixture&) = delete;
+    EventLoopFixture& operator=(const EventLoopFixture&) = delete;
+    EventLoopFixture(EventLoopFixture&&) = delete;
+    EventLoopFixture& operator=(EventLoopFixture&&) = delete;
+
+    ~EventLoopFixture()
+    {
+        ADUC_EventLoop_Deinit();
+    }
+};
+
+/**
+ * @brief Calls ADUC_EventLoop_Wait and measures how long it waited.
+ */
+long long TimedWait(unsigned int maxWaitMs, bool* woken)
+{
+    const Clock::time_point start = Clock::now();
+    *woken = ADUC_EventLoop_Wait(maxWaitMs);
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+}
+
+} // namespace
+
+TEST_CASE_METHOD(EventLoopFixture, "ADUC_EventLoop_Wait")
+{
+    bool woken = true;
+
+    SECTION("Waits for at most the maximum wait")
+    {
+        const long long elapsedMs = TimedWait(100, &woken);
+        CHECK_FALSE(woken);
+        CHECK(elapsedMs >= 90);
+        CHECK(elapsedMs < 1000);
+    }
+
+    SECTION("Returns at the earliest requested time")
+    {
+        ADUC_EventLoop_RequestWakeIn(200);
+        ADUC_EventLoop_RequestWakeIn(50);
+
+        const long long elapsedMs = TimedWait(10000, &woken);
+        CHECK_FALSE(woken);
+        CHECK(elapsedMs >= 40);
+        CHECK(elapsedMs < 1000);
+
+        // A request applies to the next wait only.
+        CHECK(TimedWait(100, &woken) >= 90);
+    }
+
+    SECTION("Does not miss a wake-up that happened before it")
+    {
+        ADUC_EventLoop_Wake();
+
+        const long long elapsedMs = TimedWait(10000, &woken);
+        CHECK(woken);
+        CHECK(elapsedMs < 1000);
+
+        // Wake-ups do not accumulate.
+        CHECK(TimedWait(100, &woken) >= 90);
+        CHECK_FALSE(woken);
+    }
+
+    SECTION("Returns when another thread wakes it")
+    {
+        std::thread waker{ []() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            ADUC_EventLoop_Wake();
+        } };
+
+        const long long elapsedMs = TimedWait(10000, &woken);
+        waker.join();
+
+        CHECK(woken);
+        CHECK(elapsedMs < 1000);
+    }
+
+    SECTION("Returns early when another thread requests an earlier time")
+    {
+        std::thread requester{ []() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            ADUC_EventLoop_RequestWakeIn(0);
+        } };
+
+        const long long elapsedMs = TimedWait(10000, &woken);
+        requester.join();
+
+        CHECK(elapsedMs < 1000);
+    }
+}
@@ -0,0 +1,85 @@
+/**
+ * @file verified_extension_cache.h
+ * @brief A persistent cache of the extension files whose hash was already verified.
+ *
+ * @details An entry records the identity of an extension file (device, inode, size, modification and status change
+ * times) along with the hash it was verified against. The hash is not computed again while the file keeps that
+ * identity, is owned by root, and is not writable by group or others. Any other file is always hashed.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_VERIFIED_EXTENSION_CACHE_H
+#define ADUC_VERIFIED_EXTENSION_CACHE_H
+
+#include <aduc/c_utils.h> // for EXTERN_C_BEGIN, EXTERN_C_END
+#include <aduc/types/hash.h> // for ADUC_Hash
+#include <azure_c_shared_utility/sha.h> // for SHAversion
+#include <stdbool.h>
+#include <stddef.h> // for size_t
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief The maximum number of entries kept in the cache. The oldest entries are dropped beyond it.
+ */
+#define ADUC_VERIFIED_EXTENSION_CACHE_MAX_ENTRIES 256
+
+/**
+ * @brief Checks if the hash of the extension file at @p filePath matches @p hashBase64, skipping the hash
+ * computation if the file was already verified against @p hashBase64 and has not changed since.
+ *
+ * @param filePath The path to the extension file.
+ * @param hashBase64 The expected hash of the file.
+ * @param algorithm The hashing algorithm of @p hashBase64.
+ * @return bool true if the hash matches.
+ */
+bool ADUC_VerifiedExtensionCache_IsValidFileHash(const char* filePath, const char* hashBase64, SHAversion algorithm);
+
+/**
+ * @brief Verifies the extension file at @p filePath against the hash with the strongest algorithm in @p hashes, like
+ * ADUC_HashUtils_VerifyWithStrongestHash, skipping the hash computation if the file was already verified.
+ *
+ * @param filePath The path to the extension file.
+ * @param hashes The array of ADUC_Hash objects.
+ * @param hashCount The length of the array.
+ * @return bool true if the hash with the strongest algorithm matches.
+ */
+bool ADUC_VerifiedExtensionCache_VerifyWithStrongestHash(
+    const char* filePath, const ADUC_Hash* hashes, size_t hashCount);
+
+/**
+ * @brief Sets the path of the cache file.
+ * @details The default is the 'extension_verification_cache' file in the data folder. The cache file is ignored
+ * unless it is owned by the effective user of the process and not writable by group or others.
+ * This also drops the entries in memory, so that they are loaded again from the new file.
+ *
+ * @param filePath The path of the cache file, or NULL to restore the default.
+ */
+void ADUC_VerifiedExtensionCache_SetFilePath(const char* filePath);
+
+/**
+ * @brief Sets the owner that extension files must have to be cached. The default is root (0).
+ * @details This is meant for tests and benchmarks, which do not run as root.
+ *
+ * @param ownerId The user id of the owner.
+ */
+void ADUC_VerifiedExtensionCache_SetTrustedOwner(unsigned int ownerId);
+
+/**
+ * @brief Drops the entries in memory, so that they are loaded again from the cache file on next use, as after a
+ * restart. The hit and miss counts are reset too.
+ */
+void ADUC_VerifiedExtensionCache_Reset(void);
+
+/**
+ * @brief Gets how many verifications were answered from the cache, and how many computed the hash.
+ *
+ * @param[out] hitCount The number of verifications answered from the cache. May be NULL.
+ * @param[out] missCount The number of verifications that computed the hash. May be NULL.
+ */
+void ADUC_VerifiedExtensionCache_GetStatistics(size_t* hitCount, size_t* missCount);
+
+EXTERN_C_END
+
+#endif // ADUC_VERIFIED_EXTENSION_CACHE_H
@@ -0,0 +1,633 @@
+/**
+ * @file verified_extension_cache.c
+ * @brief Implements the persistent cache of the extension files whose hash was already verified.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/verified_extension_cache.h"
+#include "aduc/config_utils.h"
+#include "aduc/hash_utils.h"
+#include "aduc/logging.h"
+#include "aduc/string_c_utils.h"
+#include "aduc/types/download.h" // ADUC_VERIFIED_DIGEST_MAX_HASH_BASE64_LEN
+
+#include <errno.h>
+#include <fcntl.h> // open, O_*
+#include <inttypes.h> // PRIu64, SCNu64
+#include <pthread.h>
+#include <stdio.h> // FILE, fgets, rename
+#include <stdlib.h> // calloc, free
+#include <string.h> // memmove, strcmp
+#include <sys/stat.h> // stat
+
+#include <aducpal/sys_stat.h> // S_I*
+#include <aducpal/unistd.h> // close, geteuid
+
+/**
+ * @brief The name of the cache file in the data folder.
+ */
+#define VERIFIED_EXTENSION_CACHE_FILE_NAME "extension_verification_cache"
+
+/**
+ * @brief The first line of a cache file. The version is bumped whenever the format of the entries changes.
+ */
+#define VERIFIED_EXTENSION_CACHE_HEADER "aduc-verified-extensions 1"
+
+/**
+ * @brief The maximum length of a line of the cache file, including the file path.
+ */
+#define VERIFIED_EXTENSION_CACHE_MAX_LINE_LEN 4352
+
+/**
+ * @brief The identity of a file, which changes whenever the file is replaced, modified, or its owner or mode changes.
+ */
+typedef struct tagVerifiedExtensionFileIdentity
+{
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    int64_t modifiedTimeSec;
+    int64_t modifiedTimeNsec;
+    int64_t changedTimeSec;
+    int64_t changedTimeNsec;
+} VerifiedExtensionFileIdentity;
+
+/**
+ * @brief An extension file that was verified against a hash.
+ */
+typedef struct tagVerifiedExtensionEntry
+{
+    char* filePath;
+    int32_t algorithm;
+    char hashBase64[ADUC_VERIFIED_DIGEST_MAX_HASH_BASE64_LEN + 1];
+    VerifiedExtensionFileIdentity identity;
+} VerifiedExtensionEntry;
+
+static pthread_mutex_t s_cacheMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// The entries, oldest first.
+static VerifiedExtensionEntry s_entries[ADUC_VERIFIED_EXTENSION_CACHE_MAX_ENTRIES];
+static size_t s_entryCount = 0;
+
+// Whether the entries were loaded from the cache file.
+static bool s_loaded = false;
+
+// The path set by ADUC_VerifiedExtensionCache_SetFilePath, or NULL for the default.
+static char* s_cacheFilePath = NULL;
+
+static unsigned int s_trustedOwner = 0;
+
+static size_t s_hitCount = 0;
+static size_t s_missCount = 0;
+
+/**
+ * @brief Gets the identity of @p st.
+ */
+static void GetFileIdentity(const struct stat* st, VerifiedExtensionFileIdentity* identity)
+{
+    identity->device = (uint64_t)st->st_dev;
+    identity->inode = (uint64_t)st->st_ino;
+    identity->size = (uint64_t)st->st_size;
+    identity->modifiedTimeSec = (int64_t)st->st_mtime;
+    identity->changedTimeSec = (int64_t)st->st_ctime;
+#if defined(WIN32)
+    identity->modifiedTimeNsec = 0;
+    identity->changedTimeNsec = 0;
+#else
+    identity->modifiedTimeNsec = (int64_t)st->st_mtim.tv_nsec;
+    identity->changedTimeNsec = (int64_t)st->st_ctim.tv_nsec;
+#endif
+}
+
+static bool IsSameFileIdentity(const VerifiedExtensionFileIdentity* a, const VerifiedExtensionFileIdentity* b)
+{
+    return a->device == b->device && a->inode == b->inode && a->size == b->size
+        && a->modifiedTimeSec == b->modifiedTimeSec && a->modifiedTimeNsec == b->modifiedTimeNsec
+        && a->changedTimeSec == b->changedTimeSec && a->changedTimeNsec == b->changedTimeNsec;
+}
+
+/**
+ * @brief Returns whether the file described by @p st can be cached: a regular file, owned by the trusted owner, and
+ * not writable by group or others. Anyone else able to write the file could change it while keeping its identity.
+ */
+static bool IsTrustedExtensionFile(const struct stat* st)
+{
+#if defined(WIN32)
+    (void)st;
+    return false;
+#else
+    return S_ISREG(st->st_mode) && st->st_uid == (uid_t)s_trustedOwner && (st->st_mode & (S_IWGRP | S_IWOTH)) == 0;
+#endif
+}
+
+/**
+ * @brief Returns whether the cache file described by @p st can be trusted: a regular file, owned by the effective
+ * user of the process, and not writable by group or others.
+ */
+static bool IsTrustedCacheFile(const struct stat* st)
+{
+#if defined(WIN32)
+    (void)st;
+    return false;
+#else
+    return S_ISREG(st->st_mode) && st->st_uid == geteuid() && (st->st_mode & (S_IWGRP | S_IWOTH)) == 0;
+#endif
+}
+
+/**
+ * @brief Gets the path of the cache file. Must be called with the mutex held.
+ *
+ * @return char* The path, or NULL if there is no data folder. Must be freed by the caller.
+ */
+static char* GetCacheFilePath(void)
+{
+    char* path = NULL;
+
+    if (s_cacheFilePath != NULL)
+    {
+        return ADUC_StringFormat("%s", s_cacheFilePath);
+    }
+
+    const ADUC_ConfigInfo* config = ADUC_ConfigInfo_GetInstance();
+    if (config != NULL)
+    {
+        if (config->dataFolder != NULL)
+        {
+            path = ADUC_StringFormat("%s/%s", config->dataFolder, VERIFIED_EXTENSION_CACHE_FILE_NAME);
+        }
+        ADUC_ConfigInfo_ReleaseInstance(config);
+    }
+
+    return path;
+}
+
+/**
+ * @brief Frees the entries in memory. Must be called with the mutex held.
+ */
+static void FreeEntries(void)
+{
+    for (size_t i = 0; i < s_entryCount; ++i)
+    {
+        free(s_entries[i].filePath);
+    }
+
+    memset(s_entries, 0, sizeof(s_entries));
+    s_entryCount = 0;
+}
+
+/**
+ * @brief Removes the entry at @p entryIndex. Must be called with the mutex held.
+ */
+static void RemoveEntry(size_t entryIndex)
+{
+    free(s_entries[entryIndex].filePath);
+    memmove(
+        &s_entries[entryIndex],
+        &s_entries[entryIndex + 1],
+        (s_entryCount - entryIndex - 1) * sizeof(VerifiedExtensionEntry));
+    --s_entryCount;
+    memset(&s_entries[s_entryCount], 0, sizeof(VerifiedExtensionEntry));
+}
+
+/**
+ * @brief Finds the entry of @p filePath. Must be called with the mutex held.
+ *
+ * @return VerifiedExtensionEntry* The entry, or NULL if not found.
+ */
+static VerifiedExtensionEntry* FindEntry(const char* filePath)
+{
+    for (size_t i = 0; i < s_entryCount; ++i)
+    {
+        if (strcmp(s_entries[i].filePath, filePath) == 0)
+        {
+            return &s_entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Adds an entry, replacing the entry of the same file if any, and dropping the oldest entry if the cache is
+ * full. Must be called with the mutex held.
+ *
+ * @return bool true on success.
+ */
+static bool AddEntry(
+    const char* filePath, int32_t algorithm, const char* hashBase64, const VerifiedExtensionFileIdentity* identity)
+{
+    char* filePathCopy = ADUC_StringFormat("%s", filePath);
+    if (filePathCopy == NULL)
+    {
+        return false;
+    }
+
+    VerifiedExtensionEntry* existing = FindEntry(filePath);
+    if (existing != NULL)
+    {
+        RemoveEntry((size_t)(existing - s_entries));
+    }
+    else if (s_entryCount == ADUC_VERIFIED_EXTENSION_CACHE_MAX_ENTRIES)
+    {
+        RemoveEntry(0);
+    }
+
+    VerifiedExtensionEntry* entry = &s_entries[s_entryCount++];
+    entry->filePath = filePathCopy;
+    entry->algorithm = algorithm;
+    ADUC_Safe_StrCopyN(entry->hashBase64, hashBase64, sizeof(entry->hashBase64), strlen(hashBase64));
+    entry->identity = *identity;
+
+    return true;
+}
+
+/**
+ * @brief Parses a line of the cache file into an entry. Must be called with the mutex held.
+ *
+ * @return bool true if the line is a valid entry.
+ */
+static bool ParseEntryLine(char* line)
+{
+    int32_t algorithm = 0;
+    char hashBase64[ADUC_VERIFIED_DIGEST_MAX_HASH_BASE64_LEN + 1] = { 0 };
+    VerifiedExtensionFileIdentity identity = { 0 };
+    int pathOffset = -1;
+
+    // The file path is last, as it may contain spaces. The hash width is ADUC_VERIFIED_DIGEST_MAX_HASH_BASE64_LEN.
+    if (sscanf(
+            line,
+            "%" SCNd32 " %88s %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNd64 " %" SCNd64 " %" SCNd64 " %" SCNd64 " %n",
+            &algorithm,
+            hashBase64,
+            &identity.device,
+            &identity.inode,
+            &identity.size,
+            &identity.modifiedTimeSec,
+            &identity.modifiedTimeNsec,
+            &identity.changedTimeSec,
+            &identity.changedTimeNsec,
+            &pathOffset)
+            != 9
+        || pathOffset < 0)
+    {
+        return false;
+    }
+
+    char* filePath = line + pathOffset;
+    filePath[strcspn(filePath, "\r\n")] = '\0';
+
+    if (*filePath != '/' || !ADUC_HashUtils_IsValidHashAlgorithm((SHAversion)algorithm))
+    {
+        return false;
+    }
+
+    return AddEntry(filePath, algorithm, hashBase64, &identity);
+}
+
+/**
+ * @brief Loads the entries from the cache file, once. Must be called with the mutex held.
+ * @details A missing, untrusted or malformed cache file leaves the cache empty; it is replaced on the next save.
+ */
+static void LoadEntries(void)
+{
+    FILE* file = NULL;
+    char* line = NULL;
+    char* cacheFilePath = NULL;
+    struct stat st;
+
+    if (s_loaded)
+    {
+        return;
+    }
+
+    s_loaded = true;
+
+    cacheFilePath = GetCacheFilePath();
+    if (cacheFilePath == NULL)
+    {
+        goto done;
+    }
+
+    file = fopen(cacheFilePath, "r");
+    if (file == NULL)
+    {
+        goto done;
+    }
+
+    if (fstat(fileno(file), &st) != 0 || !IsTrustedCacheFile(&st))
+    {
+        Log_Warn("Ignoring untrusted extension verification cache '%s'.", cacheFilePath);
+        goto done;
+    }
+
+    line = calloc(1, VERIFIED_EXTENSION_CACHE_MAX_LINE_LEN);
+    if (line == NULL)
+    {
+        goto done;
+    }
+
+    if (fgets(line, VERIFIED_EXTENSION_CACHE_MAX_LINE_LEN, file) == NULL
+        || strncmp(line, VERIFIED_EXTENSION_CACHE_HEADER, strlen(VERIFIED_EXTENSION_CACHE_HEADER)) != 0)
+    {
+        Log_Info("Ignoring extension verification cache '%s' of another version.", cacheFilePath);
+        goto done;
+    }
+
+    while (fgets(line, VERIFIED_EXTENSION_CACHE_MAX_LINE_LEN, file) != NULL)
+    {
+        if (!ParseEntryLine(line))
+        {
+            Log_Warn("Ignoring malformed extension verification cache '%s'.", cacheFilePath);
+            FreeEntries();
+            goto done;
+        }
+    }
+
+    Log_Debug("Loaded %zu verified extension(s) from '%s'.", s_entryCount, cacheFilePath);
+
+done:
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+
+    free(line);
+    free(cacheFilePath);
+}
+
+/**
+ * @brief Saves the entries to the cache file, replacing it atomically. Must be called with the mutex held.
+ * @details A failure to save is not an error: the extensions are hashed again after the next restart.
+ */
+static void SaveEntries(void)
+{
+    FILE* file = NULL;
+    int fd = -1;
+    char* cacheFilePath = NULL;
+    char* tempFilePath = NULL;
+    bool saved = false;
+
+    cacheFilePath = GetCacheFilePath();
+    if (cacheFilePath == NULL)
+    {
+        goto done;
+    }
+
+    tempFilePath = ADUC_StringFormat("%s.tmp", cacheFilePath);
+    if (tempFilePath == NULL)
+    {
+        goto done;
+    }
+
+    // Owner read and write only, as the entries are trusted to skip the hash.
+    fd = open(tempFilePath, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+    {
+        Log_Warn("Cannot create '%s', errno: %d", tempFilePath, errno);
+        goto done;
+    }
+
+    file = fdopen(fd, "w");
+    if (file == NULL)
+    {
+        goto done;
+    }
+
+    fd = -1;
+
+    fprintf(file, "%s\n", VERIFIED_EXTENSION_CACHE_HEADER);
+
+    for (size_t i = 0; i < s_entryCount; ++i)
+    {
+        const VerifiedExtensionEntry* entry = &s_entries[i];
+        fprintf(
+            file,
+            "%" PRId32 " %s %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRId64 " %" PRId64 " %" PRId64 " %" PRId64 " %s\n",
+            entry->algorithm,
+            entry->hashBase64,
+            entry->identity.device,
+            entry->identity.inode,
+            entry->identity.size,
+            entry->identity.modifiedTimeSec,
+            entry->identity.modifiedTimeNsec,
+            entry->identity.changedTimeSec,
+            entry->identity.changedTimeNsec,
+            entry->filePath);
+    }
+
+    if (fflush(file) != 0 || ferror(file))
+    {
+        Log_Warn("Cannot write '%s'", tempFilePath);
+        goto done;
+    }
+
+    if (fclose(file) != 0)
+    {
+        file = NULL;
+        goto done;
+    }
+
+    file = NULL;
+
+    if (rename(tempFilePath, cacheFilePath) != 0)
+    {
+        Log_Warn("Cannot rename '%s' to '%s', errno: %d", tempFilePath, cacheFilePath, errno);
+        goto done;
+    }
+
+    saved = true;
+
+done:
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    if (!saved && tempFilePath != NULL)
+    {
+        (void)remove(tempFilePath);
+    }
+
+    free(tempFilePath);
+    free(cacheFilePath);
+}
+
+/**
+ * @brief Checks if the hash of the extension file at @p filePath matches @p hashBase64, skipping the hash
+ * computation if the file was already verified against @p hashBase64 and has not changed since.
+ *
+ * @param filePath The path to the extension file.
+ * @param hashBase64 The expected hash of the file.
+ * @param algorithm The hashing algorithm of @p hashBase64.
+ * @return bool true if the hash matches.
+ */
+bool ADUC_VerifiedExtensionCache_IsValidFileHash(const char* filePath, const char* hashBase64, SHAversion algorithm)
+{
+    struct stat before;
+    struct stat after;
+    VerifiedExtensionFileIdentity identity = { 0 };
+    VerifiedExtensionFileIdentity afterIdentity = { 0 };
+
+    if (filePath == NULL || hashBase64 == NULL)
+    {
+        return false;
+    }
+
+    // Relative paths and hashes that do not fit an entry are never cached.
+    const bool cacheable = *filePath == '/' && strlen(hashBase64) <= ADUC_VERIFIED_DIGEST_MAX_HASH_BASE64_LEN
+        && strpbrk(filePath, "\r\n") == NULL && strpbrk(hashBase64, " \t\r\n") == NULL && stat(filePath, &before) == 0
+        && IsTrustedExtensionFile(&before);
+
+    if (cacheable)
+    {
+        GetFileIdentity(&before, &identity);
+
+        pthread_mutex_lock(&s_cacheMutex);
+
+        LoadEntries();
+
+        const VerifiedExtensionEntry* entry = FindEntry(filePath);
+        const bool hit = entry != NULL && entry->algorithm == (int32_t)algorithm
+            && strcmp(entry->hashBase64, hashBase64) == 0 && IsSameFileIdentity(&entry->identity, &identity);
+
+        if (hit)
+        {
+            ++s_hitCount;
+        }
+
+        pthread_mutex_unlock(&s_cacheMutex);
+
+        if (hit)
+        {
+            Log_Debug("Extension '%s' was already verified.", filePath);
+            return true;
+        }
+    }
+
+    pthread_mutex_lock(&s_cacheMutex);
+    ++s_missCount;
+    pthread_mutex_unlock(&s_cacheMutex);
+
+    if (!ADUC_HashUtils_IsValidFileHash(filePath, hashBase64, algorithm, true /* suppressErrorLog */))
+    {
+        return false;
+    }
+
+    // Only cache the file if it did not change while it was hashed.
+    if (cacheable && stat(filePath, &after) == 0 && IsTrustedExtensionFile(&after))
+    {
+        GetFileIdentity(&after, &afterIdentity);
+
+        if (IsSameFileIdentity(&identity, &afterIdentity))
+        {
+            pthread_mutex_lock(&s_cacheMutex);
+
+            if (AddEntry(filePath, (int32_t)algorithm, hashBase64, &identity))
+            {
+                SaveEntries();
+            }
+
+            pthread_mutex_unlock(&s_cacheMutex);
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Verifies the extension file at @p filePath against the hash with the strongest algorithm in @p hashes,
+ * skipping the hash computation if the file was already verified.
+ *
+ * @param filePath The path to the extension file.
+ * @param hashes The array of ADUC_Hash objects.
+ * @param hashCount The length of the array.
+ * @return bool true if the hash with the strongest algorithm matches.
+ */
+bool ADUC_VerifiedExtensionCache_VerifyWithStrongestHash(
+    const char* filePath, const ADUC_Hash* hashes, size_t hashCount)
+{
+    size_t strongestIndex = 0;
+    SHAversion algorithm = SHA256;
+
+    if (!ADUC_HashUtils_GetIndexStrongestValidHash(hashes, hashCount, &strongestIndex, &algorithm))
+    {
+        return false;
+    }
+
+    return ADUC_VerifiedExtensionCache_IsValidFileHash(
+        filePath, ADUC_HashUtils_GetHashValue(hashes, hashCount, strongestIndex), algorithm);
+}
+
+/**
+ * @brief Sets the path of the cache file, and drops the entries in memory.
+ *
+ * @param filePath The path of the cache file, or NULL to restore the default.
+ */
+void ADUC_VerifiedExtensionCache_SetFilePath(const char* filePath)
+{
+    pthread_mutex_lock(&s_cacheMutex);
+
+    free(s_cacheFilePath);
+    s_cacheFilePath = filePath == NULL ? NULL : ADUC_StringFormat("%s", filePath);
+
+    FreeEntries();
+    s_loaded = false;
+
+    pthread_mutex_unlock(&s_cacheMutex);
+}
+
+/**
+ * @brief Sets the owner that extension files must have to be cached.
+ *
+ * @param ownerId The user id of the owner.
+ */
+void ADUC_VerifiedExtensionCache_SetTrustedOwner(unsigned int ownerId)
+{
+    pthread_mutex_lock(&s_cacheMutex);
+    s_trustedOwner = ownerId;
+    pthread_mutex_unlock(&s_cacheMutex);
+}
+
+/**
+ * @brief Drops the entries in memory and resets the hit and miss counts.
+ */
+void ADUC_VerifiedExtensionCache_Reset(void)
+{
+    pthread_mutex_lock(&s_cacheMutex);
+
+    FreeEntries();
+    s_loaded = false;
+    s_hitCount = 0;
+    s_missCount = 0;
+
+    pthread_mutex_unlock(&s_cacheMutex);
+}
+
+/**
+ * @brief Gets how many verifications were answered from the cache, and how many computed the hash.
+ *
+ * @param[out] hitCount The number of verifications answered from the cache. May be NULL.
+ * @param[out] missCount The number of verifications that computed the hash. May be NULL.
+ */
+void ADUC_VerifiedExtensionCache_GetStatistics(size_t* hitCount, size_t* missCount)
+{
+    pthread_mutex_lock(&s_cacheMutex);
+
+    if (hitCount != NULL)
+    {
+        *hitCount = s_hitCount;
+    }
+
+    if (missCount != NULL)
+    {
+        *missCount = s_missCount;
+    }
+
+    pthread_mutex_unlock(&s_cacheMutex);
+}
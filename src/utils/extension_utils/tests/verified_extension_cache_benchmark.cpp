@@ -0,0 +1,258 @@
+/**
+ * @file verified_extension_cache_benchmark.cpp
+ * @brief Measures how long the agent takes, after a cold start, until its handler extensions are verified and ready
+ * to be loaded, with and without the verified extension cache.
+ *
+ * @details Hidden from the default run, as it writes a dozen extension files. Run it with:
+ *   extension_utils_unit_tests "[benchmark]"
+ *
+ * Each run emulates a cold start: the cache is dropped from memory, and the extension files are dropped from the
+ * page cache. Every extension is then verified the way the extension manager does before loading it: its
+ * registration file is parsed and its file is checked against the registered hash. The extension files are not
+ * libraries, so dlopen, whose cost does not depend on the cache, is not measured.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/verified_extension_cache.h"
+
+#include <aduc/calloc_wrapper.hpp> // ADUC::StringUtils::cstr_wrapper
+#include <aduc/extension_utils.h> // GetExtensionFileEntity
+#include <aduc/hash_utils.h>
+#include <aduc/system_utils.h>
+#include <aduc/parser_utils.h> // ADUC_FileEntity_Uninit
+
+#include <catch2/catch_all.hpp>
+
+#include <algorithm> // std::min
+#include <chrono>
+#include <cstdio> // printf, std::remove
+#include <cstdlib> // mkdtemp
+#include <fcntl.h> // open, posix_fadvise
+#include <fstream>
+#include <string>
+#include <sys/stat.h> // chmod
+#include <unistd.h> // close, fdatasync, geteuid
+#include <vector>
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+/**
+ * @brief A dozen extension files with their registration files, in a temporary folder removed on destruction.
+ */
+class BenchmarkExtensions
+{
+public:
+    BenchmarkExtensions(const BenchmarkExtensions&) = delete;
+    BenchmarkExtensions& operator=(const BenchmarkExtensions&) = delete;
+    BenchmarkExtensions(BenchmarkExtensions&&) = delete;
+    BenchmarkExtensions& operator=(BenchmarkExtensions&&) = delete;
+
+    BenchmarkExtensions(size_t extensionCount, size_t extensionSizeInBytes)
+    {
+        REQUIRE(mkdtemp(_dir) != nullptr);
+
+        std::vector<char> chunk(1024 * 1024);
+        uint64_t state = 0x9E3779B97F4A7C15ULL;
+
+        for (size_t i = 0; i < extensionCount; ++i)
+        {
+            const std::string extensionPath = std::string{ _dir } + "/libextension" + std::to_string(i) + ".so";
+            const std::string regPath = std::string{ _dir } + "/extension" + std::to_string(i) + ".json";
+
+            {
+                std::ofstream file{ extensionPath, std::ios::trunc | std::ios::binary };
+                for (size_t written = 0; written < extensionSizeInBytes; written += chunk.size())
+                {
+                    // xorshift64, so the content does not compress or deduplicate.
+                    for (char& c : chunk)
+                    {
+                        state ^= state << 13;
+                        state ^= state >> 7;
+                        state ^= state << 17;
+                        c = static_cast<char>(state);
+                    }
+                    file.write(
+                        chunk.data(),
+                        static_cast<std::streamsize>(std::min(chunk.size(), extensionSizeInBytes - written)));
+                }
+                REQUIRE(file.good());
+            }
+
+            REQUIRE(chmod(extensionPath.c_str(), 0644) == 0);
+
+            ADUC::StringUtils::cstr_wrapper hash;
+            REQUIRE(ADUC_HashUtils_GetFileHash(extensionPath.c_str(), SHA256, hash.address_of()));
+
+            // The same content as the registration files written by RegisterExtension.
+            std::ofstream regFile{ regPath, std::ios::trunc };
+            regFile << "{\n"
+                    << "   \"fileName\":\"" << extensionPath << "\",\n"
+                    << "   \"sizeInBytes\":" << extensionSizeInBytes << ",\n"
+                    << "   \"hashes\": {\n"
+                    << "        \"sha256\":\"" << hash.get() << "\"\n"
+                    << "   }\n"
+                    << "}\n";
+            REQUIRE(regFile.good());
+
+            _extensionPaths.push_back(extensionPath);
+            _regPaths.push_back(regPath);
+        }
+    }
+
+    ~BenchmarkExtensions()
+    {
+        ADUC_SystemUtils_RmDirRecursive(_dir);
+    }
+
+    std::string GetCachePath() const
+    {
+        return std::string{ _dir } + "/extension_verification_cache";
+    }
+
+    const std::vector<std::string>& GetRegPaths() const
+    {
+        return _regPaths;
+    }
+
+    /**
+     * @brief Drops the extension files from the page cache, as after a reboot.
+     */
+    void Drop() const
+    {
+        for (const std::string& path : _extensionPaths)
+        {
+            const int fd = open(path.c_str(), O_RDONLY);
+            REQUIRE(fd >= 0);
+            (void)fdatasync(fd);
+            (void)posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+    }
+
+private:
+    char _dir[sizeof("/tmp/aduc_extension_benchmark_XXXXXX")] = "/tmp/aduc_extension_benchmark_XXXXXX";
+    std::vector<std::string> _extensionPaths;
+    std::vector<std::string> _regPaths;
+};
+
+/**
+ * @brief Verifies the extension registered in @p regPath, as ExtensionManager::LoadExtensionLibrary does.
+ */
+bool VerifyExtension(const std::string& regPath)
+{
+    ADUC_FileEntity entity = {};
+    SHAversion algorithm = SHA256;
+
+    if (!GetExtensionFileEntity(regPath.c_str(), &entity))
+    {
+        return false;
+    }
+
+    const char* hashType = ADUC_HashUtils_GetHashType(entity.Hash, entity.HashCount, 0);
+    const char* hashValue = ADUC_HashUtils_GetHashValue(entity.Hash, entity.HashCount, 0);
+    const bool verified = ADUC_HashUtils_GetShaVersionForTypeString(hashType, &algorithm)
+        && ADUC_VerifiedExtensionCache_IsValidFileHash(entity.TargetFilename, hashValue, algorithm);
+
+    ADUC_FileEntity_Uninit(&entity);
+    return verified;
+}
+
+struct StartupTimes
+{
+    double firstReadySeconds;
+    double allReadySeconds;
+};
+
+/**
+ * @brief Emulates @p iterations cold starts, deleting the cache file before each one unless @p useCache is set.
+ *
+ * @return StartupTimes The best times until the first and the last extensions were verified.
+ */
+StartupTimes MeasureColdStart(const BenchmarkExtensions& extensions, int iterations, bool useCache)
+{
+    StartupTimes best{};
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        if (!useCache)
+        {
+            std::remove(extensions.GetCachePath().c_str());
+        }
+
+        ADUC_VerifiedExtensionCache_Reset();
+        extensions.Drop();
+
+        StartupTimes times{};
+        const Clock::time_point start = Clock::now();
+
+        for (const std::string& regPath : extensions.GetRegPaths())
+        {
+            REQUIRE(VerifyExtension(regPath));
+
+            if (times.firstReadySeconds == 0)
+            {
+                times.firstReadySeconds = std::chrono::duration<double>(Clock::now() - start).count();
+            }
+        }
+
+        times.allReadySeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        if (i == 0 || times.allReadySeconds < best.allReadySeconds)
+        {
+            best = times;
+        }
+    }
+
+    return best;
+}
+
+struct ExtensionSize
+{
+    const char* name;
+    size_t sizeInBytes;
+};
+
+} // namespace
+
+TEST_CASE("Agent cold start time until the handler extensions are ready", "[.hide][benchmark]")
+{
+    // clang-format off
+    const ExtensionSize extensionSize = GENERATE( // NOLINT(google-build-using-namespace)
+        ExtensionSize{ "1 MB", 1024ULL * 1024 },
+        ExtensionSize{ "8 MB", 8ULL * 1024 * 1024 });
+    // clang-format on
+
+    const size_t extensionCount = 12;
+    const int iterations = 5;
+    BenchmarkExtensions extensions{ extensionCount, extensionSize.sizeInBytes };
+
+    // The benchmark files are owned by the current user rather than root.
+    ADUC_VerifiedExtensionCache_SetFilePath(extensions.GetCachePath().c_str());
+    ADUC_VerifiedExtensionCache_SetTrustedOwner(geteuid());
+
+    for (const bool useCache : { false, true })
+    {
+        if (useCache)
+        {
+            // Populate the cache, as the first start after the extensions were installed does.
+            MeasureColdStart(extensions, 1, true);
+        }
+
+        const StartupTimes times = MeasureColdStart(extensions, iterations, useCache);
+
+        printf(
+            "%zu x %-5s %-13s first handler ready in %8.2f ms, all handlers ready in %8.2f ms\n",
+            extensionCount,
+            extensionSize.name,
+            useCache ? "cache" : "no cache",
+            times.firstReadySeconds * 1000.0,
+            times.allReadySeconds * 1000.0);
+    }
+
+    ADUC_VerifiedExtensionCache_SetFilePath(nullptr);
+    ADUC_VerifiedExtensionCache_SetTrustedOwner(0);
+    ADUC_VerifiedExtensionCache_Reset();
+}
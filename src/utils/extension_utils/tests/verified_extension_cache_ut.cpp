@@ -0,0 +1,198 @@
+/**
+ * @file verified_extension_cache_ut.cpp
+ * @brief Unit Tests for the verified extension cache.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/verified_extension_cache.h"
+
+#include <aduc/calloc_wrapper.hpp> // ADUC::StringUtils::cstr_wrapper
+#include <aduc/hash_utils.h>
+#include <aduc/system_utils.h>
+
+#include <catch2/catch_all.hpp>
+
+#include <cstdlib> // mkdtemp
+#include <fstream>
+#include <string>
+#include <sys/stat.h> // chmod
+#include <unistd.h> // geteuid
+
+namespace
+{
+/**
+ * @brief Points the cache to a file in a temporary folder, and trusts the extension files of the current user.
+ */
+class VerifiedExtensionCacheFixture
+{
+public:
+    VerifiedExtensionCacheFixture()
+    {
+        REQUIRE(mkdtemp(_dir) != nullptr);
+        ADUC_VerifiedExtensionCache_SetFilePath(GetPath("cache").c_str());
+        ADUC_VerifiedExtensionCache_SetTrustedOwner(geteuid());
+        ADUC_VerifiedExtensionCache_Reset();
+    }
+
+    VerifiedExtensionCacheFixture(const VerifiedExtensionCacheFixture&) = delete;
+    VerifiedExtensionCacheFixture& operator=(const VerifiedExtensionCacheFixture&) = delete;
+    VerifiedExtensionCacheFixture(VerifiedExtensionCacheFixture&&) = delete;
+    VerifiedExtensionCacheFixture& operator=(VerifiedExtensionCacheFixture&&) = delete;
+
+    ~VerifiedExtensionCacheFixture()
+    {
+        ADUC_VerifiedExtensionCache_SetFilePath(nullptr);
+        ADUC_VerifiedExtensionCache_SetTrustedOwner(0);
+        ADUC_VerifiedExtensionCache_Reset();
+        ADUC_SystemUtils_RmDirRecursive(_dir);
+    }
+
+    std::string GetPath(const char* fileName) const
+    {
+        return std::string{ _dir } + "/" + fileName;
+    }
+
+    /**
+     * @brief Writes an extension file, and returns its SHA256 hash.
+     */
+    std::string WriteExtension(const std::string& path, const std::string& content, mode_t mode = 0644) const
+    {
+        {
+            std::ofstream file{ path, std::ios::trunc | std::ios::binary };
+            file << content;
+            REQUIRE(file.good());
+        }
+
+        REQUIRE(chmod(path.c_str(), mode) == 0);
+
+        ADUC::StringUtils::cstr_wrapper hash;
+        REQUIRE(ADUC_HashUtils_GetFileHash(path.c_str(), SHA256, hash.address_of()));
+        return hash.get();
+    }
+
+private:
+    char _dir[sizeof("/tmp/aduc_verified_extension_cache_XXXXXX")] = "/tmp/aduc_verified_extension_cache_XXXXXX";
+};
+
+size_t GetHitCount()
+{
+    size_t hitCount = 0;
+    ADUC_VerifiedExtensionCache_GetStatistics(&hitCount, nullptr);
+    return hitCount;
+}
+
+size_t GetMissCount()
+{
+    size_t missCount = 0;
+    ADUC_VerifiedExtensionCache_GetStatistics(nullptr, &missCount);
+    return missCount;
+}
+
+} // namespace
+
+TEST_CASE_METHOD(VerifiedExtensionCacheFixture, "Verified extension is not hashed again")
+{
+    const std::string path = GetPath("extension.so");
+    const std::string hash = WriteExtension(path, "extension content");
+
+    CHECK(ADUC_VerifiedExtensionCache_IsValidFileHash(path.c_str(), hash.c_str(), SHA256));
+    CHECK(GetMissCount() == 1);
+    CHECK(ADUC_VerifiedExtensionCache_IsValidFileHash(path.c_str(), hash.c_str(), SHA256));
+    CHECK(GetHitCount() == 1);
+
+    SECTION("The cache survives a restart")
+    {
+        ADUC_VerifiedExtensionCache_Reset();
+
+        CHECK(ADUC_VerifiedExtensionCache_IsValidFileHash(path.c_str(), hash.c_str(), SHA256));
+        CHECK(GetHitCount() == 1);
+        CHECK(GetMissCount() == 0);
+    }
+
+    SECTION("Another expected hash is verified")
+    {
+        CHECK_FALSE(ADUC_VerifiedExtensionCache_IsValidFileHash(
+            path.c_str(), "47DEQpj8HBSa+/TImW+5JCeuQeRkm5NMpJWZG3hSuFU=", SHA256));
+        CHECK(GetMissCount() == 2);
+    }
+
+    SECTION("A modified extension is hashed again")
+    {
+        WriteExtension(path, "modified extension content");
+
+        CHECK_FALSE(ADUC_VerifiedExtensionCache_IsValidFileHash(path.c_str(), hash.c_str(), SHA256));
+        CHECK(GetMissCount() == 2);
+    }
+
+    SECTION("A replaced extension is hashed again")
+    {
+        const std::string newPath = GetPath("new_extension.so");
+        REQUIRE(WriteExtension(newPath, "extension content") == hash);
+        REQUIRE(rename(newPath.c_str(), path.c_str()) == 0);
+
+        CHECK(ADUC_VerifiedExtensionCache_IsValidFileHash(path.c_str(), hash.c_str(), SHA256));
+        CHECK(GetMissCount() == 2);
+    }
+}
+
+TEST_CASE_METHOD(VerifiedExtensionCacheFixture, "Untrusted extension is always hashed")
+{
+    const std::string path = GetPath("extension.so");
+
+    SECTION("Writable by others")
+    {
+        const std::string hash = WriteExtension(path, "extension content", 0666);
+
+        CHECK(ADUC_VerifiedExtensionCache_IsValidFileHash(path.c_str(), hash.c_str(), SHA256));
+        CHECK(ADUC_VerifiedExtensionCache_IsValidFileHash(path.c_str(), hash.c_str(), SHA256));
+        CHECK(GetHitCount() == 0);
+        CHECK(GetMissCount() == 2);
+    }
+
+    SECTION("Owned by another user")
+    {
+        const std::string hash = WriteExtension(path, "extension content");
+        ADUC_VerifiedExtensionCache_SetTrustedOwner(geteuid() + 1);
+
+        CHECK(ADUC_VerifiedExtensionCache_IsValidFileHash(path.c_str(), hash.c_str(), SHA256));
+        CHECK(ADUC_VerifiedExtensionCache_IsValidFileHash(path.c_str(), hash.c_str(), SHA256));
+        CHECK(GetHitCount() == 0);
+        CHECK(GetMissCount() == 2);
+    }
+}
+
+TEST_CASE_METHOD(VerifiedExtensionCacheFixture, "Untrusted cache file is ignored")
+{
+    const std::string path = GetPath("extension.so");
+    const std::string hash = WriteExtension(path, "extension content");
+
+    CHECK(ADUC_VerifiedExtensionCache_IsValidFileHash(path.c_str(), hash.c_str(), SHA256));
+    REQUIRE(chmod(GetPath("cache").c_str(), 0666) == 0);
+    ADUC_VerifiedExtensionCache_Reset();
+
+    CHECK(ADUC_VerifiedExtensionCache_IsValidFileHash(path.c_str(), hash.c_str(), SHA256));
+    CHECK(GetHitCount() == 0);
+    CHECK(GetMissCount() == 1);
+}
+
+TEST_CASE_METHOD(VerifiedExtensionCacheFixture, "Verify with strongest hash")
+{
+    const std::string path = GetPath("extension.so");
+    const std::string sha256 = WriteExtension(path, "extension content");
+
+    ADUC::StringUtils::cstr_wrapper sha512;
+    REQUIRE(ADUC_HashUtils_GetFileHash(path.c_str(), SHA512, sha512.address_of()));
+
+    ADUC_Hash hashes[2] = {};
+    REQUIRE(ADUC_Hash_Init(&hashes[0], sha256.c_str(), "sha256"));
+    REQUIRE(ADUC_Hash_Init(&hashes[1], sha512.get(), "sha512"));
+
+    CHECK(ADUC_VerifiedExtensionCache_VerifyWithStrongestHash(path.c_str(), hashes, 2));
+    CHECK(ADUC_VerifiedExtensionCache_VerifyWithStrongestHash(path.c_str(), hashes, 2));
+    CHECK(GetHitCount() == 1);
+    CHECK(GetMissCount() == 1);
+
+    ADUC_Hash_UnInit(&hashes[0]);
+    ADUC_Hash_UnInit(&hashes[1]);
+}
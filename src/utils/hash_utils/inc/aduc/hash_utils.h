@@ -9,15 +9,51 @@
 #define ADUC_HASH_UTILS_H
 
 #include "aduc/c_utils.h"
+#include "aduc/types/download.h" // for ADUC_VerifiedDigest
 #include "aduc/types/hash.h"
 
 #include "azure_c_shared_utility/sha.h" // for SHAversion
 
 #include <stdbool.h> // for bool
 #include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
 
 EXTERN_C_BEGIN
 
+/**
+ * @brief The implementation used to compute digests.
+ */
+typedef enum tagADUC_HashUtils_DigestBackend
+{
+    ADUC_HashUtils_DigestBackend_OpenSSL = 0, /**< OpenSSL EVP, which uses the SHA instructions of the CPU (Intel SHA
+                                                extensions, ARMv8 cryptography extensions) when it detects them. */
+    ADUC_HashUtils_DigestBackend_Portable = 1, /**< The portable RFC 6234 implementation. */
+} ADUC_HashUtils_DigestBackend;
+
+/**
+ * @brief How file content is read to hash it.
+ */
+typedef enum tagADUC_HashUtils_FileReadMode
+{
+    ADUC_HashUtils_FileReadMode_Auto = 0, /**< Small files are read into a buffer, larger ones are memory mapped. */
+    ADUC_HashUtils_FileReadMode_Buffered = 1, /**< Read into a large aligned buffer. */
+    ADUC_HashUtils_FileReadMode_MemoryMapped = 2, /**< Memory mapped for sequential access, one window at a time.
+                                                     Falls back to reading when the file cannot be mapped. */
+} ADUC_HashUtils_FileReadMode;
+
+/**
+ * @brief Incremental hash state for content that is hashed as it is streamed, e.g. while being downloaded.
+ * @details Zero-initialize it before ADUC_HashUtils_StreamContext_Init, and release it with
+ * ADUC_HashUtils_StreamContext_UnInit.
+ */
+typedef struct tagADUC_HashUtils_StreamContext
+{
+    void* evpContext; /**< The OpenSSL EVP_MD_CTX, or NULL when the portable implementation is used. */
+    USHAContext shaContext; /**< The portable hash context, used when evpContext is NULL. */
+    SHAversion algorithm; /**< The hash algorithm. */
+    uint64_t bytesHashed; /**< The number of bytes hashed so far. */
+} ADUC_HashUtils_StreamContext;
+
 bool ADUC_HashUtils_IsValidFileHash(
     const char* path, const char* hashBase64, SHAversion algorithm, bool suppressErrorLog);
 
@@ -80,6 +116,18 @@ void ADUC_Hash_FreeArray(size_t hashCount, ADUC_Hash* hashArray);
  */
 bool ADUC_HashUtils_VerifyWithStrongestHash(const char* filePath, const ADUC_Hash* hashes, size_t hashCount);
 
+/**
+ * @brief Finds the hash with the strongest valid algorithm in the array.
+ *
+ * @param hashes The array of ADUC_Hash objects.
+ * @param hashCount The length of the array.
+ * @param[out] outIndexStrongestAlgorithm The index of the hash with the strongest algorithm.
+ * @param[out] outBestShaVersion The strongest algorithm.
+ * @return bool true if there is a hash with a valid algorithm, and all the algorithms are supported.
+ */
+bool ADUC_HashUtils_GetIndexStrongestValidHash(
+    const ADUC_Hash* hashes, size_t hashCount, size_t* outIndexStrongestAlgorithm, SHAversion* outBestShaVersion);
+
 /**
  * @brief Whether the hash algorithm is valid.
  *
@@ -88,6 +136,129 @@ bool ADUC_HashUtils_VerifyWithStrongestHash(const char* filePath, const ADUC_Has
  */
 bool ADUC_HashUtils_IsValidHashAlgorithm(SHAversion sha);
 
+/**
+ * @brief Selects the implementation used for the digests computed from now on.
+ * @details The default is ADUC_HashUtils_DigestBackend_OpenSSL. The portable implementation is used whenever
+ * OpenSSL cannot compute a digest. This is meant for tests and benchmarks; contexts that were already initialized
+ * keep their implementation.
+ *
+ * @param backend The implementation.
+ */
+void ADUC_HashUtils_SetDigestBackend(ADUC_HashUtils_DigestBackend backend);
+
+/**
+ * @brief Gets the implementation selected by ADUC_HashUtils_SetDigestBackend.
+ *
+ * @return ADUC_HashUtils_DigestBackend The implementation.
+ */
+ADUC_HashUtils_DigestBackend ADUC_HashUtils_GetDigestBackend(void);
+
+/**
+ * @brief Selects how file content is read to hash it.
+ * @details The default is ADUC_HashUtils_FileReadMode_Auto. Whatever the mode, large files are dropped from the page
+ * cache once they are hashed. This is meant for tests and benchmarks.
+ *
+ * @param mode The read mode.
+ */
+void ADUC_HashUtils_SetFileReadMode(ADUC_HashUtils_FileReadMode mode);
+
+/**
+ * @brief Gets the read mode selected by ADUC_HashUtils_SetFileReadMode.
+ *
+ * @return ADUC_HashUtils_FileReadMode The read mode.
+ */
+ADUC_HashUtils_FileReadMode ADUC_HashUtils_GetFileReadMode(void);
+
+/**
+ * @brief Initializes a stream context for hashing content incrementally.
+ *
+ * @param context The stream context to initialize. It must not be initialized already.
+ * @param algorithm The hashing algorithm to use.
+ * @return bool true on success.
+ */
+bool ADUC_HashUtils_StreamContext_Init(ADUC_HashUtils_StreamContext* context, SHAversion algorithm);
+
+/**
+ * @brief Discards the content hashed so far by an initialized stream context, so that it can hash new content.
+ *
+ * @param context The stream context.
+ * @return bool true on success.
+ */
+bool ADUC_HashUtils_StreamContext_Reset(ADUC_HashUtils_StreamContext* context);
+
+/**
+ * @brief Releases the resources of a stream context.
+ * @details It is safe to call on a zero-initialized context, and more than once.
+ *
+ * @param context The stream context.
+ */
+void ADUC_HashUtils_StreamContext_UnInit(ADUC_HashUtils_StreamContext* context);
+
+/**
+ * @brief Feeds the next chunk of streamed content into the hash.
+ *
+ * @param context The stream context.
+ * @param data The content bytes.
+ * @param dataLen The number of bytes in @p data.
+ * @return bool true on success.
+ */
+bool ADUC_HashUtils_StreamContext_Update(ADUC_HashUtils_StreamContext* context, const uint8_t* data, size_t dataLen);
+
+/**
+ * @brief Finishes hashing the streamed content and produces a verified digest token for the file it was written to.
+ * @details The digest is compared to @p hashBase64 before the token is populated, and the identity of the file
+ * at @p filePath is recorded so that ADUC_HashUtils_IsVerifiedDigestCurrent can later detect modifications.
+ * The caller must have flushed and closed the file before calling this function.
+ *
+ * @param context The stream context. It cannot be updated after this call, but must still be released with
+ * ADUC_HashUtils_StreamContext_UnInit.
+ * @param hashBase64 The expected hash of the streamed content.
+ * @param filePath The path of the file the streamed content was written to.
+ * @param[out] verifiedDigest The verified digest token.
+ * @return bool true if the content hash matches @p hashBase64 and the token was populated.
+ */
+bool ADUC_HashUtils_StreamContext_FinalizeToVerifiedDigest(
+    ADUC_HashUtils_StreamContext* context,
+    const char* hashBase64,
+    const char* filePath,
+    ADUC_VerifiedDigest* verifiedDigest);
+
+/**
+ * @brief Hashes the file at @p filePath and produces a verified digest token for it, if it matches @p hashBase64.
+ * @details This is the same as streaming the file content through a stream context and finalizing it with
+ * ADUC_HashUtils_StreamContext_FinalizeToVerifiedDigest, so that a file that was just verified does not need to be
+ * hashed again by its consumer.
+ *
+ * @param filePath The path to the file.
+ * @param hashBase64 The expected hash of the file.
+ * @param algorithm The algorithm of the expected hash.
+ * @param[out] verifiedDigest The verified digest token.
+ * @return bool true if the file hash matches @p hashBase64 and the token was populated.
+ */
+bool ADUC_HashUtils_GetFileVerifiedDigest(
+    const char* filePath, const char* hashBase64, SHAversion algorithm, ADUC_VerifiedDigest* verifiedDigest);
+
+/**
+ * @brief Checks whether the verified digest token still describes the file at @p filePath, i.e. the file has not
+ * been replaced or modified since the digest was taken.
+ *
+ * @param verifiedDigest The verified digest token.
+ * @param filePath The path to the file.
+ * @return bool true if the token is populated and the file identity, size and modification time are unchanged.
+ */
+bool ADUC_HashUtils_IsVerifiedDigestCurrent(const ADUC_VerifiedDigest* verifiedDigest, const char* filePath);
+
+/**
+ * @brief Checks whether the verified digest token matches the expected hash.
+ *
+ * @param verifiedDigest The verified digest token.
+ * @param hashBase64 The expected hash.
+ * @param algorithm The algorithm of the expected hash.
+ * @return bool true if the token is populated with a digest of @p algorithm that equals @p hashBase64.
+ */
+bool ADUC_HashUtils_IsVerifiedDigestMatch(
+    const ADUC_VerifiedDigest* verifiedDigest, const char* hashBase64, SHAversion algorithm);
+
 EXTERN_C_END
 
 #endif // ADUC_HASH_UTILS_H
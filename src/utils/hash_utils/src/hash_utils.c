@@ -7,8 +7,20 @@
  */
 #include "aduc/hash_utils.h"
 
+#include <limits.h> // for UINT_MAX
 #include <stdio.h> // for FILE
 #include <stdlib.h> // for calloc
+#include <string.h> // for strcmp, strlen
+#include <sys/stat.h> // for stat
+
+#if defined(WIN32)
+#    include <intrin.h> // for _InterlockedExchange8
+#else
+#    include <errno.h> // for errno
+#    include <fcntl.h> // for open, posix_fadvise
+#    include <sys/mman.h> // for mmap, madvise
+#    include <unistd.h> // for read, close
+#endif
 
 #include <aducpal/strings.h> // strcasecmp
 
@@ -18,6 +30,451 @@
 #include <azure_c_shared_utility/sha.h>
 
 #include <aduc/logging.h>
+#include <aduc/string_c_utils.h> // for ADUC_Safe_StrCopyN
+
+#include <openssl/evp.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    include <cpuid.h> // for __get_cpuid_count
+#elif defined(__aarch64__) && defined(__linux__)
+#    include <asm/hwcap.h> // for HWCAP_SHA2
+#    include <sys/auxv.h> // for getauxval
+#endif
+
+/**
+ * @brief The implementation used for new digests.
+ */
+static ADUC_HashUtils_DigestBackend s_digestBackend = ADUC_HashUtils_DigestBackend_OpenSSL;
+
+/**
+ * @brief Whether the implementation used for digests was logged. Only accessed atomically.
+ */
+static char s_digestBackendLogged = 0;
+
+/**
+ * @brief How file content is read to hash it.
+ */
+static ADUC_HashUtils_FileReadMode s_fileReadMode = ADUC_HashUtils_FileReadMode_Auto;
+
+/**
+ * @brief The size of the buffer that file content is read into.
+ */
+static const size_t HashFileReadBufferSize = 1024 * 1024;
+
+/**
+ * @brief The amount of file content mapped at once, and dropped from the page cache at once.
+ * @details Mapping windows rather than the whole file bounds the address space used on 32-bit devices.
+ */
+static const uint64_t HashFileWindowSize = 64 * 1024 * 1024;
+
+/**
+ * @brief In ADUC_HashUtils_FileReadMode_Auto, files of at least this size are memory mapped.
+ */
+static const uint64_t HashFileMapMinFileSize = 4 * 1024 * 1024;
+
+/**
+ * @brief Files of at least this size are dropped from the page cache once hashed, so that verifying a large
+ * payload does not evict the working set of the device.
+ */
+static const uint64_t HashFileDropCacheMinFileSize = 16 * 1024 * 1024;
+
+/**
+ * @brief The outcome of hashing the content of a file.
+ */
+typedef enum tagHashFileResult
+{
+    HashFileResult_Success, /**< The whole content was hashed. */
+    HashFileResult_CannotOpen, /**< The file cannot be opened. */
+    HashFileResult_ReadError, /**< The content cannot be read or hashed. */
+} HashFileResult;
+
+/**
+ * @brief Gets the OpenSSL message digest for @p algorithm.
+ * @param algorithm The hash algorithm.
+ * @returns const EVP_MD* The message digest, or NULL if @p algorithm is not supported.
+ */
+static const EVP_MD* GetEvpMessageDigest(SHAversion algorithm)
+{
+    switch (algorithm)
+    {
+    case SHA1:
+        return EVP_sha1();
+    case SHA224:
+        return EVP_sha224();
+    case SHA256:
+        return EVP_sha256();
+    case SHA384:
+        return EVP_sha384();
+    case SHA512:
+        return EVP_sha512();
+    default:
+        return NULL;
+    }
+}
+
+/**
+ * @brief Gets the SHA instructions of the CPU, which OpenSSL detects and uses at runtime.
+ * @returns const char* A description of the SHA instructions.
+ */
+static const char* GetCpuShaExtensions(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax = 0;
+    unsigned int ebx = 0;
+    unsigned int ecx = 0;
+    unsigned int edx = 0;
+
+    // CPUID leaf 7, sub-leaf 0: bit 29 of EBX reports the Intel SHA extensions.
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) != 0 && (ebx & (1u << 29)) != 0)
+    {
+        return "Intel SHA extensions";
+    }
+#elif defined(__aarch64__) && defined(__linux__)
+    const unsigned long hwcap = getauxval(AT_HWCAP);
+
+#    if defined(HWCAP_SHA512)
+    if ((hwcap & HWCAP_SHA512) != 0)
+    {
+        return "ARMv8 SHA2 and SHA512 cryptography extensions";
+    }
+#    endif
+    if ((hwcap & HWCAP_SHA2) != 0)
+    {
+        return "ARMv8 SHA2 cryptography extensions";
+    }
+#endif
+    return "none";
+}
+
+/**
+ * @brief Logs the implementation used for digests, the first time a digest is computed.
+ * @param usingOpenSSL Whether OpenSSL computes the digest.
+ */
+static void LogDigestBackend(bool usingOpenSSL)
+{
+    // Digests are computed on concurrent threads, so exactly one of them claims the message.
+#if defined(WIN32)
+    if (_InterlockedExchange8(&s_digestBackendLogged, 1) != 0)
+#else
+    if (__atomic_exchange_n(&s_digestBackendLogged, 1, __ATOMIC_RELAXED) != 0)
+#endif
+    {
+        return;
+    }
+
+    if (usingOpenSSL)
+    {
+        Log_Info(
+            "Computing digests with %s, CPU SHA instructions: %s",
+            OpenSSL_version(OPENSSL_VERSION),
+            GetCpuShaExtensions());
+    }
+    else
+    {
+        Log_Info("Computing digests with the portable implementation.");
+    }
+}
+
+/**
+ * @brief Initializes a stream context with the selected implementation, falling back to the portable one.
+ * @param context The stream context to initialize.
+ * @param algorithm The hashing algorithm to use.
+ * @param suppressErrorLog A boolean indicates whether to log error message inside this function.
+ * @returns bool true on success.
+ */
+static bool InitStreamContext(ADUC_HashUtils_StreamContext* context, SHAversion algorithm, bool suppressErrorLog)
+{
+    memset(context, 0, sizeof(*context));
+    context->algorithm = algorithm;
+
+    const EVP_MD* messageDigest = GetEvpMessageDigest(algorithm);
+
+    if (s_digestBackend == ADUC_HashUtils_DigestBackend_OpenSSL && messageDigest != NULL)
+    {
+        EVP_MD_CTX* evpContext = EVP_MD_CTX_new();
+
+        if (evpContext != NULL && EVP_DigestInit_ex(evpContext, messageDigest, NULL) == 1)
+        {
+            context->evpContext = evpContext;
+            LogDigestBackend(true);
+            return true;
+        }
+
+        // e.g. the algorithm is not allowed by the OpenSSL configuration.
+        EVP_MD_CTX_free(evpContext);
+        Log_Warn("Cannot initialize OpenSSL digest, SHAversion: %d. Using the portable implementation.", algorithm);
+    }
+
+    if (USHAReset(&context->shaContext, algorithm) != 0)
+    {
+        if (!suppressErrorLog)
+        {
+            Log_Error("Error in SHA Reset, SHAversion: %d", algorithm);
+        }
+        return false;
+    }
+
+    LogDigestBackend(false);
+    return true;
+}
+
+/**
+ * @brief Computes the digest of the content hashed by @p context.
+ * @param context The stream context. It cannot be updated after this call.
+ * @param digest The buffer for the digest. It must be at least EVP_MAX_MD_SIZE bytes.
+ * @param digestLen [out] The length of the digest.
+ * @returns bool true on success.
+ */
+static bool FinalizeStreamContext(ADUC_HashUtils_StreamContext* context, uint8_t* digest, size_t* digestLen)
+{
+    if (context->evpContext != NULL)
+    {
+        unsigned int len = 0;
+
+        if (EVP_DigestFinal_ex((EVP_MD_CTX*)context->evpContext, digest, &len) != 1)
+        {
+            return false;
+        }
+
+        *digestLen = (size_t)len;
+        return true;
+    }
+
+    if (USHAResult(&context->shaContext, digest) != 0)
+    {
+        return false;
+    }
+
+    *digestLen = (size_t)USHAHashSize(context->algorithm);
+    return true;
+}
+
+#if defined(WIN32)
+
+/**
+ * @brief Hashes the content of the file at @p path.
+ * @param path The path of the file.
+ * @param context The stream context to update.
+ * @returns HashFileResult The outcome.
+ */
+static HashFileResult HashFileContent(const char* path, ADUC_HashUtils_StreamContext* context)
+{
+    HashFileResult result = HashFileResult_ReadError;
+    uint8_t* buffer = NULL;
+    size_t readSize = 0;
+
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return HashFileResult_CannotOpen;
+    }
+
+    buffer = malloc(HashFileReadBufferSize);
+    if (buffer == NULL)
+    {
+        goto done;
+    }
+
+    while ((readSize = fread(buffer, 1, HashFileReadBufferSize, file)) > 0)
+    {
+        if (!ADUC_HashUtils_StreamContext_Update(context, buffer, readSize))
+        {
+            goto done;
+        }
+    }
+
+    if (ferror(file) == 0)
+    {
+        result = HashFileResult_Success;
+    }
+
+done:
+    free(buffer);
+    fclose(file);
+    return result;
+}
+
+#else
+
+/**
+ * @brief Hashes the content of a file by reading it into a large aligned buffer.
+ * @param fd The file descriptor, positioned at the start of the file.
+ * @param fileSize The size of the file, or 0 if it is not known.
+ * @param dropCache Whether to drop the content from the page cache once it is hashed.
+ * @param context The stream context to update.
+ * @returns bool true if the content up to the end of the file was hashed.
+ */
+static bool HashFileByReading(int fd, uint64_t fileSize, bool dropCache, ADUC_HashUtils_StreamContext* context)
+{
+    bool success = false;
+    void* buffer = NULL;
+    uint64_t offset = 0;
+    uint64_t droppedOffset = 0;
+
+    // A buffer one page larger than a small file reads it, and detects its end, with two calls.
+    const size_t bufferSize = (fileSize < HashFileReadBufferSize) ? (size_t)(fileSize / 4096 + 1) * 4096
+                                                                  : HashFileReadBufferSize;
+
+    if (posix_memalign(&buffer, 4096, bufferSize) != 0)
+    {
+        buffer = NULL;
+        goto done;
+    }
+
+    (void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    for (;;)
+    {
+        const ssize_t readSize = read(fd, buffer, bufferSize);
+        if (readSize < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            goto done;
+        }
+
+        if (readSize == 0)
+        {
+            break;
+        }
+
+        if (!ADUC_HashUtils_StreamContext_Update(context, buffer, (size_t)readSize))
+        {
+            goto done;
+        }
+
+        offset += (uint64_t)readSize;
+
+        if (dropCache && offset - droppedOffset >= HashFileWindowSize)
+        {
+            (void)posix_fadvise(fd, (off_t)droppedOffset, (off_t)(offset - droppedOffset), POSIX_FADV_DONTNEED);
+            droppedOffset = offset;
+        }
+    }
+
+    if (dropCache)
+    {
+        (void)posix_fadvise(fd, (off_t)droppedOffset, 0 /* to the end */, POSIX_FADV_DONTNEED);
+    }
+
+    success = true;
+
+done:
+    free(buffer);
+    return success;
+}
+
+/**
+ * @brief Hashes the content of a regular file by mapping it into memory, one window at a time.
+ * @param fd The file descriptor.
+ * @param fileSize The size of the file.
+ * @param dropCache Whether to drop the content from the page cache once it is hashed.
+ * @param context The stream context to update.
+ * @param[out] cannotMap Set to true if the file cannot be mapped at all, in which case @p context is unchanged.
+ * @returns bool true if the content was hashed.
+ */
+static bool HashFileByMapping(
+    int fd, uint64_t fileSize, bool dropCache, ADUC_HashUtils_StreamContext* context, bool* cannotMap)
+{
+    *cannotMap = false;
+
+    for (uint64_t offset = 0; offset < fileSize; offset += HashFileWindowSize)
+    {
+        const size_t length =
+            (size_t)((fileSize - offset < HashFileWindowSize) ? fileSize - offset : HashFileWindowSize);
+
+        void* mapped = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, (off_t)offset);
+        if (mapped == MAP_FAILED)
+        {
+            *cannotMap = (offset == 0);
+            return false;
+        }
+
+        (void)madvise(mapped, length, MADV_SEQUENTIAL);
+
+        const bool updated = ADUC_HashUtils_StreamContext_Update(context, mapped, length);
+
+        (void)munmap(mapped, length);
+
+        if (!updated)
+        {
+            return false;
+        }
+
+        if (dropCache)
+        {
+            (void)posix_fadvise(fd, (off_t)offset, (off_t)length, POSIX_FADV_DONTNEED);
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Hashes the content of the file at @p path, reading it as selected by ADUC_HashUtils_SetFileReadMode.
+ * @param path The path of the file.
+ * @param context The stream context to update.
+ * @returns HashFileResult The outcome.
+ */
+static HashFileResult HashFileContent(const char* path, ADUC_HashUtils_StreamContext* context)
+{
+    HashFileResult result = HashFileResult_ReadError;
+    struct stat st;
+
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return HashFileResult_CannotOpen;
+    }
+
+    if (fstat(fd, &st) != 0)
+    {
+        goto done;
+    }
+
+    // Other kinds of files, e.g. pipes, can only be read, and their size is not known.
+    const bool isRegularFile = S_ISREG(st.st_mode);
+    const uint64_t fileSize = isRegularFile ? (uint64_t)st.st_size : 0;
+    const bool dropCache = (fileSize >= HashFileDropCacheMinFileSize);
+
+    ADUC_HashUtils_FileReadMode mode = s_fileReadMode;
+    if (mode == ADUC_HashUtils_FileReadMode_Auto)
+    {
+        mode = (fileSize >= HashFileMapMinFileSize) ? ADUC_HashUtils_FileReadMode_MemoryMapped
+                                                    : ADUC_HashUtils_FileReadMode_Buffered;
+    }
+
+    if (mode == ADUC_HashUtils_FileReadMode_MemoryMapped && isRegularFile)
+    {
+        bool cannotMap = false;
+
+        if (HashFileByMapping(fd, fileSize, dropCache, context, &cannotMap))
+        {
+            result = HashFileResult_Success;
+            goto done;
+        }
+
+        if (!cannotMap)
+        {
+            goto done;
+        }
+
+        Log_Debug("Cannot map %s, errno %d. Reading it instead.", path, errno);
+    }
+
+    if (HashFileByReading(fd, fileSize, dropCache, context))
+    {
+        result = HashFileResult_Success;
+    }
+
+done:
+    close(fd);
+    return result;
+}
+
+#endif // WIN32
 
 /**
  * @brief Helper function gets the calculated hash from the @p context, compares it to @p hashBase64, and returns the appropriate value
@@ -28,14 +485,19 @@
  * @returns bool True if the hash is valid and equals @p hashBase64
  */
 static bool GetResultAndCompareHashes(
-    USHAContext* context, const char* hashBase64, SHAversion algorithm, bool suppressErrorLog, char** outputHash)
+    ADUC_HashUtils_StreamContext* context,
+    const char* hashBase64,
+    SHAversion algorithm,
+    bool suppressErrorLog,
+    char** outputHash)
 {
     bool success = false;
-    // "USHAHashSize(algorithm)" is more precise, but requires a variable length array, or heap allocation.
-    uint8_t buffer_hash[USHAMaxHashSize];
+    // EVP_MAX_MD_SIZE is at least USHAMaxHashSize, and is large enough for every algorithm of both implementations.
+    uint8_t buffer_hash[EVP_MAX_MD_SIZE];
+    size_t hashLen = 0;
     STRING_HANDLE encoded_file_hash = NULL;
 
-    if (USHAResult(context, (uint8_t*)buffer_hash) != 0)
+    if (!FinalizeStreamContext(context, buffer_hash, &hashLen))
     {
         if (!suppressErrorLog)
         {
@@ -44,7 +506,7 @@ static bool GetResultAndCompareHashes(
         goto done;
     }
 
-    encoded_file_hash = Azure_Base64_Encode_Bytes((unsigned char*)buffer_hash, (size_t)USHAHashSize(algorithm));
+    encoded_file_hash = Azure_Base64_Encode_Bytes((unsigned char*)buffer_hash, hashLen);
     if (encoded_file_hash == NULL)
     {
         if (!suppressErrorLog)
@@ -93,7 +555,16 @@ bool ADUC_HashUtils_IsValidHashAlgorithm(SHAversion sha)
     return sha >= SHA256;
 }
 
-static bool ADUC_HashUtils_GetIndexStrongestValidHash(
+/**
+ * @brief Finds the hash with the strongest valid algorithm in the array.
+ *
+ * @param hashes The array of ADUC_Hash objects.
+ * @param hashCount The length of the array.
+ * @param[out] outIndexStrongestAlgorithm The index of the hash with the strongest algorithm.
+ * @param[out] outBestShaVersion The strongest algorithm.
+ * @return bool true if there is a hash with a valid algorithm, and all the algorithms are supported.
+ */
+bool ADUC_HashUtils_GetIndexStrongestValidHash(
     const ADUC_Hash* hashes, size_t hashCount, size_t* outIndexStrongestAlgorithm, SHAversion* outBestShaVersion)
 {
     if (outIndexStrongestAlgorithm == NULL || outBestShaVersion == NULL)
@@ -179,7 +650,7 @@ bool ADUC_HashUtils_VerifyWithStrongestHash(const char* filePath, const ADUC_Has
 bool ADUC_HashUtils_GetFileHash(const char* path, SHAversion algorithm, char** hash)
 {
     bool success = false;
-    FILE* file = NULL;
+    ADUC_HashUtils_StreamContext context = { 0 };
 
     if (hash == NULL)
     {
@@ -189,55 +660,32 @@ bool ADUC_HashUtils_GetFileHash(const char* path, SHAversion algorithm, char** h
 
     *hash = NULL;
 
-    file = fopen(path, "rb");
-    if (file == NULL)
+    if (!InitStreamContext(&context, algorithm, false /* suppressErrorLog */))
     {
-        // Sometime we call this function to check whether the file is already exist.
-        // So, log info here instead of error.
-        Log_Info("No such file or directory: %s", path);
         goto done;
     }
 
-    USHAContext context;
-
-    if (USHAReset(&context, algorithm) != 0)
+    switch (HashFileContent(path, &context))
     {
-        Log_Error("Error in SHA Reset, SHAversion: %d", algorithm);
-        goto done;
-    };
+    case HashFileResult_Success:
+        break;
 
-    // Repeatedly read and hash chunks of the file
-    while (!feof(file))
-    {
-        uint8_t buffer[USHA_Max_Message_Block_Size];
-        const size_t readSize = fread(buffer, sizeof(buffer[0]), ARRAY_SIZE(buffer), file);
-        if (readSize == 0)
-        {
-            if (ferror(file))
-            {
-                Log_Error("Error reading file content.");
-                goto done;
-            }
-
-            // At the end of file. We're done here.
-            break;
-        }
+    case HashFileResult_CannotOpen:
+        // Sometime we call this function to check whether the file is already exist.
+        // So, log info here instead of error.
+        Log_Info("No such file or directory: %s", path);
+        goto done;
 
-        if (USHAInput(&context, buffer, (unsigned int)readSize) != 0)
-        {
-            Log_Error("Error in SHA Input, SHAversion: %d", algorithm);
-            goto done;
-        };
+    default:
+        Log_Error("Error reading file content.");
+        goto done;
     }
 
     success = GetResultAndCompareHashes(&context, NULL, algorithm, true, hash);
 
 done:
 
-    if (file != NULL)
-    {
-        fclose(file);
-    }
+    ADUC_HashUtils_StreamContext_UnInit(&context);
 
     return success;
 }
@@ -293,56 +741,31 @@ bool ADUC_HashUtils_IsValidFileHash(
     const char* path, const char* hashBase64, SHAversion algorithm, bool suppressErrorLog)
 {
     bool success = false;
+    ADUC_HashUtils_StreamContext context = { 0 };
 
-    FILE* file = fopen(path, "rb");
-    if (file == NULL)
+    if (!InitStreamContext(&context, algorithm, suppressErrorLog))
     {
-        if (!suppressErrorLog)
-        {
-            Log_Error("Cannot open file: %s", path);
-        }
         goto done;
     }
 
-    USHAContext context;
-
-    if (USHAReset(&context, algorithm) != 0)
+    switch (HashFileContent(path, &context))
     {
+    case HashFileResult_Success:
+        break;
+
+    case HashFileResult_CannotOpen:
         if (!suppressErrorLog)
         {
-            Log_Error("Error in SHA Reset, SHAversion: %d", algorithm);
+            Log_Error("Cannot open file: %s", path);
         }
         goto done;
-    };
 
-    // Repeatedly read and hash chunks of the file
-    while (!feof(file))
-    {
-        uint8_t buffer[USHA_Max_Message_Block_Size];
-        const size_t readSize = fread(buffer, sizeof(buffer[0]), ARRAY_SIZE(buffer), file);
-        if (readSize == 0)
+    default:
+        if (!suppressErrorLog)
         {
-            if (ferror(file))
-            {
-                if (!suppressErrorLog)
-                {
-                    Log_Error("Error reading file content.");
-                }
-                goto done;
-            }
-
-            // At the end of file. We're done here.
-            break;
+            Log_Error("Error reading file content.");
         }
-
-        if (USHAInput(&context, buffer, (unsigned int)readSize) != 0)
-        {
-            if (!suppressErrorLog)
-            {
-                Log_Error("Error in SHA Input, SHAversion: %d", algorithm);
-            }
-            goto done;
-        };
+        goto done;
     }
 
     success = GetResultAndCompareHashes(&context, hashBase64, algorithm, suppressErrorLog, NULL /* outputHash */);
@@ -352,10 +775,7 @@ bool ADUC_HashUtils_IsValidFileHash(
     }
 
 done:
-    if (file != NULL)
-    {
-        fclose(file);
-    }
+    ADUC_HashUtils_StreamContext_UnInit(&context);
 
     return success;
 }
@@ -371,21 +791,25 @@ done:
 bool ADUC_HashUtils_IsValidBufferHash(
     const uint8_t* buffer, size_t bufferLen, const char* hashBase64, SHAversion algorithm)
 {
-    USHAContext context;
+    bool success = false;
+    ADUC_HashUtils_StreamContext context = { 0 };
 
-    if (USHAReset(&context, algorithm) != 0)
+    if (!InitStreamContext(&context, algorithm, false /* suppressErrorLog */))
     {
-        Log_Error("Error in SHA Reset, SHAversion: %d", algorithm);
-        return false;
+        goto done;
     }
 
-    if (USHAInput(&context, buffer, (unsigned int)bufferLen) != 0)
+    if (!ADUC_HashUtils_StreamContext_Update(&context, buffer, bufferLen))
     {
-        Log_Error("Error in SHA Input, SHAversion: %d", algorithm);
-        return false;
+        goto done;
     }
 
-    return GetResultAndCompareHashes(&context, hashBase64, algorithm, true, NULL);
+    success = GetResultAndCompareHashes(&context, hashBase64, algorithm, true, NULL);
+
+done:
+    ADUC_HashUtils_StreamContext_UnInit(&context);
+
+    return success;
 }
 
 /**
@@ -503,3 +927,346 @@ void ADUC_Hash_FreeArray(size_t hashCount, ADUC_Hash* hashArray)
         free(hashArray);
     }
 }
+
+/**
+ * @brief Selects the implementation used for the digests computed from now on.
+ *
+ * @param backend The implementation.
+ */
+void ADUC_HashUtils_SetDigestBackend(ADUC_HashUtils_DigestBackend backend)
+{
+    s_digestBackend = backend;
+}
+
+/**
+ * @brief Gets the implementation selected by ADUC_HashUtils_SetDigestBackend.
+ *
+ * @return ADUC_HashUtils_DigestBackend The implementation.
+ */
+ADUC_HashUtils_DigestBackend ADUC_HashUtils_GetDigestBackend(void)
+{
+    return s_digestBackend;
+}
+
+/**
+ * @brief Selects how file content is read to hash it.
+ *
+ * @param mode The read mode.
+ */
+void ADUC_HashUtils_SetFileReadMode(ADUC_HashUtils_FileReadMode mode)
+{
+    s_fileReadMode = mode;
+}
+
+/**
+ * @brief Gets the read mode selected by ADUC_HashUtils_SetFileReadMode.
+ *
+ * @return ADUC_HashUtils_FileReadMode The read mode.
+ */
+ADUC_HashUtils_FileReadMode ADUC_HashUtils_GetFileReadMode(void)
+{
+    return s_fileReadMode;
+}
+
+/**
+ * @brief Initializes a stream context for hashing content incrementally.
+ *
+ * @param context The stream context to initialize. It must not be initialized already.
+ * @param algorithm The hashing algorithm to use.
+ * @return bool true on success.
+ */
+bool ADUC_HashUtils_StreamContext_Init(ADUC_HashUtils_StreamContext* context, SHAversion algorithm)
+{
+    if (context == NULL)
+    {
+        return false;
+    }
+
+    return InitStreamContext(context, algorithm, false /* suppressErrorLog */);
+}
+
+/**
+ * @brief Discards the content hashed so far by an initialized stream context, so that it can hash new content.
+ *
+ * @param context The stream context.
+ * @return bool true on success.
+ */
+bool ADUC_HashUtils_StreamContext_Reset(ADUC_HashUtils_StreamContext* context)
+{
+    if (context == NULL)
+    {
+        return false;
+    }
+
+    context->bytesHashed = 0;
+
+    if (context->evpContext != NULL)
+    {
+        if (EVP_DigestInit_ex(
+                (EVP_MD_CTX*)context->evpContext, GetEvpMessageDigest(context->algorithm), NULL /* impl */)
+            != 1)
+        {
+            Log_Error("Error in OpenSSL digest reset, SHAversion: %d", context->algorithm);
+            return false;
+        }
+
+        return true;
+    }
+
+    if (USHAReset(&context->shaContext, context->algorithm) != 0)
+    {
+        Log_Error("Error in SHA Reset, SHAversion: %d", context->algorithm);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Releases the resources of a stream context.
+ *
+ * @param context The stream context.
+ */
+void ADUC_HashUtils_StreamContext_UnInit(ADUC_HashUtils_StreamContext* context)
+{
+    if (context == NULL)
+    {
+        return;
+    }
+
+    EVP_MD_CTX_free((EVP_MD_CTX*)context->evpContext);
+    context->evpContext = NULL;
+}
+
+/**
+ * @brief Feeds the next chunk of streamed content into the hash.
+ *
+ * @param context The stream context.
+ * @param data The content bytes.
+ * @param dataLen The number of bytes in @p data.
+ * @return bool true on success.
+ */
+bool ADUC_HashUtils_StreamContext_Update(ADUC_HashUtils_StreamContext* context, const uint8_t* data, size_t dataLen)
+{
+    if (context == NULL || (data == NULL && dataLen != 0))
+    {
+        return false;
+    }
+
+    if (context->evpContext != NULL)
+    {
+        if (EVP_DigestUpdate((EVP_MD_CTX*)context->evpContext, data, dataLen) != 1)
+        {
+            Log_Error("Error in OpenSSL digest update, SHAversion: %d", context->algorithm);
+            return false;
+        }
+
+        context->bytesHashed += dataLen;
+        return true;
+    }
+
+    // USHAInput takes an unsigned int length, so feed very large chunks in pieces.
+    size_t remaining = dataLen;
+    while (remaining > 0)
+    {
+        const unsigned int inputLen = (remaining > UINT_MAX) ? UINT_MAX : (unsigned int)remaining;
+        if (USHAInput(&context->shaContext, data, inputLen) != 0)
+        {
+            Log_Error("Error in SHA Input, SHAversion: %d", context->algorithm);
+            return false;
+        }
+
+        data += inputLen;
+        remaining -= inputLen;
+    }
+
+    context->bytesHashed += dataLen;
+    return true;
+}
+
+/**
+ * @brief Records the identity of the file at @p filePath into @p verifiedDigest.
+ *
+ * @param filePath The path to the file.
+ * @param verifiedDigest The verified digest whose file identity members will be set.
+ * @return bool true on success.
+ */
+static bool GetVerifiedDigestFileIdentity(const char* filePath, ADUC_VerifiedDigest* verifiedDigest)
+{
+    struct stat st;
+
+    if (stat(filePath, &st) != 0)
+    {
+        return false;
+    }
+
+    verifiedDigest->fileSize = (uint64_t)st.st_size;
+    verifiedDigest->fileDevice = (uint64_t)st.st_dev;
+    verifiedDigest->fileInode = (uint64_t)st.st_ino;
+    verifiedDigest->fileModifiedTimeSec = (int64_t)st.st_mtime;
+#if defined(WIN32)
+    verifiedDigest->fileModifiedTimeNsec = 0;
+#else
+    verifiedDigest->fileModifiedTimeNsec = (int64_t)st.st_mtim.tv_nsec;
+#endif
+
+    return true;
+}
+
+/**
+ * @brief Finishes hashing the streamed content and produces a verified digest token for the file it was written to.
+ *
+ * @param context The stream context. It cannot be updated after this call.
+ * @param hashBase64 The expected hash of the streamed content.
+ * @param filePath The path of the file the streamed content was written to.
+ * @param[out] verifiedDigest The verified digest token.
+ * @return bool true if the content hash matches @p hashBase64 and the token was populated.
+ */
+bool ADUC_HashUtils_StreamContext_FinalizeToVerifiedDigest(
+    ADUC_HashUtils_StreamContext* context,
+    const char* hashBase64,
+    const char* filePath,
+    ADUC_VerifiedDigest* verifiedDigest)
+{
+    bool success = false;
+    char* computedHash = NULL;
+
+    if (context == NULL || hashBase64 == NULL || filePath == NULL || verifiedDigest == NULL)
+    {
+        Log_Error("Invalid argument(s).");
+        goto done;
+    }
+
+    memset(verifiedDigest, 0, sizeof(*verifiedDigest));
+
+    if (!GetResultAndCompareHashes(
+            context, hashBase64, context->algorithm, false /* suppressErrorLog */, &computedHash))
+    {
+        goto done;
+    }
+
+    if (strlen(computedHash) > ADUC_VERIFIED_DIGEST_MAX_HASH_BASE64_LEN)
+    {
+        Log_Error("Digest too long for verified digest token, SHAversion: %d", context->algorithm);
+        goto done;
+    }
+
+    if (!GetVerifiedDigestFileIdentity(filePath, verifiedDigest))
+    {
+        Log_Error("Cannot stat %s", filePath);
+        goto done;
+    }
+
+    if (verifiedDigest->fileSize != context->bytesHashed)
+    {
+        Log_Error(
+            "Size of %s (%llu) differs from hashed content size (%llu)",
+            filePath,
+            (unsigned long long)verifiedDigest->fileSize,
+            (unsigned long long)context->bytesHashed);
+        goto done;
+    }
+
+    verifiedDigest->algorithm = (int32_t)context->algorithm;
+    ADUC_Safe_StrCopyN(
+        verifiedDigest->hashBase64, computedHash, sizeof(verifiedDigest->hashBase64), strlen(computedHash));
+
+    success = true;
+
+done:
+    if (!success && verifiedDigest != NULL)
+    {
+        memset(verifiedDigest, 0, sizeof(*verifiedDigest));
+    }
+
+    free(computedHash);
+    return success;
+}
+
+/**
+ * @brief Hashes the file at @p filePath and produces a verified digest token for it, if it matches @p hashBase64.
+ *
+ * @param filePath The path to the file.
+ * @param hashBase64 The expected hash of the file.
+ * @param algorithm The algorithm of the expected hash.
+ * @param[out] verifiedDigest The verified digest token.
+ * @return bool true if the file hash matches @p hashBase64 and the token was populated.
+ */
+bool ADUC_HashUtils_GetFileVerifiedDigest(
+    const char* filePath, const char* hashBase64, SHAversion algorithm, ADUC_VerifiedDigest* verifiedDigest)
+{
+    bool success = false;
+    ADUC_HashUtils_StreamContext context = { 0 };
+
+    if (filePath == NULL || hashBase64 == NULL || verifiedDigest == NULL)
+    {
+        Log_Error("Invalid argument(s).");
+        goto done;
+    }
+
+    memset(verifiedDigest, 0, sizeof(*verifiedDigest));
+
+    if (!InitStreamContext(&context, algorithm, false /* suppressErrorLog */))
+    {
+        goto done;
+    }
+
+    if (HashFileContent(filePath, &context) != HashFileResult_Success)
+    {
+        Log_Error("Error reading file content of %s", filePath);
+        goto done;
+    }
+
+    success = ADUC_HashUtils_StreamContext_FinalizeToVerifiedDigest(&context, hashBase64, filePath, verifiedDigest);
+
+done:
+    ADUC_HashUtils_StreamContext_UnInit(&context);
+
+    return success;
+}
+
+/**
+ * @brief Checks whether the verified digest token still describes the file at @p filePath.
+ *
+ * @param verifiedDigest The verified digest token.
+ * @param filePath The path to the file.
+ * @return bool true if the token is populated and the file identity, size and modification time are unchanged.
+ */
+bool ADUC_HashUtils_IsVerifiedDigestCurrent(const ADUC_VerifiedDigest* verifiedDigest, const char* filePath)
+{
+    ADUC_VerifiedDigest current;
+
+    if (verifiedDigest == NULL || filePath == NULL || verifiedDigest->hashBase64[0] == '\0')
+    {
+        return false;
+    }
+
+    if (!GetVerifiedDigestFileIdentity(filePath, &current))
+    {
+        return false;
+    }
+
+    return current.fileSize == verifiedDigest->fileSize && current.fileDevice == verifiedDigest->fileDevice
+        && current.fileInode == verifiedDigest->fileInode
+        && current.fileModifiedTimeSec == verifiedDigest->fileModifiedTimeSec
+        && current.fileModifiedTimeNsec == verifiedDigest->fileModifiedTimeNsec;
+}
+
+/**
+ * @brief Checks whether the verified digest token matches the expected hash.
+ *
+ * @param verifiedDigest The verified digest token.
+ * @param hashBase64 The expected hash.
+ * @param algorithm The algorithm of the expected hash.
+ * @return bool true if the token is populated with a digest of @p algorithm that equals @p hashBase64.
+ */
+bool ADUC_HashUtils_IsVerifiedDigestMatch(
+    const ADUC_VerifiedDigest* verifiedDigest, const char* hashBase64, SHAversion algorithm)
+{
+    if (verifiedDigest == NULL || hashBase64 == NULL || verifiedDigest->hashBase64[0] == '\0')
+    {
+        return false;
+    }
+
+    return verifiedDigest->algorithm == (int32_t)algorithm && strcmp(verifiedDigest->hashBase64, hashBase64) == 0;
+}
@@ -0,0 +1,327 @@
+/**
+ * @file hash_utils_benchmark.cpp
+ * @brief Compares the throughput of the digest implementations and file read modes of the hash_utils library.
+ *
+ * @details Hidden from the default run, as it writes and hashes a 1 GB file. Run it with:
+ *   hash_utils_unit_test "[benchmark]"
+ *
+ * The digest implementations are compared with the files in the page cache, so the results show the digest
+ * throughput rather than the storage throughput. The read modes are compared both with the files in the page cache
+ * (warm) and with the files dropped from it (cold), along with how much of the file remains in the page cache.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include <aduc/hash_utils.h>
+
+#include "aduc/system_utils.h" // ADUC_SystemUtils_MkTemp
+
+#include <catch2/catch_all.hpp>
+
+#include <aduc/calloc_wrapper.hpp>
+#include <algorithm> // std::min
+#include <chrono>
+#include <cstdio> // std::remove, printf
+#include <fcntl.h> // open, posix_fadvise
+#include <fstream>
+#include <functional>
+#include <string>
+#include <sys/mman.h> // mmap, mincore
+#include <unistd.h> // close, fdatasync
+#include <vector>
+
+namespace
+{
+/**
+ * @brief A file of pseudo-random content, removed on destruction.
+ */
+class BenchmarkFile
+{
+public:
+    BenchmarkFile(const BenchmarkFile&) = delete;
+    BenchmarkFile& operator=(const BenchmarkFile&) = delete;
+    BenchmarkFile(BenchmarkFile&&) = delete;
+    BenchmarkFile& operator=(BenchmarkFile&&) = delete;
+
+    explicit BenchmarkFile(size_t sizeInBytes) : _sizeInBytes{ sizeInBytes }
+    {
+        ADUC_SystemUtils_MkTemp(_filePath);
+
+        std::vector<char> chunk(1024 * 1024);
+        uint64_t state = 0x9E3779B97F4A7C15ULL;
+        std::ofstream file{ _filePath, std::ios::trunc | std::ios::binary };
+
+        for (size_t written = 0; written < sizeInBytes; written += chunk.size())
+        {
+            // xorshift64, so the content does not compress or deduplicate.
+            for (char& c : chunk)
+            {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                c = static_cast<char>(state);
+            }
+            file.write(chunk.data(), static_cast<std::streamsize>(std::min(chunk.size(), sizeInBytes - written)));
+        }
+
+        REQUIRE(file.good());
+    }
+
+    ~BenchmarkFile()
+    {
+        std::remove(_filePath);
+    }
+
+    const char* Filename() const
+    {
+        return _filePath;
+    }
+
+    size_t GetSizeInBytes() const
+    {
+        return _sizeInBytes;
+    }
+
+    /**
+     * @brief Brings the whole file into the page cache.
+     */
+    void Warm() const
+    {
+        std::vector<char> buffer(1024 * 1024);
+        std::ifstream file{ _filePath, std::ios::binary };
+        while (file.read(buffer.data(), static_cast<std::streamsize>(buffer.size())))
+        {
+        }
+    }
+
+    /**
+     * @brief Drops the file from the page cache.
+     */
+    void Drop() const
+    {
+        const int fd = open(_filePath, O_RDONLY);
+        REQUIRE(fd >= 0);
+        (void)fdatasync(fd);
+        (void)posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+
+    /**
+     * @brief Gets the share of the file that is in the page cache.
+     *
+     * @return double The share, in percent.
+     */
+    double GetResidentPercent() const
+    {
+        const int fd = open(_filePath, O_RDONLY);
+        REQUIRE(fd >= 0);
+
+        void* mapped = mmap(nullptr, _sizeInBytes, PROT_READ, MAP_SHARED, fd, 0);
+        REQUIRE(mapped != MAP_FAILED);
+
+        const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        std::vector<unsigned char> pages((_sizeInBytes + pageSize - 1) / pageSize);
+        REQUIRE(mincore(mapped, _sizeInBytes, pages.data()) == 0);
+
+        munmap(mapped, _sizeInBytes);
+        close(fd);
+
+        const auto resident = std::count_if(pages.begin(), pages.end(), [](unsigned char p) { return (p & 1) != 0; });
+        return 100.0 * static_cast<double>(resident) / static_cast<double>(pages.size());
+    }
+
+private:
+    char _filePath[ARRAY_SIZE("/tmp/tmpfileXXXXXX")] = "/tmp/tmpfileXXXXXX";
+    size_t _sizeInBytes;
+};
+
+const char* GetBackendName(ADUC_HashUtils_DigestBackend backend)
+{
+    return backend == ADUC_HashUtils_DigestBackend_OpenSSL ? "OpenSSL EVP" : "portable";
+}
+
+const char* GetReadModeName(ADUC_HashUtils_FileReadMode mode)
+{
+    switch (mode)
+    {
+    case ADUC_HashUtils_FileReadMode_Buffered:
+        return "buffered";
+    case ADUC_HashUtils_FileReadMode_MemoryMapped:
+        return "mmap";
+    default:
+        return "auto";
+    }
+}
+
+/**
+ * @brief Hashes @p file the way hash_utils did before it had read modes: fread into a 128 byte buffer.
+ *
+ * @return bool true if the hash matches @p hashBase64.
+ */
+bool ValidateWithSmallReads(const BenchmarkFile& file, SHAversion algorithm, const char* hashBase64)
+{
+    ADUC_HashUtils_StreamContext context = {};
+    REQUIRE(ADUC_HashUtils_StreamContext_Init(&context, algorithm));
+
+    FILE* stream = fopen(file.Filename(), "rb");
+    REQUIRE(stream != nullptr);
+
+    uint8_t buffer[128];
+    size_t readSize = 0;
+    while ((readSize = fread(buffer, 1, sizeof(buffer), stream)) > 0)
+    {
+        REQUIRE(ADUC_HashUtils_StreamContext_Update(&context, buffer, readSize));
+    }
+    fclose(stream);
+
+    ADUC_VerifiedDigest verifiedDigest{};
+    const bool valid =
+        ADUC_HashUtils_StreamContext_FinalizeToVerifiedDigest(&context, hashBase64, file.Filename(), &verifiedDigest);
+    ADUC_HashUtils_StreamContext_UnInit(&context);
+    return valid;
+}
+
+/**
+ * @brief Runs @p validate @p iterations times, calling @p prepare before each run.
+ *
+ * @return double The best throughput, in MB/s.
+ */
+double MeasureThroughput(
+    const BenchmarkFile& file,
+    int iterations,
+    const std::function<void()>& prepare,
+    const std::function<bool()>& validate)
+{
+    using Clock = std::chrono::steady_clock;
+    double bestSeconds = 0;
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        prepare();
+
+        const Clock::time_point start = Clock::now();
+        REQUIRE(validate());
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        if (i == 0 || seconds < bestSeconds)
+        {
+            bestSeconds = seconds;
+        }
+    }
+
+    return (static_cast<double>(file.GetSizeInBytes()) / (1024.0 * 1024.0)) / bestSeconds;
+}
+
+struct FileSize
+{
+    const char* name;
+    size_t sizeInBytes;
+    int iterations;
+};
+
+} // namespace
+
+TEST_CASE("ADUC_HashUtils digest backend throughput", "[.hide][benchmark]")
+{
+    // clang-format off
+    const FileSize fileSize = GENERATE( // NOLINT(google-build-using-namespace)
+        FileSize{ "1 MB", 1024ULL * 1024, 20 },
+        FileSize{ "100 MB", 100ULL * 1024 * 1024, 3 },
+        FileSize{ "1 GB", 1024ULL * 1024 * 1024, 1 });
+
+    const SHAversion algorithm = GENERATE( // NOLINT(google-build-using-namespace)
+        SHAversion::SHA256,
+        SHAversion::SHA512);
+    // clang-format on
+
+    const ADUC_HashUtils_DigestBackend previousBackend = ADUC_HashUtils_GetDigestBackend();
+    BenchmarkFile file{ fileSize.sizeInBytes };
+
+    ADUC_HashUtils_SetDigestBackend(ADUC_HashUtils_DigestBackend_Portable);
+    ADUC::StringUtils::cstr_wrapper expectedHash;
+    REQUIRE(ADUC_HashUtils_GetFileHash(file.Filename(), algorithm, expectedHash.address_of()));
+
+    for (const ADUC_HashUtils_DigestBackend backend :
+         { ADUC_HashUtils_DigestBackend_Portable, ADUC_HashUtils_DigestBackend_OpenSSL })
+    {
+        ADUC_HashUtils_SetDigestBackend(backend);
+
+        const double throughput = MeasureThroughput(
+            file, fileSize.iterations, [&file]() { file.Warm(); }, [&]() {
+                return ADUC_HashUtils_IsValidFileHash(file.Filename(), expectedHash.get(), algorithm, false);
+            });
+
+        printf(
+            "%-6s SHA%-3s %-11s %9.1f MB/s\n",
+            fileSize.name,
+            algorithm == SHAversion::SHA256 ? "256" : "512",
+            GetBackendName(backend),
+            throughput);
+    }
+
+    ADUC_HashUtils_SetDigestBackend(previousBackend);
+}
+
+TEST_CASE("ADUC_HashUtils file read mode throughput", "[.hide][benchmark]")
+{
+    // clang-format off
+    const FileSize fileSize = GENERATE( // NOLINT(google-build-using-namespace)
+        FileSize{ "1 MB", 1024ULL * 1024, 20 },
+        FileSize{ "100 MB", 100ULL * 1024 * 1024, 3 },
+        FileSize{ "1 GB", 1024ULL * 1024 * 1024, 2 });
+    // clang-format on
+
+    const SHAversion algorithm = SHAversion::SHA256;
+    const ADUC_HashUtils_FileReadMode previousMode = ADUC_HashUtils_GetFileReadMode();
+    BenchmarkFile file{ fileSize.sizeInBytes };
+
+    ADUC::StringUtils::cstr_wrapper expectedHash;
+    REQUIRE(ADUC_HashUtils_GetFileHash(file.Filename(), algorithm, expectedHash.address_of()));
+
+    for (const bool cold : { false, true })
+    {
+        const std::function<void()> prepare = [&file, cold]() {
+            if (cold)
+            {
+                file.Drop();
+            }
+            else
+            {
+                file.Warm();
+            }
+        };
+
+        const double baseline = MeasureThroughput(file, fileSize.iterations, prepare, [&]() {
+            return ValidateWithSmallReads(file, algorithm, expectedHash.get());
+        });
+
+        printf(
+            "%-6s %-4s %-14s %9.1f MB/s, %5.1f%% left in page cache\n",
+            fileSize.name,
+            cold ? "cold" : "warm",
+            "fread 128 B",
+            baseline,
+            file.GetResidentPercent());
+
+        for (const ADUC_HashUtils_FileReadMode mode : { ADUC_HashUtils_FileReadMode_Auto,
+                                                        ADUC_HashUtils_FileReadMode_Buffered,
+                                                        ADUC_HashUtils_FileReadMode_MemoryMapped })
+        {
+            ADUC_HashUtils_SetFileReadMode(mode);
+
+            const double throughput = MeasureThroughput(file, fileSize.iterations, prepare, [&]() {
+                return ADUC_HashUtils_IsValidFileHash(file.Filename(), expectedHash.get(), algorithm, false);
+            });
+
+            printf(
+                "%-6s %-4s %-14s %9.1f MB/s, %5.1f%% left in page cache\n",
+                fileSize.name,
+                cold ? "cold" : "warm",
+                GetReadModeName(mode),
+                throughput,
+                file.GetResidentPercent());
+        }
+    }
+
+    ADUC_HashUtils_SetFileReadMode(previousMode);
+}
@@ -13,6 +13,7 @@
 using Catch::Matchers::Equals;
 
 #include <aduc/calloc_wrapper.hpp>
+#include <algorithm> // std::min
 #include <array>
 #include <fstream>
 #include <unordered_map>
@@ -306,3 +307,196 @@ TEST_CASE("ADUC_HashUtils_GetFileHash - LargeFile")
         CHECK_THAT(hash.get(), Equals(testFile.GetDataHashBase64(version)));
     }
 }
+
+TEST_CASE("ADUC_HashUtils_StreamContext - LargeFile")
+{
+    LargeFile testFile;
+
+    // clang-format off
+    auto version = GENERATE( // NOLINT(google-build-using-namespace)
+        SHAversion::SHA256,
+        SHAversion::SHA384,
+        SHAversion::SHA512);
+    // clang-format on
+
+    // Feed the content in uneven chunks, as a download would.
+    ADUC_HashUtils_StreamContext context = {};
+    REQUIRE(ADUC_HashUtils_StreamContext_Init(&context, version));
+
+    const size_t chunkSize = 4093;
+    for (size_t offset = 0; offset < testFile.GetDataByteLen(); offset += chunkSize)
+    {
+        const size_t len = std::min(chunkSize, testFile.GetDataByteLen() - offset);
+        REQUIRE(ADUC_HashUtils_StreamContext_Update(&context, testFile.GetData() + offset, len));
+    }
+
+    SECTION("Verify streamed hash produces a current verified digest")
+    {
+        INFO("SHAversion: " << version);
+        ADUC_VerifiedDigest verifiedDigest{};
+        REQUIRE(ADUC_HashUtils_StreamContext_FinalizeToVerifiedDigest(
+            &context, testFile.GetDataHashBase64(version), testFile.Filename(), &verifiedDigest));
+        CHECK_THAT(verifiedDigest.hashBase64, Equals(testFile.GetDataHashBase64(version)));
+        CHECK(verifiedDigest.fileSize == testFile.GetDataByteLen());
+        CHECK(ADUC_HashUtils_IsVerifiedDigestCurrent(&verifiedDigest, testFile.Filename()));
+        CHECK(ADUC_HashUtils_IsVerifiedDigestMatch(&verifiedDigest, testFile.GetDataHashBase64(version), version));
+        CHECK_FALSE(ADUC_HashUtils_IsVerifiedDigestMatch(
+            &verifiedDigest, "xxXXXgW/Nr695oSEGijw/UPGmFCj3OX+26aZKO46iZE=", version));
+
+        // Appending to the file makes the token stale.
+        {
+            std::ofstream file{ testFile.Filename(), std::ios::app | std::ios::binary };
+            file << "x";
+        }
+        CHECK_FALSE(ADUC_HashUtils_IsVerifiedDigestCurrent(&verifiedDigest, testFile.Filename()));
+    }
+
+    SECTION("Verify bad streamed hash does not produce a verified digest")
+    {
+        INFO("SHAversion: " << version);
+        ADUC_VerifiedDigest verifiedDigest{};
+        REQUIRE_FALSE(ADUC_HashUtils_StreamContext_FinalizeToVerifiedDigest(
+            &context, "xxXXXgW/Nr695oSEGijw/UPGmFCj3OX+26aZKO46iZE=", testFile.Filename(), &verifiedDigest));
+        CHECK_FALSE(ADUC_HashUtils_IsVerifiedDigestCurrent(&verifiedDigest, testFile.Filename()));
+    }
+
+    ADUC_HashUtils_StreamContext_UnInit(&context);
+}
+
+TEST_CASE("ADUC_HashUtils_GetFileVerifiedDigest - LargeFile")
+{
+    LargeFile testFile;
+
+    // clang-format off
+    auto version = GENERATE( // NOLINT(google-build-using-namespace)
+        SHAversion::SHA256,
+        SHAversion::SHA384,
+        SHAversion::SHA512);
+    // clang-format on
+
+    INFO("SHAversion: " << version);
+    ADUC_VerifiedDigest verifiedDigest{};
+
+    SECTION("Verify good file hash produces a current verified digest")
+    {
+        REQUIRE(ADUC_HashUtils_GetFileVerifiedDigest(
+            testFile.Filename(), testFile.GetDataHashBase64(version), version, &verifiedDigest));
+        CHECK(ADUC_HashUtils_IsVerifiedDigestCurrent(&verifiedDigest, testFile.Filename()));
+        CHECK(ADUC_HashUtils_IsVerifiedDigestMatch(&verifiedDigest, testFile.GetDataHashBase64(version), version));
+    }
+
+    SECTION("Verify bad file hash does not produce a verified digest")
+    {
+        REQUIRE_FALSE(ADUC_HashUtils_GetFileVerifiedDigest(
+            testFile.Filename(), "xxXXXgW/Nr695oSEGijw/UPGmFCj3OX+26aZKO46iZE=", version, &verifiedDigest));
+        CHECK_FALSE(ADUC_HashUtils_IsVerifiedDigestCurrent(&verifiedDigest, testFile.Filename()));
+    }
+}
+
+TEST_CASE("ADUC_HashUtils_StreamContext_Reset")
+{
+    SmallFile testFile;
+
+    ADUC_HashUtils_StreamContext context = {};
+    REQUIRE(ADUC_HashUtils_StreamContext_Init(&context, SHAversion::SHA256));
+
+    // Content hashed before the reset must not contribute to the digest.
+    const uint8_t discarded[] = { 'x', 'y', 'z' };
+    REQUIRE(ADUC_HashUtils_StreamContext_Update(&context, discarded, sizeof(discarded)));
+    REQUIRE(ADUC_HashUtils_StreamContext_Reset(&context));
+    CHECK(context.bytesHashed == 0);
+
+    REQUIRE(ADUC_HashUtils_StreamContext_Update(&context, testFile.GetData(), testFile.GetDataByteLen()));
+
+    ADUC_VerifiedDigest verifiedDigest{};
+    CHECK(ADUC_HashUtils_StreamContext_FinalizeToVerifiedDigest(
+        &context, testFile.GetDataHashBase64(SHAversion::SHA256), testFile.Filename(), &verifiedDigest));
+
+    ADUC_HashUtils_StreamContext_UnInit(&context);
+    ADUC_HashUtils_StreamContext_UnInit(&context);
+}
+
+TEST_CASE("ADUC_HashUtils digest backends")
+{
+    LargeFile testFile;
+
+    // clang-format off
+    auto backend = GENERATE( // NOLINT(google-build-using-namespace)
+        ADUC_HashUtils_DigestBackend_OpenSSL,
+        ADUC_HashUtils_DigestBackend_Portable);
+
+    auto version = GENERATE( // NOLINT(google-build-using-namespace)
+        SHAversion::SHA1,
+        SHAversion::SHA224,
+        SHAversion::SHA256,
+        SHAversion::SHA384,
+        SHAversion::SHA512);
+    // clang-format on
+
+    INFO("backend: " << backend << ", SHAversion: " << version);
+
+    const ADUC_HashUtils_DigestBackend previousBackend = ADUC_HashUtils_GetDigestBackend();
+    ADUC_HashUtils_SetDigestBackend(backend);
+
+    ADUC_HashUtils_StreamContext context = {};
+    REQUIRE(ADUC_HashUtils_StreamContext_Init(&context, version));
+    CHECK((context.evpContext != nullptr) == (backend == ADUC_HashUtils_DigestBackend_OpenSSL));
+    ADUC_HashUtils_StreamContext_UnInit(&context);
+
+    ADUC::StringUtils::cstr_wrapper hash;
+    CHECK(ADUC_HashUtils_GetFileHash(testFile.Filename(), version, hash.address_of()));
+    CHECK_THAT(hash.get(), Equals(testFile.GetDataHashBase64(version)));
+    CHECK(ADUC_HashUtils_IsValidFileHash(testFile.Filename(), testFile.GetDataHashBase64(version), version, true));
+    CHECK(ADUC_HashUtils_IsValidBufferHash(
+        testFile.GetData(), testFile.GetDataByteLen(), testFile.GetDataHashBase64(version), version));
+
+    ADUC_HashUtils_SetDigestBackend(previousBackend);
+}
+
+TEST_CASE("ADUC_HashUtils file read modes")
+{
+    LargeFile testFile;
+
+    // clang-format off
+    auto mode = GENERATE( // NOLINT(google-build-using-namespace)
+        ADUC_HashUtils_FileReadMode_Auto,
+        ADUC_HashUtils_FileReadMode_Buffered,
+        ADUC_HashUtils_FileReadMode_MemoryMapped);
+    // clang-format on
+
+    INFO("mode: " << mode);
+
+    const ADUC_HashUtils_FileReadMode previousMode = ADUC_HashUtils_GetFileReadMode();
+    ADUC_HashUtils_SetFileReadMode(mode);
+
+    ADUC::StringUtils::cstr_wrapper hash;
+    CHECK(ADUC_HashUtils_GetFileHash(testFile.Filename(), SHAversion::SHA256, hash.address_of()));
+    CHECK_THAT(hash.get(), Equals(testFile.GetDataHashBase64(SHAversion::SHA256)));
+    CHECK(ADUC_HashUtils_IsValidFileHash(
+        testFile.Filename(), testFile.GetDataHashBase64(SHAversion::SHA256), SHAversion::SHA256, true));
+
+    SECTION("Empty file")
+    {
+        char emptyFilePath[] = "/tmp/tmpfileXXXXXX";
+        ADUC_SystemUtils_MkTemp(emptyFilePath);
+        {
+            std::ofstream file{ emptyFilePath, std::ios::trunc | std::ios::binary };
+        }
+
+        // The SHA-256 of no content.
+        CHECK(ADUC_HashUtils_IsValidFileHash(
+            emptyFilePath, "47DEQpj8HBSa+/TImW+5JCeuQeRkm5NMpJWZG3hSuFU=", SHAversion::SHA256, true));
+        REQUIRE(std::remove(emptyFilePath) == 0);
+    }
+
+    SECTION("Missing file")
+    {
+        CHECK_FALSE(ADUC_HashUtils_IsValidFileHash(
+            "/tmp/missing-file-for-hash-utils",
+            testFile.GetDataHashBase64(SHAversion::SHA256),
+            SHAversion::SHA256,
+            true));
+    }
+
+    ADUC_HashUtils_SetFileReadMode(previousMode);
+}
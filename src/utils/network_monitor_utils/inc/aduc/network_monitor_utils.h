@@ -0,0 +1,71 @@
+/**
+ * @file network_monitor_utils.h
+ * @brief Notifies the agent when the network comes back, so that it can reconnect without waiting for a retry delay.
+ *
+ * @details On Linux, a background thread listens to the kernel's rtnetlink link and route notifications, and calls
+ * back when a network interface comes up or a default route is added. Elsewhere, the monitor cannot be started.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef ADUC_NETWORK_MONITOR_UTILS_H
+#define ADUC_NETWORK_MONITOR_UTILS_H
+
+#include "aduc/c_utils.h"
+
+#include <stdbool.h> // for bool
+#include <stddef.h> // for size_t
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief The network changes reported to the callback, as bit flags.
+ */
+typedef enum tagADUC_NetworkChange
+{
+    ADUC_NetworkChange_None = 0,
+    ADUC_NetworkChange_LinkUp = 1, /**< A network interface, other than loopback, came up and is running. */
+    ADUC_NetworkChange_DefaultRouteAdded = 2, /**< An IPv4 or IPv6 default route was added. */
+} ADUC_NetworkChange;
+
+/**
+ * @brief A callback to be called when the network changes.
+ *
+ * @param changes The ADUC_NetworkChange flags of the changes.
+ * @param context The context passed to ADUC_NetworkMonitor_Start.
+ * @remark Called on the monitor's thread, so it must only do thread-safe work, such as waking the main loop.
+ */
+typedef void (*ADUC_NETWORK_CHANGE_CALLBACK)(unsigned int changes, void* context);
+
+/**
+ * @brief Starts monitoring the network changes.
+ *
+ * @param callback The callback to be called when the network changes.
+ * @param context The context passed to @p callback.
+ * @return bool true on success, or if the monitor is already started. false if the platform does not support it, or
+ * the monitor cannot be started.
+ */
+bool ADUC_NetworkMonitor_Start(ADUC_NETWORK_CHANGE_CALLBACK callback, void* context);
+
+/**
+ * @brief Stops monitoring the network changes. Once it returns, the callback is no longer called.
+ */
+void ADUC_NetworkMonitor_Stop();
+
+/**
+ * @brief Tells whether the monitor is started.
+ */
+bool ADUC_NetworkMonitor_IsStarted();
+
+/**
+ * @brief Gets the network changes that a buffer of rtnetlink messages, as read from the monitor's socket, reports.
+ *
+ * @param buffer The messages.
+ * @param size The size of @p buffer, in bytes.
+ * @return unsigned int The ADUC_NetworkChange flags of the changes.
+ */
+unsigned int ADUC_NetworkMonitor_ParseMessages(const void* buffer, size_t size);
+
+EXTERN_C_END
+
+#endif // ADUC_NETWORK_MONITOR_UTILS_H
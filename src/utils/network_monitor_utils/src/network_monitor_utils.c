@@ -0,0 +1,374 @@
+/**
+ * @file network_monitor_utils.c
+ * @brief Implements the network change monitor, on the kernel's rtnetlink notifications.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/network_monitor_utils.h"
+
+#include <aduc/logging.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h> // uint64_t
+
+#if defined(__linux__)
+#    include <linux/netlink.h>
+#    include <linux/rtnetlink.h>
+#    include <net/if.h> // IFF_*
+#    include <poll.h>
+#    include <sys/eventfd.h>
+#    include <sys/socket.h>
+#    include <unistd.h> // close, read, write
+#endif
+
+/**
+ * @brief The size of the buffer the notifications are read into. The kernel sends at most a page per read.
+ */
+#define NETLINK_READ_BUFFER_SIZE 8192
+
+/**
+ * @brief Protects the state of the monitor below, against concurrent starts and stops.
+ */
+static pthread_mutex_t s_monitorMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Whether the monitor thread is running.
+ */
+static bool s_isStarted = false;
+
+static ADUC_NETWORK_CHANGE_CALLBACK s_callback = NULL;
+static void* s_callbackContext = NULL;
+
+#if defined(__linux__)
+static pthread_t s_monitorThread;
+static int s_netlinkFd = -1;
+static int s_stopEventFd = -1;
+
+/**
+ * @brief Gets the change that a link notification reports.
+ */
+static unsigned int ParseLinkMessage(const struct nlmsghdr* header)
+{
+    const struct ifinfomsg* info = (const struct ifinfomsg*)NLMSG_DATA(header);
+    const unsigned int runningFlags = IFF_UP | IFF_RUNNING;
+
+    if (header->nlmsg_len < NLMSG_LENGTH(sizeof(*info)))
+    {
+        return ADUC_NetworkChange_None;
+    }
+
+    if ((info->ifi_flags & IFF_LOOPBACK) != 0 || (info->ifi_flags & runningFlags) != runningFlags)
+    {
+        return ADUC_NetworkChange_None;
+    }
+
+    return ADUC_NetworkChange_LinkUp;
+}
+
+/**
+ * @brief Gets the change that a route notification reports.
+ */
+static unsigned int ParseRouteMessage(const struct nlmsghdr* header)
+{
+    const struct rtmsg* route = (const struct rtmsg*)NLMSG_DATA(header);
+
+    if (header->nlmsg_len < NLMSG_LENGTH(sizeof(*route)))
+    {
+        return ADUC_NetworkChange_None;
+    }
+
+    // A default route has no destination prefix. Local, broadcast and unreachable routes do not lead anywhere.
+    if (route->rtm_dst_len != 0 || route->rtm_type != RTN_UNICAST
+        || (route->rtm_family != AF_INET && route->rtm_family != AF_INET6))
+    {
+        return ADUC_NetworkChange_None;
+    }
+
+    return ADUC_NetworkChange_DefaultRouteAdded;
+}
+#endif
+
+unsigned int ADUC_NetworkMonitor_ParseMessages(const void* buffer, size_t size)
+{
+    unsigned int changes = ADUC_NetworkChange_None;
+
+#if defined(__linux__)
+    const char* cursor = (const char*)buffer;
+    size_t remaining = size;
+
+    if (buffer == NULL)
+    {
+        return ADUC_NetworkChange_None;
+    }
+
+    // Walks the messages by hand: NLMSG_OK and NLMSG_NEXT work on an int length, and mix signed and unsigned types.
+    while (remaining >= sizeof(struct nlmsghdr))
+    {
+        const struct nlmsghdr* header = (const struct nlmsghdr*)cursor;
+        const size_t messageSize = header->nlmsg_len;
+        size_t alignedSize = 0;
+
+        if (messageSize < sizeof(*header) || messageSize > remaining)
+        {
+            break;
+        }
+
+        switch (header->nlmsg_type)
+        {
+        case RTM_NEWLINK:
+            changes |= ParseLinkMessage(header);
+            break;
+
+        case RTM_NEWROUTE:
+            changes |= ParseRouteMessage(header);
+            break;
+
+        case NLMSG_DONE:
+            return changes;
+
+        default:
+            break;
+        }
+
+        alignedSize = NLMSG_ALIGN(messageSize);
+        if (alignedSize > remaining)
+        {
+            alignedSize = remaining;
+        }
+
+        cursor += alignedSize;
+        remaining -= alignedSize;
+    }
+#else
+    (void)buffer;
+    (void)size;
+#endif
+
+    return changes;
+}
+
+#if defined(__linux__)
+/**
+ * @brief Reads the notifications until the monitor is stopped, and calls the callback for those that report a change.
+ */
+static void* MonitorThreadProc(void* arg)
+{
+    // Aligned for the nlmsghdr structures it holds.
+    struct nlmsghdr buffer[NETLINK_READ_BUFFER_SIZE / sizeof(struct nlmsghdr)];
+    struct pollfd fds[2];
+
+    (void)arg;
+
+    // Cancellation is the fallback of ADUC_NetworkMonitor_Stop() when it cannot signal the stop event. It is only
+    // allowed while waiting, so that the thread is never cancelled while logging or calling the callback.
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+    fds[0].fd = s_netlinkFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = s_stopEventFd;
+    fds[1].events = POLLIN;
+
+    for (;;)
+    {
+        struct sockaddr_nl sender = { 0 };
+        socklen_t senderSize = sizeof(sender);
+        unsigned int changes = ADUC_NetworkChange_None;
+        ssize_t readSize = 0;
+        int pollResult = 0;
+
+        fds[0].revents = 0;
+        fds[1].revents = 0;
+
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        pollResult = poll(fds, 2, -1 /* timeout */);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+        if (pollResult == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            Log_Error("Cannot wait for network changes, errno %d. Network monitor stopped.", errno);
+            break;
+        }
+
+        if (fds[1].revents != 0)
+        {
+            break;
+        }
+
+        readSize =
+            recvfrom(s_netlinkFd, buffer, sizeof(buffer), MSG_DONTWAIT, (struct sockaddr*)&sender, &senderSize);
+        if (readSize == -1)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                continue;
+            }
+
+            if (errno != ENOBUFS)
+            {
+                Log_Error("Cannot read network changes, errno %d. Network monitor stopped.", errno);
+                break;
+            }
+
+            // The kernel dropped notifications. Any of them may have been the one awaited.
+            Log_Warn("Network change notifications were dropped.");
+            changes = ADUC_NetworkChange_LinkUp | ADUC_NetworkChange_DefaultRouteAdded;
+        }
+        else if (sender.nl_pid == 0)
+        {
+            // Only the kernel's notifications are trusted.
+            changes = ADUC_NetworkMonitor_ParseMessages(buffer, (size_t)readSize);
+        }
+
+        if (changes != ADUC_NetworkChange_None)
+        {
+            Log_Debug("Network changed (changes: 0x%x).", changes);
+            s_callback(changes, s_callbackContext);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Closes the sockets of the monitor. Called with the monitor's mutex held, once the thread is stopped.
+ */
+static void CloseMonitorFds()
+{
+    if (s_netlinkFd != -1)
+    {
+        close(s_netlinkFd);
+        s_netlinkFd = -1;
+    }
+
+    if (s_stopEventFd != -1)
+    {
+        close(s_stopEventFd);
+        s_stopEventFd = -1;
+    }
+}
+#endif
+
+bool ADUC_NetworkMonitor_Start(ADUC_NETWORK_CHANGE_CALLBACK callback, void* context)
+{
+    bool succeeded = false;
+
+    if (callback == NULL)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&s_monitorMutex);
+
+    if (s_isStarted)
+    {
+        succeeded = true;
+        goto done;
+    }
+
+#if defined(__linux__)
+    {
+        struct sockaddr_nl address = { 0 };
+        int error = 0;
+
+        s_netlinkFd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+        if (s_netlinkFd == -1)
+        {
+            goto done;
+        }
+
+        address.nl_family = AF_NETLINK;
+        address.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE;
+        if (bind(s_netlinkFd, (struct sockaddr*)&address, sizeof(address)) != 0)
+        {
+            goto done;
+        }
+
+        s_stopEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (s_stopEventFd == -1)
+        {
+            goto done;
+        }
+
+        s_callback = callback;
+        s_callbackContext = context;
+
+        error = pthread_create(&s_monitorThread, NULL, MonitorThreadProc, NULL);
+        if (error != 0)
+        {
+            errno = error;
+            goto done;
+        }
+
+        s_isStarted = true;
+        succeeded = true;
+    }
+#else
+    (void)context;
+#endif
+
+done:
+    if (!succeeded)
+    {
+        Log_Warn("Cannot monitor network changes, errno %d.", errno);
+#if defined(__linux__)
+        CloseMonitorFds();
+#endif
+        s_callback = NULL;
+        s_callbackContext = NULL;
+    }
+
+    pthread_mutex_unlock(&s_monitorMutex);
+
+    return succeeded;
+}
+
+void ADUC_NetworkMonitor_Stop()
+{
+    pthread_mutex_lock(&s_monitorMutex);
+
+    if (!s_isStarted)
+    {
+        goto done;
+    }
+
+#if defined(__linux__)
+    {
+        const uint64_t one = 1;
+
+        // Without the event, the thread would block in poll() forever, and the join below with it.
+        if (write(s_stopEventFd, &one, sizeof(one)) != (ssize_t)sizeof(one))
+        {
+            Log_Warn("Cannot signal the network monitor thread to stop, errno %d. Cancelling it.", errno);
+            pthread_cancel(s_monitorThread);
+        }
+    }
+
+    pthread_join(s_monitorThread, NULL);
+    CloseMonitorFds();
+#endif
+
+    s_isStarted = false;
+    s_callback = NULL;
+    s_callbackContext = NULL;
+
+done:
+    pthread_mutex_unlock(&s_monitorMutex);
+}
+
+bool ADUC_NetworkMonitor_IsStarted()
+{
+    bool isStarted = false;
+
+    pthread_mutex_lock(&s_monitorMutex);
+    isStarted = s_isStarted;
+    pthread_mutex_unlock(&s_monitorMutex);
+
+    return isStarted;
+}
@@ -0,0 +1,160 @@
+/**
+ * @file network_monitor_utils_ut.cpp
+ * @brief Unit Tests for network_monitor_utils library
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/network_monitor_utils.h"
+
+#include <catch2/catch_all.hpp>
+
+#include <cstring>
+#include <vector>
+
+#include <linux/rtnetlink.h>
+#include <net/if.h> // IFF_*
+
+namespace
+{
+/**
+ * @brief Builds a buffer of rtnetlink messages, as the kernel sends them.
+ */
+class NetlinkMessages
+{
+public:
+    /**
+     * @brief Appends a message with the @p type header and the @p payload structure.
+     */
+    template<typename Payload>
+    NetlinkMessages& Add(unsigned short type, const Payload& payload)
+    {
+        const size_t offset = _buffer.size();
+        _buffer.resize(offset + NLMSG_SPACE(sizeof(payload)));
+
+        auto header = reinterpret_cast<nlmsghdr*>(&_buffer[offset]);
+        header->nlmsg_len = NLMSG_LENGTH(sizeof(payload));
+        header->nlmsg_type = type;
+        std::memcpy(NLMSG_DATA(header), &payload, sizeof(payload));
+        return *this;
+    }
+
+    unsigned int Parse() const
+    {
+        return ADUC_NetworkMonitor_ParseMessages(_buffer.data(), _buffer.size());
+    }
+
+    std::vector<char>& Buffer()
+    {
+        return _buffer;
+    }
+
+private:
+    std::vector<char> _buffer;
+};
+
+rtmsg MakeRoute(unsigned char family, unsigned char dstLength, unsigned char type = RTN_UNICAST)
+{
+    rtmsg route = {};
+    route.rtm_family = family;
+    route.rtm_dst_len = dstLength;
+    route.rtm_table = RT_TABLE_MAIN;
+    route.rtm_type = type;
+    return route;
+}
+
+ifinfomsg MakeLink(unsigned int flags)
+{
+    ifinfomsg link = {};
+    link.ifi_family = AF_UNSPEC;
+    link.ifi_index = 2;
+    link.ifi_flags = flags;
+    return link;
+}
+
+} // namespace
+
+TEST_CASE("ADUC_NetworkMonitor_ParseMessages")
+{
+    NetlinkMessages messages;
+
+    SECTION("A new default route")
+    {
+        CHECK(messages.Add(RTM_NEWROUTE, MakeRoute(AF_INET, 0)).Parse() == ADUC_NetworkChange_DefaultRouteAdded);
+    }
+
+    SECTION("A new IPv6 default route")
+    {
+        CHECK(messages.Add(RTM_NEWROUTE, MakeRoute(AF_INET6, 0)).Parse() == ADUC_NetworkChange_DefaultRouteAdded);
+    }
+
+    SECTION("Routes that are not default routes")
+    {
+        messages.Add(RTM_NEWROUTE, MakeRoute(AF_INET, 24))
+            .Add(RTM_NEWROUTE, MakeRoute(AF_INET, 0, RTN_UNREACHABLE))
+            .Add(RTM_DELROUTE, MakeRoute(AF_INET, 0));
+        CHECK(messages.Parse() == ADUC_NetworkChange_None);
+    }
+
+    SECTION("A link that comes up")
+    {
+        CHECK(messages.Add(RTM_NEWLINK, MakeLink(IFF_UP | IFF_RUNNING)).Parse() == ADUC_NetworkChange_LinkUp);
+    }
+
+    SECTION("Links that are not up, or loopback")
+    {
+        messages.Add(RTM_NEWLINK, MakeLink(IFF_UP))
+            .Add(RTM_NEWLINK, MakeLink(IFF_UP | IFF_RUNNING | IFF_LOOPBACK))
+            .Add(RTM_DELLINK, MakeLink(IFF_UP | IFF_RUNNING));
+        CHECK(messages.Parse() == ADUC_NetworkChange_None);
+    }
+
+    SECTION("The changes of all the messages are combined")
+    {
+        messages.Add(RTM_NEWLINK, MakeLink(IFF_UP | IFF_RUNNING)).Add(RTM_NEWROUTE, MakeRoute(AF_INET, 0));
+        CHECK(messages.Parse() == (ADUC_NetworkChange_LinkUp | ADUC_NetworkChange_DefaultRouteAdded));
+    }
+
+    SECTION("A truncated message is ignored")
+    {
+        messages.Add(RTM_NEWROUTE, MakeRoute(AF_INET, 0));
+        messages.Buffer().resize(NLMSG_HDRLEN + 4);
+        CHECK(messages.Parse() == ADUC_NetworkChange_None);
+    }
+
+    SECTION("An empty buffer")
+    {
+        CHECK(messages.Parse() == ADUC_NetworkChange_None);
+        CHECK(ADUC_NetworkMonitor_ParseMessages(nullptr, 16) == ADUC_NetworkChange_None);
+    }
+}
+
+static void OnNetworkChange(unsigned int changes, void* context)
+{
+    (void)changes;
+    (void)context;
+}
+
+TEST_CASE("ADUC_NetworkMonitor_Start and ADUC_NetworkMonitor_Stop")
+{
+    CHECK_FALSE(ADUC_NetworkMonitor_Start(nullptr, nullptr));
+    CHECK_FALSE(ADUC_NetworkMonitor_IsStarted());
+
+    // Some sandboxes do not allow netlink sockets.
+    if (!ADUC_NetworkMonitor_Start(OnNetworkChange, nullptr))
+    {
+        WARN("Cannot open a netlink socket here.");
+        return;
+    }
+
+    CHECK(ADUC_NetworkMonitor_IsStarted());
+    CHECK(ADUC_NetworkMonitor_Start(OnNetworkChange, nullptr));
+
+    ADUC_NetworkMonitor_Stop();
+    CHECK_FALSE(ADUC_NetworkMonitor_IsStarted());
+
+    // Stopping again, and restarting, are allowed.
+    ADUC_NetworkMonitor_Stop();
+    CHECK(ADUC_NetworkMonitor_Start(OnNetworkChange, nullptr));
+    ADUC_NetworkMonitor_Stop();
+}
@@ -13,6 +13,7 @@
 #include <aducpal/unistd.h> // getegid, geteuid
 
 #include <azure_c_shared_utility/vector.h>
+#include <cstdint> // uint8_t
 #include <functional>
 
 #include <string>
@@ -45,6 +46,92 @@ int ADUC_LaunchChildProcess(const std::string& command, std::vector<std::string>
 int ADUC_LaunchChildProcess(
     const std::string& command, std::vector<std::string> args, std::vector<std::string>& output);
 
+/**
+ * @brief Runs specified command in a new process and streams its standard output, as raw bytes, to @p outputSink.
+ * @details Standard error is captured separately into @p errorOutput so that it does not get interleaved with
+ * the (possibly binary) standard output.
+ *
+ * @param command Name of a command to run. If command doesn't contain '/', this function will
+ *               search for the specified command in PATH.
+ * @param args List of arguments for the command.
+ * @param outputSink Called for each chunk read from standard output. Returning false stops reading and terminates the child process.
+ * @param errorOutput The standard error from the command.
+ *
+ * @return An exit code from the command.
+ */
+int ADUC_LaunchChildProcessStreamOutput(
+    const std::string& command,
+    std::vector<std::string> args,
+    const std::function<bool(const uint8_t* data, size_t size)>& outputSink,
+    std::string& errorOutput);
+
+/**
+ * @brief Options for ADUC_LaunchChildProcessWithOptions.
+ * The defaults retain all of the output and never stop the child.
+ */
+struct ADUC_ChildProcessOptions
+{
+    /**
+     * @brief Optional. Called with each line of standard output, without its line feed, as soon as it is read.
+     */
+    std::function<void(const std::string& line)> outputLineSink;
+
+    /**
+     * @brief Optional. Called with each line of standard error, without its line feed, as soon as it is read.
+     */
+    std::function<void(const std::string& line)> errorLineSink;
+
+    /**
+     * @brief The most bytes of combined output that are retained, or 0 for no limit.
+     * Once the limit is reached, only the most recent output is kept.
+     */
+    size_t maxOutputSizeInBytes = 0;
+
+    /**
+     * @brief The seconds the child process may run before its process group is terminated, or 0 for no timeout.
+     */
+    unsigned int timeoutInSeconds = 0;
+
+    /**
+     * @brief Optional. Polled while the child process runs; its process group is stopped once this returns true.
+     */
+    std::function<bool()> isCancelled;
+};
+
+/**
+ * @brief How a child process launched by ADUC_LaunchChildProcessWithOptions ended.
+ */
+struct ADUC_ChildProcessStatus
+{
+    bool timedOut = false; /**< The child was stopped because it ran past its timeout. */
+    bool cancelled = false; /**< The child was stopped because the cancellation check returned true. */
+    uint64_t outputSizeInBytes = 0; /**< The size of all of the output, including any that was not retained. */
+    bool outputTruncated = false; /**< The start of the output was dropped to stay within the size limit. */
+};
+
+/**
+ * @brief Runs specified command in a new process group, streaming its output line by line while it runs.
+ * @details The child is started with posix_spawn, so no copy of the (possibly large) calling process is made.
+ * Standard output and standard error are read as they are written; each complete line goes to its sink, and the
+ * combined output is retained in arrival order, up to the configured limit.
+ * On timeout or cancellation the whole process group receives SIGTERM, then SIGKILL if it has not exited in time.
+ *
+ * @param command Name of a command to run. If command doesn't contain '/', this function will
+ *               search for the specified command in PATH.
+ * @param args List of arguments for the command.
+ * @param options The line sinks, output limit, timeout and cancellation check.
+ * @param output The standard output and standard error from the command, or their tail when over the limit.
+ * @param status Optional. Receives how the child process ended.
+ *
+ * @return An exit code from the command.
+ */
+int ADUC_LaunchChildProcessWithOptions(
+    const std::string& command,
+    const std::vector<std::string>& args,
+    const ADUC_ChildProcessOptions& options,
+    std::string& output,
+    ADUC_ChildProcessStatus* status = nullptr);
+
 /**
  * @brief Ensure that the effective group of the process is the given group (or is root).
  * @remark This function is not thread-safe if called with the defaults for the optional args.
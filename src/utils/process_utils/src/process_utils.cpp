@@ -18,6 +18,7 @@
 #include <aduc/c_utils.h>
 #include <aduc/config_utils.h>
 #include <aduc/logging.h>
+#include <aduc/process_utils.hpp>
 #include <aduc/string_utils.hpp>
 
 #include <aducpal/stdio.h> // popen,pclose
@@ -25,12 +26,18 @@
 #include <azure_c_shared_utility/strings.h>
 #include <azure_c_shared_utility/vector.h>
 
+#include <algorithm> // std::min
 #include <chrono>
 #include <functional> // for std::function
 #include <string>
 #ifndef WIN32 // Note: Only included when not in windows since a different wait signal is used.
+#    include <poll.h>
+#    include <signal.h>
+#    include <spawn.h>
 #    include <sys/wait.h>
 #    include <unistd.h>
+
+extern char** environ;
 #endif
 #include <fcntl.h>
 #include <sys/types.h>
@@ -89,49 +96,128 @@ static int ADUC_LaunchChildProcessHelper(
 }
 #else
 
-static int ADUC_LaunchChildProcessHelper(
-    const std::string& command, std::vector<std::string> args, std::function<void(const char*)> func)
-{
+static int GetChildExitStatus(int wstatus);
+
 #    define READ_END 0
 #    define WRITE_END 1
 
-    int filedes[2];
-    const int ret = pipe(filedes);
-    if (ret != 0)
+/**
+ * @brief Starts @p command in a new process group with its standard output and standard error redirected.
+ * @details posix_spawn is used instead of fork so that the agent, which may have a large resident set, is not copied
+ * just to exec another program. The child gets a default signal mask and dispositions, whatever the caller has set up.
+ *
+ * @param command Name of a command to run, searched for in PATH when it doesn't contain '/'.
+ * @param args List of arguments for the command.
+ * @param outFd The descriptor that becomes the standard output of the child.
+ * @param errFd The descriptor that becomes the standard error of the child.
+ * @param spawnError Receives the error number when the child could not be started.
+ * @return pid_t The process id of the child, which also is its process group id, or -1 on failure.
+ */
+static pid_t SpawnChildProcess(
+    const std::string& command, const std::vector<std::string>& args, int outFd, int errFd, int* spawnError)
+{
+    pid_t pid = -1;
+    posix_spawn_file_actions_t fileActions;
+    posix_spawnattr_t attr;
+    sigset_t signalSet;
+
+    *spawnError = posix_spawn_file_actions_init(&fileActions);
+    if (*spawnError != 0)
     {
-        Log_Error("Cannot create output and error pipes. %s (errno %d).", strerror(errno), errno);
-        return ret;
+        Log_Error("Cannot init spawn file actions, error %d", *spawnError);
+        return -1;
+    }
+
+    *spawnError = posix_spawnattr_init(&attr);
+    if (*spawnError != 0)
+    {
+        Log_Error("Cannot init spawn attributes, error %d", *spawnError);
+        posix_spawn_file_actions_destroy(&fileActions);
+        return -1;
+    }
+
+    std::vector<char*> argv;
+    argv.reserve(args.size() + 2);
+    argv.emplace_back(const_cast<char*>(command.c_str())); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+    for (const std::string& arg : args)
+    {
+        argv.emplace_back(const_cast<char*>(arg.c_str())); // NOLINT(cppcoreguidelines-pro-type-const-cast)
     }
+    argv.emplace_back(nullptr);
 
-    const int pid = fork();
+    // The pipes are close-on-exec, so only the two redirections are needed in the child.
+    *spawnError = posix_spawn_file_actions_adddup2(&fileActions, outFd, STDOUT_FILENO);
+    if (*spawnError == 0)
+    {
+        *spawnError = posix_spawn_file_actions_adddup2(&fileActions, errFd, STDERR_FILENO);
+    }
 
-    if (pid == 0)
+    if (*spawnError == 0)
     {
-        // Running inside child process.
+        *spawnError = posix_spawnattr_setflags(
+            &attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    }
 
-        // Redirect stdout and stderr to WRITE_END
-        dup2(filedes[WRITE_END], STDOUT_FILENO);
-        dup2(filedes[WRITE_END], STDERR_FILENO);
+    if (*spawnError == 0)
+    {
+        // A process group of its own lets timeouts and cancellation stop everything the command started.
+        *spawnError = posix_spawnattr_setpgroup(&attr, 0);
+    }
 
-        close(filedes[READ_END]);
-        close(filedes[WRITE_END]);
+    if (*spawnError == 0)
+    {
+        sigemptyset(&signalSet);
+        *spawnError = posix_spawnattr_setsigmask(&attr, &signalSet);
+    }
 
-        std::vector<char*> argv;
-        argv.reserve(args.size() + 2);
-        argv.emplace_back(const_cast<char*>(command.c_str())); // NOLINT(cppcoreguidelines-pro-type-const-cast)
-        for (const std::string& arg : args)
-        {
-            argv.emplace_back(const_cast<char*>(arg.c_str())); // NOLINT(cppcoreguidelines-pro-type-const-cast)
-        }
-        argv.emplace_back(nullptr);
+    if (*spawnError == 0)
+    {
+        sigemptyset(&signalSet);
+        sigaddset(&signalSet, SIGPIPE);
+        sigaddset(&signalSet, SIGTERM);
+        sigaddset(&signalSet, SIGINT);
+        sigaddset(&signalSet, SIGHUP);
+        *spawnError = posix_spawnattr_setsigdefault(&attr, &signalSet);
+    }
+
+    if (*spawnError == 0)
+    {
+        *spawnError = posix_spawnp(&pid, command.c_str(), &fileActions, &attr, argv.data(), environ);
+    }
 
-        // The exec() functions only return if an error has occurred.
-        // The return value is -1, and errno is set to indicate the error.
-        int status = execvp(command.c_str(), &argv[0]);
+    if (*spawnError != 0)
+    {
+        Log_Error("Cannot spawn '%s', error %d", command.c_str(), *spawnError);
+        pid = -1;
+    }
 
-        fprintf(stderr, "execvp failed, returned %d, error %d\n", status, errno);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&fileActions);
 
-        _exit(EXIT_FAILURE);
+    return pid;
+}
+
+static int ADUC_LaunchChildProcessHelper(
+    const std::string& command, std::vector<std::string> args, std::function<void(const char*)> func)
+{
+    int filedes[2];
+    const int ret = pipe2(filedes, O_CLOEXEC);
+    if (ret != 0)
+    {
+        Log_Error("Cannot create output and error pipes. %s (errno %d).", strerror(errno), errno);
+        return ret;
+    }
+
+    int spawnError = 0;
+    const pid_t pid = SpawnChildProcess(command, args, filedes[WRITE_END], filedes[WRITE_END], &spawnError);
+    if (pid < 0)
+    {
+        close(filedes[READ_END]);
+        close(filedes[WRITE_END]);
+
+        const std::string message = "posix_spawnp failed, error " + std::to_string(spawnError) + "\n";
+        func(message.c_str());
+        return EXIT_FAILURE;
     }
 
     close(filedes[WRITE_END]);
@@ -159,10 +245,24 @@ static int ADUC_LaunchChildProcessHelper(
     }
 
     int wstatus;
-    int childExitStatus;
 
     waitpid(pid, &wstatus, 0);
 
+    close(filedes[READ_END]);
+
+    return GetChildExitStatus(wstatus);
+}
+
+/**
+ * @brief Gets the exit code of a child process from the status returned by waitpid.
+ *
+ * @param wstatus The status returned by waitpid.
+ * @return int The exit code of the child process.
+ */
+static int GetChildExitStatus(int wstatus)
+{
+    int childExitStatus;
+
     // Get the child process exit code.
     if (WIFEXITED(wstatus))
     {
@@ -191,11 +291,431 @@ static int ADUC_LaunchChildProcessHelper(
         Log_Error("Child process terminated abnormally.", childExitStatus);
     }
 
-    close(filedes[READ_END]);
-
     return childExitStatus;
 }
 
+static int ADUC_LaunchChildProcessStreamOutputHelper(
+    const std::string& command,
+    std::vector<std::string> args,
+    const std::function<bool(const uint8_t* data, size_t size)>& outputSink,
+    std::string& errorOutput)
+{
+    int outPipe[2];
+    int errPipe[2];
+
+    if (pipe2(outPipe, O_CLOEXEC) != 0)
+    {
+        Log_Error("Cannot create output pipe. %s (errno %d).", strerror(errno), errno);
+        return EXIT_FAILURE;
+    }
+
+    if (pipe2(errPipe, O_CLOEXEC) != 0)
+    {
+        Log_Error("Cannot create error pipe. %s (errno %d).", strerror(errno), errno);
+        close(outPipe[READ_END]);
+        close(outPipe[WRITE_END]);
+        return EXIT_FAILURE;
+    }
+
+    int spawnError = 0;
+    const pid_t pid = SpawnChildProcess(command, args, outPipe[WRITE_END], errPipe[WRITE_END], &spawnError);
+
+    close(outPipe[WRITE_END]);
+    close(errPipe[WRITE_END]);
+
+    if (pid < 0)
+    {
+        errorOutput = "posix_spawnp failed, error " + std::to_string(spawnError) + "\n";
+        close(outPipe[READ_END]);
+        close(errPipe[READ_END]);
+        return EXIT_FAILURE;
+    }
+
+    // Read both pipes until the child closes them, so that neither can fill up and block the child.
+    struct pollfd fds[2] = { { outPipe[READ_END], POLLIN, 0 }, { errPipe[READ_END], POLLIN, 0 } };
+    bool sinkFailed = false;
+    std::vector<uint8_t> buffer(64 * 1024);
+
+    while (fds[0].fd >= 0 || fds[1].fd >= 0)
+    {
+        if (poll(fds, ARRAY_SIZE(fds), -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            Log_Error("Poll failed, error %d", errno);
+            break;
+        }
+
+        for (auto& pfd : fds)
+        {
+            if (pfd.fd < 0 || pfd.revents == 0)
+            {
+                continue;
+            }
+
+            const ssize_t count = read(pfd.fd, buffer.data(), buffer.size());
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (count <= 0)
+            {
+                close(pfd.fd);
+                pfd.fd = -1;
+                continue;
+            }
+
+            if (pfd.fd == outPipe[READ_END])
+            {
+                if (!sinkFailed && !outputSink(buffer.data(), static_cast<size_t>(count)))
+                {
+                    // Stop the child; keep draining until it closes its end of the pipes.
+                    sinkFailed = true;
+                    kill(pid, SIGTERM);
+                }
+            }
+            else
+            {
+                errorOutput.append(reinterpret_cast<const char*>(buffer.data()), static_cast<size_t>(count)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+            }
+        }
+    }
+
+    for (const auto& pfd : fds)
+    {
+        if (pfd.fd >= 0)
+        {
+            close(pfd.fd);
+        }
+    }
+
+    int wstatus;
+
+    waitpid(pid, &wstatus, 0);
+
+    const int childExitStatus = GetChildExitStatus(wstatus);
+
+    return sinkFailed && childExitStatus == 0 ? EXIT_FAILURE : childExitStatus;
+}
+
+/**
+ * @brief How long the process group gets to exit after SIGTERM, and then after SIGKILL, before it is given up on.
+ */
+static const std::chrono::seconds ChildProcessStopGracePeriod{ 5 };
+
+/**
+ * @brief How often timeouts and cancellation are checked while the child process is quiet.
+ */
+static const int ChildProcessPollIntervalMilliseconds = 100;
+
+/**
+ * @brief The longest line passed to a line sink; longer lines are passed on in pieces of this size.
+ */
+static const size_t ChildProcessMaxLineLength = 64 * 1024;
+
+/**
+ * @brief Splits one output stream of a child process into lines for a line sink.
+ */
+class ChildProcessLineSplitter
+{
+public:
+    explicit ChildProcessLineSplitter(const std::function<void(const std::string& line)>& sink) : _sink(sink)
+    {
+    }
+
+    void Append(const char* data, size_t size)
+    {
+        if (!_sink)
+        {
+            return;
+        }
+
+        const char* const end = data + size;
+        while (data < end)
+        {
+            const char* const lineFeed = static_cast<const char*>(memchr(data, '\n', end - data));
+            const char* const pieceEnd = lineFeed != nullptr ? lineFeed : end;
+            const size_t pieceSize = std::min(
+                static_cast<size_t>(pieceEnd - data), ChildProcessMaxLineLength - _pending.size());
+
+            _pending.append(data, pieceSize);
+            data += pieceSize;
+
+            if (data == lineFeed)
+            {
+                ++data;
+                Flush();
+            }
+            else if (_pending.size() == ChildProcessMaxLineLength)
+            {
+                Flush();
+            }
+        }
+    }
+
+    void Flush()
+    {
+        if (!_sink)
+        {
+            return;
+        }
+
+        if (!_pending.empty() && _pending.back() == '\r')
+        {
+            _pending.pop_back();
+        }
+
+        _sink(_pending);
+        _pending.clear();
+    }
+
+    void FlushPartialLine()
+    {
+        if (!_pending.empty())
+        {
+            Flush();
+        }
+    }
+
+private:
+    const std::function<void(const std::string& line)>& _sink;
+    std::string _pending;
+};
+
+/**
+ * @brief Keeps the combined output of a child process, dropping its start once it grows past the size limit.
+ * @details Trimming waits until the buffer holds twice the limit, so each byte is moved at most once or twice.
+ */
+class ChildProcessOutputTail
+{
+public:
+    ChildProcessOutputTail(std::string& output, size_t maxSize) : _output(output), _maxSize(maxSize)
+    {
+    }
+
+    void Append(const char* data, size_t size)
+    {
+        _totalSize += size;
+
+        if (_maxSize != 0 && size >= _maxSize)
+        {
+            _output.assign(data + size - _maxSize, _maxSize);
+            _truncated = true;
+            return;
+        }
+
+        _output.append(data, size);
+        if (_maxSize != 0 && _output.size() > 2 * _maxSize)
+        {
+            Trim();
+        }
+    }
+
+    void Trim()
+    {
+        if (_maxSize != 0 && _output.size() > _maxSize)
+        {
+            _output.erase(0, _output.size() - _maxSize);
+            _truncated = true;
+        }
+    }
+
+    uint64_t TotalSize() const
+    {
+        return _totalSize;
+    }
+
+    bool Truncated() const
+    {
+        return _truncated;
+    }
+
+private:
+    std::string& _output;
+    const size_t _maxSize;
+    uint64_t _totalSize = 0;
+    bool _truncated = false;
+};
+
+static int ADUC_LaunchChildProcessWithOptionsHelper(
+    const std::string& command,
+    const std::vector<std::string>& args,
+    const ADUC_ChildProcessOptions& options,
+    std::string& output,
+    ADUC_ChildProcessStatus* status)
+{
+    using Clock = std::chrono::steady_clock;
+
+    int outPipe[2];
+    int errPipe[2];
+
+    if (pipe2(outPipe, O_CLOEXEC) != 0)
+    {
+        Log_Error("Cannot create output pipe. %s (errno %d).", strerror(errno), errno);
+        return EXIT_FAILURE;
+    }
+
+    if (pipe2(errPipe, O_CLOEXEC) != 0)
+    {
+        Log_Error("Cannot create error pipe. %s (errno %d).", strerror(errno), errno);
+        close(outPipe[READ_END]);
+        close(outPipe[WRITE_END]);
+        return EXIT_FAILURE;
+    }
+
+    int spawnError = 0;
+    const pid_t pid = SpawnChildProcess(command, args, outPipe[WRITE_END], errPipe[WRITE_END], &spawnError);
+
+    close(outPipe[WRITE_END]);
+    close(errPipe[WRITE_END]);
+
+    if (pid < 0)
+    {
+        output = "posix_spawnp failed, error " + std::to_string(spawnError) + "\n";
+        close(outPipe[READ_END]);
+        close(errPipe[READ_END]);
+        return EXIT_FAILURE;
+    }
+
+    ChildProcessLineSplitter outLines{ options.outputLineSink };
+    ChildProcessLineSplitter errLines{ options.errorLineSink };
+    ChildProcessOutputTail tail{ output, options.maxOutputSizeInBytes };
+
+    const Clock::time_point deadline = Clock::now() + std::chrono::seconds(options.timeoutInSeconds);
+    Clock::time_point stopDeadline;
+    int stopSignal = 0;
+    bool timedOut = false;
+    bool cancelled = false;
+
+    // Only wake up periodically when there is something to check; otherwise block until the child writes or exits.
+    const bool needsPolling = options.timeoutInSeconds != 0 || options.isCancelled;
+
+    struct pollfd fds[2] = { { outPipe[READ_END], POLLIN, 0 }, { errPipe[READ_END], POLLIN, 0 } };
+    std::vector<char> buffer(64 * 1024);
+
+    while (fds[0].fd >= 0 || fds[1].fd >= 0)
+    {
+        if (poll(fds, ARRAY_SIZE(fds), needsPolling || stopSignal != 0 ? ChildProcessPollIntervalMilliseconds : -1)
+            < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            Log_Error("Poll failed, error %d", errno);
+            break;
+        }
+
+        for (auto& pfd : fds)
+        {
+            if (pfd.fd < 0 || pfd.revents == 0)
+            {
+                continue;
+            }
+
+            const ssize_t count = read(pfd.fd, buffer.data(), buffer.size());
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (count <= 0)
+            {
+                close(pfd.fd);
+                pfd.fd = -1;
+                continue;
+            }
+
+            ChildProcessLineSplitter& lines = pfd.fd == outPipe[READ_END] ? outLines : errLines;
+            lines.Append(buffer.data(), static_cast<size_t>(count));
+            tail.Append(buffer.data(), static_cast<size_t>(count));
+        }
+
+        const Clock::time_point now = Clock::now();
+
+        if (stopSignal == 0)
+        {
+            if (options.timeoutInSeconds != 0 && now >= deadline)
+            {
+                Log_Warn("'%s' ran longer than %u seconds, stopping it.", command.c_str(), options.timeoutInSeconds);
+                timedOut = true;
+            }
+            else if (options.isCancelled && options.isCancelled())
+            {
+                Log_Info("'%s' was cancelled, stopping it.", command.c_str());
+                cancelled = true;
+            }
+            else
+            {
+                continue;
+            }
+
+            stopSignal = SIGTERM;
+        }
+        else if (now < stopDeadline)
+        {
+            continue;
+        }
+        else if (stopSignal == SIGTERM)
+        {
+            Log_Warn("'%s' did not exit after SIGTERM, killing it.", command.c_str());
+            stopSignal = SIGKILL;
+        }
+        else
+        {
+            // Something outside the process group still holds the pipes open; stop waiting for it.
+            Log_Error("Output of '%s' is still open after SIGKILL, no longer reading it.", command.c_str());
+            break;
+        }
+
+        if (kill(-pid, stopSignal) != 0 && errno != ESRCH)
+        {
+            Log_Error("Cannot signal process group %d, error %d", static_cast<int>(pid), errno);
+        }
+
+        stopDeadline = now + ChildProcessStopGracePeriod;
+    }
+
+    for (const auto& pfd : fds)
+    {
+        if (pfd.fd >= 0)
+        {
+            close(pfd.fd);
+        }
+    }
+
+    outLines.FlushPartialLine();
+    errLines.FlushPartialLine();
+    tail.Trim();
+
+    int wstatus = 0;
+    while (waitpid(pid, &wstatus, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            Log_Error("waitpid failed, error %d", errno);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (status != nullptr)
+    {
+        status->timedOut = timedOut;
+        status->cancelled = cancelled;
+        status->outputSizeInBytes = tail.TotalSize();
+        status->outputTruncated = tail.Truncated();
+    }
+
+    const int childExitStatus = GetChildExitStatus(wstatus);
+
+    return (timedOut || cancelled) && childExitStatus == 0 ? EXIT_FAILURE : childExitStatus;
+}
+
 #endif
 
 /**
@@ -239,6 +759,71 @@ int ADUC_LaunchChildProcess(
         output.push_back(str.substr(0, str.size() - 1));
     });
 }
+
+/**
+ * @brief Runs specified command in a new process and streams its standard output, as raw bytes, to @p outputSink.
+ *
+ * @param command Name of a command to run. If command doesn't contain '/', this function will
+ *               search for the specified command in PATH.
+ * @param args List of arguments for the command.
+ * @param outputSink Called for each chunk read from standard output. Returning false stops reading and terminates the child process.
+ * @param errorOutput The standard error from the command.
+ *
+ * @return An exit code from the command.
+ */
+int ADUC_LaunchChildProcessStreamOutput(
+    const std::string& command,
+    std::vector<std::string> args,
+    const std::function<bool(const uint8_t* data, size_t size)>& outputSink,
+    std::string& errorOutput)
+{
+    errorOutput.clear();
+
+#ifdef WIN32
+    UNREFERENCED_PARAMETER(command);
+    UNREFERENCED_PARAMETER(args);
+    UNREFERENCED_PARAMETER(outputSink);
+    Log_Error("Streaming child process output is not supported on this platform.");
+    return EXIT_FAILURE;
+#else
+    return ADUC_LaunchChildProcessStreamOutputHelper(command, std::move(args), outputSink, errorOutput);
+#endif
+}
+
+/**
+ * @brief Runs specified command in a new process group, streaming its output line by line while it runs.
+ *
+ * @param command Name of a command to run. If command doesn't contain '/', this function will
+ *               search for the specified command in PATH.
+ * @param args List of arguments for the command.
+ * @param options The line sinks, output limit, timeout and cancellation check.
+ * @param output The standard output and standard error from the command, or their tail when over the limit.
+ * @param status Optional. Receives how the child process ended.
+ *
+ * @return An exit code from the command.
+ */
+int ADUC_LaunchChildProcessWithOptions(
+    const std::string& command,
+    const std::vector<std::string>& args,
+    const ADUC_ChildProcessOptions& options,
+    std::string& output,
+    ADUC_ChildProcessStatus* status /* = nullptr */)
+{
+    output.clear();
+
+    if (status != nullptr)
+    {
+        *status = ADUC_ChildProcessStatus{};
+    }
+
+#ifdef WIN32
+    UNREFERENCED_PARAMETER(options);
+    Log_Warn("Child process timeouts and cancellation are not supported on this platform.");
+    return ADUC_LaunchChildProcess(command, args, output);
+#else
+    return ADUC_LaunchChildProcessWithOptionsHelper(command, args, options, output, status);
+#endif
+}
 /**
  * @brief Ensure that the effective group of the process is the given group (or is root).
  * @remark This function is not thread-safe if called with the defaults for the optional args.
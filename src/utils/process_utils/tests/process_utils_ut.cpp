@@ -11,6 +11,8 @@
 
 #include "aduc/process_utils.hpp" // ADUC_LaunchChildProcess
 
+#include <chrono>
+#include <string>
 #include <vector>
 
 using Catch::Matchers::ContainsSubstring;
@@ -81,6 +83,98 @@ TEST_CASE("Bad parameter error")
     CHECK_THAT(output.c_str(), ContainsSubstring(bogusOption));
 }
 
+#ifndef WIN32
+TEST_CASE("ADUC_LaunchChildProcessWithOptions - streams lines")
+{
+    std::vector<std::string> outputLines;
+    std::vector<std::string> errorLines;
+    ADUC_ChildProcessOptions options;
+    options.outputLineSink = [&outputLines](const std::string& line) { outputLines.push_back(line); };
+    options.errorLineSink = [&errorLines](const std::string& line) { errorLines.push_back(line); };
+
+    std::vector<std::string> args{ "-c", "echo first; echo oops >&2; echo; printf 'no line feed'; exit 3" };
+    std::string output;
+    ADUC_ChildProcessStatus status;
+    const int exitCode = ADUC_LaunchChildProcessWithOptions("sh", args, options, output, &status);
+
+    CHECK(exitCode == 3);
+    CHECK(outputLines == std::vector<std::string>{ "first", "", "no line feed" });
+    CHECK(errorLines == std::vector<std::string>{ "oops" });
+    CHECK_THAT(output, ContainsSubstring("first\n"));
+    CHECK_THAT(output, ContainsSubstring("oops\n"));
+    CHECK_FALSE(status.timedOut);
+    CHECK_FALSE(status.cancelled);
+    CHECK_FALSE(status.outputTruncated);
+    CHECK(status.outputSizeInBytes == output.size());
+}
+
+TEST_CASE("ADUC_LaunchChildProcessWithOptions - keeps the tail of the output")
+{
+    size_t lineCount = 0;
+    ADUC_ChildProcessOptions options;
+    options.outputLineSink = [&lineCount](const std::string&) { ++lineCount; };
+    options.maxOutputSizeInBytes = 100;
+
+    std::vector<std::string> args{ "-c", "i=0; while [ $i -lt 5000 ]; do echo line $i; i=$((i+1)); done" };
+    std::string output;
+    ADUC_ChildProcessStatus status;
+    const int exitCode = ADUC_LaunchChildProcessWithOptions("sh", args, options, output, &status);
+
+    CHECK(exitCode == 0);
+    CHECK(lineCount == 5000);
+    CHECK(output.size() == 100);
+    CHECK_THAT(output, ContainsSubstring("line 4999\n"));
+    CHECK(status.outputTruncated);
+    CHECK(status.outputSizeInBytes > 100);
+}
+
+TEST_CASE("ADUC_LaunchChildProcessWithOptions - timeout stops the process group")
+{
+    ADUC_ChildProcessOptions options;
+    options.timeoutInSeconds = 1;
+
+    // The background sleep holds the output pipes open; it must be stopped along with the shell.
+    std::vector<std::string> args{ "-c", "echo started; sleep 30 & wait" };
+    std::string output;
+    ADUC_ChildProcessStatus status;
+    const auto start = std::chrono::steady_clock::now();
+    const int exitCode = ADUC_LaunchChildProcessWithOptions("sh", args, options, output, &status);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    CHECK(exitCode != 0);
+    CHECK(status.timedOut);
+    CHECK_FALSE(status.cancelled);
+    CHECK_THAT(output, ContainsSubstring("started"));
+    CHECK(elapsed < std::chrono::seconds(10));
+}
+
+TEST_CASE("ADUC_LaunchChildProcessWithOptions - cancellation")
+{
+    int checks = 0;
+    ADUC_ChildProcessOptions options;
+    options.isCancelled = [&checks]() { return ++checks > 3; };
+
+    std::vector<std::string> args{ "-c", "sleep 30" };
+    std::string output;
+    ADUC_ChildProcessStatus status;
+    const int exitCode = ADUC_LaunchChildProcessWithOptions("sh", args, options, output, &status);
+
+    CHECK(exitCode != 0);
+    CHECK(status.cancelled);
+    CHECK_FALSE(status.timedOut);
+}
+
+TEST_CASE("ADUC_LaunchChildProcessWithOptions - command not found")
+{
+    std::string output;
+    const int exitCode = ADUC_LaunchChildProcessWithOptions(
+        "/nonexistent/command", std::vector<std::string>{}, ADUC_ChildProcessOptions{}, output);
+
+    CHECK(exitCode != 0);
+    CHECK_THAT(output, ContainsSubstring("posix_spawnp failed"));
+}
+#endif
+
 TEST_CASE("VerifyProcessEffectiveGroup")
 {
     SECTION("it should return false when gegrnam returns nullptr and sets errno")
@@ -11,6 +11,7 @@
 #include <aduc/c_utils.h>
 #include <azure_c_shared_utility/strings.h>
 #include <stdbool.h>
+#include <stdint.h> // uint64_t
 
 #include <aducpal/sys_stat.h> // mode_t
 #include <aducpal/unistd.h> // uid_t, gid_t
@@ -29,6 +30,27 @@ typedef struct tagADUC_SystemUtils_ForEachDirFunctor
     ADUC_SystemUtils_ForEachDirFunc callbackFn; ///< The ForEachDirFunc callback function.
 } ADUC_SystemUtils_ForEachDirFunctor;
 
+/**
+ * @brief The methods ADUC_SystemUtils_CopyFile uses to copy content, in the order they are tried.
+ */
+typedef enum tagADUC_SystemUtils_CopyMethod
+{
+    ADUC_SystemUtils_CopyMethod_Auto = 0, ///< Try each method in turn.
+    ADUC_SystemUtils_CopyMethod_CopyFileRange = 1, ///< copy_file_range, within the kernel; may share extents.
+    ADUC_SystemUtils_CopyMethod_Reflink = 2, ///< ioctl FICLONE, shares the extents on copy-on-write file systems.
+    ADUC_SystemUtils_CopyMethod_Sendfile = 3, ///< sendfile, within the kernel.
+    ADUC_SystemUtils_CopyMethod_Buffered = 4, ///< read and write through a large buffer.
+} ADUC_SystemUtils_CopyMethod;
+
+/**
+ * @brief How ADUC_SystemUtils_CopyFile copied a file.
+ */
+typedef struct tagADUC_SystemUtils_CopyFileStats
+{
+    ADUC_SystemUtils_CopyMethod method; ///< The method that finished the copy.
+    uint64_t bytesCopied; ///< The size of the copy.
+} ADUC_SystemUtils_CopyFileStats;
+
 const char* ADUC_SystemUtils_GetTemporaryPathName();
 
 char* ADUC_SystemUtils_MkTemp(char* tmpl);
@@ -51,6 +73,14 @@ int ADUC_SystemUtils_RmDirRecursive(const char* path);
 
 int ADUC_SystemUtils_CopyFileToDir(const char* filePath, const char* dirPath, bool overwriteExistingFile);
 
+int ADUC_SystemUtils_CopyFile(
+    const char* sourceFilePath,
+    const char* destFilePath,
+    bool overwriteExistingFile,
+    ADUC_SystemUtils_CopyFileStats* stats);
+
+void ADUC_SystemUtils_SetFileCopyMethod(ADUC_SystemUtils_CopyMethod method);
+
 int ADUC_SystemUtils_WriteStringToFile(const char* path, const char* buff);
 
 int ADUC_SystemUtils_ReadStringFromFile(const char* path, char* buff, size_t buffLen);
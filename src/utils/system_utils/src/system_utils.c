@@ -28,6 +28,14 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#if defined(__linux__)
+#    include <linux/fs.h> // FICLONE
+#    include <sys/ioctl.h> // ioctl
+#    include <sys/sendfile.h> // sendfile
+#    include <sys/syscall.h> // SYS_copy_file_range
+#    include <unistd.h> // syscall
+#endif
+
 // keep this last to avoid interfering with system headers
 #include "aduc/aduc_banned.h"
 
@@ -461,98 +469,404 @@ done:
 }
 
 /**
- * @brief Copies the file at @p filePath to @p dirPath with the same name
- * @details Preserves the ownership and filemode bit permissions
- * @param filePath path to the file
- * @param dirPath path to the directory
- * @param overwriteExistingFile if set to true will overwrite the existing file in @p dirPath named with the filename in @p fileName if it exists
- * @returns the result of the operation
+ * @brief The copy method selected by ADUC_SystemUtils_SetFileCopyMethod.
  */
-int ADUC_SystemUtils_CopyFileToDir(const char* filePath, const char* dirPath, const bool overwriteExistingFile)
+static ADUC_SystemUtils_CopyMethod s_fileCopyMethod = ADUC_SystemUtils_CopyMethod_Auto;
+
+/**
+ * @brief The size of the buffer used when the content is copied through user space.
+ */
+static const size_t CopyFileBufferSize = 1024 * 1024;
+
+#if defined(__linux__)
+
+/**
+ * @brief The largest amount of content that one copy_file_range or sendfile call is asked to copy.
+ * @details Both may copy less than asked, so they are called until the end of the source file.
+ */
+static const size_t CopyFileMaxChunkSize = 1024 * 1024 * 1024;
+
+/**
+ * @brief Whether a copy method failed because it is not supported for these files, in which case the next method
+ * is tried.
+ * @param err The errno of the failure.
+ * @return bool true if the failure is about support rather than the files themselves.
+ */
+static bool IsCopyMethodUnsupported(int err)
 {
-    int result = -1;
-    STRING_HANDLE destFilePath = NULL;
+    return err == ENOSYS || err == EXDEV || err == EINVAL || err == EOPNOTSUPP || err == ENOTTY || err == EBADF
+        || err == ETXTBSY;
+}
 
-    FILE* sourceFile = NULL;
-    FILE* destFile = NULL;
-    unsigned char readBuff[1024];
-    const size_t readMaxBuffSize = ARRAY_SIZE(readBuff);
+/**
+ * @brief Copies with copy_file_range, which copies within the kernel and lets the file system share the extents
+ * (e.g. btrfs, XFS, NFS server-side copy).
+ * @param sourceFd The source file descriptor.
+ * @param destFd The destination file descriptor.
+ * @param[in,out] offset The offset up to which the content was copied.
+ * @return int 0 if the content was copied to the end of the source file, otherwise the errno of the failure.
+ */
+static int CopyWithCopyFileRange(int sourceFd, int destFd, uint64_t* offset)
+{
+#    if defined(SYS_copy_file_range)
+    for (;;)
+    {
+        loff_t sourceOffset = (loff_t)*offset;
+        loff_t destOffset = (loff_t)*offset;
 
-    memset(readBuff, 0, readMaxBuffSize);
+        // The system call rather than the glibc 2.27 wrapper, so that the agent still runs on older C libraries.
+        const long copied =
+            syscall(SYS_copy_file_range, sourceFd, &sourceOffset, destFd, &destOffset, CopyFileMaxChunkSize, 0);
+        if (copied < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno;
+        }
 
-    if (filePath == NULL || dirPath == NULL)
+        if (copied == 0)
+        {
+            return 0;
+        }
+
+        *offset += (uint64_t)copied;
+    }
+#    else
+    UNREFERENCED_PARAMETER(sourceFd);
+    UNREFERENCED_PARAMETER(destFd);
+    UNREFERENCED_PARAMETER(offset);
+    return ENOSYS;
+#    endif
+}
+
+/**
+ * @brief Copies with a FICLONE reflink, which shares the extents of the whole file on copy-on-write file systems.
+ * @param sourceFd The source file descriptor.
+ * @param destFd The destination file descriptor. It must be empty.
+ * @param sourceSize The size of the source file.
+ * @param[in,out] offset The offset up to which the content was copied. It must be 0.
+ * @return int 0 if the content was copied, otherwise the errno of the failure.
+ */
+static int CopyWithReflink(int sourceFd, int destFd, uint64_t sourceSize, uint64_t* offset)
+{
+#    if defined(FICLONE)
+    if (*offset != 0)
+    {
+        return EINVAL;
+    }
+
+    if (ioctl(destFd, FICLONE, sourceFd) != 0)
+    {
+        return errno;
+    }
+
+    *offset = sourceSize;
+    return 0;
+#    else
+    UNREFERENCED_PARAMETER(sourceFd);
+    UNREFERENCED_PARAMETER(destFd);
+    UNREFERENCED_PARAMETER(sourceSize);
+    UNREFERENCED_PARAMETER(offset);
+    return ENOTTY;
+#    endif
+}
+
+/**
+ * @brief Copies with sendfile, which copies within the kernel without sharing extents.
+ * @param sourceFd The source file descriptor.
+ * @param destFd The destination file descriptor, positioned at @p offset.
+ * @param[in,out] offset The offset up to which the content was copied.
+ * @return int 0 if the content was copied to the end of the source file, otherwise the errno of the failure.
+ */
+static int CopyWithSendfile(int sourceFd, int destFd, uint64_t* offset)
+{
+    if (lseek(destFd, (off_t)*offset, SEEK_SET) < 0)
     {
+        return errno;
+    }
+
+    for (;;)
+    {
+        off_t sourceOffset = (off_t)*offset;
+
+        const ssize_t copied = sendfile(destFd, sourceFd, &sourceOffset, CopyFileMaxChunkSize);
+        if (copied < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno;
+        }
+
+        if (copied == 0)
+        {
+            return 0;
+        }
+
+        *offset += (uint64_t)copied;
+    }
+}
+
+#endif // __linux__
+
+/**
+ * @brief Copies through a large user space buffer.
+ * @param sourceFile The source file.
+ * @param destFile The destination file.
+ * @param[in,out] offset The offset up to which the content was copied.
+ * @return int 0 if the content was copied to the end of the source file, otherwise the errno of the failure.
+ */
+static int CopyWithBuffer(FILE* sourceFile, FILE* destFile, uint64_t* offset)
+{
+    int err = 0;
+    size_t readBytes = 0;
+
+    unsigned char* buffer = malloc(CopyFileBufferSize);
+    if (buffer == NULL)
+    {
+        return ENOMEM;
+    }
+
+    // Another method may have copied part of the content through the file descriptors.
+    if (fseeko(sourceFile, (off_t)*offset, SEEK_SET) != 0 || fseeko(destFile, (off_t)*offset, SEEK_SET) != 0)
+    {
+        err = errno;
         goto done;
     }
 
-    if (!ADUC_SystemUtils_FormatFilePathHelper(&destFilePath, filePath, dirPath))
+    while ((readBytes = fread(buffer, 1, CopyFileBufferSize, sourceFile)) != 0)
+    {
+        if (fwrite(buffer, 1, readBytes, destFile) != readBytes)
+        {
+            err = (errno != 0) ? errno : EIO;
+            goto done;
+        }
+
+        *offset += readBytes;
+    }
+
+    if (ferror(sourceFile) != 0)
+    {
+        err = (errno != 0) ? errno : EIO;
+        goto done;
+    }
+
+    if (fflush(destFile) != 0)
     {
+        err = errno;
         goto done;
     }
 
-    sourceFile = fopen(filePath, "rb");
+done:
+    free(buffer);
+    return err;
+}
+
+/**
+ * @brief Selects how ADUC_SystemUtils_CopyFile copies content, e.g. to compare the methods.
+ * @param method The method to use, falling back to the buffer if it is not supported.
+ * ADUC_SystemUtils_CopyMethod_Auto, the default, tries each method in turn.
+ */
+void ADUC_SystemUtils_SetFileCopyMethod(ADUC_SystemUtils_CopyMethod method)
+{
+    s_fileCopyMethod = method;
+}
+
+/**
+ * @brief Copies the file at @p sourceFilePath to @p destFilePath
+ * @details Preserves the filemode bit permissions. The copy is owned by the calling process.
+ * The content is copied with the first method that works for the two files: copy_file_range, a FICLONE reflink,
+ * sendfile, then a user space buffer.
+ * @param sourceFilePath path to the file
+ * @param destFilePath path to the copy
+ * @param overwriteExistingFile whether to overwrite the file at @p destFilePath if it exists
+ * @param[out] stats optional, how the content was copied
+ * @returns int 0 on success, otherwise the errno of the failure, or -1
+ */
+int ADUC_SystemUtils_CopyFile(
+    const char* sourceFilePath,
+    const char* destFilePath,
+    const bool overwriteExistingFile,
+    ADUC_SystemUtils_CopyFileStats* stats)
+{
+    int result = -1;
+    FILE* sourceFile = NULL;
+    FILE* destFile = NULL;
+    uint64_t offset = 0;
+    ADUC_SystemUtils_CopyMethod method = ADUC_SystemUtils_CopyMethod_Buffered;
+    struct stat sourceStat;
+
+    if (stats != NULL)
+    {
+        memset(stats, 0, sizeof(*stats));
+    }
+
+    if (sourceFilePath == NULL || destFilePath == NULL)
+    {
+        goto done;
+    }
+
+    sourceFile = fopen(sourceFilePath, "rb");
 
     if (sourceFile == NULL)
     {
+        result = errno;
+        goto done;
+    }
+
+    if (stat(sourceFilePath, &sourceStat) != 0)
+    {
+        result = errno;
         goto done;
     }
 
     if (overwriteExistingFile)
     {
-        destFile = fopen(STRING_c_str(destFilePath), "wb+");
+        destFile = fopen(destFilePath, "wb+");
     }
     else
     {
-        destFile = fopen(STRING_c_str(destFilePath), "wb");
+        destFile = fopen(destFilePath, "wb");
     }
 
     if (destFile == NULL)
     {
+        result = errno;
         goto done;
     }
 
-    size_t readBytes = fread(readBuff, readMaxBuffSize, sizeof(readBuff[0]), sourceFile);
-
-    while (readBytes != 0 && feof(sourceFile) != 0)
+#if defined(__linux__)
     {
-        const size_t writtenBytes = fwrite(readBuff, readBytes, sizeof(readBuff[0]), destFile);
-
-        result = ferror(destFile);
-        if (writtenBytes != readBytes || result != 0)
+        const int sourceFd = fileno(sourceFile);
+        const int destFd = fileno(destFile);
+        const ADUC_SystemUtils_CopyMethod firstMethod = s_fileCopyMethod;
+
+        // Try each kernel method in turn, unless a specific one was selected, and carry on from where the
+        // previous one stopped.
+        for (method = ADUC_SystemUtils_CopyMethod_CopyFileRange; method < ADUC_SystemUtils_CopyMethod_Buffered;
+             ++method)
         {
-            goto done;
+            if (firstMethod != ADUC_SystemUtils_CopyMethod_Auto && method != firstMethod)
+            {
+                continue;
+            }
+
+            int err = 0;
+            switch (method)
+            {
+            case ADUC_SystemUtils_CopyMethod_CopyFileRange:
+                err = CopyWithCopyFileRange(sourceFd, destFd, &offset);
+                break;
+
+            case ADUC_SystemUtils_CopyMethod_Reflink:
+                err = CopyWithReflink(sourceFd, destFd, (uint64_t)sourceStat.st_size, &offset);
+                break;
+
+            default:
+                err = CopyWithSendfile(sourceFd, destFd, &offset);
+                break;
+            }
+
+            if (err == 0)
+            {
+                // copy_file_range and sendfile also return 0 when the file system cannot copy the rest of the file,
+                // so finish a short copy through the buffer from where it stopped.
+                if (offset != (uint64_t)sourceStat.st_size)
+                {
+                    Log_Warn(
+                        "Copied %llu of %llu bytes of '%s' with method %d, copying the rest through a buffer",
+                        (unsigned long long)offset,
+                        (unsigned long long)sourceStat.st_size,
+                        sourceFilePath,
+                        (int)method);
+                    method = ADUC_SystemUtils_CopyMethod_Buffered;
+                }
+                break;
+            }
+
+            if (!IsCopyMethodUnsupported(err))
+            {
+                Log_Error("Cannot copy '%s' to '%s', errno %d", sourceFilePath, destFilePath, err);
+                result = err;
+                goto done;
+            }
         }
+    }
+#endif
 
-        readBytes = fread(readBuff, readMaxBuffSize, sizeof(readBuff[0]), sourceFile);
-        result = ferror(sourceFile);
-        if (result != 0)
+    if (method == ADUC_SystemUtils_CopyMethod_Buffered)
+    {
+        const int err = CopyWithBuffer(sourceFile, destFile, &offset);
+        if (err != 0)
         {
+            Log_Error("Cannot copy '%s' to '%s', errno %d", sourceFilePath, destFilePath, err);
+            result = err;
             goto done;
         }
     }
 
-    struct stat buff;
-    if (stat(filePath, &buff) != 0)
+    if (ADUCPAL_chmod(destFilePath, sourceStat.st_mode) != 0)
     {
+        result = errno;
         goto done;
     }
 
-    if (ADUCPAL_chmod(STRING_c_str(destFilePath), buff.st_mode) != 0)
+    if (stats != NULL)
     {
-        goto done;
+        stats->method = method;
+        stats->bytesCopied = offset;
     }
 
     result = 0;
 done:
 
-    fclose(sourceFile);
-    fclose(destFile);
+    if (sourceFile != NULL)
+    {
+        fclose(sourceFile);
+    }
 
-    if (result != 0)
+    if (destFile != NULL && fclose(destFile) != 0 && result == 0)
+    {
+        result = errno;
+    }
+
+    if (result != 0 && destFile != NULL)
     {
-        remove(STRING_c_str(destFilePath));
+        remove(destFilePath);
     }
 
+    return result;
+}
+
+/**
+ * @brief Copies the file at @p filePath to @p dirPath with the same name
+ * @details Preserves the filemode bit permissions. See ADUC_SystemUtils_CopyFile.
+ * @param filePath path to the file
+ * @param dirPath path to the directory
+ * @param overwriteExistingFile if set to true will overwrite the existing file in @p dirPath named with the filename in @p fileName if it exists
+ * @returns the result of the operation
+ */
+int ADUC_SystemUtils_CopyFileToDir(const char* filePath, const char* dirPath, const bool overwriteExistingFile)
+{
+    int result = -1;
+    STRING_HANDLE destFilePath = NULL;
+
+    if (filePath == NULL || dirPath == NULL)
+    {
+        goto done;
+    }
+
+    if (!ADUC_SystemUtils_FormatFilePathHelper(&destFilePath, filePath, dirPath))
+    {
+        goto done;
+    }
+
+    result = ADUC_SystemUtils_CopyFile(filePath, STRING_c_str(destFilePath), overwriteExistingFile, NULL /* stats */);
+
+done:
     STRING_delete(destFilePath);
     return result;
 }
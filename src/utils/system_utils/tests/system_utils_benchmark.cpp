@@ -0,0 +1,131 @@
+/**
+ * @file system_utils_benchmark.cpp
+ * @brief Compares the throughput of the methods ADUC_SystemUtils_CopyFile uses to copy content.
+ *
+ * @details Hidden from the default run, as it writes and copies a 1 GB file. Run it with:
+ *   system_utils_unit_tests "[benchmark]"
+ *
+ * The files are copied within the temporary directory; set TMPDIR to benchmark another file system, e.g. btrfs or
+ * XFS, where copy_file_range and reflinks share extents instead of copying them. Methods that the file system does
+ * not support fall back to the buffer, which the "used" column shows.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/system_utils.h"
+
+#include <catch2/catch_all.hpp>
+
+#include <chrono>
+#include <cstdio> // std::remove, printf
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+const char* GetCopyMethodName(ADUC_SystemUtils_CopyMethod method)
+{
+    switch (method)
+    {
+    case ADUC_SystemUtils_CopyMethod_CopyFileRange:
+        return "copy_file_range";
+    case ADUC_SystemUtils_CopyMethod_Reflink:
+        return "reflink";
+    case ADUC_SystemUtils_CopyMethod_Sendfile:
+        return "sendfile";
+    case ADUC_SystemUtils_CopyMethod_Buffered:
+        return "buffered";
+    default:
+        return "auto";
+    }
+}
+
+struct FileSize
+{
+    const char* name;
+    size_t sizeInBytes;
+    int iterations;
+};
+
+} // namespace
+
+TEST_CASE("ADUC_SystemUtils_CopyFile throughput", "[.hide][benchmark]")
+{
+    // clang-format off
+    const FileSize fileSize = GENERATE( // NOLINT(google-build-using-namespace)
+        FileSize{ "1 MB", 1024ULL * 1024, 20 },
+        FileSize{ "100 MB", 100ULL * 1024 * 1024, 3 },
+        FileSize{ "1 GB", 1024ULL * 1024 * 1024, 2 });
+    // clang-format on
+
+    const std::string testPath{ std::string{ ADUC_SystemUtils_GetTemporaryPathName() } + "/system_utils_benchmark" };
+    const std::string sourceFilePath{ testPath + "/source.bin" };
+    const std::string destFilePath{ testPath + "/dest.bin" };
+
+    (void)ADUC_SystemUtils_RmDirRecursive(testPath.c_str());
+    REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault(testPath.c_str()) == 0);
+
+    {
+        std::vector<char> chunk(1024 * 1024);
+        uint64_t state = 0x9E3779B97F4A7C15ULL;
+        std::ofstream file{ sourceFilePath, std::ios::trunc | std::ios::binary };
+
+        for (size_t written = 0; written < fileSize.sizeInBytes; written += chunk.size())
+        {
+            // xorshift64, so the content does not compress or deduplicate.
+            for (char& c : chunk)
+            {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                c = static_cast<char>(state);
+            }
+            file.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        }
+
+        REQUIRE(file.good());
+    }
+
+    for (const ADUC_SystemUtils_CopyMethod method : { ADUC_SystemUtils_CopyMethod_Auto,
+                                                      ADUC_SystemUtils_CopyMethod_CopyFileRange,
+                                                      ADUC_SystemUtils_CopyMethod_Reflink,
+                                                      ADUC_SystemUtils_CopyMethod_Sendfile,
+                                                      ADUC_SystemUtils_CopyMethod_Buffered })
+    {
+        using Clock = std::chrono::steady_clock;
+        double bestSeconds = 0;
+        ADUC_SystemUtils_CopyFileStats stats{};
+
+        ADUC_SystemUtils_SetFileCopyMethod(method);
+
+        for (int i = 0; i < fileSize.iterations; ++i)
+        {
+            // Copy to a new file each time, as reflinks require an empty destination.
+            (void)std::remove(destFilePath.c_str());
+
+            const Clock::time_point start = Clock::now();
+            REQUIRE(ADUC_SystemUtils_CopyFile(sourceFilePath.c_str(), destFilePath.c_str(), true, &stats) == 0);
+            const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+            REQUIRE(stats.bytesCopied == fileSize.sizeInBytes);
+
+            if (i == 0 || seconds < bestSeconds)
+            {
+                bestSeconds = seconds;
+            }
+        }
+
+        (void)std::remove(destFilePath.c_str());
+
+        printf(
+            "%-6s %-16s used %-16s %10.1f MB/s\n",
+            fileSize.name,
+            GetCopyMethodName(method),
+            GetCopyMethodName(stats.method),
+            (static_cast<double>(fileSize.sizeInBytes) / (1024.0 * 1024.0)) / bestSeconds);
+    }
+
+    ADUC_SystemUtils_SetFileCopyMethod(ADUC_SystemUtils_CopyMethod_Auto);
+    (void)ADUC_SystemUtils_RmDirRecursive(testPath.c_str());
+}
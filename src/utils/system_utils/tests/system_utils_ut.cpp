@@ -11,6 +11,8 @@ using Catch::Matchers::Equals;
 #include "aduc/system_utils.h"
 #include <aduc/auto_opendir.hpp>
 #include <aduc/string_handle_wrapper.hpp>
+#include <fstream>
+#include <sstream>
 #include <sys/stat.h>
 #include <vector>
 
@@ -485,3 +487,84 @@ TEST_CASE("ADUC_SystemUtils_FormatFilePathHelper")
         CHECK_THAT(STRING_c_str(newFilePath.get()), Equals("/path/to/folder/file.ext"));
     }
 }
+
+TEST_CASE_METHOD(TestCaseFixture, "ADUC_SystemUtils_CopyFile")
+{
+    REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault(TestPath()) == 0);
+
+    const std::string sourceFilePath{ std::string{ TestPath() } + "/source.bin" };
+    const std::string destDirPath{ std::string{ TestPath() } + "/dest" };
+    const std::string destFilePath{ destDirPath + "/source.bin" };
+
+    // Larger than the copy buffer, and not a multiple of it.
+    std::string content;
+    for (size_t i = 0; content.size() < 3 * 1024 * 1024 + 7; ++i)
+    {
+        content += std::to_string(i);
+    }
+
+    {
+        std::ofstream file{ sourceFilePath, std::ios::binary };
+        file << content;
+    }
+
+#if !defined(WIN32)
+    REQUIRE(chmod(sourceFilePath.c_str(), 0640) == 0);
+#endif
+
+    REQUIRE(ADUC_SystemUtils_MkDirRecursiveDefault(destDirPath.c_str()) == 0);
+
+    const auto readFile = [](const std::string& path) {
+        std::ifstream file{ path, std::ios::binary };
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        return buffer.str();
+    };
+
+    SECTION("Copy with each method")
+    {
+        // clang-format off
+        auto method = GENERATE( // NOLINT(google-build-using-namespace)
+            ADUC_SystemUtils_CopyMethod_Auto,
+            ADUC_SystemUtils_CopyMethod_CopyFileRange,
+            ADUC_SystemUtils_CopyMethod_Reflink,
+            ADUC_SystemUtils_CopyMethod_Sendfile,
+            ADUC_SystemUtils_CopyMethod_Buffered);
+        // clang-format on
+
+        INFO("method: " << method);
+        ADUC_SystemUtils_SetFileCopyMethod(method);
+
+        ADUC_SystemUtils_CopyFileStats stats{};
+        CHECK(ADUC_SystemUtils_CopyFile(sourceFilePath.c_str(), destFilePath.c_str(), true, &stats) == 0);
+        CHECK(stats.bytesCopied == content.size());
+        CHECK(stats.method != ADUC_SystemUtils_CopyMethod_Auto);
+        CHECK(readFile(destFilePath) == content);
+
+#if !defined(WIN32)
+        struct stat st = {};
+        REQUIRE(stat(destFilePath.c_str(), &st) == 0);
+        CHECK((st.st_mode & 0777) == 0640);
+#endif
+
+        ADUC_SystemUtils_SetFileCopyMethod(ADUC_SystemUtils_CopyMethod_Auto);
+    }
+
+    SECTION("Copy to directory replaces a larger file")
+    {
+        {
+            std::ofstream file{ destFilePath, std::ios::binary };
+            file << content << content;
+        }
+
+        CHECK(ADUC_SystemUtils_CopyFileToDir(sourceFilePath.c_str(), destDirPath.c_str(), true) == 0);
+        CHECK(readFile(destFilePath) == content);
+    }
+
+    SECTION("Copy missing file")
+    {
+        const std::string missingFilePath{ std::string{ TestPath() } + "/missing.bin" };
+        CHECK(ADUC_SystemUtils_CopyFile(missingFilePath.c_str(), destFilePath.c_str(), true, nullptr) != 0);
+        CHECK_FALSE(ADUC_SystemUtils_Exists(destFilePath.c_str()));
+    }
+}
@@ -0,0 +1,82 @@
+/**
+ * @file workflow_component_set.h
+ * @brief A shared, reference-counted set of selected components, parsed once and borrowed by child workflows.
+ *
+ * A set is created from the selected-components JSON string, as returned by a component enumerator, and keeps that
+ * string so that it is never serialized again. A single-component set is a view of one component of another set: it
+ * holds a reference to that set instead of a copy of the component, and is only serialized if its JSON string is
+ * asked for, e.g. by a step handler extension.
+ *
+ * All functions are thread-safe. A set never changes once created.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef WORKFLOW_COMPONENT_SET_H
+#define WORKFLOW_COMPONENT_SET_H
+
+#include <aduc/c_utils.h> // for EXTERN_C_BEGIN, EXTERN_C_END
+#include <parson.h>
+#include <stdbool.h>
+#include <stddef.h> // for size_t
+
+EXTERN_C_BEGIN
+
+typedef struct tagADUC_ComponentSet ADUC_ComponentSet;
+
+/**
+ * @brief Creates a set from a selected-components JSON string. The string is parsed the first time it is needed.
+ *
+ * @param componentsJson A JSON object with a 'components' array.
+ * @return ADUC_ComponentSet* The set, with one reference, or NULL if @p componentsJson is NULL or out of memory.
+ */
+ADUC_ComponentSet* ADUC_ComponentSet_CreateFromString(const char* componentsJson);
+
+/**
+ * @brief Creates a set of one component of another set, which it holds a reference to.
+ *
+ * @param componentSet The set.
+ * @param index The index of the component in @p componentSet.
+ * @return ADUC_ComponentSet* The set, with one reference, or NULL if @p index is out of range or out of memory.
+ */
+ADUC_ComponentSet* ADUC_ComponentSet_CreateSingle(ADUC_ComponentSet* componentSet, size_t index);
+
+/**
+ * @brief Adds a reference to a set.
+ *
+ * @return ADUC_ComponentSet* @p componentSet.
+ */
+ADUC_ComponentSet* ADUC_ComponentSet_AddRef(ADUC_ComponentSet* componentSet);
+
+/**
+ * @brief Releases a reference to a set, and frees it with the last one. Does nothing if @p componentSet is NULL.
+ */
+void ADUC_ComponentSet_Release(ADUC_ComponentSet* componentSet);
+
+/**
+ * @brief Tells whether the set's JSON is an object with a 'components' array.
+ */
+bool ADUC_ComponentSet_IsValid(ADUC_ComponentSet* componentSet);
+
+/**
+ * @brief Gets the number of components, or 0 if the set is not valid.
+ */
+size_t ADUC_ComponentSet_GetCount(ADUC_ComponentSet* componentSet);
+
+/**
+ * @brief Gets a component.
+ *
+ * @return const JSON_Object* The component, owned by the set, or NULL if @p index is out of range.
+ */
+const JSON_Object* ADUC_ComponentSet_GetComponent(ADUC_ComponentSet* componentSet, size_t index);
+
+/**
+ * @brief Gets the set as a selected-components JSON string, serializing it the first time if needed.
+ *
+ * @return const char* The string, owned by the set, or NULL if out of memory.
+ */
+const char* ADUC_ComponentSet_PeekString(ADUC_ComponentSet* componentSet);
+
+EXTERN_C_END
+
+#endif // WORKFLOW_COMPONENT_SET_H
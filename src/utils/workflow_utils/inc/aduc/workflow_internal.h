@@ -16,6 +16,9 @@
 #include <azure_c_shared_utility/vector.h>
 #include <parson.h>
 
+struct tagADUC_ComponentSet;
+struct tagADUC_ManifestIndex;
+
 /**
  * @brief A struct containing data needed for an update workflow.
  *
@@ -30,6 +33,7 @@ typedef struct tagADUC_Workflow
     JSON_Object* UpdateManifestObject; /**< The update manifest JSON object. */
     JSON_Object* PropertiesObject; /**< The Property JSON object. */
     JSON_Object* ResultsObject; /**< The results JSON object. */
+    struct tagADUC_ManifestIndex* ManifestIndex; /**< The indexed files and steps of UpdateManifestObject. */
 
     //
     // Mutable state used by the agent workflow orchestration.
@@ -50,6 +54,9 @@ typedef struct tagADUC_Workflow
     size_t ChildCount; /**< The count of children. */
     int Level; /**< The level of the workflow in the tree. */
     size_t StepIndex; /**< The step index for this workflow. */
+    struct tagADUC_ComponentSet*
+        SelectedComponents; /**< The components selected for this workflow, shared with the parent or children. */
+    bool KeepsRequests; /**< Whether reboot and agent restart requests are kept on this workflow, not on the root. */
 
     //
     // Operation worker state including state for handling cancellation and completion.
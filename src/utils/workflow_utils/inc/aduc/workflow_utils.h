@@ -12,6 +12,7 @@
 #include "aduc/result.h"
 #include "aduc/types/update_content.h"
 #include "aduc/types/workflow.h"
+#include "aduc/workflow_component_set.h"
 #include <azure_c_shared_utility/strings.h>
 
 #include <stdbool.h>
@@ -59,6 +60,21 @@ workflow_init_from_file(const char* updateManifestFile, bool validateManifest, A
  */
 ADUC_Result workflow_create_from_inline_step(ADUC_WorkflowHandle base, size_t stepIndex, ADUC_WorkflowHandle* handle);
 
+/**
+ * @brief Instantiate a workflow object for the @p base inline step that runs apart from the step's child workflow,
+ * e.g. to install the step on several components concurrently.
+ * @details Like a child of @p base, the workflow resolves its files and work folder through @p base. It is not one of
+ * the children of @p base, though, and it keeps its own reboot and agent restart requests instead of setting them on
+ * the root workflow, so that it does not change the workflow tree while it runs. Free it with workflow_free.
+ *
+ * @param base A source workflow object.
+ * @param stepIndex A step index.
+ * @param handle A workflow object handle with information about the workflow.
+ * @return ADUC_Result
+ */
+ADUC_Result
+workflow_create_detached_from_inline_step(ADUC_WorkflowHandle base, size_t stepIndex, ADUC_WorkflowHandle* handle);
+
 /**
  * @brief Transfer action data from @p sourceHandle to @p targetHandle.
  * The sourceHandle will no longer contains transferred action data.
@@ -213,21 +229,43 @@ char* workflow_get_root_sandbox_dir(const ADUC_WorkflowHandle handle);
 
 /**
  * @brief Sets selected-components (in a form of serialized json string) to be used in this workflow.
+ * @details The string is kept as is, and only parsed if the components are needed. See
+ * workflow_set_selected_component_set to share already selected components instead.
  *
  * @param handle A workflow data object handle.
- * @param selectedComponents Json string contains one or more components.
+ * @param selectedComponents Json string contains one or more components, or NULL to clear them.
  * @return Returns true if succeeded.
  */
 bool workflow_set_selected_components(ADUC_WorkflowHandle handle, const char* selectedComponents);
 
 /**
  * @brief Gets a reference to the selected-components JSON string.
+ * @details For a workflow given a single component with workflow_set_selected_component_set, the string is
+ * serialized the first time it is asked for.
  *
  * @param handle A workflow data object handle.
  * @return const char* Contain selected-components JSON. Caller must not free this string.
  */
 const char* workflow_peek_selected_components(ADUC_WorkflowHandle handle);
 
+/**
+ * @brief Shares a set of selected components with this workflow, which adds a reference to it.
+ *
+ * @param handle A workflow data object handle.
+ * @param componentSet The set, or NULL to clear the selected components.
+ * @return Returns true if succeeded.
+ */
+bool workflow_set_selected_component_set(ADUC_WorkflowHandle handle, ADUC_ComponentSet* componentSet);
+
+/**
+ * @brief Gets the set of selected components of this workflow, without parsing or copying them.
+ *
+ * @param handle A workflow data object handle.
+ * @return ADUC_ComponentSet* The set, or NULL if none. It is valid while the workflow holds it; call
+ * ADUC_ComponentSet_AddRef to keep it longer.
+ */
+ADUC_ComponentSet* workflow_peek_selected_component_set(ADUC_WorkflowHandle handle);
+
 /**
  * @brief Gets the update files count.
  *
@@ -256,6 +294,35 @@ bool workflow_get_update_file(ADUC_WorkflowHandle handle, size_t index, ADUC_Fil
  */
 bool workflow_get_update_file_by_name(ADUC_WorkflowHandle handle, const char* fileName, ADUC_FileEntity* entity);
 
+/**
+ * @brief Gets a read-only update file entity at the specified index, without copying it.
+ *
+ * @param handle A workflow data object handle.
+ * @param index An index of the file to get.
+ * @return const ADUC_FileEntity* The file entity, or NULL if not found or its metadata is incomplete.
+ * The entity, including its strings, hashes and related files, is owned by the workflow. Caller must not modify or
+ * uninitialize it, and must not use it after the workflow is freed, or its update action or manifest is replaced.
+ */
+const ADUC_FileEntity* workflow_peek_update_file(ADUC_WorkflowHandle handle, size_t index);
+
+/**
+ * @brief Gets a read-only update file entity by name, compared case-insensitively, without copying it.
+ *
+ * @param handle A workflow data object handle.
+ * @param fileName File name.
+ * @return const ADUC_FileEntity* The file entity, or NULL if not found. See workflow_peek_update_file for its lifetime.
+ */
+const ADUC_FileEntity* workflow_peek_update_file_by_name(ADUC_WorkflowHandle handle, const char* fileName);
+
+/**
+ * @brief Gets a read-only update file entity by file id, without copying it.
+ *
+ * @param handle A workflow data object handle.
+ * @param fileId The file id, the key of the file in the update manifest 'files' map.
+ * @return const ADUC_FileEntity* The file entity, or NULL if not found. See workflow_peek_update_file for its lifetime.
+ */
+const ADUC_FileEntity* workflow_peek_update_file_by_id(ADUC_WorkflowHandle handle, const char* fileId);
+
 /**
  * @brief Gets the inode associated with the update file entity at the specified index.
  *
@@ -0,0 +1,272 @@
+/**
+ * @file workflow_component_set.c
+ * @brief Implements the shared, reference-counted set of selected components.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/workflow_component_set.h"
+
+#include <pthread.h>
+#include <stdlib.h> // for calloc, free
+#include <string.h>
+
+#define COMPONENT_SET_FIELD_COMPONENTS "components"
+
+struct tagADUC_ComponentSet
+{
+    pthread_mutex_t Mutex; /**< Guards the reference count, and the parse and serialization below. */
+    size_t RefCount;
+
+    ADUC_ComponentSet* Parent; /**< For a single-component set, the set that holds the component. */
+    size_t ParentIndex; /**< For a single-component set, the index of the component in Parent. */
+
+    bool IsParsed; /**< Whether String was parsed. Only for a set created from a string. */
+    JSON_Value* RootValue; /**< The parsed String, or NULL if it is not valid JSON. */
+    JSON_Array* Components; /**< The 'components' array of RootValue, or NULL if the set is not valid. */
+
+    char* String; /**< The selected-components JSON string, or NULL if not serialized yet. */
+    bool IsStringSerialized; /**< Whether String was allocated by parson, rather than copied. */
+};
+
+/**
+ * @brief Parses the string of a set created from a string, once. Called with the set's mutex held.
+ */
+static void ComponentSet_EnsureParsed(ADUC_ComponentSet* componentSet)
+{
+    if (componentSet->IsParsed)
+    {
+        return;
+    }
+
+    componentSet->IsParsed = true;
+    componentSet->RootValue = json_parse_string(componentSet->String);
+    componentSet->Components =
+        json_object_get_array(json_value_get_object(componentSet->RootValue), COMPONENT_SET_FIELD_COMPONENTS);
+}
+
+/**
+ * @brief Gets the components array of a set created from a string, parsing it the first time.
+ */
+static JSON_Array* ComponentSet_GetComponentsArray(ADUC_ComponentSet* componentSet)
+{
+    JSON_Array* components = NULL;
+
+    pthread_mutex_lock(&componentSet->Mutex);
+    ComponentSet_EnsureParsed(componentSet);
+    components = componentSet->Components;
+    pthread_mutex_unlock(&componentSet->Mutex);
+
+    return components;
+}
+
+static ADUC_ComponentSet* ComponentSet_Alloc(void)
+{
+    ADUC_ComponentSet* componentSet = calloc(1, sizeof(*componentSet));
+    if (componentSet == NULL)
+    {
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&componentSet->Mutex, NULL) != 0)
+    {
+        free(componentSet);
+        return NULL;
+    }
+
+    componentSet->RefCount = 1;
+    return componentSet;
+}
+
+ADUC_ComponentSet* ADUC_ComponentSet_CreateFromString(const char* componentsJson)
+{
+    if (componentsJson == NULL)
+    {
+        return NULL;
+    }
+
+    ADUC_ComponentSet* componentSet = ComponentSet_Alloc();
+    if (componentSet == NULL)
+    {
+        return NULL;
+    }
+
+    const size_t size = strlen(componentsJson) + 1;
+    componentSet->String = malloc(size);
+    if (componentSet->String == NULL)
+    {
+        ADUC_ComponentSet_Release(componentSet);
+        return NULL;
+    }
+
+    memcpy(componentSet->String, componentsJson, size);
+    return componentSet;
+}
+
+ADUC_ComponentSet* ADUC_ComponentSet_CreateSingle(ADUC_ComponentSet* componentSet, size_t index)
+{
+    if (ADUC_ComponentSet_GetComponent(componentSet, index) == NULL)
+    {
+        return NULL;
+    }
+
+    // A view of a view refers to the set that holds the component, so that chains stay one level deep.
+    while (componentSet->Parent != NULL)
+    {
+        index = componentSet->ParentIndex;
+        componentSet = componentSet->Parent;
+    }
+
+    ADUC_ComponentSet* single = ComponentSet_Alloc();
+    if (single == NULL)
+    {
+        return NULL;
+    }
+
+    single->Parent = ADUC_ComponentSet_AddRef(componentSet);
+    single->ParentIndex = index;
+    return single;
+}
+
+ADUC_ComponentSet* ADUC_ComponentSet_AddRef(ADUC_ComponentSet* componentSet)
+{
+    if (componentSet != NULL)
+    {
+        pthread_mutex_lock(&componentSet->Mutex);
+        ++componentSet->RefCount;
+        pthread_mutex_unlock(&componentSet->Mutex);
+    }
+
+    return componentSet;
+}
+
+void ADUC_ComponentSet_Release(ADUC_ComponentSet* componentSet)
+{
+    if (componentSet == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&componentSet->Mutex);
+    const size_t refCount = --componentSet->RefCount;
+    pthread_mutex_unlock(&componentSet->Mutex);
+
+    if (refCount > 0)
+    {
+        return;
+    }
+
+    ADUC_ComponentSet_Release(componentSet->Parent);
+    json_value_free(componentSet->RootValue);
+
+    if (componentSet->IsStringSerialized)
+    {
+        json_free_serialized_string(componentSet->String);
+    }
+    else
+    {
+        free(componentSet->String);
+    }
+
+    pthread_mutex_destroy(&componentSet->Mutex);
+    free(componentSet);
+}
+
+bool ADUC_ComponentSet_IsValid(ADUC_ComponentSet* componentSet)
+{
+    if (componentSet == NULL)
+    {
+        return false;
+    }
+
+    // A single-component set is only created for an existing component.
+    return componentSet->Parent != NULL || ComponentSet_GetComponentsArray(componentSet) != NULL;
+}
+
+size_t ADUC_ComponentSet_GetCount(ADUC_ComponentSet* componentSet)
+{
+    if (componentSet == NULL)
+    {
+        return 0;
+    }
+
+    if (componentSet->Parent != NULL)
+    {
+        return 1;
+    }
+
+    return json_array_get_count(ComponentSet_GetComponentsArray(componentSet));
+}
+
+const JSON_Object* ADUC_ComponentSet_GetComponent(ADUC_ComponentSet* componentSet, size_t index)
+{
+    if (componentSet == NULL)
+    {
+        return NULL;
+    }
+
+    if (componentSet->Parent != NULL)
+    {
+        return index == 0 ? ADUC_ComponentSet_GetComponent(componentSet->Parent, componentSet->ParentIndex) : NULL;
+    }
+
+    return json_array_get_object(ComponentSet_GetComponentsArray(componentSet), index);
+}
+
+const char* ADUC_ComponentSet_PeekString(ADUC_ComponentSet* componentSet)
+{
+    const char* string = NULL;
+    JSON_Value* rootValue = NULL;
+    JSON_Value* componentsValue = NULL;
+    JSON_Value* componentValue = NULL;
+
+    if (componentSet == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&componentSet->Mutex);
+
+    if (componentSet->String != NULL)
+    {
+        string = componentSet->String;
+        goto done;
+    }
+
+    // Only a single-component set has no string yet. It is serialized as a set of its own, for step handlers.
+    componentValue = json_value_deep_copy(json_object_get_wrapping_value(
+        ADUC_ComponentSet_GetComponent(componentSet->Parent, componentSet->ParentIndex)));
+    componentsValue = json_value_init_array();
+    rootValue = json_value_init_object();
+    if (componentValue == NULL || componentsValue == NULL || rootValue == NULL)
+    {
+        goto done;
+    }
+
+    if (json_array_append_value(json_array(componentsValue), componentValue) != JSONSuccess)
+    {
+        goto done;
+    }
+
+    componentValue = NULL;
+
+    if (json_object_set_value(json_object(rootValue), COMPONENT_SET_FIELD_COMPONENTS, componentsValue) != JSONSuccess)
+    {
+        goto done;
+    }
+
+    componentsValue = NULL;
+
+    componentSet->String = json_serialize_to_string_pretty(rootValue);
+    componentSet->IsStringSerialized = true;
+    string = componentSet->String;
+
+done:
+    pthread_mutex_unlock(&componentSet->Mutex);
+
+    json_value_free(componentValue);
+    json_value_free(componentsValue);
+    json_value_free(rootValue);
+
+    return string;
+}
@@ -0,0 +1,704 @@
+/**
+ * @file workflow_manifest_index.c
+ * @brief Implements the immutable, indexed copy of the update manifest files and steps.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "workflow_manifest_index.h"
+#include "aduc/adu_types.h" // for ADUCITF_FIELDNAME_*
+#include "aduc/logging.h"
+
+#include <ctype.h> // for tolower
+#include <stdint.h> // for SIZE_MAX, uint32_t
+#include <stdlib.h> // for calloc, free
+#include <string.h>
+
+#include <aducpal/strings.h> // for strcasecmp
+
+#define STEP_PROPERTY_FIELD_TYPE "type"
+#define STEP_PROPERTY_FIELD_HANDLER "handler"
+#define STEP_PROPERTY_FIELD_DETACHED_MANIFEST_FILE_ID "detachedManifestFileId"
+
+/**
+ * @brief The default size of an arena block. Larger allocations get a block of their own.
+ */
+#define MANIFEST_ARENA_BLOCK_SIZE (16 * 1024)
+
+/**
+ * @brief The minimum capacity of the lookup tables. Capacities are powers of two.
+ */
+#define MANIFEST_TABLE_MIN_CAPACITY 16
+
+/**
+ * @brief A type with the strictest alignment needed by the objects stored in the arena.
+ */
+typedef union tagADUC_ManifestArenaAlign
+{
+    void* p;
+    long long ll;
+    long double ld;
+} ADUC_ManifestArenaAlign;
+
+typedef struct tagADUC_ManifestArenaBlock
+{
+    struct tagADUC_ManifestArenaBlock* Next;
+    size_t Capacity; /**< The capacity of Data, in bytes. */
+    size_t Used; /**< The bytes of Data already allocated. */
+    ADUC_ManifestArenaAlign Data[];
+} ADUC_ManifestArenaBlock;
+
+/**
+ * @brief The string interning table used while building the index.
+ * Equal strings, e.g. hash algorithms, download handler ids and property names, are stored only once in the arena.
+ */
+typedef struct tagADUC_ManifestStringTable
+{
+    const char** Slots;
+    size_t Capacity;
+    size_t Count;
+} ADUC_ManifestStringTable;
+
+struct tagADUC_ManifestIndex
+{
+    ADUC_ManifestArenaBlock* Blocks; /**< The arena holding everything below. */
+
+    ADUC_FileEntity* Files; /**< The update files, in the order of the 'files' map. */
+    ADUC_ManifestFileStatus* FileStatuses; /**< The status of each file. */
+    size_t FileCount;
+    bool HasUnresolvedUrls;
+
+    size_t* FileIdSlots; /**< Open-addressing table of file index + 1, keyed by file id. 0 is an empty slot. */
+    size_t* FileNameSlots; /**< Same, keyed by the lowercase file name. */
+    size_t FileSlotMask; /**< The capacity of the file tables, minus one. */
+
+    ADUC_ManifestStep* Steps;
+    bool* StepIsValid; /**< Whether each step is a JSON object. */
+    size_t StepCount;
+};
+
+//
+// Arena
+//
+
+/**
+ * @brief Allocates @p size zeroed bytes, aligned on @p align bytes, from the arena of @p index.
+ * Strings are allocated with an alignment of 1, so that they are packed.
+ */
+static void* Arena_Alloc(ADUC_ManifestIndex* index, size_t size, size_t align)
+{
+    if (size > SIZE_MAX / 2)
+    {
+        return NULL;
+    }
+
+    ADUC_ManifestArenaBlock* block = index->Blocks;
+    size_t offset = block == NULL ? 0 : (block->Used + align - 1) / align * align;
+
+    if (block == NULL || offset > block->Capacity || block->Capacity - offset < size)
+    {
+        const size_t capacity = size > MANIFEST_ARENA_BLOCK_SIZE ? size : MANIFEST_ARENA_BLOCK_SIZE;
+
+        // calloc, so that everything allocated from the arena starts zeroed.
+        // Data of a new block is aligned for any type.
+        block = calloc(1, sizeof(*block) + capacity);
+        if (block == NULL)
+        {
+            return NULL;
+        }
+
+        block->Capacity = capacity;
+        offset = 0;
+
+        if (capacity == size && index->Blocks != NULL)
+        {
+            // A block of its own: keep allocating from the current block, which still has room.
+            block->Next = index->Blocks->Next;
+            index->Blocks->Next = block;
+        }
+        else
+        {
+            block->Next = index->Blocks;
+            index->Blocks = block;
+        }
+    }
+
+    block->Used = offset + size;
+    return (unsigned char*)block->Data + offset;
+}
+
+static void* Arena_AllocArray(ADUC_ManifestIndex* index, size_t count, size_t elementSize)
+{
+    if (elementSize != 0 && count > SIZE_MAX / elementSize)
+    {
+        return NULL;
+    }
+
+    return Arena_Alloc(index, count * elementSize, sizeof(ADUC_ManifestArenaAlign));
+}
+
+static void Arena_Free(ADUC_ManifestIndex* index)
+{
+    ADUC_ManifestArenaBlock* block = index->Blocks;
+    while (block != NULL)
+    {
+        ADUC_ManifestArenaBlock* next = block->Next;
+        free(block);
+        block = next;
+    }
+
+    index->Blocks = NULL;
+}
+
+//
+// Lookup tables
+//
+
+static size_t HashString(const char* s, bool ignoreCase)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (; *s != '\0'; ++s)
+    {
+        unsigned char c = (unsigned char)*s;
+        h ^= ignoreCase ? (unsigned char)tolower(c) : c;
+        h *= 16777619u;
+    }
+
+    return (size_t)h;
+}
+
+static size_t TableCapacityFor(size_t count)
+{
+    size_t capacity = MANIFEST_TABLE_MIN_CAPACITY;
+    while (capacity < count * 2)
+    {
+        capacity *= 2;
+    }
+
+    return capacity;
+}
+
+/**
+ * @brief Returns the interned copy of @p s, copying it into the arena the first time it is seen.
+ *
+ * @return const char* The interned string; NULL if @p s is NULL, or if out of memory (then *oom is set).
+ */
+static const char*
+Intern(ADUC_ManifestIndex* index, ADUC_ManifestStringTable* table, const char* s, bool* oom)
+{
+    if (s == NULL)
+    {
+        return NULL;
+    }
+
+    if ((table->Count + 1) * 2 > table->Capacity)
+    {
+        const size_t capacity = TableCapacityFor(table->Count + 1);
+        const char** slots = calloc(capacity, sizeof(*slots));
+        if (slots == NULL)
+        {
+            *oom = true;
+            return NULL;
+        }
+
+        for (size_t i = 0; i < table->Capacity; ++i)
+        {
+            if (table->Slots[i] != NULL)
+            {
+                size_t slot = HashString(table->Slots[i], false) & (capacity - 1);
+                while (slots[slot] != NULL)
+                {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                slots[slot] = table->Slots[i];
+            }
+        }
+
+        free(table->Slots);
+        table->Slots = slots;
+        table->Capacity = capacity;
+    }
+
+    size_t slot = HashString(s, false) & (table->Capacity - 1);
+    while (table->Slots[slot] != NULL)
+    {
+        if (strcmp(table->Slots[slot], s) == 0)
+        {
+            return table->Slots[slot];
+        }
+
+        slot = (slot + 1) & (table->Capacity - 1);
+    }
+
+    const size_t size = strlen(s) + 1;
+    char* copy = Arena_Alloc(index, size, 1);
+    if (copy == NULL)
+    {
+        *oom = true;
+        return NULL;
+    }
+
+    memcpy(copy, s, size);
+    table->Slots[slot] = copy;
+    ++table->Count;
+    return copy;
+}
+
+/**
+ * @brief Adds file @p fileIndex under @p key, unless a previous file already has that key.
+ */
+static void FileTable_Add(size_t* slots, size_t mask, const ADUC_FileEntity* files, size_t fileIndex, bool byName)
+{
+    const char* key = byName ? files[fileIndex].TargetFilename : files[fileIndex].FileId;
+    if (key == NULL)
+    {
+        return;
+    }
+
+    size_t slot = HashString(key, byName) & mask;
+    while (slots[slot] != 0)
+    {
+        const ADUC_FileEntity* other = files + slots[slot] - 1;
+        if (byName ? ADUCPAL_strcasecmp(other->TargetFilename, key) == 0 : strcmp(other->FileId, key) == 0)
+        {
+            return;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    slots[slot] = fileIndex + 1;
+}
+
+static bool FileTable_Find(const ADUC_ManifestIndex* index, const char* key, bool byName, size_t* fileIndex)
+{
+    if (index == NULL || key == NULL || index->FileCount == 0)
+    {
+        return false;
+    }
+
+    const size_t* slots = byName ? index->FileNameSlots : index->FileIdSlots;
+    size_t slot = HashString(key, byName) & index->FileSlotMask;
+    while (slots[slot] != 0)
+    {
+        const ADUC_FileEntity* file = index->Files + slots[slot] - 1;
+        if (byName ? ADUCPAL_strcasecmp(file->TargetFilename, key) == 0 : strcmp(file->FileId, key) == 0)
+        {
+            if (fileIndex != NULL)
+            {
+                *fileIndex = slots[slot] - 1;
+            }
+            return true;
+        }
+
+        slot = (slot + 1) & index->FileSlotMask;
+    }
+
+    return false;
+}
+
+//
+// Builder
+//
+
+typedef struct tagADUC_ManifestIndexBuilder
+{
+    ADUC_ManifestIndex* Index;
+    ADUC_ManifestStringTable Strings;
+    const JSON_Object* const* FileUrlsMaps;
+    size_t FileUrlsMapCount;
+    bool OutOfMemory;
+} ADUC_ManifestIndexBuilder;
+
+static const char* Builder_Intern(ADUC_ManifestIndexBuilder* builder, const char* s)
+{
+    return Intern(builder->Index, &builder->Strings, s, &builder->OutOfMemory);
+}
+
+static const char* Builder_ResolveUrl(ADUC_ManifestIndexBuilder* builder, const char* fileId)
+{
+    for (size_t i = 0; i < builder->FileUrlsMapCount; ++i)
+    {
+        const char* uri = json_object_get_string(builder->FileUrlsMaps[i], fileId);
+        if (uri != NULL)
+        {
+            return Builder_Intern(builder, uri);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Copies a 'hashes' map into a flat array in the arena.
+ * @return bool false if the map is missing or empty, or has a non-string value.
+ */
+static bool Builder_AddHashes(
+    ADUC_ManifestIndexBuilder* builder, const JSON_Object* hashesObj, ADUC_Hash** hashes, size_t* hashCount)
+{
+    const size_t count = json_object_get_count(hashesObj);
+    if (count == 0)
+    {
+        return false;
+    }
+
+    ADUC_Hash* array = Arena_AllocArray(builder->Index, count, sizeof(*array));
+    if (array == NULL)
+    {
+        builder->OutOfMemory = true;
+        return false;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const char* value = json_value_get_string(json_object_get_value_at(hashesObj, i));
+        if (value == NULL)
+        {
+            return false;
+        }
+
+        // ADUC_Hash members are not const, but the index never modifies them.
+        array[i].type = (char*)Builder_Intern(builder, json_object_get_name(hashesObj, i));
+        array[i].value = (char*)Builder_Intern(builder, value);
+    }
+
+    *hashes = array;
+    *hashCount = count;
+    return !builder->OutOfMemory;
+}
+
+static size_t GetSizeInBytes(const JSON_Object* file)
+{
+    if (!json_object_has_value(file, ADUCITF_FIELDNAME_SIZEINBYTES))
+    {
+        return 0;
+    }
+
+    return (size_t)json_object_get_number(file, ADUCITF_FIELDNAME_SIZEINBYTES);
+}
+
+static ADUC_ManifestFileStatus
+Builder_AddRelatedFiles(ADUC_ManifestIndexBuilder* builder, const JSON_Object* relatedFilesObj, ADUC_FileEntity* entity)
+{
+    const size_t count = json_object_get_count(relatedFilesObj);
+    if (count == 0)
+    {
+        return ADUC_ManifestFileStatus_InvalidMetadata;
+    }
+
+    ADUC_RelatedFile* relatedFiles = Arena_AllocArray(builder->Index, count, sizeof(*relatedFiles));
+    if (relatedFiles == NULL)
+    {
+        builder->OutOfMemory = true;
+        return ADUC_ManifestFileStatus_InvalidMetadata;
+    }
+
+    entity->RelatedFiles = relatedFiles;
+    entity->RelatedFileCount = count;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        ADUC_RelatedFile* relatedFile = relatedFiles + i;
+        const JSON_Object* relatedFileObj = json_value_get_object(json_object_get_value_at(relatedFilesObj, i));
+        const char* fileId = json_object_get_name(relatedFilesObj, i);
+
+        if (relatedFileObj == NULL || fileId == NULL || *fileId == '\0')
+        {
+            return ADUC_ManifestFileStatus_InvalidMetadata;
+        }
+
+        relatedFile->FileId = (char*)Builder_Intern(builder, fileId);
+        relatedFile->DownloadUri = (char*)Builder_ResolveUrl(builder, fileId);
+        if (relatedFile->DownloadUri == NULL)
+        {
+            return ADUC_ManifestFileStatus_UrlNotFound;
+        }
+
+        relatedFile->FileName = (char*)Builder_Intern(builder, json_object_get_string(relatedFileObj, "fileName"));
+        relatedFile->SizeInBytes = GetSizeInBytes(relatedFileObj);
+        if (relatedFile->FileName == NULL
+            || !Builder_AddHashes(
+                builder, json_object_get_object(relatedFileObj, "hashes"), &relatedFile->Hash, &relatedFile->HashCount))
+        {
+            return ADUC_ManifestFileStatus_InvalidMetadata;
+        }
+
+        const JSON_Object* propertiesObj = json_object_get_object(relatedFileObj, "properties");
+        const size_t propertiesCount = json_object_get_count(propertiesObj);
+        if (propertiesCount == 0)
+        {
+            return ADUC_ManifestFileStatus_InvalidMetadata;
+        }
+
+        ADUC_Property* properties = Arena_AllocArray(builder->Index, propertiesCount, sizeof(*properties));
+        if (properties == NULL)
+        {
+            builder->OutOfMemory = true;
+            return ADUC_ManifestFileStatus_InvalidMetadata;
+        }
+
+        for (size_t j = 0; j < propertiesCount; ++j)
+        {
+            const char* value = json_value_get_string(json_object_get_value_at(propertiesObj, j));
+            if (value == NULL)
+            {
+                return ADUC_ManifestFileStatus_InvalidMetadata;
+            }
+
+            properties[j].Name = (char*)Builder_Intern(builder, json_object_get_name(propertiesObj, j));
+            properties[j].Value = (char*)Builder_Intern(builder, value);
+        }
+
+        relatedFile->Properties = properties;
+        relatedFile->PropertiesCount = propertiesCount;
+    }
+
+    return ADUC_ManifestFileStatus_Ok;
+}
+
+/**
+ * @brief Fills @p entity from the JSON @p file, checking it the same way workflow_get_update_file always has.
+ */
+static ADUC_ManifestFileStatus Builder_AddFile(
+    ADUC_ManifestIndexBuilder* builder, const char* fileId, const JSON_Object* file, ADUC_FileEntity* entity)
+{
+    entity->FileId = (char*)Builder_Intern(builder, fileId);
+    if (file == NULL)
+    {
+        return ADUC_ManifestFileStatus_InvalidMetadata;
+    }
+
+    entity->TargetFilename = (char*)Builder_Intern(builder, json_object_get_string(file, ADUCITF_FIELDNAME_FILENAME));
+    entity->Arguments = (char*)Builder_Intern(builder, json_object_get_string(file, ADUCITF_FIELDNAME_ARGUMENTS));
+    entity->SizeInBytes = GetSizeInBytes(file);
+
+    entity->DownloadUri = (char*)Builder_ResolveUrl(builder, fileId);
+    if (entity->DownloadUri == NULL)
+    {
+        return ADUC_ManifestFileStatus_UrlNotFound;
+    }
+
+    if (entity->TargetFilename == NULL
+        || !Builder_AddHashes(
+            builder, json_object_get_object(file, ADUCITF_FIELDNAME_HASHES), &entity->Hash, &entity->HashCount))
+    {
+        return ADUC_ManifestFileStatus_InvalidMetadata;
+    }
+
+    const JSON_Object* downloadHandlerObj = json_object_get_object(file, ADUCITF_FIELDNAME_DOWNLOADHANDLER);
+    if (downloadHandlerObj == NULL)
+    {
+        // Related files are only used by download handlers.
+        return ADUC_ManifestFileStatus_Ok;
+    }
+
+    const char* downloadHandlerId = json_object_get_string(downloadHandlerObj, ADUCITF_FIELDNAME_DOWNLOADHANDLER_ID);
+    if (downloadHandlerId == NULL || *downloadHandlerId == '\0')
+    {
+        return ADUC_ManifestFileStatus_InvalidMetadata;
+    }
+
+    entity->DownloadHandlerId = (char*)Builder_Intern(builder, downloadHandlerId);
+
+    const JSON_Object* relatedFilesObj = json_object_get_object(file, ADUCITF_FIELDNAME_RELATEDFILES);
+    if (relatedFilesObj == NULL)
+    {
+        return ADUC_ManifestFileStatus_Ok;
+    }
+
+    return Builder_AddRelatedFiles(builder, relatedFilesObj, entity);
+}
+
+static bool Builder_AddFiles(ADUC_ManifestIndexBuilder* builder, const JSON_Object* files)
+{
+    ADUC_ManifestIndex* index = builder->Index;
+    const size_t count = json_object_get_count(files);
+    if (count == 0)
+    {
+        return true;
+    }
+
+    const size_t capacity = TableCapacityFor(count);
+
+    index->Files = Arena_AllocArray(index, count, sizeof(*index->Files));
+    index->FileStatuses = Arena_AllocArray(index, count, sizeof(*index->FileStatuses));
+    index->FileIdSlots = Arena_AllocArray(index, capacity, sizeof(*index->FileIdSlots));
+    index->FileNameSlots = Arena_AllocArray(index, capacity, sizeof(*index->FileNameSlots));
+    if (index->Files == NULL || index->FileStatuses == NULL || index->FileIdSlots == NULL
+        || index->FileNameSlots == NULL)
+    {
+        return false;
+    }
+
+    index->FileCount = count;
+    index->FileSlotMask = capacity - 1;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const JSON_Object* file = json_value_get_object(json_object_get_value_at(files, i));
+        const ADUC_ManifestFileStatus status =
+            Builder_AddFile(builder, json_object_get_name(files, i), file, index->Files + i);
+        if (builder->OutOfMemory)
+        {
+            return false;
+        }
+
+        index->FileStatuses[i] = status;
+        if (status == ADUC_ManifestFileStatus_UrlNotFound)
+        {
+            index->HasUnresolvedUrls = true;
+        }
+
+        FileTable_Add(index->FileIdSlots, index->FileSlotMask, index->Files, i, false /* byName */);
+        FileTable_Add(index->FileNameSlots, index->FileSlotMask, index->Files, i, true /* byName */);
+    }
+
+    return true;
+}
+
+static bool Builder_AddSteps(ADUC_ManifestIndexBuilder* builder, const JSON_Array* steps)
+{
+    ADUC_ManifestIndex* index = builder->Index;
+    const size_t count = json_array_get_count(steps);
+    if (count == 0)
+    {
+        return true;
+    }
+
+    index->Steps = Arena_AllocArray(index, count, sizeof(*index->Steps));
+    index->StepIsValid = Arena_AllocArray(index, count, sizeof(*index->StepIsValid));
+    if (index->Steps == NULL || index->StepIsValid == NULL)
+    {
+        return false;
+    }
+
+    index->StepCount = count;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const JSON_Object* step = json_array_get_object(steps, i);
+        if (step == NULL)
+        {
+            continue;
+        }
+
+        index->StepIsValid[i] = true;
+        index->Steps[i].Type = Builder_Intern(builder, json_object_get_string(step, STEP_PROPERTY_FIELD_TYPE));
+        index->Steps[i].Handler = Builder_Intern(builder, json_object_get_string(step, STEP_PROPERTY_FIELD_HANDLER));
+        index->Steps[i].DetachedManifestFileId =
+            Builder_Intern(builder, json_object_get_string(step, STEP_PROPERTY_FIELD_DETACHED_MANIFEST_FILE_ID));
+    }
+
+    return !builder->OutOfMemory;
+}
+
+ADUC_ManifestIndex* ADUC_ManifestIndex_Create(
+    const JSON_Object* files,
+    const JSON_Array* steps,
+    const JSON_Object* const* fileUrlsMaps,
+    size_t fileUrlsMapCount)
+{
+    bool succeeded = false;
+    ADUC_ManifestIndexBuilder builder;
+    memset(&builder, 0, sizeof(builder));
+
+    builder.FileUrlsMaps = fileUrlsMaps;
+    builder.FileUrlsMapCount = fileUrlsMaps == NULL ? 0 : fileUrlsMapCount;
+
+    builder.Index = calloc(1, sizeof(*builder.Index));
+    if (builder.Index == NULL)
+    {
+        goto done;
+    }
+
+    if (!Builder_AddFiles(&builder, files))
+    {
+        goto done;
+    }
+
+    if (!Builder_AddSteps(&builder, steps))
+    {
+        goto done;
+    }
+
+    succeeded = true;
+
+done:
+    free(builder.Strings.Slots);
+
+    if (!succeeded)
+    {
+        Log_Error("Failed to index the update manifest: out of memory");
+        ADUC_ManifestIndex_Free(builder.Index);
+        builder.Index = NULL;
+    }
+
+    return builder.Index;
+}
+
+void ADUC_ManifestIndex_Free(ADUC_ManifestIndex* index)
+{
+    if (index == NULL)
+    {
+        return;
+    }
+
+    Arena_Free(index);
+    free(index);
+}
+
+//
+// Accessors
+//
+
+size_t ADUC_ManifestIndex_GetFileCount(const ADUC_ManifestIndex* index)
+{
+    return index == NULL ? 0 : index->FileCount;
+}
+
+const ADUC_FileEntity*
+ADUC_ManifestIndex_GetFile(const ADUC_ManifestIndex* index, size_t fileIndex, ADUC_ManifestFileStatus* status)
+{
+    if (index == NULL || fileIndex >= index->FileCount)
+    {
+        return NULL;
+    }
+
+    if (status != NULL)
+    {
+        *status = index->FileStatuses[fileIndex];
+    }
+
+    return index->Files + fileIndex;
+}
+
+bool ADUC_ManifestIndex_FindFileById(const ADUC_ManifestIndex* index, const char* fileId, size_t* fileIndex)
+{
+    return FileTable_Find(index, fileId, false /* byName */, fileIndex);
+}
+
+bool ADUC_ManifestIndex_FindFileByName(const ADUC_ManifestIndex* index, const char* fileName, size_t* fileIndex)
+{
+    return FileTable_Find(index, fileName, true /* byName */, fileIndex);
+}
+
+bool ADUC_ManifestIndex_HasUnresolvedUrls(const ADUC_ManifestIndex* index)
+{
+    return index != NULL && index->HasUnresolvedUrls;
+}
+
+size_t ADUC_ManifestIndex_GetStepCount(const ADUC_ManifestIndex* index)
+{
+    return index == NULL ? 0 : index->StepCount;
+}
+
+const ADUC_ManifestStep* ADUC_ManifestIndex_GetStep(const ADUC_ManifestIndex* index, size_t stepIndex)
+{
+    if (index == NULL || stepIndex >= index->StepCount || !index->StepIsValid[stepIndex])
+    {
+        return NULL;
+    }
+
+    return index->Steps + stepIndex;
+}
@@ -0,0 +1,103 @@
+/**
+ * @file workflow_manifest_index.h
+ * @brief An immutable, indexed copy of the update manifest files and steps.
+ *
+ * The index is built once per update manifest. All of its strings, hash arrays and related files live in a single
+ * arena that is released by ADUC_ManifestIndex_Free, so lookups neither walk the JSON objects nor allocate.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#ifndef WORKFLOW_MANIFEST_INDEX_H
+#define WORKFLOW_MANIFEST_INDEX_H
+
+#include <aduc/c_utils.h> // for EXTERN_C_BEGIN, EXTERN_C_END
+#include <aduc/types/update_content.h> // for ADUC_FileEntity
+#include <parson.h>
+#include <stdbool.h>
+#include <stddef.h> // for size_t
+
+EXTERN_C_BEGIN
+
+/**
+ * @brief Whether an indexed update file can be used.
+ */
+typedef enum tagADUC_ManifestFileStatus
+{
+    ADUC_ManifestFileStatus_Ok = 0, /**< The file entity is complete. */
+    ADUC_ManifestFileStatus_UrlNotFound = 1, /**< No fileUrls map has a URL for the file, or for a related file. */
+    ADUC_ManifestFileStatus_InvalidMetadata = 2, /**< The file name, hashes or download handler are invalid. */
+} ADUC_ManifestFileStatus;
+
+/**
+ * @brief An update manifest step, as indexed.
+ */
+typedef struct tagADUC_ManifestStep
+{
+    const char* Type; /**< The 'type' property, or NULL if not specified. */
+    const char* Handler; /**< The 'handler' property, or NULL for a reference step. */
+    const char* DetachedManifestFileId; /**< The 'detachedManifestFileId' property, or NULL for an inline step. */
+} ADUC_ManifestStep;
+
+typedef struct tagADUC_ManifestIndex ADUC_ManifestIndex;
+
+/**
+ * @brief Builds the index of an update manifest.
+ *
+ * @param files The 'files' map of the update manifest. May be NULL.
+ * @param steps The 'instructions.steps' array of the update manifest. May be NULL.
+ * @param fileUrlsMaps The 'fileUrls' maps used to resolve the download URIs, searched in order.
+ * @param fileUrlsMapCount The count of @p fileUrlsMaps.
+ * @return ADUC_ManifestIndex* The index, or NULL if out of memory. Must be freed with ADUC_ManifestIndex_Free.
+ */
+ADUC_ManifestIndex* ADUC_ManifestIndex_Create(
+    const JSON_Object* files,
+    const JSON_Array* steps,
+    const JSON_Object* const* fileUrlsMaps,
+    size_t fileUrlsMapCount);
+
+void ADUC_ManifestIndex_Free(ADUC_ManifestIndex* index);
+
+size_t ADUC_ManifestIndex_GetFileCount(const ADUC_ManifestIndex* index);
+
+/**
+ * @brief Gets an indexed update file.
+ *
+ * @param index The index.
+ * @param fileIndex The index of the file in the 'files' map.
+ * @param[out] status The status of the file. May be NULL.
+ * @return const ADUC_FileEntity* The file entity, owned by the index, or NULL if @p fileIndex is out of range.
+ * The entity is returned even if it is incomplete; check @p status before using it.
+ */
+const ADUC_FileEntity*
+ADUC_ManifestIndex_GetFile(const ADUC_ManifestIndex* index, size_t fileIndex, ADUC_ManifestFileStatus* status);
+
+/**
+ * @brief Finds the index of the update file with the given id.
+ * @return bool true if found.
+ */
+bool ADUC_ManifestIndex_FindFileById(const ADUC_ManifestIndex* index, const char* fileId, size_t* fileIndex);
+
+/**
+ * @brief Finds the index of the first update file with the given file name, compared case-insensitively.
+ * @return bool true if found.
+ */
+bool ADUC_ManifestIndex_FindFileByName(const ADUC_ManifestIndex* index, const char* fileName, size_t* fileIndex);
+
+/**
+ * @brief Returns whether a file or related file had no URL in any of the fileUrls maps.
+ * Such an index must be rebuilt once more fileUrls maps are available, e.g. when the workflow gets a parent.
+ */
+bool ADUC_ManifestIndex_HasUnresolvedUrls(const ADUC_ManifestIndex* index);
+
+size_t ADUC_ManifestIndex_GetStepCount(const ADUC_ManifestIndex* index);
+
+/**
+ * @brief Gets an indexed step.
+ * @return const ADUC_ManifestStep* The step, owned by the index, or NULL if out of range or not a JSON object.
+ */
+const ADUC_ManifestStep* ADUC_ManifestIndex_GetStep(const ADUC_ManifestIndex* index, size_t stepIndex);
+
+EXTERN_C_END
+
+#endif // WORKFLOW_MANIFEST_INDEX_H
@@ -26,8 +26,10 @@
 #include "azure_c_shared_utility/strings.h" // for STRING_*
 #include "jws_utils.h"
 #include "root_key_util.h"
+#include "workflow_manifest_index.h"
 
 #include <parson.h>
+#include <pthread.h>
 #include <stdarg.h> // for va_*
 #include <stdlib.h> // for malloc, atoi
 #include <string.h>
@@ -47,14 +49,11 @@
 #define WORKFLOW_PROPERTY_FIELD_IMMEDIATE_REBOOT_REQUESTED "_immediateRebootRequested"
 #define WORKFLOW_PROPERTY_FIELD_AGENT_RESTART_REQUESTED "_agentRestartRequested"
 #define WORKFLOW_PROPERTY_FIELD_IMMEDIATE_AGENT_RESTART_REQUESTED "_immediateAgentRestartRequested"
-#define WORKFLOW_PROPERTY_FIELD_SELECTED_COMPONENTS "_selectedComponents"
 
 // V4 and later.
 #define DEFAULT_STEP_TYPE "reference"
 #define WORKFLOW_PROPERTY_FIELD_INSTRUCTIONS_DOT_STEPS "instructions.steps"
 #define UPDATE_MANIFEST_PROPERTY_FIELD_DETACHED_MANIFEST_FILE_ID "detachedManifestFileId"
-#define STEP_PROPERTY_FIELD_DETACHED_MANIFEST_FILE_ID UPDATE_MANIFEST_PROPERTY_FIELD_DETACHED_MANIFEST_FILE_ID
-#define STEP_PROPERTY_FIELD_TYPE "type"
 #define STEP_PROPERTY_FIELD_HANDLER "handler"
 #define STEP_PROPERTY_FIELD_FILES "files"
 #define STEP_PROPERTY_FIELD_HANDLER_PROPERTIES "handlerProperties"
@@ -72,6 +71,9 @@ extern ExtensionManager_Download_Options Default_ExtensionManager_Download_Optio
 
 // forward decls
 const JSON_Object* _workflow_get_fileurls_map(ADUC_WorkflowHandle handle);
+const JSON_Object* _workflow_get_update_manifest_files_map(ADUC_WorkflowHandle handle);
+static JSON_Array* workflow_get_instructions_steps_array(ADUC_WorkflowHandle handle);
+void workflow_set_parent(ADUC_WorkflowHandle handle, ADUC_WorkflowHandle parent);
 
 //
 // Private functions - this is an adapter for the underlying ADUC_Workflow object.
@@ -156,66 +158,6 @@ static void ADUC_Properties_FreeArray(size_t propertiesCount, ADUC_Property* pro
     free(propertiesArray);
 }
 
-/**
- * @brief Allocates memory and populate with ADUC_Property object from a Parson JSON_Object.
- *
- * Caller MUST assume that this method allocates the memory for the returned ADUC_Property pointer.
- *
- * @param propertiesObj JSON Object that contains the properties to be returned.
- * @param propertiesCount A size_t* where the count of output properties will be stored.
- * @returns If success, a pointer to an array of ADUC_Property object. Otherwise, returns NULL.
- *  Caller must call ADUC_FileEntityArray_Free() to free the array.
- */
-ADUC_Property* ADUC_PropertiesArray_AllocAndInit(const JSON_Object* propertiesObj, size_t* propertiesCount)
-{
-    ADUC_Property* tempPropertyArray = NULL;
-
-    if (propertiesCount == NULL || propertiesObj == NULL)
-    {
-        return NULL;
-    }
-    *propertiesCount = 0;
-
-    size_t tempPropertyCount = json_object_get_count(propertiesObj);
-
-    if (tempPropertyCount == 0)
-    {
-        Log_Error("No properties");
-        goto done;
-    }
-
-    tempPropertyArray = calloc(tempPropertyCount, sizeof(*tempPropertyArray));
-
-    if (tempPropertyArray == NULL)
-    {
-        goto done;
-    }
-
-    for (size_t properties_index = 0; properties_index < tempPropertyCount; ++properties_index)
-    {
-        ADUC_Property* currProperty = tempPropertyArray + properties_index;
-
-        const char* propertiesName = json_object_get_name(propertiesObj, properties_index);
-        const char* propertiesValue = json_value_get_string(json_object_get_value_at(propertiesObj, properties_index));
-        if (!ADUC_Property_Init(currProperty, propertiesName, propertiesValue))
-        {
-            goto done;
-        }
-    }
-
-    *propertiesCount = tempPropertyCount;
-
-done:
-
-    if (*propertiesCount == 0 && tempPropertyCount > 0)
-    {
-        ADUC_Properties_FreeArray(tempPropertyCount, tempPropertyArray);
-        tempPropertyArray = NULL;
-    }
-
-    return tempPropertyArray;
-}
-
 /**
  * @brief Free the ADUC_RelatedFile struct members
  * @param hash a pointer to an ADUC_RelatedFile
@@ -259,7 +201,6 @@ static bool ADUC_RelatedFile_Init(
         return false;
     }
 
-    relatedFile->HashCount = hashCount;
     ADUC_Hash* tempHashArray = calloc(hashCount, sizeof(*tempHashArray));
     if (tempHashArray == NULL)
     {
@@ -274,8 +215,7 @@ static bool ADUC_RelatedFile_Init(
         }
     }
 
-    relatedFile->PropertiesCount = propertiesCount;
-    tempPropertiesArray = (ADUC_Property*)malloc(propertiesCount * sizeof(ADUC_Property));
+    tempPropertiesArray = calloc(propertiesCount, sizeof(*tempPropertiesArray));
     if (tempPropertiesArray == NULL)
     {
         goto done;
@@ -394,272 +334,262 @@ void ADUC_RelatedFile_FreeArray(size_t relatedFileCount, ADUC_RelatedFile* relat
 }
 
 /**
- * @brief Allocates memory and populate with ADUC_RelatedFile object from a Parson JSON_Object.
+ * @brief Makes a deep copy of a file entity owned by the manifest index.
  *
- * Caller MUST assume that this method allocates the memory for the returned ADUC_RelatedFile pointer.
- *
- * @param handle The workflow handle.
- * @param relatedFileObj JSON Object that contains the relatedFiles to be returned.
- * @param relatedFileCount A size_t* where the count of output relatedFiles will be stored.
- * @returns If success, a pointer to an array of ADUC_RelatedFile object. Otherwise, returns NULL.
- * @details Caller must call ADUC_RelatedFileArray_Free() to free the array. On error, this function
- * will set extendedResultCode
+ * @param source The indexed file entity.
+ * @param entity The output file entity. Caller must uninitialize it via ADUC_FileEntity_Uninit when done.
+ * @returns true for success.
  */
-ADUC_RelatedFile* ADUC_RelatedFileArray_AllocAndInit(
-    ADUC_WorkflowHandle handle, const JSON_Object* relatedFileObj, size_t* relatedFileCount)
+static bool CopyIndexedFileEntity(const ADUC_FileEntity* source, ADUC_FileEntity* entity)
 {
     bool success = false;
-
-    ADUC_RelatedFile* tempRelatedFileArray = NULL;
-    const JSON_Object* fileUrls = NULL;
-
-    if (relatedFileObj == NULL || relatedFileCount == NULL)
+    ADUC_RelatedFile* tempRelatedFiles = NULL;
+
+    if (!ADUC_FileEntity_Init(
+            entity,
+            source->FileId,
+            source->TargetFilename,
+            source->DownloadUri,
+            source->Arguments,
+            source->Hash,
+            source->HashCount,
+            source->SizeInBytes))
     {
+        Log_Error("Invalid file entity arguments");
         return false;
     }
-    *relatedFileCount = 0;
-
-    size_t tempRelatedFileCount = json_object_get_count(relatedFileObj);
-
-    if (tempRelatedFileCount == 0)
-    {
-        Log_Error("No relatedFiles.");
-        goto done;
-    }
-
-    tempRelatedFileArray = calloc(tempRelatedFileCount, sizeof(*tempRelatedFileArray));
 
-    if (tempRelatedFileArray == NULL)
+    if (source->DownloadHandlerId != NULL
+        && mallocAndStrcpy_s(&(entity->DownloadHandlerId), source->DownloadHandlerId) != 0)
     {
         goto done;
     }
 
-    for (size_t relatedFile_index = 0; relatedFile_index < tempRelatedFileCount; ++relatedFile_index)
+    if (source->RelatedFileCount > 0)
     {
-        const char* fileName = NULL;
-        const char* uri = NULL;
-        size_t hashCount = 0;
-        ADUC_Hash* tempHashes = NULL;
-        size_t propertiesCount = 0;
-        ADUC_Property* tempProperties = NULL;
-
-        ADUC_RelatedFile* currentRelatedFile = tempRelatedFileArray + relatedFile_index;
-
-        JSON_Object* relatedFileValueObj =
-            json_value_get_object(json_object_get_value_at(relatedFileObj, relatedFile_index));
-        if (relatedFileValueObj == NULL)
-        {
-            Log_Error("no relatedFile");
-            goto done;
-        }
-
-        // fileId
-        const char* fileId = json_object_get_name(relatedFileObj, relatedFile_index);
-        if (IsNullOrEmpty(fileId))
+        tempRelatedFiles = calloc(source->RelatedFileCount, sizeof(*tempRelatedFiles));
+        if (tempRelatedFiles == NULL)
         {
-            Log_Error("empty file id at %d", relatedFile_index);
             goto done;
         }
 
-        // downloadUri
-        ADUC_WorkflowHandle h = handle;
-        do
-        {
-            if ((fileUrls = _workflow_get_fileurls_map(h)) != NULL)
-            {
-                uri = json_object_get_string(fileUrls, fileId);
-            }
-            h = workflow_get_parent(h);
-        } while (uri == NULL && h != NULL);
-
-        if (uri == NULL)
-        {
-            Log_Error("Cannot find URL for fileId '%s'", fileId);
-            goto done;
-        }
-
-        // fileName
-        fileName = json_object_get_string(relatedFileValueObj, "fileName");
-
-        // hashes
-        {
-            JSON_Object* hashesObj = json_object_get_object(relatedFileValueObj, "hashes");
-            if (hashesObj == NULL)
-            {
-                Log_Error("'hashes' missing at %d", relatedFile_index);
-                goto done;
-            }
-
-            tempHashes = ADUC_HashArray_AllocAndInit(hashesObj, &hashCount);
-            if (tempHashes == NULL)
-            {
-                goto done;
-            }
-        }
-
-        // properties
+        for (size_t i = 0; i < source->RelatedFileCount; ++i)
         {
-            JSON_Object* propertiesObj = json_object_get_object(relatedFileValueObj, "properties");
-            if (propertiesObj == NULL)
+            const ADUC_RelatedFile* relatedFile = source->RelatedFiles + i;
+            if (!ADUC_RelatedFile_Init(
+                    tempRelatedFiles + i,
+                    relatedFile->FileId,
+                    relatedFile->DownloadUri,
+                    relatedFile->FileName,
+                    relatedFile->HashCount,
+                    relatedFile->Hash,
+                    relatedFile->PropertiesCount,
+                    relatedFile->Properties))
             {
-                Log_Error("'properties' missing at %d", relatedFile_index);
                 goto done;
             }
 
-            tempProperties = ADUC_PropertiesArray_AllocAndInit(propertiesObj, &propertiesCount);
-            if (tempProperties == NULL)
-            {
-                goto done;
-            }
+            tempRelatedFiles[i].SizeInBytes = relatedFile->SizeInBytes;
         }
 
-        if (!ADUC_RelatedFile_Init(
-                currentRelatedFile, fileId, uri, fileName, hashCount, tempHashes, propertiesCount, tempProperties))
-        {
-            goto done;
-        }
+        entity->RelatedFiles = tempRelatedFiles;
+        entity->RelatedFileCount = source->RelatedFileCount;
+        tempRelatedFiles = NULL;
     }
 
-    *relatedFileCount = tempRelatedFileCount;
-
     success = true;
 
 done:
 
     if (!success)
     {
-        ADUC_RelatedFile_FreeArray(tempRelatedFileCount, tempRelatedFileArray);
-        tempRelatedFileArray = NULL;
+        ADUC_RelatedFile_FreeArray(source->RelatedFileCount, tempRelatedFiles);
+        free(entity->DownloadHandlerId);
+        ADUC_FileEntity_Uninit(entity);
     }
 
-    return tempRelatedFileArray;
+    return success;
 }
 
 /**
- * @brief Parses the related files and assigns the relevant fields on the given ADUC_FileEntity.
+ * @brief Deep copy string. Caller must call workflow_free_string() when done.
  *
- * @param handle The workflow handle.
- * @param file the json object parsed from a file entry in the update metadata.
- * @param entity the file entity.
- * @returns true for success.
+ * @param s Input string.
+ * @return A copy of input string if succeeded. Otherwise, return NULL.
  */
-static bool ParseFileEntityRelatedFiles(ADUC_WorkflowHandle handle, const JSON_Object* file, ADUC_FileEntity* entity)
+char* workflow_copy_string(const char* s)
 {
-    bool success = false;
-
-    const JSON_Object* relatedFilesObj = json_object_get_object(file, ADUCITF_FIELDNAME_RELATEDFILES);
-    if (relatedFilesObj == NULL)
-    {
-        // it's not necessarily an error if there are no related files for the file entity as one can
-        // have a download handler that does not use/process related files.
-        return true;
-    }
-
-    size_t tempRelatedFilesCount = 0;
-    ADUC_RelatedFile* tempRelatedFiles =
-        ADUC_RelatedFileArray_AllocAndInit(handle, relatedFilesObj, &tempRelatedFilesCount);
-    if (tempRelatedFiles == NULL)
+    char* ret = NULL;
+    if (mallocAndStrcpy_s(&ret, s) == 0)
     {
-        goto done;
+        return ret;
     }
+    return NULL;
+}
 
-    entity->RelatedFileCount = tempRelatedFilesCount;
-    entity->RelatedFiles = tempRelatedFiles;
-    tempRelatedFiles = NULL;
-    tempRelatedFilesCount = 0;
-
-    success = true;
+/**
+ * @brief Convert ADUC_Workflow* to ADUC_WorkflowHandle.
+ */
+ADUC_WorkflowHandle handle_from_workflow(ADUC_Workflow* workflow)
+{
+    return (ADUC_WorkflowHandle)(workflow);
+}
 
-done:
+/**
+ * @brief Convert ADUC_WorkflowHandle to ADUC_Workflow*.
+ */
+ADUC_Workflow* workflow_from_handle(ADUC_WorkflowHandle handle)
+{
+    return (ADUC_Workflow*)(handle);
+}
 
-    if (tempRelatedFilesCount > 0 && tempRelatedFiles != NULL)
+/**
+ * @brief Frees the manifest index of @p wf.
+ */
+static void _workflow_free_manifest_index(ADUC_Workflow* wf)
+{
+    if (wf != NULL)
     {
-        ADUC_RelatedFile_FreeArray(tempRelatedFilesCount, tempRelatedFiles);
+        ADUC_ManifestIndex_Free(wf->ManifestIndex);
+        wf->ManifestIndex = NULL;
     }
-
-    return success;
 }
 
 /**
- * @brief Parses the downloadHandlerId and related files for a file entry in the update metadata json.
- *
- * @param handle The workflow handle.
- * @param file the json object parsed from a file entry in the update metadata.
- * @param entity the file entity.
- * @returns true for success.
+ * @brief Builds the manifest index of @p wf, replacing the existing one.
+ * File URLs are resolved with the 'fileUrls' maps of this workflow, then of its enclosing workflow(s).
  */
-static bool
-ParseFileEntityDownloadHandler(ADUC_WorkflowHandle handle, const JSON_Object* file, ADUC_FileEntity* entity)
+static void _workflow_build_manifest_index(ADUC_Workflow* wf)
 {
-    bool success = false;
-    const char* downloadHandlerId = NULL;
-    const JSON_Object* downloadHandlerObj = NULL;
-
-    if (entity == NULL)
-    {
-        return false;
-    }
+    _workflow_free_manifest_index(wf);
 
-    downloadHandlerObj = json_object_get_object(file, ADUCITF_FIELDNAME_DOWNLOADHANDLER);
-    if (downloadHandlerObj == NULL)
+    if (wf == NULL || wf->UpdateManifestObject == NULL)
     {
-        // it's ok not to have a download handler json object if there's none associated with the related file.
-        return true;
+        return;
     }
 
-    downloadHandlerId = json_object_get_string(downloadHandlerObj, ADUCITF_FIELDNAME_DOWNLOADHANDLER_ID);
-    if (IsNullOrEmpty(downloadHandlerId))
+    size_t levels = 0;
+    for (const ADUC_Workflow* w = wf; w != NULL; w = w->Parent)
     {
-        Log_Error("missing '%s' under '%s'", ADUCITF_FIELDNAME_DOWNLOADHANDLER_ID, ADUCITF_FIELDNAME_DOWNLOADHANDLER);
-        goto done;
+        ++levels;
     }
 
-    if (mallocAndStrcpy_s(&(entity->DownloadHandlerId), downloadHandlerId) != 0)
+    const JSON_Object** fileUrlsMaps = calloc(levels, sizeof(*fileUrlsMaps));
+    if (fileUrlsMaps == NULL)
     {
-        goto done;
+        return;
     }
 
-    if (!ParseFileEntityRelatedFiles(handle, file, entity))
+    size_t fileUrlsMapCount = 0;
+    for (ADUC_Workflow* w = wf; w != NULL; w = w->Parent)
     {
-        goto done;
+        const JSON_Object* fileUrls = _workflow_get_fileurls_map(handle_from_workflow(w));
+        if (fileUrls != NULL)
+        {
+            fileUrlsMaps[fileUrlsMapCount++] = fileUrls;
+        }
     }
 
-    success = true;
-done:
+    wf->ManifestIndex = ADUC_ManifestIndex_Create(
+        _workflow_get_update_manifest_files_map(handle_from_workflow(wf)),
+        workflow_get_instructions_steps_array(handle_from_workflow(wf)),
+        fileUrlsMaps,
+        fileUrlsMapCount);
 
-    return success;
+    free(fileUrlsMaps);
 }
 
 /**
- * @brief Deep copy string. Caller must call workflow_free_string() when done.
+ * @brief Updates the manifest indexes of @p wf and its descendants after the enclosing workflow of @p wf changed.
  *
- * @param s Input string.
- * @return A copy of input string if succeeded. Otherwise, return NULL.
+ * @param wf The workflow.
+ * @param hadParent Whether @p wf had an enclosing workflow, whose 'fileUrls' may have been used by the indexes.
+ * These indexes are freed, and rebuilt on next use; this is the case when a child workflow is removed before it is
+ * freed. Otherwise, only the indexes with unresolved file URLs are rebuilt, now that more 'fileUrls' are available.
  */
-char* workflow_copy_string(const char* s)
+static void _workflow_update_manifest_indexes(ADUC_Workflow* wf, bool hadParent)
 {
-    char* ret = NULL;
-    if (mallocAndStrcpy_s(&ret, s) == 0)
+    if (hadParent)
     {
-        return ret;
+        _workflow_free_manifest_index(wf);
+    }
+    else if (ADUC_ManifestIndex_HasUnresolvedUrls(wf->ManifestIndex))
+    {
+        _workflow_build_manifest_index(wf);
+    }
+
+    for (size_t i = 0; i < wf->ChildCount; ++i)
+    {
+        _workflow_update_manifest_indexes(wf->Children[i], hadParent);
     }
-    return NULL;
 }
 
 /**
- * @brief Convert ADUC_Workflow* to ADUC_WorkflowHandle.
+ * @brief Serializes the builds of the manifest indexes on first use.
+ * @details Step handlers look up the files of their steps from the download worker threads, so an index may be
+ * built on first use by any of them. Once built, an index is only read until the workflow tree changes, which is
+ * never done while steps are processed.
  */
-ADUC_WorkflowHandle handle_from_workflow(ADUC_Workflow* workflow)
+static pthread_mutex_t s_manifestIndexMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Gets the manifest index of a workflow, building it if needed.
+ *
+ * @param handle A workflow object handle.
+ * @return const ADUC_ManifestIndex* The index, or NULL if the workflow has no update manifest.
+ */
+static const ADUC_ManifestIndex* _workflow_get_manifest_index(ADUC_WorkflowHandle handle)
 {
-    return (ADUC_WorkflowHandle)(workflow);
+    const ADUC_ManifestIndex* index = NULL;
+    ADUC_Workflow* wf = workflow_from_handle(handle);
+    if (wf == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&s_manifestIndexMutex);
+
+    if (wf->ManifestIndex == NULL)
+    {
+        _workflow_build_manifest_index(wf);
+    }
+
+    index = wf->ManifestIndex;
+
+    pthread_mutex_unlock(&s_manifestIndexMutex);
+
+    return index;
 }
 
 /**
- * @brief Convert ADUC_WorkflowHandle to ADUC_Workflow*.
+ * @brief Gets a complete update file entity from the manifest index.
+ *
+ * @param handle A workflow object handle.
+ * @param index The index of the file.
+ * @return const ADUC_FileEntity* The file entity, owned by the workflow, or NULL if not found or incomplete.
  */
-ADUC_Workflow* workflow_from_handle(ADUC_WorkflowHandle handle)
+static const ADUC_FileEntity* _workflow_peek_indexed_file(ADUC_WorkflowHandle handle, size_t index)
 {
-    return (ADUC_Workflow*)(handle);
+    ADUC_ManifestFileStatus status = ADUC_ManifestFileStatus_Ok;
+    const ADUC_FileEntity* entity = ADUC_ManifestIndex_GetFile(_workflow_get_manifest_index(handle), index, &status);
+    if (entity == NULL)
+    {
+        return NULL;
+    }
+
+    switch (status)
+    {
+    case ADUC_ManifestFileStatus_Ok:
+        return entity;
+
+    case ADUC_ManifestFileStatus_UrlNotFound:
+        Log_Error("Cannot find URL for fileId '%s' or its related files", entity->FileId);
+        return NULL;
+
+    default:
+        Log_Error("Invalid file entity metadata for fileId '%s'", entity->FileId);
+        return NULL;
+    }
 }
 
 /**
@@ -1088,6 +1018,7 @@ ADUC_Result ReplaceExistingUpdateManifestWithDetachedManifest(
     }
 
     // Replace old manifest object with detached one.
+    _workflow_free_manifest_index(wf);
     json_value_free(json_object_get_wrapping_value(wf->UpdateManifestObject));
     wf->UpdateManifestObject = detachedManifestJsonObj;
     detachedManifestJsonObj = NULL;
@@ -1343,6 +1274,9 @@ ADUC_Result _workflow_parse(const JSON_Value* updateActionJson, bool validateMan
         }
     }
 
+    // Index the files and steps of the final update manifest, so that accessors don't walk the JSON objects.
+    _workflow_build_manifest_index(wf);
+
     *handle = wf;
     result.ResultCode = ADUC_GeneralResult_Success;
     result.ExtendedResultCode = 0;
@@ -1356,6 +1290,7 @@ done:
 
     if (IsAducResultCodeFailure(result.ResultCode))
     {
+        _workflow_free_manifest_index(wf);
         free(wf);
         wf = NULL;
     }
@@ -1373,6 +1308,8 @@ void _workflow_free_updateaction(ADUC_WorkflowHandle handle)
     ADUC_Workflow* wf = workflow_from_handle(handle);
     if (wf != NULL && wf->UpdateActionObject != NULL)
     {
+        // The index holds URLs from the 'fileUrls' map.
+        _workflow_free_manifest_index(wf);
         json_value_free(json_object_get_wrapping_value(wf->UpdateActionObject));
         wf->UpdateActionObject = NULL;
     }
@@ -1388,6 +1325,7 @@ void _workflow_free_updatemanifest(ADUC_WorkflowHandle handle)
     ADUC_Workflow* wf = workflow_from_handle(handle);
     if (wf != NULL && wf->UpdateManifestObject != NULL)
     {
+        _workflow_free_manifest_index(wf);
         json_value_free(json_object_get_wrapping_value(wf->UpdateManifestObject));
         wf->UpdateManifestObject = NULL;
     }
@@ -1792,12 +1730,51 @@ bool workflow_set_workfolder(ADUC_WorkflowHandle handle, const char* format, ...
 
 bool workflow_set_selected_components(ADUC_WorkflowHandle handle, const char* selectedComponents)
 {
-    return workflow_set_string_property(handle, WORKFLOW_PROPERTY_FIELD_SELECTED_COMPONENTS, selectedComponents);
+    if (handle == NULL)
+    {
+        return false;
+    }
+
+    if (selectedComponents == NULL)
+    {
+        return workflow_set_selected_component_set(handle, NULL);
+    }
+
+    ADUC_ComponentSet* componentSet = ADUC_ComponentSet_CreateFromString(selectedComponents);
+    if (componentSet == NULL)
+    {
+        return false;
+    }
+
+    const bool success = workflow_set_selected_component_set(handle, componentSet);
+    ADUC_ComponentSet_Release(componentSet);
+    return success;
 }
 
 const char* workflow_peek_selected_components(ADUC_WorkflowHandle handle)
 {
-    return workflow_get_string_property(handle, WORKFLOW_PROPERTY_FIELD_SELECTED_COMPONENTS);
+    return ADUC_ComponentSet_PeekString(workflow_peek_selected_component_set(handle));
+}
+
+bool workflow_set_selected_component_set(ADUC_WorkflowHandle handle, ADUC_ComponentSet* componentSet)
+{
+    ADUC_Workflow* wf = workflow_from_handle(handle);
+    if (wf == NULL)
+    {
+        return false;
+    }
+
+    // Add the new reference first, in case the set is already the workflow's.
+    ADUC_ComponentSet_AddRef(componentSet);
+    ADUC_ComponentSet_Release(wf->SelectedComponents);
+    wf->SelectedComponents = componentSet;
+    return true;
+}
+
+ADUC_ComponentSet* workflow_peek_selected_component_set(ADUC_WorkflowHandle handle)
+{
+    ADUC_Workflow* wf = workflow_from_handle(handle);
+    return wf == NULL ? NULL : wf->SelectedComponents;
 }
 
 bool workflow_set_sandbox(ADUC_WorkflowHandle handle, const char* sandbox)
@@ -2095,6 +2072,13 @@ bool workflow_get_operation_in_progress(ADUC_WorkflowHandle handle)
     return result;
 }
 
+/**
+ * @brief Serializes the cancellation flags of the workflows: 'OperationCancelled' and the cancel requested property.
+ * @details The agent sets them on its own thread, while content downloaders read them on the threads that run the
+ * transfers, through their cancellation callback.
+ */
+static pthread_mutex_t s_cancelMutex = PTHREAD_MUTEX_INITIALIZER;
+
 void workflow_set_operation_cancel_requested(ADUC_WorkflowHandle handle, bool cancel)
 {
     ADUC_Workflow* wf = workflow_from_handle(handle);
@@ -2104,7 +2088,9 @@ void workflow_set_operation_cancel_requested(ADUC_WorkflowHandle handle, bool ca
         return;
     }
 
+    pthread_mutex_lock(&s_cancelMutex);
     wf->OperationCancelled = cancel;
+    pthread_mutex_unlock(&s_cancelMutex);
 }
 
 bool workflow_get_operation_cancel_requested(ADUC_WorkflowHandle handle)
@@ -2115,7 +2101,9 @@ bool workflow_get_operation_cancel_requested(ADUC_WorkflowHandle handle)
 
     if (wf != NULL)
     {
+        pthread_mutex_lock(&s_cancelMutex);
         result = wf->OperationCancelled;
+        pthread_mutex_unlock(&s_cancelMutex);
     }
 
     return result;
@@ -2135,7 +2123,10 @@ void workflow_clear_inprogress_and_cancelrequested(ADUC_WorkflowHandle handle)
     }
 
     wf->OperationInProgress = false;
+
+    pthread_mutex_lock(&s_cancelMutex);
     wf->OperationCancelled = false;
+    pthread_mutex_unlock(&s_cancelMutex);
 }
 
 /**
@@ -2166,8 +2157,7 @@ ADUCITF_UpdateAction workflow_get_action(ADUC_WorkflowHandle handle)
 // Public functions - always return a copy of value.
 size_t workflow_get_update_files_count(ADUC_WorkflowHandle handle)
 {
-    const JSON_Object* files = _workflow_get_update_manifest_files_map(handle);
-    return files == NULL ? 0 : json_object_get_count(files);
+    return ADUC_ManifestIndex_GetFileCount(_workflow_get_manifest_index(handle));
 }
 
 bool workflow_get_update_file(ADUC_WorkflowHandle handle, size_t index, ADUC_FileEntity* entity)
@@ -2177,101 +2167,13 @@ bool workflow_get_update_file(ADUC_WorkflowHandle handle, size_t index, ADUC_Fil
         return false;
     }
 
-    size_t count = workflow_get_update_files_count(handle);
-    if (index >= count)
+    const ADUC_FileEntity* indexedEntity = workflow_peek_update_file(handle, index);
+    if (indexedEntity == NULL)
     {
         return false;
     }
 
-    bool succeeded = false;
-    const JSON_Object* files = NULL;
-    const JSON_Object* file = NULL;
-    const JSON_Object* fileUrls = NULL;
-    const char* uri = NULL;
-    const char* fileId = NULL;
-    const char* name = NULL;
-    const char* arguments = NULL;
-    size_t tempHashCount = 0;
-    ADUC_Hash* tempHash = NULL;
-
-    if ((files = _workflow_get_update_manifest_files_map(handle)) == NULL)
-    {
-        goto done;
-    }
-
-    fileId = json_object_get_name(files, index);
-
-    if ((file = json_value_get_object(json_object_get_value_at(files, index))) == NULL)
-    {
-        goto done;
-    }
-
-    // Find fileurls map in this workflow, and its enclosing workflow(s).
-    ADUC_WorkflowHandle h = handle;
-
-    do
-    {
-        if ((fileUrls = _workflow_get_fileurls_map(h)) != NULL)
-        {
-            uri = json_object_get_string(fileUrls, fileId);
-        }
-        h = workflow_get_parent(h);
-    } while (uri == NULL && h != NULL);
-
-    if (uri == NULL)
-    {
-        Log_Error("Cannot find URL for fileId '%s'", fileId);
-        goto done;
-    }
-
-    name = json_object_get_string(file, ADUCITF_FIELDNAME_FILENAME);
-    arguments = json_object_get_string(file, ADUCITF_FIELDNAME_ARGUMENTS);
-
-    const JSON_Object* hashObj = json_object_get_object(file, ADUCITF_FIELDNAME_HASHES);
-
-    tempHash = ADUC_HashArray_AllocAndInit(hashObj, &tempHashCount);
-    if (tempHash == NULL)
-    {
-        Log_Error("Unable to parse hashes for file @ %zu", index);
-        goto done;
-    }
-
-    size_t sizeInBytes = 0;
-    if (json_object_has_value(file, ADUCITF_FIELDNAME_SIZEINBYTES))
-    {
-        sizeInBytes = (size_t)json_object_get_number(file, ADUCITF_FIELDNAME_SIZEINBYTES);
-    }
-
-    if (!ADUC_FileEntity_Init(entity, fileId, name, uri, arguments, tempHash, tempHashCount, sizeInBytes))
-    {
-        Log_Error("Invalid file entity arguments");
-        goto done;
-    }
-
-    // ADUC_FileEntity_Init makes a deep copy of the hash so must free tempHash to avoid memory leak.
-    ADUC_Hash_FreeArray(tempHashCount, tempHash);
-    tempHash = NULL;
-
-    if (!ParseFileEntityDownloadHandler(handle, file, entity))
-    {
-        goto done;
-    }
-
-    succeeded = true;
-
-done:
-    if (!succeeded)
-    {
-        entity->Hash = NULL; // Manually free hash array below that is pointed to by tempHash...
-        ADUC_FileEntity_Uninit(entity);
-    }
-
-    if (tempHash != NULL)
-    {
-        ADUC_Hash_FreeArray(tempHashCount, tempHash);
-    }
-
-    return succeeded;
+    return CopyIndexedFileEntity(indexedEntity, entity);
 }
 
 bool workflow_get_update_file_by_name(ADUC_WorkflowHandle handle, const char* fileName, ADUC_FileEntity* entity)
@@ -2281,105 +2183,40 @@ bool workflow_get_update_file_by_name(ADUC_WorkflowHandle handle, const char* fi
         return false;
     }
 
-    size_t count = workflow_get_update_files_count(handle);
-    if (count == 0)
+    const ADUC_FileEntity* indexedEntity = workflow_peek_update_file_by_name(handle, fileName);
+    if (indexedEntity == NULL)
     {
         return false;
     }
 
-    bool succeeded = false;
-    const JSON_Object* files = NULL;
-    const JSON_Object* file = NULL;
-    const JSON_Object* fileUrls = NULL;
-    const char* uri = NULL;
-    const char* fileId = NULL;
-    const char* name = NULL;
-    const char* arguments = NULL;
-    size_t tempHashCount = 0;
-    ADUC_Hash* tempHash = NULL;
-
-    if ((files = _workflow_get_update_manifest_files_map(handle)) == NULL)
-    {
-        goto done;
-    }
-
-    // Find file by name.
-    for (size_t i = 0; i < count; i++)
-    {
-        if ((file = json_value_get_object(json_object_get_value_at(files, i))) != NULL
-            && ADUCPAL_strcasecmp(json_object_get_string(file, "fileName"), fileName) == 0)
-        {
-            fileId = json_object_get_name(files, i);
-            break;
-        }
-    }
-
-    if (fileId == NULL)
-    {
-        goto done;
-    }
-
-    // Find fileurls map in this workflow, and its enclosing workflow(s).
-    ADUC_WorkflowHandle h = handle;
-
-    do
-    {
-        if ((fileUrls = _workflow_get_fileurls_map(h)) != NULL)
-        {
-            uri = json_object_get_string(fileUrls, fileId);
-        }
-        h = workflow_get_parent(h);
-    } while (uri == NULL && h != NULL);
-
-    if (uri == NULL)
-    {
-        Log_Error("Cannot find URL for fileId '%s'", fileId);
-    }
-
-    name = json_object_get_string(file, ADUCITF_FIELDNAME_FILENAME);
-    arguments = json_object_get_string(file, ADUCITF_FIELDNAME_ARGUMENTS);
-
-    const JSON_Object* hashObj = json_object_get_object(file, ADUCITF_FIELDNAME_HASHES);
-
-    tempHash = ADUC_HashArray_AllocAndInit(hashObj, &tempHashCount);
-    if (tempHash == NULL)
-    {
-        Log_Error("Unable to parse hashes for fileId", fileId);
-        goto done;
-    }
-
-    size_t sizeInBytes = 0;
-    if (json_object_has_value(file, ADUCITF_FIELDNAME_SIZEINBYTES))
-    {
-        sizeInBytes = (size_t)json_object_get_number(file, ADUCITF_FIELDNAME_SIZEINBYTES);
-    }
+    return CopyIndexedFileEntity(indexedEntity, entity);
+}
 
-    if (!ADUC_FileEntity_Init(entity, fileId, name, uri, arguments, tempHash, tempHashCount, sizeInBytes))
-    {
-        Log_Error("Invalid file entity arguments");
-        goto done;
-    }
+const ADUC_FileEntity* workflow_peek_update_file(ADUC_WorkflowHandle handle, size_t index)
+{
+    return _workflow_peek_indexed_file(handle, index);
+}
 
-    if (!ParseFileEntityDownloadHandler(handle, file, entity))
+const ADUC_FileEntity* workflow_peek_update_file_by_name(ADUC_WorkflowHandle handle, const char* fileName)
+{
+    size_t index = 0;
+    if (!ADUC_ManifestIndex_FindFileByName(_workflow_get_manifest_index(handle), fileName, &index))
     {
-        goto done;
+        return NULL;
     }
 
-    succeeded = true;
+    return _workflow_peek_indexed_file(handle, index);
+}
 
-done:
-    if (!succeeded)
+const ADUC_FileEntity* workflow_peek_update_file_by_id(ADUC_WorkflowHandle handle, const char* fileId)
+{
+    size_t index = 0;
+    if (!ADUC_ManifestIndex_FindFileById(_workflow_get_manifest_index(handle), fileId, &index))
     {
-        entity->Hash = NULL; // will be freed with tempHash below
-        ADUC_FileEntity_Uninit(entity);
-
-        if (tempHash != NULL)
-        {
-            ADUC_Hash_FreeArray(tempHashCount, tempHash);
-        }
+        return NULL;
     }
 
-    return succeeded;
+    return _workflow_peek_indexed_file(handle, index);
 }
 
 /**
@@ -2787,6 +2624,7 @@ ADUC_Result workflow_create_from_inline_step(ADUC_WorkflowHandle base, size_t st
 
     wf->UpdateActionObject = updateActionObject;
     wf->UpdateManifestObject = updateManifestObject;
+    _workflow_build_manifest_index(wf);
 
     {
         char* baseWorkfolder = workflow_get_workfolder(base);
@@ -2809,6 +2647,22 @@ done:
     return result;
 }
 
+ADUC_Result
+workflow_create_detached_from_inline_step(ADUC_WorkflowHandle base, size_t stepIndex, ADUC_WorkflowHandle* handle)
+{
+    ADUC_Result result = workflow_create_from_inline_step(base, stepIndex, handle);
+    if (IsAducResultCodeFailure(result.ResultCode))
+    {
+        return result;
+    }
+
+    ADUC_Workflow* wf = workflow_from_handle(*handle);
+    wf->KeepsRequests = true;
+    workflow_set_parent(*handle, base);
+
+    return result;
+}
+
 /**
  * @brief Transfer data from @p sourceHandle to @p targetHandle.
  * The sourceHandle will no longer contains transferred action data.
@@ -2852,6 +2706,13 @@ bool workflow_transfer_data(ADUC_WorkflowHandle targetHandle, ADUC_WorkflowHandl
     wfTarget->PropertiesObject = wfSource->PropertiesObject;
     wfSource->PropertiesObject = NULL;
 
+    ADUC_ComponentSet_Release(wfTarget->SelectedComponents);
+    wfTarget->SelectedComponents = wfSource->SelectedComponents;
+    wfSource->SelectedComponents = NULL;
+
+    _workflow_free_manifest_index(wfSource);
+    _workflow_build_manifest_index(wfTarget);
+
     return true;
 }
 
@@ -3071,6 +2932,13 @@ void workflow_uninit(ADUC_WorkflowHandle handle)
     _workflow_free_results_object(handle);
 
     _workflow_free_update_file_inodes(wf);
+    _workflow_free_manifest_index(wf);
+
+    if (wf != NULL)
+    {
+        ADUC_ComponentSet_Release(wf->SelectedComponents);
+        wf->SelectedComponents = NULL;
+    }
 
     // This should have been transferred, but free it if it's still around.
     if (wf != NULL && wf->DeferredReplacementWorkflow != NULL)
@@ -3117,9 +2985,13 @@ void workflow_set_parent(ADUC_WorkflowHandle handle, ADUC_WorkflowHandle parent)
     }
 
     ADUC_Workflow* wf = workflow_from_handle(handle);
+    const bool hadParent = wf->Parent != NULL;
     wf->Parent = workflow_from_handle(parent);
     wf->Level = workflow_get_level(parent) + 1;
 
+    // File URLs are resolved through the enclosing workflows.
+    _workflow_update_manifest_indexes(wf, hadParent);
+
     if (parent != NULL && workflow_is_cancel_requested(parent))
     {
         if (!workflow_request_cancel(handle))
@@ -3509,7 +3381,11 @@ bool workflow_update_replacement_deployment(
     if (currentWorkflow->OperationInProgress)
     {
         currentWorkflow->CancellationType = ADUC_WorkflowCancellationType_Replacement;
+
+        pthread_mutex_lock(&s_cancelMutex);
         currentWorkflow->OperationCancelled = true;
+        pthread_mutex_unlock(&s_cancelMutex);
+
         currentWorkflow->DeferredReplacementWorkflow =
             nextWorkflowHandle; // upon return, caller must release ownership as it's owned by current workflow now
         wasDeferred = true;
@@ -3526,8 +3402,11 @@ static void reset_state_for_processing_deployment(ADUC_Workflow* wf)
 {
     wf->CurrentWorkflowStep = ADUCITF_WorkflowStep_ProcessDeployment;
     wf->OperationInProgress = false;
-    wf->OperationCancelled = false;
     wf->CancellationType = ADUC_WorkflowCancellationType_None;
+
+    pthread_mutex_lock(&s_cancelMutex);
+    wf->OperationCancelled = false;
+    pthread_mutex_unlock(&s_cancelMutex);
 }
 
 /**
@@ -3581,70 +3460,118 @@ bool workflow_read_state_from_file(ADUC_WorkflowHandle handle, const char* state
     return true;
 }
 
+/**
+ * @brief Sets the cancel requested property of a workflow and its children. The caller must hold s_cancelMutex.
+ *
+ * @param handle A workflow object handle.
+ * @return bool true if the property of every workflow was set.
+ */
+static bool _workflow_request_cancel_locked(ADUC_WorkflowHandle handle)
+{
+    bool success = workflow_set_boolean_property(handle, WORKFLOW_PROPERTY_FIELD_CANCEL_REQUESTED, true);
+    size_t childCount = workflow_get_children_count(handle);
+    for (size_t i = 0; i < childCount; i++)
+    {
+        success = success && _workflow_request_cancel_locked(workflow_get_child(handle, i));
+    }
+    return success;
+}
+
 bool workflow_request_cancel(ADUC_WorkflowHandle handle)
 {
+    bool success = false;
+
     if (handle == NULL)
     {
         return false;
     }
 
-    bool success = workflow_set_boolean_property(handle, WORKFLOW_PROPERTY_FIELD_CANCEL_REQUESTED, true);
-    size_t childCount = workflow_get_children_count(handle);
-    for (size_t i = 0; i < childCount; i++)
-    {
-        success = success && workflow_request_cancel(workflow_get_child(handle, i));
-    }
+    pthread_mutex_lock(&s_cancelMutex);
+    success = _workflow_request_cancel_locked(handle);
+    pthread_mutex_unlock(&s_cancelMutex);
+
     return success;
 }
 
 bool workflow_is_cancel_requested(ADUC_WorkflowHandle handle)
 {
-    return workflow_get_boolean_property(handle, WORKFLOW_PROPERTY_FIELD_CANCEL_REQUESTED);
+    bool result = false;
+
+    pthread_mutex_lock(&s_cancelMutex);
+    result = workflow_get_boolean_property(handle, WORKFLOW_PROPERTY_FIELD_CANCEL_REQUESTED);
+    pthread_mutex_unlock(&s_cancelMutex);
+
+    return result;
+}
+
+/**
+ * @brief Gets the workflow that holds the reboot and agent restart requests of @p handle: the root workflow, unless a
+ * workflow on the way keeps its own requests.
+ *
+ * @param handle A workflow object handle.
+ * @return ADUC_WorkflowHandle The workflow that holds the requests.
+ */
+static ADUC_WorkflowHandle _workflow_get_requests_holder(ADUC_WorkflowHandle handle)
+{
+    ADUC_Workflow* wf = workflow_from_handle(handle);
+    if (wf == NULL)
+    {
+        return NULL;
+    }
+
+    while (!wf->KeepsRequests && wf->Parent != NULL)
+    {
+        wf = wf->Parent;
+    }
+    return handle_from_workflow(wf);
 }
 
 bool workflow_is_agent_restart_requested(ADUC_WorkflowHandle handle)
 {
-    return workflow_get_boolean_property(workflow_get_root(handle), WORKFLOW_PROPERTY_FIELD_AGENT_RESTART_REQUESTED);
+    return workflow_get_boolean_property(
+        _workflow_get_requests_holder(handle), WORKFLOW_PROPERTY_FIELD_AGENT_RESTART_REQUESTED);
 }
 
 bool workflow_is_immediate_agent_restart_requested(ADUC_WorkflowHandle handle)
 {
     return workflow_get_boolean_property(
-        workflow_get_root(handle), WORKFLOW_PROPERTY_FIELD_IMMEDIATE_AGENT_RESTART_REQUESTED);
+        _workflow_get_requests_holder(handle), WORKFLOW_PROPERTY_FIELD_IMMEDIATE_AGENT_RESTART_REQUESTED);
 }
 
 bool workflow_is_reboot_requested(ADUC_WorkflowHandle handle)
 {
-    return workflow_get_boolean_property(workflow_get_root(handle), WORKFLOW_PROPERTY_FIELD_REBOOT_REQUESTED);
+    return workflow_get_boolean_property(
+        _workflow_get_requests_holder(handle), WORKFLOW_PROPERTY_FIELD_REBOOT_REQUESTED);
 }
 
 bool workflow_is_immediate_reboot_requested(ADUC_WorkflowHandle handle)
 {
     return workflow_get_boolean_property(
-        workflow_get_root(handle), WORKFLOW_PROPERTY_FIELD_IMMEDIATE_REBOOT_REQUESTED);
+        _workflow_get_requests_holder(handle), WORKFLOW_PROPERTY_FIELD_IMMEDIATE_REBOOT_REQUESTED);
 }
 
 bool workflow_request_reboot(ADUC_WorkflowHandle handle)
 {
-    return workflow_set_boolean_property(workflow_get_root(handle), WORKFLOW_PROPERTY_FIELD_REBOOT_REQUESTED, true);
+    return workflow_set_boolean_property(
+        _workflow_get_requests_holder(handle), WORKFLOW_PROPERTY_FIELD_REBOOT_REQUESTED, true);
 }
 
 bool workflow_request_immediate_reboot(ADUC_WorkflowHandle handle)
 {
     return workflow_set_boolean_property(
-        workflow_get_root(handle), WORKFLOW_PROPERTY_FIELD_IMMEDIATE_REBOOT_REQUESTED, true);
+        _workflow_get_requests_holder(handle), WORKFLOW_PROPERTY_FIELD_IMMEDIATE_REBOOT_REQUESTED, true);
 }
 
 bool workflow_request_agent_restart(ADUC_WorkflowHandle handle)
 {
     return workflow_set_boolean_property(
-        workflow_get_root(handle), WORKFLOW_PROPERTY_FIELD_AGENT_RESTART_REQUESTED, true);
+        _workflow_get_requests_holder(handle), WORKFLOW_PROPERTY_FIELD_AGENT_RESTART_REQUESTED, true);
 }
 
 bool workflow_request_immediate_agent_restart(ADUC_WorkflowHandle handle)
 {
     return workflow_set_boolean_property(
-        workflow_get_root(handle), WORKFLOW_PROPERTY_FIELD_IMMEDIATE_AGENT_RESTART_REQUESTED, true);
+        _workflow_get_requests_holder(handle), WORKFLOW_PROPERTY_FIELD_IMMEDIATE_AGENT_RESTART_REQUESTED, true);
 }
 
 /**
@@ -3853,6 +3780,7 @@ workflow_create_from_instruction_value(ADUC_WorkflowHandle base, JSON_Value* ins
 
     wf->UpdateActionObject = updateActionObject;
     wf->UpdateManifestObject = updateManifestObject;
+    _workflow_build_manifest_index(wf);
 
     {
         char* baseWorkfolder = workflow_get_workfolder(base);
@@ -3884,7 +3812,7 @@ done:
  */
 size_t workflow_get_instructions_steps_count(ADUC_WorkflowHandle handle)
 {
-    return json_array_get_count(workflow_get_instructions_steps_array(handle));
+    return ADUC_ManifestIndex_GetStepCount(_workflow_get_manifest_index(handle));
 }
 
 /**
@@ -3897,19 +3825,18 @@ size_t workflow_get_instructions_steps_count(ADUC_WorkflowHandle handle)
  */
 const char* workflow_peek_step_type(ADUC_WorkflowHandle handle, size_t stepIndex)
 {
-    JSON_Object* step = json_array_get_object(workflow_get_instructions_steps_array(handle), stepIndex);
+    const ADUC_ManifestStep* step = ADUC_ManifestIndex_GetStep(_workflow_get_manifest_index(handle), stepIndex);
     if (step == NULL)
     {
         return NULL;
     }
 
-    const char* stepType = json_object_get_string(step, STEP_PROPERTY_FIELD_TYPE);
-    if (stepType == NULL)
+    if (step->Type == NULL)
     {
         return DEFAULT_STEP_TYPE;
     }
 
-    return stepType;
+    return step->Type;
 }
 
 /**
@@ -3940,14 +3867,13 @@ workflow_peek_update_manifest_handler_properties_string(ADUC_WorkflowHandle hand
  */
 bool workflow_is_inline_step(ADUC_WorkflowHandle handle, size_t stepIndex)
 {
-    JSON_Object* step = json_array_get_object(workflow_get_instructions_steps_array(handle), stepIndex);
+    const ADUC_ManifestStep* step = ADUC_ManifestIndex_GetStep(_workflow_get_manifest_index(handle), stepIndex);
     if (step == NULL)
     {
         return false;
     }
 
-    const char* stepType = json_object_get_string(step, STEP_PROPERTY_FIELD_TYPE);
-    if (stepType != NULL && strcmp(stepType, "reference") == 0)
+    if (step->Type != NULL && strcmp(step->Type, "reference") == 0)
     {
         return false;
     }
@@ -3964,14 +3890,13 @@ bool workflow_is_inline_step(ADUC_WorkflowHandle handle, size_t stepIndex)
  */
 const char* workflow_peek_update_manifest_step_handler(ADUC_WorkflowHandle handle, size_t stepIndex)
 {
-    JSON_Object* step = json_array_get_object(workflow_get_instructions_steps_array(handle), stepIndex);
+    const ADUC_ManifestStep* step = ADUC_ManifestIndex_GetStep(_workflow_get_manifest_index(handle), stepIndex);
     if (step == NULL)
     {
-        return false;
+        return NULL;
     }
 
-    const char* stepHandler = json_object_get_string(step, STEP_PROPERTY_FIELD_HANDLER);
-    return stepHandler;
+    return step->Handler;
 }
 
 /**
@@ -3984,84 +3909,19 @@ const char* workflow_peek_update_manifest_step_handler(ADUC_WorkflowHandle handl
  */
 bool workflow_get_step_detached_manifest_file(ADUC_WorkflowHandle handle, size_t stepIndex, ADUC_FileEntity* entity)
 {
-    size_t count = workflow_get_instructions_steps_count(handle);
-    if (stepIndex >= count)
+    const ADUC_ManifestStep* step = ADUC_ManifestIndex_GetStep(_workflow_get_manifest_index(handle), stepIndex);
+    if (step == NULL || entity == NULL)
     {
         return false;
     }
 
-    bool succeeded = false;
-    bool fileEntityInited = false;
-    JSON_Object* step = json_array_get_object(workflow_get_instructions_steps_array(handle), stepIndex);
-    const char* fileId = json_object_get_string(step, STEP_PROPERTY_FIELD_DETACHED_MANIFEST_FILE_ID);
-    const JSON_Object* files = _workflow_get_update_manifest_files_map(handle);
-    const JSON_Object* file = json_object_get_object(files, fileId);
-    const JSON_Object* fileUrls = NULL;
-    const char* uri = NULL;
-    const char* name = NULL;
-    size_t tempHashCount = 0;
-    ADUC_Hash* tempHash = NULL;
-
-    // Find fileurls map in this workflow, and its enclosing workflow(s).
-    ADUC_WorkflowHandle h = handle;
-
-    do
-    {
-        if ((fileUrls = _workflow_get_fileurls_map(h)) == NULL)
-        {
-            Log_Warn("'fileUrls' property not found.");
-        }
-        else
-        {
-            uri = json_object_get_string(fileUrls, fileId);
-        }
-        h = workflow_get_parent(h);
-    } while (uri == NULL && h != NULL);
-
-    if (uri == NULL)
-    {
-        goto done;
-    }
-
-    name = json_object_get_string(file, ADUCITF_FIELDNAME_FILENAME);
-    const JSON_Object* hashObj = json_object_get_object(file, ADUCITF_FIELDNAME_HASHES);
-
-    tempHash = ADUC_HashArray_AllocAndInit(hashObj, &tempHashCount);
-    if (tempHash == NULL)
-    {
-        Log_Error("Unable to parse hashes for file @ %zu", stepIndex);
-        goto done;
-    }
-
-    size_t sizeInBytes = 0;
-    if (json_object_has_value(file, ADUCITF_FIELDNAME_SIZEINBYTES))
+    const ADUC_FileEntity* indexedEntity = workflow_peek_update_file_by_id(handle, step->DetachedManifestFileId);
+    if (indexedEntity == NULL)
     {
-        sizeInBytes = (size_t)json_object_get_number(file, ADUCITF_FIELDNAME_SIZEINBYTES);
-    }
-
-    if (!ADUC_FileEntity_Init(entity, fileId, name, uri, NULL /*arguments*/, tempHash, tempHashCount, sizeInBytes))
-    {
-        Log_Error("Invalid file entity arguments");
-        goto done;
-    }
-
-    fileEntityInited = true;
-
-    if (!ParseFileEntityDownloadHandler(handle, file, entity))
-    {
-        goto done;
-    }
-
-    succeeded = true;
-
-done:
-
-    if (!succeeded && fileEntityInited)
-    {
-        ADUC_FileEntity_Uninit(entity);
+        return false;
     }
 
-    return succeeded;
+    return CopyIndexedFileEntity(indexedEntity, entity);
 }
 
 /**
@@ -4164,6 +4024,7 @@ bool workflow_set_update_action_object(ADUC_WorkflowHandle handle, JSON_Object*
     if (wf != NULL)
     {
         wf->UpdateActionObject = jsonObj;
+        _workflow_build_manifest_index(wf);
         return true;
     }
 
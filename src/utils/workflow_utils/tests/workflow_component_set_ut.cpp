@@ -0,0 +1,182 @@
+/**
+ * @file workflow_component_set_ut.cpp
+ * @brief Unit Tests for the shared set of selected components.
+ *
+ * @copyright Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License.
+ */
+#include "aduc/result.h"
+#include "aduc/workflow_component_set.h"
+#include "aduc/workflow_utils.h"
+
+#include <catch2/catch_all.hpp>
+using Catch::Matchers::Equals;
+
+#include <parson.h>
+#include <string>
+
+// clang-format off
+
+const char* selected_components =
+    R"( {                                                                                   )"
+    R"(     "components": [                                                                 )"
+    R"(         { "id": "0", "name": "left-motor", "group": "motors", "properties": { "path": "/tmp/left" } },  )"
+    R"(         { "id": "1", "name": "right-motor", "group": "motors" }                    )"
+    R"(     ]                                                                               )"
+    R"( }                                                                                   )";
+
+const char* action_components_update =
+    R"( { "updateManifest":"{\"manifestVersion\":\"4\",\"updateId\":{\"provider\":\"contoso\",\"name\":\"contoso-virtual-motors\",\"version\":\"1.1\"},\"compatibility\":[{\"group\":\"motors\"}],\"instructions\":{\"steps\":[{\"handler\":\"microsoft/script:1\",\"files\":[\"f13b5435aab7c18da\",\"f2c5d1f3b0295db0f\"],\"handlerProperties\":{\"scriptFileName\":\"contoso-motor-installscript.sh\",\"arguments\":\"--firmware-file motor-firmware-1.1.json --component-name --component-name-val --component-group --component-group-val --component-prop path --component-prop-val path\",\"installedCriteria\":\"contoso-contoso-virtual-motors-1.1-step-1\"}}]},\"files\":{\"f13b5435aab7c18da\":{\"fileName\":\"contoso-motor-installscript.sh\",\"sizeInBytes\":27030,\"hashes\":{\"sha256\":\"DYb4/+P3mq2yjq6n987msufTo3GUb5tpMtk+f7IeHx0=\"}},\"f2c5d1f3b0295db0f\":{\"fileName\":\"motor-firmware-1.1.json\",\"sizeInBytes\":123,\"hashes\":{\"sha256\":\"b8CC9E/93hUuMT19VjGVLDWGShq4GzpMYBO8vzlej74=\"}}},\"createdDateTime\":\"2022-01-27T13:45:05.8836909Z\"}"} )";
+
+// clang-format on
+
+static std::string GetComponentId(ADUC_ComponentSet* componentSet, size_t index)
+{
+    const char* id = json_object_get_string(ADUC_ComponentSet_GetComponent(componentSet, index), "id");
+    return id == nullptr ? "" : id;
+}
+
+TEST_CASE("ADUC_ComponentSet parses the selected components once")
+{
+    ADUC_ComponentSet* componentSet = ADUC_ComponentSet_CreateFromString(selected_components);
+    REQUIRE(componentSet != nullptr);
+
+    CHECK(ADUC_ComponentSet_IsValid(componentSet));
+    CHECK(ADUC_ComponentSet_GetCount(componentSet) == 2);
+    CHECK(GetComponentId(componentSet, 0) == "0");
+    CHECK(GetComponentId(componentSet, 1) == "1");
+    CHECK(ADUC_ComponentSet_GetComponent(componentSet, 2) == nullptr);
+
+    // The string is kept as given, so it is never serialized again.
+    CHECK_THAT(ADUC_ComponentSet_PeekString(componentSet), Equals(selected_components));
+
+    // The same component object is returned every time.
+    CHECK(ADUC_ComponentSet_GetComponent(componentSet, 1) == ADUC_ComponentSet_GetComponent(componentSet, 1));
+
+    ADUC_ComponentSet_Release(componentSet);
+}
+
+TEST_CASE("ADUC_ComponentSet single-component sets")
+{
+    ADUC_ComponentSet* componentSet = ADUC_ComponentSet_CreateFromString(selected_components);
+    REQUIRE(componentSet != nullptr);
+
+    ADUC_ComponentSet* single = ADUC_ComponentSet_CreateSingle(componentSet, 0);
+    REQUIRE(single != nullptr);
+
+    SECTION("Share the component of the whole set")
+    {
+        CHECK(ADUC_ComponentSet_IsValid(single));
+        CHECK(ADUC_ComponentSet_GetCount(single) == 1);
+        CHECK(ADUC_ComponentSet_GetComponent(single, 0) == ADUC_ComponentSet_GetComponent(componentSet, 0));
+        CHECK(ADUC_ComponentSet_GetComponent(single, 1) == nullptr);
+    }
+
+    SECTION("Serialize as a set of one component, only when asked")
+    {
+        const char* singleString = ADUC_ComponentSet_PeekString(single);
+        REQUIRE(singleString != nullptr);
+        CHECK(ADUC_ComponentSet_PeekString(single) == singleString);
+
+        JSON_Value* value = json_parse_string(singleString);
+        JSON_Array* components = json_object_get_array(json_object(value), "components");
+        REQUIRE(json_array_get_count(components) == 1);
+        CHECK_THAT(json_object_get_string(json_array_get_object(components, 0), "name"), Equals("left-motor"));
+        CHECK_THAT(
+            json_object_dotget_string(json_array_get_object(components, 0), "properties.path"), Equals("/tmp/left"));
+        json_value_free(value);
+    }
+
+    SECTION("Outlive the set they are made from")
+    {
+        ADUC_ComponentSet* singleOfSingle = ADUC_ComponentSet_CreateSingle(single, 0);
+        REQUIRE(singleOfSingle != nullptr);
+        CHECK(ADUC_ComponentSet_CreateSingle(single, 1) == nullptr);
+
+        ADUC_ComponentSet_Release(componentSet);
+        componentSet = nullptr;
+        ADUC_ComponentSet_Release(single);
+        single = nullptr;
+
+        CHECK(GetComponentId(singleOfSingle, 0) == "0");
+        ADUC_ComponentSet_Release(singleOfSingle);
+    }
+
+    ADUC_ComponentSet_Release(single);
+    ADUC_ComponentSet_Release(componentSet);
+}
+
+TEST_CASE("ADUC_ComponentSet invalid selected components")
+{
+    CHECK(ADUC_ComponentSet_CreateFromString(nullptr) == nullptr);
+    CHECK_FALSE(ADUC_ComponentSet_IsValid(nullptr));
+    CHECK(ADUC_ComponentSet_GetCount(nullptr) == 0);
+    CHECK(ADUC_ComponentSet_PeekString(nullptr) == nullptr);
+
+    for (const char* json : { "", "not json", "[]", R"({ "devices": [] })" })
+    {
+        ADUC_ComponentSet* componentSet = ADUC_ComponentSet_CreateFromString(json);
+        REQUIRE(componentSet != nullptr);
+
+        CHECK_FALSE(ADUC_ComponentSet_IsValid(componentSet));
+        CHECK(ADUC_ComponentSet_GetCount(componentSet) == 0);
+        CHECK(ADUC_ComponentSet_CreateSingle(componentSet, 0) == nullptr);
+        CHECK_THAT(ADUC_ComponentSet_PeekString(componentSet), Equals(json));
+
+        ADUC_ComponentSet_Release(componentSet);
+    }
+}
+
+TEST_CASE("Workflows share their selected components")
+{
+    ADUC_WorkflowHandle parent = nullptr;
+    ADUC_WorkflowHandle child = nullptr;
+
+    REQUIRE(IsAducResultCodeSuccess(workflow_init(action_components_update, false, &parent).ResultCode));
+    REQUIRE(IsAducResultCodeSuccess(workflow_init(action_components_update, false, &child).ResultCode));
+
+    CHECK(workflow_peek_selected_component_set(parent) == nullptr);
+    CHECK(workflow_peek_selected_components(parent) == nullptr);
+
+    REQUIRE(workflow_set_selected_components(parent, selected_components));
+    ADUC_ComponentSet* parentSet = workflow_peek_selected_component_set(parent);
+    REQUIRE(parentSet != nullptr);
+    CHECK_THAT(workflow_peek_selected_components(parent), Equals(selected_components));
+
+    SECTION("A child borrows the parent's set")
+    {
+        REQUIRE(workflow_set_selected_component_set(child, parentSet));
+        CHECK(workflow_peek_selected_component_set(child) == parentSet);
+
+        // Replacing the parent's components does not change the child's.
+        REQUIRE(workflow_set_selected_components(parent, R"({ "components": [] })"));
+        CHECK(ADUC_ComponentSet_GetCount(workflow_peek_selected_component_set(child)) == 2);
+        CHECK_THAT(workflow_peek_selected_components(child), Equals(selected_components));
+    }
+
+    SECTION("A child is given one component of the parent's set")
+    {
+        ADUC_ComponentSet* single = ADUC_ComponentSet_CreateSingle(parentSet, 1);
+        REQUIRE(workflow_set_selected_component_set(child, single));
+        ADUC_ComponentSet_Release(single);
+
+        // Setting the same set again keeps it.
+        REQUIRE(workflow_set_selected_component_set(child, workflow_peek_selected_component_set(child)));
+
+        JSON_Value* value = json_parse_string(workflow_peek_selected_components(child));
+        JSON_Array* components = json_object_get_array(json_object(value), "components");
+        REQUIRE(json_array_get_count(components) == 1);
+        CHECK_THAT(json_object_get_string(json_array_get_object(components, 0), "name"), Equals("right-motor"));
+        json_value_free(value);
+    }
+
+    SECTION("Clearing the selected components")
+    {
+        REQUIRE(workflow_set_selected_components(parent, nullptr));
+        CHECK(workflow_peek_selected_component_set(parent) == nullptr);
+        CHECK(workflow_peek_selected_components(parent) == nullptr);
+    }
+
+    workflow_free(child);
+    workflow_free(parent);
+}
@@ -258,6 +258,69 @@ TEST_CASE("Get update file by name - mixed case")
     workflow_free(bundle);
 }
 
+TEST_CASE("Peek update files")
+{
+    ADUC_WorkflowHandle bundle = nullptr;
+    ADUC_Result result = workflow_init(action_parent_update, false /* validateManifest */, &bundle);
+    REQUIRE(result.ResultCode != 0);
+
+    const ADUC_FileEntity* file0 = workflow_peek_update_file(bundle, 0);
+    REQUIRE(file0 != nullptr);
+    CHECK_THAT(file0->FileId, Equals("f483750ebb885d32c"));
+    CHECK_THAT(file0->TargetFilename, Equals("apt-manifest-tree-1.0.json"));
+    CHECK(file0->SizeInBytes == 136);
+    REQUIRE(file0->HashCount == 1);
+    CHECK_THAT(file0->Hash[0].type, Equals("sha256"));
+    CHECK_THAT(file0->Hash[0].value, Equals("Uk1vsEL/nT4btMngo0YSJjheOL2aqm6/EAFhzPb0rXs="));
+    CHECK_THAT(
+        file0->DownloadUri,
+        Equals(
+            "http://duinstance2.b.nlu.dl.adu.microsoft.com/westus2/duinstance2/e5cc19d5e9174c93ada35cc315f1fb1d/apt-manifest-tree-1.0.json"));
+
+    // Views are not copies.
+    CHECK(workflow_peek_update_file(bundle, 0) == file0);
+    CHECK(workflow_peek_update_file_by_id(bundle, "f483750ebb885d32c") == file0);
+    CHECK(workflow_peek_update_file_by_name(bundle, "APT-manifest-tree-1.0.json") == file0);
+
+    const ADUC_FileEntity* file1 = workflow_peek_update_file(bundle, 1);
+    REQUIRE(file1 != nullptr);
+    CHECK_THAT(file1->FileId, Equals("f222b9ffefaaac577"));
+
+    CHECK(workflow_peek_update_file(bundle, 2) == nullptr);
+    CHECK(workflow_peek_update_file_by_id(bundle, "F483750EBB885D32C") == nullptr);
+    CHECK(workflow_peek_update_file_by_name(bundle, "missing.json") == nullptr);
+
+    CHECK(workflow_get_instructions_steps_count(bundle) == 2);
+    CHECK_FALSE(workflow_is_inline_step(bundle, 1));
+    CHECK_THAT(workflow_peek_update_manifest_step_handler(bundle, 0), Equals("microsoft/apt:1"));
+
+    ADUC_FileEntity detachedManifestFile;
+    memset(&detachedManifestFile, 0, sizeof(detachedManifestFile));
+    REQUIRE(workflow_get_step_detached_manifest_file(bundle, 1, &detachedManifestFile));
+    CHECK_THAT(detachedManifestFile.FileId, Equals("f222b9ffefaaac577"));
+    CHECK(detachedManifestFile.FileId != file1->FileId);
+    ADUC_FileEntity_Uninit(&detachedManifestFile);
+
+    // The child workflow has no 'fileUrls' of its own until it is inserted in the bundle.
+    ADUC_WorkflowHandle leaf0 = nullptr;
+    result = workflow_init(action_child_update_0, false /* validateManifest */, &leaf0);
+    REQUIRE(result.ResultCode != 0);
+
+    CHECK(workflow_get_update_files_count(leaf0) == 2);
+    CHECK(workflow_peek_update_file(leaf0, 0) == nullptr);
+
+    workflow_insert_child(bundle, 0, leaf0);
+
+    const ADUC_FileEntity* leafFile0 = workflow_peek_update_file_by_name(leaf0, "contoso-motor-installscript.sh");
+    REQUIRE(leafFile0 != nullptr);
+    CHECK_THAT(
+        leafFile0->DownloadUri,
+        Equals(
+            "http://duinstance2.b.nlu.dl.adu.microsoft.com/westus2/duinstance2/c02058a476a242d7bc0e3c576c180051/contoso-motor-installscript.sh"));
+
+    workflow_free(bundle);
+}
+
 TEST_CASE("Add and remove children")
 {
     ADUC_WorkflowHandle handle = nullptr;